@@ -26,6 +26,22 @@
 #include "convert.h"
 
 #pragma comment(lib,"Strmiids.lib") 
+
+// The formats asked of the camera, in order: the YUV ones that the encoder
+// takes as they are, then RGB24 (converted to YUV420 for every frame)
+static const struct
+{
+    const GUID* pSubtype;
+    ECamPixelFormat eFormat;
+    bool bRGB;
+} s_formats[] =
+{
+    { &MEDIASUBTYPE_NV12,  CAM_PIX_NV12, false },
+    { &MEDIASUBTYPE_YUY2,  CAM_PIX_YUYV, false },
+    { &MEDIASUBTYPE_IYUV,  CAM_PIX_I420, false },
+    { &MEDIASUBTYPE_RGB24, CAM_PIX_I420, true },
+};
+static const int NUM_FORMATS = sizeof(s_formats) / sizeof(s_formats[0]);
 //////////////////////////////////////////////////////////////////////
 // Construction/Destruction
 //////////////////////////////////////////////////////////////////////
@@ -42,6 +58,9 @@ CCameraDS::CCameraDS()
     m_pYUVData = NULL;
 	m_pImgData = NULL;
     m_nBufferSize = 0;
+    m_llGrabTime = 0;
+    m_eFormat = CAM_PIX_I420;
+    m_bRGB = true;
 
     m_pNullFilter = NULL;
     m_pMediaEvent = NULL;
@@ -95,6 +114,8 @@ void CCameraDS::CloseCamera()
     m_bLock = false;
     m_bChanged = false;
     m_nBufferSize = 0;
+    m_eFormat = CAM_PIX_I420;
+    m_bRGB = true;
 }
 
 bool CCameraDS::OpenCamera(int nCamID, int nWidth, int nHeight)
@@ -134,12 +155,6 @@ bool CCameraDS::OpenCamera(int nCamID, int nWidth, int nHeight)
     hr = m_pSampleGrabberFilter->QueryInterface(IID_ISampleGrabber, (void**)&m_pSampleGrabber);
 
     AM_MEDIA_TYPE   mt;
-    ZeroMemory(&mt, sizeof(AM_MEDIA_TYPE));
-    mt.majortype = MEDIATYPE_Video;
-    mt.subtype = MEDIASUBTYPE_RGB24;
-    mt.formattype = FORMAT_VideoInfo; 
-    hr = m_pSampleGrabber->SetMediaType(&mt);
-    MYFREEMEDIATYPE(mt);
 
     m_pGraph->AddFilter(m_pSampleGrabberFilter, L"Grabber");
  
@@ -231,7 +246,23 @@ bool CCameraDS::OpenCamera(int nCamID, int nWidth, int nHeight)
         MYFREEMEDIATYPE(*pmt);
     }
 
-    hr = m_pGraph->Connect(m_pCameraOutput, m_pGrabberInput);
+    for (int i = 0; i < NUM_FORMATS; i++)
+    {
+        ZeroMemory(&mt, sizeof(AM_MEDIA_TYPE));
+        mt.majortype = MEDIATYPE_Video;
+        mt.subtype = *s_formats[i].pSubtype;
+        mt.formattype = FORMAT_VideoInfo; 
+        hr = m_pSampleGrabber->SetMediaType(&mt);
+        MYFREEMEDIATYPE(mt);
+
+        hr = m_pGraph->Connect(m_pCameraOutput, m_pGrabberInput);
+        if (SUCCEEDED(hr))
+        {
+            m_eFormat = s_formats[i].eFormat;
+            m_bRGB = s_formats[i].bRGB;
+            break;
+        }
+    }
     hr = m_pGraph->Connect(m_pGrabberOutput, m_pNullInputPin);
 
     if (FAILED(hr))
@@ -260,13 +291,14 @@ bool CCameraDS::OpenCamera(int nCamID, int nWidth, int nHeight)
     videoHeader = reinterpret_cast<VIDEOINFOHEADER*>(mt.pbFormat);
     m_nWidth = videoHeader->bmiHeader.biWidth;
     m_nHeight = videoHeader->bmiHeader.biHeight;
+    MYFREEMEDIATYPE(mt);
     m_bConnected = true;
 
     pEnum = NULL;
     
     //ʼRGB->YUV
     RGBYUVConvert::InitLookupTable();
-    m_pYUVData = new unsigned char[nWidth*nHeight + nWidth*nHeight/2];
+    m_pYUVData = new unsigned char[m_nWidth*m_nHeight + m_nWidth*m_nHeight/2];
     
     return true;
 }
@@ -387,10 +419,8 @@ void CCameraDS::SetCrossBar()
     pBuilder->Release();
 }
 
-/*
-The returned image can not be released.
-*/
-unsigned char* CCameraDS::QueryFrame()
+// Grab a frame into m_pImgData; false unless it holds a whole one
+bool CCameraDS::Grab()
 {
 
     long evCode;
@@ -412,12 +442,83 @@ unsigned char* CCameraDS::QueryFrame()
 
     m_pSampleGrabber->GetCurrentBuffer(&m_nBufferSize, (long*)m_pImgData);
 
+    LARGE_INTEGER grabTime;
+    QueryPerformanceCounter(&grabTime);
+    m_llGrabTime = grabTime.QuadPart;
+
+    long lFrameSize = m_bRGB ? m_nWidth*m_nHeight*3
+        : m_eFormat == CAM_PIX_YUYV ? m_nWidth*m_nHeight*2
+        : m_nWidth*m_nHeight*3/2;
+    return m_nBufferSize >= lFrameSize;
+}
+
+/*
+The returned image can not be released.
+*/
+unsigned char* CCameraDS::QueryFrame()
+{
+    if (!Grab())
+    {
+        return NULL;
+    }
+
     //convert to YUV
-    RGBYUVConvert::ConvertRGB2YUV(m_nWidth, m_nHeight, m_pImgData, m_pYUVData);
+    if (m_bRGB)
+    {
+        RGBYUVConvert::ConvertRGB2YUV(m_nWidth, m_nHeight, m_pImgData, m_pYUVData);
+    }
+    else if (m_eFormat == CAM_PIX_NV12)
+    {
+        RGBYUVConvert::ConvertNV12ToYUV(m_nWidth, m_nHeight, m_pImgData, m_pYUVData);
+    }
+    else if (m_eFormat == CAM_PIX_YUYV)
+    {
+        RGBYUVConvert::ConvertYUYVToYUV(m_nWidth, m_nHeight, m_pImgData, m_pYUVData);
+    }
+    else
+    {
+        return m_pImgData;
+    }
 
     return m_pYUVData;
 }
 
+bool CCameraDS::QueryFrame(TCamFrame& frame)
+{
+    if (m_bRGB)
+    {
+        return ICameraCaptuer::QueryFrame(frame);
+    }
+    if (!Grab())
+    {
+        return false;
+    }
+
+    frame.eFormat = m_eFormat;
+    frame.iWidth = m_nWidth;
+    frame.iHeight = m_nHeight;
+    frame.pPlane[0] = m_pImgData;
+    frame.pPlane[1] = frame.pPlane[2] = NULL;
+    frame.iStride[1] = frame.iStride[2] = 0;
+    switch (m_eFormat)
+    {
+    case CAM_PIX_NV12:
+        frame.iStride[0] = frame.iStride[1] = m_nWidth;
+        frame.pPlane[1] = m_pImgData + m_nWidth*m_nHeight;
+        break;
+    case CAM_PIX_YUYV:
+        frame.iStride[0] = m_nWidth*2;
+        break;
+    default:
+        frame.iStride[0] = m_nWidth;
+        frame.iStride[1] = frame.iStride[2] = m_nWidth/2;
+        frame.pPlane[1] = m_pImgData + m_nWidth*m_nHeight;
+        frame.pPlane[2] = frame.pPlane[1] + m_nWidth*m_nHeight/4;
+        break;
+    }
+    return true;
+}
+
 int CCameraDS::CameraCount()
 {
 
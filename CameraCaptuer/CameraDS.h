@@ -60,14 +60,17 @@ class CCameraDS: public ICameraCaptuer
 {
 private:
     //IplImage * m_pFrame;
-    unsigned char* m_pImgData; // RGB
+    unsigned char* m_pImgData; // as the camera gives it (see m_eFormat)
     unsigned char* m_pYUVData; // YUV
+    ECamPixelFormat m_eFormat; // of m_pImgData, unless m_bRGB
+    bool m_bRGB; // no YUV format to be had: RGB24, converted for every frame
     bool m_bConnected;
     int m_nWidth;
     int m_nHeight;
     bool m_bLock;
     bool m_bChanged;
     long m_nBufferSize;
+    long long m_llGrabTime; // see GetLastGrabTime()
 
     CComPtr<IGraphBuilder> m_pGraph;
     CComPtr<IBaseFilter> m_pDeviceFilter;
@@ -86,6 +89,7 @@ private:
 private:
     bool BindFilter(int nCamIDX, IBaseFilter **pFilter);
     void SetCrossBar();
+    bool Grab();
 
 public:
     //jiangqi:  ҪnCamID캯ĲʹһCCameraDSֻһͷ
@@ -120,6 +124,12 @@ public:
     //ץȡһ֡صIplImageֶͷţ
     //ͼݵΪRGBģʽTop-down(һֽΪϽ)IplImage::origin=0(IPL_ORIGIN_TL)
     unsigned  char * QueryFrame();
+
+    // The frame as the camera gives it - NV12, YUYV or I420, whichever it could
+    // connect with - without conversion; I420 converted from RGB24 otherwise
+    bool QueryFrame(TCamFrame& frame);
+
+    long long GetLastGrabTime() { return m_llGrabTime; }
 };
 
 #endif 
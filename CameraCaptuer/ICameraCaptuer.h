@@ -3,6 +3,25 @@
 
 #include "DllManager.h"
 
+// The pixel formats that a frame can come in
+enum ECamPixelFormat
+{
+    CAM_PIX_I420, // Y, then U and V planes at half the width and height
+    CAM_PIX_NV12, // Y, then one plane of U and V packed together (UVUV...)
+    CAM_PIX_YUYV  // one packed plane, YUYV (4:2:2)
+};
+
+// A frame as the camera gave it, without conversion: its planes (NULL past
+// the last one) and their strides in bytes. Valid until the next QueryFrame().
+struct TCamFrame
+{
+    ECamPixelFormat eFormat;
+    int iWidth;
+    int iHeight;
+    unsigned char* pPlane[3];
+    int iStride[3];
+};
+
 class DLL_EXPORT ICameraCaptuer
 {
 public:
@@ -18,6 +37,32 @@ public:
     virtual int GetHeight() = 0;
 
     virtual unsigned  char * QueryFrame() = 0;
+
+    // Grab a frame in the camera's own pixel format, saving the conversion to
+    // I420 that QueryFrame() does, for a consumer (like x264) that can read it
+    // as it is. The default is QueryFrame()'s I420.
+    virtual bool QueryFrame(TCamFrame& frame)
+    {
+        unsigned char* pData = QueryFrame();
+        if (!pData)
+        {
+            return false;
+        }
+        int iWidth = GetWidth(), iHeight = GetHeight();
+        frame.eFormat = CAM_PIX_I420;
+        frame.iWidth = iWidth;
+        frame.iHeight = iHeight;
+        frame.pPlane[0] = pData;
+        frame.pPlane[1] = pData + iWidth * iHeight;
+        frame.pPlane[2] = frame.pPlane[1] + iWidth * iHeight / 4;
+        frame.iStride[0] = iWidth;
+        frame.iStride[1] = frame.iStride[2] = iWidth / 2;
+        return true;
+    }
+
+    // When the last QueryFrame() had the camera's image, before converting it
+    // to YUV, in QueryPerformanceCounter() ticks; 0 if the camera can't tell
+    virtual long long GetLastGrabTime() { return 0; }
 };
 
 class DLL_EXPORT CamCaptuerMgr
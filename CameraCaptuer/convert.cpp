@@ -16,6 +16,7 @@
 
 //#include "stdafx.h"
 #include "convert.h"
+#include <string.h>
 
 // Conversion from RGB to YUV420
 int RGB2YUV_YR[256], RGB2YUV_YG[256], RGB2YUV_YB[256];
@@ -184,6 +185,51 @@ int RGBYUVConvert::ConvertRGB2YUV(int w,int h,unsigned char *bmp,unsigned char *
     return 1;
 }
 
+//
+// Convert from NV12 to YUV420
+//
+void RGBYUVConvert::ConvertNV12ToYUV(int w,int h,unsigned char *nv12, unsigned char *yuv)
+{
+    unsigned char *uv = nv12 + w*h;
+    unsigned char *u = yuv + w*h;
+    unsigned char *v = u + w*h/4;
+    int i;
+
+    memcpy(yuv, nv12, w*h);
+    for(i=0;i<w*h/4;i++)
+    {
+        u[i] = uv[2*i];
+        v[i] = uv[2*i+1];
+    }
+}
+
+//
+// Convert from YUYV to YUV420
+//
+void RGBYUVConvert::ConvertYUYVToYUV(int w,int h,unsigned char *yuyv, unsigned char *yuv)
+{
+    unsigned char *y = yuv;
+    unsigned char *u = yuv + w*h;
+    unsigned char *v = u + w*h/4;
+    int i,j;
+
+    for(i=0;i<h;i+=2)
+    {
+        unsigned char *row0 = yuyv + i*w*2;
+        unsigned char *row1 = row0 + w*2;
+        for(j=0;j<w;j+=2)
+        {
+            y[j]     = row0[2*j];
+            y[j+1]   = row0[2*j+2];
+            y[j+w]   = row1[2*j];
+            y[j+w+1] = row1[2*j+2];
+            *u++ = (row0[2*j+1] + row1[2*j+1] + 1) >> 1;
+            *v++ = (row0[2*j+3] + row1[2*j+3] + 1) >> 1;
+        }
+        y += 2*w;
+    }
+}
+
 //
 //Initialize conversion table for YUV420 to RGB
 //
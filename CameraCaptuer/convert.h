@@ -26,6 +26,12 @@ public:
     static void InitLookupTable();
     static int  ConvertRGB2YUV(int w,int h,unsigned char *rgbdata, unsigned char *yuv);
 
+    // Conversion from the YUV formats that cameras deliver to YUV420 (I420):
+    // NV12 (Y plane, then U and V packed together) and YUYV (4:2:2 packed,
+    // the U and V of each pair of rows averaged)
+    static void ConvertNV12ToYUV(int w,int h,unsigned char *nv12, unsigned char *yuv);
+    static void ConvertYUYVToYUV(int w,int h,unsigned char *yuyv, unsigned char *yuv);
+
 
     // Conversion from YUV420 to RGB24
     static void InitConvertTable();
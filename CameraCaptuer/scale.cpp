@@ -0,0 +1,253 @@
+//////////////////////////////////////////////////////////////////////
+// scale.cpp
+// Polyphase scaling of I420 pictures
+//
+// Each plane is filtered vertically first - every output row from the
+// input rows around it, at the input width - and then horizontally. The
+// vertical pass, where every pixel of a row has the same weights, is done
+// 8 pixels at a time with SSE2 where the compiler targets it; the
+// horizontal pass, over the (fewer) output pixels, a pixel at a time.
+//////////////////////////////////////////////////////////////////////
+
+#include "scale.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#if defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2) || defined(__SSE2__)
+#include <emmintrin.h>
+#define SCALE_SSE2
+#endif
+
+#define COEF_BITS 14 // the weights are Q14
+#define ROW_BITS 6   // the vertically filtered row is Q6
+#define MAX_TAPS 64  // enough for scaling down 16:1
+
+// Catmull-Rom: sharp, but without much ringing
+static double Cubic(double x)
+{
+    if (x < 0) x = -x;
+    if (x < 1) return 1.5 * x * x * x - 2.5 * x * x + 1;
+    if (x < 2) return -0.5 * x * x * x + 2.5 * x * x - 4 * x + 2;
+    return 0;
+}
+
+YUVScaler::YUVScaler()
+{
+    m_iSrcWidth = m_iSrcHeight = m_iDstWidth = m_iDstHeight = 0;
+    memset(m_horz, 0, sizeof(m_horz));
+    memset(m_vert, 0, sizeof(m_vert));
+    m_pRow = NULL;
+}
+
+YUVScaler::~YUVScaler()
+{
+    Clean();
+}
+
+void YUVScaler::Clean()
+{
+    for (int i = 0; i < 2; i++)
+    {
+        FreeFilter(m_horz[i]);
+        FreeFilter(m_vert[i]);
+    }
+    delete[] m_pRow;
+    m_pRow = NULL;
+    m_iSrcWidth = m_iSrcHeight = m_iDstWidth = m_iDstHeight = 0;
+}
+
+bool YUVScaler::Init(int iSrcWidth, int iSrcHeight, int iDstWidth, int iDstHeight)
+{
+    Clean();
+    if (iSrcWidth <= 0 || iSrcHeight <= 0 || iDstWidth <= 0 || iDstHeight <= 0
+        || (iSrcWidth | iSrcHeight | iDstWidth | iDstHeight) & 1)
+    {
+        return false;
+    }
+
+    for (int i = 0; i < 2; i++)
+    {
+        if (!InitFilter(m_horz[i], iSrcWidth >> i, iDstWidth >> i)
+            || !InitFilter(m_vert[i], iSrcHeight >> i, iDstHeight >> i))
+        {
+            Clean();
+            return false;
+        }
+    }
+    m_pRow = new short[iSrcWidth];
+
+    m_iSrcWidth = iSrcWidth;
+    m_iSrcHeight = iSrcHeight;
+    m_iDstWidth = iDstWidth;
+    m_iDstHeight = iDstHeight;
+    return true;
+}
+
+bool YUVScaler::InitFilter(TFilter& filter, int iSrcSize, int iDstSize)
+{
+    // The filter reaches 2 pixels either side - of the output, when scaling
+    // down - and its weights are worked out afresh for each output pixel's
+    // phase (its center's position between two input pixels)
+    double dScale = (double)iSrcSize / iDstSize;
+    double dStretch = dScale > 1 ? dScale : 1;
+    double dSupport = 2 * dStretch;
+    filter.iTaps = (int)ceil(2 * dSupport);
+    if (filter.iTaps > MAX_TAPS)
+    {
+        filter.iTaps = 0;
+        return false;
+    }
+    filter.pIndex = new int[iDstSize * filter.iTaps];
+    filter.pCoef = new short[iDstSize * filter.iTaps];
+    double* pWeight = new double[filter.iTaps];
+
+    for (int i = 0; i < iDstSize; i++)
+    {
+        double dCenter = (i + 0.5) * dScale - 0.5;
+        int iFirst = (int)floor(dCenter - dSupport) + 1;
+        double dSum = 0;
+        int k;
+        for (k = 0; k < filter.iTaps; k++)
+        {
+            pWeight[k] = Cubic((iFirst + k - dCenter) / dStretch);
+            dSum += pWeight[k];
+        }
+
+        // Normalized, so that a flat area stays flat, rounding errors and all
+        int* pIndex = &filter.pIndex[i * filter.iTaps];
+        short* pCoef = &filter.pCoef[i * filter.iTaps];
+        int iTotal = 0, iLargest = 0;
+        for (k = 0; k < filter.iTaps; k++)
+        {
+            int iPos = iFirst + k;
+            pIndex[k] = iPos < 0 ? 0 : iPos >= iSrcSize ? iSrcSize - 1 : iPos;
+            pCoef[k] = (short)floor(pWeight[k] / dSum * (1 << COEF_BITS) + 0.5);
+            iTotal += pCoef[k];
+            if (pCoef[k] > pCoef[iLargest])
+            {
+                iLargest = k;
+            }
+        }
+        pCoef[iLargest] += (short)((1 << COEF_BITS) - iTotal);
+    }
+
+    delete[] pWeight;
+    return true;
+}
+
+void YUVScaler::FreeFilter(TFilter& filter)
+{
+    delete[] filter.pIndex;
+    delete[] filter.pCoef;
+    filter.pIndex = NULL;
+    filter.pCoef = NULL;
+    filter.iTaps = 0;
+}
+
+void YUVScaler::Scale(const unsigned char* const pSrc[3], const int iSrcStride[3],
+                      unsigned char* const pDst[3], const int iDstStride[3])
+{
+    for (int i = 0; i < 3; i++)
+    {
+        ScalePlane(i, pSrc[i], iSrcStride[i], pDst[i], iDstStride[i]);
+    }
+}
+
+void YUVScaler::Scale(const unsigned char* pSrc, unsigned char* pDst)
+{
+    const unsigned char* pSrcPlane[3];
+    unsigned char* pDstPlane[3];
+    int iSrcStride[3], iDstStride[3];
+
+    pSrcPlane[0] = pSrc;
+    pSrcPlane[1] = pSrcPlane[0] + m_iSrcWidth * m_iSrcHeight;
+    pSrcPlane[2] = pSrcPlane[1] + m_iSrcWidth * m_iSrcHeight / 4;
+    pDstPlane[0] = pDst;
+    pDstPlane[1] = pDstPlane[0] + m_iDstWidth * m_iDstHeight;
+    pDstPlane[2] = pDstPlane[1] + m_iDstWidth * m_iDstHeight / 4;
+    iSrcStride[0] = m_iSrcWidth;
+    iSrcStride[1] = iSrcStride[2] = m_iSrcWidth / 2;
+    iDstStride[0] = m_iDstWidth;
+    iDstStride[1] = iDstStride[2] = m_iDstWidth / 2;
+    Scale(pSrcPlane, iSrcStride, pDstPlane, iDstStride);
+}
+
+void YUVScaler::ScalePlane(int iPlane, const unsigned char* pSrc, int iSrcStride,
+                           unsigned char* pDst, int iDstStride)
+{
+    const int iChroma = iPlane > 0;
+    const int iSrcWidth = m_iSrcWidth >> iChroma;
+    const int iDstWidth = m_iDstWidth >> iChroma, iDstHeight = m_iDstHeight >> iChroma;
+    const TFilter& horz = m_horz[iChroma];
+    const TFilter& vert = m_vert[iChroma];
+    const unsigned char* pRows[MAX_TAPS];
+    const int iRound = 1 << (COEF_BITS - ROW_BITS - 1);
+
+    for (int y = 0; y < iDstHeight; y++)
+    {
+        // Vertically: the input rows around this one, at the input width
+        const int* pIndex = &vert.pIndex[y * vert.iTaps];
+        const short* pCoef = &vert.pCoef[y * vert.iTaps];
+        const int iTaps = vert.iTaps;
+        int k, x = 0;
+        for (k = 0; k < iTaps; k++)
+        {
+            pRows[k] = pSrc + pIndex[k] * iSrcStride;
+        }
+#if defined(SCALE_SSE2)
+        const __m128i zero = _mm_setzero_si128();
+        for (; x + 8 <= iSrcWidth; x += 8)
+        {
+            // Rows in pairs: (a, b) interleaved, times (coef a, coef b), is
+            // one madd to 32 bits
+            __m128i lo = _mm_set1_epi32(iRound), hi = lo;
+            for (k = 0; k < iTaps; k += 2)
+            {
+                __m128i a = _mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i*)(pRows[k] + x)), zero);
+                __m128i b = zero;
+                int iCoefB = 0;
+                if (k + 1 < iTaps)
+                {
+                    b = _mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i*)(pRows[k + 1] + x)), zero);
+                    iCoefB = pCoef[k + 1];
+                }
+                __m128i coef = _mm_set1_epi32((unsigned short)pCoef[k] | (iCoefB << 16));
+                lo = _mm_add_epi32(lo, _mm_madd_epi16(_mm_unpacklo_epi16(a, b), coef));
+                hi = _mm_add_epi32(hi, _mm_madd_epi16(_mm_unpackhi_epi16(a, b), coef));
+            }
+            lo = _mm_srai_epi32(lo, COEF_BITS - ROW_BITS);
+            hi = _mm_srai_epi32(hi, COEF_BITS - ROW_BITS);
+            _mm_storeu_si128((__m128i*)(m_pRow + x), _mm_packs_epi32(lo, hi));
+        }
+#endif
+        for (; x < iSrcWidth; x++)
+        {
+            int iSum = iRound;
+            for (k = 0; k < iTaps; k++)
+            {
+                iSum += pCoef[k] * pRows[k][x];
+            }
+            iSum >>= COEF_BITS - ROW_BITS;
+            m_pRow[x] = (short)(iSum < -32768 ? -32768 : iSum > 32767 ? 32767 : iSum);
+        }
+
+        // Horizontally, from that row
+        unsigned char* pOut = pDst + y * iDstStride;
+        pIndex = horz.pIndex;
+        pCoef = horz.pCoef;
+        for (x = 0; x < iDstWidth; x++)
+        {
+            int iSum = 1 << (COEF_BITS + ROW_BITS - 1);
+            for (k = 0; k < horz.iTaps; k++)
+            {
+                iSum += pCoef[k] * m_pRow[pIndex[k]];
+            }
+            iSum >>= COEF_BITS + ROW_BITS;
+            pOut[x] = (unsigned char)(iSum < 0 ? 0 : iSum > 255 ? 255 : iSum);
+            pIndex += horz.iTaps;
+            pCoef += horz.iTaps;
+        }
+    }
+}
@@ -0,0 +1,60 @@
+//////////////////////////////////////////////////////////////////////
+// scale.h
+// Polyphase scaling of I420 pictures: one camera picture scaled, once
+// per frame, for each of the sizes that it's encoded at
+//////////////////////////////////////////////////////////////////////
+
+#ifndef _SCALE_H_
+#define _SCALE_H_
+
+#include "DllManager.h"
+
+class DLL_EXPORT YUVScaler
+{
+public:
+    YUVScaler();
+    ~YUVScaler();
+
+    // Set up the filters for iSrcWidth x iSrcHeight -> iDstWidth x iDstHeight
+    // (all even). Each output pixel is a bicubic (Catmull-Rom) weighting of
+    // the input pixels around it, the filter widened by the scale factor when
+    // scaling down, so that detail finer than the output can hold is averaged
+    // out rather than aliased. Returns false if a size is invalid, or if it
+    // would scale down by more than 16:1.
+    bool Init(int iSrcWidth, int iSrcHeight, int iDstWidth, int iDstHeight);
+
+    // Scale one picture, given each plane (Y, U, V) and its stride in bytes
+    void Scale(const unsigned char* const pSrc[3], const int iSrcStride[3],
+               unsigned char* const pDst[3], const int iDstStride[3]);
+    // ... or as contiguous I420 buffers
+    void Scale(const unsigned char* pSrc, unsigned char* pDst);
+
+    int GetSrcWidth() const { return m_iSrcWidth; }
+    int GetSrcHeight() const { return m_iSrcHeight; }
+    int GetDstWidth() const { return m_iDstWidth; }
+    int GetDstHeight() const { return m_iDstHeight; }
+
+private:
+    // The weights of one pass (horizontal or vertical) of one plane: output
+    // pixel i is the sum over k < iTaps of pCoef[i*iTaps+k] (Q14) times input
+    // pixel pIndex[i*iTaps+k] (edge pixels repeated)
+    struct TFilter
+    {
+        int iTaps;
+        int* pIndex;
+        short* pCoef;
+    };
+
+    static bool InitFilter(TFilter& filter, int iSrcSize, int iDstSize);
+    static void FreeFilter(TFilter& filter);
+    void ScalePlane(int iPlane, const unsigned char* pSrc, int iSrcStride,
+                    unsigned char* pDst, int iDstStride);
+    void Clean();
+
+    int m_iSrcWidth, m_iSrcHeight;
+    int m_iDstWidth, m_iDstHeight;
+    TFilter m_horz[2], m_vert[2]; // luma, chroma
+    short* m_pRow; // one vertically filtered row, at the input width (Q6)
+};
+
+#endif
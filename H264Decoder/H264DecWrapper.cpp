@@ -1,6 +1,13 @@
 
 #include "H264DecWrapper.h"
 
+#if defined(_WIN32) || defined(WIN32)
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#else
+#include <sys/time.h>
+#endif
+
 extern "C" 
 {
 #include "avcodec.h"
@@ -12,6 +19,49 @@ extern "C"
 extern AVCodec h264_decoder;
 }
 
+// Wall clock in microseconds; decode time under CPU pressure includes the time
+// this thread was preempted, which is exactly what load shedding should react to
+static long long NowUs()
+{
+#if defined(_WIN32) || defined(WIN32)
+    static LARGE_INTEGER freq;
+    LARGE_INTEGER now;
+    if (freq.QuadPart == 0)
+        QueryPerformanceFrequency(&freq);
+    QueryPerformanceCounter(&now);
+    return now.QuadPart * 1000000 / freq.QuadPart;
+#else
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return (long long)tv.tv_sec * 1000000 + tv.tv_usec;
+#endif
+}
+
+static int ToAVDiscard(EDecSkip eSkip)
+{
+    switch (eSkip)
+    {
+    case DEC_SKIP_NONREF: return AVDISCARD_NONREF;
+    case DEC_SKIP_BIDIR:  return AVDISCARD_BIDIR;
+    case DEC_SKIP_NONKEY: return AVDISCARD_NONKEY;
+    case DEC_SKIP_ALL:    return AVDISCARD_ALL;
+    default:              return AVDISCARD_DEFAULT;
+    }
+}
+
+// What each automatic level skips: loop filter, frames
+static const EDecSkip s_autoSkip[DEC_SKIP_LEVEL_MAX + 1][2] =
+{
+    { DEC_SKIP_NONE,   DEC_SKIP_NONE   },
+    { DEC_SKIP_NONREF, DEC_SKIP_NONE   },
+    { DEC_SKIP_ALL,    DEC_SKIP_NONE   },
+    { DEC_SKIP_ALL,    DEC_SKIP_NONREF },
+    { DEC_SKIP_ALL,    DEC_SKIP_NONKEY },
+};
+
+#define AUTO_SKIP_HOLD    8   // pictures to wait after a level change before judging again
+#define AUTO_SKIP_CALM    50  // pictures under half the budget before stepping down
+
 H264DecWrapper::H264DecWrapper()
 {
     codec = NULL;
@@ -21,6 +71,12 @@ H264DecWrapper::H264DecWrapper()
     h = NULL;
     s = NULL;
     frame = size = got_picture = len = 0;
+
+    m_eSkipFrame = m_eSkipLoopFilter = DEC_SKIP_NONE;
+    m_iBudgetUs = 0;
+    m_iMaxLevel = 3;
+    m_iLevel = m_iAvgUs = m_iPendingUs = m_iHoldFrames = m_iCalmFrames = 0;
+    m_iLowres = 0;
 }
 
 H264DecWrapper::~H264DecWrapper()
@@ -39,6 +95,7 @@ int H264DecWrapper::Initialize()
     {
         c->flags |= CODEC_FLAG_TRUNCATED; 
     }
+    c->lowres = m_iLowres;
 
     if (avcodec_open(c, codec) < 0) {
         fprintf(stderr, "could not open codec\n");
@@ -49,6 +106,7 @@ int H264DecWrapper::Initialize()
     s = &h->s;
     s->dsp.idct_permutation_type = 1;
     dsputil_init(&s->dsp, c);    
+    ApplySkip();
 
     return 0;
 }
@@ -76,7 +134,12 @@ int H264DecWrapper::Decode(unsigned char* szNal, int iSize,
     unsigned char* szOutImage, int& iOutSize, bool& bGetFrame)
 {
     int got_picture_ptr = 0;
+    long long tStart = m_iBudgetUs > 0 ? NowUs() : 0;
     int len = avcodec_decode_video(c, picture, &got_picture_ptr, szNal, iSize);
+    if (m_iBudgetUs > 0)
+    {
+        m_iPendingUs += (int)(NowUs() - tStart);
+    }
     if (len < 0) 
     {
         fprintf(stderr, "Error while decoding frame %d\n", frame);
@@ -86,6 +149,12 @@ int H264DecWrapper::Decode(unsigned char* szNal, int iSize,
     
     if (bGetFrame) 
     {
+        frame++;
+        if (m_iBudgetUs > 0)
+        {
+            UpdateAutoSkip(m_iPendingUs);
+            m_iPendingUs = 0;
+        }
         iOutSize = 0;
         iOutSize += output(picture->data[0], picture->linesize[0],c->width, c->height, szOutImage+iOutSize);
         iOutSize += output(picture->data[1], picture->linesize[1],c->width/2, c->height/2, szOutImage+iOutSize);
@@ -99,4 +168,160 @@ int H264DecWrapper::Decode(unsigned char* szNal, int iSize,
     return len;
 }
 
+int H264DecWrapper::GetWidth() const
+{
+    return c ? c->width : 0;
+}
+
+int H264DecWrapper::GetHeight() const
+{
+    return c ? c->height : 0;
+}
+
+void H264DecWrapper::EnableBench(bool bEnable)
+{
+    h->bench.enabled = bEnable ? 1 : 0;
+}
+
+// idct is what is left of hl_decode_mb once MC and the loop filter are taken out
+void H264DecWrapper::GetBenchStats(TDecBenchStats& stats) const
+{
+    const BenchContext* bc = &h->bench;
+    stats.frames = frame;
+    stats.macroblocks = bc->calls[BENCH_RECON];
+    stats.cavlc = bc->cycles[BENCH_CAVLC];
+    stats.cabac = bc->cycles[BENCH_CABAC];
+    stats.mc = bc->cycles[BENCH_MC];
+    stats.deblock = bc->cycles[BENCH_DEBLOCK];
+    stats.er = bc->cycles[BENCH_ER];
+    stats.idct = bc->cycles[BENCH_RECON] - bc->cycles[BENCH_MC] - bc->cycles[BENCH_DEBLOCK];
+}
+
+void H264DecWrapper::ResetBenchStats()
+{
+    ff_bench_reset(&h->bench);
+    frame = 0;
+}
+
+void H264DecWrapper::SetSkipFrame(EDecSkip eSkip)
+{
+    m_eSkipFrame = eSkip;
+    ApplySkip();
+}
+
+void H264DecWrapper::SetSkipLoopFilter(EDecSkip eSkip)
+{
+    m_eSkipLoopFilter = eSkip;
+    ApplySkip();
+}
+
+void H264DecWrapper::SetAutoSkip(int iBudgetUs, int iMaxLevel)
+{
+    if (iMaxLevel < 0)
+        iMaxLevel = 0;
+    if (iMaxLevel > DEC_SKIP_LEVEL_MAX)
+        iMaxLevel = DEC_SKIP_LEVEL_MAX;
+
+    m_iBudgetUs = iBudgetUs > 0 ? iBudgetUs : 0;
+    m_iMaxLevel = iMaxLevel;
+    m_iAvgUs = m_iPendingUs = m_iHoldFrames = m_iCalmFrames = 0;
+    if (m_iBudgetUs == 0 || m_iLevel > m_iMaxLevel)
+        m_iLevel = m_iBudgetUs == 0 ? 0 : m_iMaxLevel;
+    ApplySkip();
+}
+
+int H264DecWrapper::GetSkipLevel() const
+{
+    return m_iLevel;
+}
+
+int H264DecWrapper::GetAvgDecodeTime() const
+{
+    return m_iAvgUs;
+}
+
+// Frames are always decoded whole (CODEC_FLAG_TRUNCATED), so between two
+// Decode() calls it is safe to change; h264.c reinitializes on the next slice
+void H264DecWrapper::SetLowres(int iLowres)
+{
+    if (iLowres < 0)
+        iLowres = 0;
+    if (iLowres > 3)
+        iLowres = 3;
+
+    m_iLowres = iLowres;
+    if (c)
+    {
+        c->lowres = iLowres;
+    }
+}
+
+int H264DecWrapper::GetLowres() const
+{
+    return c ? c->lowres : m_iLowres;
+}
+
+// The stronger of the manual and the automatic setting wins. h264.c reads both
+// fields for every slice, so a change takes effect from the next picture on.
+void H264DecWrapper::ApplySkip()
+{
+    EDecSkip eLoopFilter = m_eSkipLoopFilter;
+    EDecSkip eFrame = m_eSkipFrame;
+
+    if (s_autoSkip[m_iLevel][0] > eLoopFilter)
+        eLoopFilter = s_autoSkip[m_iLevel][0];
+    if (s_autoSkip[m_iLevel][1] > eFrame)
+        eFrame = s_autoSkip[m_iLevel][1];
+
+    if (c)
+    {
+        c->skip_loop_filter = (enum AVDiscard)ToAVDiscard(eLoopFilter);
+        c->skip_frame = (enum AVDiscard)ToAVDiscard(eFrame);
+    }
+}
+
+// iFrameUs covers every Decode() call since the previous output picture, so
+// pictures dropped at the higher levels are charged to the next one shown
+void H264DecWrapper::UpdateAutoSkip(int iFrameUs)
+{
+    int iLevel = m_iLevel;
+
+    // 1/8 weight moving average, seeded with the first sample
+    if (m_iAvgUs == 0)
+        m_iAvgUs = iFrameUs;
+    else
+        m_iAvgUs += (iFrameUs - m_iAvgUs) / 8;
+
+    if (m_iHoldFrames > 0)
+    {
+        m_iHoldFrames--;
+        return;
+    }
+
+    if (m_iAvgUs > m_iBudgetUs)
+    {
+        m_iCalmFrames = 0;
+        if (iLevel < m_iMaxLevel)
+            iLevel++;
+    }
+    else if (m_iAvgUs < m_iBudgetUs / 2)
+    {
+        if (++m_iCalmFrames >= AUTO_SKIP_CALM && iLevel > 0)
+        {
+            iLevel--;
+            m_iCalmFrames = 0;
+        }
+    }
+    else
+    {
+        m_iCalmFrames = 0;
+    }
+
+    if (iLevel != m_iLevel)
+    {
+        m_iLevel = iLevel;
+        m_iHoldFrames = AUTO_SKIP_HOLD;
+        ApplySkip();
+    }
+}
 
@@ -10,6 +10,38 @@ struct H264Context;
 struct MpegEncContext;
 struct DSPContext;
 
+// Per-stage decoder cost, in TSC cycles, collected while EnableBench(true)
+struct DLL_EXPORT TDecBenchStats
+{
+    int frames;                      // pictures output by Decode()
+    unsigned long long macroblocks;  // macroblocks reconstructed
+    unsigned long long cavlc;        // CAVLC macroblock parsing
+    unsigned long long cabac;        // CABAC macroblock parsing
+    unsigned long long mc;           // motion compensation
+    unsigned long long idct;         // IDCT + intra prediction (reconstruction minus MC and deblock)
+    unsigned long long deblock;      // loop filter
+    unsigned long long er;           // error resilience / concealment
+    TDecBenchStats(): frames(0), macroblocks(0), cavlc(0), cabac(0), mc(0), idct(0), deblock(0), er(0) {}
+};
+
+// Which pictures a skip setting applies to, weakest to strongest (maps onto AVDiscard)
+enum EDecSkip
+{
+    DEC_SKIP_NONE = 0,  // decode / filter everything
+    DEC_SKIP_NONREF,    // non-reference pictures (nal_ref_idc == 0)
+    DEC_SKIP_BIDIR,     // B pictures
+    DEC_SKIP_NONKEY,    // everything except I pictures
+    DEC_SKIP_ALL        // every picture
+};
+
+// Automatic load shedding levels, see SetAutoSkip()
+//   0: full quality
+//   1: no loop filter on non-reference pictures
+//   2: no loop filter at all
+//   3: no loop filter, non-reference pictures dropped
+//   4: no loop filter, only I pictures decoded
+#define DEC_SKIP_LEVEL_MAX 4
+
 class DLL_EXPORT H264DecWrapper
 {
 public:
@@ -21,8 +53,42 @@ public:
     int Decode(unsigned char* szNal, int iSize, unsigned char* szOutImage, int& iOutSize, bool& bGetFrame);
 
     int Destroy();
-    
+
+    // Size of the last decoded picture, 0 before the first SPS
+    int GetWidth() const;
+    int GetHeight() const;
+
+    // Turn the per-stage cycle counters on or off; they are off by default
+    void EnableBench(bool bEnable);
+    void GetBenchStats(TDecBenchStats& stats) const;
+    void ResetBenchStats();
+
+    // Manual load shedding. Skipping the loop filter on reference pictures or
+    // dropping reference pictures makes later pictures drift until the next IDR.
+    void SetSkipFrame(EDecSkip eSkip);
+    void SetSkipLoopFilter(EDecSkip eSkip);
+
+    // Automatic load shedding: when the average decode time per output picture
+    // goes over iBudgetUs the level is raised one step, and lowered again once it
+    // has stayed under half the budget for a while. Never goes past iMaxLevel.
+    // The manual settings above stay in force as a floor. iBudgetUs = 0 turns it off.
+    void SetAutoSkip(int iBudgetUs, int iMaxLevel = 3);
+    int GetSkipLevel() const;
+    // Average decode time per output picture, in microseconds
+    int GetAvgDecodeTime() const;
+
+    // Reconstruct at 1/2, 1/4 or 1/8 of the coded size (iLowres = 1, 2, 3) for
+    // thumbnails; 0 is full size. Deblocking is off and the picture drifts until
+    // the next IDR, interlaced streams always decode at full size. Best set before
+    // Initialize(); a change mid-stream acts like a resolution change.
+    // GetWidth()/GetHeight() and Decode() output follow the reduced size.
+    void SetLowres(int iLowres);
+    int GetLowres() const;
+
 private:
+    void ApplySkip();
+    void UpdateAutoSkip(int iFrameUs);
+
     
     AVCodec *codec;
     AVCodecContext *c;
@@ -31,6 +97,17 @@ private:
     DSPContext* dsp;
     H264Context *h;
     MpegEncContext *s;
+
+    EDecSkip m_eSkipFrame;         // manual settings
+    EDecSkip m_eSkipLoopFilter;
+    int m_iBudgetUs;               // 0: automatic mode off
+    int m_iMaxLevel;
+    int m_iLevel;                  // current automatic level
+    int m_iAvgUs;                  // moving average of decode time per picture
+    int m_iPendingUs;              // time spent since the last output picture
+    int m_iHoldFrames;             // pictures left before the level may change again
+    int m_iCalmFrames;             // consecutive pictures under half the budget
+    int m_iLowres;
 };
 
 #endif
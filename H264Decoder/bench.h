@@ -0,0 +1,110 @@
+/*
+ * Low overhead per-stage cycle counters for the H.264 decoder
+ *
+ * This file is part of FFmpeg.
+ *
+ * FFmpeg is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * FFmpeg is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with FFmpeg; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+/**
+ * @file bench.h
+ * Per-stage cycle accounting used by bench_h264dec.
+ *
+ * Unlike START_TIMER/STOP_TIMER, which print running averages for a single
+ * call site, these counters accumulate into a BenchContext owned by the
+ * decoder context so that the caller can read a full breakdown per stream.
+ * They cost two timestamp reads per timed call and are skipped entirely
+ * unless BenchContext.enabled is set.
+ */
+
+#ifndef FFMPEG_BENCH_H
+#define FFMPEG_BENCH_H
+
+#include "common.h"
+#include "define.h"
+#include <string.h>
+
+enum BenchStage {
+    BENCH_CAVLC = 0,  ///< CAVLC macroblock parsing (decode_mb_cavlc)
+    BENCH_CABAC,      ///< CABAC macroblock parsing (decode_mb_cabac)
+    BENCH_RECON,      ///< whole hl_decode_mb, includes BENCH_MC and BENCH_DEBLOCK
+    BENCH_MC,         ///< motion compensation (hl_motion)
+    BENCH_DEBLOCK,    ///< loop filter (filter_mb / filter_mb_fast)
+    BENCH_ER,         ///< error resilience (ff_er_frame_end)
+    BENCH_NB
+};
+
+typedef struct BenchContext {
+    int enabled;
+    uint64_t cycles[BENCH_NB];
+    unsigned int calls[BENCH_NB];
+} BenchContext;
+
+#if ENABLE_BENCH
+#   if defined(_MSC_VER)
+#       include <intrin.h>
+#       pragma intrinsic(__rdtsc)
+#       define BENCH_READ_TIME() __rdtsc()
+#   elif defined(__GNUC__) && (defined(__i386__) || defined(__x86_64__))
+static av_always_inline uint64_t bench_read_time(void)
+{
+    uint32_t a, d;
+    __asm__ volatile("rdtsc" : "=a" (a), "=d" (d));
+    return ((uint64_t)d << 32) | a;
+}
+#       define BENCH_READ_TIME() bench_read_time()
+#   elif defined(AV_READ_TIME)
+#       define BENCH_READ_TIME() AV_READ_TIME()
+#   endif
+#endif
+
+#ifdef BENCH_READ_TIME
+/**
+ * Runs code and, if benchmarking is enabled on bc, charges its cycles to
+ * stage. code must be a statement, not a declaration.
+ */
+#define BENCH_TIMED(bc, stage, code) \
+do{\
+    if((bc)->enabled){\
+        uint64_t bench_tstart= BENCH_READ_TIME();\
+        code;\
+        (bc)->cycles[stage] += BENCH_READ_TIME() - bench_tstart;\
+        (bc)->calls[stage]++;\
+    }else{\
+        code;\
+    }\
+}while(0)
+#else
+#define BENCH_TIMED(bc, stage, code) do{ code; }while(0)
+#endif
+
+static inline void ff_bench_reset(BenchContext *bc)
+{
+    int enabled= bc->enabled;
+    memset(bc, 0, sizeof(*bc));
+    bc->enabled= enabled;
+}
+
+static inline void ff_bench_merge(BenchContext *dst, BenchContext *src)
+{
+    int i;
+    for(i=0; i<BENCH_NB; i++){
+        dst->cycles[i] += src->cycles[i];
+        dst->calls[i]  += src->calls[i];
+    }
+    ff_bench_reset(src);
+}
+
+#endif /* FFMPEG_BENCH_H */
@@ -6,6 +6,7 @@
 #define INT64_MAX (1<<30)
 #define INT_MIN (-1<<30)
 #define ENABLE_THREADS 0
+#define ENABLE_BENCH 1
 
 #define restrict 
 #define ENABLE_SMALL 0
@@ -2612,10 +2612,11 @@ static av_always_inline void hl_decode_mb_internal(H264Context *h, int simple){
             if(h->deblocking_filter && (simple || !FRAME_MBAFF))
                 xchg_mb_border(h, dest_y, dest_cb, dest_cr, linesize, uvlinesize, 0, simple);
         }else if(is_h264){
-            hl_motion(h, dest_y, dest_cb, dest_cr,
-                      s->me.qpel_put, s->dsp.put_h264_chroma_pixels_tab,
-                      s->me.qpel_avg, s->dsp.avg_h264_chroma_pixels_tab,
-                      s->dsp.weight_h264_pixels_tab, s->dsp.biweight_h264_pixels_tab);
+            BENCH_TIMED(&h->bench, BENCH_MC,
+                hl_motion(h, dest_y, dest_cb, dest_cr,
+                          s->me.qpel_put, s->dsp.put_h264_chroma_pixels_tab,
+                          s->me.qpel_avg, s->dsp.avg_h264_chroma_pixels_tab,
+                          s->dsp.weight_h264_pixels_tab, s->dsp.biweight_h264_pixels_tab));
         }
 
 
@@ -2702,23 +2703,455 @@ static av_always_inline void hl_decode_mb_internal(H264Context *h, int simple){
             fill_caches(h, mb_type_top, 1); //FIXME don't fill stuff which isn't used by filter_mb
             h->chroma_qp[0] = get_chroma_qp(h, 0, s->current_picture.qscale_table[mb_xy]);
             h->chroma_qp[1] = get_chroma_qp(h, 1, s->current_picture.qscale_table[mb_xy]);
-            filter_mb(h, mb_x, mb_y, pair_dest_y, pair_dest_cb, pair_dest_cr, linesize, uvlinesize);
+            BENCH_TIMED(&h->bench, BENCH_DEBLOCK,
+                filter_mb(h, mb_x, mb_y, pair_dest_y, pair_dest_cb, pair_dest_cr, linesize, uvlinesize));
             // bottom
             s->mb_y++; h->mb_xy += s->mb_stride;
             tprintf(h->s.avctx, "call mbaff filter_mb\n");
             fill_caches(h, mb_type_bottom, 1); //FIXME don't fill stuff which isn't used by filter_mb
             h->chroma_qp[0] = get_chroma_qp(h, 0, s->current_picture.qscale_table[mb_xy+s->mb_stride]);
             h->chroma_qp[1] = get_chroma_qp(h, 1, s->current_picture.qscale_table[mb_xy+s->mb_stride]);
-            filter_mb(h, mb_x, mb_y+1, dest_y, dest_cb, dest_cr, linesize, uvlinesize);
+            BENCH_TIMED(&h->bench, BENCH_DEBLOCK,
+                filter_mb(h, mb_x, mb_y+1, dest_y, dest_cb, dest_cr, linesize, uvlinesize));
         } else {
             tprintf(h->s.avctx, "call filter_mb\n");
             backup_mb_border(h, dest_y, dest_cb, dest_cr, linesize, uvlinesize, simple);
             fill_caches(h, mb_type, 1); //FIXME don't fill stuff which isn't used by filter_mb
-            filter_mb_fast(h, mb_x, mb_y, dest_y, dest_cb, dest_cr, linesize, uvlinesize);
+            BENCH_TIMED(&h->bench, BENCH_DEBLOCK,
+                filter_mb_fast(h, mb_x, mb_y, dest_y, dest_cb, dest_cr, linesize, uvlinesize));
+        }
+    }
+}
+
+#define LOWRES_SCRATCH_STRIDE 32
+
+/**
+ * Value at full resolution position j (0 = first sample of the block) along a
+ * row or column of lowres samples v[0..len-1], linear between the sample
+ * centres and extrapolated past both ends.
+ */
+static inline int lowres_interp(const int *v, int len, int j, int lowres){
+    const int s2= 2<<lowres;
+    const int pos= 2*j + 1 - (1<<lowres); /* from the centre of v[0], in 1/s2 units */
+    int x, f, sum;
+
+    if(len < 2)
+        return v[0];
+    x= pos < 0 ? 0 : FFMIN(pos / s2, len - 2);
+    f= pos - x*s2;
+    sum= v[x]*(s2 - f) + v[x+1]*f;
+    return av_clip_uint8(sum >= 0 ? (sum + (s2>>1)) / s2 : 0);
+}
+
+/**
+ * Fills row -1 (top-left sample plus top_len more) and column -1 of an n x n
+ * full resolution block at src from the lowres picture around dst, whose
+ * top-left sample is at (x0, y0). A lowres sample is the mean of a square and
+ * sits further from the block than the real edge sample, so the edge is
+ * extrapolated from the two nearest rows / columns where both exist.
+ * The lowres top-left sample itself is not read, it may not be decoded.
+ */
+static void lowres_load_neighbours(uint8_t *src, const uint8_t *dst, int stride,
+                                   int n, int top_len, int lowres, int x0, int y0){
+    const int k= (1<<lowres) - 1;
+    const int shift= lowres + 1;
+    int v[16];
+    int len, x, j;
+
+#define LOWRES_EDGE(a, b) av_clip_uint8((a) + ((((a) - (b))*k + (1<<(shift-1))) >> shift))
+    len= top_len >> lowres;
+    for(x=0; x<len; x++)
+        v[x]= y0 >= 2 ? LOWRES_EDGE(dst[x - stride], dst[x - 2*stride]) : dst[x - stride];
+    for(j=-1; j<top_len; j++)
+        src[j - LOWRES_SCRATCH_STRIDE]= lowres_interp(v, len, j, lowres);
+
+    len= n >> lowres;
+    for(x=0; x<len; x++)
+        v[x]= x0 >= 2 ? LOWRES_EDGE(dst[x*stride - 1], dst[x*stride - 2]) : dst[x*stride - 1];
+    for(j=0; j<n; j++)
+        src[j*LOWRES_SCRATCH_STRIDE - 1]= lowres_interp(v, len, j, lowres);
+#undef LOWRES_EDGE
+}
+
+/** box filters an n x n full resolution block down to (n>>lowres) square at dst */
+static void lowres_downsample(uint8_t *dst, int stride, const uint8_t *src, int n, int lowres){
+    const int s= 1<<lowres;
+    const int round= 1<<(2*lowres-1);
+    int x, y, i, j;
+
+    for(y=0; y<(n>>lowres); y++){
+        for(x=0; x<(n>>lowres); x++){
+            const uint8_t *p= src + (x + y*LOWRES_SCRATCH_STRIDE)*s;
+            int sum= 0;
+            for(j=0; j<s; j++)
+                for(i=0; i<s; i++)
+                    sum+= p[i + j*LOWRES_SCRATCH_STRIDE];
+            dst[x + y*stride]= (sum + round) >> (2*lowres);
+        }
+    }
+}
+
+/**
+ * Intra macroblock in lowres mode. Intra prediction does not scale down
+ * usefully (every approximated mode biases the next block and the error runs
+ * across the picture), so the macroblock is rebuilt at full size in a scratch
+ * buffer from neighbours interpolated out of the lowres picture, with the
+ * normal predictors and transforms, and then box filtered down.
+ */
+static void hl_decode_intra_lowres(H264Context *h, uint8_t *dest_y, uint8_t *dest_cb, uint8_t *dest_cr,
+                                   int linesize, int uvlinesize){
+    MpegEncContext * const s = &h->s;
+    const int lowres= s->avctx->lowres;
+    const int mb_type= s->current_picture.mb_type[h->mb_xy];
+    const int transform_bypass = (s->qscale == 0 && h->sps.transform_bypass);
+    const int x0= s->mb_x * (16>>lowres), y0= s->mb_y * (16>>lowres);
+    DECLARE_ALIGNED_8(uint8_t, luma[17*LOWRES_SCRATCH_STRIDE]);
+    DECLARE_ALIGNED_8(uint8_t, chroma[2][9*LOWRES_SCRATCH_STRIDE]);
+    uint8_t * const y= luma + LOWRES_SCRATCH_STRIDE + 8;
+    uint8_t * const cb= chroma[0] + LOWRES_SCRATCH_STRIDE + 8;
+    uint8_t * const cr= chroma[1] + LOWRES_SCRATCH_STRIDE + 8;
+    void (*idct_add)(uint8_t *dst, DCTELEM *block, int stride);
+    void (*idct_dc_add)(uint8_t *dst, DCTELEM *block, int stride);
+    int i;
+
+#define LOWRES_BLOCK_OFFSET(i) ((((scan8[i]&7)-4) + ((scan8[i]>>3)-1)*LOWRES_SCRATCH_STRIDE)*4)
+#define LOWRES_CHROMA_OFFSET(i) ((((i)&1) + (((i)>>1)&1)*LOWRES_SCRATCH_STRIDE)*4)
+
+    lowres_load_neighbours(y , dest_y , linesize  , 16, 24, lowres, x0   , y0   );
+    lowres_load_neighbours(cb, dest_cb, uvlinesize,  8,  8, lowres, x0>>1, y0>>1);
+    lowres_load_neighbours(cr, dest_cr, uvlinesize,  8,  8, lowres, x0>>1, y0>>1);
+
+    if(IS_INTRA_PCM(mb_type)){
+        int j;
+        for(i=0; i<16; i++)
+            for(j=0; j<16; j++)
+                y[LOWRES_BLOCK_OFFSET(i) + (j>>2)*LOWRES_SCRATCH_STRIDE + (j&3)]= h->mb[i*16 + j];
+        for(i=16; i<24; i++)
+            for(j=0; j<16; j++)
+                (i < 20 ? cb : cr)[LOWRES_CHROMA_OFFSET(i) + (j>>2)*LOWRES_SCRATCH_STRIDE + (j&3)]= h->mb[i*16 + j];
+    }else{
+        if(transform_bypass){
+            idct_dc_add =
+            idct_add = IS_8x8DCT(mb_type) ? s->dsp.add_pixels8 : s->dsp.add_pixels4;
+        }else if(IS_8x8DCT(mb_type)){
+            idct_dc_add = s->dsp.h264_idct8_dc_add;
+            idct_add = s->dsp.h264_idct8_add;
+        }else{
+            idct_dc_add = s->dsp.h264_idct_dc_add;
+            idct_add = s->dsp.h264_idct_add;
+        }
+
+        h->hpc.pred8x8[ h->chroma_pred_mode ](cb, LOWRES_SCRATCH_STRIDE);
+        h->hpc.pred8x8[ h->chroma_pred_mode ](cr, LOWRES_SCRATCH_STRIDE);
+
+        if(IS_INTRA4x4(mb_type)){
+            if(IS_8x8DCT(mb_type)){
+                for(i=0; i<16; i+=4){
+                    uint8_t * const ptr= y + LOWRES_BLOCK_OFFSET(i);
+                    const int dir= h->intra4x4_pred_mode_cache[ scan8[i] ];
+                    const int nnz = h->non_zero_count_cache[ scan8[i] ];
+                    h->hpc.pred8x8l[ dir ](ptr, (h->topleft_samples_available<<i)&0x8000,
+                                           (h->topright_samples_available<<i)&0x4000, LOWRES_SCRATCH_STRIDE);
+                    if(nnz){
+                        if(nnz == 1 && h->mb[i*16])
+                            idct_dc_add(ptr, h->mb + i*16, LOWRES_SCRATCH_STRIDE);
+                        else
+                            idct_add(ptr, h->mb + i*16, LOWRES_SCRATCH_STRIDE);
+                    }
+                }
+            }else{
+                for(i=0; i<16; i++){
+                    uint8_t * const ptr= y + LOWRES_BLOCK_OFFSET(i);
+                    uint8_t *topright;
+                    const int dir= h->intra4x4_pred_mode_cache[ scan8[i] ];
+                    int nnz, tr;
+
+                    if(dir == DIAG_DOWN_LEFT_PRED || dir == VERT_LEFT_PRED){
+                        const int topright_avail= (h->topright_samples_available<<i)&0x8000;
+                        if(!topright_avail){
+                            tr= ptr[3 - LOWRES_SCRATCH_STRIDE]*0x01010101;
+                            topright= (uint8_t*) &tr;
+                        }else
+                            topright= ptr + 4 - LOWRES_SCRATCH_STRIDE;
+                    }else
+                        topright= NULL;
+
+                    h->hpc.pred4x4[ dir ](ptr, topright, LOWRES_SCRATCH_STRIDE);
+                    nnz = h->non_zero_count_cache[ scan8[i] ];
+                    if(nnz){
+                        if(nnz == 1 && h->mb[i*16])
+                            idct_dc_add(ptr, h->mb + i*16, LOWRES_SCRATCH_STRIDE);
+                        else
+                            idct_add(ptr, h->mb + i*16, LOWRES_SCRATCH_STRIDE);
+                    }
+                }
+            }
+        }else{
+            h->hpc.pred16x16[ h->intra16x16_pred_mode ](y, LOWRES_SCRATCH_STRIDE);
+            if(!transform_bypass)
+                h264_luma_dc_dequant_idct_c(h->mb, s->qscale, h->dequant4_coeff[0][s->qscale][0]);
+            for(i=0; i<16; i++){
+                if(h->non_zero_count_cache[ scan8[i] ])
+                    idct_add(y + LOWRES_BLOCK_OFFSET(i), h->mb + i*16, LOWRES_SCRATCH_STRIDE);
+                else if(h->mb[i*16])
+                    idct_dc_add(y + LOWRES_BLOCK_OFFSET(i), h->mb + i*16, LOWRES_SCRATCH_STRIDE);
+            }
+        }
+
+        if(transform_bypass){
+            idct_add = idct_dc_add = s->dsp.add_pixels4;
+        }else{
+            idct_add = s->dsp.h264_idct_add;
+            idct_dc_add = s->dsp.h264_idct_dc_add;
+            chroma_dc_dequant_idct_c(h->mb + 16*16, h->chroma_qp[0], h->dequant4_coeff[1][h->chroma_qp[0]][0]);
+            chroma_dc_dequant_idct_c(h->mb + 16*16+4*16, h->chroma_qp[1], h->dequant4_coeff[2][h->chroma_qp[1]][0]);
+        }
+        for(i=16; i<16+8; i++){
+            uint8_t * const ptr= (i < 20 ? cb : cr) + LOWRES_CHROMA_OFFSET(i);
+            if(h->non_zero_count_cache[ scan8[i] ])
+                idct_add(ptr, h->mb + i*16, LOWRES_SCRATCH_STRIDE);
+            else if(h->mb[i*16])
+                idct_dc_add(ptr, h->mb + i*16, LOWRES_SCRATCH_STRIDE);
+        }
+    }
+#undef LOWRES_BLOCK_OFFSET
+#undef LOWRES_CHROMA_OFFSET
+
+    lowres_downsample(dest_y , linesize  , y , 16, lowres);
+    lowres_downsample(dest_cb, uvlinesize, cb,  8, lowres);
+    lowres_downsample(dest_cr, uvlinesize, cr,  8, lowres);
+}
+
+static inline void lowres_dc_add(uint8_t *dst, int stride, int size, int dc){
+    int x, y;
+    for(y=0; y<size; y++)
+        for(x=0; x<size; x++)
+            dst[x + y*stride]= av_clip_uint8(dst[x + y*stride] + dc);
+}
+
+/**
+ * Adds the residual of the four 4x4 blocks n..n+3, which cover one 8x8 area,
+ * to the (8>>lowres) square at dst.
+ * A 4x4 block shrinks to 2x2 through ff_h264_idct_2x2_add_c() and to a single
+ * sample through its DC; at lowres 3 the four DCs are averaged into one sample.
+ */
+static void lowres_add_8x8_area(H264Context *h, uint8_t *dst, int stride, int n, int lowres){
+    DCTELEM *block= h->mb + 16*n;
+    int j;
+
+    if(lowres == 3){
+        const int dc= block[0] + block[16] + block[32] + block[48];
+        if(dc)
+            dst[0]= av_clip_uint8(dst[0] + ((dc + 128) >> 8));
+        return;
+    }
+    for(j=0; j<4; j++){
+        uint8_t *ptr= dst + ((j&1) + (j>>1)*stride) * (4>>lowres);
+        if(!h->non_zero_count_cache[ scan8[n+j] ] && !block[16*j])
+            continue;
+        if(lowres == 1)
+            ff_h264_idct_2x2_add_c(ptr, block + 16*j, stride);
+        else
+            ptr[0]= av_clip_uint8(ptr[0] + ((block[16*j] + 32) >> 6));
+    }
+}
+
+/**
+ * Bilinear prediction of a w x h lowres block from (x + fx/8, y + fy/8) in src,
+ * with coordinates clamped to the plane since no edges are drawn in lowres mode.
+ */
+static void mc_lowres_block(uint8_t *dst, int dst_stride, const uint8_t *src, int src_stride,
+                            int w, int h, int x, int y, int fx, int fy,
+                            int pic_width, int pic_height, int avg){
+    const int A=(8-fx)*(8-fy);
+    const int B=(  fx)*(8-fy);
+    const int C=(8-fx)*(  fy);
+    const int D=(  fx)*(  fy);
+    int xs[9];
+    int i, j;
+
+    for(i=0; i<=w; i++)
+        xs[i]= av_clip(x + i, 0, pic_width - 1);
+
+    for(j=0; j<h; j++){
+        const uint8_t *r0= src + av_clip(y + j    , 0, pic_height - 1)*src_stride;
+        const uint8_t *r1= src + av_clip(y + j + 1, 0, pic_height - 1)*src_stride;
+        for(i=0; i<w; i++){
+            const int v= (A*r0[xs[i]] + B*r0[xs[i+1]] + C*r1[xs[i]] + D*r1[xs[i+1]] + 32) >> 6;
+            dst[i + j*dst_stride]= avg ? (dst[i + j*dst_stride] + v + 1) >> 1 : v;
         }
     }
 }
 
+/**
+ * Size of a partition edge at lowres scale. Partitions smaller than one
+ * lowres sample are represented by the one at the sample's top-left corner;
+ * the others return 0 and are skipped.
+ */
+static inline int lowres_part_size(int pos, int size, int lowres){
+    if(size >> lowres)
+        return size >> lowres;
+    return (pos & ((1<<lowres)-1)) ? 0 : 1;
+}
+
+/**
+ * Motion compensation of one partition at lowres scale. x, y, w, h are in
+ * full resolution luma samples relative to the macroblock. Weighted
+ * prediction is reduced to the plain average.
+ */
+static void mc_part_lowres(H264Context *h, int n, int x, int y, int w, int hgt,
+                           uint8_t *dest_y, uint8_t *dest_cb, uint8_t *dest_cr,
+                           int list0, int list1){
+    MpegEncContext * const s = &h->s;
+    const int lowres= s->avctx->lowres;
+    const int lw = lowres_part_size(x   , w   , lowres);
+    const int lh = lowres_part_size(y   , hgt , lowres);
+    const int cw = lowres_part_size(x>>1, w>>1, lowres);
+    const int ch = lowres_part_size(y>>1, hgt>>1, lowres);
+    const int pic_width = (16*s->mb_width ) >> lowres;
+    const int pic_height= (16*s->mb_height) >> lowres;
+    int list, avg= 0;
+
+    for(list=0; list<2; list++){
+        Picture *ref;
+        int mx, my, refn;
+
+        if(!(list ? list1 : list0))
+            continue;
+        refn= h->ref_cache[list][ scan8[n] ];
+        if(refn < 0)
+            continue;
+        ref= &h->ref_list[list][refn];
+        if(!ref->data[0])
+            continue;
+
+        /* luma in 1/4 sample units, chroma in 1/8, both at full resolution */
+        mx= h->mv_cache[list][ scan8[n] ][0] + (16*s->mb_x + x)*4;
+        my= h->mv_cache[list][ scan8[n] ][1] + (16*s->mb_y + y)*4;
+
+        if(lw && lh)
+            mc_lowres_block(dest_y + (x>>lowres) + (y>>lowres)*h->mb_linesize, h->mb_linesize,
+                            ref->data[0], h->mb_linesize, lw, lh,
+                            mx >> (2+lowres), my >> (2+lowres),
+                            (mx & ((4<<lowres)-1)) >> (lowres-1), (my & ((4<<lowres)-1)) >> (lowres-1),
+                            pic_width, pic_height, avg);
+
+        if(cw && ch && !(ENABLE_GRAY && s->flags&CODEC_FLAG_GRAY)){
+            const int off= (x>>(lowres+1)) + (y>>(lowres+1))*h->mb_uvlinesize;
+            const int cx= mx >> (3+lowres), fx= (mx & ((8<<lowres)-1)) >> lowres;
+            const int cy= my >> (3+lowres), fy= (my & ((8<<lowres)-1)) >> lowres;
+            mc_lowres_block(dest_cb + off, h->mb_uvlinesize, ref->data[1], h->mb_uvlinesize,
+                            cw, ch, cx, cy, fx, fy, pic_width>>1, pic_height>>1, avg);
+            mc_lowres_block(dest_cr + off, h->mb_uvlinesize, ref->data[2], h->mb_uvlinesize,
+                            cw, ch, cx, cy, fx, fy, pic_width>>1, pic_height>>1, avg);
+        }
+        avg= 1;
+    }
+}
+
+static void hl_motion_lowres(H264Context *h, uint8_t *dest_y, uint8_t *dest_cb, uint8_t *dest_cr){
+    MpegEncContext * const s = &h->s;
+    const int mb_type= s->current_picture.mb_type[h->mb_xy];
+
+    assert(IS_INTER(mb_type));
+
+    if(IS_16X16(mb_type)){
+        mc_part_lowres(h, 0, 0, 0, 16, 16, dest_y, dest_cb, dest_cr,
+                       IS_DIR(mb_type, 0, 0), IS_DIR(mb_type, 0, 1));
+    }else if(IS_16X8(mb_type)){
+        mc_part_lowres(h, 0, 0, 0, 16, 8, dest_y, dest_cb, dest_cr,
+                       IS_DIR(mb_type, 0, 0), IS_DIR(mb_type, 0, 1));
+        mc_part_lowres(h, 8, 0, 8, 16, 8, dest_y, dest_cb, dest_cr,
+                       IS_DIR(mb_type, 1, 0), IS_DIR(mb_type, 1, 1));
+    }else if(IS_8X16(mb_type)){
+        mc_part_lowres(h, 0, 0, 0, 8, 16, dest_y, dest_cb, dest_cr,
+                       IS_DIR(mb_type, 0, 0), IS_DIR(mb_type, 0, 1));
+        mc_part_lowres(h, 4, 8, 0, 8, 16, dest_y, dest_cb, dest_cr,
+                       IS_DIR(mb_type, 1, 0), IS_DIR(mb_type, 1, 1));
+    }else{
+        int i;
+
+        assert(IS_8X8(mb_type));
+
+        for(i=0; i<4; i++){
+            const int sub_mb_type= h->sub_mb_type[i];
+            const int list0= IS_DIR(sub_mb_type, 0, 0);
+            const int list1= IS_DIR(sub_mb_type, 0, 1);
+            const int n= 4*i;
+            const int x= (i&1)<<3;
+            const int y= (i&2)<<2;
+
+            if(IS_SUB_8X8(sub_mb_type)){
+                mc_part_lowres(h, n  , x, y  , 8, 8, dest_y, dest_cb, dest_cr, list0, list1);
+            }else if(IS_SUB_8X4(sub_mb_type)){
+                mc_part_lowres(h, n  , x, y  , 8, 4, dest_y, dest_cb, dest_cr, list0, list1);
+                mc_part_lowres(h, n+2, x, y+4, 8, 4, dest_y, dest_cb, dest_cr, list0, list1);
+            }else if(IS_SUB_4X8(sub_mb_type)){
+                mc_part_lowres(h, n  , x  , y, 4, 8, dest_y, dest_cb, dest_cr, list0, list1);
+                mc_part_lowres(h, n+1, x+4, y, 4, 8, dest_y, dest_cb, dest_cr, list0, list1);
+            }else{
+                int j;
+                assert(IS_SUB_4X4(sub_mb_type));
+                for(j=0; j<4; j++)
+                    mc_part_lowres(h, n+j, x + 4*(j&1), y + 2*(j&2), 4, 4,
+                                   dest_y, dest_cb, dest_cr, list0, list1);
+            }
+        }
+    }
+}
+
+/**
+ * Process a macroblock at 1/(1<<lowres) of the coded resolution.
+ * Inter macroblocks are predicted and get their residual directly on the
+ * reduced planes, which is where the savings are; the 8x8 transform keeps only
+ * its DC there. Together with the missing loop filter this makes the picture
+ * drift from the real one until the next IDR. Only progressive streams get
+ * here, see decode_slice_header().
+ */
+static void hl_decode_mb_lowres(H264Context *h){
+    MpegEncContext * const s = &h->s;
+    const int lowres= s->avctx->lowres;
+    const int mb_type= s->current_picture.mb_type[h->mb_xy];
+    const int linesize  = h->mb_linesize   = s->linesize;
+    const int uvlinesize= h->mb_uvlinesize = s->uvlinesize;
+    const int mb_size = 16 >> lowres;
+    const int mbc_size=  8 >> lowres;
+    uint8_t *dest_y, *dest_cb, *dest_cr;
+    int i;
+
+    dest_y  = s->current_picture.data[0] + (s->mb_y * mb_size * linesize  ) + s->mb_x * mb_size;
+    dest_cb = s->current_picture.data[1] + (s->mb_y * mbc_size* uvlinesize) + s->mb_x * mbc_size;
+    dest_cr = s->current_picture.data[2] + (s->mb_y * mbc_size* uvlinesize) + s->mb_x * mbc_size;
+
+    if(IS_INTRA(mb_type)){
+        hl_decode_intra_lowres(h, dest_y, dest_cb, dest_cr, linesize, uvlinesize);
+        return;
+    }
+
+    BENCH_TIMED(&h->bench, BENCH_MC,
+        hl_motion_lowres(h, dest_y, dest_cb, dest_cr));
+
+    if(IS_8x8DCT(mb_type)){
+        const int size= 8 >> lowres;
+        for(i=0; i<16; i+=4){
+            if(h->non_zero_count_cache[ scan8[i] ])
+                lowres_dc_add(dest_y + ((i>>2)&1)*size + (i>>3)*size*linesize, linesize, size,
+                              (h->mb[i*16] + 32) >> 6);
+        }
+    }else{
+        const int size= 8 >> lowres;
+        for(i=0; i<16; i+=4)
+            lowres_add_8x8_area(h, dest_y + ((i>>2)&1)*size + (i>>3)*size*linesize, linesize, i, lowres);
+    }
+
+    if(!(s->qscale == 0 && h->sps.transform_bypass)){
+        chroma_dc_dequant_idct_c(h->mb + 16*16, h->chroma_qp[0], h->dequant4_coeff[4][h->chroma_qp[0]][0]);
+        chroma_dc_dequant_idct_c(h->mb + 16*16+4*16, h->chroma_qp[1], h->dequant4_coeff[5][h->chroma_qp[1]][0]);
+    }
+    lowres_add_8x8_area(h, dest_cb, uvlinesize, 16, lowres);
+    lowres_add_8x8_area(h, dest_cr, uvlinesize, 20, lowres);
+}
+
 /**
  * Process a macroblock; this case avoids checks for expensive uncommon cases.
  */
@@ -2742,9 +3175,14 @@ static void hl_decode_mb(H264Context *h){
     if(!s->decode)
         return;
 
+    if (s->avctx->lowres) {
+        BENCH_TIMED(&h->bench, BENCH_RECON, hl_decode_mb_lowres(h));
+        return;
+    }
+
     if (is_complex)
-        hl_decode_mb_complex(h);
-    else hl_decode_mb_simple(h);
+        BENCH_TIMED(&h->bench, BENCH_RECON, hl_decode_mb_complex(h));
+    else BENCH_TIMED(&h->bench, BENCH_RECON, hl_decode_mb_simple(h));
 }
 
 static void pic_as_field(Picture *pic, const int parity){
@@ -3948,6 +4386,13 @@ static int decode_slice_header(H264Context *h, H264Context *h0){
     s->mb_width= h->sps.mb_width;
     s->mb_height= h->sps.mb_height * (2 - h->sps.frame_mbs_only_flag);
 
+    if(s->avctx->lowres > 3)
+        s->avctx->lowres = 3;
+    if(s->avctx->lowres && !h->sps.frame_mbs_only_flag){
+        av_log(h->s.avctx, AV_LOG_ERROR, "lowres decoding of interlaced streams is not supported\n");
+        s->avctx->lowres = 0;
+    }
+
     h->b_stride=  s->mb_width*4;
     h->b8_stride= s->mb_width*2;
 
@@ -3958,7 +4403,8 @@ static int decode_slice_header(H264Context *h, H264Context *h0){
         s->height= 16*s->mb_height - 4*FFMIN(h->sps.crop_bottom, 3);
 
     if (s->context_initialized
-        && (   s->width != s->avctx->width || s->height != s->avctx->height)) {
+        && (   -((-s->width )>>s->avctx->lowres) != s->avctx->width
+            || -((-s->height)>>s->avctx->lowres) != s->avctx->height)) {
         if(h != h0)
             return -1;   // width / height changed during parallelized decoding
         free_tables(h);
@@ -3989,8 +4435,7 @@ static int decode_slice_header(H264Context *h, H264Context *h0){
             if(context_init(h->thread_context[i]) < 0)
                 return -1;
 
-        s->avctx->width = s->width;
-        s->avctx->height = s->height;
+        avcodec_set_dimensions(s->avctx, s->width, s->height);
         s->avctx->sample_aspect_ratio= h->sps.sar;
         if(!s->avctx->sample_aspect_ratio.den)
             s->avctx->sample_aspect_ratio.den = 1;
@@ -4213,6 +4658,7 @@ static int decode_slice_header(H264Context *h, H264Context *h0){
     }
 
     if(   s->avctx->skip_loop_filter >= AVDISCARD_ALL
+       || s->avctx->lowres
        ||(s->avctx->skip_loop_filter >= AVDISCARD_NONKEY && h->slice_type != FF_I_TYPE)
        ||(s->avctx->skip_loop_filter >= AVDISCARD_BIDIR  && h->slice_type == FF_B_TYPE)
        ||(s->avctx->skip_loop_filter >= AVDISCARD_NONREF && h->nal_ref_idc == 0))
@@ -6812,17 +7258,16 @@ static int decode_slice(struct AVCodecContext *avctx, H264Context *h){
         }
 
         for(;;){
-//START_TIMER
-            int ret = decode_mb_cabac(h);
+            int ret;
             int eos;
-//STOP_TIMER("decode_mb_cabac")
+            BENCH_TIMED(&h->bench, BENCH_CABAC, ret = decode_mb_cabac(h));
 
             if(ret>=0) hl_decode_mb(h);
 
             if( ret >= 0 && FRAME_MBAFF ) { //FIXME optimal? or let mb_decode decode 16x32 ?
                 s->mb_y++;
 
-                if(ret>=0) ret = decode_mb_cabac(h);
+                if(ret>=0) BENCH_TIMED(&h->bench, BENCH_CABAC, ret = decode_mb_cabac(h));
 
                 if(ret>=0) hl_decode_mb(h);
                 s->mb_y--;
@@ -6853,13 +7298,14 @@ static int decode_slice(struct AVCodecContext *avctx, H264Context *h){
 
     } else {
         for(;;){
-            int ret = decode_mb_cavlc(h);
+            int ret;
+            BENCH_TIMED(&h->bench, BENCH_CAVLC, ret = decode_mb_cavlc(h));
 
             if(ret>=0) hl_decode_mb(h);
 
             if(ret>=0 && FRAME_MBAFF){ //FIXME optimal? or let mb_decode decode 16x32 ?
                 s->mb_y++;
-                ret = decode_mb_cavlc(h);
+                BENCH_TIMED(&h->bench, BENCH_CAVLC, ret = decode_mb_cavlc(h));
 
                 if(ret>=0) hl_decode_mb(h);
                 s->mb_y--;
@@ -7448,6 +7894,7 @@ static void execute_decode_slices(H264Context *h, int context_count){
             hx = h->thread_context[i];
             hx->s.error_resilience = avctx->error_resilience;
             hx->s.error_count = 0;
+            hx->bench.enabled = h->bench.enabled;
         }
 
         avctx->execute(avctx, (void *)decode_slice,
@@ -7459,8 +7906,10 @@ static void execute_decode_slices(H264Context *h, int context_count){
         s->mb_y = hx->s.mb_y;
         s->dropable = hx->s.dropable;
         s->picture_structure = hx->s.picture_structure;
-        for(i = 1; i < context_count; i++)
+        for(i = 1; i < context_count; i++){
             h->s.error_count += h->thread_context[i]->s.error_count;
+            ff_bench_merge(&h->bench, &h->thread_context[i]->bench);
+        }
     }
 }
 
@@ -7800,8 +8249,8 @@ static int decode_frame(AVCodecContext *avctx,
          * past end by one (callers fault) and resync_mb_y != 0
          * causes problems for the first MB line, too.
          */
-        if (!FIELD_PICTURE)
-            ff_er_frame_end(s);
+        if (!FIELD_PICTURE && !avctx->lowres)
+            BENCH_TIMED(&h->bench, BENCH_ER, ff_er_frame_end(s));
 
         MPV_frame_end(s);
 
@@ -33,6 +33,7 @@
 #include "mpegvideo.h"
 #include "h264pred.h"
 #include "log.h"
+#include "bench.h"
 
 #define interlaced_dct interlaced_dct_is_a_bad_name
 #define mb_intra mb_intra_is_not_initialized_see_mb_type
@@ -417,6 +418,12 @@ typedef struct H264Context{
 
     int mb_xy;
 
+    /**
+     * per-stage cycle counters, accumulated per slice context and merged
+     * into the master context after each execute_decode_slices()
+     */
+    BenchContext bench;
+
 }H264Context;
 
 #endif /* FFMPEG_H264_H */
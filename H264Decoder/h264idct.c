@@ -70,6 +70,33 @@ void ff_h264_lowres_idct_put_c(uint8_t *dst, int stride, DCTELEM *block){
     idct_internal(dst, block, stride, 8, 3, 0);
 }
 
+/**
+ * 4x4 inverse transform averaged down to 2x2, for reduced resolution decoding.
+ * Averaging pairs of outputs cancels the second basis function and leaves
+ * d0 +- (3*d1 - d3)/4 in each direction; everything is kept scaled by 16.
+ */
+void ff_h264_idct_2x2_add_c(uint8_t *dst, DCTELEM *block, int stride){
+    int i;
+    int tmp[4*2];
+    uint8_t *cm = ff_cropTbl + MAX_NEG_CROP;
+
+    for(i=0; i<4; i++){
+        const int z0= 4*block[0 + 4*i];
+        const int z1= 3*block[1 + 4*i] - block[3 + 4*i];
+
+        tmp[0 + 2*i]= z0 + z1;
+        tmp[1 + 2*i]= z0 - z1;
+    }
+
+    for(i=0; i<2; i++){
+        const int z0= 4*tmp[i + 2*0];
+        const int z1= 3*tmp[i + 2*1] - tmp[i + 2*3];
+
+        dst[i + 0*stride]= cm[ dst[i + 0*stride] + ((z0 + z1 + (32<<4)) >> 10) ];
+        dst[i + 1*stride]= cm[ dst[i + 1*stride] + ((z0 - z1 + (32<<4)) >> 10) ];
+    }
+}
+
 void ff_h264_idct8_add_c(uint8_t *dst, DCTELEM *block, int stride){
     int i;
     DCTELEM (*src)[8] = (DCTELEM(*)[8])block;
@@ -20,6 +20,7 @@ along with this library; if not, write to the Free Software Foundation, Inc.,
 #ifndef IMN_PIM
 #include "BasicUsageEnvironment.hh"
 #include "HandlerSet.hh"
+#include "Boolean.hh"
 #include <stdio.h>
 #if defined(_QNX4)
 #include <sys/select.h>
@@ -37,6 +38,7 @@ BasicTaskScheduler* BasicTaskScheduler::createNew() {
 BasicTaskScheduler::BasicTaskScheduler()
   : fMaxNumSockets(0) {
   FD_ZERO(&fReadSet);
+  FD_ZERO(&fWriteSet);
 }
 
 BasicTaskScheduler::~BasicTaskScheduler() {
@@ -49,6 +51,9 @@ BasicTaskScheduler::~BasicTaskScheduler() {
 //ӳ񡣴˺в־־̫
 void BasicTaskScheduler::SingleStep(unsigned maxDelayTime) {
   fd_set readSet = this->fReadSet; // make a copy for this select() call
+  fd_set writeSet = this->fWriteSet; // ditto
+  fd_set exceptionSet = this->fWriteSet;
+      // (Windows reports a failed non-blocking "connect()" only here)
 
   //1 óʱʱ//////////////////////////
   //һ¼ӳʱ
@@ -75,13 +80,13 @@ void BasicTaskScheduler::SingleStep(unsigned maxDelayTime) {
   }
 
   //1 ִselectȴʱ/////////////////////////
-  int selectResult = select(fMaxNumSockets, &readSet, NULL, NULL,  &tv_timeToDelay);
+  int selectResult = select(fMaxNumSockets, &readSet, &writeSet, &exceptionSet, &tv_timeToDelay);
   if (selectResult < 0) {
 #if defined(__WIN32__) || defined(_WIN32)
     int err = WSAGetLastError();
     // For some unknown reason, select() in Windoze sometimes fails with WSAEINVAL if
     // it was called with no entries set in "readSet".  If this happens, ignore it:
-    if (err == WSAEINVAL && readSet.fd_count == 0) {
+    if (err == WSAEINVAL && readSet.fd_count == 0 && writeSet.fd_count == 0) {
       err = EINTR;
       // To stop this from happening again, create a dummy readable socket:
       int dummySocketNum = socket(AF_INET, SOCK_DGRAM, 0);
@@ -160,17 +165,51 @@ void BasicTaskScheduler::SingleStep(unsigned maxDelayTime) {
       BasicTaskScheduler0::fLastHandledSocketNum = -1;//because we didn't call a handler
   }
 
+  // Call the handler function for one writable socket.  (Such handlers
+  // usually turn themselves off, so there's no need to take turns.)
+  if (selectResult > 0) {
+    HandlerIterator writeIter(*BasicTaskScheduler0::fWriteHandlers);
+    while ((handler = writeIter.next()) != NULL) {
+      int mask = 0;
+      if (FD_ISSET(handler->socketNum, &writeSet)) mask |= SOCKET_WRITABLE;
+      if (FD_ISSET(handler->socketNum, &exceptionSet)) mask |= SOCKET_EXCEPTION;
+      if (mask != 0 &&
+	  FD_ISSET(handler->socketNum, &fWriteSet) /* sanity check */ &&
+	  handler->handlerProc != NULL) {
+	(*handler->handlerProc)(handler->clientData, mask);
+	break;
+      }
+    }
+  }
+
   //1 ɾѾĳʱ¼/////////////////////////
   // Also handle any delayed event that may have come due.  (Note that we do this *after* calling a socket
   // handler, in case the delayed event handler modifies the set of readable socket.)
   BasicTaskScheduler0::fDelayQueue.handleAlarm();
 }
 
+// Whether "socketNum" can be put in "set" (and so handled by "select()").
+// Elsewhere, "FD_SET()" on a socket number >= FD_SETSIZE writes past the end
+// of the set.  (Each RTSP client session of ours - TCP, RTP and RTCP - takes
+// three, so a server handles at most about FD_SETSIZE/3 at once.)  Windows
+// sets are arrays of up to FD_SETSIZE sockets, whatever their numbers:
+static Boolean canBeSelected(int socketNum, fd_set& set) {
+#if defined(__WIN32__) || defined(_WIN32)
+  if (set.fd_count < FD_SETSIZE || FD_ISSET((unsigned)socketNum, &set)) return True;
+#else
+  if (socketNum < FD_SETSIZE) return True;
+#endif
+
+  DEBUG_LOG(ERR, "Can't handle socket %d: over the FD_SETSIZE (%d) limit",
+	    socketNum, FD_SETSIZE);
+  return False;
+}
+
 //öķʽsocketNumĳӦsocketNumsocket()صľ
 void BasicTaskScheduler::turnOnBackgroundReadHandling(int socketNum,
 				BackgroundHandlerProc* handlerProc,
 				void* clientData) {
-  if (socketNum < 0) return;
+  if (socketNum < 0 || !canBeSelected(socketNum, fReadSet)) return;
   //ļfReadSetжӦļsocketNumλ(Ϊ1)
   FD_SET((unsigned)socketNum, &fReadSet);
   //洦ָ뼰ڲһ˫
@@ -184,11 +223,39 @@ void BasicTaskScheduler::turnOnBackgroundReadHandling(int socketNum,
 //ȡ
 void BasicTaskScheduler::turnOffBackgroundReadHandling(int socketNum) {
   if (socketNum < 0) return;
+#if !defined(__WIN32__) && !defined(_WIN32)
+  if (socketNum >= FD_SETSIZE) return; // (it was never turned on)
+#endif
   //ļfReadSetжӦļsocketNumλΪ0
   FD_CLR((unsigned)socketNum, &fReadSet);
   fReadHandlers->removeHandler(socketNum);
 
-  if (socketNum+1 == fMaxNumSockets) {
+  if (socketNum+1 == fMaxNumSockets && !FD_ISSET((unsigned)socketNum, &fWriteSet)) {
+    --fMaxNumSockets;
+  }
+}
+
+void BasicTaskScheduler::turnOnBackgroundWriteHandling(int socketNum,
+				BackgroundHandlerProc* handlerProc,
+				void* clientData) {
+  if (socketNum < 0 || !canBeSelected(socketNum, fWriteSet)) return;
+  FD_SET((unsigned)socketNum, &fWriteSet);
+  fWriteHandlers->assignHandler(socketNum, handlerProc, clientData);
+
+  if (socketNum+1 > fMaxNumSockets) {
+    fMaxNumSockets = socketNum+1;
+  }
+}
+
+void BasicTaskScheduler::turnOffBackgroundWriteHandling(int socketNum) {
+  if (socketNum < 0) return;
+#if !defined(__WIN32__) && !defined(_WIN32)
+  if (socketNum >= FD_SETSIZE) return; // (it was never turned on)
+#endif
+  FD_CLR((unsigned)socketNum, &fWriteSet);
+  fWriteHandlers->removeHandler(socketNum);
+
+  if (socketNum+1 == fMaxNumSockets && !FD_ISSET((unsigned)socketNum, &fReadSet)) {
     --fMaxNumSockets;
   }
 }
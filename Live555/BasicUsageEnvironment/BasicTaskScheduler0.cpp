@@ -45,9 +45,11 @@ private:
 BasicTaskScheduler0::BasicTaskScheduler0()
   : fLastHandledSocketNum(-1) {
   fReadHandlers = new HandlerSet;
+  fWriteHandlers = new HandlerSet;
 }
 
 BasicTaskScheduler0::~BasicTaskScheduler0() {
+  delete fWriteHandlers;
   delete fReadHandlers;
 }
 
@@ -64,11 +64,18 @@ protected:
 				    BackgroundHandlerProc* handlerProc,
 				    void* clientData);
   virtual void turnOffBackgroundReadHandling(int socketNum);
+  virtual void turnOnBackgroundWriteHandling(int socketNum,
+				    BackgroundHandlerProc* handlerProc,
+				    void* clientData);
+  virtual void turnOffBackgroundWriteHandling(int socketNum);
 
 protected:
   // To implement background reads:
   int fMaxNumSockets;//1(selectĵһ)
   fd_set fReadSet;
+
+  // To implement background writes:
+  fd_set fWriteSet;
 };
 
 #endif
@@ -96,6 +96,9 @@ protected:
   // To implement background reads:
   HandlerSet* fReadHandlers;//¼Ӧ
   int fLastHandledSocketNum;//һαsocket
+
+  // To implement background writes:
+  HandlerSet* fWriteHandlers;
 };
 
 #endif
@@ -135,6 +135,12 @@ public:
 				BackgroundHandlerProc* handlerProc,
 				void* clientData) = 0;
   virtual void turnOffBackgroundReadHandling(int socketNum) = 0;
+  // ... and, likewise, for when a socket becomes writable (e.g., when a
+  // non-blocking "connect()" completes):
+  virtual void turnOnBackgroundWriteHandling(int socketNum,
+				BackgroundHandlerProc* handlerProc,
+				void* clientData) = 0;
+  virtual void turnOffBackgroundWriteHandling(int socketNum) = 0;
 
   //ϵѭ֪watchVariableɷǿַ
   virtual void doEventLoop(char* watchVariable = NULL) = 0;
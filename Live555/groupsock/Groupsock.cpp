@@ -44,6 +44,12 @@ OutputSocket::~OutputSocket() {
 
 Boolean OutputSocket::write(netAddressBits address, Port port, u_int8_t ttl,
 			    unsigned char* buffer, unsigned bufferSize) {
+  return write(address, port, ttl, NULL, 0, buffer, bufferSize);
+}
+
+Boolean OutputSocket::write(netAddressBits address, Port port, u_int8_t ttl,
+			    unsigned char* header, unsigned headerSize,
+			    unsigned char* buffer, unsigned bufferSize) {
   if (ttl == fLastSentTTL) {
     // Optimization: So we don't do a 'set TTL' system call again
     ttl = 0;
@@ -52,7 +58,7 @@ Boolean OutputSocket::write(netAddressBits address, Port port, u_int8_t ttl,
   }
   struct in_addr destAddr; destAddr.s_addr = address;
   if (!writeSocket(env(), socketNum(), destAddr, port, ttl,
-		   buffer, bufferSize))
+		   header, headerSize, buffer, bufferSize))
     return False;
 
   if (sourcePortNum() == 0) {
@@ -246,19 +252,38 @@ void Groupsock::multicastSendOnly() {
 Boolean Groupsock::output(UsageEnvironment& env, u_int8_t ttlToSend,
 			  unsigned char* buffer, unsigned bufferSize,
 			  DirectedNetInterface* interfaceNotToFwdBackTo) {
+  return output(env, ttlToSend, NULL, 0, buffer, bufferSize,
+		interfaceNotToFwdBackTo);
+}
+
+Boolean Groupsock::output(UsageEnvironment& env, u_int8_t ttlToSend,
+			  unsigned char* header, unsigned headerSize,
+			  unsigned char* buffer, unsigned bufferSize,
+			  DirectedNetInterface* interfaceNotToFwdBackTo) {
+  if (headerSize > 0 && !members().IsEmpty()) {
+    // Relaying to our members needs the packet in one piece:
+    unsigned char* packet = new unsigned char[headerSize + bufferSize];
+    memmove(packet, header, headerSize);
+    memmove(&packet[headerSize], buffer, bufferSize);
+    Boolean result = output(env, ttlToSend, packet, headerSize + bufferSize,
+			    interfaceNotToFwdBackTo);
+    delete[] packet;
+    return result;
+  }
+
   do {
     // First, do the datagram send, to each destination:
     Boolean writeSuccess = True;
     for (destRecord* dests = fDests; dests != NULL; dests = dests->fNext) {
       if (!write(dests->fGroupEId.groupAddress().s_addr, dests->fPort, ttlToSend,
-		 buffer, bufferSize)) {
+		 header, headerSize, buffer, bufferSize)) {
 	writeSuccess = False;
 	break;
       }
     }
     if (!writeSuccess) break;
-    statsOutgoing.countPacket(bufferSize);
-    statsGroupOutgoing.countPacket(bufferSize);
+    statsOutgoing.countPacket(headerSize + bufferSize);
+    statsGroupOutgoing.countPacket(headerSize + bufferSize);
 
     // Then, forward to our members:
     int numMembers = 0;
@@ -306,24 +331,53 @@ Boolean Groupsock::handleRead(unsigned char* buffer, unsigned bufferMaxSize,
     return False;
   }
 
+  bytesRead = handleIncomingData(buffer, numBytes, fromAddress);
+  return True;
+}
+
+Boolean Groupsock::handleReadBatch(unsigned char** buffers,
+				   unsigned bufferMaxSize,
+				   unsigned* bytesRead,
+				   struct sockaddr_in* fromAddresses,
+				   unsigned maxPackets, unsigned& numPackets) {
+  numPackets = 0;
+
+  int maxBytesToRead = bufferMaxSize - TunnelEncapsulationTrailerMaxSize;
+  int numRead = readSocketBatch(env(), socketNum(), buffers, maxBytesToRead,
+				bytesRead, fromAddresses, maxPackets);
+  if (numRead < 0) {
+    if (DebugLevel >= 0) { // this is a fatal error
+      env().setResultMsg("Groupsock read failed: ",
+			 env().getResultMsg());
+    }
+    return False;
+  }
+
+  for (int i = 0; i < numRead; ++i) {
+    bytesRead[i] = handleIncomingData(buffers[i], bytesRead[i], fromAddresses[i]);
+  }
+  numPackets = numRead;
+  return True;
+}
+
+unsigned Groupsock::handleIncomingData(unsigned char* buffer, unsigned numBytes,
+				       struct sockaddr_in& fromAddress) {
   // If we're a SSM group, make sure the source address matches:
   if (isSSM()
       && fromAddress.sin_addr.s_addr != sourceFilterAddress().s_addr) {
-    return True;
+    return 0;
   }
 
   // We'll handle this data.
   // Also write it (with the encapsulation trailer) to each member,
   // unless the packet was originally sent by us to begin with.
-  bytesRead = numBytes;
-
   int numMembers = 0;
   if (!wasLoopedBackFromUs(env(), fromAddress)) {
     statsIncoming.countPacket(numBytes);
     statsGroupIncoming.countPacket(numBytes);
     numMembers =
       outputToAllMembersExcept(NULL, ttl(),
-			       buffer, bytesRead,
+			       buffer, numBytes,
 			       fromAddress.sin_addr.s_addr);
     if (numMembers > 0) {
       statsRelayedIncoming.countPacket(numBytes);
@@ -331,7 +385,7 @@ Boolean Groupsock::handleRead(unsigned char* buffer, unsigned bufferMaxSize,
     }
   }
   if (DebugLevel >= 3) {
-    env() << *this << ": read " << bytesRead << " bytes from ";
+    env() << *this << ": read " << numBytes << " bytes from ";
     env() << our_inet_ntoa(fromAddress.sin_addr);
     if (numMembers > 0) {
       env() << "; relayed to " << numMembers << " members";
@@ -339,7 +393,7 @@ Boolean Groupsock::handleRead(unsigned char* buffer, unsigned bufferMaxSize,
     env() << "\n";
   }
 
-  return True;
+  return numBytes;
 }
 
 Boolean Groupsock::wasLoopedBackFromUs(UsageEnvironment& env,
@@ -27,6 +27,7 @@ extern "C" int initializeWinsockIfNecessary();
 #include <stdarg.h>
 #include <time.h>
 #include <fcntl.h>
+#include <sys/uio.h>
 #define initializeWinsockIfNecessary() 1
 #endif
 #include <stdio.h>
@@ -50,6 +51,16 @@ NoReuse::~NoReuse() {
   reuseFlag = 1;
 }
 
+static int reusePortFlag = 0;
+
+ReusePort::ReusePort() {
+  reusePortFlag = 1;
+}
+
+ReusePort::~ReusePort() {
+  reusePortFlag = 0;
+}
+
 int setupDatagramSocket(UsageEnvironment& env, Port port,
 #ifdef IP_MULTICAST_LOOP
 			Boolean setLoopback
@@ -150,6 +161,19 @@ Boolean makeSocketNonBlocking(int sock) {
 #endif
 }
 
+Boolean makeSocketBlocking(int sock) {
+#if defined(__WIN32__) || defined(_WIN32) || defined(IMN_PIM)
+  unsigned long arg = 0;
+  return ioctlsocket(sock, FIONBIO, &arg) == 0;
+#elif defined(VXWORKS)
+  int arg = 0;
+  return ioctl(sock, FIONBIO, (int)&arg) == 0;
+#else
+  int curFlags = fcntl(sock, F_GETFL, 0);
+  return fcntl(sock, F_SETFL, curFlags&(~O_NONBLOCK)) >= 0;
+#endif
+}
+
 //׽(TCP)
 int setupStreamSocket(UsageEnvironment& env,
                       Port port, Boolean makeNonBlocking) 
@@ -192,6 +216,14 @@ int setupStreamSocket(UsageEnvironment& env,
   }
 #endif
 #endif
+#endif
+#if !defined(__WIN32__) && !defined(_WIN32) && defined(SO_REUSEPORT)
+  if (reusePortFlag && setsockopt(newSocket, SOL_SOCKET, SO_REUSEPORT,
+				  (const char*)&reusePortFlag, sizeof reusePortFlag) < 0) {
+    socketErr(env, "setsockopt(SO_REUSEPORT) error: ");
+    closeSocket(newSocket);
+    return -1;
+  }
 #endif
 
   // 󶨡Note: Windoze requires binding, even if the port number is 0
@@ -307,6 +339,54 @@ int readSocket(UsageEnvironment& env,
 }
 
 
+#define MAX_BATCH_READ 64 // datagrams per "recvmmsg()" call
+
+int readSocketBatch(UsageEnvironment& env, int socket,
+		    unsigned char** buffers, unsigned bufferSize,
+		    unsigned* bytesRead, struct sockaddr_in* fromAddresses,
+		    unsigned maxPackets) {
+  if (maxPackets == 0) return 0;
+#if defined(__linux__) && defined(MSG_WAITFORONE)
+  // Take everything that's already queued (up to "maxPackets") in one system call.
+  // MSG_DONTWAIT: we're called once the socket is readable, so never block here:
+  struct mmsghdr msgs[MAX_BATCH_READ];
+  struct iovec iovecs[MAX_BATCH_READ];
+  if (maxPackets > MAX_BATCH_READ) maxPackets = MAX_BATCH_READ;
+  memset(msgs, 0, maxPackets*sizeof msgs[0]);
+  for (unsigned i = 0; i < maxPackets; ++i) {
+    iovecs[i].iov_base = buffers[i];
+    iovecs[i].iov_len = bufferSize;
+    msgs[i].msg_hdr.msg_iov = &iovecs[i];
+    msgs[i].msg_hdr.msg_iovlen = 1;
+    msgs[i].msg_hdr.msg_name = &fromAddresses[i];
+    msgs[i].msg_hdr.msg_namelen = sizeof fromAddresses[i];
+  }
+
+  int numPackets = recvmmsg(socket, msgs, maxPackets, MSG_DONTWAIT, NULL);
+  if (numPackets < 0) {
+    int err = env.getErrno();
+    if (err == EAGAIN || err == EWOULDBLOCK
+	|| err == 111 /*ECONNREFUSED*/ || err == 113 /*EHOSTUNREACH*/) {
+      // See the same hack in "readSocket()":
+      bytesRead[0] = 0;
+      fromAddresses[0].sin_addr.s_addr = 0;
+      return 1;
+    }
+    socketErr(env, "recvmmsg() error: ");
+    return -1;
+  }
+  for (int i = 0; i < numPackets; ++i) bytesRead[i] = msgs[i].msg_len;
+  return numPackets;
+#else
+  // No batched receive on this platform; read the one datagram we know is there:
+  int result = readSocket(env, socket, buffers[0], bufferSize, fromAddresses[0]);
+  if (result < 0) return -1;
+  bytesRead[0] = (unsigned)result;
+  return 1;
+#endif
+}
+
+
 int readSocketExact(UsageEnvironment& env,
 		    int socket, unsigned char* buffer, unsigned bufferSize,
 		    struct sockaddr_in& fromAddress,
@@ -329,25 +409,31 @@ int readSocketExact(UsageEnvironment& env,
   return totBytesRead;
 }
 
-Boolean writeSocket(UsageEnvironment& env,
-		    int socket, struct in_addr address, Port port,
-		    u_int8_t ttlArg,
-		    unsigned char* buffer, unsigned bufferSize) {
-	do {
-		if (ttlArg != 0) {
-			// Before sending, set the socket's TTL:
+static Boolean setSocketTTL(UsageEnvironment& env, int socket, u_int8_t ttlArg) {
+	if (ttlArg != 0) {
+		// Before sending, set the socket's TTL:
 #if defined(__WIN32__) || defined(_WIN32)
 #define TTL_TYPE int
 #else
 #define TTL_TYPE u_int8_t
 #endif
-			TTL_TYPE ttl = (TTL_TYPE)ttlArg;
-			if (setsockopt(socket, IPPROTO_IP, IP_MULTICAST_TTL,
-				       (const char*)&ttl, sizeof ttl) < 0) {
-				socketErr(env, "setsockopt(IP_MULTICAST_TTL) error: ");
-				break;
-			}
+		TTL_TYPE ttl = (TTL_TYPE)ttlArg;
+		if (setsockopt(socket, IPPROTO_IP, IP_MULTICAST_TTL,
+			       (const char*)&ttl, sizeof ttl) < 0) {
+			socketErr(env, "setsockopt(IP_MULTICAST_TTL) error: ");
+			return False;
 		}
+	}
+
+	return True;
+}
+
+Boolean writeSocket(UsageEnvironment& env,
+		    int socket, struct in_addr address, Port port,
+		    u_int8_t ttlArg,
+		    unsigned char* buffer, unsigned bufferSize) {
+	do {
+		if (!setSocketTTL(env, socket, ttlArg)) break;
 
 		MAKE_SOCKADDR_IN(dest, address.s_addr, port.num());
 		int bytesSent = sendto(socket, (char*)buffer, bufferSize, 0,
@@ -365,6 +451,54 @@ Boolean writeSocket(UsageEnvironment& env,
 	return False;
 }
 
+Boolean writeSocket(UsageEnvironment& env,
+		    int socket, struct in_addr address, Port port,
+		    u_int8_t ttlArg,
+		    unsigned char* header, unsigned headerSize,
+		    unsigned char* buffer, unsigned bufferSize) {
+	if (headerSize == 0) {
+		return writeSocket(env, socket, address, port, ttlArg,
+				   buffer, bufferSize);
+	}
+
+	do {
+		if (!setSocketTTL(env, socket, ttlArg)) break;
+
+		MAKE_SOCKADDR_IN(dest, address.s_addr, port.num());
+		unsigned totSize = headerSize + bufferSize;
+#if defined(__WIN32__) || defined(_WIN32)
+		WSABUF bufs[2];
+		bufs[0].buf = (char*)header; bufs[0].len = headerSize;
+		bufs[1].buf = (char*)buffer; bufs[1].len = bufferSize;
+		DWORD numBytesSent = 0;
+		int bytesSent = WSASendTo(socket, bufs, 2, &numBytesSent, 0,
+					  (struct sockaddr*)&dest, sizeof dest,
+					  NULL, NULL) == 0 ? (int)numBytesSent : -1;
+#else
+		struct iovec iov[2];
+		iov[0].iov_base = (char*)header; iov[0].iov_len = headerSize;
+		iov[1].iov_base = (char*)buffer; iov[1].iov_len = bufferSize;
+		struct msghdr msg;
+		memset(&msg, 0, sizeof msg);
+		msg.msg_name = &dest;
+		msg.msg_namelen = sizeof dest;
+		msg.msg_iov = iov;
+		msg.msg_iovlen = 2;
+		int bytesSent = sendmsg(socket, &msg, 0);
+#endif
+		if (bytesSent != (int)totSize) {
+			char tmpBuf[100];
+			sprintf(tmpBuf, "writeSocket(%d), sendmsg() error: wrote %d bytes instead of %u: ", socket, bytesSent, totSize);
+			socketErr(env, tmpBuf);
+			break;
+		}
+
+		return True;
+	} while (0);
+
+	return False;
+}
+
 static unsigned getBufferSize(UsageEnvironment& env, int bufOptName,
 			      int socket) {
   unsigned curSize;
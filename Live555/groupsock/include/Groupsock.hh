@@ -44,6 +44,10 @@ public:
   //.address:IPv4ַport:˿ں
   Boolean write(netAddressBits address, Port port, u_int8_t ttl,
 		unsigned char* buffer, unsigned bufferSize);
+  Boolean write(netAddressBits address, Port port, u_int8_t ttl,
+		unsigned char* header, unsigned headerSize,
+		unsigned char* buffer, unsigned bufferSize);
+      // sends "header" and "buffer" as one packet, without copying them
 
 protected:
   OutputSocket(UsageEnvironment& env, Port port);
@@ -123,6 +127,12 @@ public:
   Boolean output(UsageEnvironment& env, u_int8_t ttl,
 		 unsigned char* buffer, unsigned bufferSize,
 		 DirectedNetInterface* interfaceNotToFwdBackTo = NULL);
+  Boolean output(UsageEnvironment& env, u_int8_t ttl,
+		 unsigned char* header, unsigned headerSize,
+		 unsigned char* buffer, unsigned bufferSize,
+		 DirectedNetInterface* interfaceNotToFwdBackTo = NULL);
+      // as above, for a packet that's in two pieces (e.g., a RTP header
+      // that's been rewritten for this destination, and a shared payload)
 
   DirectedNetInterfaceSet& members() { return fMembers; }
 
@@ -148,7 +158,18 @@ public: // redefined virtual functions
 			     unsigned& bytesRead,
 			     struct sockaddr_in& fromAddress);
 
+public:
+  Boolean handleReadBatch(unsigned char** buffers, unsigned bufferMaxSize,
+			  unsigned* bytesRead, struct sockaddr_in* fromAddresses,
+			  unsigned maxPackets, unsigned& numPackets);
+      // Like "handleRead()", but takes up to "maxPackets" queued datagrams at
+      // once (see "readSocketBatch()").  A datagram that is filtered out
+      // (e.g., by SSM) is returned with a "bytesRead[]" of 0.
+
 private:
+  unsigned handleIncomingData(unsigned char* buffer, unsigned numBytes,
+			      struct sockaddr_in& fromAddress);
+      // the per-datagram part of "handleRead()"; returns the usable size
   int outputToAllMembersExcept(DirectedNetInterface* exceptInterface,
 			       u_int8_t ttlToFwd,
 			       unsigned char* data, unsigned size,
@@ -42,10 +42,26 @@ int readSocketExact(UsageEnvironment& env,
     // like "readSocket()", except that it rereads as many times as needed until
     // *exactly* "bufferSize" bytes are read.
 
+int readSocketBatch(UsageEnvironment& env, int socket,
+		    unsigned char** buffers, unsigned bufferSize,
+		    unsigned* bytesRead, struct sockaddr_in* fromAddresses,
+		    unsigned maxPackets);
+    // Reads up to "maxPackets" datagrams into "buffers[]", taking only those that
+    // are already queued, so call it once the socket is readable.  Uses "recvmmsg()"
+    // where available; elsewhere it reads a single datagram, like "readSocket()".
+    // Returns the number of datagrams read (some may be empty), or -1 on error.
+
+Boolean writeSocket(UsageEnvironment& env,
+		    int socket, struct in_addr address, Port port,
+		    u_int8_t ttlArg,
+		    unsigned char* buffer, unsigned bufferSize);
 Boolean writeSocket(UsageEnvironment& env,
 		    int socket, struct in_addr address, Port port,
 		    u_int8_t ttlArg,
+		    unsigned char* header, unsigned headerSize,
 		    unsigned char* buffer, unsigned bufferSize);
+    // Sends "header" followed by "buffer" as a single datagram, without first
+    // copying them together ("sendmsg()", or "WSASendTo()" on Windows).
 
 unsigned getSendBufferSize(UsageEnvironment& env, int socket);
 unsigned getReceiveBufferSize(UsageEnvironment& env, int socket);
@@ -59,6 +75,7 @@ unsigned increaseReceiveBufferTo(UsageEnvironment& env,
 				 int socket, unsigned requestedSize);
 
 Boolean makeSocketNonBlocking(int sock);
+Boolean makeSocketBlocking(int sock);
 
 Boolean socketJoinGroup(UsageEnvironment& env, int socket,
 			netAddressBits groupAddress);
@@ -116,6 +133,21 @@ public:
   ~NoReuse();
 };
 
+// Similarly, to let several processes listen on the same TCP port - with
+// the kernel sharing out the incoming connections between them - enclose
+// the creation of each one's listening socket with:
+//          {
+//            ReusePort dummy;
+//            ...
+//          }
+// (This sets SO_REUSEPORT, where there is such a thing.  On Windoze,
+// SO_REUSEADDR - which is set by default - already lets the port be shared.)
+class ReusePort {
+public:
+  ReusePort();
+  ~ReusePort();
+};
+
 
 #if (defined(__WIN32__) || defined(_WIN32)) && !defined(IMN_PIM)
 // For Windoze, we need to implement our own gettimeofday()
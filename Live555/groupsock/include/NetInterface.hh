@@ -137,14 +137,14 @@ public:
 
   void countPacket(unsigned packetSize);
 
-  float totNumPackets() const {return fTotNumPackets;}
-  float totNumBytes() const {return fTotNumBytes;}
+  double totNumPackets() const {return fTotNumPackets;}
+  double totNumBytes() const {return fTotNumBytes;}
 
   Boolean haveSeenTraffic() const;
 
 private:
-  float fTotNumPackets;
-  float fTotNumBytes;
+  double fTotNumPackets; // (as a "float", these would stop counting
+  double fTotNumBytes;   // after 16 million)
 };
 
 #endif
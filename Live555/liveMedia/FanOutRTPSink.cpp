@@ -0,0 +1,294 @@
+/**********
+This library is free software; you can redistribute it and/or modify it under
+the terms of the GNU Lesser General Public License as published by the
+Free Software Foundation; either version 2.1 of the License, or (at your
+option) any later version. (See <http://www.gnu.org/copyleft/lesser.html>.)
+
+This library is distributed in the hope that it will be useful, but WITHOUT
+ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for
+more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with this library; if not, write to the Free Software Foundation, Inc.,
+51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA
+**********/
+// "liveMedia"
+// Copyright (c) 1996-2009 Live Networks, Inc.  All rights reserved.
+// A RTP sink that sends - as its own RTP stream - the packets that another
+// ("packetizer") sink has already built, rewriting only their RTP headers
+// Implementation
+
+#include "FanOutRTPSink.hh"
+#include "GOPCache.hh"
+#include "GroupsockHelper.hh"
+#include <string.h>
+#include "LogMacros.hh"
+
+#define RTP_HEADER_SIZE 12
+
+FanOutRTPSink* FanOutRTPSink::createNew(UsageEnvironment& env,
+					Groupsock* RTPgs,
+					MultiFramedRTPSink& packetizer) {
+  return new FanOutRTPSink(env, RTPgs, packetizer);
+}
+
+FanOutRTPSink::FanOutRTPSink(UsageEnvironment& env, Groupsock* RTPgs,
+			     MultiFramedRTPSink& packetizer)
+  : RTPSink(env, RTPgs, packetizer.rtpPayloadType(),
+	    packetizer.rtpTimestampFrequency(),
+	    packetizer.rtpPayloadFormatName(), packetizer.numChannels()),
+    fPacketizerName(strDup(packetizer.name())),
+    fMediaType(strDup(packetizer.sdpMediaType())),
+    fNextFanOutSink(NULL), fIsFannedOut(False),
+    fWaitingForFrameStart(False), fHaveSentPacket(False),
+    fSeqNoOffset(0), fTimestampOffset(0), fFirstSeqNo(0),
+    fLastTimestamp(0), fRetimeNextFrame(False),
+    fTimestampOffsets(NULL), fNumTimestampOffsets(0), fMaxNumTimestampOffsets(0),
+    fNumRetransmittedPackets(0), fNextCachedPacket(NULL), fCachedPacketTask(NULL) {
+}
+
+FanOutRTPSink::~FanOutRTPSink() {
+  stopPlaying();
+  delete[] fTimestampOffsets;
+  delete[] fMediaType;
+  delete[] fPacketizerName;
+}
+
+void FanOutRTPSink::startFanOut() {
+  if (fIsFannedOut) return;
+
+  MultiFramedRTPSink* packetizer = lookupPacketizer();
+  if (packetizer == NULL) return;
+
+  fHaveSentPacket = False; // so that our offsets get recomputed
+  fRetimeNextFrame = False;
+  GOPCache* gopCache = packetizer->gopCache();
+  if (gopCache != NULL && gopCache->keyFrameStart() != NULL) {
+    // Start with the cached key frame, and the packets since:
+    DEBUG_LOG(INF, "Send the %u-byte GOP cache first", gopCache->size());
+    fNextCachedPacket = gopCache->keyFrameStart();
+    fNextCachedPacket->addRef();
+    fWaitingForFrameStart = False;
+    gettimeofday(&fNextCachedPacketTime, NULL);
+    fCachedPacketTask
+      = envir().taskScheduler().scheduleDelayedTask(0, sendNextCachedPackets, this);
+  } else {
+    // A video frame's packets are of no use without the first one, so join
+    // (or rejoin, after a pause) once the current frame has been sent - if
+    // the packetizer has started one:
+    fWaitingForFrameStart = strcmp(fMediaType, "video") == 0
+      && packetizer->packetCount() > 0;
+  }
+  packetizer->addFanOutSink(this);
+  fIsFannedOut = True;
+}
+
+void FanOutRTPSink::stopPlaying() {
+  if (fIsFannedOut) {
+    MultiFramedRTPSink* packetizer = lookupPacketizer();
+    if (packetizer != NULL) packetizer->removeFanOutSink(this);
+    fIsFannedOut = False;
+  }
+  stopSendingGOPCache();
+
+  RTPSink::stopPlaying();
+}
+
+char const* FanOutRTPSink::sdpMediaType() const {
+  return fMediaType;
+}
+
+Boolean FanOutRTPSink::continuePlaying() {
+  // We're never played from a source of our own; see "startFanOut()":
+  return False;
+}
+
+MultiFramedRTPSink* FanOutRTPSink::lookupPacketizer() const {
+  RTPSink* sink;
+  if (!RTPSink::lookupByName(envir(), fPacketizerName, sink)) return NULL;
+
+  return (MultiFramedRTPSink*)sink;
+}
+
+void FanOutRTPSink::sendFannedOutPacket(unsigned char* packet,
+					unsigned packetSize,
+					struct timeval presentationTime) {
+  if (packetSize < RTP_HEADER_SIZE) return;
+
+  if (fWaitingForFrameStart) {
+    // Wait for the packet that ends the current frame (its marker bit):
+    if ((packet[1]&0x80) != 0) fWaitingForFrameStart = False;
+    return;
+  }
+  if (fNextCachedPacket != NULL) return; // we'll get to it, in the cache
+
+  if (fRetimeNextFrame) {
+    // The first live frame after the GOP cache (which may have ended partway
+    // through a frame) is timestamped with the time it was captured:
+    u_int32_t timestamp = ntohl(*(u_int32_t*)&packet[4]);
+    if (timestamp != fLastTimestamp) {
+      retimeFrame(timestamp, presentationTime);
+      fRetimeNextFrame = False;
+    }
+  }
+  sendRewrittenPacket(packet, packetSize, presentationTime);
+}
+
+void FanOutRTPSink::sendRewrittenPacket(unsigned char* packet,
+					unsigned packetSize,
+					struct timeval presentationTime) {
+  u_int16_t seqNo = (packet[2]<<8)|packet[3];
+  u_int32_t timestamp = ntohl(*(u_int32_t*)&packet[4]);
+  if (!fHaveSentPacket) {
+    // Our sequence numbers and timestamps carry on from where
+    // "currentSeqNo()" and "presetNextTimestamp()" (used for the RTSP
+    // "RTP-Info:") left them.  From then on, they're a fixed offset from the
+    // packetizer's, which is all that our per-packet work amounts to:
+    fSeqNoOffset = fSeqNo - seqNo;
+    fFirstSeqNo = fSeqNo;
+    fNumTimestampOffsets = 0;
+    retimeFrame(timestamp, presentationTime);
+    fHaveSentPacket = True;
+  } else if (fNumTimestampOffsets > 0
+	     && (u_int16_t)(fSeqNo - fTimestampOffsets[fNumTimestampOffsets-1].seqNo)
+	        >= 0x8000) {
+    // Those offsets are for packets long gone (and would soon look new):
+    fNumTimestampOffsets = 0;
+  }
+  fSeqNo = seqNo + fSeqNoOffset;
+  fCurrentTimestamp = timestamp + fTimestampOffset;
+  fLastTimestamp = timestamp;
+
+  // Our own header (the packetizer's first two bytes: V, P, X, CC, M, PT),
+  // then the packetizer's payload, from where it is:
+  fHeader[0] = packet[0]; fHeader[1] = packet[1];
+  fHeader[2] = fSeqNo>>8; fHeader[3] = (unsigned char)fSeqNo;
+  *(u_int32_t*)&fHeader[4] = htonl(fCurrentTimestamp);
+  *(u_int32_t*)&fHeader[8] = htonl(SSRC());
+  fRTPInterface.sendPacket(fHeader, RTP_HEADER_SIZE,
+			   &packet[RTP_HEADER_SIZE], packetSize - RTP_HEADER_SIZE);
+
+  ++fPacketCount;
+  fOctetCount += packetSize - RTP_HEADER_SIZE;
+  fTotalOctetCount += packetSize;
+  ++fSeqNo; // for "currentSeqNo()"
+}
+
+void FanOutRTPSink::retransmitPacket(u_int16_t seqNo) {
+  // Only packets that we've sent since starting can be found again:
+  if (!fHaveSentPacket
+      || (u_int16_t)(seqNo - fFirstSeqNo) >= (u_int16_t)(fSeqNo - fFirstSeqNo)) {
+    return;
+  }
+  MultiFramedRTPSink* packetizer = lookupPacketizer();
+  if (packetizer == NULL) return;
+
+  unsigned packetSize;
+  unsigned char* packet
+    = packetizer->sentPacket((u_int16_t)(seqNo - fSeqNoOffset), packetSize);
+  if (packet == NULL || packetSize < RTP_HEADER_SIZE) return;
+  ++fNumRetransmittedPackets;
+
+  unsigned char header[RTP_HEADER_SIZE];
+  u_int32_t timestamp
+    = ntohl(*(u_int32_t*)&packet[4]) + timestampOffsetFor(seqNo);
+  header[0] = packet[0]; header[1] = packet[1];
+  header[2] = seqNo>>8; header[3] = (unsigned char)seqNo;
+  *(u_int32_t*)&header[4] = htonl(timestamp);
+  *(u_int32_t*)&header[8] = htonl(SSRC());
+
+  DEBUG_LOG(INF, "Retransmit fanned-out packet %u (%u bytes)", seqNo, packetSize);
+  fRTPInterface.sendPacket(header, RTP_HEADER_SIZE,
+			   &packet[RTP_HEADER_SIZE], packetSize - RTP_HEADER_SIZE);
+  fTotalOctetCount += packetSize;
+}
+
+void FanOutRTPSink::sendNextCachedPackets(void* clientData) {
+  ((FanOutRTPSink*)clientData)->sendNextCachedPackets1();
+}
+
+void FanOutRTPSink::sendNextCachedPackets1() {
+  fCachedPacketTask = NULL;
+  MultiFramedRTPSink* packetizer = lookupPacketizer();
+  if (packetizer == NULL) {
+    stopSendingGOPCache();
+    return;
+  }
+  unsigned burstRate = packetizer->gopBurstRate(); // kbps; 0 means no limit
+
+  struct timeval timeNow;
+  gettimeofday(&timeNow, NULL);
+  while (fNextCachedPacket != NULL) {
+    int uSecondsToGo
+      = (fNextCachedPacketTime.tv_sec - timeNow.tv_sec)*1000000
+      + (fNextCachedPacketTime.tv_usec - timeNow.tv_usec);
+    if (uSecondsToGo > 0) {
+      fCachedPacketTask = envir().taskScheduler()
+	.scheduleDelayedTask(uSecondsToGo, sendNextCachedPackets, this);
+      return;
+    }
+
+    // Each frame's timestamp is rebased to now (its presentation time is
+    // gone), so that the viewer catches up with the live stream as it gets
+    // them, rather than playing them at their original pace:
+    CachedRTPPacket* packet = fNextCachedPacket;
+    if (fHaveSentPacket && packet->size() >= RTP_HEADER_SIZE) {
+      u_int32_t timestamp = ntohl(*(u_int32_t*)&packet->data()[4]);
+      if (timestamp != fLastTimestamp) retimeFrame(timestamp, timeNow);
+    }
+    sendRewrittenPacket(packet->data(), packet->size(), timeNow);
+    if (burstRate > 0) {
+      fNextCachedPacketTime.tv_usec += packet->size()*8000/burstRate;
+      fNextCachedPacketTime.tv_sec += fNextCachedPacketTime.tv_usec/1000000;
+      fNextCachedPacketTime.tv_usec %= 1000000;
+    }
+
+    fNextCachedPacket = packet->next();
+    if (fNextCachedPacket != NULL) fNextCachedPacket->addRef();
+    CachedRTPPacket::release(packet);
+  }
+  // We've caught up.  From now on, the packetizer's packets are sent as it
+  // sends them.
+  DEBUG_LOG(INF, "Sent the GOP cache; now live");
+  fRetimeNextFrame = True;
+}
+
+void FanOutRTPSink::stopSendingGOPCache() {
+  envir().taskScheduler().unscheduleDelayedTask(fCachedPacketTask);
+  CachedRTPPacket::release(fNextCachedPacket);
+}
+
+void FanOutRTPSink::retimeFrame(u_int32_t timestamp, struct timeval timeNow) {
+  u_int32_t newTimestamp = convertToRTPTimestamp(timeNow);
+  if (fHaveSentPacket && (int32_t)(newTimestamp - fCurrentTimestamp) <= 0) {
+    // (e.g. a frame captured before the last of the GOP cache was sent)
+    newTimestamp = fCurrentTimestamp + 1;
+  }
+  fTimestampOffset = newTimestamp - timestamp;
+
+  // Remember it, from the next packet that we send:
+  if (fNumTimestampOffsets == fMaxNumTimestampOffsets) {
+    fMaxNumTimestampOffsets = fMaxNumTimestampOffsets == 0 ? 16
+      : 2*fMaxNumTimestampOffsets;
+    TimestampOffset* offsets = new TimestampOffset[fMaxNumTimestampOffsets];
+    for (unsigned i = 0; i < fNumTimestampOffsets; ++i) {
+      offsets[i] = fTimestampOffsets[i];
+    }
+    delete[] fTimestampOffsets; fTimestampOffsets = offsets;
+  }
+  fTimestampOffsets[fNumTimestampOffsets].seqNo = fSeqNo;
+  fTimestampOffsets[fNumTimestampOffsets].offset = fTimestampOffset;
+  ++fNumTimestampOffsets;
+}
+
+u_int32_t FanOutRTPSink::timestampOffsetFor(u_int16_t seqNo) const {
+  // The latest offset that was in use when we sent "seqNo":
+  u_int16_t age = fSeqNo - seqNo;
+  for (unsigned i = fNumTimestampOffsets; i > 0; --i) {
+    if ((u_int16_t)(fSeqNo - fTimestampOffsets[i-1].seqNo) >= age) {
+      return fTimestampOffsets[i-1].offset;
+    }
+  }
+  return fTimestampOffset;
+}
@@ -22,9 +22,13 @@ along with this library; if not, write to the Free Software Foundation, Inc.,
 #include <io.h>
 #include <fcntl.h>
 #endif
+#if !defined(__WIN32__) && !defined(_WIN32)
+#include <sys/uio.h>
+#endif
 #include "FileSink.hh"
 #include "GroupsockHelper.hh"
 #include "OutputFile.hh"
+#include "MultiFramedRTPSource.hh"
 
 ////////// FileSink //////////
 
@@ -113,10 +117,78 @@ void FileSink::addData(unsigned char* data, unsigned dataSize,
   }
 }
 
+#if !defined(__WIN32__) && !defined(_WIN32)
+#define MAX_IOVECS_PER_WRITE 64
+
+static void writevAll(int fd, struct iovec* iov, int iovCount) {
+  while (iovCount > 0) {
+    ssize_t bytesWritten = writev(fd, iov, iovCount);
+    if (bytesWritten < 0) {
+      if (errno == EINTR) continue;
+      return; // as with "fwrite()" in "addData()", errors are noticed later
+    }
+
+    // Skip over whatever got written, in case this was a partial write:
+    while (iovCount > 0 && (size_t)bytesWritten >= iov->iov_len) {
+      bytesWritten -= iov->iov_len;
+      ++iov; --iovCount;
+    }
+    if (iovCount > 0) {
+      iov->iov_base = (char*)iov->iov_base + bytesWritten;
+      iov->iov_len -= bytesWritten;
+    }
+  }
+}
+#endif
+
+void FileSink::addFragments(unsigned char* header, unsigned headerSize,
+			    FrameFragments const& fragments,
+			    struct timeval presentationTime) {
+  if (fPerFrameFileNameBuffer != NULL) {
+    // Special case: Open a new file on-the-fly for this frame
+    sprintf(fPerFrameFileNameBuffer, "%s-%lu.%06lu", fPerFrameFileNamePrefix,
+	    presentationTime.tv_sec, presentationTime.tv_usec);
+    fOutFid = OpenOutputFile(envir(), fPerFrameFileNameBuffer);
+  }
+  if (fOutFid == NULL) return;
+
+#if !defined(__WIN32__) && !defined(_WIN32)
+  fflush(fOutFid); // anything written through "fOutFid" must go first
+  int fd = fileno(fOutFid);
+
+  struct iovec iov[MAX_IOVECS_PER_WRITE];
+  int iovCount = 0;
+  if (headerSize > 0) {
+    iov[iovCount].iov_base = (char*)header;
+    iov[iovCount].iov_len = headerSize;
+    ++iovCount;
+  }
+  for (unsigned i = 0; i < fragments.numFragments(); ++i) {
+    if (iovCount == MAX_IOVECS_PER_WRITE) {
+      writevAll(fd, iov, iovCount);
+      iovCount = 0;
+    }
+    iov[iovCount].iov_base = (char*)fragments.fragmentData(i);
+    iov[iovCount].iov_len = fragments.fragmentSize(i);
+    ++iovCount;
+  }
+  writevAll(fd, iov, iovCount);
+#else
+  // No "writev()"; at least write each piece from where it is:
+  if (headerSize > 0) fwrite(header, 1, headerSize, fOutFid);
+  for (unsigned i = 0; i < fragments.numFragments(); ++i) {
+    fwrite(fragments.fragmentData(i), 1, fragments.fragmentSize(i), fOutFid);
+  }
+#endif
+}
+
 void FileSink::afterGettingFrame1(unsigned frameSize,
 				  struct timeval presentationTime) {
   addData(fBuffer, frameSize, presentationTime);
+  afterWritingFrame();
+}
 
+void FileSink::afterWritingFrame() {
   if (fOutFid == NULL || fflush(fOutFid) == EOF) {
     // The output file has closed.  Handle this the same way as if the
     // input source had closed:
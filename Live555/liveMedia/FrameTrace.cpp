@@ -0,0 +1,346 @@
+/**********
+This library is free software; you can redistribute it and/or modify it under
+the terms of the GNU Lesser General Public License as published by the
+Free Software Foundation; either version 2.1 of the License, or (at your
+option) any later version. (See <http://www.gnu.org/copyleft/lesser.html>.)
+
+This library is distributed in the hope that it will be useful, but WITHOUT
+ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for
+more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with this library; if not, write to the Free Software Foundation, Inc.,
+51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA
+**********/
+// "liveMedia"
+// Copyright (c) 1996-2009 Live Networks, Inc.  All rights reserved.
+// Per-frame timestamps at each stage of a live frame's way from the camera
+// to the network, kept in a lock-free ring
+// Implementation
+
+#include "FrameTrace.hh"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#if !defined(__WIN32__) && !defined(_WIN32)
+#include <time.h>
+#endif
+
+struct FrameTrace::Record {
+  unsigned volatile frameId; // 0 while it's being (re)written
+  struct timeval presentationTime;
+  u_int64_t stamps[NUM_STAGES]; // 0: not (yet) passed
+};
+
+Boolean FrameTrace::fIsEnabled = False;
+FrameTrace::Record* FrameTrace::fRing = NULL;
+unsigned volatile FrameTrace::fLastFrameId = 0;
+
+// A packet's frame is looked for among this many of the latest:
+#define LOOKUP_DEPTH 64
+
+static unsigned atomicIncrement(unsigned volatile* value) {
+#if defined(__WIN32__) || defined(_WIN32)
+  return (unsigned)InterlockedIncrement((LONG volatile*)value);
+#else
+  return __sync_add_and_fetch(value, 1);
+#endif
+}
+
+static void memoryBarrier() {
+#if defined(__WIN32__) || defined(_WIN32)
+  MemoryBarrier();
+#else
+  __sync_synchronize();
+#endif
+}
+
+void FrameTrace::enable(Boolean enabled) {
+  if (enabled && fRing == NULL) {
+    // (Never freed: another thread may still be stamping)
+    fRing = new Record[RING_SIZE];
+    memset((void*)fRing, 0, RING_SIZE*sizeof(Record));
+  }
+  fIsEnabled = enabled;
+}
+
+u_int64_t FrameTrace::now() {
+#if defined(__WIN32__) || defined(_WIN32)
+  LARGE_INTEGER counter;
+  QueryPerformanceCounter(&counter);
+  return (u_int64_t)counter.QuadPart;
+#else
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (u_int64_t)ts.tv_sec*1000000000 + ts.tv_nsec;
+#endif
+}
+
+u_int64_t FrameTrace::ticksPerSecond() {
+#if defined(__WIN32__) || defined(_WIN32)
+  static u_int64_t frequency = 0;
+  if (frequency == 0) {
+    LARGE_INTEGER f;
+    QueryPerformanceFrequency(&f);
+    frequency = (u_int64_t)f.QuadPart;
+  }
+  return frequency;
+#else
+  return 1000000000;
+#endif
+}
+
+unsigned FrameTrace::beginFrame() {
+  if (!fIsEnabled) return 0;
+
+  unsigned frameId = atomicIncrement(&fLastFrameId);
+  if (frameId == 0) frameId = atomicIncrement(&fLastFrameId); // it wrapped
+  Record& record = fRing[frameId%RING_SIZE];
+  record.frameId = 0;
+  memoryBarrier();
+  record.presentationTime.tv_sec = record.presentationTime.tv_usec = 0;
+  memset(record.stamps, 0, sizeof record.stamps);
+  record.stamps[CAPTURE_STARTED] = now();
+  memoryBarrier();
+  record.frameId = frameId;
+
+  return frameId;
+}
+
+void FrameTrace::setPresentationTime(unsigned frameId,
+				     struct timeval const& presentationTime) {
+  if (frameId == 0) return;
+
+  Record& record = fRing[frameId%RING_SIZE];
+  if (record.frameId == frameId) record.presentationTime = presentationTime;
+}
+
+void FrameTrace::mark(unsigned frameId, Stage stage) {
+  if (frameId == 0) return;
+
+  mark(frameId, stage, now());
+}
+
+void FrameTrace::mark(unsigned frameId, Stage stage, u_int64_t ticks) {
+  if (frameId == 0 || ticks == 0) return;
+
+  Record& record = fRing[frameId%RING_SIZE];
+  if (record.frameId != frameId || record.stamps[stage] != 0) return;
+  record.stamps[stage] = ticks;
+}
+
+void FrameTrace::markPacketSent(struct timeval const& presentationTime,
+				Boolean isLastPacketOfFrame) {
+  if (!fIsEnabled) return;
+
+  unsigned frameId = lookupFrame(presentationTime);
+  if (frameId == 0) return; // not a traced frame
+
+  u_int64_t timeNow = now();
+  mark(frameId, FIRST_PACKET_SENT, timeNow);
+  if (isLastPacketOfFrame) mark(frameId, LAST_PACKET_SENT, timeNow);
+}
+
+unsigned FrameTrace::lookupFrame(struct timeval const& presentationTime) {
+  // A frame's packets are sent one after another, so remember the last:
+  static struct timeval lastPresentationTime;
+  static unsigned lastFrameId = 0;
+  if (lastFrameId != 0
+      && presentationTime.tv_sec == lastPresentationTime.tv_sec
+      && presentationTime.tv_usec == lastPresentationTime.tv_usec
+      && fRing[lastFrameId%RING_SIZE].frameId == lastFrameId) {
+    return lastFrameId;
+  }
+
+  unsigned newestFrameId = fLastFrameId;
+  for (unsigned i = 0; i < LOOKUP_DEPTH && i < RING_SIZE; ++i) {
+    unsigned frameId = newestFrameId - i;
+    if (frameId == 0) break;
+
+    Record const& record = fRing[frameId%RING_SIZE];
+    if (record.frameId == frameId
+	&& record.presentationTime.tv_sec == presentationTime.tv_sec
+	&& record.presentationTime.tv_usec == presentationTime.tv_usec) {
+      lastPresentationTime = presentationTime;
+      lastFrameId = frameId;
+      return frameId;
+    }
+  }
+  return 0;
+}
+
+Boolean FrameTrace::copyRecord(unsigned frameId, Record& result) {
+  Record const& record = fRing[frameId%RING_SIZE];
+  if (frameId == 0 || record.frameId != frameId) return False;
+
+  memoryBarrier();
+  memcpy(&result, (void const*)&record, sizeof result);
+  memoryBarrier();
+  // It mustn't have been reused while we were copying it:
+  return record.frameId == frameId && result.frameId == frameId;
+}
+
+// The spans between stages that are reported.  Without "GRABBED" (a camera
+// that doesn't say), "capture" includes the conversion:
+static struct {
+  char const* name;
+  FrameTrace::Stage from, to;
+} const spans[] = {
+  { "capture", FrameTrace::CAPTURE_STARTED, FrameTrace::GRABBED },
+  { "convert", FrameTrace::GRABBED, FrameTrace::CONVERTED },
+  { "encode", FrameTrace::CONVERTED, FrameTrace::ENCODED },
+  { "packetize", FrameTrace::ENCODED, FrameTrace::FIRST_PACKET_SENT },
+  { "send", FrameTrace::FIRST_PACKET_SENT, FrameTrace::LAST_PACKET_SENT },
+  { "total", FrameTrace::CAPTURE_STARTED, FrameTrace::LAST_PACKET_SENT }
+};
+#define NUM_SPANS (sizeof spans/sizeof spans[0])
+
+static Boolean getSpan(u_int64_t const* stamps, unsigned span,
+		       u_int64_t& from, u_int64_t& to) {
+  from = stamps[spans[span].from];
+  to = stamps[spans[span].to];
+  if (spans[span].to == FrameTrace::GRABBED && to == 0) {
+    to = stamps[FrameTrace::CONVERTED];
+  }
+  return from != 0 && to >= from;
+}
+
+Boolean FrameTrace::writeChromeTrace(char const* fileName) {
+  if (fRing == NULL) return False;
+  FILE* fid = fopen(fileName, "w");
+  if (fid == NULL) return False;
+
+  double const usPerTick = 1000000.0/ticksPerSecond();
+  unsigned const newestFrameId = fLastFrameId;
+  unsigned const numFrames
+    = newestFrameId < (unsigned)RING_SIZE ? newestFrameId : (unsigned)RING_SIZE;
+  u_int64_t base = 0; // the oldest frame's capture: time 0
+  char const* separator = "";
+
+  fprintf(fid, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[");
+  // A row (or "thread") per span, in order:
+  for (unsigned s = 0; s + 1 < NUM_SPANS; ++s) {
+    fprintf(fid, "%s\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%u,"
+	    "\"args\":{\"name\":\"%u %s\"}}", separator, s + 1, s + 1, spans[s].name);
+    separator = ",";
+  }
+  for (unsigned i = numFrames; i > 0; --i) {
+    Record record;
+    if (!copyRecord(newestFrameId - i + 1, record)) continue;
+    if (base == 0) base = record.stamps[CAPTURE_STARTED];
+
+    for (unsigned s = 0; s < NUM_SPANS; ++s) {
+      u_int64_t from, to;
+      if (!getSpan(record.stamps, s, from, to)) continue;
+      double ts = (double)(int64_t)(from - base)*usPerTick;
+      if (s + 1 < NUM_SPANS) {
+	fprintf(fid, "%s\n{\"name\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":%u,"
+		"\"ts\":%.3f,\"dur\":%.3f,\"args\":{\"frame\":%u}}",
+		separator, spans[s].name, s + 1, ts, (to - from)*usPerTick,
+		record.frameId);
+      } else {
+	// The whole frame, which may overlap the next:
+	fprintf(fid, "%s\n{\"name\":\"frame %u\",\"cat\":\"frame\",\"ph\":\"b\","
+		"\"id\":%u,\"pid\":1,\"tid\":0,\"ts\":%.3f}", separator,
+		record.frameId, record.frameId, ts);
+	fprintf(fid, ",\n{\"name\":\"frame %u\",\"cat\":\"frame\",\"ph\":\"e\","
+		"\"id\":%u,\"pid\":1,\"tid\":0,\"ts\":%.3f}",
+		record.frameId, record.frameId, ts + (to - from)*usPerTick);
+      }
+      separator = ",";
+    }
+  }
+  fprintf(fid, "\n]}\n");
+
+  Boolean ok = ferror(fid) == 0;
+  fclose(fid);
+  return ok;
+}
+
+static int compareDoubles(void const* a, void const* b) {
+  double x = *(double const*)a, y = *(double const*)b;
+  return x < y ? -1 : x > y ? 1 : 0;
+}
+
+// As HdrHistogram's "outputPercentileDistribution()" (with 5 reporting
+// ticks per half distance), but from the (sorted) values themselves:
+static void writePercentileDistribution(FILE* fid, double const* values,
+					unsigned numValues) {
+  fprintf(fid, "%12s %14s %10s %14s\n\n",
+	  "Value", "Percentile", "TotalCount", "1/(1-Percentile)");
+
+  double sum = 0.0, sumOfSquares = 0.0;
+  for (unsigned i = 0; i < numValues; ++i) {
+    sum += values[i];
+    sumOfSquares += values[i]*values[i];
+  }
+  if (numValues > 0) {
+    double percentile = 0.0;
+    while (1) {
+      unsigned count = (unsigned)(percentile/100.0*numValues + 0.999999);
+      if (count == 0) count = 1;
+      if (count >= numValues) break;
+
+      fprintf(fid, "%12.3f %2.12f %10u %14.2f\n", values[count - 1],
+	      percentile/100.0, count, 1.0/(1.0 - percentile/100.0));
+      // Halve the distance to 100% every 5 lines:
+      double halvings = floor(log(100.0/(100.0 - percentile))/log(2.0));
+      percentile += 100.0/(5*pow(2.0, halvings + 1));
+    }
+    fprintf(fid, "%12.3f %2.12f %10u\n", values[numValues - 1], 1.0, numValues);
+  }
+
+  double mean = numValues > 0 ? sum/numValues : 0.0;
+  double variance = numValues > 0 ? sumOfSquares/numValues - mean*mean : 0.0;
+  fprintf(fid, "#[Mean    = %12.3f, StdDeviation   = %12.3f]\n",
+	  mean, variance > 0.0 ? sqrt(variance) : 0.0);
+  fprintf(fid, "#[Max     = %12.3f, Total count    = %12u]\n",
+	  numValues > 0 ? values[numValues - 1] : 0.0, numValues);
+}
+
+Boolean FrameTrace::writeHistograms(char const* fileNamePrefix) {
+  if (fRing == NULL) return False;
+
+  double const msPerTick = 1000.0/ticksPerSecond();
+  unsigned const newestFrameId = fLastFrameId;
+  unsigned const numFrames
+    = newestFrameId < (unsigned)RING_SIZE ? newestFrameId : (unsigned)RING_SIZE;
+  double* values = new double[NUM_SPANS*RING_SIZE];
+  unsigned numValues[NUM_SPANS];
+  memset(numValues, 0, sizeof numValues);
+
+  for (unsigned i = numFrames; i > 0; --i) {
+    Record record;
+    if (!copyRecord(newestFrameId - i + 1, record)) continue;
+    if (record.stamps[LAST_PACKET_SENT] == 0) continue; // not yet all sent
+
+    for (unsigned s = 0; s < NUM_SPANS; ++s) {
+      u_int64_t from, to;
+      if (!getSpan(record.stamps, s, from, to)) continue;
+      values[s*RING_SIZE + numValues[s]++] = (to - from)*msPerTick;
+    }
+  }
+
+  Boolean ok = True;
+  char* fileName = new char[strlen(fileNamePrefix) + 20];
+  for (unsigned s = 0; s < NUM_SPANS; ++s) {
+    if (numValues[s] == 0) continue;
+
+    sprintf(fileName, "%s-%s.hgrm", fileNamePrefix, spans[s].name);
+    FILE* fid = fopen(fileName, "w");
+    if (fid == NULL) {
+      ok = False;
+      continue;
+    }
+    qsort(&values[s*RING_SIZE], numValues[s], sizeof (double), compareDoubles);
+    writePercentileDistribution(fid, &values[s*RING_SIZE], numValues[s]);
+    if (ferror(fid) != 0) ok = False;
+    fclose(fid);
+  }
+  delete[] fileName;
+  delete[] values;
+
+  return ok;
+}
@@ -0,0 +1,91 @@
+/**********
+This library is free software; you can redistribute it and/or modify it under
+the terms of the GNU Lesser General Public License as published by the
+Free Software Foundation; either version 2.1 of the License, or (at your
+option) any later version. (See <http://www.gnu.org/copyleft/lesser.html>.)
+
+This library is distributed in the hope that it will be useful, but WITHOUT
+ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for
+more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with this library; if not, write to the Free Software Foundation, Inc.,
+51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA
+**********/
+// "liveMedia"
+// Copyright (c) 1996-2009 Live Networks, Inc.  All rights reserved.
+// A cache of the RTP packets sent since the last key frame, so that a new
+// viewer of a live stream can start decoding at once
+// Implementation
+
+#include "GOPCache.hh"
+#include <string.h>
+#include "LogMacros.hh"
+
+////////// CachedRTPPacket //////////
+
+CachedRTPPacket::CachedRTPPacket(unsigned char const* packet,
+				 unsigned packetSize)
+  : fRefCount(1), fNext(NULL), fSize(packetSize) {
+  fData = new unsigned char[packetSize];
+  memcpy(fData, packet, packetSize);
+}
+
+CachedRTPPacket::~CachedRTPPacket() {
+  delete[] fData;
+}
+
+void CachedRTPPacket::release(CachedRTPPacket*& packet) {
+  // Free each packet that this leaves unreferenced, in turn (rather than
+  // recursively, as a long chain could overflow the stack):
+  CachedRTPPacket* p = packet;
+  packet = NULL;
+  while (p != NULL && --p->fRefCount == 0) {
+    CachedRTPPacket* next = p->fNext;
+    delete p;
+    p = next;
+  }
+}
+
+////////// GOPCache //////////
+
+GOPCache::GOPCache(unsigned maxSize)
+  : fMaxSize(maxSize), fSize(0), fKeyFrameStart(NULL), fLastPacket(NULL) {
+}
+
+GOPCache::~GOPCache() {
+  CachedRTPPacket::release(fKeyFrameStart);
+  CachedRTPPacket::release(fLastPacket);
+}
+
+void GOPCache::addPacket(unsigned char const* packet, unsigned packetSize,
+			 Boolean startsKeyFrame) {
+  if (startsKeyFrame) {
+    // The previous group of pictures is no longer needed (by us):
+    CachedRTPPacket::release(fKeyFrameStart);
+    fSize = 0;
+  } else if (fKeyFrameStart == NULL) {
+    // We're waiting for a key frame, but a reader may still need this:
+    if (fLastPacket == NULL) return;
+  }
+
+  CachedRTPPacket* newPacket = new CachedRTPPacket(packet, packetSize);
+  if (fLastPacket != NULL) {
+    fLastPacket->fNext = newPacket; newPacket->addRef();
+    CachedRTPPacket::release(fLastPacket); // freed if no one else needs it
+  }
+  fLastPacket = newPacket;
+
+  if (startsKeyFrame) {
+    fKeyFrameStart = newPacket; newPacket->addRef();
+  }
+  if (fKeyFrameStart != NULL) {
+    fSize += packetSize;
+    if (fSize > fMaxSize) {
+      DEBUG_LOG(INF, "Group of pictures is over %u bytes; dropping it", fMaxSize);
+      CachedRTPPacket::release(fKeyFrameStart);
+      fSize = 0;
+    }
+  }
+}
@@ -0,0 +1,685 @@
+/**********
+This library is free software; you can redistribute it and/or modify it under
+the terms of the GNU Lesser General Public License as published by the
+Free Software Foundation; either version 2.1 of the License, or (at your
+option) any later version. (See <http://www.gnu.org/copyleft/lesser.html>.)
+
+This library is distributed in the hope that it will be useful, but WITHOUT
+ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for
+more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with this library; if not, write to the Free Software Foundation, Inc.,
+51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA
+**********/
+// "liveMedia"
+// Copyright (c) 1996-2009 Live Networks, Inc.  All rights reserved.
+// A ladder of live H.264 streams - the one camera, encoded at several sizes
+// and bitrates at once - for viewers to choose from
+// Implementation
+
+#if defined(__WIN32__) || defined(_WIN32)
+#include <windows.h>
+#include <process.h>
+#else
+#include <pthread.h>
+#include <semaphore.h>
+#endif
+#include <stdio.h>
+#include <string.h>
+
+#include "H264SimulcastEncoder.hh"
+#include "ICameraCaptuer.h"
+#include "H264EndWrapper.h"
+#include "scale.h"
+#include "MetricsRegistry.hh"
+#include "FrameTrace.hh"
+#include "Base64.hh"
+#include "GroupsockHelper.hh" // gettimeofday
+#include "LogMacros.hh"
+
+// Access units that a source holds for its reader: a second, at 25 fps
+#define SIMULCAST_QUEUE_SIZE 25
+// Each rung's encoder holds its encode time at this percentage of the frame
+// interval, and codes a frame that the camera's noise alone has changed as
+// a skip frame (see H264EncWrapper)
+#define SIMULCAST_SPEED_TARGET 70
+#define SIMULCAST_STATIC_THRESHOLD 3.0f
+
+static MetricsCounter simulcastFrames("simulcast_frames_total",
+				      "Camera frames captured for the simulcast ladder");
+static MetricsCounter simulcastCaptureSeconds("simulcast_capture_seconds_total",
+					      "Time spent waiting for, and converting, the ladder's camera frames");
+static MetricsCounter simulcastEncodeSeconds("simulcast_encode_seconds_total",
+					     "Time spent scaling and encoding each frame, for all of the ladder's rungs at once");
+static MetricsCounter simulcastBytes("simulcast_bytes_total",
+				     "Bytes of NAL units that the ladder's encoders output");
+static MetricsCounter simulcastDropped("simulcast_access_units_dropped_total",
+				       "Access units dropped by simulcast sources whose readers fell behind");
+static MetricsGauge simulcastOpenRungs("simulcast_open_rungs",
+				       "Rungs of the simulcast ladder being encoded");
+
+////////// H264SimulcastWorkers //////////
+
+// A few threads, each running jobs - a frame's rungs - as it takes them from
+// a shared counter; "run()" returns once all of a batch's jobs are done.
+// (The thread that calls "run()" takes jobs too, so a batch of "n" jobs needs
+// only "n"-1 workers.)
+
+#if defined(__WIN32__) || defined(_WIN32)
+typedef HANDLE Semaphore;
+typedef HANDLE Thread;
+static void semaphoreInit(Semaphore& s) { s = CreateSemaphore(NULL, 0, 0x7FFFFFFF, NULL); }
+static void semaphorePost(Semaphore& s, unsigned count) { ReleaseSemaphore(s, count, NULL); }
+static void semaphoreWait(Semaphore& s) { WaitForSingleObject(s, INFINITE); }
+static void semaphoreDestroy(Semaphore& s) { CloseHandle(s); }
+static unsigned atomicIncrement(unsigned volatile& value) {
+  return (unsigned)InterlockedIncrement((LONG volatile*)&value);
+}
+#define THREAD_RESULT unsigned __stdcall
+#else
+typedef sem_t Semaphore;
+typedef pthread_t Thread;
+static void semaphoreInit(Semaphore& s) { sem_init(&s, 0, 0); }
+static void semaphorePost(Semaphore& s, unsigned count) {
+  while (count-- > 0) sem_post(&s);
+}
+static void semaphoreWait(Semaphore& s) { while (sem_wait(&s) != 0) {} }
+static void semaphoreDestroy(Semaphore& s) { sem_destroy(&s); }
+static unsigned atomicIncrement(unsigned volatile& value) {
+  return __sync_add_and_fetch(&value, 1);
+}
+#define THREAD_RESULT void*
+#endif
+
+class H264SimulcastWorkers {
+public:
+  typedef void (JobFunc)(void* clientData, unsigned jobIndex);
+
+  H264SimulcastWorkers(unsigned numThreads);
+  ~H264SimulcastWorkers();
+
+  void run(JobFunc* func, void* clientData, unsigned numJobs);
+
+private:
+  static THREAD_RESULT threadMain(void* clientData);
+  void doJobs();
+
+private:
+  unsigned fNumThreads;
+  Thread* fThreads;
+  Semaphore fStart, fDone;
+  Boolean volatile fQuit;
+  // The batch being run:
+  JobFunc* fFunc;
+  void* fClientData;
+  unsigned fNumJobs;
+  unsigned volatile fNextJob;
+};
+
+H264SimulcastWorkers::H264SimulcastWorkers(unsigned numThreads)
+  : fNumThreads(0), fThreads(NULL), fQuit(False),
+    fFunc(NULL), fClientData(NULL), fNumJobs(0), fNextJob(0) {
+  semaphoreInit(fStart);
+  semaphoreInit(fDone);
+  if (numThreads == 0) return;
+
+  fThreads = new Thread[numThreads];
+  for (unsigned i = 0; i < numThreads; ++i) {
+#if defined(__WIN32__) || defined(_WIN32)
+    fThreads[fNumThreads] = (HANDLE)_beginthreadex(NULL, 0, threadMain, this, 0, NULL);
+    if (fThreads[fNumThreads] == 0) break;
+#else
+    if (pthread_create(&fThreads[fNumThreads], NULL, threadMain, this) != 0) break;
+#endif
+    ++fNumThreads;
+  }
+  // (If we have fewer threads than we asked for, batches just take longer.)
+}
+
+H264SimulcastWorkers::~H264SimulcastWorkers() {
+  fQuit = True;
+  semaphorePost(fStart, fNumThreads);
+  for (unsigned i = 0; i < fNumThreads; ++i) {
+#if defined(__WIN32__) || defined(_WIN32)
+    WaitForSingleObject(fThreads[i], INFINITE);
+    CloseHandle(fThreads[i]);
+#else
+    pthread_join(fThreads[i], NULL);
+#endif
+  }
+  delete[] fThreads;
+  semaphoreDestroy(fStart);
+  semaphoreDestroy(fDone);
+}
+
+void H264SimulcastWorkers::run(JobFunc* func, void* clientData, unsigned numJobs) {
+  fFunc = func;
+  fClientData = clientData;
+  fNumJobs = numJobs;
+  fNextJob = 0;
+
+  unsigned numHelpers = numJobs > 0 ? numJobs - 1 : 0;
+  if (numHelpers > fNumThreads) numHelpers = fNumThreads;
+  semaphorePost(fStart, numHelpers);
+  doJobs();
+  for (unsigned i = 0; i < numHelpers; ++i) semaphoreWait(fDone);
+}
+
+THREAD_RESULT H264SimulcastWorkers::threadMain(void* clientData) {
+  H264SimulcastWorkers* workers = (H264SimulcastWorkers*)clientData;
+  while (1) {
+    semaphoreWait(workers->fStart);
+    if (workers->fQuit) break;
+    workers->doJobs();
+    semaphorePost(workers->fDone, 1);
+  }
+  return 0;
+}
+
+void H264SimulcastWorkers::doJobs() {
+  while (1) {
+    unsigned jobIndex = atomicIncrement(fNextJob) - 1;
+    if (jobIndex >= fNumJobs) break;
+    (*fFunc)(fClientData, jobIndex);
+  }
+}
+
+////////// H264SimulcastEncoder //////////
+
+struct H264SimulcastRungState {
+  H264SimulcastRung rung;
+  H264SimulcastSource* sources; // linked through "fNextSource"
+  H264EncWrapper* encoder; // NULL while there are no sources
+  YUVScaler* scaler; // NULL if the camera's picture is this rung's size
+  unsigned char* picture; // the camera's picture, scaled
+  Boolean wantsKeyFrame; // for a source that's joined, or fallen behind
+  char* sprop; // once it's been asked for
+  unsigned profileLevelId;
+  // This frame's output (from a worker thread):
+  int result;
+  TNAL* nalUnits;
+  int numNALUnits;
+};
+
+static H264EncWrapper* openEncoder(H264SimulcastRung const& rung,
+				   unsigned frameRate) {
+  H264EncWrapper* encoder = new H264EncWrapper;
+  if (encoder->Initialize(rung.width, rung.height, rung.bitrate, frameRate) < 0) {
+    delete encoder;
+    return NULL;
+  }
+  return encoder;
+}
+
+static void closeEncoder(H264EncWrapper* encoder) {
+  if (encoder == NULL) return;
+  encoder->Destroy();
+  delete encoder;
+}
+
+H264SimulcastEncoder*
+H264SimulcastEncoder::createNew(UsageEnvironment& env,
+				H264SimulcastRung const* rungs,
+				unsigned numRungs, unsigned frameRate) {
+  if (numRungs == 0 || frameRate == 0) {
+    env.setResultMsg("a simulcast ladder needs a rung, and a frame rate");
+    return NULL;
+  }
+  for (unsigned i = 0; i < numRungs; ++i) {
+    if (rungs[i].width == 0 || rungs[i].height == 0 || rungs[i].bitrate == 0
+	|| ((rungs[i].width | rungs[i].height)&1) != 0) {
+      env.setResultMsg("bad simulcast rung size or bitrate");
+      return NULL;
+    }
+  }
+
+  return new H264SimulcastEncoder(env, rungs, numRungs, frameRate);
+}
+
+H264SimulcastEncoder::H264SimulcastEncoder(UsageEnvironment& env,
+					   H264SimulcastRung const* rungs,
+					   unsigned numRungs, unsigned frameRate)
+  : Medium(env), fNumRungs(numRungs), fFrameRate(frameRate),
+    fCamera(NULL), fNumOpenRungs(0), fCameraPicture(NULL), fTickTask(NULL) {
+  fRungs = new H264SimulcastRungState[numRungs];
+  memset(fRungs, 0, numRungs*sizeof (H264SimulcastRungState));
+  for (unsigned i = 0; i < numRungs; ++i) fRungs[i].rung = rungs[i];
+  fJobs = new unsigned[numRungs];
+  fWorkers = new H264SimulcastWorkers(numRungs - 1);
+  fNextTickTime.tv_sec = fNextTickTime.tv_usec = 0;
+}
+
+H264SimulcastEncoder::~H264SimulcastEncoder() {
+  // (Our sources must have been closed first.)
+  envir().taskScheduler().unscheduleDelayedTask(fTickTask);
+  for (unsigned i = 0; i < fNumRungs; ++i) {
+    closeRung(fRungs[i]);
+    delete[] fRungs[i].sprop;
+  }
+  closeCamera();
+  delete fWorkers;
+  delete[] fJobs;
+  delete[] fRungs;
+}
+
+H264SimulcastRung const& H264SimulcastEncoder::rung(unsigned rungIndex) const {
+  return fRungs[rungIndex].rung;
+}
+
+char* H264SimulcastEncoder::spropParameterSets(unsigned rungIndex,
+					       unsigned& profileLevelId) {
+  if (rungIndex >= fNumRungs) return NULL;
+  H264SimulcastRungState& state = fRungs[rungIndex];
+
+  if (state.sprop == NULL) {
+    // A running encoder has sent its parameter sets already, so we ask a new
+    // one - opened just as it was - for them:
+    H264EncWrapper* encoder = openEncoder(state.rung, fFrameRate);
+    TNAL* nalUnits = NULL;
+    int numNALUnits = 0;
+    if (encoder == NULL || encoder->GetHeaders(nalUnits, numNALUnits) < 0) {
+      closeEncoder(encoder);
+      return NULL;
+    }
+
+    char* spsBase64 = NULL;
+    char* ppsBase64 = NULL;
+    for (int i = 0; i < numNALUnits; ++i) {
+      unsigned char const* nalUnit = nalUnits[i].data;
+      unsigned nalUnitSize = nalUnits[i].size;
+      if (nalUnitSize >= 4 && nalUnit[0] == 0 && nalUnit[1] == 0
+	  && nalUnit[2] == 0 && nalUnit[3] == 1) {
+	nalUnit += 4; nalUnitSize -= 4;
+      }
+      if (nalUnitSize == 0) continue;
+
+      unsigned char nalUnitType = nalUnit[0]&0x1F;
+      if (nalUnitType == 7 && spsBase64 == NULL) {
+	state.profileLevelId = nalUnitSize >= 4
+	  ? (nalUnit[1]<<16)|(nalUnit[2]<<8)|nalUnit[3] : 0;
+	spsBase64 = base64Encode((char const*)nalUnit, nalUnitSize);
+      } else if (nalUnitType == 8 && ppsBase64 == NULL) {
+	ppsBase64 = base64Encode((char const*)nalUnit, nalUnitSize);
+      }
+    }
+    encoder->CleanNAL(nalUnits, numNALUnits);
+    closeEncoder(encoder);
+
+    if (spsBase64 != NULL && ppsBase64 != NULL) {
+      state.sprop = new char[strlen(spsBase64) + strlen(ppsBase64) + 2];
+      sprintf(state.sprop, "%s,%s", spsBase64, ppsBase64);
+    }
+    delete[] spsBase64; delete[] ppsBase64;
+    if (state.sprop == NULL) return NULL;
+  }
+
+  profileLevelId = state.profileLevelId;
+  return strDup(state.sprop);
+}
+
+Boolean H264SimulcastEncoder::addSource(H264SimulcastSource* source) {
+  H264SimulcastRungState& state = fRungs[source->rungIndex()];
+
+  if (fCamera == NULL && !openCamera()) return False;
+  if (state.encoder == NULL) {
+    if (!openRung(state)) {
+      if (fNumOpenRungs == 0) closeCamera();
+      return False;
+    }
+  } else {
+    // The rung's stream has started already; the new source waits for its
+    // next key frame, which we have it send now:
+    state.wantsKeyFrame = True;
+  }
+  source->fNextSource = state.sources;
+  state.sources = source;
+
+  if (fTickTask == NULL) {
+    gettimeofday(&fNextTickTime, NULL);
+    fTickTask = envir().taskScheduler().scheduleDelayedTask(0, tickTask, this);
+  }
+  return True;
+}
+
+void H264SimulcastEncoder::removeSource(H264SimulcastSource* source) {
+  H264SimulcastRungState& state = fRungs[source->rungIndex()];
+  for (H264SimulcastSource** s = &state.sources; *s != NULL; s = &(*s)->fNextSource) {
+    if (*s == source) {
+      *s = source->fNextSource;
+      break;
+    }
+  }
+
+  if (state.sources == NULL) closeRung(state);
+  if (fNumOpenRungs == 0) {
+    envir().taskScheduler().unscheduleDelayedTask(fTickTask);
+    fTickTask = NULL;
+    closeCamera();
+  }
+}
+
+Boolean H264SimulcastEncoder::openCamera() {
+  // At the largest rung's size, if the camera can do it; the other rungs
+  // are scaled from that
+  unsigned largest = 0;
+  for (unsigned i = 1; i < fNumRungs; ++i) {
+    if (fRungs[i].rung.width*fRungs[i].rung.height
+	> fRungs[largest].rung.width*fRungs[largest].rung.height) {
+      largest = i;
+    }
+  }
+
+  if (NULL == (fCamera = CamCaptuerMgr::GetCamCaptuer())) {
+    DEBUG_LOG(ERR, "Create camera instance error");
+    return False;
+  }
+  if (!fCamera->OpenCamera(0, fRungs[largest].rung.width, fRungs[largest].rung.height)) {
+    DEBUG_LOG(ERR, "Can not open camera.");
+    CamCaptuerMgr::Destory(fCamera);
+    fCamera = NULL;
+    return False;
+  }
+  DEBUG_LOG(INF, "Simulcast: camera open at %dx%d", fCamera->GetWidth(), fCamera->GetHeight());
+  return True;
+}
+
+void H264SimulcastEncoder::closeCamera() {
+  if (fCamera == NULL) return;
+  fCamera->CloseCamera();
+  CamCaptuerMgr::Destory(fCamera);
+  fCamera = NULL;
+}
+
+Boolean H264SimulcastEncoder::openRung(H264SimulcastRungState& state) {
+  H264SimulcastRung const& rung = state.rung;
+  if (NULL == (state.encoder = openEncoder(rung, fFrameRate))) {
+    DEBUG_LOG(ERR, "Initialize x264 encoder error (%ux%u).", rung.width, rung.height);
+    return False;
+  }
+  if (state.encoder->EnableSpeedControl(SIMULCAST_SPEED_TARGET) < 0) {
+    DEBUG_LOG(ERR, "Can not enable x264 speed control.");
+  }
+  if (state.encoder->SetStaticThreshold(SIMULCAST_STATIC_THRESHOLD) < 0) {
+    DEBUG_LOG(ERR, "Can not enable x264 static-scene skip.");
+  }
+
+  int cameraWidth = fCamera->GetWidth(), cameraHeight = fCamera->GetHeight();
+  if ((unsigned)cameraWidth != rung.width || (unsigned)cameraHeight != rung.height) {
+    state.scaler = new YUVScaler;
+    if (!state.scaler->Init(cameraWidth, cameraHeight, rung.width, rung.height)) {
+      DEBUG_LOG(ERR, "Can not scale %dx%d to %ux%u", cameraWidth, cameraHeight,
+	rung.width, rung.height);
+      delete state.scaler; state.scaler = NULL;
+      closeEncoder(state.encoder); state.encoder = NULL;
+      return False;
+    }
+    state.picture = new unsigned char[rung.width*rung.height*3/2];
+  }
+  state.wantsKeyFrame = False; // (the first frame is one)
+
+  simulcastOpenRungs.set(++fNumOpenRungs);
+  DEBUG_LOG(INF, "Simulcast: rung %ux%u at %u kbps open", rung.width, rung.height, rung.bitrate);
+  return True;
+}
+
+void H264SimulcastEncoder::closeRung(H264SimulcastRungState& state) {
+  if (state.encoder == NULL) return;
+
+  closeEncoder(state.encoder); state.encoder = NULL;
+  delete state.scaler; state.scaler = NULL;
+  delete[] state.picture; state.picture = NULL;
+
+  simulcastOpenRungs.set(--fNumOpenRungs);
+  DEBUG_LOG(INF, "Simulcast: rung %ux%u closed", state.rung.width, state.rung.height);
+}
+
+void H264SimulcastEncoder::tickTask(void* clientData) {
+  H264SimulcastEncoder* encoder = (H264SimulcastEncoder*)clientData;
+  encoder->fTickTask = NULL;
+  encoder->tick();
+}
+
+void H264SimulcastEncoder::tick() {
+  if (fNumOpenRungs == 0) return;
+
+  u_int64_t captureStart = FrameTrace::now();
+  fCameraPicture = fCamera->QueryFrame();
+  struct timeval presentationTime; // the same for every rung
+  gettimeofday(&presentationTime, NULL);
+
+  if (fCameraPicture != NULL) {
+    u_int64_t encodeStart = FrameTrace::now();
+    unsigned numJobs = 0;
+    for (unsigned i = 0; i < fNumRungs; ++i) {
+      if (fRungs[i].encoder == NULL) continue;
+      if (fRungs[i].wantsKeyFrame) {
+	fRungs[i].encoder->ForceKeyFrame();
+	fRungs[i].wantsKeyFrame = False;
+      }
+      fJobs[numJobs++] = i;
+    }
+    fWorkers->run(encodeRung, this, numJobs);
+
+    double ticksPerSecond = (double)FrameTrace::ticksPerSecond();
+    simulcastFrames.increment();
+    simulcastCaptureSeconds.add((encodeStart - captureStart)/ticksPerSecond);
+    simulcastEncodeSeconds.add((FrameTrace::now() - encodeStart)/ticksPerSecond);
+
+    // Hand each rung's access unit to each of its sources:
+    for (unsigned j = 0; j < numJobs; ++j) {
+      H264SimulcastRungState& state = fRungs[fJobs[j]];
+      if (state.result < 0) {
+	DEBUG_LOG(ERR, "Simulcast: encoding rung %ux%u failed",
+	  state.rung.width, state.rung.height);
+	continue;
+      }
+
+      // Our NAL units don't begin with a start code, even if the encoder's do:
+      unsigned size = 0;
+      int i;
+      for (i = 0; i < state.numNALUnits; ++i) size += 4 + state.nalUnits[i].size;
+      unsigned char* accessUnit = new unsigned char[size];
+      Boolean isKeyFrame = False;
+      size = 0;
+      for (i = 0; i < state.numNALUnits; ++i) {
+	unsigned char const* nalUnit = state.nalUnits[i].data;
+	unsigned nalUnitSize = state.nalUnits[i].size;
+	simulcastBytes.add(nalUnitSize);
+	if (nalUnitSize >= 4 && nalUnit[0] == 0 && nalUnit[1] == 0
+	    && nalUnit[2] == 0 && nalUnit[3] == 1) {
+	  nalUnit += 4; nalUnitSize -= 4;
+	}
+	if (nalUnitSize == 0) continue;
+	if ((nalUnit[0]&0x1F) == 5) isKeyFrame = True;
+
+	unsigned char* to = &accessUnit[size];
+	to[0] = nalUnitSize>>24; to[1] = nalUnitSize>>16;
+	to[2] = nalUnitSize>>8; to[3] = nalUnitSize;
+	memmove(&to[4], nalUnit, nalUnitSize);
+	size += 4 + nalUnitSize;
+      }
+      state.encoder->CleanNAL(state.nalUnits, state.numNALUnits);
+      state.nalUnits = NULL; state.numNALUnits = 0;
+
+      if (size > 0) {
+	for (H264SimulcastSource* s = state.sources; s != NULL; s = s->fNextSource) {
+	  if (!s->enqueueAccessUnit(accessUnit, size, isKeyFrame, presentationTime)) {
+	    state.wantsKeyFrame = True;
+	  }
+	}
+      }
+      delete[] accessUnit;
+    }
+    fCameraPicture = NULL;
+  }
+
+  // Then wait for the next frame's time (unless we're behind):
+  struct timeval timeNow;
+  gettimeofday(&timeNow, NULL);
+  fNextTickTime.tv_usec += 1000000/fFrameRate;
+  fNextTickTime.tv_sec += fNextTickTime.tv_usec/1000000;
+  fNextTickTime.tv_usec %= 1000000;
+  int uSecondsToGo = 0;
+  if (fNextTickTime.tv_sec > timeNow.tv_sec
+      || (fNextTickTime.tv_sec == timeNow.tv_sec
+	  && fNextTickTime.tv_usec > timeNow.tv_usec)) {
+    uSecondsToGo = (fNextTickTime.tv_sec - timeNow.tv_sec)*1000000
+      + (fNextTickTime.tv_usec - timeNow.tv_usec);
+  } else {
+    fNextTickTime = timeNow; // we're behind; don't try to catch up
+  }
+  fTickTask = envir().taskScheduler().scheduleDelayedTask(uSecondsToGo, tickTask, this);
+}
+
+// Called on a worker thread (or ours) - so no logging here:
+void H264SimulcastEncoder::encodeRung(void* clientData, unsigned jobIndex) {
+  H264SimulcastEncoder* encoder = (H264SimulcastEncoder*)clientData;
+  H264SimulcastRungState& state = encoder->fRungs[encoder->fJobs[jobIndex]];
+
+  unsigned char* picture = encoder->fCameraPicture;
+  if (state.scaler != NULL) {
+    state.scaler->Scale(picture, state.picture);
+    picture = state.picture;
+  }
+  state.nalUnits = NULL;
+  state.numNALUnits = 0;
+  state.result = state.encoder->Encode(picture, state.nalUnits, state.numNALUnits);
+}
+
+////////// H264SimulcastSource //////////
+
+H264SimulcastSource* H264SimulcastSource::createNew(UsageEnvironment& env,
+						    H264SimulcastEncoder& encoder,
+						    unsigned rungIndex) {
+  if (rungIndex >= encoder.numRungs()) return NULL;
+
+  H264SimulcastSource* source = new H264SimulcastSource(env, encoder, rungIndex);
+  if (!encoder.addSource(source)) {
+    source->fRungIndex = ~0; // so that it doesn't remove itself
+    Medium::close(source);
+    return NULL;
+  }
+  return source;
+}
+
+H264SimulcastSource::H264SimulcastSource(UsageEnvironment& env,
+					 H264SimulcastEncoder& encoder,
+					 unsigned rungIndex)
+  : H264VideoStreamFramer(env, NULL),
+    fEncoder(encoder), fRungIndex(rungIndex), fNextSource(NULL),
+    fWaitingForKeyFrame(True), fIsWaitingForData(False),
+    fQueueHead(0), fQueueLength(0), fNextNALUnitOffset(0),
+    fCurrentNALUnitEndsAccessUnit(False) {
+  fQueue = new AccessUnit[SIMULCAST_QUEUE_SIZE];
+  memset(fQueue, 0, SIMULCAST_QUEUE_SIZE*sizeof (AccessUnit));
+  memset(&fCurrent, 0, sizeof fCurrent);
+}
+
+H264SimulcastSource::~H264SimulcastSource() {
+  if (fRungIndex < fEncoder.numRungs()) fEncoder.removeSource(this);
+
+  for (unsigned i = 0; i < fQueueLength; ++i) {
+    delete[] fQueue[(fQueueHead + i)%SIMULCAST_QUEUE_SIZE].data;
+  }
+  delete[] fQueue;
+  delete[] fCurrent.data;
+}
+
+char const* H264SimulcastSource::MIMEtype() const {
+  return "video/H264";
+}
+
+Boolean H264SimulcastSource::currentNALUnitEndsAccessUnit() {
+  return fCurrentNALUnitEndsAccessUnit;
+}
+
+void H264SimulcastSource::doGetNextFrame() {
+  if (fNextNALUnitOffset >= fCurrent.size && !dequeueAccessUnit()) {
+    // Nothing new yet; the encoder delivers the next when it has it
+    fIsWaitingForData = True;
+    return;
+  }
+  deliverNALUnit();
+}
+
+void H264SimulcastSource::doStopGettingFrames() {
+  fIsWaitingForData = False;
+  envir().taskScheduler().unscheduleDelayedTask(nextTask());
+}
+
+Boolean H264SimulcastSource::enqueueAccessUnit(unsigned char const* accessUnit,
+					       unsigned size, Boolean isKeyFrame,
+					       struct timeval presentationTime) {
+  if (fWaitingForKeyFrame && !isKeyFrame) return True;
+  fWaitingForKeyFrame = False;
+
+  if (fQueueLength == SIMULCAST_QUEUE_SIZE) {
+    // Our reader has fallen too far behind.  It'll have to start again,
+    // from a key frame:
+    DEBUG_LOG(ERR, "Simulcast source (rung %u) overrun; skipping to a key frame",
+      fRungIndex);
+    simulcastDropped.add(fQueueLength);
+    for (unsigned i = 0; i < fQueueLength; ++i) {
+      AccessUnit& au = fQueue[(fQueueHead + i)%SIMULCAST_QUEUE_SIZE];
+      delete[] au.data; au.data = NULL;
+    }
+    fQueueHead = fQueueLength = 0;
+    if (!isKeyFrame) {
+      fWaitingForKeyFrame = True;
+      return False;
+    }
+  }
+
+  AccessUnit& au = fQueue[(fQueueHead + fQueueLength)%SIMULCAST_QUEUE_SIZE];
+  au.data = new unsigned char[size];
+  memmove(au.data, accessUnit, size);
+  au.size = size;
+  au.presentationTime = presentationTime;
+  ++fQueueLength;
+
+  if (fIsWaitingForData) {
+    fIsWaitingForData = False;
+    dequeueAccessUnit();
+    deliverNALUnit();
+  }
+  return True;
+}
+
+Boolean H264SimulcastSource::dequeueAccessUnit() {
+  if (fQueueLength == 0) return False;
+
+  delete[] fCurrent.data;
+  fCurrent = fQueue[fQueueHead];
+  fQueue[fQueueHead].data = NULL;
+  fQueueHead = (fQueueHead + 1)%SIMULCAST_QUEUE_SIZE;
+  --fQueueLength;
+  fNextNALUnitOffset = 0;
+  return True;
+}
+
+void H264SimulcastSource::deliverNALUnit() {
+  unsigned char const* ptr = &fCurrent.data[fNextNALUnitOffset];
+  unsigned nalUnitSize = (ptr[0]<<24)|(ptr[1]<<16)|(ptr[2]<<8)|ptr[3];
+  fNextNALUnitOffset += 4 + nalUnitSize;
+
+  if (nalUnitSize > fMaxSize) {
+    fNumTruncatedBytes = nalUnitSize - fMaxSize;
+    fFrameSize = fMaxSize;
+  } else {
+    fNumTruncatedBytes = 0;
+    fFrameSize = nalUnitSize;
+  }
+  memmove(fTo, &ptr[4], fFrameSize);
+
+  // All of an access unit's NAL units have its presentation time.  (They're
+  // live, so are sent as soon as they're read: no durations.)
+  fPresentationTime = fCurrent.presentationTime;
+  fDurationInMicroseconds = 0;
+  fCurrentNALUnitEndsAccessUnit = fNextNALUnitOffset + 4 > fCurrent.size;
+
+  // To avoid possible infinite recursion, we need to return to the event loop to do this:
+  nextTask() = envir().taskScheduler().scheduleDelayedTask(0,
+				(TaskFunc*)FramedSource::afterGetting, this);
+}
@@ -0,0 +1,91 @@
+/**********
+This library is free software; you can redistribute it and/or modify it under
+the terms of the GNU Lesser General Public License as published by the
+Free Software Foundation; either version 2.1 of the License, or (at your
+option) any later version. (See <http://www.gnu.org/copyleft/lesser.html>.)
+
+This library is distributed in the hope that it will be useful, but WITHOUT
+ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for
+more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with this library; if not, write to the Free Software Foundation, Inc.,
+51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA
+**********/
+// "liveMedia"
+// Copyright (c) 1996-2009 Live Networks, Inc.  All rights reserved.
+// A 'ServerMediaSubsession' object that creates new, unicast, "RTPSink"s
+// on demand, from one rung of a "H264SimulcastEncoder"'s ladder.
+// Implementation
+
+#include "H264SimulcastServerMediaSubsession.hh"
+#include "H264SimulcastEncoder.hh"
+#include "H264VideoRTPSink.hh"
+#include "LogMacros.hh"
+
+H264SimulcastServerMediaSubsession*
+H264SimulcastServerMediaSubsession::createNew(UsageEnvironment& env,
+					      H264SimulcastEncoder& encoder,
+					      unsigned rungIndex,
+					      Boolean fanOutFirstSource,
+					      unsigned gopCacheSize,
+					      unsigned gopBurstRate) {
+  if (rungIndex >= encoder.numRungs()) return NULL;
+
+  return new H264SimulcastServerMediaSubsession(env, encoder, rungIndex,
+						fanOutFirstSource,
+						gopCacheSize, gopBurstRate);
+}
+
+H264SimulcastServerMediaSubsession
+::H264SimulcastServerMediaSubsession(UsageEnvironment& env,
+				     H264SimulcastEncoder& encoder,
+				     unsigned rungIndex,
+				     Boolean fanOutFirstSource,
+				     unsigned gopCacheSize,
+				     unsigned gopBurstRate)
+  : OnDemandServerMediaSubsession(env, False/*reuseFirstSource*/, 6970,
+				  fanOutFirstSource),
+    fEncoder(encoder), fRungIndex(rungIndex),
+    fGOPCacheSize(gopCacheSize), fGOPBurstRate(gopBurstRate) {
+}
+
+H264SimulcastServerMediaSubsession::~H264SimulcastServerMediaSubsession() {
+}
+
+FramedSource* H264SimulcastServerMediaSubsession
+::createNewStreamSource(unsigned /*clientSessionId*/, unsigned& estBitrate) {
+  H264SimulcastRung const& rung = fEncoder.rung(fRungIndex);
+  estBitrate = rung.bitrate; // kbps
+
+  H264SimulcastSource* source
+    = H264SimulcastSource::createNew(envir(), fEncoder, fRungIndex);
+  if (source == NULL) {
+    DEBUG_LOG(ERR, "Can't start simulcast rung %ux%u", rung.width, rung.height);
+  }
+  return source;
+}
+
+RTPSink* H264SimulcastServerMediaSubsession
+::createNewRTPSink(Groupsock* rtpGroupsock,
+		   unsigned char rtpPayloadTypeIfDynamic,
+		   FramedSource* /*inputSource*/) {
+  // The sink must be able to take any access unit's NAL units whole; a key
+  // frame of the rung's may take up to a second's worth of its bits:
+  unsigned maxNALUnitSize = fEncoder.rung(fRungIndex).bitrate*1000/8;
+  if (OutPacketBuffer::maxSize < maxNALUnitSize) {
+    OutPacketBuffer::maxSize = maxNALUnitSize;
+  }
+
+  unsigned profileLevelId = 0;
+  char* sprop = fEncoder.spropParameterSets(fRungIndex, profileLevelId);
+  H264VideoRTPSink* sink
+    = H264VideoRTPSink::createNew(envir(), rtpGroupsock, rtpPayloadTypeIfDynamic,
+				  profileLevelId, sprop == NULL ? "" : sprop);
+  delete[] sprop;
+  if (sink != NULL && fansOutFirstSource() && fGOPCacheSize > 0) {
+    sink->enableGOPCache(fGOPCacheSize, fGOPBurstRate);
+  }
+  return sink;
+}
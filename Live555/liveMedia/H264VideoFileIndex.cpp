@@ -0,0 +1,355 @@
+/**********
+This library is free software; you can redistribute it and/or modify it under
+the terms of the GNU Lesser General Public License as published by the
+Free Software Foundation; either version 2.1 of the License, or (at your
+option) any later version. (See <http://www.gnu.org/copyleft/lesser.html>.)
+
+This library is distributed in the hope that it will be useful, but WITHOUT
+ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for
+more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with this library; if not, write to the Free Software Foundation, Inc.,
+51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA
+**********/
+// "liveMedia"
+// Copyright (c) 1996-2009 Live Networks, Inc.  All rights reserved.
+// An index of the NAL units, access units ('frames') and key frames of a
+// (memory-mapped) H.264 Elementary Stream file
+// Implementation
+
+#if defined(__WIN32__) || defined(_WIN32)
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+#include <sys/stat.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "H264VideoFileIndex.hh"
+#include "Base64.hh"
+#include "LogMacros.hh"
+
+#define INDEX_FILE_MAGIC "H264IDX1"
+#define INDEX_FILE_BYTE_ORDER 0x01020304 // as we write it
+
+struct IndexFileHeader {
+  char magic[8];
+  u_int32_t byteOrder;
+  u_int32_t numNALUnits, numAccessUnits, numKeyFrames;
+  u_int64_t fileSize; // of the file that was indexed
+  int64_t modificationTime; // ditto
+};
+
+// Grows "array" (of "num" entries) by half, if it's full:
+template <class T>
+static void makeRoomFor1More(T*& array, unsigned num, unsigned& maxNum) {
+  if (num < maxNum) return;
+
+  maxNum = maxNum < 1024 ? 1024 : maxNum + maxNum/2;
+  T* newArray = new T[maxNum];
+  if (num > 0) memcpy(newArray, array, num*sizeof (T));
+  delete[] array;
+  array = newArray;
+}
+
+// Returns the offset of the next "00 00 01" start code at or after "from",
+// or "size" if there's none:
+static u_int64_t findStartCode(unsigned char const* data,
+			       u_int64_t from, u_int64_t size) {
+  u_int64_t i = from + 2;
+  while (i < size) {
+    if (data[i] > 1) {
+      i += 3; // it can't be any of a start code's 3 bytes
+    } else if (data[i] == 1) {
+      if (data[i-1] == 0 && data[i-2] == 0) return i-2;
+      i += 3;
+    } else {
+      ++i;
+    }
+  }
+
+  return size;
+}
+
+H264VideoFileIndex* H264VideoFileIndex::createNew(UsageEnvironment& env,
+						  char const* fileName,
+						  double frameRate) {
+  if (frameRate <= 0.0) frameRate = 25.0;
+
+  H264VideoFileIndex* index = new H264VideoFileIndex(env, fileName, frameRate);
+  if (!index->mapFile()) {
+    delete index;
+    return NULL;
+  }
+
+  if (!index->readIndexFile()) {
+    index->buildIndex();
+    if (index->fNumNALUnits > 0) index->writeIndexFile();
+  }
+  if (index->fNumNALUnits == 0) {
+    env.setResultMsg("no H.264 NAL units in file \"", fileName, "\"");
+    delete index;
+    return NULL;
+  }
+  index->setParameterSets();
+
+  return index;
+}
+
+H264VideoFileIndex::H264VideoFileIndex(UsageEnvironment& env,
+				       char const* fileName, double frameRate)
+  : fEnv(env), fFileName(strDup(fileName)), fFrameRate(frameRate),
+    fFileSize(0), fModificationTime(0), fData(NULL),
+#if defined(__WIN32__) || defined(_WIN32)
+    fFileHandle(NULL), fMappingHandle(NULL),
+#endif
+    fNALUnits(NULL), fNumNALUnits(0), fMaxNumNALUnits(0), fMaxNALUnitSize(0),
+    fAccessUnits(NULL), fNumAccessUnits(0), fMaxNumAccessUnits(0),
+    fKeyFrames(NULL), fNumKeyFrames(0), fMaxNumKeyFrames(0),
+    fAccessUnitHasIDR(False), fProfileLevelId(0), fSpropParameterSets(NULL) {
+  fIndexFileName = new char[strlen(fileName) + sizeof H264_INDEX_FILE_SUFFIX];
+  sprintf(fIndexFileName, "%s%s", fileName, H264_INDEX_FILE_SUFFIX);
+}
+
+H264VideoFileIndex::~H264VideoFileIndex() {
+  unmapFile();
+
+  delete[] fSpropParameterSets;
+  delete[] fKeyFrames; delete[] fAccessUnits; delete[] fNALUnits;
+  delete[] fIndexFileName; delete[] fFileName;
+}
+
+unsigned H264VideoFileIndex::keyFrameAtOrBefore(double npt) const {
+  // Binary search, for the last key frame whose time is <= "npt":
+  unsigned low = 0, high = fNumKeyFrames; // the answer is in [low, high)
+  while (high - low > 1) {
+    unsigned mid = (low + high)/2;
+    if (this->npt(fKeyFrames[mid]) <= npt) {
+      low = mid;
+    } else {
+      high = mid;
+    }
+  }
+
+  return low;
+}
+
+Boolean H264VideoFileIndex::mapFile() {
+  struct stat sb;
+  if (stat(fFileName, &sb) != 0 || sb.st_size == 0) {
+    fEnv.setResultMsg("unable to open file \"", fFileName, "\"");
+    return False;
+  }
+  fFileSize = (u_int64_t)sb.st_size;
+  fModificationTime = (int64_t)sb.st_mtime;
+
+#if defined(__WIN32__) || defined(_WIN32)
+  HANDLE fileHandle = CreateFileA(fFileName, GENERIC_READ, FILE_SHARE_READ, NULL,
+				  OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+  if (fileHandle != INVALID_HANDLE_VALUE) {
+    fFileHandle = fileHandle;
+    fMappingHandle = CreateFileMappingA(fileHandle, NULL, PAGE_READONLY, 0, 0, NULL);
+    if (fMappingHandle != NULL) {
+      fData = (unsigned char const*)MapViewOfFile(fMappingHandle, FILE_MAP_READ,
+						  0, 0, 0);
+    }
+  }
+#else
+  int fd = open(fFileName, O_RDONLY);
+  if (fd >= 0) {
+    void* data = mmap(NULL, (size_t)fFileSize, PROT_READ, MAP_SHARED, fd, 0);
+    if (data != MAP_FAILED) fData = (unsigned char const*)data;
+    close(fd); // (the mapping stays)
+  }
+#endif
+  if (fData == NULL) {
+    fEnv.setResultMsg("unable to map file \"", fFileName, "\"");
+    return False;
+  }
+
+  return True;
+}
+
+void H264VideoFileIndex::unmapFile() {
+#if defined(__WIN32__) || defined(_WIN32)
+  if (fData != NULL) UnmapViewOfFile(fData);
+  if (fMappingHandle != NULL) CloseHandle((HANDLE)fMappingHandle);
+  if (fFileHandle != NULL) CloseHandle((HANDLE)fFileHandle);
+  fFileHandle = fMappingHandle = NULL;
+#else
+  if (fData != NULL) munmap((void*)fData, (size_t)fFileSize);
+#endif
+  fData = NULL;
+}
+
+Boolean H264VideoFileIndex::readIndexFile() {
+  FILE* fid = fopen(fIndexFileName, "rb");
+  if (fid == NULL) return False;
+
+  IndexFileHeader header;
+  Boolean isValid = fread(&header, sizeof header, 1, fid) == 1
+    && memcmp(header.magic, INDEX_FILE_MAGIC, sizeof header.magic) == 0
+    && header.byteOrder == INDEX_FILE_BYTE_ORDER
+    && header.fileSize == fFileSize
+    && header.modificationTime == fModificationTime
+    && header.numNALUnits > 0 && header.numAccessUnits > 0;
+  if (isValid) {
+    fNumNALUnits = fMaxNumNALUnits = header.numNALUnits;
+    fNumAccessUnits = fMaxNumAccessUnits = header.numAccessUnits;
+    fNumKeyFrames = fMaxNumKeyFrames = header.numKeyFrames;
+    fNALUnits = new NALUnitEntry[fNumNALUnits];
+    fAccessUnits = new u_int32_t[fNumAccessUnits];
+    fKeyFrames = new u_int32_t[fNumKeyFrames];
+    isValid = fread(fNALUnits, sizeof (NALUnitEntry), fNumNALUnits, fid) == fNumNALUnits
+      && fread(fAccessUnits, sizeof (u_int32_t), fNumAccessUnits, fid) == fNumAccessUnits
+      && fread(fKeyFrames, sizeof (u_int32_t), fNumKeyFrames, fid) == fNumKeyFrames;
+  }
+  fclose(fid);
+
+  // Make sure that a damaged index can't take us outside the mapping:
+  unsigned i;
+  for (i = 0; isValid && i < fNumNALUnits; ++i) {
+    NALUnitEntry const& nalUnit = fNALUnits[i];
+    isValid = nalUnit.size > 0 && nalUnit.offset < fFileSize
+      && nalUnit.size <= fFileSize - nalUnit.offset;
+    if (nalUnit.size > fMaxNALUnitSize) fMaxNALUnitSize = nalUnit.size;
+  }
+  for (i = 0; isValid && i < fNumAccessUnits; ++i) {
+    isValid = fAccessUnits[i] < fNumNALUnits;
+  }
+  for (i = 0; isValid && i < fNumKeyFrames; ++i) {
+    isValid = fKeyFrames[i] < fNumAccessUnits;
+  }
+
+  if (!isValid) {
+    DEBUG_LOG(INF, "Index file \"%s\" is out of date; rebuilding it", fIndexFileName);
+    delete[] fNALUnits; fNALUnits = NULL;
+    delete[] fAccessUnits; fAccessUnits = NULL;
+    delete[] fKeyFrames; fKeyFrames = NULL;
+    fNumNALUnits = fMaxNumNALUnits = fMaxNALUnitSize = 0;
+    fNumAccessUnits = fMaxNumAccessUnits = 0;
+    fNumKeyFrames = fMaxNumKeyFrames = 0;
+    return False;
+  }
+
+  DEBUG_LOG(INF, "Read index file \"%s\": %u NAL units, %u access units, %u key frames",
+	    fIndexFileName, fNumNALUnits, fNumAccessUnits, fNumKeyFrames);
+  return True;
+}
+
+void H264VideoFileIndex::writeIndexFile() {
+  FILE* fid = fopen(fIndexFileName, "wb");
+  if (fid == NULL) {
+    DEBUG_LOG(ERR, "Can't save index file \"%s\"", fIndexFileName);
+    return; // we'll just have to index the file again next time
+  }
+
+  IndexFileHeader header;
+  memset(&header, 0, sizeof header);
+  memcpy(header.magic, INDEX_FILE_MAGIC, sizeof header.magic);
+  header.byteOrder = INDEX_FILE_BYTE_ORDER;
+  header.numNALUnits = fNumNALUnits;
+  header.numAccessUnits = fNumAccessUnits;
+  header.numKeyFrames = fNumKeyFrames;
+  header.fileSize = fFileSize;
+  header.modificationTime = fModificationTime;
+
+  Boolean isWritten = fwrite(&header, sizeof header, 1, fid) == 1
+    && fwrite(fNALUnits, sizeof (NALUnitEntry), fNumNALUnits, fid) == fNumNALUnits
+    && fwrite(fAccessUnits, sizeof (u_int32_t), fNumAccessUnits, fid) == fNumAccessUnits
+    && fwrite(fKeyFrames, sizeof (u_int32_t), fNumKeyFrames, fid) == fNumKeyFrames;
+  if (fclose(fid) != 0 || !isWritten) {
+    DEBUG_LOG(ERR, "Can't save index file \"%s\"", fIndexFileName);
+    remove(fIndexFileName);
+  }
+}
+
+void H264VideoFileIndex::buildIndex() {
+  u_int64_t startCode = findStartCode(fData, 0, fFileSize);
+  while (startCode < fFileSize) {
+    u_int64_t nalUnitStart = startCode + 3;
+    u_int64_t nextStartCode = findStartCode(fData, nalUnitStart, fFileSize);
+
+    // A NAL unit never ends with a 0 byte, so any here are the first byte of
+    // a 4-byte start code, or "trailing_zero_8bits":
+    u_int64_t nalUnitEnd = nextStartCode;
+    while (nalUnitEnd > nalUnitStart && fData[nalUnitEnd-1] == 0) --nalUnitEnd;
+    if (nalUnitEnd > nalUnitStart) {
+      addNALUnit(nalUnitStart, (unsigned)(nalUnitEnd - nalUnitStart));
+    }
+
+    startCode = nextStartCode;
+  }
+  endAccessUnit();
+
+  DEBUG_LOG(INF, "Indexed \"%s\": %u NAL units, %u access units, %u key frames",
+	    fFileName, fNumNALUnits, fNumAccessUnits, fNumKeyFrames);
+}
+
+void H264VideoFileIndex::addNALUnit(u_int64_t offset, unsigned size) {
+  unsigned char nalUnitType = fData[offset]&0x1F;
+  Boolean isVCL = nalUnitType >= 1 && nalUnitType <= 5;
+  if (fNumNALUnits > 0) {
+    unsigned char prevNALUnitType = fData[fNALUnits[fNumNALUnits-1].offset]&0x1F;
+    // After a VCL NAL unit, these begin the next access unit (H.264
+    // 7.4.1.2.3): an AUD, SPS, PPS, SEI, or types 14-18; or a slice whose
+    // "first_mb_in_slice" (its first 'ue(v)') is 0:
+    if (prevNALUnitType >= 1 && prevNALUnitType <= 5
+	&& ((nalUnitType >= 6 && nalUnitType <= 9)
+	    || (nalUnitType >= 14 && nalUnitType <= 18)
+	    || (isVCL && size > 1 && (fData[offset+1]&0x80) != 0))) {
+      endAccessUnit();
+    }
+  }
+
+  if (fNumNALUnits == 0 || nalUnitEndsAccessUnit(fNumNALUnits-1)) {
+    makeRoomFor1More(fAccessUnits, fNumAccessUnits, fMaxNumAccessUnits);
+    fAccessUnits[fNumAccessUnits++] = fNumNALUnits;
+  }
+
+  makeRoomFor1More(fNALUnits, fNumNALUnits, fMaxNumNALUnits);
+  NALUnitEntry& nalUnit = fNALUnits[fNumNALUnits++];
+  nalUnit.offset = offset;
+  nalUnit.size = size;
+  nalUnit.flags = 0;
+  if (size > fMaxNALUnitSize) fMaxNALUnitSize = size;
+  if (nalUnitType == 5) fAccessUnitHasIDR = True;
+}
+
+void H264VideoFileIndex::endAccessUnit() {
+  if (fNumNALUnits == 0 || nalUnitEndsAccessUnit(fNumNALUnits-1)) return;
+
+  fNALUnits[fNumNALUnits-1].flags |= NAL_UNIT_ENDS_ACCESS_UNIT;
+  if (fAccessUnitHasIDR) {
+    makeRoomFor1More(fKeyFrames, fNumKeyFrames, fMaxNumKeyFrames);
+    fKeyFrames[fNumKeyFrames++] = fNumAccessUnits-1;
+    fAccessUnitHasIDR = False;
+  }
+}
+
+void H264VideoFileIndex::setParameterSets() {
+  char* sps = NULL;
+  char* pps = NULL;
+  for (unsigned i = 0; i < fNumNALUnits && (sps == NULL || pps == NULL); ++i) {
+    unsigned size;
+    unsigned char const* nal = nalUnit(i, size);
+    unsigned char nalUnitType = nal[0]&0x1F;
+    if (nalUnitType == 7 && sps == NULL) {
+      if (size >= 4) fProfileLevelId = (nal[1]<<16)|(nal[2]<<8)|nal[3];
+      sps = base64Encode((char const*)nal, size);
+    } else if (nalUnitType == 8 && pps == NULL) {
+      pps = base64Encode((char const*)nal, size);
+    }
+  }
+
+  fSpropParameterSets = new char[(sps == NULL ? 0 : strlen(sps))
+				 + (pps == NULL ? 0 : strlen(pps)) + 2];
+  sprintf(fSpropParameterSets, "%s%s%s", sps == NULL ? "" : sps,
+	  sps != NULL && pps != NULL ? "," : "", pps == NULL ? "" : pps);
+  delete[] sps; delete[] pps;
+}
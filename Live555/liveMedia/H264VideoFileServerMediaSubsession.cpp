@@ -0,0 +1,99 @@
+/**********
+This library is free software; you can redistribute it and/or modify it under
+the terms of the GNU Lesser General Public License as published by the
+Free Software Foundation; either version 2.1 of the License, or (at your
+option) any later version. (See <http://www.gnu.org/copyleft/lesser.html>.)
+
+This library is distributed in the hope that it will be useful, but WITHOUT
+ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for
+more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with this library; if not, write to the Free Software Foundation, Inc.,
+51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA
+**********/
+// "liveMedia"
+// Copyright (c) 1996-2009 Live Networks, Inc.  All rights reserved.
+// A 'ServerMediaSubsession' object that creates new, unicast, "RTPSink"s
+// on demand, from an (indexed, memory-mapped) H.264 Elementary Stream file.
+// Implementation
+
+#include "H264VideoFileServerMediaSubsession.hh"
+#include "H264VideoMappedFileSource.hh"
+#include "H264VideoRTPSink.hh"
+#include "LogMacros.hh"
+
+H264VideoFileServerMediaSubsession*
+H264VideoFileServerMediaSubsession::createNew(UsageEnvironment& env,
+					      char const* fileName,
+					      Boolean reuseFirstSource,
+					      double frameRate) {
+  H264VideoFileIndex* index
+    = H264VideoFileIndex::createNew(env, fileName, frameRate);
+  if (index == NULL) {
+    DEBUG_LOG(ERR, "Can't index \"%s\": %s", fileName, env.getResultMsg());
+    return NULL;
+  }
+
+  return new H264VideoFileServerMediaSubsession(env, fileName,
+						reuseFirstSource, index);
+}
+
+H264VideoFileServerMediaSubsession
+::H264VideoFileServerMediaSubsession(UsageEnvironment& env,
+				     char const* fileName,
+				     Boolean reuseFirstSource,
+				     H264VideoFileIndex* index)
+  : FileServerMediaSubsession(env, fileName, reuseFirstSource),
+    fIndex(index) {
+  fFileSize = index->fileSize();
+}
+
+H264VideoFileServerMediaSubsession::~H264VideoFileServerMediaSubsession() {
+  delete fIndex;
+}
+
+void H264VideoFileServerMediaSubsession::testScaleFactor(float& scale) {
+  // Any scale can be done with key frames alone - if there are any:
+  if (scale == 0.0f || fIndex->numKeyFrames() == 0) scale = 1.0f;
+}
+
+float H264VideoFileServerMediaSubsession::duration() const {
+  return (float)fIndex->duration();
+}
+
+void H264VideoFileServerMediaSubsession
+::seekStreamSource(FramedSource* inputSource, double seekNPT) {
+  ((H264VideoMappedFileSource*)inputSource)->seekToNPT(seekNPT);
+}
+
+void H264VideoFileServerMediaSubsession
+::setStreamSourceScale(FramedSource* inputSource, float scale) {
+  ((H264VideoMappedFileSource*)inputSource)->setScale(scale);
+}
+
+FramedSource* H264VideoFileServerMediaSubsession
+::createNewStreamSource(unsigned /*clientSessionId*/, unsigned& estBitrate) {
+  double duration = fIndex->duration();
+  estBitrate = duration > 0.0
+    ? (unsigned)(fFileSize*8/1000/duration) : 500; // kbps
+  if (estBitrate == 0) estBitrate = 1;
+
+  return H264VideoMappedFileSource::createNew(envir(), *fIndex);
+}
+
+RTPSink* H264VideoFileServerMediaSubsession
+::createNewRTPSink(Groupsock* rtpGroupsock,
+		   unsigned char rtpPayloadTypeIfDynamic,
+		   FramedSource* /*inputSource*/) {
+  // The sink must be able to take the file's largest NAL unit whole:
+  if (OutPacketBuffer::maxSize < fIndex->maxNALUnitSize()) {
+    OutPacketBuffer::maxSize = fIndex->maxNALUnitSize();
+  }
+
+  return H264VideoRTPSink::createNew(envir(), rtpGroupsock,
+				     rtpPayloadTypeIfDynamic,
+				     fIndex->profileLevelId(),
+				     fIndex->spropParameterSets());
+}
@@ -145,3 +145,39 @@ void H264VideoFileSink::afterGettingFrame1(unsigned frameSize,
   FileSink::afterGettingFrame1(frameSize, presentationTime);
 
 }
+
+Boolean H264VideoFileSink::continuePlaying() {
+  if (fSource == NULL) return False;
+  if (!fSource->isMultiFramedRTPSource()) return FileSink::continuePlaying();
+
+  ((MultiFramedRTPSource*)fSource)
+    ->getNextFrameFragments(fFragments, fBufferSize,
+			    afterGettingFragments, this,
+			    onSourceClosure, this);
+  return True;
+}
+
+void H264VideoFileSink::afterGettingFragments(void* clientData,
+					      unsigned /*frameSize*/,
+					      unsigned /*numTruncatedBytes*/,
+					      struct timeval presentationTime,
+					      unsigned /*durationInMicroseconds*/) {
+  H264VideoFileSink* sink = (H264VideoFileSink*)clientData;
+  sink->afterGettingFragments1(presentationTime);
+}
+
+void H264VideoFileSink::afterGettingFragments1(struct timeval presentationTime) {
+#if defined(_TEST_CLIENT_DISPLAY)
+  // The decoder needs the NAL unit in one piece:
+  unsigned frameSize = fFragments.copyTo(fBuffer, fBufferSize);
+  fFragments.release();
+  afterGettingFrame1(frameSize, presentationTime);
+#else
+  unsigned char start_code[4] = {0x00, 0x00, 0x00, 0x01};
+  addFragments(start_code, 4, fFragments, presentationTime);
+  DEBUG_LOG(INF, "Get data: size = %d", fFragments.totalSize()+4);
+  fFragments.release();
+
+  afterWritingFrame();
+#endif
+}
@@ -0,0 +1,626 @@
+/**********
+This library is free software; you can redistribute it and/or modify it under
+the terms of the GNU Lesser General Public License as published by the
+Free Software Foundation; either version 2.1 of the License, or (at your
+option) any later version. (See <http://www.gnu.org/copyleft/lesser.html>.)
+
+This library is distributed in the hope that it will be useful, but WITHOUT
+ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for
+more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with this library; if not, write to the Free Software Foundation, Inc.,
+51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA
+**********/
+// "liveMedia"
+// Copyright (c) 1996-2009 Live Networks, Inc.  All rights reserved.
+// A shared-memory ring of H.264 access units, written by one (encoder)
+// process and read - without locks - by any number of (server) processes
+// Implementation
+
+#if defined(__WIN32__) || defined(_WIN32)
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+#include <string.h>
+
+#include "H264VideoFrameBus.hh"
+#include "MetricsRegistry.hh"
+#include "Base64.hh"
+#include "GroupsockHelper.hh"
+#include "LogMacros.hh"
+
+#define H264_FRAME_BUS_MAGIC 0x34363248 // "H264"
+#define H264_FRAME_BUS_VERSION 1
+#define CACHE_LINE_SIZE 64
+
+struct H264FrameBusHeader {
+  u_int32_t magic, version;
+  u_int32_t numSlots, slotSize;
+  u_int32_t volatile lastSeqNo; // of the latest access unit written
+  u_int32_t volatile lastKeyFrameSeqNo;
+  u_int32_t volatile parameterSetsVersion; // odd while they're being rewritten
+  u_int32_t spsSize, ppsSize;
+  unsigned char sps[H264_FRAME_BUS_MAX_PARAMETER_SET_SIZE];
+  unsigned char pps[H264_FRAME_BUS_MAX_PARAMETER_SET_SIZE];
+};
+
+struct H264FrameBusSlot {
+  u_int32_t volatile seqNo; // of the access unit in it; 0 while it's being rewritten
+  u_int32_t presentationTimeSec, presentationTimeUSec;
+  u_int32_t isKeyFrame;
+  u_int32_t dataSize;
+  // followed by "slotSize" bytes of data
+};
+
+static unsigned roundUp(unsigned size) {
+  return (size + CACHE_LINE_SIZE - 1)&~(CACHE_LINE_SIZE - 1);
+}
+
+static unsigned slotStride(unsigned slotSize) {
+  return roundUp(sizeof (H264FrameBusSlot) + slotSize);
+}
+
+static unsigned regionSize(unsigned numSlots, unsigned slotSize) {
+  return roundUp(sizeof (H264FrameBusHeader)) + numSlots*slotStride(slotSize);
+}
+
+static void memoryBarrier() {
+#if defined(__WIN32__) || defined(_WIN32)
+  MemoryBarrier();
+#else
+  __sync_synchronize();
+#endif
+}
+
+static MetricsCounter accessUnitsWritten("frame_bus_access_units_written_total",
+					 "Access units written to the shared-memory frame bus");
+static MetricsCounter accessUnitsDropped("frame_bus_access_units_dropped_total",
+					 "Access units too big for a frame bus slot");
+static MetricsCounter readerOverruns("frame_bus_overruns_total",
+				     "Times that a frame bus reader fell behind, and skipped to a key frame");
+
+////////// H264VideoFrameBus //////////
+
+H264VideoFrameBus* H264VideoFrameBus::createWriter(UsageEnvironment& env,
+						   char const* name,
+						   unsigned numSlots,
+						   unsigned slotSize) {
+  if (numSlots < 2 || slotSize == 0) {
+    env.setResultMsg("bad frame bus geometry");
+    return NULL;
+  }
+  slotSize = (slotSize + 3)&~3;
+  unsigned size = regionSize(numSlots, slotSize);
+  void* mapping = NULL;
+  void* region = NULL;
+  Boolean isNew;
+
+#if defined(__WIN32__) || defined(_WIN32)
+  mapping = CreateFileMappingA(INVALID_HANDLE_VALUE, NULL, PAGE_READWRITE,
+			       0, size, name);
+  if (mapping == NULL) {
+    env.setResultErrMsg("unable to create the frame bus: ");
+    return NULL;
+  }
+  isNew = GetLastError() != ERROR_ALREADY_EXISTS;
+  region = MapViewOfFile(mapping, FILE_MAP_ALL_ACCESS, 0, 0, size);
+  if (region == NULL) {
+    env.setResultErrMsg("unable to map the frame bus: ");
+    CloseHandle((HANDLE)mapping);
+    return NULL;
+  }
+#else
+  char* shmName = new char[strlen(name) + 2];
+  sprintf(shmName, "%s%s", name[0] == '/' ? "" : "/", name);
+  int fd = shm_open(shmName, O_RDWR|O_CREAT, 0644);
+  delete[] shmName;
+  struct stat sb;
+  if (fd < 0 || fstat(fd, &sb) != 0) {
+    env.setResultErrMsg("unable to create the frame bus: ");
+    if (fd >= 0) close(fd);
+    return NULL;
+  }
+  isNew = sb.st_size == 0;
+  if ((isNew && ftruncate(fd, size) != 0)
+      || (!isNew && sb.st_size != (off_t)size)) {
+    env.setResultMsg("frame bus \"", name, "\" exists, with another geometry");
+    close(fd);
+    return NULL;
+  }
+  region = mmap(NULL, size, PROT_READ|PROT_WRITE, MAP_SHARED, fd, 0);
+  close(fd); // (the mapping stays)
+  if (region == MAP_FAILED) {
+    env.setResultErrMsg("unable to map the frame bus: ");
+    return NULL;
+  }
+#endif
+
+  H264FrameBusHeader* header = (H264FrameBusHeader*)region;
+  if (isNew || header->magic == 0) {
+    memset(region, 0, size);
+    header->version = H264_FRAME_BUS_VERSION;
+    header->numSlots = numSlots;
+    header->slotSize = slotSize;
+    memoryBarrier();
+    header->magic = H264_FRAME_BUS_MAGIC;
+  } else if (header->magic != H264_FRAME_BUS_MAGIC
+	     || header->version != H264_FRAME_BUS_VERSION
+	     || header->numSlots != numSlots || header->slotSize != slotSize) {
+    env.setResultMsg("frame bus \"", name, "\" exists, with another geometry");
+    H264VideoFrameBus dummy(name, True, mapping, region, size); // unmaps it
+    return NULL;
+  } else {
+    DEBUG_LOG(INF, "Frame bus \"%s\": carrying on from access unit %u",
+      name, header->lastSeqNo);
+  }
+
+  return new H264VideoFrameBus(name, True, mapping, region, size);
+}
+
+H264VideoFrameBus* H264VideoFrameBus::openReader(UsageEnvironment& env,
+						 char const* name) {
+  void* mapping = NULL;
+  void* region = NULL;
+  unsigned size;
+
+#if defined(__WIN32__) || defined(_WIN32)
+  mapping = OpenFileMappingA(FILE_MAP_READ, FALSE, name);
+  if (mapping != NULL) region = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+  MEMORY_BASIC_INFORMATION info;
+  if (region == NULL || VirtualQuery(region, &info, sizeof info) == 0) {
+    env.setResultMsg("no frame bus \"", name, "\"");
+    if (region != NULL) UnmapViewOfFile(region);
+    if (mapping != NULL) CloseHandle((HANDLE)mapping);
+    return NULL;
+  }
+  size = (unsigned)info.RegionSize;
+#else
+  char* shmName = new char[strlen(name) + 2];
+  sprintf(shmName, "%s%s", name[0] == '/' ? "" : "/", name);
+  int fd = shm_open(shmName, O_RDONLY, 0);
+  delete[] shmName;
+  struct stat sb;
+  if (fd < 0 || fstat(fd, &sb) != 0 || sb.st_size == 0) {
+    env.setResultMsg("no frame bus \"", name, "\"");
+    if (fd >= 0) close(fd);
+    return NULL;
+  }
+  size = (unsigned)sb.st_size;
+  region = mmap(NULL, size, PROT_READ, MAP_SHARED, fd, 0);
+  close(fd); // (the mapping stays)
+  if (region == MAP_FAILED) {
+    env.setResultErrMsg("unable to map the frame bus: ");
+    return NULL;
+  }
+#endif
+
+  H264VideoFrameBus* bus = new H264VideoFrameBus(name, False, mapping, region, size);
+  H264FrameBusHeader const* header = bus->fHeader;
+  if (size < sizeof (H264FrameBusHeader)
+      || header->magic != H264_FRAME_BUS_MAGIC
+      || header->version != H264_FRAME_BUS_VERSION
+      || size < regionSize(header->numSlots, header->slotSize)) {
+    env.setResultMsg("frame bus \"", name, "\" isn't ready, or is of another version");
+    delete bus;
+    return NULL;
+  }
+  return bus;
+}
+
+H264VideoFrameBus::H264VideoFrameBus(char const* name, Boolean isWriter,
+				     void* mapping, void* region,
+				     unsigned regionSize)
+  : fName(strDup(name)), fIsWriter(isWriter), fMapping(mapping),
+    fRegion(region), fRegionSize(regionSize),
+    fHeader((H264FrameBusHeader*)region),
+    fCurrentSeqNo(0), fCurrentSize(0),
+    fCurrentIsKeyFrame(False), fCurrentIsTooBig(False) {
+}
+
+H264VideoFrameBus::~H264VideoFrameBus() {
+  // (The region itself stays, for whoever else has it mapped - or, on POSIX
+  // systems, for the writer's next run.)
+#if defined(__WIN32__) || defined(_WIN32)
+  UnmapViewOfFile(fRegion);
+  CloseHandle((HANDLE)fMapping);
+#else
+  munmap(fRegion, fRegionSize);
+#endif
+  delete[] fName;
+}
+
+unsigned H264VideoFrameBus::numSlots() const {
+  return fHeader->numSlots;
+}
+
+unsigned H264VideoFrameBus::slotSize() const {
+  return fHeader->slotSize;
+}
+
+H264FrameBusSlot* H264VideoFrameBus::slot(u_int32_t seqNo) const {
+  return (H264FrameBusSlot*)((unsigned char*)fRegion
+			     + roundUp(sizeof (H264FrameBusHeader))
+			     + (seqNo%fHeader->numSlots)*slotStride(fHeader->slotSize));
+}
+
+void H264VideoFrameBus::beginAccessUnit() {
+  fCurrentSeqNo = fHeader->lastSeqNo + 1;
+  if (fCurrentSeqNo == 0) fCurrentSeqNo = 1; // 0 means "none"
+  fCurrentSize = 0;
+  fCurrentIsKeyFrame = fCurrentIsTooBig = False;
+
+  // Readers mustn't take the slot's old access unit from now on:
+  slot(fCurrentSeqNo)->seqNo = 0;
+  memoryBarrier();
+}
+
+Boolean H264VideoFrameBus::addNALUnit(unsigned char const* nalUnit,
+				      unsigned nalUnitSize) {
+  // Our NAL units don't begin with a start code, even if the encoder's do:
+  if (nalUnitSize >= 4 && nalUnit[0] == 0 && nalUnit[1] == 0
+      && nalUnit[2] == 0 && nalUnit[3] == 1) {
+    nalUnit += 4; nalUnitSize -= 4;
+  } else if (nalUnitSize >= 3 && nalUnit[0] == 0 && nalUnit[1] == 0
+	     && nalUnit[2] == 1) {
+    nalUnit += 3; nalUnitSize -= 3;
+  }
+  if (nalUnitSize == 0) return True;
+
+  unsigned char nalUnitType = nalUnit[0]&0x1F;
+  if (nalUnitType == 7 || nalUnitType == 8) noteParameterSet(nalUnit, nalUnitSize);
+  if (nalUnitType == 5) fCurrentIsKeyFrame = True;
+
+  if (fCurrentIsTooBig || fCurrentSize + 4 + nalUnitSize > fHeader->slotSize) {
+    fCurrentIsTooBig = True;
+    return False;
+  }
+  H264FrameBusSlot* s = slot(fCurrentSeqNo);
+  unsigned char* to = (unsigned char*)(s + 1) + fCurrentSize;
+  to[0] = nalUnitSize>>24; to[1] = nalUnitSize>>16;
+  to[2] = nalUnitSize>>8; to[3] = nalUnitSize;
+  memmove(&to[4], nalUnit, nalUnitSize);
+  fCurrentSize += 4 + nalUnitSize;
+  return True;
+}
+
+void H264VideoFrameBus::endAccessUnit(struct timeval presentationTime) {
+  if (fCurrentIsTooBig || fCurrentSize == 0) {
+    // Drop it.  (Its number is used by the next.)
+    if (fCurrentIsTooBig) {
+      DEBUG_LOG(ERR, "Frame bus \"%s\": dropped an access unit too big for a %u-byte slot",
+	fName, fHeader->slotSize);
+      accessUnitsDropped.increment();
+    }
+    return;
+  }
+
+  H264FrameBusSlot* s = slot(fCurrentSeqNo);
+  s->presentationTimeSec = (u_int32_t)presentationTime.tv_sec;
+  s->presentationTimeUSec = (u_int32_t)presentationTime.tv_usec;
+  s->isKeyFrame = fCurrentIsKeyFrame;
+  s->dataSize = fCurrentSize;
+  memoryBarrier();
+  s->seqNo = fCurrentSeqNo;
+  memoryBarrier();
+  fHeader->lastSeqNo = fCurrentSeqNo;
+  if (fCurrentIsKeyFrame) fHeader->lastKeyFrameSeqNo = fCurrentSeqNo;
+  accessUnitsWritten.increment();
+}
+
+void H264VideoFrameBus::noteParameterSet(unsigned char const* nalUnit,
+					 unsigned nalUnitSize) {
+  if (nalUnitSize > H264_FRAME_BUS_MAX_PARAMETER_SET_SIZE) return;
+
+  Boolean isSPS = (nalUnit[0]&0x1F) == 7;
+  unsigned char* to = isSPS ? fHeader->sps : fHeader->pps;
+  u_int32_t& toSize = isSPS ? fHeader->spsSize : fHeader->ppsSize;
+  if (toSize == nalUnitSize && memcmp(to, nalUnit, nalUnitSize) == 0) {
+    return; // the encoder repeats them, with each key frame
+  }
+
+  ++fHeader->parameterSetsVersion; // odd: being rewritten
+  memoryBarrier();
+  memmove(to, nalUnit, nalUnitSize);
+  toSize = nalUnitSize;
+  memoryBarrier();
+  ++fHeader->parameterSetsVersion;
+}
+
+u_int32_t H264VideoFrameBus::lastSeqNo() const {
+  return fHeader->lastSeqNo;
+}
+
+u_int32_t H264VideoFrameBus::lastKeyFrameSeqNo() const {
+  return fHeader->lastKeyFrameSeqNo;
+}
+
+H264VideoFrameBus::ReadResult
+H264VideoFrameBus::read(u_int32_t seqNo, unsigned char* to, unsigned& size,
+			struct timeval& presentationTime,
+			Boolean& isKeyFrame) const {
+  H264FrameBusSlot const* s = slot(seqNo);
+  u_int32_t slotSeqNo = s->seqNo;
+  memoryBarrier();
+  if (slotSeqNo != seqNo) {
+    // Either it hasn't been written yet, or it's been overwritten since:
+    return (int)(fHeader->lastSeqNo - seqNo) < 0 ? READ_NOT_YET : READ_OVERRUN;
+  }
+
+  size = s->dataSize;
+  if (size > fHeader->slotSize) return READ_OVERRUN; // being rewritten
+  memmove(to, (unsigned char const*)(s + 1), size);
+  presentationTime.tv_sec = s->presentationTimeSec;
+  presentationTime.tv_usec = s->presentationTimeUSec;
+  isKeyFrame = s->isKeyFrame != 0;
+
+  // If the slot was rewritten while we were copying it, what we have is
+  // no good:
+  memoryBarrier();
+  return s->seqNo == seqNo ? READ_OK : READ_OVERRUN;
+}
+
+Boolean H264VideoFrameBus::getParameterSets(unsigned char* sps, unsigned& spsSize,
+					    unsigned char* pps, unsigned& ppsSize) const {
+  for (unsigned i = 0; i < 100; ++i) {
+    u_int32_t version = fHeader->parameterSetsVersion;
+    memoryBarrier();
+    if ((version&1) != 0) continue; // being rewritten
+
+    spsSize = fHeader->spsSize; ppsSize = fHeader->ppsSize;
+    if (spsSize > H264_FRAME_BUS_MAX_PARAMETER_SET_SIZE
+	|| ppsSize > H264_FRAME_BUS_MAX_PARAMETER_SET_SIZE) continue;
+    memmove(sps, fHeader->sps, spsSize);
+    memmove(pps, fHeader->pps, ppsSize);
+    memoryBarrier();
+    if (fHeader->parameterSetsVersion == version) {
+      return spsSize > 0 && ppsSize > 0;
+    }
+  }
+  return False;
+}
+
+char* H264VideoFrameBus::spropParameterSets(unsigned& profileLevelId) const {
+  unsigned char sps[H264_FRAME_BUS_MAX_PARAMETER_SET_SIZE];
+  unsigned char pps[H264_FRAME_BUS_MAX_PARAMETER_SET_SIZE];
+  unsigned spsSize, ppsSize;
+  if (!getParameterSets(sps, spsSize, pps, ppsSize)) return NULL;
+
+  profileLevelId = spsSize >= 4 ? (sps[1]<<16)|(sps[2]<<8)|sps[3] : 0;
+  char* spsBase64 = base64Encode((char const*)sps, spsSize);
+  char* ppsBase64 = base64Encode((char const*)pps, ppsSize);
+  char* result = new char[strlen(spsBase64) + strlen(ppsBase64) + 2];
+  sprintf(result, "%s,%s", spsBase64, ppsBase64);
+  delete[] spsBase64; delete[] ppsBase64;
+  return result;
+}
+
+////////// H264VideoFrameBusSink //////////
+
+H264VideoFrameBusSink* H264VideoFrameBusSink::createNew(UsageEnvironment& env,
+							char const* busName,
+							unsigned numSlots,
+							unsigned slotSize) {
+  H264VideoFrameBus* bus
+    = H264VideoFrameBus::createWriter(env, busName, numSlots, slotSize);
+  if (bus == NULL) return NULL;
+
+  return new H264VideoFrameBusSink(env, bus);
+}
+
+H264VideoFrameBusSink::H264VideoFrameBusSink(UsageEnvironment& env,
+					     H264VideoFrameBus* bus)
+  : MediaSink(env), fBus(bus), fIsInAccessUnit(False) {
+  fBufferSize = bus->slotSize(); // no NAL unit can be bigger
+  fBuffer = new unsigned char[fBufferSize];
+  fNextFrameTime.tv_sec = fNextFrameTime.tv_usec = 0;
+}
+
+H264VideoFrameBusSink::~H264VideoFrameBusSink() {
+  delete[] fBuffer;
+  delete fBus;
+}
+
+Boolean H264VideoFrameBusSink::sourceIsCompatibleWithUs(MediaSource& source) {
+  // We need to know where each access unit ends:
+  return source.isH264VideoStreamFramer();
+}
+
+Boolean H264VideoFrameBusSink::continuePlaying() {
+  if (fSource == NULL) return False;
+
+  fSource->getNextFrame(fBuffer, fBufferSize,
+			afterGettingFrame, this,
+			onSourceClosure, this);
+  return True;
+}
+
+void H264VideoFrameBusSink::afterGettingFrame(void* clientData, unsigned frameSize,
+					      unsigned numTruncatedBytes,
+					      struct timeval presentationTime,
+					      unsigned durationInMicroseconds) {
+  H264VideoFrameBusSink* sink = (H264VideoFrameBusSink*)clientData;
+  if (numTruncatedBytes > 0) {
+    DEBUG_LOG(ERR, "H264VideoFrameBusSink: dropped %u bytes of a too-large NAL unit",
+      numTruncatedBytes);
+  }
+  sink->afterGettingFrame1(frameSize, presentationTime, durationInMicroseconds);
+}
+
+void H264VideoFrameBusSink::afterGettingFrame1(unsigned frameSize,
+					       struct timeval presentationTime,
+					       unsigned durationInMicroseconds) {
+  if (!fIsInAccessUnit) {
+    fBus->beginAccessUnit();
+    fIsInAccessUnit = True;
+  }
+  fBus->addNALUnit(fBuffer, frameSize);
+  if (!((H264VideoStreamFramer*)fSource)->currentNALUnitEndsAccessUnit()) {
+    continuePlaying();
+    return;
+  }
+  fBus->endAccessUnit(presentationTime);
+  fIsInAccessUnit = False;
+
+  // A live source may hand us frames as fast as we ask for them, so - as
+  // "MultiFramedRTPSink" does - we ask for each frame only once the previous
+  // one's duration is up:
+  struct timeval timeNow;
+  gettimeofday(&timeNow, NULL);
+  if (fNextFrameTime.tv_sec == 0) fNextFrameTime = timeNow;
+  fNextFrameTime.tv_usec += durationInMicroseconds;
+  fNextFrameTime.tv_sec += fNextFrameTime.tv_usec/1000000;
+  fNextFrameTime.tv_usec %= 1000000;
+  int uSecondsToGo = 0;
+  if (fNextFrameTime.tv_sec > timeNow.tv_sec
+      || (fNextFrameTime.tv_sec == timeNow.tv_sec
+	  && fNextFrameTime.tv_usec > timeNow.tv_usec)) {
+    uSecondsToGo = (fNextFrameTime.tv_sec - timeNow.tv_sec)*1000000
+      + (fNextFrameTime.tv_usec - timeNow.tv_usec);
+  } else {
+    fNextFrameTime = timeNow; // we're behind; don't try to catch up
+  }
+  nextTask() = envir().taskScheduler().scheduleDelayedTask(uSecondsToGo,
+					      (TaskFunc*)getNextFrame, this);
+}
+
+void H264VideoFrameBusSink::getNextFrame(void* clientData) {
+  ((H264VideoFrameBusSink*)clientData)->continuePlaying();
+}
+
+////////// H264VideoFrameBusSource //////////
+
+H264VideoFrameBusSource*
+H264VideoFrameBusSource::createNew(UsageEnvironment& env, char const* busName,
+				   unsigned pollInterval) {
+  H264VideoFrameBus* bus = H264VideoFrameBus::openReader(env, busName);
+  if (bus == NULL) return NULL;
+
+  return new H264VideoFrameBusSource(env, bus, pollInterval);
+}
+
+H264VideoFrameBusSource::H264VideoFrameBusSource(UsageEnvironment& env,
+						 H264VideoFrameBus* bus,
+						 unsigned pollInterval)
+  : H264VideoStreamFramer(env, NULL),
+    fBus(bus), fPollInterval(pollInterval), fPollTask(NULL),
+    fNextSeqNo(0), fWaitingForKeyFrame(False), fNumOverruns(0),
+    fAccessUnitSize(0), fNextNALUnitOffset(0),
+    fCurrentNALUnitEndsAccessUnit(False) {
+  fAccessUnit = new unsigned char[bus->slotSize()];
+  fAccessUnitPresentationTime.tv_sec = fAccessUnitPresentationTime.tv_usec = 0;
+}
+
+H264VideoFrameBusSource::~H264VideoFrameBusSource() {
+  envir().taskScheduler().unscheduleDelayedTask(fPollTask);
+  delete[] fAccessUnit;
+  delete fBus;
+}
+
+char const* H264VideoFrameBusSource::MIMEtype() const {
+  return "video/H264";
+}
+
+Boolean H264VideoFrameBusSource::currentNALUnitEndsAccessUnit() {
+  return fCurrentNALUnitEndsAccessUnit;
+}
+
+void H264VideoFrameBusSource::doGetNextFrame() {
+  if (fNextNALUnitOffset >= fAccessUnitSize && !readAccessUnit()) {
+    // Nothing new yet; look again soon:
+    fPollTask = envir().taskScheduler().scheduleDelayedTask(fPollInterval,
+							    pollTask, this);
+    return;
+  }
+  deliverNALUnit();
+}
+
+void H264VideoFrameBusSource::doStopGettingFrames() {
+  envir().taskScheduler().unscheduleDelayedTask(fPollTask);
+  envir().taskScheduler().unscheduleDelayedTask(nextTask());
+}
+
+void H264VideoFrameBusSource::pollTask(void* clientData) {
+  H264VideoFrameBusSource* source = (H264VideoFrameBusSource*)clientData;
+  source->fPollTask = NULL;
+  source->doGetNextFrame();
+}
+
+Boolean H264VideoFrameBusSource::readAccessUnit() {
+  while (1) {
+    if (fNextSeqNo == 0) {
+      // Start from the latest key frame, if it's still there, else wait for
+      // the next:
+      u_int32_t lastSeqNo = fBus->lastSeqNo();
+      u_int32_t keyFrameSeqNo = fBus->lastKeyFrameSeqNo();
+      if (keyFrameSeqNo != 0 && lastSeqNo - keyFrameSeqNo < fBus->numSlots() - 1) {
+	fNextSeqNo = keyFrameSeqNo;
+	fWaitingForKeyFrame = False;
+      } else {
+	fNextSeqNo = lastSeqNo + 1;
+	if (fNextSeqNo == 0) fNextSeqNo = 1;
+	fWaitingForKeyFrame = True;
+      }
+    }
+
+    Boolean isKeyFrame;
+    switch (fBus->read(fNextSeqNo, fAccessUnit, fAccessUnitSize,
+		       fAccessUnitPresentationTime, isKeyFrame)) {
+    case H264VideoFrameBus::READ_NOT_YET: {
+      fAccessUnitSize = 0;
+      return False;
+    }
+    case H264VideoFrameBus::READ_OVERRUN: {
+      // We've fallen too far behind:
+      DEBUG_LOG(ERR, "Frame bus reader overrun at access unit %u; skipping to a key frame",
+	fNextSeqNo);
+      ++fNumOverruns;
+      readerOverruns.increment();
+      fNextSeqNo = 0;
+      fAccessUnitSize = 0;
+      break;
+    }
+    case H264VideoFrameBus::READ_OK: {
+      if (++fNextSeqNo == 0) fNextSeqNo = 1;
+      if (fWaitingForKeyFrame && !isKeyFrame) break;
+
+      fWaitingForKeyFrame = False;
+      fNextNALUnitOffset = 0;
+      return True;
+    }
+    }
+  }
+}
+
+void H264VideoFrameBusSource::deliverNALUnit() {
+  unsigned char const* ptr = &fAccessUnit[fNextNALUnitOffset];
+  unsigned nalUnitSize = (ptr[0]<<24)|(ptr[1]<<16)|(ptr[2]<<8)|ptr[3];
+  if (nalUnitSize > fAccessUnitSize - fNextNALUnitOffset - 4) {
+    nalUnitSize = fAccessUnitSize - fNextNALUnitOffset - 4; // can't happen
+  }
+  fNextNALUnitOffset += 4 + nalUnitSize;
+
+  if (nalUnitSize > fMaxSize) {
+    fNumTruncatedBytes = nalUnitSize - fMaxSize;
+    fFrameSize = fMaxSize;
+  } else {
+    fNumTruncatedBytes = 0;
+    fFrameSize = nalUnitSize;
+  }
+  memmove(fTo, &ptr[4], fFrameSize);
+
+  // All of an access unit's NAL units have its presentation time.  (They're
+  // live, so are sent as soon as they're read: no durations.)
+  fPresentationTime = fAccessUnitPresentationTime;
+  fDurationInMicroseconds = 0;
+  fCurrentNALUnitEndsAccessUnit = fNextNALUnitOffset + 4 > fAccessUnitSize;
+
+  // To avoid possible infinite recursion, we need to return to the event loop to do this:
+  nextTask() = envir().taskScheduler().scheduleDelayedTask(0,
+				(TaskFunc*)FramedSource::afterGetting, this);
+}
@@ -0,0 +1,104 @@
+/**********
+This library is free software; you can redistribute it and/or modify it under
+the terms of the GNU Lesser General Public License as published by the
+Free Software Foundation; either version 2.1 of the License, or (at your
+option) any later version. (See <http://www.gnu.org/copyleft/lesser.html>.)
+
+This library is distributed in the hope that it will be useful, but WITHOUT
+ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for
+more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with this library; if not, write to the Free Software Foundation, Inc.,
+51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA
+**********/
+// "liveMedia"
+// Copyright (c) 1996-2009 Live Networks, Inc.  All rights reserved.
+// A 'ServerMediaSubsession' object that creates new, unicast, "RTPSink"s
+// on demand, from the live H.264 stream that another process's encoder is
+// writing into a shared-memory "H264VideoFrameBus".
+// Implementation
+
+#include "H264VideoFrameBusServerMediaSubsession.hh"
+#include "H264VideoFrameBus.hh"
+#include "H264VideoRTPSink.hh"
+#include "LogMacros.hh"
+
+H264VideoFrameBusServerMediaSubsession*
+H264VideoFrameBusServerMediaSubsession::createNew(UsageEnvironment& env,
+						  char const* busName,
+						  Boolean fanOutFirstSource,
+						  unsigned gopCacheSize,
+						  unsigned gopBurstRate) {
+  return new H264VideoFrameBusServerMediaSubsession(env, busName,
+						    fanOutFirstSource,
+						    gopCacheSize, gopBurstRate);
+}
+
+H264VideoFrameBusServerMediaSubsession
+::H264VideoFrameBusServerMediaSubsession(UsageEnvironment& env,
+					 char const* busName,
+					 Boolean fanOutFirstSource,
+					 unsigned gopCacheSize,
+					 unsigned gopBurstRate)
+  : OnDemandServerMediaSubsession(env, False/*reuseFirstSource*/, 6970,
+				  fanOutFirstSource),
+    fBusName(strDup(busName)),
+    fGOPCacheSize(gopCacheSize), fGOPBurstRate(gopBurstRate) {
+}
+
+H264VideoFrameBusServerMediaSubsession::~H264VideoFrameBusServerMediaSubsession() {
+  delete[] fBusName;
+}
+
+FramedSource* H264VideoFrameBusServerMediaSubsession
+::createNewStreamSource(unsigned /*clientSessionId*/, unsigned& estBitrate) {
+  estBitrate = 500; // kbps, estimate
+
+  H264VideoFrameBusSource* source
+    = H264VideoFrameBusSource::createNew(envir(), fBusName);
+  if (source == NULL) {
+    DEBUG_LOG(ERR, "Can't read frame bus \"%s\": %s", fBusName,
+      envir().getResultMsg());
+  }
+  return source;
+}
+
+RTPSink* H264VideoFrameBusServerMediaSubsession
+::createNewRTPSink(Groupsock* rtpGroupsock,
+		   unsigned char rtpPayloadTypeIfDynamic,
+		   FramedSource* inputSource) {
+  // inputSource comes from our createNewStreamSource() - except for a
+  // fan-out packetizer, which gets it later; we look at the bus ourself:
+  H264VideoFrameBus* ourBus = NULL;
+  if (inputSource == NULL) {
+    ourBus = H264VideoFrameBus::openReader(envir(), fBusName);
+    if (ourBus == NULL) {
+      DEBUG_LOG(ERR, "Can't read frame bus \"%s\": %s", fBusName,
+	envir().getResultMsg());
+      return NULL;
+    }
+  }
+  H264VideoFrameBus& bus = inputSource != NULL
+    ? ((H264VideoFrameBusSource*)inputSource)->bus() : *ourBus;
+
+  // The sink must be able to take any access unit's NAL units whole:
+  if (OutPacketBuffer::maxSize < bus.slotSize()) {
+    OutPacketBuffer::maxSize = bus.slotSize();
+  }
+
+  // The encoder may not have sent its SPS and PPS yet; if not, they'll be
+  // in-band only:
+  unsigned profileLevelId = 0;
+  char* sprop = bus.spropParameterSets(profileLevelId);
+  H264VideoRTPSink* sink
+    = H264VideoRTPSink::createNew(envir(), rtpGroupsock, rtpPayloadTypeIfDynamic,
+				  profileLevelId, sprop == NULL ? "" : sprop);
+  delete[] sprop;
+  delete ourBus;
+  if (sink != NULL && fansOutFirstSource() && fGOPCacheSize > 0) {
+    sink->enableGOPCache(fGOPCacheSize, fGOPBurstRate);
+  }
+  return sink;
+}
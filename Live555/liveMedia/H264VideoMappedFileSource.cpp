@@ -0,0 +1,188 @@
+/**********
+This library is free software; you can redistribute it and/or modify it under
+the terms of the GNU Lesser General Public License as published by the
+Free Software Foundation; either version 2.1 of the License, or (at your
+option) any later version. (See <http://www.gnu.org/copyleft/lesser.html>.)
+
+This library is distributed in the hope that it will be useful, but WITHOUT
+ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for
+more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with this library; if not, write to the Free Software Foundation, Inc.,
+51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA
+**********/
+// "liveMedia"
+// Copyright (c) 1996-2009 Live Networks, Inc.  All rights reserved.
+// A source that delivers - as a "H264VideoStreamFramer" - the NAL units of
+// an indexed, memory-mapped H.264 Elementary Stream file
+// Implementation
+
+#include "H264VideoMappedFileSource.hh"
+#include "GroupsockHelper.hh"
+#include <string.h>
+
+#define NPT_EPSILON 1e-6 // seconds; well within a frame
+
+H264VideoMappedFileSource*
+H264VideoMappedFileSource::createNew(UsageEnvironment& env,
+				     H264VideoFileIndex& index) {
+  return new H264VideoMappedFileSource(env, index);
+}
+
+H264VideoMappedFileSource
+::H264VideoMappedFileSource(UsageEnvironment& env, H264VideoFileIndex& index)
+  : H264VideoStreamFramer(env, NULL), fIndex(index), fScale(1.0f),
+    fCurrentAccessUnit(0), fNextNALUnit(0), fEndNALUnit(0),
+    fAccessUnitDuration(0), fCurrentNALUnitEndsAccessUnit(False),
+    fResetPresentationTime(True), fLastDuration(0) {
+  startAccessUnit(0);
+}
+
+H264VideoMappedFileSource::~H264VideoMappedFileSource() {
+  envir().taskScheduler().unscheduleDelayedTask(nextTask());
+}
+
+void H264VideoMappedFileSource::seekToNPT(double seekNPT) {
+  unsigned accessUnit;
+  if (fIndex.numKeyFrames() > 0) {
+    accessUnit = fIndex.keyFrame(fIndex.keyFrameAtOrBefore(seekNPT + NPT_EPSILON));
+  } else {
+    // We can only hope that the decoder copes:
+    accessUnit = seekNPT <= 0.0 ? 0 : (unsigned)(seekNPT*fIndex.frameRate());
+    if (accessUnit >= fIndex.numAccessUnits()) {
+      accessUnit = fIndex.numAccessUnits() - 1;
+    }
+  }
+
+  startAccessUnit(accessUnit);
+  fResetPresentationTime = True;
+}
+
+void H264VideoMappedFileSource::setScale(float scale) {
+  if (scale == 0.0f || fIndex.numKeyFrames() == 0) scale = 1.0f;
+  fScale = scale;
+  fResetPresentationTime = True;
+
+  if (isTrickPlay() && fNextNALUnit == fIndex.firstNALUnit(fCurrentAccessUnit)) {
+    // Start (again) from a key frame:
+    double npt = fIndex.npt(fCurrentAccessUnit);
+    startAccessUnit(fIndex.keyFrame(fIndex.keyFrameAtOrBefore(npt + NPT_EPSILON)));
+  } else {
+    startAccessUnit(fCurrentAccessUnit, False);
+  }
+}
+
+void H264VideoMappedFileSource::doGetNextFrame() {
+  if (fNextNALUnit >= fEndNALUnit) {
+    // On to the next access unit:
+    unsigned accessUnit;
+    if (isTrickPlay()) {
+      if (!nextKeyFrame(accessUnit)) {
+	handleClosure(this);
+	return;
+      }
+    } else {
+      accessUnit = fCurrentAccessUnit + 1;
+      if (accessUnit >= fIndex.numAccessUnits()) {
+	handleClosure(this);
+	return;
+      }
+    }
+    startAccessUnit(accessUnit);
+  }
+
+  deliverNALUnit();
+}
+
+void H264VideoMappedFileSource::doStopGettingFrames() {
+  envir().taskScheduler().unscheduleDelayedTask(nextTask());
+}
+
+char const* H264VideoMappedFileSource::MIMEtype() const {
+  return "video/H264";
+}
+
+Boolean H264VideoMappedFileSource::currentNALUnitEndsAccessUnit() {
+  return fCurrentNALUnitEndsAccessUnit;
+}
+
+void H264VideoMappedFileSource::startAccessUnit(unsigned accessUnit,
+						Boolean fromItsStart) {
+  fCurrentAccessUnit = accessUnit;
+  if (fromItsStart) fNextNALUnit = fIndex.firstNALUnit(accessUnit);
+  fEndNALUnit = accessUnit + 1 < fIndex.numAccessUnits()
+    ? fIndex.firstNALUnit(accessUnit + 1) : fIndex.numNALUnits();
+
+  // How long this access unit is shown for:
+  double frameDuration = 1000000.0/fIndex.frameRate();
+  unsigned nextAccessUnit;
+  if (!isTrickPlay()) {
+    fAccessUnitDuration = (unsigned)(frameDuration/fScale);
+  } else if (nextKeyFrame(nextAccessUnit)) {
+    // Until the next key frame's time, at this scale:
+    unsigned numFrames = nextAccessUnit > accessUnit
+      ? nextAccessUnit - accessUnit : accessUnit - nextAccessUnit;
+    fAccessUnitDuration
+      = (unsigned)(numFrames*frameDuration/(fScale < 0 ? -fScale : fScale));
+  } else {
+    fAccessUnitDuration = (unsigned)frameDuration;
+  }
+}
+
+Boolean H264VideoMappedFileSource::nextKeyFrame(unsigned& accessUnit) const {
+  // The key frame at least "fScale" frames on (or back) from the current one:
+  double target = fIndex.npt(fCurrentAccessUnit) + fScale/fIndex.frameRate();
+  unsigned k;
+  if (fScale > 0) {
+    k = fIndex.keyFrameAtOrBefore(target - NPT_EPSILON);
+    if (fIndex.npt(fIndex.keyFrame(k)) < target - NPT_EPSILON) ++k;
+    if (k >= fIndex.numKeyFrames()) return False;
+  } else {
+    k = fIndex.keyFrameAtOrBefore(target + NPT_EPSILON);
+    if (fIndex.npt(fIndex.keyFrame(k)) > target + NPT_EPSILON) return False;
+  }
+
+  accessUnit = fIndex.keyFrame(k);
+  return True;
+}
+
+void H264VideoMappedFileSource::deliverNALUnit() {
+  unsigned nalUnitSize;
+  unsigned char const* nalUnit = fIndex.nalUnit(fNextNALUnit, nalUnitSize);
+  if (nalUnitSize > fMaxSize) {
+    fNumTruncatedBytes = nalUnitSize - fMaxSize;
+    nalUnitSize = fMaxSize;
+  } else {
+    fNumTruncatedBytes = 0;
+  }
+  memmove(fTo, nalUnit, nalUnitSize);
+  fFrameSize = nalUnitSize;
+
+  // All of an access unit's NAL units have its presentation time:
+  if (fNextNALUnit == fIndex.firstNALUnit(fCurrentAccessUnit)) {
+    if (fResetPresentationTime) {
+      gettimeofday(&fPresentationTime, NULL);
+      fResetPresentationTime = False;
+    } else {
+      // Increment by the play time of the previous access unit:
+      unsigned uSeconds = fPresentationTime.tv_usec + fLastDuration;
+      fPresentationTime.tv_sec += uSeconds/1000000;
+      fPresentationTime.tv_usec = uSeconds%1000000;
+    }
+  }
+
+  fCurrentNALUnitEndsAccessUnit = fIndex.nalUnitEndsAccessUnit(fNextNALUnit)
+    || fNextNALUnit + 1 == fEndNALUnit;
+  if (fCurrentNALUnitEndsAccessUnit) {
+    fDurationInMicroseconds = fLastDuration = fAccessUnitDuration;
+  } else {
+    fDurationInMicroseconds = 0;
+  }
+  ++fNextNALUnit;
+
+  // To avoid possible infinite recursion, we need to return to the event loop to do this:
+  nextTask() = envir().taskScheduler().scheduleDelayedTask(0,
+				(TaskFunc*)FramedSource::afterGetting, this);
+}
@@ -30,7 +30,7 @@ H264VideoRTPSink
            unsigned profile_level_id,
            char const* sprop_parameter_sets_str)
   : VideoRTPSink(env, RTPgs, rtpPayloadFormat, 90000, "H264"),
-    fOurFragmenter(NULL) {
+    fOurFragmenter(NULL), fLastNALUnitType(0) {
   // Set up the "a=fmtp:" SDP line for this stream:
   char const* fmtpFmt =
     "a=fmtp:%d packetization-mode=1"
@@ -122,6 +122,30 @@ Boolean H264VideoRTPSink
   return False;
 }
 
+Boolean H264VideoRTPSink
+::packetStartsKeyFrame(unsigned char const* payload, unsigned payloadSize) {
+  // Our framer's NAL units keep the Annex B start code that x264 gives them:
+  if (payloadSize >= 4 && payload[0] == 0 && payload[1] == 0
+      && payload[2] == 0 && payload[3] == 1) {
+    payload += 4; payloadSize -= 4;
+  }
+  if (payloadSize < 2) return False;
+
+  unsigned char nalUnitType = payload[0]&0x1F;
+  if (nalUnitType == 28) { // FU-A
+    if ((payload[1]&0x80) == 0) return False; // not the NAL unit's start
+    nalUnitType = payload[1]&0x1F;
+  }
+  if (nalUnitType == 6 || nalUnitType == 9) return False; // SEI, AUD
+
+  // A key frame is SPS, PPS, then IDR slice(s) - or just the IDR slice(s):
+  Boolean wasKeyFrame = fLastNALUnitType == 7 || fLastNALUnitType == 8
+    || fLastNALUnitType == 5;
+  fLastNALUnitType = nalUnitType;
+  return !wasKeyFrame
+    && (nalUnitType == 7 || nalUnitType == 8 || nalUnitType == 5);
+}
+
 char const* H264VideoRTPSink::auxSDPLine() {
   return fFmtpSDPLine;
 }
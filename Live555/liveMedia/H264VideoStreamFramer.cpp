@@ -40,9 +40,34 @@ Boolean H264VideoStreamFramer::isH264VideoStreamFramer() const {
 #include "ICameraCaptuer.h"
 #include "H264EndWrapper.h"
 #include "H264DecWrapper.h"
+#include "RTCPRateController.hh"
+#include "FrameTrace.hh"
+#include "MetricsRegistry.hh"
 
 ICameraCaptuer* MyH264VideoStreamFramer::m_pCamera = NULL;
 
+// For a "MetricsRegistry" to scrape (all live encoders together):
+static MetricsCounter encodedFrames("encoder_frames_total",
+    "Frames captured and encoded");
+static MetricsCounter encodedBytes("encoder_bytes_total",
+    "Bytes of NAL units that the encoder output");
+static MetricsCounter captureSeconds("encoder_capture_seconds_total",
+    "Time spent waiting for, and converting, camera frames");
+static MetricsCounter encodeSeconds("encoder_encode_seconds_total",
+    "Time spent encoding frames");
+static MetricsGauge targetBitrate("encoder_target_bits_per_second",
+    "The encoder's target bitrate");
+static MetricsGauge queuedNALUnits("encoder_queued_nal_units",
+    "NAL units encoded, but not yet taken by the RTP sink");
+static MetricsGauge speedPreset("encoder_speed_preset",
+    "The encoder's analysis preset, from 0 (fastest) up");
+static MetricsGauge frameBudgetUsed("encoder_frame_budget_used",
+    "Smoothed encode time per frame, as a fraction of the frame interval");
+static MetricsCounter speedChanges("encoder_speed_changes_total",
+    "Times that the encoder's speed control changed its preset");
+static MetricsCounter staticFrames("encoder_static_frames_total",
+    "Frames coded as unchanged since the last one (all skipped macroblocks)");
+
 //jiangqi
 //
 #undef _TEST_OUTPUT_264  //ֹ264ļ
@@ -74,12 +99,15 @@ MyH264VideoStreamFramer::MyH264VideoStreamFramer(UsageEnvironment& env,
     FramedSource* inputSource, H264EncWrapper* pH264Enc, H264DecWrapper* pH264Dec):
       H264VideoStreamFramer(env, inputSource), 
       m_pNalArray(NULL), m_iCurNalNum(0), m_iCurNal(0), m_iCurFrame(0),
-      m_pH264Enc(pH264Enc), m_pH264Dec(pH264Dec)
+      m_pH264Enc(pH264Enc), m_pH264Dec(pH264Dec), m_pRateController(NULL)
 {
 }
 
 MyH264VideoStreamFramer::~MyH264VideoStreamFramer()
 {
+    Medium::close(m_pRateController);
+    m_pRateController = NULL;
+
     m_pCamera->CloseCamera();
     
     m_pH264Enc->Destroy();
@@ -104,7 +132,28 @@ MyH264VideoStreamFramer::~MyH264VideoStreamFramer()
 #endif
 }
 
-const int VIDEO_WIDTH = 320, VIDEO_HEIGHT = 240;
+const int VIDEO_WIDTH = 320, VIDEO_HEIGHT = 240, VIDEO_FRAME_RATE = 25;
+// kbps; the encoder starts at VIDEO_BITRATE and RTCP feedback moves it within the range
+const int VIDEO_BITRATE = 96, VIDEO_MIN_BITRATE = 32, VIDEO_MAX_BITRATE = 512;
+// Sent packets kept for resending on a NACK (a few seconds even at the top
+// bitrate), and the RFC 4588 payload type they're resent with
+const unsigned RTP_HISTORY_SIZE = 256;
+const unsigned char RTX_PAYLOAD_TYPE = 97;
+// One RFC 5109 parity packet per FEC_ROW_SIZE packets (10% more packets),
+// for viewers too far away for a NACK round trip
+const unsigned FEC_ROW_SIZE = 10;
+const unsigned char FEC_PAYLOAD_TYPE = 98;
+// Fanned-out viewers start from the last key frame, sent from a cache of up
+// to GOP_CACHE_SIZE bytes at GOP_BURST_RATE kbps, rather than wait for the next
+const unsigned GOP_CACHE_SIZE = 1024*1024;
+const unsigned GOP_BURST_RATE = 4*VIDEO_MAX_BITRATE;
+// The encoder's speed control keeps its encode time at this percentage of
+// the frame interval, trading analysis effort for it (see H264EncWrapper)
+const int ENCODER_SPEED_TARGET = 70;
+// A frame that differs from the last one coded in full by no more than this
+// (mean luma difference per pixel, in every macroblock) - camera noise - is
+// coded as a skip frame, at a fraction of the CPU
+const float ENCODER_STATIC_THRESHOLD = 3.0f;
 
 MyH264VideoStreamFramer* MyH264VideoStreamFramer::createNew(
                                                          UsageEnvironment& env,
@@ -134,11 +183,21 @@ MyH264VideoStreamFramer* MyH264VideoStreamFramer::createNew(
     //ʼx264ͨʿԿͼ
     //jiangqi ע:H264VideoFileServerMediaSubsessionĹ캯Ҳʿ
     H264EncWrapper* pH264Enc = new H264EncWrapper;
-    if(pH264Enc->Initialize(VIDEO_WIDTH, VIDEO_HEIGHT, 96, 25) < 0)
+    if(pH264Enc->Initialize(VIDEO_WIDTH, VIDEO_HEIGHT, VIDEO_BITRATE, VIDEO_FRAME_RATE) < 0)
     {
         DEBUG_LOG(ERR, "Initialize x264 encoder error.");
         return NULL;
     }
+    targetBitrate.set(pH264Enc->GetBitrate()*1000.0);
+    if(pH264Enc->EnableSpeedControl(ENCODER_SPEED_TARGET) < 0)
+    {
+        DEBUG_LOG(ERR, "Can not enable x264 speed control.");
+    }
+    if(pH264Enc->SetStaticThreshold(ENCODER_STATIC_THRESHOLD) < 0)
+    {
+        DEBUG_LOG(ERR, "Can not enable x264 static-scene skip.");
+    }
+    speedPreset.set(pH264Enc->GetPreset());
 
     // ʼ
     H264DecWrapper* pH264Dec = new H264DecWrapper;
@@ -179,11 +238,49 @@ Boolean MyH264VideoStreamFramer::currentNALUnitEndsAccessUnit()
     }
 }
 
+void MyH264VideoStreamFramer::startRateControl(MultiFramedRTPSink& sink)
+{
+    Medium::close(m_pRateController);
+    m_pRateController = RTCPRateController::createNew(envir(), sink,
+        m_pH264Enc->GetBitrate(), VIDEO_MIN_BITRATE, VIDEO_MAX_BITRATE,
+        onTargetBitrate, this);
+}
+
+// Called from the event loop, like doGetNextFrame(), so the encoder is never busy here
+void MyH264VideoStreamFramer::onTargetBitrate(void* clientData, unsigned newKbps)
+{
+    MyH264VideoStreamFramer* fr = (MyH264VideoStreamFramer*)clientData;
+    if(fr->m_pH264Enc->SetBitrate((int)newKbps) < 0)
+    {
+        DEBUG_LOG(ERR, "Can not change x264 bitrate to %u kbps", newKbps);
+    }
+    targetBitrate.set(fr->m_pH264Enc->GetBitrate()*1000.0);
+}
+
+void MyH264VideoStreamFramer::setMaxKeyFrameInterval(double seconds)
+{
+    int frames = (int)(seconds*VIDEO_FRAME_RATE);
+    if(m_pH264Enc->SetMaxKeyFrameInterval(frames) < 0)
+    {
+        DEBUG_LOG(ERR, "Can not limit the x264 key frame interval to %d frames", frames);
+    }
+}
+
+void MyH264VideoStreamFramer::retryGetNextFrame(void* clientData)
+{
+    ((MyH264VideoStreamFramer*)clientData)->doGetNextFrame();
+}
+
+void MyH264VideoStreamFramer::doStopGettingFrames()
+{
+    envir().taskScheduler().unscheduleDelayedTask(nextTask());
+    H264VideoStreamFramer::doStopGettingFrames();
+}
+
 void MyH264VideoStreamFramer::doGetNextFrame()
 {
     DEBUG_LOG(INF, "MyH264VideoStreamFramer::doGetNextFrame()");
     TNAL* pNal = NULL;
-    unsigned char* pOrgImg;
     
     //ȡNAL
     if((m_pNalArray != NULL) && (m_iCurNal < m_iCurNalNum))
@@ -196,14 +293,64 @@ void MyH264VideoStreamFramer::doGetNextFrame()
         m_pH264Enc->CleanNAL(m_pNalArray, m_iCurNalNum);
         m_iCurNal = 0;
         
-        pOrgImg = m_pCamera->QueryFrame();
+        unsigned frameId = FrameTrace::beginFrame();
+        u_int64_t captureStart = FrameTrace::now();
+        TCamFrame frame;
+        if(!m_pCamera->QueryFrame(frame)
+            || frame.iWidth != VIDEO_WIDTH || frame.iHeight != VIDEO_HEIGHT)
+        {
+            DEBUG_LOG(ERR, "Can not grab a %dx%d frame from the camera, trying again",
+                VIDEO_WIDTH, VIDEO_HEIGHT);
+            m_pNalArray = NULL;
+            m_iCurNalNum = 0;
+            nextTask() = envir().taskScheduler().scheduleDelayedTask(40000,
+                (TaskFunc*)retryGetNextFrame, this);
+            return;
+        }
+        FrameTrace::mark(frameId, FrameTrace::GRABBED, m_pCamera->GetLastGrabTime());
+        FrameTrace::mark(frameId, FrameTrace::CONVERTED);
         gettimeofday(&fPresentationTime, NULL);//ͬһ֡NALͬʱ
+        FrameTrace::setPresentationTime(frameId, fPresentationTime);
+
+        u_int64_t encodeStart = FrameTrace::now();
+        // In the camera's own format, NV12, YUYV or I420, straight from its
+        // buffer: x264 converts it to I420 as it copies the frame in
+        static const int s_iCsp[] = { X264_CSP_I420, X264_CSP_NV12, X264_CSP_YUYV };
+        m_pH264Enc->Encode(s_iCsp[frame.eFormat], frame.pPlane, frame.iStride,
+            m_pNalArray, m_iCurNalNum);
+        FrameTrace::mark(frameId, FrameTrace::ENCODED);
+
+        double ticksPerSecond = (double)FrameTrace::ticksPerSecond();
+        encodedFrames.increment();
+        captureSeconds.add((encodeStart - captureStart)/ticksPerSecond);
+        encodeSeconds.add((FrameTrace::now() - encodeStart)/ticksPerSecond);
+        for(int i = 0; i < m_iCurNalNum; i++)
+        {
+            encodedBytes.add(m_pNalArray[i].size);
+        }
+        if(m_pH264Enc->IsLastFrameStatic())
+        {
+            staticFrames.increment();
+        }
 
-        m_pH264Enc->Encode(pOrgImg, m_pNalArray, m_iCurNalNum);
+        H264EncWrapper::TSpeedState speed;
+        m_pH264Enc->GetSpeedState(speed);
+        if(speed.iPreset != (int)speedPreset.value())
+        {
+            DEBUG_LOG(INF, "Encoder speed preset now \"%s\" (%d steps down, %d up so far)",
+                H264EncWrapper::GetPresetName(speed.iPreset), speed.iStepsDown, speed.iStepsUp);
+            speedPreset.set(speed.iPreset);
+            speedChanges.increment();
+        }
+        if(speed.dEncodeMs > 0) // (0 just after a step)
+        {
+            frameBudgetUsed.set(speed.dEncodeMs/speed.dBudgetMs);
+        }
         pNal = &m_pNalArray[m_iCurNal];
         DEBUG_LOG(INF, "Frame[%d], Nal[%d:%d]: size = %d", m_iCurFrame, m_iCurNalNum, m_iCurNal, pNal->size);
     }
     m_iCurNal++;
+    queuedNALUnits.set(m_iCurNalNum - m_iCurNal);
 
 #if defined(_TEST_DECODE)
     // begin ////////////////////////////////////////////////
@@ -273,14 +420,18 @@ void MyH264VideoStreamFramer::doGetNextFrame()
 
 H264LiveVideoServerMediaSubsession*
 H264LiveVideoServerMediaSubsession::createNew(UsageEnvironment& env,
-						  Boolean reuseFirstSource) {
-  return new H264LiveVideoServerMediaSubsession(env, reuseFirstSource);
+						  Boolean reuseFirstSource,
+						  Boolean fanOutFirstSource) {
+  return new H264LiveVideoServerMediaSubsession(env, reuseFirstSource,
+						fanOutFirstSource);
 }
 
 H264LiveVideoServerMediaSubsession
 ::H264LiveVideoServerMediaSubsession(UsageEnvironment& env,
-					 Boolean reuseFirstSource)
-  : OnDemandServerMediaSubsession(env, reuseFirstSource) {
+					 Boolean reuseFirstSource,
+					 Boolean fanOutFirstSource)
+  : OnDemandServerMediaSubsession(env, reuseFirstSource, 6970,
+				  fanOutFirstSource) {
 }
 
 H264LiveVideoServerMediaSubsession::~H264LiveVideoServerMediaSubsession() {
@@ -299,23 +450,192 @@ FramedSource* H264LiveVideoServerMediaSubsession
   return MyH264VideoStreamFramer::createNew(envir(), NULL);
 }
 
+// The sink for our live source (unicast or multicast), with the recovery
+// and rate control that the SDP below announces.  A multicast sink gets only
+// FEC: one receiver's NACKs would have packets resent to the whole group,
+// and its receiver reports would set everyone's bitrate.
+static H264VideoRTPSink* createLiveRTPSink(UsageEnvironment& env,
+					   Groupsock* rtpGroupsock,
+					   FramedSource* inputSource,
+					   Boolean isMulticast) {
+  H264VideoRTPSink* sink = H264VideoRTPSink::createNew(env, rtpGroupsock, 96, 0, "H264");
+  if (sink == NULL) return NULL;
+
+  sink->enableFEC(FEC_PAYLOAD_TYPE, FEC_ROW_SIZE);
+  if (isMulticast) return sink;
+
+  sink->enableRetransmission(RTP_HISTORY_SIZE, RTX_PAYLOAD_TYPE);
+  if (inputSource != NULL) {
+    // inputSource is a MyH264VideoStreamFramer
+    ((MyH264VideoStreamFramer*)inputSource)->startRateControl(*sink);
+  }
+  return sink;
+}
+
+// The SDP attributes of the streams that "createLiveRTPSink()" sends, by
+// payload type:
+#define LIVE_VIDEO_SDP_H264_ATTRIBUTES \
+        "a=rtpmap:96 H264/90000\r\n" \
+        "a=fmtp:96 packetization-mode=1;profile-level-id=000000;sprop-parameter-sets=H264\r\n"
+#define LIVE_VIDEO_SDP_NACK_ATTRIBUTES \
+        "a=rtcp-fb:96 nack\r\n"
+#define LIVE_VIDEO_SDP_RTX_ATTRIBUTES \
+        "a=rtpmap:97 rtx/90000\r\n" \
+        "a=fmtp:97 apt=96\r\n"
+#define LIVE_VIDEO_SDP_FEC_ATTRIBUTES \
+        "a=rtpmap:98 ulpfec/90000\r\n"
+
+// Unicast, with everything.  The NACK feedback needs the "RTP/AVPF" profile
+// (RFC 4585):
+#define LIVE_VIDEO_SDP_PROTOCOL "RTP/AVPF"
+#define LIVE_VIDEO_SDP_FORMATS "96 97 98"
+#define LIVE_VIDEO_SDP_ATTRIBUTES \
+        LIVE_VIDEO_SDP_H264_ATTRIBUTES \
+        LIVE_VIDEO_SDP_NACK_ATTRIBUTES \
+        LIVE_VIDEO_SDP_RTX_ATTRIBUTES \
+        LIVE_VIDEO_SDP_FEC_ATTRIBUTES
+
+// A fanned-out stream has no FEC (see "getFanOutPacketizer()"), and its
+// sinks resend the NACKed packets as they were (see
+// "FanOutRTPSink::retransmitPacket()"), so only the media format is announced:
+#define FAN_OUT_VIDEO_SDP_FORMATS "96"
+#define FAN_OUT_VIDEO_SDP_ATTRIBUTES \
+        LIVE_VIDEO_SDP_H264_ATTRIBUTES \
+        LIVE_VIDEO_SDP_NACK_ATTRIBUTES
+
+// Multicast: FEC, but no feedback
+#define MULTICAST_VIDEO_SDP_PROTOCOL "RTP/AVP"
+#define MULTICAST_VIDEO_SDP_FORMATS "96 98"
+#define MULTICAST_VIDEO_SDP_ATTRIBUTES \
+        LIVE_VIDEO_SDP_H264_ATTRIBUTES \
+        LIVE_VIDEO_SDP_FEC_ATTRIBUTES
+
 RTPSink* H264LiveVideoServerMediaSubsession::createNewRTPSink(Groupsock* rtpGroupsock,
 								  unsigned char rtpPayloadTypeIfDynamic,
-								  FramedSource* /*inputSource*/) {
-  return H264VideoRTPSink::createNew(envir(), rtpGroupsock, 96, 0, "H264");
+								  FramedSource* inputSource) {
+  // inputSource comes from our createNewStreamSource()
+  H264VideoRTPSink* sink = createLiveRTPSink(envir(), rtpGroupsock, inputSource, False);
+  if (sink != NULL && fansOutFirstSource()) {
+    sink->enableGOPCache(GOP_CACHE_SIZE, GOP_BURST_RATE);
+  }
+  return sink;
+}
+
+void H264LiveVideoServerMediaSubsession
+::fanOutSourceCreated(FramedSource* inputSource, MultiFramedRTPSink& packetizer) {
+  // inputSource comes from our createNewStreamSource()
+  ((MyH264VideoStreamFramer*)inputSource)->startRateControl(packetizer);
 }
 
 //jiangqi: δsourcesink
 //SDPҪʵʵýϢ
 char const* H264LiveVideoServerMediaSubsession::sdpLines()
 {
+    if (fansOutFirstSource())
+    {
+        return fSDPLines = 
+            "m=video 0 " LIVE_VIDEO_SDP_PROTOCOL " " FAN_OUT_VIDEO_SDP_FORMATS "\r\n"
+            "c=IN IP4 0.0.0.0\r\n"
+            "b=AS:96\r\n"
+            FAN_OUT_VIDEO_SDP_ATTRIBUTES
+            "a=control:track1\r\n";
+    }
     return fSDPLines = 
-        "m=video 0 RTP/AVP 96\r\n"
+        "m=video 0 " LIVE_VIDEO_SDP_PROTOCOL " " LIVE_VIDEO_SDP_FORMATS "\r\n"
         "c=IN IP4 0.0.0.0\r\n"
         "b=AS:96\r\n"
-        "a=rtpmap:96 H264/90000\r\n"
-        "a=fmtp:96 packetization-mode=1;profile-level-id=000000;sprop-parameter-sets=H264\r\n"
+        LIVE_VIDEO_SDP_ATTRIBUTES
         "a=control:track1\r\n";
 }
+
+H264LiveVideoMulticastSubsession*
+H264LiveVideoMulticastSubsession::createNew(UsageEnvironment& env,
+					    struct in_addr const& groupAddress,
+					    portNumBits rtpPortNum, u_int8_t ttl,
+					    Boolean isSSM,
+					    H264VideoStreamFramer* source) {
+  Groupsock* rtpGroupsock = new Groupsock(env, groupAddress, Port(rtpPortNum), ttl);
+  Groupsock* rtcpGroupsock = new Groupsock(env, groupAddress, Port(rtpPortNum+1), ttl);
+  if (isSSM) rtpGroupsock->multicastSendOnly(); // we're a SSM source
+      // (RTCPInstance does the same for "rtcpGroupsock")
+
+  if (source == NULL) source = MyH264VideoStreamFramer::createNew(env, NULL);
+  H264VideoRTPSink* sink = createLiveRTPSink(env, rtpGroupsock, source, True);
+  if (source == NULL || sink == NULL) {
+    Medium::close(sink); Medium::close(source);
+    delete rtpGroupsock; delete rtcpGroupsock;
+    return NULL;
+  }
+
+  char CNAME[100];
+  gethostname(CNAME, sizeof CNAME);
+  CNAME[sizeof CNAME-1] = '\0'; // just in case
+  RTCPInstance* rtcpInstance
+    = RTCPInstance::createNew(env, rtcpGroupsock, VIDEO_BITRATE,
+			      (unsigned char*)CNAME, sink, NULL /* we're a server */,
+			      isSSM);
+      // Note: This starts RTCP running automatically
+
+  DEBUG_LOG(INF, "Multicast the live stream to %s:%u (ttl %u%s)",
+    our_inet_ntoa(groupAddress), rtpPortNum, ttl, isSSM ? ", SSM" : "");
+  sink->startPlaying(*source, NULL, NULL);
+  return new H264LiveVideoMulticastSubsession(*sink, rtcpInstance, source, isSSM);
+}
+
+H264LiveVideoMulticastSubsession
+::H264LiveVideoMulticastSubsession(RTPSink& rtpSink, RTCPInstance* rtcpInstance,
+				   FramedSource* source, Boolean isSSM)
+  : PassiveServerMediaSubsession(rtpSink, rtcpInstance),
+    fOurRTPSink(rtpSink), fOurRTCPInstance(rtcpInstance), fSource(source),
+    fIsSSM(isSSM), fOurSDPLines(NULL) {
+}
+
+H264LiveVideoMulticastSubsession::~H264LiveVideoMulticastSubsession() {
+  delete[] fOurSDPLines;
+
+  Groupsock* rtpGroupsock = &fOurRTPSink.groupsockBeingUsed();
+  Groupsock* rtcpGroupsock = fOurRTCPInstance->RTCPgs();
+  Medium::close(fOurRTCPInstance) /* will send a RTCP BYE */;
+  Medium::close(&fOurRTPSink);
+  Medium::close(fSource);
+  delete rtpGroupsock; delete rtcpGroupsock;
+}
+
+char const* H264LiveVideoMulticastSubsession::sdpLines() {
+  if (fOurSDPLines == NULL) {
+    // With the group's address, port and TTL:
+    Groupsock const& gs = fOurRTPSink.groupsockBeingUsed();
+    char* const ipAddressStr = strDup(our_inet_ntoa(gs.groupAddress()));
+    char const* const sdpFmt =
+      "m=video %u " MULTICAST_VIDEO_SDP_PROTOCOL " " MULTICAST_VIDEO_SDP_FORMATS "\r\n"
+      "c=IN IP4 %s/%u\r\n"
+      "b=AS:%u\r\n"
+      MULTICAST_VIDEO_SDP_ATTRIBUTES
+      "%s"
+      "a=control:%s\r\n";
+    char const* const rtcpUnicastLine = fIsSSM
+      ? "a=rtcp-unicast:reflection\r\n"
+          // RFC 5760: receivers send their RTCP to us, and our (SSM source's)
+          // "RTCPInstance" reflects it to the group
+      : "";
+    unsigned sdpFmtSize = strlen(sdpFmt)
+      + 5 /* max short len */
+      + strlen(ipAddressStr) + 3 /* max char len */
+      + 20 /* max int len */
+      + strlen(rtcpUnicastLine)
+      + strlen(trackId());
+    fOurSDPLines = new char[sdpFmtSize];
+    sprintf(fOurSDPLines, sdpFmt,
+	    ntohs(gs.port().num()), // m= <port>
+	    ipAddressStr, // c= <connection address>
+	    gs.ttl(), // c= TTL
+	    VIDEO_BITRATE, // b=AS:<bandwidth>
+	    rtcpUnicastLine, // a=rtcp-unicast: (if SSM)
+	    trackId()); // a=control:<track-id>
+    delete[] ipAddressStr;
+  }
+
+  return fOurSDPLines;
+}
 //jiangqi
 
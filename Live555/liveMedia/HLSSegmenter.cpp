@@ -0,0 +1,495 @@
+/**********
+This library is free software; you can redistribute it and/or modify it under
+the terms of the GNU Lesser General Public License as published by the
+Free Software Foundation; either version 2.1 of the License, or (at your
+option) any later version. (See <http://www.gnu.org/copyleft/lesser.html>.)
+
+This library is distributed in the hope that it will be useful, but WITHOUT
+ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for
+more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with this library; if not, write to the Free Software Foundation, Inc.,
+51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA
+**********/
+// "liveMedia"
+// Copyright (c) 1996-2009 Live Networks, Inc.  All rights reserved.
+// A sink that muxes a H.264 video stream into MPEG Transport Stream
+// segments - and (Low-Latency HLS) partial segments - kept in memory, for
+// serving (e.g., by "HLSServer") as a HTTP Live Stream
+// Implementation
+
+#include "HLSSegmenter.hh"
+#include "H264VideoStreamFramer.hh"
+#include <string.h>
+#include "GroupsockHelper.hh" // gettimeofday
+#include "LogMacros.hh"
+
+#define TS_PACKET_SIZE 188
+#define PAT_PID 0x0000
+#define PMT_PID 0x1000
+#define VIDEO_PID 0x0100 // also carries the PCR
+#define PROGRAM_NUMBER 1
+#define H264_STREAM_TYPE 0x1B
+
+// The PCR runs this far (in 90 kHz units) behind the PTS, giving players
+// this much time to decode each frame:
+#define PTS_DELAY (90000/10)
+#define PTS_MASK ((((u_int64_t)1)<<33) - 1)
+
+#define PES_HEADER_SIZE 14 // with a PTS, but no DTS
+#define MAX_NAL_UNIT_SIZE 300000
+
+static unsigned char const accessUnitDelimiter[] = {0, 0, 0, 1, 9, 0xF0};
+static unsigned char const startCode[] = {0, 0, 0, 1};
+
+////////// HLSSegment implementation //////////
+
+HLSSegment::HLSSegment(u_int32_t sequenceNumber)
+  : fRefCount(1), fSequenceNumber(sequenceNumber),
+    fData(NULL), fSize(0), fMaxSize(0), fIsComplete(False), fDuration(0.0),
+    fParts(NULL), fNumParts(0), fMaxNumParts(0) {
+}
+
+HLSSegment::~HLSSegment() {
+  delete[] fParts;
+  delete[] fData;
+}
+
+void HLSSegment::release(HLSSegment*& segment) {
+  if (segment != NULL && --segment->fRefCount == 0) delete segment;
+  segment = NULL;
+}
+
+unsigned char* HLSSegment::append(unsigned numBytes) {
+  if (fSize + numBytes > fMaxSize) {
+    unsigned newMaxSize = fMaxSize == 0 ? 64*1024 : 2*fMaxSize;
+    while (newMaxSize < fSize + numBytes) newMaxSize *= 2;
+
+    unsigned char* newData = new unsigned char[newMaxSize];
+    memcpy(newData, fData, fSize);
+    delete[] fData;
+    fData = newData;
+    fMaxSize = newMaxSize;
+  }
+
+  unsigned char* result = &fData[fSize];
+  fSize += numBytes;
+  return result;
+}
+
+void HLSSegment::addPart(unsigned offset, double duration, Boolean isIndependent) {
+  if (fNumParts == fMaxNumParts) {
+    unsigned newMaxNumParts = fMaxNumParts == 0 ? 16 : 2*fMaxNumParts;
+    Part* newParts = new Part[newMaxNumParts];
+    for (unsigned i = 0; i < fNumParts; ++i) newParts[i] = fParts[i];
+    delete[] fParts;
+    fParts = newParts;
+    fMaxNumParts = newMaxNumParts;
+  }
+
+  Part& part = fParts[fNumParts++];
+  part.offset = offset;
+  part.size = fSize - offset;
+  part.duration = duration;
+  part.isIndependent = isIndependent;
+}
+
+////////// HLSSegmenter implementation //////////
+
+HLSSegmenter* HLSSegmenter::createNew(UsageEnvironment& env,
+				      double targetDuration,
+				      double partTargetDuration,
+				      unsigned numSegments,
+				      double maxKeyFrameInterval) {
+  if (numSegments == 0) numSegments = 1;
+  if (numSegments > HLS_MAX_NUM_SEGMENTS) numSegments = HLS_MAX_NUM_SEGMENTS;
+  if (maxKeyFrameInterval <= 0.0) maxKeyFrameInterval = targetDuration;
+  if (targetDuration < maxKeyFrameInterval) targetDuration = maxKeyFrameInterval;
+  if (partTargetDuration > targetDuration) partTargetDuration = targetDuration;
+
+  // A segment that's this long goes on to the next key frame - at most
+  // "maxKeyFrameInterval" later - and no further:
+  return new HLSSegmenter(env, targetDuration, partTargetDuration, numSegments,
+			  targetDuration - maxKeyFrameInterval);
+}
+
+HLSSegmenter::HLSSegmenter(UsageEnvironment& env, double targetDuration,
+			   double partTargetDuration, unsigned numSegments,
+			   double minSegmentDuration)
+  : MediaSink(env),
+    fTargetDuration(targetDuration), fPartTargetDuration(partTargetDuration),
+    fMinSegmentDuration(minSegmentDuration),
+    fMaxNumSegments(numSegments), fNumSegments(0), fNextSequenceNumber(0),
+    fCurrentSegment(NULL), fSegmentStartTime(0.0), fPartStartTime(0.0),
+    fLastFrameTime(0.0), fFrameInterval(0.0),
+    fPartOffset(0),
+    fPartIsIndependent(False),
+    fBufferSize(MAX_NAL_UNIT_SIZE),
+    fAccessUnitSize(PES_HEADER_SIZE), fAccessUnitMaxSize(MAX_NAL_UNIT_SIZE),
+    fAccessUnitIsKeyFrame(False), fAccessUnitHasSPS(False), fAccessUnitHasPPS(False),
+    fSPS(NULL), fSPSSize(0), fPPS(NULL), fPPSSize(0),
+    fNewPartHandler(NULL), fNewPartClientData(NULL) {
+  fNextFrameTime.tv_sec = fNextFrameTime.tv_usec = 0;
+  fBuffer = new unsigned char[fBufferSize];
+  fAccessUnit = new unsigned char[fAccessUnitMaxSize];
+  memset(fContinuityCounter, 0, sizeof fContinuityCounter);
+}
+
+HLSSegmenter::~HLSSegmenter() {
+  stopPlaying();
+
+  for (unsigned i = 0; i < fNumSegments; ++i) HLSSegment::release(fSegments[i]);
+  delete[] fPPS; delete[] fSPS;
+  delete[] fAccessUnit;
+  delete[] fBuffer;
+}
+
+HLSSegment* HLSSegmenter::segment(unsigned i) const {
+  return i < fNumSegments ? fSegments[i] : NULL;
+}
+
+HLSSegment* HLSSegmenter::lookupSegment(u_int32_t sequenceNumber) const {
+  for (unsigned i = 0; i < fNumSegments; ++i) {
+    if (fSegments[i]->sequenceNumber() == sequenceNumber) return fSegments[i];
+  }
+  return NULL;
+}
+
+void HLSSegmenter::setNewPartHandler(newPartHandler* handler, void* clientData) {
+  fNewPartHandler = handler;
+  fNewPartClientData = clientData;
+}
+
+Boolean HLSSegmenter::sourceIsCompatibleWithUs(MediaSource& source) {
+  // We need to know where each access unit ends:
+  return source.isH264VideoStreamFramer();
+}
+
+Boolean HLSSegmenter::continuePlaying() {
+  if (fSource == NULL) return False;
+
+  fSource->getNextFrame(fBuffer, fBufferSize,
+			afterGettingFrame, this,
+			onSourceClosure, this);
+  return True;
+}
+
+void HLSSegmenter::afterGettingFrame(void* clientData, unsigned frameSize,
+				     unsigned numTruncatedBytes,
+				     struct timeval presentationTime,
+				     unsigned durationInMicroseconds) {
+  HLSSegmenter* segmenter = (HLSSegmenter*)clientData;
+  if (numTruncatedBytes > 0) {
+    DEBUG_LOG(ERR, "HLSSegmenter: dropped %u bytes of a too-large NAL unit",
+      numTruncatedBytes);
+  }
+  segmenter->afterGettingFrame1(frameSize, presentationTime,
+				durationInMicroseconds);
+}
+
+void HLSSegmenter::afterGettingFrame1(unsigned frameSize,
+				      struct timeval presentationTime,
+				      unsigned durationInMicroseconds) {
+  addNALUnit(fBuffer, frameSize);
+  if (!((H264VideoStreamFramer*)fSource)->currentNALUnitEndsAccessUnit()) {
+    continuePlaying();
+    return;
+  }
+  addAccessUnit(presentationTime);
+
+  // A live source may hand us frames as fast as we ask for them, so - as
+  // "MultiFramedRTPSink" does - we ask for each frame only once the previous
+  // one's duration is up:
+  struct timeval timeNow;
+  gettimeofday(&timeNow, NULL);
+  if (fNextFrameTime.tv_sec == 0) fNextFrameTime = timeNow;
+  fNextFrameTime.tv_usec += durationInMicroseconds;
+  fNextFrameTime.tv_sec += fNextFrameTime.tv_usec/1000000;
+  fNextFrameTime.tv_usec %= 1000000;
+  int uSecondsToGo = 0;
+  if (fNextFrameTime.tv_sec > timeNow.tv_sec
+      || (fNextFrameTime.tv_sec == timeNow.tv_sec
+	  && fNextFrameTime.tv_usec > timeNow.tv_usec)) {
+    uSecondsToGo = (fNextFrameTime.tv_sec - timeNow.tv_sec)*1000000
+      + (fNextFrameTime.tv_usec - timeNow.tv_usec);
+  } else {
+    fNextFrameTime = timeNow; // we're behind; don't try to catch up
+  }
+  nextTask() = envir().taskScheduler().scheduleDelayedTask(uSecondsToGo,
+					      (TaskFunc*)getNextFrame, this);
+}
+
+void HLSSegmenter::getNextFrame(void* clientData) {
+  ((HLSSegmenter*)clientData)->continuePlaying();
+}
+
+void HLSSegmenter::addNALUnit(unsigned char const* nalUnit, unsigned nalUnitSize) {
+  // Our source's NAL units may, or may not, begin with a start code:
+  if (nalUnitSize >= 4 && nalUnit[0] == 0 && nalUnit[1] == 0
+      && nalUnit[2] == 0 && nalUnit[3] == 1) {
+    nalUnit += 4; nalUnitSize -= 4;
+  } else if (nalUnitSize >= 3 && nalUnit[0] == 0 && nalUnit[1] == 0
+	     && nalUnit[2] == 1) {
+    nalUnit += 3; nalUnitSize -= 3;
+  }
+  if (nalUnitSize == 0) return;
+
+  u_int8_t nalUnitType = nalUnit[0]&0x1F;
+  switch (nalUnitType) {
+    case 7: { // SPS
+      delete[] fSPS;
+      fSPS = new unsigned char[nalUnitSize];
+      memcpy(fSPS, nalUnit, nalUnitSize);
+      fSPSSize = nalUnitSize;
+      fAccessUnitHasSPS = True;
+      break;
+    }
+    case 8: { // PPS
+      delete[] fPPS;
+      fPPS = new unsigned char[nalUnitSize];
+      memcpy(fPPS, nalUnit, nalUnitSize);
+      fPPSSize = nalUnitSize;
+      fAccessUnitHasPPS = True;
+      break;
+    }
+    case 9: { // access unit delimiter; we add our own
+      return;
+    }
+    case 5: { // IDR slice
+      if (!fAccessUnitIsKeyFrame) {
+	// Each segment must be decodable by itself, so a key frame carries the
+	// parameter sets, even if the encoder sent them only once:
+	fAccessUnitIsKeyFrame = True;
+	if (!fAccessUnitHasSPS && fSPS != NULL) appendNALUnit(fSPS, fSPSSize);
+	if (!fAccessUnitHasPPS && fPPS != NULL) appendNALUnit(fPPS, fPPSSize);
+      }
+      break;
+    }
+  }
+
+  appendNALUnit(nalUnit, nalUnitSize);
+}
+
+void HLSSegmenter::appendNALUnit(unsigned char const* nalUnit, unsigned nalUnitSize) {
+  unsigned newSize = fAccessUnitSize + sizeof accessUnitDelimiter
+    + sizeof startCode + nalUnitSize;
+  if (newSize > fAccessUnitMaxSize) {
+    unsigned char* newAccessUnit = new unsigned char[2*newSize];
+    memcpy(newAccessUnit, fAccessUnit, fAccessUnitSize);
+    delete[] fAccessUnit;
+    fAccessUnit = newAccessUnit;
+    fAccessUnitMaxSize = 2*newSize;
+  }
+  if (fAccessUnitSize == PES_HEADER_SIZE) {
+    memcpy(&fAccessUnit[fAccessUnitSize], accessUnitDelimiter,
+	   sizeof accessUnitDelimiter);
+    fAccessUnitSize += sizeof accessUnitDelimiter;
+  }
+  memcpy(&fAccessUnit[fAccessUnitSize], startCode, sizeof startCode);
+  fAccessUnitSize += sizeof startCode;
+  memcpy(&fAccessUnit[fAccessUnitSize], nalUnit, nalUnitSize);
+  fAccessUnitSize += nalUnitSize;
+}
+
+void HLSSegmenter::addAccessUnit(struct timeval presentationTime) {
+  double timeNow = presentationTime.tv_sec + presentationTime.tv_usec/1000000.0;
+  u_int64_t clock = (u_int64_t)presentationTime.tv_sec*90000
+    + presentationTime.tv_usec*9/100;
+
+  do {
+    if (fAccessUnitSize == PES_HEADER_SIZE) break; // there's nothing in it
+
+    if (fCurrentSegment != NULL) {
+      if (timeNow > fLastFrameTime) fFrameInterval = timeNow - fLastFrameTime;
+
+      // A segment is cut only before a key frame, which its successor must
+      // start with:
+      double segmentDuration = timeNow - fSegmentStartTime;
+      if (fAccessUnitIsKeyFrame && segmentDuration >= fMinSegmentDuration) {
+	endPart(timeNow);
+	endSegment(timeNow);
+      } else if (timeNow - fPartStartTime + fFrameInterval > fPartTargetDuration
+		 && fCurrentSegment->size() > fPartOffset) {
+	endPart(timeNow);
+      }
+    }
+
+    if (fCurrentSegment == NULL) {
+      if (fNextSequenceNumber == 0 && !fAccessUnitIsKeyFrame) {
+	break; // a stream must start with a key frame
+      }
+
+      if (fNumSegments == fMaxNumSegments) {
+	// Drop our oldest segment (leaving it to whoever is still sending it):
+	HLSSegment::release(fSegments[0]);
+	--fNumSegments;
+	for (unsigned i = 0; i < fNumSegments; ++i) fSegments[i] = fSegments[i+1];
+      }
+      fCurrentSegment = fSegments[fNumSegments++] = new HLSSegment(fNextSequenceNumber);
+      fSegmentStartTime = fPartStartTime = timeNow;
+      fPartOffset = 0;
+    }
+
+    if (fCurrentSegment->size() == fPartOffset) {
+      // Each part starts with the program tables, so that it can be played
+      // by itself:
+      writeProgramTables();
+      fPartIsIndependent = fAccessUnitIsKeyFrame;
+    }
+
+    // Fill in the PES header that we left room for:
+    u_int64_t pts = (clock + PTS_DELAY)&PTS_MASK;
+    unsigned char* pes = fAccessUnit;
+    pes[0] = 0; pes[1] = 0; pes[2] = 1; pes[3] = 0xE0; // video stream 0
+    pes[4] = pes[5] = 0; // PES_packet_length: unbounded
+    pes[6] = 0x80;
+    pes[7] = 0x80; // PTS only
+    pes[8] = 5; // PES_header_data_length
+    pes[9] = 0x21 | (u_int8_t)((pts>>29)&0x0E);
+    pes[10] = (u_int8_t)(pts>>22);
+    pes[11] = (u_int8_t)((pts>>14)&0xFE) | 1;
+    pes[12] = (u_int8_t)(pts>>7);
+    pes[13] = (u_int8_t)((pts<<1)&0xFE) | 1;
+    writeTSPackets(VIDEO_PID, fAccessUnit, fAccessUnitSize,
+		   True, clock&PTS_MASK, fAccessUnitIsKeyFrame);
+    fLastFrameTime = timeNow;
+  } while (0);
+
+  // Start the next access unit:
+  fAccessUnitSize = PES_HEADER_SIZE;
+  fAccessUnitIsKeyFrame = fAccessUnitHasSPS = fAccessUnitHasPPS = False;
+}
+
+void HLSSegmenter::endPart(double endTime) {
+  if (fCurrentSegment->size() == fPartOffset) return; // the part is empty
+
+  fCurrentSegment->addPart(fPartOffset, endTime - fPartStartTime, fPartIsIndependent);
+  fPartOffset = fCurrentSegment->size();
+  fPartStartTime = endTime;
+  if (fNewPartHandler != NULL) (*fNewPartHandler)(fNewPartClientData);
+}
+
+void HLSSegmenter::endSegment(double endTime) {
+  fCurrentSegment->fDuration = endTime - fSegmentStartTime;
+  fCurrentSegment->fIsComplete = True;
+  if ((unsigned)(fCurrentSegment->fDuration + 0.5)
+      > (unsigned)(fTargetDuration + 0.999)) {
+    // Our playlists are no longer valid; the source's key frames are further
+    // apart than it said:
+    DEBUG_LOG(ERR, "HLS segment %u is longer (%.3f s) than the target duration",
+      fCurrentSegment->sequenceNumber(), fCurrentSegment->duration());
+  }
+  DEBUG_LOG(INF, "HLS segment %u: %u bytes, %u parts, %.3f s",
+    fCurrentSegment->sequenceNumber(), fCurrentSegment->size(),
+    fCurrentSegment->numParts(), fCurrentSegment->duration());
+  fCurrentSegment = NULL;
+  ++fNextSequenceNumber;
+  if (fNewPartHandler != NULL) (*fNewPartHandler)(fNewPartClientData);
+}
+
+void HLSSegmenter::writeTSPackets(u_int16_t pid, unsigned char const* payload,
+				  unsigned payloadSize, Boolean withPCR,
+				  u_int64_t pcr, Boolean isRandomAccess) {
+  u_int8_t& continuityCounter
+    = fContinuityCounter[pid == PAT_PID ? 0 : pid == PMT_PID ? 1 : 2];
+  Boolean isFirstPacket = True;
+
+  while (isFirstPacket || payloadSize > 0) {
+    unsigned char* packet = fCurrentSegment->append(TS_PACKET_SIZE);
+
+    // The adaptation field (if any) - with the PCR and "random access"
+    // flag in the first packet - pads the last packet out, too:
+    u_int8_t flags = 0;
+    unsigned adaptationFieldSize = 0; // including its length byte
+    if (isFirstPacket && withPCR) {
+      flags |= 0x10;
+      adaptationFieldSize = 8;
+    }
+    if (isFirstPacket && isRandomAccess) {
+      flags |= 0x40;
+      if (adaptationFieldSize == 0) adaptationFieldSize = 2;
+    }
+    unsigned numPayloadBytes = TS_PACKET_SIZE - 4 - adaptationFieldSize;
+    if (payloadSize < numPayloadBytes) {
+      adaptationFieldSize += numPayloadBytes - payloadSize;
+      numPayloadBytes = payloadSize;
+    }
+
+    packet[0] = 0x47; // sync byte
+    packet[1] = (isFirstPacket ? 0x40 : 0) | ((pid>>8)&0x1F);
+    packet[2] = (u_int8_t)pid;
+    packet[3] = (adaptationFieldSize > 0 ? 0x30 : 0x10) | (continuityCounter&0x0F);
+    ++continuityCounter;
+
+    unsigned char* ptr = &packet[4];
+    if (adaptationFieldSize > 0) {
+      *ptr++ = adaptationFieldSize - 1;
+      if (adaptationFieldSize > 1) {
+	*ptr++ = flags;
+	if (flags&0x10) {
+	  *ptr++ = (u_int8_t)(pcr>>25);
+	  *ptr++ = (u_int8_t)(pcr>>17);
+	  *ptr++ = (u_int8_t)(pcr>>9);
+	  *ptr++ = (u_int8_t)(pcr>>1);
+	  *ptr++ = (u_int8_t)((pcr&1)<<7) | 0x7E; // + 6 reserved bits
+	  *ptr++ = 0; // PCR extension
+	}
+	unsigned char* payloadStart = &packet[4 + adaptationFieldSize];
+	memset(ptr, 0xFF, payloadStart - ptr); // stuffing
+	ptr = payloadStart;
+      }
+    }
+    memcpy(ptr, payload, numPayloadBytes);
+    payload += numPayloadBytes;
+    payloadSize -= numPayloadBytes;
+    isFirstPacket = False;
+  }
+}
+
+static u_int32_t mpeg2CRC32(unsigned char const* data, unsigned dataSize) {
+  u_int32_t crc = 0xFFFFFFFF;
+  while (dataSize-- > 0) {
+    crc ^= (u_int32_t)(*data++)<<24;
+    for (unsigned i = 0; i < 8; ++i) {
+      crc = (crc&0x80000000) != 0 ? (crc<<1)^0x04C11DB7 : crc<<1;
+    }
+  }
+  return crc;
+}
+
+// Fills in a PSI section's CRC, given its "section" (after its pointer
+// field) up to there:
+static void addCRC(unsigned char* section, unsigned sizeBeforeCRC) {
+  u_int32_t crc = mpeg2CRC32(section, sizeBeforeCRC);
+  unsigned char* ptr = &section[sizeBeforeCRC];
+  ptr[0] = (u_int8_t)(crc>>24); ptr[1] = (u_int8_t)(crc>>16);
+  ptr[2] = (u_int8_t)(crc>>8); ptr[3] = (u_int8_t)crc;
+}
+
+void HLSSegmenter::writeProgramTables() {
+  unsigned char pat[] = {
+    0, // pointer field
+    0x00, 0xB0, 13, // table_id; section_length
+    0x00, 0x01, // transport_stream_id
+    0xC1, 0, 0, // version 0, current; section_number, last_section_number
+    0x00, PROGRAM_NUMBER, 0xE0|(PMT_PID>>8), PMT_PID&0xFF,
+    0, 0, 0, 0 // CRC
+  };
+  addCRC(&pat[1], sizeof pat - 1 - 4);
+  writeTSPackets(PAT_PID, pat, sizeof pat);
+
+  unsigned char pmt[] = {
+    0, // pointer field
+    0x02, 0xB0, 18, // table_id; section_length
+    0x00, PROGRAM_NUMBER,
+    0xC1, 0, 0, // version 0, current; section_number, last_section_number
+    0xE0|(VIDEO_PID>>8), VIDEO_PID&0xFF, // PCR_PID
+    0xF0, 0, // program_info_length
+    H264_STREAM_TYPE, 0xE0|(VIDEO_PID>>8), VIDEO_PID&0xFF, 0xF0, 0,
+    0, 0, 0, 0 // CRC
+  };
+  addCRC(&pmt[1], sizeof pmt - 1 - 4);
+  writeTSPackets(PMT_PID, pmt, sizeof pmt);
+}
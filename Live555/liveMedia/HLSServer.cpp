@@ -0,0 +1,585 @@
+/**********
+This library is free software; you can redistribute it and/or modify it under
+the terms of the GNU Lesser General Public License as published by the
+Free Software Foundation; either version 2.1 of the License, or (at your
+option) any later version. (See <http://www.gnu.org/copyleft/lesser.html>.)
+
+This library is distributed in the hope that it will be useful, but WITHOUT
+ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for
+more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with this library; if not, write to the Free Software Foundation, Inc.,
+51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA
+**********/
+// "liveMedia"
+// Copyright (c) 1996-2009 Live Networks, Inc.  All rights reserved.
+// A (non-blocking, keep-alive) HTTP server for the playlist, segments and
+// partial segments of a "HLSSegmenter"'s HTTP Live Stream
+// Implementation
+
+#include "HLSServer.hh"
+#include "HLSSegmenter.hh"
+#include "RTSPCommon.hh"
+#include <GroupsockHelper.hh>
+#include "LogMacros.hh"
+
+#include <string.h>
+#if defined(__WIN32__) || defined(_WIN32) || defined(_QNX4)
+#define snprintf _snprintf
+#else
+#include <sys/uio.h>
+#include <signal.h>
+#define USE_SIGNALS 1
+#endif
+
+// The scheduler tells us only when a socket is readable, so a response
+// that doesn't fit into the socket's send buffer is continued after this
+// many microseconds:
+#define SEND_RETRY_INTERVAL 10000
+// ... which the send buffer is made big enough for this to be rare:
+#define SEND_BUFFER_SIZE (256*1024)
+
+///////// HLSServer implementation //////////
+
+HLSServer* HLSServer::createNew(UsageEnvironment& env, HLSSegmenter& segmenter,
+				char const* streamName, Port ourPort) {
+  int ourSocket = -1;
+
+  do {
+    ourSocket = setUpOurSocket(env, ourPort);
+    if (ourSocket == -1) break;
+
+    return new HLSServer(env, ourSocket, ourPort, segmenter, streamName);
+  } while (0);
+
+  if (ourSocket != -1) ::closeSocket(ourSocket);
+  return NULL;
+}
+
+#define LISTEN_BACKLOG_SIZE 20
+
+int HLSServer::setUpOurSocket(UsageEnvironment& env, Port& ourPort) {
+  int ourSocket = -1;
+
+  do {
+    NoReuse dummy; // Don't use this socket if there's already a local server using it
+
+    ourSocket = setupStreamSocket(env, ourPort);
+    if (ourSocket < 0) break;
+
+    // Make sure we have a big send buffer:
+    if (!increaseSendBufferTo(env, ourSocket, SEND_BUFFER_SIZE)) break;
+
+    // Allow multiple simultaneous connections:
+    if (listen(ourSocket, LISTEN_BACKLOG_SIZE) < 0) {
+      env.setResultErrMsg("listen() failed: ");
+      break;
+    }
+
+    if (ourPort.num() == 0) {
+      // bind() will have chosen a port for us; return it also:
+      if (!getSourcePort(env, ourSocket, ourPort)) break;
+    }
+
+    return ourSocket;
+  } while (0);
+
+  if (ourSocket != -1) ::closeSocket(ourSocket);
+  return -1;
+}
+
+HLSServer::HLSServer(UsageEnvironment& env, int ourSocket, Port ourPort,
+		     HLSSegmenter& segmenter, char const* streamName)
+  : Medium(env),
+    fServerSocket(ourSocket), fServerPort(ourPort),
+    fSegmenterName(strDup(segmenter.name())), fStreamName(strDup(streamName)),
+    fConnections(NULL) {
+#ifdef USE_SIGNALS
+  // Ignore the SIGPIPE signal, so that clients on the same host that are killed
+  // don't also kill us:
+  signal(SIGPIPE, SIG_IGN);
+#endif
+
+  segmenter.setNewPartHandler(newPartHandler, this);
+
+  // Arrange to handle connections from others:
+  env.taskScheduler().turnOnBackgroundReadHandling(fServerSocket,
+	   (TaskScheduler::BackgroundHandlerProc*)&incomingConnectionHandler,
+						   this);
+}
+
+HLSServer::~HLSServer() {
+  envir().taskScheduler().turnOffBackgroundReadHandling(fServerSocket);
+  ::closeSocket(fServerSocket);
+
+  while (fConnections != NULL) delete fConnections; // unlinks itself
+
+  HLSSegmenter* segmenter = lookupSegmenter();
+  if (segmenter != NULL) segmenter->setNewPartHandler(NULL, NULL);
+  delete[] fStreamName;
+  delete[] fSegmenterName;
+}
+
+char* HLSServer::playlistURL() const {
+  struct in_addr ourAddress;
+  ourAddress.s_addr = ReceivingInterfaceAddr != 0
+    ? ReceivingInterfaceAddr
+    : ourIPAddress(envir()); // hack
+
+  char* resultURL = new char[100 + strlen(fStreamName)];
+  sprintf(resultURL, "http://%s:%hu/%s/index.m3u8",
+	  our_inet_ntoa(ourAddress), ntohs(fServerPort.num()), fStreamName);
+  return resultURL;
+}
+
+HLSSegmenter* HLSServer::lookupSegmenter() const {
+  MediaSink* sink;
+  if (!MediaSink::lookupByName(envir(), fSegmenterName, sink)) return NULL;
+
+  return (HLSSegmenter*)sink;
+}
+
+void HLSServer::incomingConnectionHandler(void* instance, int /*mask*/) {
+  HLSServer* server = (HLSServer*)instance;
+  server->incomingConnectionHandler1();
+}
+
+void HLSServer::incomingConnectionHandler1() {
+  struct sockaddr_in clientAddr;
+  SOCKLEN_T clientAddrLen = sizeof clientAddr;
+  int clientSocket = accept(fServerSocket, (struct sockaddr*)&clientAddr,
+                            &clientAddrLen);
+  if (clientSocket < 0) {
+    int err = envir().getErrno();
+    if (err != EWOULDBLOCK) {
+      envir().setResultErrMsg("accept() failed: ");
+    }
+    return;
+  }
+  makeSocketNonBlocking(clientSocket);
+  increaseSendBufferTo(envir(), clientSocket, SEND_BUFFER_SIZE);
+  DEBUG_LOG(INF, "HLSServer: accept()ed connection from %s",
+    our_inet_ntoa(clientAddr.sin_addr));
+
+  // Create a new object for handling this HTTP connection:
+  new HLSClientConnection(*this, clientSocket);
+}
+
+void HLSServer::newPartHandler(void* clientData) {
+  HLSServer* server = (HLSServer*)clientData;
+
+  // Answer whichever requests were waiting for this.  (A connection may
+  // go away as we do so.)
+  HLSClientConnection* connection = server->fConnections;
+  while (connection != NULL) {
+    HLSClientConnection* nextConnection = connection->next();
+    connection->retryWaitingRequest();
+    connection = nextConnection;
+  }
+}
+
+
+////////// HLSClientConnection implementation /////////
+
+HLSServer::HLSClientConnection
+::HLSClientConnection(HLSServer& ourServer, int clientSocket)
+  : fOurServer(ourServer), fNext(ourServer.fConnections),
+    fClientSocket(clientSocket), fKeepAlive(True), fIsWaiting(False),
+    fWaitTimeoutTask(NULL), fSendTask(NULL), fResponseHeaderSize(0),
+    fPlaylist(NULL), fSegment(NULL), fBodyOffset(0), fBodySize(0),
+    fBytesSent(0) {
+  ourServer.fConnections = this;
+
+  // Arrange to handle incoming requests:
+  resetRequestBuffer();
+  envir().taskScheduler().turnOnBackgroundReadHandling(fClientSocket,
+	       (TaskScheduler::BackgroundHandlerProc*)&incomingRequestHandler, this);
+}
+
+HLSServer::HLSClientConnection::~HLSClientConnection() {
+  HLSClientConnection** ptr = &fOurServer.fConnections;
+  while (*ptr != this) ptr = &(*ptr)->fNext;
+  *ptr = fNext;
+
+  envir().taskScheduler().unscheduleDelayedTask(fWaitTimeoutTask);
+  envir().taskScheduler().unscheduleDelayedTask(fSendTask);
+  HLSSegment::release(fSegment);
+  delete[] fPlaylist;
+
+  // Turn off background read handling:
+  envir().taskScheduler().turnOffBackgroundReadHandling(fClientSocket);
+
+  ::closeSocket(fClientSocket);
+}
+
+void HLSServer::HLSClientConnection
+::incomingRequestHandler(void* instance, int /*mask*/) {
+  HLSClientConnection* connection = (HLSClientConnection*)instance;
+  connection->incomingRequestHandler1();
+}
+
+void HLSServer::HLSClientConnection::incomingRequestHandler1() {
+  struct sockaddr_in dummy; // 'from' address, meaningless in this case
+  Boolean endOfMsg = False;
+  char* ptr = &fRequestBuffer[fRequestBytesAlreadySeen];
+
+  int bytesRead = readSocket(envir(), fClientSocket,
+                             (unsigned char*)ptr, fRequestBufferBytesLeft, dummy);
+  if (bytesRead <= 0 || (unsigned)bytesRead >= fRequestBufferBytesLeft) {
+    // Either the client socket has died (or closed a kept-alive connection),
+    // or the request was too big for us.  Terminate this connection:
+    delete this;
+    return;
+  }
+
+  // Look for the end of the message: <CR><LF><CR><LF>
+  char* tmpPtr = ptr;
+  if (fRequestBytesAlreadySeen > 0) --tmpPtr;
+  // in case the last read ended with a <CR>
+  while (tmpPtr < &ptr[bytesRead-1]) {
+    if (*tmpPtr == '\r' && *(tmpPtr+1) == '\n') {
+      if (tmpPtr - fLastCRLF == 2) { // This is it:
+        endOfMsg = 1;
+        break;
+      }
+      fLastCRLF = tmpPtr;
+    }
+    ++tmpPtr;
+  }
+
+  fRequestBufferBytesLeft -= bytesRead;
+  fRequestBytesAlreadySeen += bytesRead;
+
+  if (!endOfMsg) return; // subsequent reads will be needed to complete the request
+
+  // Until this request has been answered, don't read any more:
+  fRequestBuffer[fRequestBytesAlreadySeen] = '\0';
+  envir().taskScheduler().turnOffBackgroundReadHandling(fClientSocket);
+  handleRequest();
+}
+
+void HLSServer::HLSClientConnection::resetRequestBuffer() {
+  fRequestBytesAlreadySeen = 0;
+  fRequestBufferBytesLeft = sizeof fRequestBuffer;
+  fLastCRLF = &fRequestBuffer[-3]; // hack
+}
+
+#define HTTP_PARAM_STRING_MAX 1000
+
+void HLSServer::HLSClientConnection::handleRequest() {
+  char cmdName[HTTP_PARAM_STRING_MAX];
+  char url[HTTP_PARAM_STRING_MAX];
+  unsigned versionMajor, versionMinor;
+  if (sscanf(fRequestBuffer, "%999s %999s HTTP/%u.%u",
+	     cmdName, url, &versionMajor, &versionMinor) != 4) {
+    fKeepAlive = False;
+    handleCmd_bad(400, "Bad Request");
+  } else {
+    // HTTP/1.1 connections persist, unless the client says otherwise;
+    // HTTP/1.0 ones don't, unless it asks:
+    fKeepAlive = versionMajor > 1 || (versionMajor == 1 && versionMinor >= 1);
+    for (char const* line = strstr(fRequestBuffer, "\r\n"); line != NULL;
+	 line = strstr(line + 2, "\r\n")) {
+      if (_strncasecmp(line + 2, "Connection:", 11) != 0) continue;
+
+      char const* value = line + 13;
+      while (*value == ' ' || *value == '\t') ++value;
+      if (_strncasecmp(value, "close", 5) == 0) fKeepAlive = False;
+      else if (_strncasecmp(value, "keep-alive", 10) == 0) fKeepAlive = True;
+      break;
+    }
+
+    char* query = strchr(url, '?');
+    if (query != NULL) *query++ = '\0';
+
+    if (strcmp(cmdName, "GET") != 0) {
+      handleCmd_bad(405, "Method Not Allowed");
+    } else if (!handleCmd_GET(url, query == NULL ? "" : query)) {
+      // Wait (but not forever) for the segmenter:
+      if (!fIsWaiting) {
+	HLSSegmenter* segmenter = fOurServer.lookupSegmenter();
+	unsigned timeout = (unsigned)(3*segmenter->targetDuration()*1000000);
+	fWaitTimeoutTask = envir().taskScheduler()
+	  .scheduleDelayedTask(timeout, waitTimeoutTask, this);
+	fIsWaiting = True;
+      }
+      return;
+    }
+  }
+
+  if (fIsWaiting) {
+    envir().taskScheduler().unscheduleDelayedTask(fWaitTimeoutTask);
+    fIsWaiting = False;
+  }
+  fBytesSent = 0;
+  sendResponse();
+}
+
+void HLSServer::HLSClientConnection::retryWaitingRequest() {
+  if (fIsWaiting) handleRequest();
+}
+
+void HLSServer::HLSClientConnection::waitTimeoutTask(void* clientData) {
+  HLSClientConnection* connection = (HLSClientConnection*)clientData;
+  connection->fWaitTimeoutTask = NULL;
+  connection->fIsWaiting = False;
+
+  connection->handleCmd_bad(503, "Service Unavailable");
+  connection->fBytesSent = 0;
+  connection->sendResponse();
+}
+
+Boolean HLSServer::HLSClientConnection
+::handleCmd_GET(char const* urlPath, char const* query) {
+  // The URL path must be "/<streamName>/<file>":
+  char const* streamName = fOurServer.fStreamName;
+  unsigned streamNameLen = strlen(streamName);
+  HLSSegmenter* segmenter = fOurServer.lookupSegmenter();
+  if (segmenter == NULL || urlPath[0] != '/'
+      || strncmp(&urlPath[1], streamName, streamNameLen) != 0
+      || urlPath[1 + streamNameLen] != '/') {
+    handleCmd_bad(404, "Not Found");
+    return True;
+  }
+  char const* fileName = &urlPath[1 + streamNameLen + 1];
+
+  unsigned sequenceNumber, partNum;
+  char c;
+  if (strcmp(fileName, "index.m3u8") == 0) {
+    return handlePlaylistRequest(segmenter, query);
+  } else if (sscanf(fileName, "%u.%u.t%c", &sequenceNumber, &partNum, &c) == 3
+	     && c == 's') {
+    return handleSegmentRequest(segmenter, sequenceNumber, (int)partNum);
+  } else if (sscanf(fileName, "%u.t%c", &sequenceNumber, &c) == 2 && c == 's') {
+    return handleSegmentRequest(segmenter, sequenceNumber, -1);
+  }
+
+  handleCmd_bad(404, "Not Found");
+  return True;
+}
+
+Boolean HLSServer::HLSClientConnection
+::handlePlaylistRequest(HLSSegmenter* segmenter, char const* query) {
+  u_int32_t nextSequenceNumber = segmenter->nextSequenceNumber();
+  HLSSegment* first = segmenter->segment(0);
+  if (first == NULL || (first->numParts() == 0 && !first->isComplete())) {
+    return False; // there's nothing to list yet
+  }
+
+  // A "blocking playlist reload" waits for the segment "_HLS_msn" - or, if
+  // given, its part "_HLS_part" - or anything later:
+  unsigned msn, part;
+  char const* msnParam = strstr(query, "_HLS_msn=");
+  if (msnParam != NULL && sscanf(msnParam, "_HLS_msn=%u", &msn) == 1) {
+    if (msn > nextSequenceNumber + 2) {
+      handleCmd_bad(400, "Bad Request"); // too far ahead to wait for
+      return True;
+    }
+
+    Boolean isReady = msn < nextSequenceNumber;
+    char const* partParam = strstr(query, "_HLS_part=");
+    if (!isReady && partParam != NULL
+	&& sscanf(partParam, "_HLS_part=%u", &part) == 1) {
+      HLSSegment* segment = segmenter->lookupSegment(msn);
+      isReady = segment != NULL && segment->numParts() > part;
+    }
+    if (!isReady) return False;
+  }
+
+  // Parts are listed only for the last few segments (those that a
+  // low-latency player might start from):
+  unsigned const numSegmentsWithParts = 3;
+  unsigned numSegments = segmenter->numSegments();
+  unsigned maxPlaylistSize = 300;
+  for (unsigned i = 0; i < numSegments; ++i) {
+    maxPlaylistSize += 50 + 80*segmenter->segment(i)->numParts();
+  }
+  delete[] fPlaylist;
+  fPlaylist = new char[maxPlaylistSize];
+
+  // No segment's EXTINF (rounded to the nearest second) may exceed the
+  // target duration, which may not change:
+  unsigned targetDuration = (unsigned)(segmenter->targetDuration() + 0.999);
+
+  char* ptr = fPlaylist;
+  ptr += sprintf(ptr,
+		 "#EXTM3U\n"
+		 "#EXT-X-VERSION:6\n"
+		 "#EXT-X-TARGETDURATION:%u\n"
+		 "#EXT-X-PART-INF:PART-TARGET=%.3f\n"
+		 "#EXT-X-SERVER-CONTROL:CAN-BLOCK-RELOAD=YES,PART-HOLD-BACK=%.3f\n"
+		 "#EXT-X-MEDIA-SEQUENCE:%u\n",
+		 targetDuration,
+		 segmenter->partTargetDuration(),
+		 3*segmenter->partTargetDuration(),
+		 first->sequenceNumber());
+  for (unsigned i = 0; i < numSegments; ++i) {
+    HLSSegment* segment = segmenter->segment(i);
+    if (i + numSegmentsWithParts >= numSegments) {
+      for (unsigned j = 0; j < segment->numParts(); ++j) {
+	ptr += sprintf(ptr, "#EXT-X-PART:DURATION=%.3f,URI=\"%u.%u.ts\"%s\n",
+		       segment->partDuration(j), segment->sequenceNumber(), j,
+		       segment->partIsIndependent(j) ? ",INDEPENDENT=YES" : "");
+      }
+    }
+    if (segment->isComplete()) {
+      ptr += sprintf(ptr, "#EXTINF:%.3f,\n%u.ts\n",
+		     segment->duration(), segment->sequenceNumber());
+    }
+  }
+  HLSSegment* last = segmenter->segment(numSegments-1);
+  ptr += sprintf(ptr, "#EXT-X-PRELOAD-HINT:TYPE=PART,URI=\"%u.%u.ts\"\n",
+		 nextSequenceNumber, last->isComplete() ? 0 : last->numParts());
+
+  setResponse("application/vnd.apple.mpegurl", ptr - fPlaylist);
+  return True;
+}
+
+Boolean HLSServer::HLSClientConnection
+::handleSegmentRequest(HLSSegmenter* segmenter,
+		       u_int32_t sequenceNumber, int partNum) {
+  HLSSegment* segment = segmenter->lookupSegment(sequenceNumber);
+  if (segment == NULL) {
+    // Wait for the segment being built (or the next), as named by the
+    // playlist's preload hint:
+    if (sequenceNumber == segmenter->nextSequenceNumber()) return False;
+
+    handleCmd_bad(404, "Not Found");
+    return True;
+  }
+
+  unsigned offset, size;
+  if (partNum < 0) {
+    if (!segment->isComplete()) return False;
+    offset = 0;
+    size = segment->size();
+  } else if ((unsigned)partNum < segment->numParts()) {
+    offset = segment->partOffset(partNum);
+    size = segment->partSize(partNum);
+  } else if (!segment->isComplete()) {
+    return False;
+  } else {
+    handleCmd_bad(404, "Not Found");
+    return True;
+  }
+
+  HLSSegment::release(fSegment);
+  fSegment = segment;
+  fSegment->addRef();
+  fBodyOffset = offset;
+  setResponse("video/MP2T", size);
+  return True;
+}
+
+void HLSServer::HLSClientConnection
+::setResponse(char const* contentType, unsigned contentLength) {
+  // Playlists change; segments and parts (at a given URL) don't:
+  Boolean isPlaylist = fPlaylist != NULL;
+  fResponseHeaderSize
+    = snprintf(fResponseHeader, sizeof fResponseHeader,
+	       "HTTP/1.1 200 OK\r\n"
+	       "Content-Type: %s\r\n"
+	       "Content-Length: %u\r\n"
+	       "Cache-Control: %s\r\n"
+	       "Access-Control-Allow-Origin: *\r\n"
+	       "Connection: %s\r\n"
+	       "\r\n",
+	       contentType, contentLength,
+	       isPlaylist ? "no-cache" : "max-age=60",
+	       fKeepAlive ? "keep-alive" : "close");
+  fBodySize = contentLength;
+}
+
+void HLSServer::HLSClientConnection::handleCmd_bad(unsigned code, char const* reason) {
+  fResponseHeaderSize
+    = snprintf(fResponseHeader, sizeof fResponseHeader,
+	       "HTTP/1.1 %u %s\r\n"
+	       "Content-Length: 0\r\n"
+	       "Allow: GET\r\n"
+	       "Connection: %s\r\n"
+	       "\r\n",
+	       code, reason, fKeepAlive ? "keep-alive" : "close");
+  fBodySize = 0;
+}
+
+// Sends what it can of "header", then "body", in one call - without first
+// copying them together - and returns how much that was (or -1):
+static int sendGathered(int socket, char const* header, unsigned headerSize,
+			unsigned char const* body, unsigned bodySize) {
+#if defined(__WIN32__) || defined(_WIN32)
+  WSABUF bufs[2];
+  bufs[0].buf = (char*)header; bufs[0].len = headerSize;
+  bufs[1].buf = (char*)body; bufs[1].len = bodySize;
+  DWORD numBytesSent = 0;
+  return WSASend(socket, bufs, 2, &numBytesSent, 0, NULL, NULL) == 0
+    ? (int)numBytesSent : -1;
+#else
+  struct iovec iov[2];
+  iov[0].iov_base = (char*)header; iov[0].iov_len = headerSize;
+  iov[1].iov_base = (char*)body; iov[1].iov_len = bodySize;
+  struct msghdr msg;
+  memset(&msg, 0, sizeof msg);
+  msg.msg_iov = iov;
+  msg.msg_iovlen = 2;
+  return sendmsg(socket, &msg, 0);
+#endif
+}
+
+void HLSServer::HLSClientConnection::sendResponse() {
+  fSendTask = NULL;
+
+  unsigned responseSize = fResponseHeaderSize + fBodySize;
+  while (fBytesSent < responseSize) {
+    // The body comes straight from the segment (which may have moved, if it's
+    // still growing) or the playlist:
+    unsigned char const* body = fSegment != NULL
+      ? &fSegment->data()[fBodyOffset] : (unsigned char const*)fPlaylist;
+    int bytesSent;
+    if (fBytesSent < fResponseHeaderSize) {
+      bytesSent = sendGathered(fClientSocket,
+			       &fResponseHeader[fBytesSent],
+			       fResponseHeaderSize - fBytesSent,
+			       body, fBodySize);
+    } else {
+      bytesSent = sendGathered(fClientSocket, NULL, 0,
+			       &body[fBytesSent - fResponseHeaderSize],
+			       responseSize - fBytesSent);
+    }
+
+    if (bytesSent < 0) {
+      if (envir().getErrno() == EWOULDBLOCK) {
+	// The socket's send buffer is full; try again later:
+	fSendTask = envir().taskScheduler()
+	  .scheduleDelayedTask(SEND_RETRY_INTERVAL, sendResponseTask, this);
+	return;
+      }
+      delete this; // the client has gone away
+      return;
+    }
+    fBytesSent += bytesSent;
+  }
+
+  endRequest();
+}
+
+void HLSServer::HLSClientConnection::sendResponseTask(void* clientData) {
+  ((HLSClientConnection*)clientData)->sendResponse();
+}
+
+void HLSServer::HLSClientConnection::endRequest() {
+  HLSSegment::release(fSegment);
+  delete[] fPlaylist; fPlaylist = NULL;
+  fBodyOffset = fBodySize = 0;
+
+  if (!fKeepAlive) {
+    delete this;
+    return;
+  }
+
+  // Wait for the next request:
+  resetRequestBuffer();
+  envir().taskScheduler().turnOnBackgroundReadHandling(fClientSocket,
+	       (TaskScheduler::BackgroundHandlerProc*)&incomingRequestHandler, this);
+}
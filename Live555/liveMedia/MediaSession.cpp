@@ -138,6 +138,7 @@ Boolean MediaSession::initializeWithSDP(char const* sdpDescription) {
 
     // Parse the line as "m=<medium_name> <client_portNum> RTP/AVP <fmt>"
     // or "m=<medium_name> <client_portNum>/<num_ports> RTP/AVP <fmt>"
+    // (or "RTP/AVPF", the same with RTCP feedback (RFC 4585))
     // (Should we be checking for >1 payload format number here?)#####
     char* mediumName = strDupSize(sdpLine); // ensures we have enough space
     char const* protocolName = NULL;
@@ -145,6 +146,10 @@ Boolean MediaSession::initializeWithSDP(char const* sdpDescription) {
     if ((sscanf(sdpLine, "m=%s %hu RTP/AVP %u",
 		mediumName, &subsession->fClientPortNum, &payloadFormat) == 3 ||
 	 sscanf(sdpLine, "m=%s %hu/%*u RTP/AVP %u",
+		mediumName, &subsession->fClientPortNum, &payloadFormat) == 3 ||
+	 sscanf(sdpLine, "m=%s %hu RTP/AVPF %u",
+		mediumName, &subsession->fClientPortNum, &payloadFormat) == 3 ||
+	 sscanf(sdpLine, "m=%s %hu/%*u RTP/AVPF %u",
 		mediumName, &subsession->fClientPortNum, &payloadFormat) == 3)
 	&& payloadFormat <= 127) {
       protocolName = "RTP";
@@ -219,6 +224,7 @@ Boolean MediaSession::initializeWithSDP(char const* sdpDescription) {
       if (subsession->parseSDPAttribute_source_filter(sdpLine)) continue;
       if (subsession->parseSDPAttribute_x_dimensions(sdpLine)) continue;
       if (subsession->parseSDPAttribute_framerate(sdpLine)) continue;
+      if (subsession->parseSDPAttribute_rtcp_fb(sdpLine)) continue;
 #ifdef SUPPORT_REAL_RTSP
       if (RealParseSDPAttributes(subsession, sdpLine)) continue;
 #endif
@@ -552,7 +558,9 @@ MediaSubsession::MediaSubsession(MediaSession& parent)
     fCpresent(False), fRandomaccessindication(False),
     fConfig(NULL), fMode(NULL), fSpropParameterSets(NULL),
     fPlayStartTime(0.0), fPlayEndTime(0.0),
-    fVideoWidth(0), fVideoHeight(0), fVideoFPS(0), fNumChannels(1), fScale(1.0f), fNPT_PTS_Offset(0.0f),
+    fVideoWidth(0), fVideoHeight(0), fVideoFPS(0), fNumChannels(1), fScale(1.0f),
+    fNACKIsSupported(False), fRTXPayloadFormat(0), fFECPayloadFormat(0),
+    fNPT_PTS_Offset(0.0f),
     fRTPSocket(NULL), fRTCPSocket(NULL),
     fRTPSource(NULL), fRTCPInstance(NULL), fReadSource(NULL) {
   rtpInfo.seqNum = 0; rtpInfo.timestamp = 0; rtpInfo.infoIsNew = False;
@@ -920,6 +928,17 @@ Boolean MediaSubsession::initiate(int useSpecialRTPoffset) {
 	env().setResultMsg("Failed to create RTCP instance");
 	break;
       }
+
+      // If the server can resend lost packets, ask it to:
+      if (fNACKIsSupported && fRTPSource->isMultiFramedRTPSource()) {
+	((MultiFramedRTPSource*)fRTPSource)
+	  ->setNACKSender(fRTCPInstance, fRTXPayloadFormat);
+      }
+      // Likewise, if it protects them with FEC, use that:
+      if (fFECPayloadFormat != 0 && fRTPSource->isMultiFramedRTPSource()) {
+	((MultiFramedRTPSource*)fRTPSource)
+	  ->setFECPayloadFormat(fFECPayloadFormat);
+      }
     }
 
     return True;
@@ -1069,17 +1088,20 @@ Boolean MediaSubsession::parseSDPAttribute_rtpmap(char const* sdpLine) {
       || sscanf(sdpLine, "a=rtpmap: %u %s",
 		&rtpmapPayloadFormat, codecName) == 2) {
     parseSuccess = True;
+    // (First, make sure the codec name is upper case)
+    {
+      Locale l("POSIX");
+      for (char* p = codecName; *p != '\0'; ++p) *p = toupper(*p);
+    }
     if (rtpmapPayloadFormat == fRTPPayloadFormat) {
       // This "rtpmap" matches our payload format, so set our
       // codec name and timestamp frequency:
-      // (First, make sure the codec name is upper case)
-      {
-	Locale l("POSIX");
-	for (char* p = codecName; *p != '\0'; ++p) *p = toupper(*p);
-      }
       delete[] fCodecName; fCodecName = strDup(codecName);
       fRTPTimestampFrequency = rtpTimestampFrequency;
       fNumChannels = numChannels;
+    } else if (strcmp(codecName, "ULPFEC") == 0) {
+      // FEC (RFC 5109) for our payload format, sent alongside it:
+      fFECPayloadFormat = (unsigned char)rtpmapPayloadFormat;
     }
   }
   delete[] codecName;
@@ -1133,7 +1155,17 @@ Boolean MediaSubsession::parseSDPAttribute_fmtp(char const* sdpLine) {
   // Later: (i) check that payload format number matches; #####
   //        (ii) look for other parameters also (generalize?) #####
   do {
-    if (strncmp(sdpLine, "a=fmtp:", 7) != 0) break; sdpLine += 7;
+    if (strncmp(sdpLine, "a=fmtp:", 7) != 0) break;
+
+    // A "rtx" payload format (RFC 4588) names the format it resends:
+    unsigned rtxFormat, associatedFormat;
+    if (sscanf(sdpLine, "a=fmtp:%u apt=%u", &rtxFormat, &associatedFormat) == 2) {
+      if (associatedFormat == fRTPPayloadFormat) {
+	fRTXPayloadFormat = (unsigned char)rtxFormat;
+      }
+      return True;
+    }
+    sdpLine += 7;
     while (isdigit(*sdpLine)) ++sdpLine;
 
     // The remaining "sdpLine" should be a sequence of
@@ -1251,6 +1283,24 @@ Boolean MediaSubsession::parseSDPAttribute_x_dimensions(char const* sdpLine) {
   return parseSuccess;
 }
 
+Boolean MediaSubsession::parseSDPAttribute_rtcp_fb(char const* sdpLine) {
+  // Check for a "a=rtcp-fb:<fmt> nack" line (RFC 4585).  ("nack pli" etc.
+  // are other kinds of feedback, that we don't send.)
+  Boolean parseSuccess = False;
+
+  unsigned fmt;
+  char* feedback = strDupSize(sdpLine);
+  if (sscanf(sdpLine, "a=rtcp-fb:%u %[^\r\n]", &fmt, feedback) == 2) {
+    parseSuccess = True;
+    if (fmt == fRTPPayloadFormat && strcmp(feedback, "nack") == 0) {
+      fNACKIsSupported = True;
+    }
+  }
+  delete[] feedback;
+
+  return parseSuccess;
+}
+
 Boolean MediaSubsession::parseSDPAttribute_framerate(char const* sdpLine) {
   // Check for a "a=framerate: <fps>" or "a=x-framerate: <fps>" line:
   Boolean parseSuccess = False;
@@ -0,0 +1,317 @@
+/**********
+This library is free software; you can redistribute it and/or modify it under
+the terms of the GNU Lesser General Public License as published by the
+Free Software Foundation; either version 2.1 of the License, or (at your
+option) any later version. (See <http://www.gnu.org/copyleft/lesser.html>.)
+
+This library is distributed in the hope that it will be useful, but WITHOUT
+ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for
+more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with this library; if not, write to the Free Software Foundation, Inc.,
+51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA
+**********/
+// "liveMedia"
+// Copyright (c) 1996-2009 Live Networks, Inc.  All rights reserved.
+// A registry of a server's metrics - counters and gauges, with labels - and
+// their text, in the Prometheus exposition format
+// Implementation
+
+#include "MetricsRegistry.hh"
+#include "Groupsock.hh"
+#include <stdio.h>
+#include <string.h>
+#if defined(__WIN32__) || defined(_WIN32)
+#define snprintf _snprintf
+#define THREAD_LOCAL __declspec(thread)
+#else
+#define THREAD_LOCAL __thread
+#endif
+
+////////// MetricsLabels //////////
+
+MetricsLabels::MetricsLabels()
+  : fSize(0) {
+  fText[0] = '\0';
+}
+
+MetricsLabels& MetricsLabels::add(char const* name, char const* value) {
+  if (value == NULL) value = "";
+
+  // Room for the worst case (every character escaped), and the '}':
+  unsigned const maxSize = fSize + strlen(name) + 2*strlen(value) + 5;
+  if (maxSize >= sizeof fText) return *this; // too long; leave it out
+
+  char* ptr = &fText[fSize];
+  *ptr++ = fSize == 0 ? '{' : ',';
+  ptr += sprintf(ptr, "%s=\"", name);
+  for (char const* from = value; *from != '\0'; ++from) {
+    switch (*from) {
+    case '\\': *ptr++ = '\\'; *ptr++ = '\\'; break;
+    case '"': *ptr++ = '\\'; *ptr++ = '"'; break;
+    case '\n': *ptr++ = '\\'; *ptr++ = 'n'; break;
+    default: *ptr++ = *from;
+    }
+  }
+  *ptr++ = '"';
+  fSize = ptr - fText;
+  *ptr++ = '}';
+  *ptr = '\0';
+  return *this;
+}
+
+MetricsLabels& MetricsLabels::add(char const* name, unsigned value) {
+  char buf[20];
+  sprintf(buf, "%u", value);
+  return add(name, buf);
+}
+
+////////// MetricsWriter //////////
+
+// The samples of one metric, and its "# HELP" and "# TYPE" lines:
+class MetricsFamily {
+public:
+  MetricsFamily(char const* name, char const* type, char const* help)
+    : fName(strDup(name)), fType(type), fHelp(help), fNext(NULL),
+      fSamples(NULL), fSize(0), fMaxSize(0) {
+  }
+  virtual ~MetricsFamily() {
+    delete[] fSamples;
+    delete[] fName;
+  }
+
+  void append(char const* str, unsigned len) {
+    if (fSize + len > fMaxSize) {
+      fMaxSize = 2*(fSize + len) + 256;
+      char* newSamples = new char[fMaxSize];
+      if (fSize > 0) memmove(newSamples, fSamples, fSize);
+      delete[] fSamples;
+      fSamples = newSamples;
+    }
+    memmove(&fSamples[fSize], str, len);
+    fSize += len;
+  }
+
+  char* fName;
+  char const* fType;
+  char const* fHelp;
+  MetricsFamily* fNext;
+  char* fSamples;
+  unsigned fSize, fMaxSize;
+};
+
+MetricsWriter::MetricsWriter(char const* prefix)
+  : fFamilies(NULL), fLastFamily(NULL), fPrefix(strDup(prefix)) {
+}
+
+MetricsWriter::~MetricsWriter() {
+  while (fFamilies != NULL) {
+    MetricsFamily* next = fFamilies->fNext;
+    delete fFamilies;
+    fFamilies = next;
+  }
+  delete[] fPrefix;
+}
+
+void MetricsWriter::counter(char const* name, char const* help,
+			    MetricsLabels const& labels, double value) {
+  addSample("counter", name, help, labels.text(), value);
+}
+
+void MetricsWriter::counter(char const* name, char const* help, double value) {
+  addSample("counter", name, help, "", value);
+}
+
+void MetricsWriter::gauge(char const* name, char const* help,
+			  MetricsLabels const& labels, double value) {
+  addSample("gauge", name, help, labels.text(), value);
+}
+
+void MetricsWriter::gauge(char const* name, char const* help, double value) {
+  addSample("gauge", name, help, "", value);
+}
+
+void MetricsWriter::addSample(char const* type, char const* name,
+			      char const* help, char const* labels,
+			      double value) {
+  MetricsFamily* family;
+  for (family = fFamilies; family != NULL; family = family->fNext) {
+    if (strcmp(family->fName, name) == 0) break;
+  }
+  if (family == NULL) {
+    family = new MetricsFamily(name, type, help);
+    if (fLastFamily == NULL) fFamilies = family;
+    else fLastFamily->fNext = family;
+    fLastFamily = family;
+  }
+
+  char sample[METRICS_LABELS_SIZE + 200];
+  int len = snprintf(sample, sizeof sample, "%s%s%s %.15g\n",
+		     fPrefix, name, labels, value);
+  if (len < 0 || (unsigned)len >= sizeof sample) return; // can't happen
+  family->append(sample, len);
+}
+
+char* MetricsWriter::text(unsigned& size) const {
+  unsigned prefixLen = strlen(fPrefix);
+  unsigned maxSize = 1;
+  MetricsFamily* family;
+  for (family = fFamilies; family != NULL; family = family->fNext) {
+    maxSize += 2*(prefixLen + strlen(family->fName)) + strlen(family->fHelp)
+      + strlen(family->fType) + 20 + family->fSize;
+  }
+
+  char* result = new char[maxSize];
+  char* ptr = result;
+  for (family = fFamilies; family != NULL; family = family->fNext) {
+    ptr += sprintf(ptr, "# HELP %s%s %s\n# TYPE %s%s %s\n",
+		   fPrefix, family->fName, family->fHelp,
+		   fPrefix, family->fName, family->fType);
+    memmove(ptr, family->fSamples, family->fSize);
+    ptr += family->fSize;
+  }
+  *ptr = '\0';
+
+  size = ptr - result;
+  return result;
+}
+
+////////// MetricsCounter //////////
+
+// Each thread is given the next slot, when it first adds to a counter:
+static THREAD_LOCAL unsigned ourSlotIndex = 0; // 1 + the index; 0: not yet
+static unsigned volatile numThreadsWithSlots = 0;
+
+static unsigned atomicIncrement(unsigned volatile* value) {
+#if defined(__WIN32__) || defined(_WIN32)
+  return (unsigned)InterlockedIncrement((LONG volatile*)value);
+#else
+  return __sync_add_and_fetch(value, 1);
+#endif
+}
+
+MetricsCounter* MetricsCounter::fFirst = NULL;
+
+MetricsCounter::MetricsCounter(char const* name, char const* help)
+  : fName(name), fHelp(help), fNext(fFirst) {
+  memset(fSlots, 0, sizeof fSlots);
+  fFirst = this;
+}
+
+MetricsCounter::~MetricsCounter() {
+  MetricsCounter** ptr = &fFirst;
+  while (*ptr != this) ptr = &(*ptr)->fNext;
+  *ptr = fNext;
+}
+
+void MetricsCounter::add(double amount) {
+  if (ourSlotIndex == 0) {
+    ourSlotIndex = (atomicIncrement(&numThreadsWithSlots) - 1)
+      %METRICS_COUNTER_NUM_SLOTS + 1;
+  }
+  fSlots[ourSlotIndex - 1].value += amount;
+}
+
+double MetricsCounter::value() const {
+  double result = 0.0;
+  for (unsigned i = 0; i < METRICS_COUNTER_NUM_SLOTS; ++i) {
+    result += ((double volatile&)fSlots[i].value);
+  }
+  return result;
+}
+
+void MetricsCounter::writeAll(MetricsWriter& writer) {
+  for (MetricsCounter* counter = fFirst; counter != NULL;
+       counter = counter->fNext) {
+    writer.counter(counter->fName, counter->fHelp, counter->value());
+  }
+}
+
+////////// MetricsGauge //////////
+
+MetricsGauge* MetricsGauge::fFirst = NULL;
+
+MetricsGauge::MetricsGauge(char const* name, char const* help)
+  : fValue(0.0), fName(name), fHelp(help), fNext(fFirst) {
+  fFirst = this;
+}
+
+MetricsGauge::~MetricsGauge() {
+  MetricsGauge** ptr = &fFirst;
+  while (*ptr != this) ptr = &(*ptr)->fNext;
+  *ptr = fNext;
+}
+
+void MetricsGauge::writeAll(MetricsWriter& writer) {
+  for (MetricsGauge* gauge = fFirst; gauge != NULL; gauge = gauge->fNext) {
+    writer.gauge(gauge->fName, gauge->fHelp, gauge->value());
+  }
+}
+
+////////// MetricsRegistry //////////
+
+MetricsRegistry* MetricsRegistry::createNew(UsageEnvironment& env,
+					    char const* prefix) {
+  return new MetricsRegistry(env, prefix);
+}
+
+MetricsRegistry::MetricsRegistry(UsageEnvironment& env, char const* prefix)
+  : Medium(env), fCollectors(NULL), fPrefix(strDup(prefix)) {
+}
+
+MetricsRegistry::~MetricsRegistry() {
+  while (fCollectors != NULL) {
+    Collector* next = fCollectors->next;
+    delete[] fCollectors->mediumName;
+    delete fCollectors;
+    fCollectors = next;
+  }
+  delete[] fPrefix;
+}
+
+void MetricsRegistry::addCollector(Medium& medium, CollectorFunc* func) {
+  Collector* collector = new Collector;
+  collector->mediumName = strDup(medium.name());
+  collector->func = func;
+  collector->next = NULL;
+
+  // Collectors are called in the order that they were added:
+  Collector** ptr = &fCollectors;
+  while (*ptr != NULL) ptr = &(*ptr)->next;
+  *ptr = collector;
+}
+
+char* MetricsRegistry::scrape(unsigned& size) {
+  MetricsWriter writer(fPrefix);
+
+  Collector** ptr = &fCollectors;
+  while (*ptr != NULL) {
+    Collector* collector = *ptr;
+    Medium* medium;
+    if (!Medium::lookupByName(envir(), collector->mediumName, medium)) {
+      // It's gone:
+      *ptr = collector->next;
+      delete[] collector->mediumName;
+      delete collector;
+      continue;
+    }
+    (*collector->func)(*medium, writer);
+    ptr = &collector->next;
+  }
+
+  // All of our groupsocks' traffic (but not RTP-over-TCP's):
+  writer.counter("net_packets_sent_total", "UDP packets sent",
+		 Groupsock::statsOutgoing.totNumPackets());
+  writer.counter("net_bytes_sent_total", "UDP bytes sent",
+		 Groupsock::statsOutgoing.totNumBytes());
+  writer.counter("net_packets_received_total", "UDP packets received",
+		 Groupsock::statsIncoming.totNumPackets());
+  writer.counter("net_bytes_received_total", "UDP bytes received",
+		 Groupsock::statsIncoming.totNumBytes());
+  MetricsCounter::writeAll(writer);
+  MetricsGauge::writeAll(writer);
+
+  return writer.text(size);
+}
@@ -0,0 +1,347 @@
+/**********
+This library is free software; you can redistribute it and/or modify it under
+the terms of the GNU Lesser General Public License as published by the
+Free Software Foundation; either version 2.1 of the License, or (at your
+option) any later version. (See <http://www.gnu.org/copyleft/lesser.html>.)
+
+This library is distributed in the hope that it will be useful, but WITHOUT
+ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for
+more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with this library; if not, write to the Free Software Foundation, Inc.,
+51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA
+**********/
+// "liveMedia"
+// Copyright (c) 1996-2009 Live Networks, Inc.  All rights reserved.
+// A (non-blocking, keep-alive) HTTP server for a "MetricsRegistry"'s
+// metrics, for Prometheus to scrape
+// Implementation
+
+#include "MetricsServer.hh"
+#include "MetricsRegistry.hh"
+#include "RTSPCommon.hh"
+#include <GroupsockHelper.hh>
+#include "LogMacros.hh"
+
+#include <string.h>
+#if !defined(__WIN32__) && !defined(_WIN32) && !defined(_QNX4)
+#include <signal.h>
+#define USE_SIGNALS 1
+#endif
+
+///////// MetricsServer implementation //////////
+
+MetricsServer* MetricsServer::createNew(UsageEnvironment& env,
+					MetricsRegistry& registry,
+					Port ourPort) {
+  int ourSocket = -1;
+
+  do {
+    ourSocket = setUpOurSocket(env, ourPort);
+    if (ourSocket == -1) break;
+
+    return new MetricsServer(env, ourSocket, ourPort, registry);
+  } while (0);
+
+  if (ourSocket != -1) ::closeSocket(ourSocket);
+  return NULL;
+}
+
+#define LISTEN_BACKLOG_SIZE 20
+
+int MetricsServer::setUpOurSocket(UsageEnvironment& env, Port& ourPort) {
+  int ourSocket = -1;
+
+  do {
+    NoReuse dummy; // Don't use this socket if there's already a local server using it
+
+    ourSocket = setupStreamSocket(env, ourPort);
+    if (ourSocket < 0) break;
+
+    // Allow multiple simultaneous connections:
+    if (listen(ourSocket, LISTEN_BACKLOG_SIZE) < 0) {
+      env.setResultErrMsg("listen() failed: ");
+      break;
+    }
+
+    if (ourPort.num() == 0) {
+      // bind() will have chosen a port for us; return it also:
+      if (!getSourcePort(env, ourSocket, ourPort)) break;
+    }
+
+    return ourSocket;
+  } while (0);
+
+  if (ourSocket != -1) ::closeSocket(ourSocket);
+  return -1;
+}
+
+MetricsServer::MetricsServer(UsageEnvironment& env, int ourSocket,
+			     Port ourPort, MetricsRegistry& registry)
+  : Medium(env),
+    fServerSocket(ourSocket), fServerPort(ourPort),
+    fRegistryName(strDup(registry.name())), fConnections(NULL) {
+#ifdef USE_SIGNALS
+  // Ignore the SIGPIPE signal, so that clients on the same host that are killed
+  // don't also kill us:
+  signal(SIGPIPE, SIG_IGN);
+#endif
+
+  // Arrange to handle connections from others:
+  env.taskScheduler().turnOnBackgroundReadHandling(fServerSocket,
+	   (TaskScheduler::BackgroundHandlerProc*)&incomingConnectionHandler,
+						   this);
+}
+
+MetricsServer::~MetricsServer() {
+  envir().taskScheduler().turnOffBackgroundReadHandling(fServerSocket);
+  ::closeSocket(fServerSocket);
+
+  while (fConnections != NULL) delete fConnections; // unlinks itself
+
+  delete[] fRegistryName;
+}
+
+char* MetricsServer::metricsURL() const {
+  struct in_addr ourAddress;
+  ourAddress.s_addr = ReceivingInterfaceAddr != 0
+    ? ReceivingInterfaceAddr
+    : ourIPAddress(envir()); // hack
+
+  char* resultURL = new char[100];
+  sprintf(resultURL, "http://%s:%hu/metrics",
+	  our_inet_ntoa(ourAddress), ntohs(fServerPort.num()));
+  return resultURL;
+}
+
+MetricsRegistry* MetricsServer::lookupRegistry() const {
+  Medium* medium;
+  if (!Medium::lookupByName(envir(), fRegistryName, medium)) return NULL;
+
+  return (MetricsRegistry*)medium;
+}
+
+void MetricsServer::incomingConnectionHandler(void* instance, int /*mask*/) {
+  MetricsServer* server = (MetricsServer*)instance;
+  server->incomingConnectionHandler1();
+}
+
+void MetricsServer::incomingConnectionHandler1() {
+  struct sockaddr_in clientAddr;
+  SOCKLEN_T clientAddrLen = sizeof clientAddr;
+  int clientSocket = accept(fServerSocket, (struct sockaddr*)&clientAddr,
+                            &clientAddrLen);
+  if (clientSocket < 0) {
+    int err = envir().getErrno();
+    if (err != EWOULDBLOCK) {
+      envir().setResultErrMsg("accept() failed: ");
+    }
+    return;
+  }
+  makeSocketNonBlocking(clientSocket);
+  DEBUG_LOG(INF, "MetricsServer: accept()ed connection from %s",
+    our_inet_ntoa(clientAddr.sin_addr));
+
+  // Create a new object for handling this HTTP connection:
+  new MetricsClientConnection(*this, clientSocket);
+}
+
+
+////////// MetricsClientConnection implementation /////////
+
+MetricsServer::MetricsClientConnection
+::MetricsClientConnection(MetricsServer& ourServer, int clientSocket)
+  : fOurServer(ourServer), fNext(ourServer.fConnections),
+    fClientSocket(clientSocket), fKeepAlive(True), fIsWaitingToSend(False),
+    fResponse(NULL), fResponseSize(0), fBytesSent(0) {
+  ourServer.fConnections = this;
+
+  // Arrange to handle incoming requests:
+  resetRequestBuffer();
+  envir().taskScheduler().turnOnBackgroundReadHandling(fClientSocket,
+	       (TaskScheduler::BackgroundHandlerProc*)&incomingRequestHandler, this);
+}
+
+MetricsServer::MetricsClientConnection::~MetricsClientConnection() {
+  MetricsClientConnection** ptr = &fOurServer.fConnections;
+  while (*ptr != this) ptr = &(*ptr)->fNext;
+  *ptr = fNext;
+
+  delete[] fResponse;
+
+  // Turn off background handling:
+  envir().taskScheduler().turnOffBackgroundReadHandling(fClientSocket);
+  if (fIsWaitingToSend) {
+    envir().taskScheduler().turnOffBackgroundWriteHandling(fClientSocket);
+  }
+
+  ::closeSocket(fClientSocket);
+}
+
+void MetricsServer::MetricsClientConnection
+::incomingRequestHandler(void* instance, int /*mask*/) {
+  MetricsClientConnection* connection = (MetricsClientConnection*)instance;
+  connection->incomingRequestHandler1();
+}
+
+void MetricsServer::MetricsClientConnection::incomingRequestHandler1() {
+  struct sockaddr_in dummy; // 'from' address, meaningless in this case
+  Boolean endOfMsg = False;
+  char* ptr = &fRequestBuffer[fRequestBytesAlreadySeen];
+
+  int bytesRead = readSocket(envir(), fClientSocket,
+                             (unsigned char*)ptr, fRequestBufferBytesLeft, dummy);
+  if (bytesRead <= 0 || (unsigned)bytesRead >= fRequestBufferBytesLeft) {
+    // Either the client socket has died (or closed a kept-alive connection),
+    // or the request was too big for us.  Terminate this connection:
+    delete this;
+    return;
+  }
+
+  // Look for the end of the message: <CR><LF><CR><LF>
+  char* tmpPtr = ptr;
+  if (fRequestBytesAlreadySeen > 0) --tmpPtr;
+  // in case the last read ended with a <CR>
+  while (tmpPtr < &ptr[bytesRead-1]) {
+    if (*tmpPtr == '\r' && *(tmpPtr+1) == '\n') {
+      if (tmpPtr - fLastCRLF == 2) { // This is it:
+        endOfMsg = 1;
+        break;
+      }
+      fLastCRLF = tmpPtr;
+    }
+    ++tmpPtr;
+  }
+
+  fRequestBufferBytesLeft -= bytesRead;
+  fRequestBytesAlreadySeen += bytesRead;
+
+  if (!endOfMsg) return; // subsequent reads will be needed to complete the request
+
+  // Until this request has been answered, don't read any more:
+  fRequestBuffer[fRequestBytesAlreadySeen] = '\0';
+  envir().taskScheduler().turnOffBackgroundReadHandling(fClientSocket);
+  handleRequest();
+}
+
+void MetricsServer::MetricsClientConnection::resetRequestBuffer() {
+  fRequestBytesAlreadySeen = 0;
+  fRequestBufferBytesLeft = sizeof fRequestBuffer;
+  fLastCRLF = &fRequestBuffer[-3]; // hack
+}
+
+#define HTTP_PARAM_STRING_MAX 1000
+
+void MetricsServer::MetricsClientConnection::handleRequest() {
+  char cmdName[HTTP_PARAM_STRING_MAX];
+  char url[HTTP_PARAM_STRING_MAX];
+  unsigned versionMajor, versionMinor;
+  if (sscanf(fRequestBuffer, "%999s %999s HTTP/%u.%u",
+	     cmdName, url, &versionMajor, &versionMinor) != 4) {
+    fKeepAlive = False;
+    setResponse(400, "Bad Request", NULL, 0);
+  } else {
+    // HTTP/1.1 connections persist, unless the client says otherwise;
+    // HTTP/1.0 ones don't, unless it asks:
+    fKeepAlive = versionMajor > 1 || (versionMajor == 1 && versionMinor >= 1);
+    for (char const* line = strstr(fRequestBuffer, "\r\n"); line != NULL;
+	 line = strstr(line + 2, "\r\n")) {
+      if (_strncasecmp(line + 2, "Connection:", 11) != 0) continue;
+
+      char const* value = line + 13;
+      while (*value == ' ' || *value == '\t') ++value;
+      if (_strncasecmp(value, "close", 5) == 0) fKeepAlive = False;
+      else if (_strncasecmp(value, "keep-alive", 10) == 0) fKeepAlive = True;
+      break;
+    }
+
+    char* query = strchr(url, '?');
+    if (query != NULL) *query = '\0'; // we take no parameters
+
+    MetricsRegistry* registry = fOurServer.lookupRegistry();
+    if (strcmp(cmdName, "GET") != 0) {
+      setResponse(405, "Method Not Allowed", NULL, 0);
+    } else if (strcmp(url, "/metrics") != 0 || registry == NULL) {
+      setResponse(404, "Not Found", NULL, 0);
+    } else {
+      unsigned bodySize;
+      char* body = registry->scrape(bodySize);
+      setResponse(200, "OK", body, bodySize);
+      delete[] body;
+    }
+  }
+
+  fBytesSent = 0;
+  sendResponse();
+}
+
+void MetricsServer::MetricsClientConnection
+::setResponse(unsigned code, char const* reason,
+	      char const* body, unsigned bodySize) {
+  char header[300];
+  unsigned headerSize
+    = sprintf(header,
+	      "HTTP/1.1 %u %s\r\n"
+	      "Content-Type: text/plain; version=0.0.4; charset=utf-8\r\n"
+	      "Content-Length: %u\r\n"
+	      "Cache-Control: no-cache\r\n"
+	      "Allow: GET\r\n"
+	      "Connection: %s\r\n"
+	      "\r\n",
+	      code, reason, bodySize, fKeepAlive ? "keep-alive" : "close");
+
+  delete[] fResponse;
+  fResponseSize = headerSize + bodySize;
+  fResponse = new char[fResponseSize];
+  memmove(fResponse, header, headerSize);
+  if (bodySize > 0) memmove(&fResponse[headerSize], body, bodySize);
+}
+
+void MetricsServer::MetricsClientConnection
+::sendResponseHandler(void* instance, int /*mask*/) {
+  ((MetricsClientConnection*)instance)->sendResponse();
+}
+
+void MetricsServer::MetricsClientConnection::sendResponse() {
+  while (fBytesSent < fResponseSize) {
+    int bytesSent = send(fClientSocket, &fResponse[fBytesSent],
+			 fResponseSize - fBytesSent, 0);
+    if (bytesSent < 0) {
+      if (envir().getErrno() == EWOULDBLOCK) {
+	// The socket's send buffer is full; continue when it's writable:
+	if (!fIsWaitingToSend) {
+	  envir().taskScheduler().turnOnBackgroundWriteHandling(fClientSocket,
+	       (TaskScheduler::BackgroundHandlerProc*)&sendResponseHandler, this);
+	  fIsWaitingToSend = True;
+	}
+	return;
+      }
+      delete this; // the client has gone away
+      return;
+    }
+    fBytesSent += bytesSent;
+  }
+
+  endRequest();
+}
+
+void MetricsServer::MetricsClientConnection::endRequest() {
+  if (fIsWaitingToSend) {
+    envir().taskScheduler().turnOffBackgroundWriteHandling(fClientSocket);
+    fIsWaitingToSend = False;
+  }
+  delete[] fResponse; fResponse = NULL;
+  fResponseSize = 0;
+
+  if (!fKeepAlive) {
+    delete this;
+    return;
+  }
+
+  // Wait for the next request:
+  resetRequestBuffer();
+  envir().taskScheduler().turnOnBackgroundReadHandling(fClientSocket,
+	       (TaskScheduler::BackgroundHandlerProc*)&incomingRequestHandler, this);
+}
@@ -20,7 +20,12 @@ along with this library; if not, write to the Free Software Foundation, Inc.,
 // Implementation
 
 #include "MultiFramedRTPSink.hh"
+#include "ULPFEC.hh"
+#include "FanOutRTPSink.hh"
+#include "GOPCache.hh"
+#include "FrameTrace.hh"
 #include "GroupsockHelper.hh"
+#include <string.h>
 #include "LogMacros.hh"
 ////////// MultiFramedRTPSink //////////
 
@@ -42,7 +47,12 @@ MultiFramedRTPSink::MultiFramedRTPSink(UsageEnvironment& env,
 				       unsigned numChannels)
   : RTPSink(env, rtpGS, rtpPayloadType, rtpTimestampFrequency,
 	    rtpPayloadFormatName, numChannels),
-  fOutBuf(NULL), fCurFragmentationOffset(0), fPreviousFrameEndedFragmentation(False) {
+  fOutBuf(NULL), fCurFragmentationOffset(0), fPreviousFrameEndedFragmentation(False),
+  fHistory(NULL), fHistorySize(0), fHistoryPacketSize(0), fHistoryData(NULL),
+  fRTXPayloadType(0), fRTXSSRC(0), fRTXSeqNo(0), fRTXBuf(NULL),
+  fNumRetransmittedPackets(0), fNumUnavailableRetransmissions(0),
+  fFECEncoder(NULL), fFECPayloadType(0), fFECSSRC(0), fFECSeqNo(0),
+  fNumFECPackets(0), fFanOutSinks(NULL), fGOPCache(NULL), fGOPBurstRate(0) {
   setPacketSizes(1000, 1448);
       // ĬϵС1500(ȥIPͷĴС)⣬4ԶΪ1448
       // Default max packet size (1500, minus allowance for IP, UDP, UMTP headers)
@@ -50,9 +60,95 @@ MultiFramedRTPSink::MultiFramedRTPSink(UsageEnvironment& env,
 }
 
 MultiFramedRTPSink::~MultiFramedRTPSink() {
+  while (fFanOutSinks != NULL) removeFanOutSink(fFanOutSinks);
+  delete fGOPCache;
+  delete fFECEncoder;
+  deleteHistory();
   delete fOutBuf;
 }
 
+void MultiFramedRTPSink::enableRetransmission(unsigned historySize,
+					      unsigned char rtxPayloadType) {
+  deleteHistory();
+  if (historySize == 0) return;
+  if (historySize > 0x8000) historySize = 0x8000; // half the seq no space
+
+  fHistorySize = historySize;
+  fHistoryPacketSize = fOurMaxPacketSize;
+  fHistory = new SentPacket[fHistorySize];
+  fHistoryData = new unsigned char[fHistorySize*fHistoryPacketSize];
+  for (unsigned i = 0; i < fHistorySize; ++i) {
+    fHistory[i].seqNo = 0;
+    fHistory[i].size = 0;
+    fHistory[i].numRetransmissions = 0;
+    fHistory[i].data = &fHistoryData[i*fHistoryPacketSize];
+  }
+
+  fRTXPayloadType = rtxPayloadType;
+  if (fRTXPayloadType != 0) {
+    fRTXSSRC = our_random32();
+    fRTXSeqNo = (u_int16_t)our_random();
+    fRTXBuf = new unsigned char[fHistoryPacketSize + 2]; // + the OSN
+  }
+}
+
+void MultiFramedRTPSink::enableFEC(unsigned char fecPayloadType,
+				   unsigned rowSize, unsigned numRows) {
+  delete fFECEncoder; fFECEncoder = NULL;
+  fFECPayloadType = fecPayloadType;
+  if (fFECPayloadType == 0) return;
+
+  fFECEncoder = new ULPFECEncoder(fOurMaxPacketSize, rowSize, numRows);
+  if (fFECSSRC == 0) {
+    fFECSSRC = our_random32();
+    fFECSeqNo = (u_int16_t)our_random();
+  }
+}
+
+void MultiFramedRTPSink::setFECGroupSizes(unsigned rowSize, unsigned numRows) {
+  if (fFECEncoder != NULL) fFECEncoder->setGroupSizes(rowSize, numRows);
+}
+
+double MultiFramedRTPSink::fecRatio() const {
+  if (fFECEncoder == NULL) return 0.0;
+
+  double ratio = 1.0/fFECEncoder->rowSize();
+  if (fFECEncoder->numRows() >= 2) ratio += 1.0/fFECEncoder->numRows();
+  return ratio;
+}
+
+void MultiFramedRTPSink::addFanOutSink(FanOutRTPSink* sink) {
+  sink->fNextFanOutSink = fFanOutSinks;
+  fFanOutSinks = sink;
+}
+
+void MultiFramedRTPSink::removeFanOutSink(FanOutRTPSink* sink) {
+  for (FanOutRTPSink** sinkPtr = &fFanOutSinks; *sinkPtr != NULL;
+       sinkPtr = &((*sinkPtr)->fNextFanOutSink)) {
+    if (*sinkPtr == sink) {
+      *sinkPtr = sink->fNextFanOutSink;
+      sink->fNextFanOutSink = NULL;
+      return;
+    }
+  }
+}
+
+void MultiFramedRTPSink::enableGOPCache(unsigned maxSize, unsigned burstKbps) {
+  delete fGOPCache; fGOPCache = NULL;
+  if (maxSize == 0) return;
+
+  fGOPCache = new GOPCache(maxSize);
+  fGOPBurstRate = burstKbps;
+}
+
+void MultiFramedRTPSink::deleteHistory() {
+  delete[] fHistory; fHistory = NULL;
+  delete[] fHistoryData; fHistoryData = NULL;
+  delete[] fRTXBuf; fRTXBuf = NULL;
+  fHistorySize = fHistoryPacketSize = 0;
+  fRTXPayloadType = 0; fRTXSSRC = 0;
+}
+
 void MultiFramedRTPSink
 ::doSpecialFrameHandling(unsigned /*fragmentationOffset*/,
 			 unsigned char* /*frameStart*/,
@@ -95,6 +191,12 @@ unsigned MultiFramedRTPSink::computeOverflowForNewFrame(unsigned newFrameSize) c
   return fOutBuf->numOverflowBytes(newFrameSize);
 }
 
+Boolean MultiFramedRTPSink
+::packetStartsKeyFrame(unsigned char const* /*payload*/,
+		       unsigned /*payloadSize*/) {
+  return False; // by default
+}
+
 void MultiFramedRTPSink::setMarkerBit() {
   unsigned rtpHdr = fOutBuf->extractWord(0);
   rtpHdr |= 0x00800000;
@@ -104,6 +206,7 @@ void MultiFramedRTPSink::setMarkerBit() {
 void MultiFramedRTPSink::setTimestamp(struct timeval timestamp) {
   // First, convert the timestamp to a 32-bit RTP timestamp:
   fCurrentTimestamp = convertToRTPTimestamp(timestamp);
+  fCurrentPresentationTime = timestamp; // for our fan-out sinks
 
   // Then, insert it into the RTP packet:
   fOutBuf->insertWord(fCurrentTimestamp, fTimestampPosition);
@@ -360,6 +463,11 @@ void MultiFramedRTPSink
 
 static unsigned const rtpHeaderSize = 12;
 
+// Each packet is resent at most this many times.  With a shared stream,
+// every viewer that missed the same packet sends its own NACK for it, and
+// one retransmission (which goes to all of them) is normally enough.
+#define MAX_RETRANSMISSIONS 2
+
 Boolean MultiFramedRTPSink::isTooBigForAPacket(unsigned numBytes) const {
   // Check whether a 'numBytes'-byte frame - together with a RTP header and
   // (possible) special headers - would be too big for an output packet:
@@ -370,22 +478,35 @@ Boolean MultiFramedRTPSink::isTooBigForAPacket(unsigned numBytes) const {
 
 void MultiFramedRTPSink::sendPacketIfNecessary() {
   if (fNumFramesUsedSoFar > 0) {
+    // Keep a copy first, so that even a packet 'lost' below can be resent:
+    if (fHistory != NULL) {
+      saveSentPacket(fOutBuf->packet(), fOutBuf->curPacketSize());
+    }
+
     // Send the packet:
-#ifdef TEST_LOSS
-    if ((our_random()%10) != 0) // simulate 10% packet loss #####
-#endif
     if(getenv("HEX") != NULL)
     {
       DEBUG_HEX(fOutBuf->packet(),fOutBuf->curPacketSize());
     }
     DEBUG_LOG(INF, "Send packet(fOutBuf), head = start = %p, size = %4u, data = %s", 
       fOutBuf->packet(), fOutBuf->curPacketSize(), binToHex(fOutBuf->packet(), 16));
+#ifdef TEST_LOSS
+    if ((our_random()%10) != 0) // simulate 10% packet loss #####
+#endif
     fRTPInterface.sendPacket(fOutBuf->packet(), fOutBuf->curPacketSize());
+    if (FrameTrace::isEnabled()) {
+      // (The marker bit ends the frame)
+      FrameTrace::markPacketSent(fCurrentPresentationTime,
+				 (fOutBuf->packet()[1]&0x80) != 0);
+    }
     ++fPacketCount;
     fTotalOctetCount += fOutBuf->curPacketSize();
     fOctetCount += fOutBuf->curPacketSize()
       - rtpHeaderSize - fSpecialHeaderSize - fTotalFrameSpecificHeaderSizes;
 
+    if (fFECEncoder != NULL) sendFECPackets();
+    fanOutPacket(fOutBuf->packet(), fOutBuf->curPacketSize());
+
     ++fSeqNo; // for next time
   }
 
@@ -443,6 +564,129 @@ void MultiFramedRTPSink::sendNext(void* firstArg) {
   sink->buildAndSendPacket(False);
 }
 
+void MultiFramedRTPSink::sendFECPackets() {
+  unsigned numFECPackets
+    = fFECEncoder->addMediaPacket(fOutBuf->packet(), fOutBuf->curPacketSize());
+  for (unsigned i = 0; i < numFECPackets; ++i) {
+    unsigned packetSize;
+    unsigned char* packet = fFECEncoder->fecPacket(i, packetSize);
+
+    // Our own RTP header, with the timestamp of the latest media packet:
+    *(unsigned*)&packet[0]
+      = htonl(0x80000000 | (fFECPayloadType<<16) | fFECSeqNo++);
+    memmove(&packet[4], &fOutBuf->packet()[4], 4);
+    *(unsigned*)&packet[8] = htonl(fFECSSRC);
+
+#ifdef TEST_LOSS
+    if ((our_random()%10) != 0) // FEC packets get lost too #####
+#endif
+    fRTPInterface.sendPacket(packet, packetSize);
+    fTotalOctetCount += packetSize;
+    ++fNumFECPackets;
+  }
+}
+
+void MultiFramedRTPSink::relayPacket(unsigned char* packet,
+				     unsigned packetSize,
+				     struct timeval presentationTime) {
+  if (packetSize < rtpHeaderSize) return;
+
+  // The packet keeps its own sequence number (and timestamp); our fan-out
+  // sinks' offsets are from these:
+  fSeqNo = (packet[2]<<8)|packet[3];
+  fCurrentTimestamp = ntohl(*(u_int32_t*)&packet[4]);
+  fCurrentPresentationTime = presentationTime;
+  if (fHistory != NULL) saveSentPacket(packet, packetSize);
+
+  ++fPacketCount;
+  fTotalOctetCount += packetSize;
+  fOctetCount += packetSize - rtpHeaderSize;
+
+  fanOutPacket(packet, packetSize);
+  ++fSeqNo; // for "currentSeqNo()"
+}
+
+void MultiFramedRTPSink::fanOutPacket(unsigned char* packet,
+				      unsigned packetSize) {
+  if (fGOPCache != NULL) {
+    // (This must come first, for fan-out sinks that are still being sent
+    // the cache:)
+    fGOPCache->addPacket(packet, packetSize,
+			 packetStartsKeyFrame(&packet[rtpHeaderSize],
+					      packetSize - rtpHeaderSize));
+  }
+
+  // Have each fan-out sink send it again, from our buffer:
+  for (FanOutRTPSink* sink = fFanOutSinks; sink != NULL;
+       sink = sink->nextFanOutSink()) {
+    sink->sendFannedOutPacket(packet, packetSize, fCurrentPresentationTime);
+  }
+}
+
+void MultiFramedRTPSink::saveSentPacket(unsigned char const* packet,
+					unsigned packetSize) {
+  SentPacket& sent = fHistory[fSeqNo%fHistorySize];
+  if (packetSize > fHistoryPacketSize) {
+    sent.size = 0; // "setPacketSizes()" was called later; can't keep this one
+    return;
+  }
+
+  sent.seqNo = fSeqNo;
+  sent.size = packetSize;
+  sent.numRetransmissions = 0;
+  memmove(sent.data, packet, packetSize);
+}
+
+unsigned char* MultiFramedRTPSink::sentPacket(u_int16_t seqNo,
+					      unsigned& packetSize) {
+  packetSize = 0;
+  if (fHistory == NULL) return NULL;
+
+  SentPacket& sent = fHistory[seqNo%fHistorySize];
+  if (sent.size == 0 || sent.seqNo != seqNo) return NULL;
+
+  packetSize = sent.size;
+  return sent.data;
+}
+
+void MultiFramedRTPSink::retransmitPacket(u_int16_t seqNo) {
+  if (fHistory == NULL) return;
+
+  SentPacket& sent = fHistory[seqNo%fHistorySize];
+  if (sent.size == 0 || sent.seqNo != seqNo
+      || sent.numRetransmissions >= MAX_RETRANSMISSIONS) {
+    // It's too old (or too often NACKed); the receiver has to cope:
+    ++fNumUnavailableRetransmissions;
+    return;
+  }
+  ++sent.numRetransmissions;
+  ++fNumRetransmittedPackets;
+
+  unsigned char* packet = sent.data;
+  unsigned packetSize = sent.size;
+  if (fRTXPayloadType != 0) {
+    // RFC 4588: our own header (same marker bit and timestamp), then the
+    // original sequence number, then the original payload:
+    unsigned rtpHdr = ntohl(*(unsigned*)sent.data);
+    rtpHdr = (rtpHdr&0xFF800000) | (fRTXPayloadType<<16) | fRTXSeqNo++;
+    *(unsigned*)&fRTXBuf[0] = htonl(rtpHdr);
+    memmove(&fRTXBuf[4], &sent.data[4], 4); // timestamp
+    *(unsigned*)&fRTXBuf[8] = htonl(fRTXSSRC);
+    fRTXBuf[12] = seqNo>>8; fRTXBuf[13] = (unsigned char)seqNo;
+    memmove(&fRTXBuf[14], &sent.data[rtpHeaderSize], sent.size - rtpHeaderSize);
+    packet = fRTXBuf;
+    packetSize = sent.size + 2;
+  }
+
+  DEBUG_LOG(INF, "Retransmit packet %u (%u bytes)%s", seqNo, packetSize,
+	    fRTXPayloadType != 0 ? " as rtx" : "");
+#ifdef TEST_LOSS
+  if ((our_random()%10) != 0) // retransmissions get lost too #####
+#endif
+  fRTPInterface.sendPacket(packet, packetSize);
+  fTotalOctetCount += packetSize;
+}
+
 void MultiFramedRTPSink::ourHandleClosure(void* clientData) {
   MultiFramedRTPSink* sink = (MultiFramedRTPSink*)clientData;
   // There are no frames left, but we may have a partially built packet
@@ -20,12 +20,16 @@ along with this library; if not, write to the Free Software Foundation, Inc.,
 // Implementation
 
 #include "MultiFramedRTPSource.hh"
+#include "RTCP.hh"
+#include "ULPFEC.hh"
 #include "GroupsockHelper.hh"
 #include <string.h>
 #include "LogMacros.hh"
 
 ////////// ReorderingPacketBuffer definition //////////
 
+#define REORDERING_RING_SIZE 1024 // must be a power of 2
+
 class ReorderingPacketBuffer {
 public:
   ReorderingPacketBuffer(BufferedPacketFactory* packetFactory);
@@ -37,25 +41,78 @@ public:
   BufferedPacket* getNextCompletedPacket(Boolean& packetLossPreceded);
   void releaseUsedPacket(BufferedPacket* packet);
   void freePacket(BufferedPacket* packet) {
-    if (packet != fSavedPacket) {
-      delete packet;
-    } else {
-      fSavedPacketFree = True;
-    }
+    // Keep it for reuse by "getFreePacket()":
+    packet->nextPacket() = fFreePackets;
+    fFreePackets = packet;
   }
-  Boolean isEmpty() const { return fHeadPacket == NULL; }
+  void unreferencePacket(BufferedPacket* packet) {
+    if (--packet->referenceCount() == 0) freePacket(packet);
+  }
+  Boolean isEmpty() const { return fNumStoredPackets == 0; }
 
   void setThresholdTime(unsigned uSeconds) { fThresholdTime = uSeconds; }
 
 private:
+  BufferedPacket*& slot(unsigned short rtpSeqNo) {
+    return fRing[rtpSeqNo&(REORDERING_RING_SIZE-1)];
+  }
+  BufferedPacket* firstStoredPacket();
+  void discardStoredPackets();
+
   BufferedPacketFactory* fPacketFactory;
   unsigned fThresholdTime; // uSeconds
   Boolean fHaveSeenFirstPacket; // used to set initial "fNextExpectedSeqNo"
   unsigned short fNextExpectedSeqNo;
-  BufferedPacket* fHeadPacket;
-  BufferedPacket* fSavedPacket;
-      // to avoid calling new/free in the common case
-  Boolean fSavedPacketFree;
+  BufferedPacket* fRing[REORDERING_RING_SIZE];
+      // stored packets, indexed by RTP sequence number.  Only packets within
+      // REORDERING_RING_SIZE of "fNextExpectedSeqNo" are stored, so each
+      // slot holds at most one.
+  unsigned fNumStoredPackets;
+  BufferedPacket* fFreePackets;
+      // packets that we're done with, linked through "nextPacket()", so that
+      // we don't call new/delete for each packet
+};
+
+
+////////// NACKGapList definition //////////
+
+#define MAX_PENDING_GAPS 64
+
+// Sequence number gaps that are waiting to be NACKed.  A gap is NACKed only
+// once it's been open for the reordering window, because a packet that just
+// arrives out of order would otherwise be resent for nothing.
+class NACKGapList {
+public:
+  NACKGapList(unsigned reorderWindow);
+
+  Boolean isFull() const { return fNumGaps == MAX_PENDING_GAPS; }
+  void addGap(unsigned short firstSeqNo, unsigned numSeqNos,
+	      struct timeval const& timeNow); // when not "isFull()"
+  void makeOldestDue();
+  void noteArrival(unsigned short rtpSeqNo) { missing(rtpSeqNo) = False; }
+
+  Boolean getDueRun(struct timeval const& timeNow,
+		    unsigned short& firstSeqNo, unsigned& numSeqNos);
+      // Returns the next run of consecutive packets, in a due gap, that are
+      // still missing (and forgets them), or False if there's none yet
+  Boolean getTimeUntilDue(struct timeval const& timeNow,
+			  unsigned& uSeconds) const;
+      // False if there are no gaps
+
+private:
+  Boolean& missing(unsigned short rtpSeqNo) {
+    return fMissing[rtpSeqNo&(REORDERING_RING_SIZE-1)];
+  }
+  unsigned uSecondsSinceNoticed(unsigned gap, struct timeval const& timeNow) const;
+
+  unsigned fReorderWindow; // uSeconds
+  Boolean fMissing[REORDERING_RING_SIZE];
+  struct {
+    unsigned short nextSeqNo;
+    unsigned numLeft;
+    struct timeval timeNoticed;
+  } fGaps[MAX_PENDING_GAPS]; // a FIFO, oldest first
+  unsigned fFirstGap, fNumGaps;
 };
 
 
@@ -66,12 +123,17 @@ MultiFramedRTPSource
 		       unsigned char rtpPayloadFormat,
 		       unsigned rtpTimestampFrequency,
 		       BufferedPacketFactory* packetFactory)
-  : RTPSource(env, RTPgs, rtpPayloadFormat, rtpTimestampFrequency) {
+  : RTPSource(env, RTPgs, rtpPayloadFormat, rtpTimestampFrequency),
+    fNACKSenderName(NULL), fRTXPayloadFormat(0), fNACKGaps(NULL),
+    fNACKTask(NULL), fHaveSeenSeqNo(False), fHighestSeqNo(0),
+    fNumNACKedPackets(0), fNumRTXPacketsReceived(0),
+    fFECDecoder(NULL), fFECPayloadFormat(0), fNumFECRecoveredPackets(0) {
   reset();
   fReorderingBuffer = new ReorderingPacketBuffer(packetFactory);
 
-  // Try to use a big receive buffer for RTP:
-  increaseReceiveBufferTo(env, RTPgs->socketNum(), 50*1024);
+  // Try to use a big receive buffer for RTP, so that a high bitrate stream
+  // doesn't overflow it between two passes through the event loop:
+  increaseReceiveBufferTo(env, RTPgs->socketNum(), 2*1024*1024);
 }
 
 void MultiFramedRTPSource::reset() {
@@ -80,11 +142,34 @@ void MultiFramedRTPSource::reset() {
   fAreDoingNetworkReads = False;
   fNeedDelivery = False;
   fPacketLossInFragmentedFrame = False;
+  fFragments = NULL;
 }
 
 MultiFramedRTPSource::~MultiFramedRTPSource() {
   fRTPInterface.stopNetworkReading();
   delete fReorderingBuffer;
+  delete[] fNACKSenderName;
+  envir().taskScheduler().unscheduleDelayedTask(fNACKTask);
+  delete fNACKGaps;
+  delete fFECDecoder;
+}
+
+void MultiFramedRTPSource::setNACKSender(RTCPInstance* rtcpInstance,
+					 unsigned char rtxPayloadFormat,
+					 unsigned reorderWindow) {
+  delete[] fNACKSenderName;
+  fNACKSenderName = rtcpInstance == NULL ? NULL : strDup(rtcpInstance->name());
+  fRTXPayloadFormat = rtcpInstance == NULL ? 0 : rtxPayloadFormat;
+
+  envir().taskScheduler().unscheduleDelayedTask(fNACKTask);
+  delete fNACKGaps;
+  fNACKGaps = rtcpInstance == NULL ? NULL : new NACKGapList(reorderWindow);
+}
+
+void MultiFramedRTPSource::setFECPayloadFormat(unsigned char fecPayloadFormat) {
+  delete fFECDecoder; fFECDecoder = NULL;
+  fFECPayloadFormat = fecPayloadFormat;
+  if (fFECPayloadFormat != 0) fFECDecoder = new ULPFECDecoder;
 }
 
 Boolean MultiFramedRTPSource
@@ -102,7 +187,23 @@ Boolean MultiFramedRTPSource
   return True;
 }
 
+Boolean MultiFramedRTPSource::isMultiFramedRTPSource() const {
+  return True;
+}
+
+void MultiFramedRTPSource
+::getNextFrameFragments(FrameFragments& fragments, unsigned maxSize,
+			afterGettingFunc* afterGettingFunc,
+			void* afterGettingClientData,
+			onCloseFunc* onCloseFunc,
+			void* onCloseClientData) {
+  fFragments = &fragments;
+  getNextFrame(NULL, maxSize, afterGettingFunc, afterGettingClientData,
+	       onCloseFunc, onCloseClientData);
+}
+
 void MultiFramedRTPSource::doStopGettingFrames() {
+  if (fFragments != NULL) fFragments->release(); // the frame won't be completed
   fRTPInterface.stopNetworkReading();
   fReorderingBuffer->reset();
   reset();
@@ -156,6 +257,7 @@ void MultiFramedRTPSource::doGetNextFrame1() {
 	// Forget any data that we used from it:
 	fTo = fSavedTo; fMaxSize = fSavedMaxSize;
 	fFrameSize = 0;
+	if (fFragments != NULL) fFragments->release();
       }
       fPacketLossInFragmentedFrame = False;
     } else if (packetLossPrecededThis) {
@@ -171,10 +273,21 @@ void MultiFramedRTPSource::doGetNextFrame1() {
 
     // The packet is usable. Deliver all or part of it to our caller:
     unsigned frameSize;
-    nextPacket->use(fTo, fMaxSize, frameSize, fNumTruncatedBytes,
-		    fCurPacketRTPSeqNum, fCurPacketRTPTimestamp,
-		    fPresentationTime, fCurPacketHasBeenSynchronizedUsingRTCP,
-		    fCurPacketMarkerBit);
+    if (fFragments == NULL) {
+      nextPacket->use(fTo, fMaxSize, frameSize, fNumTruncatedBytes,
+		      fCurPacketRTPSeqNum, fCurPacketRTPTimestamp,
+		      fPresentationTime, fCurPacketHasBeenSynchronizedUsingRTCP,
+		      fCurPacketMarkerBit);
+    } else {
+      // Leave the data in the packet, and just note where it is:
+      unsigned char* framePtr;
+      nextPacket->useInPlace(framePtr, fMaxSize, frameSize, fNumTruncatedBytes,
+			     fCurPacketRTPSeqNum, fCurPacketRTPTimestamp,
+			     fPresentationTime,
+			     fCurPacketHasBeenSynchronizedUsingRTCP,
+			     fCurPacketMarkerBit);
+      if (frameSize > 0) fFragments->append(this, nextPacket, framePtr, frameSize);
+    }
     fFrameSize += frameSize;
 
     if (!nextPacket->hasUsableData()) {
@@ -189,6 +302,7 @@ void MultiFramedRTPSource::doGetNextFrame1() {
 		<< fSavedMaxSize << ").  "
 		<< fNumTruncatedBytes << " bytes of trailing data will be dropped!\n";
       }
+      fFragments = NULL; // the next request may be an ordinary "getNextFrame()"
       // Call our own 'after getting' function, so that the downstream object can consume the data:
       if (fReorderingBuffer->isEmpty()) {
 	// Common case optimization: There are no more queued incoming packets, so this code will not get
@@ -203,7 +317,8 @@ void MultiFramedRTPSource::doGetNextFrame1() {
     } else {
       // This packet contained fragmented data, and does not complete
       // the data that the client wants.  Keep getting data:
-      fTo += frameSize; fMaxSize -= frameSize;
+      if (fFragments == NULL) fTo += frameSize;
+      fMaxSize -= frameSize;
       fNeedDelivery = True;
     }
   }
@@ -218,18 +333,45 @@ void MultiFramedRTPSource
 
 void MultiFramedRTPSource::networkReadHandler(MultiFramedRTPSource* source,
 					      int /*mask*/) {
-  // Get a free BufferedPacket descriptor to hold the new network packet:
-  BufferedPacket* bPacket
-    = source->fReorderingBuffer->getFreePacket(source);
+  // Get free BufferedPacket descriptors to hold the new network packets,
+  // and read as many packets as are waiting (up to MAX_PACKETS_PER_READ):
+  BufferedPacket* packets[MAX_PACKETS_PER_READ];
+  unsigned i;
+  for (i = 0; i < MAX_PACKETS_PER_READ; ++i) {
+    packets[i] = source->fReorderingBuffer->getFreePacket(source);
+  }
+  unsigned numPackets
+    = BufferedPacket::fillInDataBatch(source->fRTPInterface,
+				      packets, MAX_PACKETS_PER_READ);
+
+  struct timeval timeNow;
+  gettimeofday(&timeNow, NULL);
+  for (i = 0; i < MAX_PACKETS_PER_READ; ++i) {
+    if (i >= numPackets || !source->storeIncomingPacket(packets[i], timeNow)) {
+      source->fReorderingBuffer->freePacket(packets[i]);
+    }
+  }
+  if (source->fFECDecoder != NULL) source->recoverLostPackets(timeNow);
+
+  source->doGetNextFrame1();
+  // If we didn't get proper data this time, we'll get another chance
+}
 
-  // Read the network packet, and perform sanity checks on the RTP header:
+Boolean MultiFramedRTPSource
+::storeIncomingPacket(BufferedPacket* bPacket, struct timeval const& timeNow,
+		      Boolean wasRecovered) {
+  // Perform sanity checks on the RTP header:
   Boolean readSuccess = False;
+  unsigned char* rtpPacket = bPacket->data();
+  unsigned rtpPacketSize = bPacket->dataSize();
   do {
-    if (!bPacket->fillInData(source->fRTPInterface)) break;
 #ifdef TEST_LOSS
-    source->setPacketReorderingThresholdTime(0);
+    if (fNACKSenderName == NULL && fFECDecoder == NULL) {
+      setPacketReorderingThresholdTime(0);
        // don't wait for 'lost' packets to arrive out-of-order later
-    if ((our_random()%10) == 0) break; // simulate 10% packet loss
+       // (unless they're NACKed or FEC protected, in which case they should)
+    }
+    if (!wasRecovered && (our_random()%10) == 0) break; // simulate 10% packet loss
 #endif
 
     // Check for the 12-byte RTP header:
@@ -265,39 +407,137 @@ void MultiFramedRTPSource::networkReadHandler(MultiFramedRTPSource* source,
       bPacket->removePadding(numPaddingBytes);
     }
     // Check the Payload Type.
-    if ((unsigned char)((rtpHdr&0x007F0000)>>16)
-	!= source->rtpPayloadFormat()) {
+    unsigned char rtpPayloadType = (unsigned char)((rtpHdr&0x007F0000)>>16);
+    Boolean isRetransmission = False;
+    if (rtpPayloadType != rtpPayloadFormat() && fFECDecoder != NULL
+	&& rtpPayloadType == fFECPayloadFormat) {
+      // A FEC packet.  It's used (by "recoverLostPackets()") but not stored:
+      fFECDecoder->noteFECPacket(bPacket->data(), bPacket->dataSize());
       break;
     }
+    if (rtpPayloadType != rtpPayloadFormat()) {
+      if (fRTXPayloadFormat == 0 || rtpPayloadType != fRTXPayloadFormat) break;
+
+      // A RFC 4588 retransmission.  Its payload begins with the original
+      // sequence number; treat it as that packet, from the original SSRC:
+      if (bPacket->dataSize() < 2) break;
+      unsigned char* osn = bPacket->data();
+      rtpHdr = (rtpHdr&0xFFFF0000) | (osn[0]<<8) | osn[1]; ADVANCE(2);
+      rtpSSRC = fLastReceivedSSRC;
+      isRetransmission = True;
+    }
 
     // The rest of the packet is the usable data.  Record and save it:
-    source->fLastReceivedSSRC = rtpSSRC;
+    fLastReceivedSSRC = rtpSSRC;
     unsigned short rtpSeqNo = (unsigned short)(rtpHdr&0xFFFF);
     Boolean usableInJitterCalculation
-      = source->packetIsUsableInJitterCalculation((bPacket->data()),
-						  bPacket->dataSize());
+      = !isRetransmission && !wasRecovered // it's late anyway
+      && packetIsUsableInJitterCalculation((bPacket->data()),
+					   bPacket->dataSize());
     struct timeval presentationTime; // computed by:
     Boolean hasBeenSyncedUsingRTCP; // computed by:
-    source->receptionStatsDB()
+    receptionStatsDB()
       .noteIncomingPacket(rtpSSRC, rtpSeqNo, rtpTimestamp,
-			  source->timestampFrequency(),
+			  timestampFrequency(),
 			  usableInJitterCalculation, presentationTime,
 			  hasBeenSyncedUsingRTCP, bPacket->dataSize());
 
     // Fill in the rest of the packet descriptor, and store it:
-    struct timeval timeNow;
-    gettimeofday(&timeNow, NULL);
     bPacket->assignMiscParams(rtpSeqNo, rtpTimestamp, presentationTime,
 			      hasBeenSyncedUsingRTCP, rtpMarkerBit,
 			      timeNow);
-    if (!source->fReorderingBuffer->storePacket(bPacket)) break;
+    if (!fReorderingBuffer->storePacket(bPacket)) break;
+
+    if (fNACKGaps != NULL) fNACKGaps->noteArrival(rtpSeqNo);
+    if (isRetransmission) {
+      ++fNumRTXPacketsReceived;
+    } else {
+      noteSeqNo(rtpSeqNo, timeNow);
+      if (fFECDecoder != NULL) {
+	fFECDecoder->noteMediaPacket(rtpSeqNo, rtpPacket, rtpPacketSize);
+      }
+    }
+    if (wasRecovered) receptionStatsDB().noteRecoveredPacket(rtpSSRC);
 
     readSuccess = True;
   } while (0);
-  if (!readSuccess) source->fReorderingBuffer->freePacket(bPacket);
 
-  source->doGetNextFrame1();
-  // If we didn't get proper data this time, we'll get another chance
+  return readSuccess;
+}
+
+void MultiFramedRTPSource::recoverLostPackets(struct timeval const& timeNow) {
+  // Each rebuilt packet goes through "storeIncomingPacket()", like one that
+  // arrived, and may in turn complete another FEC packet's group:
+  unsigned char* packet;
+  unsigned packetSize;
+  while ((packet = fFECDecoder->recoverPacket(fLastReceivedSSRC, packetSize))
+	 != NULL) {
+    BufferedPacket* bPacket = fReorderingBuffer->getFreePacket(this);
+    bPacket->fillInData(packet, packetSize);
+    if (storeIncomingPacket(bPacket, timeNow, True)) {
+      ++fNumFECRecoveredPackets;
+    } else {
+      fReorderingBuffer->freePacket(bPacket); // e.g., it's too late for it
+    }
+  }
+}
+
+void MultiFramedRTPSource::noteSeqNo(unsigned short rtpSeqNo,
+				     struct timeval const& timeNow) {
+  if (!fHaveSeenSeqNo) {
+    fHaveSeenSeqNo = True;
+    fHighestSeqNo = rtpSeqNo;
+    return;
+  }
+
+  unsigned short seqNoDiff = rtpSeqNo - fHighestSeqNo;
+  if (seqNoDiff == 0 || seqNoDiff >= 0x8000) return; // not a new highest one
+  unsigned short firstMissing = fHighestSeqNo + 1;
+  unsigned numMissing = seqNoDiff - 1;
+  fHighestSeqNo = rtpSeqNo;
+
+  if (numMissing == 0 || fNACKGaps == NULL) return;
+  if (numMissing >= REORDERING_RING_SIZE) return;
+      // the sender jumped ahead; there's nothing we could wait for
+
+  if (fNACKGaps->isFull()) {
+    // Make room by NACKing the oldest gap now:
+    fNACKGaps->makeOldestDue();
+    sendDueNACKs(timeNow);
+  }
+  fNACKGaps->addGap(firstMissing, numMissing, timeNow);
+  sendDueNACKs(timeNow);
+}
+
+void MultiFramedRTPSource::sendDueNACKs(struct timeval const& timeNow) {
+  envir().taskScheduler().unscheduleDelayedTask(fNACKTask);
+
+  RTCPInstance* rtcpInstance;
+  if (!RTCPInstance::lookupByName(envir(), fNACKSenderName, rtcpInstance)) {
+    rtcpInstance = NULL; // the gaps are still forgotten as they fall due
+  }
+  unsigned short firstSeqNo;
+  unsigned numSeqNos;
+  while (fNACKGaps->getDueRun(timeNow, firstSeqNo, numSeqNos)) {
+    if (rtcpInstance == NULL) continue;
+    DEBUG_LOG(INF, "NACK %u packet(s) from %u", numSeqNos, firstSeqNo);
+    fNumNACKedPackets
+      += rtcpInstance->sendNACK(fLastReceivedSSRC, firstSeqNo, numSeqNos);
+  }
+
+  // Come back when the next gap falls due:
+  unsigned uSeconds;
+  if (fNACKGaps->getTimeUntilDue(timeNow, uSeconds)) {
+    fNACKTask = envir().taskScheduler()
+      .scheduleDelayedTask(uSeconds, (TaskFunc*)nackTimeoutHandler, this);
+  }
+}
+
+void MultiFramedRTPSource::nackTimeoutHandler(MultiFramedRTPSource* source) {
+  source->fNACKTask = NULL;
+  struct timeval timeNow;
+  gettimeofday(&timeNow, NULL);
+  source->sendDueNACKs(timeNow);
 }
 
 
@@ -308,7 +548,7 @@ void MultiFramedRTPSource::networkReadHandler(MultiFramedRTPSource* source,
 BufferedPacket::BufferedPacket()
   : fPacketSize(MAX_PACKET_SIZE),
     fBuf(new unsigned char[MAX_PACKET_SIZE]),
-    fNextPacket(NULL) {
+    fNextPacket(NULL), fReferenceCount(0) {
 }
 
 BufferedPacket::~BufferedPacket() {
@@ -359,6 +599,30 @@ Boolean BufferedPacket::fillInData(RTPInterface& rtpInterface) {
   return True;
 }
 
+unsigned BufferedPacket::fillInDataBatch(RTPInterface& rtpInterface,
+					BufferedPacket** packets,
+					unsigned numPackets) {
+  unsigned char* buffers[MAX_PACKETS_PER_READ];
+  unsigned bytesRead[MAX_PACKETS_PER_READ];
+  if (numPackets > MAX_PACKETS_PER_READ) numPackets = MAX_PACKETS_PER_READ;
+
+  unsigned bufferSize = 0;
+  for (unsigned i = 0; i < numPackets; ++i) {
+    BufferedPacket* packet = packets[i];
+    packet->reset();
+    buffers[i] = &packet->fBuf[packet->fTail];
+    unsigned size = packet->fPacketSize - packet->fTail;
+    if (i == 0 || size < bufferSize) bufferSize = size;
+  }
+
+  unsigned numRead
+    = rtpInterface.handleReadBatch(buffers, bufferSize, bytesRead, numPackets);
+  for (unsigned j = 0; j < numRead; ++j) {
+    packets[j]->fTail += bytesRead[j];
+  }
+  return numRead;
+}
+
 void BufferedPacket
 ::assignMiscParams(unsigned short rtpSeqNo, unsigned rtpTimestamp,
 		   struct timeval presentationTime,
@@ -382,6 +646,11 @@ void BufferedPacket::removePadding(unsigned numBytes) {
   fTail -= numBytes;
 }
 
+void BufferedPacket::fillInData(unsigned char* data, unsigned dataSize) {
+  reset();
+  appendData(data, dataSize);
+}
+
 void BufferedPacket::appendData(unsigned char* newData, unsigned numBytes) {
   if (numBytes > fPacketSize-fTail) numBytes = fPacketSize - fTail;
   memmove(&fBuf[fTail], newData, numBytes);
@@ -394,6 +663,19 @@ void BufferedPacket::use(unsigned char* to, unsigned toSize,
 			 struct timeval& presentationTime,
 			 Boolean& hasBeenSyncedUsingRTCP,
 			 Boolean& rtpMarkerBit) {
+  unsigned char* framePtr;
+  useInPlace(framePtr, toSize, bytesUsed, bytesTruncated, rtpSeqNo,
+	     rtpTimestamp, presentationTime, hasBeenSyncedUsingRTCP,
+	     rtpMarkerBit);
+  memmove(to, framePtr, bytesUsed);
+}
+
+void BufferedPacket::useInPlace(unsigned char*& framePtr, unsigned toSize,
+				unsigned& bytesUsed, unsigned& bytesTruncated,
+				unsigned short& rtpSeqNo, unsigned& rtpTimestamp,
+				struct timeval& presentationTime,
+				Boolean& hasBeenSyncedUsingRTCP,
+				Boolean& rtpMarkerBit) {
   unsigned char* origFramePtr = &fBuf[fHead];
   unsigned char* newFramePtr = origFramePtr; // may change in the call below
   unsigned frameSize, frameDurationInMicroseconds;
@@ -407,7 +689,7 @@ void BufferedPacket::use(unsigned char* to, unsigned toSize,
     bytesUsed = frameSize;
   }
 
-  memmove(to, newFramePtr, bytesUsed);
+  framePtr = newFramePtr;
   fHead += (newFramePtr - origFramePtr) + frameSize;
   ++fUseCount;
 
@@ -425,6 +707,60 @@ void BufferedPacket::use(unsigned char* to, unsigned toSize,
   }
 }
 
+////////// FrameFragments implementation //////////
+
+FrameFragments::FrameFragments()
+  : fSource(NULL), fFragments(NULL), fNumFragments(0), fMaxFragments(0),
+    fTotalSize(0) {
+}
+
+FrameFragments::~FrameFragments() {
+  release();
+  delete[] fFragments;
+}
+
+void FrameFragments::append(MultiFramedRTPSource* source,
+			    BufferedPacket* packet,
+			    unsigned char* data, unsigned size) {
+  if (fNumFragments == fMaxFragments) {
+    // Grow the array; it's kept (and reused) from then on:
+    unsigned newMax = fMaxFragments == 0 ? 64 : 2*fMaxFragments;
+    Fragment* newFragments = new Fragment[newMax];
+    for (unsigned i = 0; i < fNumFragments; ++i) newFragments[i] = fFragments[i];
+    delete[] fFragments;
+    fFragments = newFragments;
+    fMaxFragments = newMax;
+  }
+
+  fSource = source;
+  ++packet->referenceCount();
+  fFragments[fNumFragments].packet = packet;
+  fFragments[fNumFragments].data = data;
+  fFragments[fNumFragments].size = size;
+  ++fNumFragments;
+  fTotalSize += size;
+}
+
+unsigned FrameFragments::copyTo(unsigned char* to, unsigned toSize) const {
+  unsigned bytesCopied = 0;
+  for (unsigned i = 0; i < fNumFragments && bytesCopied < toSize; ++i) {
+    unsigned size = fFragments[i].size;
+    if (size > toSize - bytesCopied) size = toSize - bytesCopied;
+    memcpy(&to[bytesCopied], fFragments[i].data, size);
+    bytesCopied += size;
+  }
+  return bytesCopied;
+}
+
+void FrameFragments::release() {
+  for (unsigned i = 0; i < fNumFragments; ++i) {
+    fSource->fReorderingBuffer->unreferencePacket(fFragments[i].packet);
+  }
+  fNumFragments = 0;
+  fTotalSize = 0;
+}
+
+
 BufferedPacketFactory::BufferedPacketFactory() {
 }
 
@@ -442,10 +778,11 @@ BufferedPacket* BufferedPacketFactory
 ReorderingPacketBuffer
 ::ReorderingPacketBuffer(BufferedPacketFactory* packetFactory)
   : fThresholdTime(100000) /* default reordering threshold: 100 ms */,
-    fHaveSeenFirstPacket(False), fHeadPacket(NULL), fSavedPacket(NULL), fSavedPacketFree(True) {
+    fHaveSeenFirstPacket(False), fNumStoredPackets(0), fFreePackets(NULL) {
   fPacketFactory = (packetFactory == NULL)
     ? (new BufferedPacketFactory)
     : packetFactory;
+  for (unsigned i = 0; i < REORDERING_RING_SIZE; ++i) fRing[i] = NULL;
 }
 
 ReorderingPacketBuffer::~ReorderingPacketBuffer() {
@@ -454,26 +791,42 @@ ReorderingPacketBuffer::~ReorderingPacketBuffer() {
 }
 
 void ReorderingPacketBuffer::reset() {
-  if (fSavedPacketFree) delete fSavedPacket; // because fSavedPacket is not in the list
-  delete fHeadPacket; // will also delete fSavedPacket if it's in the list
+  discardStoredPackets();
+
+  // Delete the free packets one at a time (deleting the head of the list
+  // would delete the rest recursively):
+  while (fFreePackets != NULL) {
+    BufferedPacket* packet = fFreePackets;
+    fFreePackets = packet->nextPacket();
+    packet->nextPacket() = NULL;
+    delete packet;
+  }
   fHaveSeenFirstPacket = False;
-  fHeadPacket = NULL;
-  fSavedPacket = NULL;
 }
 
-BufferedPacket* ReorderingPacketBuffer
-::getFreePacket(MultiFramedRTPSource* ourSource) {
-  if (fSavedPacket == NULL) { // we're being called for the first time
-    fSavedPacket = fPacketFactory->createNewPacket(ourSource);
-    fSavedPacketFree = True;
+void ReorderingPacketBuffer::discardStoredPackets() {
+  if (fNumStoredPackets == 0) return;
+
+  for (unsigned i = 0; i < REORDERING_RING_SIZE; ++i) {
+    if (fRing[i] != NULL) {
+      unreferencePacket(fRing[i]);
+      fRing[i] = NULL;
+    }
   }
+  fNumStoredPackets = 0;
+}
 
-  if (fSavedPacketFree == True) {
-    fSavedPacketFree = False;
-    return fSavedPacket;
-  } else {
+BufferedPacket* ReorderingPacketBuffer
+::getFreePacket(MultiFramedRTPSource* ourSource) {
+  BufferedPacket* packet = fFreePackets;
+  if (packet == NULL) {
+    // The pool grows to the most packets ever held at once, then stays there:
     return fPacketFactory->createNewPacket(ourSource);
   }
+
+  fFreePackets = packet->nextPacket();
+  packet->nextPacket() = NULL;
+  return packet;
 }
 
 Boolean ReorderingPacketBuffer::storePacket(BufferedPacket* bPacket) {
@@ -489,70 +842,145 @@ Boolean ReorderingPacketBuffer::storePacket(BufferedPacket* bPacket) {
   // that we're looking for (in this case, it's been excessively delayed).
   if (seqNumLT(rtpSeqNo, fNextExpectedSeqNo)) return False;
 
-  // Figure out where the new packet will be stored in the queue:
-  BufferedPacket* beforePtr = NULL;
-  BufferedPacket* afterPtr = fHeadPacket;
-  while (afterPtr != NULL) {
-    if (seqNumLT(rtpSeqNo, afterPtr->rtpSeqNo())) break; // it comes here
-    if (rtpSeqNo == afterPtr->rtpSeqNo()) {
-      // This is a duplicate packet - ignore it
-      return False;
-    }
-
-    beforePtr = afterPtr;
-    afterPtr = afterPtr->nextPacket();
+  if ((unsigned short)(rtpSeqNo - fNextExpectedSeqNo) >= REORDERING_RING_SIZE) {
+    // This packet is too far ahead to fit in the ring (e.g., the sender
+    // restarted).  Give up on the packets that we have, and start again
+    // from this one, as if there had been packet loss beforehand:
+    discardStoredPackets();
+    fNextExpectedSeqNo = rtpSeqNo;
+    bPacket->isFirstPacket() = True;
   }
 
-  // Link our new packet between "beforePtr" and "afterPtr":
-  bPacket->nextPacket() = afterPtr;
-  if (beforePtr == NULL) {
-    fHeadPacket = bPacket;
-  } else {
-    beforePtr->nextPacket() = bPacket;
+  BufferedPacket*& packetSlot = slot(rtpSeqNo);
+  if (packetSlot != NULL) {
+    // This is a duplicate packet - ignore it
+    return False;
   }
 
+  packetSlot = bPacket;
+  bPacket->referenceCount() = 1; // ours, until it's released
+  ++fNumStoredPackets;
   return True;
 }
 
 void ReorderingPacketBuffer::releaseUsedPacket(BufferedPacket* packet) {
-  // ASSERT: packet == fHeadPacket
   // ASSERT: fNextExpectedSeqNo == packet->rtpSeqNo()
   ++fNextExpectedSeqNo; // because we're finished with this packet now
 
-  fHeadPacket = fHeadPacket->nextPacket();
-  packet->nextPacket() = NULL;
+  slot(packet->rtpSeqNo()) = NULL;
+  --fNumStoredPackets;
 
-  freePacket(packet);
+  unreferencePacket(packet); // "FrameFragments" may still be using it
+}
+
+BufferedPacket* ReorderingPacketBuffer::firstStoredPacket() {
+  // ASSERT: fNumStoredPackets > 0, so this finds one within the ring
+  unsigned short seqNo = fNextExpectedSeqNo;
+  while (slot(seqNo) == NULL) ++seqNo;
+  return slot(seqNo);
 }
 
 BufferedPacket* ReorderingPacketBuffer
 ::getNextCompletedPacket(Boolean& packetLossPreceded) {
-  if (fHeadPacket == NULL) return NULL;
+  if (fNumStoredPackets == 0) return NULL;
 
-  // Check whether the next packet we want is already at the head
-  // of the queue:
-  // ASSERT: fHeadPacket->rtpSeqNo() >= fNextExpectedSeqNo
-  if (fHeadPacket->rtpSeqNo() == fNextExpectedSeqNo) {
-    packetLossPreceded = fHeadPacket->isFirstPacket();
+  // Check whether the next packet we want has already arrived:
+  BufferedPacket* nextPacket = slot(fNextExpectedSeqNo);
+  if (nextPacket != NULL) {
+    packetLossPreceded = nextPacket->isFirstPacket();
         // (The very first packet is treated as if there was packet loss beforehand.)
-    return fHeadPacket;
+    return nextPacket;
   }
 
   // We're still waiting for our desired packet to arrive.  However, if
   // our time threshold has been exceeded, then forget it, and return
-  // the head packet instead:
+  // the earliest packet that we do have instead:
+  BufferedPacket* headPacket = firstStoredPacket();
   struct timeval timeNow;
   gettimeofday(&timeNow, NULL);
   unsigned uSecondsSinceReceived
-    = (timeNow.tv_sec - fHeadPacket->timeReceived().tv_sec)*1000000
-    + (timeNow.tv_usec - fHeadPacket->timeReceived().tv_usec);
+    = (timeNow.tv_sec - headPacket->timeReceived().tv_sec)*1000000
+    + (timeNow.tv_usec - headPacket->timeReceived().tv_usec);
   if (uSecondsSinceReceived > fThresholdTime) {
-    fNextExpectedSeqNo = fHeadPacket->rtpSeqNo();
+    fNextExpectedSeqNo = headPacket->rtpSeqNo();
         // we've given up on earlier packets now
     packetLossPreceded = True;
-    return fHeadPacket;
+    return headPacket;
   }
 
   // Otherwise, keep waiting for our desired packet to arrive:
   return NULL;
 }
+
+
+////////// NACKGapList implementation //////////
+
+NACKGapList::NACKGapList(unsigned reorderWindow)
+  : fReorderWindow(reorderWindow), fFirstGap(0), fNumGaps(0) {
+  for (unsigned i = 0; i < REORDERING_RING_SIZE; ++i) fMissing[i] = False;
+}
+
+void NACKGapList::addGap(unsigned short firstSeqNo, unsigned numSeqNos,
+			 struct timeval const& timeNow) {
+  for (unsigned i = 0; i < numSeqNos; ++i) {
+    missing((unsigned short)(firstSeqNo+i)) = True;
+  }
+  unsigned gap = (fFirstGap+fNumGaps)%MAX_PENDING_GAPS;
+  fGaps[gap].nextSeqNo = firstSeqNo;
+  fGaps[gap].numLeft = numSeqNos;
+  fGaps[gap].timeNoticed = timeNow;
+  ++fNumGaps;
+}
+
+void NACKGapList::makeOldestDue() {
+  if (fNumGaps == 0) return;
+  fGaps[fFirstGap].timeNoticed.tv_sec = 0;
+  fGaps[fFirstGap].timeNoticed.tv_usec = 0;
+}
+
+unsigned NACKGapList
+::uSecondsSinceNoticed(unsigned gap, struct timeval const& timeNow) const {
+  struct timeval const& timeNoticed = fGaps[gap].timeNoticed;
+  if (timeNoticed.tv_sec == 0) return fReorderWindow; // made due
+  return (timeNow.tv_sec - timeNoticed.tv_sec)*1000000
+    + (timeNow.tv_usec - timeNoticed.tv_usec);
+}
+
+Boolean NACKGapList::getDueRun(struct timeval const& timeNow,
+			       unsigned short& firstSeqNo,
+			       unsigned& numSeqNos) {
+  while (fNumGaps > 0
+	 && uSecondsSinceNoticed(fFirstGap, timeNow) >= fReorderWindow) {
+    // Skip the packets of this gap that have arrived since:
+    unsigned short& nextSeqNo = fGaps[fFirstGap].nextSeqNo;
+    unsigned& numLeft = fGaps[fFirstGap].numLeft;
+    while (numLeft > 0 && !missing(nextSeqNo)) {
+      ++nextSeqNo; --numLeft;
+    }
+
+    // and take the ones that are still missing after them:
+    firstSeqNo = nextSeqNo;
+    numSeqNos = 0;
+    while (numLeft > 0 && missing(nextSeqNo)) {
+      missing(nextSeqNo) = False;
+      ++nextSeqNo; --numLeft; ++numSeqNos;
+    }
+
+    if (numLeft == 0) {
+      fFirstGap = (fFirstGap+1)%MAX_PENDING_GAPS;
+      --fNumGaps;
+    }
+    if (numSeqNos > 0) return True;
+  }
+
+  return False;
+}
+
+Boolean NACKGapList::getTimeUntilDue(struct timeval const& timeNow,
+				     unsigned& uSeconds) const {
+  if (fNumGaps == 0) return False;
+
+  unsigned uSecondsSince = uSecondsSinceNoticed(fFirstGap, timeNow);
+  uSeconds = uSecondsSince >= fReorderWindow ? 0 : fReorderWindow - uSecondsSince;
+  return True;
+}
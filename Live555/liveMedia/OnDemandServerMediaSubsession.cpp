@@ -22,9 +22,16 @@ along with this library; if not, write to the Free Software Foundation, Inc.,
 #include "OnDemandServerMediaSubsession.hh"
 #include "RTCP.hh"
 #include "BasicUDPSink.hh"
+#include "FanOutRTPSink.hh"
 #include "GroupsockHelper.hh"
+#include "MetricsRegistry.hh"
 #include "LogMacros.hh"
 
+static MetricsCounter pipelineStarts("pipeline_starts_total",
+				     "Fan-out sources (and packetizers) started, by a first PLAY");
+static MetricsCounter pipelineStops("pipeline_stops_total",
+				    "Fan-out sources (and packetizers) released, when no one was left");
+
 class Destinations {
 public:
   Destinations(struct in_addr const& destAddr,
@@ -49,9 +56,14 @@ public:
 OnDemandServerMediaSubsession
 ::OnDemandServerMediaSubsession(UsageEnvironment& env,
 				Boolean reuseFirstSource,
-				portNumBits initialPortNum)
+				portNumBits initialPortNum,
+				Boolean fanOutFirstSource)
   : ServerMediaSubsession(env),
     fReuseFirstSource(reuseFirstSource), fInitialPortNum(initialPortNum),
+    fFanOutFirstSource(fanOutFirstSource && !reuseFirstSource),
+    fFanOutSource(NULL), fFanOutPacketizer(NULL), fFanOutGroupsock(NULL),
+    fFanOutBitrate(500), fNumFanOutStreams(0),
+    fIdleGracePeriod(0), fIdleTask(NULL),
     fLastStreamToken(NULL), fSDPLines(NULL) {
   fDestinationsHashTable = HashTable::create(ONE_WORD_HASH_KEYS);
   gethostname(fCNAME, sizeof fCNAME);
@@ -62,6 +74,7 @@ OnDemandServerMediaSubsession
 OnDemandServerMediaSubsession::~OnDemandServerMediaSubsession() {
   DEBUG_LOG(INF, "Deconstruct OnDemandServerMediaSubsession");
   delete[] fSDPLines;
+  closeFanOutPacketizer(); // in case it's draining
 
   // Clean out the destinations hash table:
   while (1) {
@@ -73,6 +86,10 @@ OnDemandServerMediaSubsession::~OnDemandServerMediaSubsession() {
   delete fDestinationsHashTable;
 }
 
+void OnDemandServerMediaSubsession::setIdleGracePeriod(unsigned seconds) {
+  fIdleGracePeriod = seconds;
+}
+
 //ServerMediaSession::generateSDPDescription()б(DESCRIBEʱʹ)
 //sdpline
 char const* OnDemandServerMediaSubsession::sdpLines() {
@@ -124,11 +141,17 @@ public:
   Port const& serverRTCPPort() const { return fServerRTCPPort; }
 
   RTPSink* rtpSink() const { return fRTPSink; }
+  RTCPInstance* rtcpInstance() const { return fRTCPInstance; }
 
   float streamDuration() const { return fStreamDuration; }
 
   FramedSource* mediaSource() const { return fMediaSource; }
 
+private:
+  Boolean isFannedOut() const {
+    return fMaster.fFanOutFirstSource && fRTPSink != NULL;
+  }
+
 private:
   OnDemandServerMediaSubsession& fMaster;
   Boolean fAreCurrentlyPlaying;
@@ -175,11 +198,20 @@ void OnDemandServerMediaSubsession::getStreamParameters(
     ++((StreamState*)fLastStreamToken)->referenceCount();
     streamToken = fLastStreamToken;
   } else {
-    // Normal case: Create a new media source:
-    DEBUG_LOG(INF, "Create a new media source");
     unsigned streamBitrate;
-    FramedSource* mediaSource
-      = createNewStreamSource(clientSessionId, streamBitrate);
+    FramedSource* mediaSource = NULL;
+    MultiFramedRTPSink* packetizer = NULL;
+    if (fFanOutFirstSource && clientRTCPPort.num() != 0) {
+      // Fan-out case: The stream gets no source of its own; its packets
+      // come from the shared packetizer:
+      DEBUG_LOG(INF, "Fan out the first source");
+      packetizer = getFanOutPacketizer();
+      streamBitrate = fFanOutBitrate;
+    } else {
+      // Normal case: Create a new media source:
+      DEBUG_LOG(INF, "Create a new media source");
+      mediaSource = createNewStreamSource(clientSessionId, streamBitrate);
+    }
 
     // Create 'groupsock' and 'sink' objects for the destination,
     // using previously unused server port numbers:
@@ -227,8 +259,14 @@ void OnDemandServerMediaSubsession::getStreamParameters(
 	break; // success
       }
 
-      unsigned char rtpPayloadType = 96 + trackNumber()-1; // if dynamic
-      rtpSink = createNewRTPSink(rtpGroupsock, rtpPayloadType, mediaSource);
+      if (fFanOutFirstSource) {
+	rtpSink = packetizer == NULL ? NULL
+	  : FanOutRTPSink::createNew(envir(), rtpGroupsock, *packetizer);
+	if (rtpSink != NULL) ++fNumFanOutStreams;
+      } else {
+	unsigned char rtpPayloadType = 96 + trackNumber()-1; // if dynamic
+	rtpSink = createNewRTPSink(rtpGroupsock, rtpPayloadType, mediaSource);
+      }
       udpSink = NULL;
     }
 
@@ -353,6 +391,23 @@ void OnDemandServerMediaSubsession::deleteStream(unsigned clientSessionId,
   delete destinations;
 }
 
+void OnDemandServerMediaSubsession
+::getRTPSinkandRTCP(void* streamToken,
+		    RTPSink*& rtpSink, RTCPInstance*& rtcp) {
+  StreamState* streamState = (StreamState*)streamToken;
+  rtpSink = streamState == NULL ? NULL : streamState->rtpSink();
+  rtcp = streamState == NULL ? NULL : streamState->rtcpInstance();
+}
+
+ServerMediaSubsession::PipelineState
+OnDemandServerMediaSubsession::pipelineState() const {
+  if (!fFanOutFirstSource) return PIPELINE_NONE;
+
+  if (fFanOutPacketizer == NULL) return PIPELINE_IDLE;
+  if (fNumFanOutStreams == 0) return PIPELINE_DRAINING;
+  return fFanOutPacketizer->source() == NULL ? PIPELINE_READY : PIPELINE_RUNNING;
+}
+
 char const* OnDemandServerMediaSubsession
 ::getAuxSDPLine(RTPSink* rtpSink, FramedSource* /*inputSource*/) {
   // Default implementation:
@@ -373,6 +428,12 @@ void OnDemandServerMediaSubsession::closeStreamSource(FramedSource *inputSource)
   Medium::close(inputSource);
 }
 
+void OnDemandServerMediaSubsession
+::fanOutSourceCreated(FramedSource* /*inputSource*/,
+		      MultiFramedRTPSink& /*packetizer*/) {
+  // Default implementation: do nothing
+}
+
 void OnDemandServerMediaSubsession
 ::setSDPLinesFromRTPSink(RTPSink* rtpSink, FramedSource* inputSource,
 			 unsigned estBitrate) {
@@ -421,6 +482,95 @@ void OnDemandServerMediaSubsession
   delete[] sdpLines;
 }
 
+MultiFramedRTPSink* OnDemandServerMediaSubsession
+::getFanOutPacketizer() {
+  if (fFanOutPacketizer != NULL) {
+    // (If it was draining, it's wanted again:)
+    envir().taskScheduler().unscheduleDelayedTask(fIdleTask);
+    return fFanOutPacketizer;
+  }
+
+  // The packetizer's own packets go nowhere; only its fan-out sinks' do:
+  struct in_addr dummyAddr; dummyAddr.s_addr = 0;
+  fFanOutGroupsock = new Groupsock(envir(), dummyAddr, 0, 255);
+  fFanOutGroupsock->removeAllDestinations();
+
+  // Its source isn't created until the first "PLAY" (in
+  // "startFanOutPacketizer()"), so that a stream that's only been set up
+  // costs nothing:
+  unsigned char rtpPayloadType = 96 + trackNumber()-1; // if dynamic
+  fFanOutPacketizer = (MultiFramedRTPSink*)
+    createNewRTPSink(fFanOutGroupsock, rtpPayloadType, NULL);
+  if (fFanOutPacketizer == NULL) {
+    closeFanOutPacketizer();
+    return NULL;
+  }
+  // (Its FEC packets would be sent nowhere; the fan-out sinks send none:)
+  fFanOutPacketizer->enableFEC(0, 0);
+
+  DEBUG_LOG(INF, "Created fan-out packetizer %s", fFanOutPacketizer->name());
+  return fFanOutPacketizer;
+}
+
+void OnDemandServerMediaSubsession::startFanOutPacketizer() {
+  if (fFanOutPacketizer == NULL || fFanOutPacketizer->source() != NULL) return;
+
+  if (fFanOutSource == NULL) {
+    // (It's shared, so isn't for any one client session:)
+    fFanOutSource = createNewStreamSource(0, fFanOutBitrate);
+    if (fFanOutSource == NULL) {
+      DEBUG_LOG(ERR, "Can't create the source of fan-out packetizer %s",
+	fFanOutPacketizer->name());
+      return; // (the next "PLAY" tries again)
+    }
+    fanOutSourceCreated(fFanOutSource, *fFanOutPacketizer);
+  }
+
+  // It plays until its last fan-out stream is reclaimed (and its grace
+  // period is up), whether or not anyone is currently watching:
+  DEBUG_LOG(INF, "Start fan-out packetizer %s", fFanOutPacketizer->name());
+  fFanOutPacketizer->startPlaying(*fFanOutSource, NULL, NULL);
+  pipelineStarts.increment();
+}
+
+void OnDemandServerMediaSubsession::releaseFanOutPacketizer() {
+  if (fNumFanOutStreams > 0 && --fNumFanOutStreams > 0) return;
+
+  if (fIdleGracePeriod > 0 && fFanOutPacketizer != NULL) {
+    // Keep it running - and its GOP cache current - for a while, in case
+    // someone else wants it:
+    DEBUG_LOG(INF, "Fan-out packetizer unused; release it in %u seconds",
+      fIdleGracePeriod);
+    envir().taskScheduler().rescheduleDelayedTask(fIdleTask,
+	(int64_t)fIdleGracePeriod*1000000, idleTimeout, this);
+    return;
+  }
+  closeFanOutPacketizer();
+}
+
+void OnDemandServerMediaSubsession::idleTimeout(void* clientData) {
+  OnDemandServerMediaSubsession* subsession
+    = (OnDemandServerMediaSubsession*)clientData;
+  subsession->fIdleTask = NULL;
+  subsession->closeFanOutPacketizer();
+}
+
+void OnDemandServerMediaSubsession::closeFanOutPacketizer() {
+  envir().taskScheduler().unscheduleDelayedTask(fIdleTask);
+  if (fFanOutPacketizer == NULL && fFanOutSource == NULL) return;
+
+  // Release the source (e.g. its camera and encoder) and packetizer (and
+  // its GOP cache), so that an unwatched stream costs nothing:
+  DEBUG_LOG(INF, "Close fan-out packetizer");
+  if (fFanOutPacketizer != NULL && fFanOutPacketizer->source() != NULL) {
+    pipelineStops.increment();
+  }
+  Medium::close(fFanOutPacketizer); fFanOutPacketizer = NULL;
+  if (fFanOutSource != NULL) closeStreamSource(fFanOutSource);
+  fFanOutSource = NULL;
+  delete fFanOutGroupsock; fFanOutGroupsock = NULL;
+}
+
 
 ////////// StreamState implementation //////////
 
@@ -467,6 +617,10 @@ void StreamState
       fUDPSink->startPlaying(*fMediaSource, afterPlayingStreamState, this);
       fAreCurrentlyPlaying = True;
     }
+  } else if (!fAreCurrentlyPlaying && isFannedOut()) {
+    fMaster.startFanOutPacketizer();
+    ((FanOutRTPSink*)fRTPSink)->startFanOut();
+    fAreCurrentlyPlaying = True;
   }
 
   if (fRTCPInstance == NULL && fRTPSink != NULL) {
@@ -535,8 +689,10 @@ void StreamState::reclaim() {
   DEBUG_LOG(INF, "StreamState::reclaim");
   // Delete allocated media objects
   Medium::close(fRTCPInstance) /* will send a RTCP BYE */; fRTCPInstance = NULL;
+  Boolean wasFannedOut = isFannedOut();
   Medium::close(fRTPSink); fRTPSink = NULL;
   Medium::close(fUDPSink); fUDPSink = NULL;
+  if (wasFannedOut) fMaster.releaseFanOutPacketizer();
 
   fMaster.closeStreamSource(fMediaSource); fMediaSource = NULL;
 
@@ -151,3 +151,10 @@ void PassiveServerMediaSubsession::startStream(unsigned /*clientSessionId*/,
 PassiveServerMediaSubsession::~PassiveServerMediaSubsession() {
   delete[] fSDPLines;
 }
+
+void PassiveServerMediaSubsession::getRTPSinkandRTCP(void* /*streamToken*/,
+						     RTPSink*& rtpSink,
+						     RTCPInstance*& rtcp) {
+  rtpSink = &fRTPSink;
+  rtcp = fRTCPInstance;
+}
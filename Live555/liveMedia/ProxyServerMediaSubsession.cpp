@@ -0,0 +1,521 @@
+/**********
+This library is free software; you can redistribute it and/or modify it under
+the terms of the GNU Lesser General Public License as published by the
+Free Software Foundation; either version 2.1 of the License, or (at your
+option) any later version. (See <http://www.gnu.org/copyleft/lesser.html>.)
+
+This library is distributed in the hope that it will be useful, but WITHOUT
+ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for
+more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with this library; if not, write to the Free Software Foundation, Inc.,
+51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA
+**********/
+// "liveMedia"
+// Copyright (c) 1996-2009 Live Networks, Inc.  All rights reserved.
+// 'ServerMediaSession' and 'ServerMediaSubsession' objects that re-serve - to
+// any number of our own clients - a stream pulled (once) from another RTSP server
+// Implementation
+
+#include "ProxyServerMediaSubsession.hh"
+#include "RelayRTPSink.hh"
+#include "BasicUDPSource.hh"
+#include "GroupsockHelper.hh"
+#include "LogMacros.hh"
+
+#define PROXY_RTP_HISTORY_SIZE 256 // packets kept for our clients' NACKs
+
+////////// ProxyServerMediaSession //////////
+
+ProxyServerMediaSession*
+ProxyServerMediaSession::createNew(UsageEnvironment& env,
+				   char const* streamName,
+				   char const* rtspURL,
+				   char const* username,
+				   char const* password,
+				   int verbosityLevel,
+				   char const* description) {
+  ProxyServerMediaSession* newSession
+    = new ProxyServerMediaSession(env, streamName, rtspURL,
+				  username, password, verbosityLevel,
+				  description);
+  // Describe it now, so that (if the upstream server answers) our first
+  // client needn't wait for it:
+  newSession->sendDescribe();
+  if (newSession->fState == UPSTREAM_IDLE) {
+    // The request couldn't even be sent (e.g. the URL is bad):
+    Medium::close(newSession);
+    return NULL;
+  }
+
+  return newSession;
+}
+
+ProxyServerMediaSession
+::ProxyServerMediaSession(UsageEnvironment& env, char const* streamName,
+			  char const* rtspURL,
+			  char const* username, char const* password,
+			  int verbosityLevel, char const* description)
+  : ServerMediaSession(env, streamName, streamName, description, False, NULL),
+    fURL(strDup(rtspURL)), fVerbosityLevel(verbosityLevel),
+    fSession(NULL), fClient(NULL), fTearingDownClient(NULL),
+    fState(UPSTREAM_IDLE), fNumResponsesAwaited(0), fTimeoutTask(NULL),
+    fNumStreamUsers(0), fReadyHandlers(NULL) {
+  if (username != NULL) {
+    fAuthenticator.setUsernameAndPassword(username,
+					  password == NULL ? "" : password);
+  }
+}
+
+ProxyServerMediaSession::~ProxyServerMediaSession() {
+  // Our subsessions read (and describe) the upstream ones, so go first:
+  deleteAllSubsessions();
+
+  envir().taskScheduler().unscheduleDelayedTask(fTimeoutTask);
+  closeClient();
+  Medium::close(fTearingDownClient);
+  while (fReadyHandlers != NULL) {
+    ReadyHandlerRecord* record = fReadyHandlers;
+    fReadyHandlers = record->next;
+    delete record;
+  }
+  Medium::close(fSession);
+
+  delete[] fURL;
+}
+
+Boolean ProxyServerMediaSession::isReady(readyHandler* handler,
+					 void* clientData) {
+  if (fSession != NULL) return True;
+
+  // Describe it (again, if that failed before), and answer once it has been:
+  if (fState == UPSTREAM_IDLE) sendDescribe();
+  if (fState == UPSTREAM_IDLE) return True; // (we couldn't even ask)
+
+  addReadyHandler(handler, clientData);
+  return False;
+}
+
+void ProxyServerMediaSession::cancelReadyHandler(void* clientData) {
+  ReadyHandlerRecord** ptr = &fReadyHandlers;
+  while (*ptr != NULL) {
+    if ((*ptr)->clientData == clientData) {
+      ReadyHandlerRecord* record = *ptr;
+      *ptr = record->next;
+      delete record;
+    } else {
+      ptr = &(*ptr)->next;
+    }
+  }
+}
+
+Boolean ProxyServerMediaSession::isStreaming(readyHandler* handler,
+					     void* clientData) {
+  if (fState == UPSTREAM_PLAYING) return True;
+
+  if (fState == UPSTREAM_IDLE) startStreaming();
+  if (fState == UPSTREAM_IDLE) return True; // (it failed at once)
+
+  addReadyHandler(handler, clientData);
+  return False;
+}
+
+void ProxyServerMediaSession::removeStreamUser() {
+  if (fNumStreamUsers > 0 && --fNumStreamUsers > 0) return;
+
+  if (fState == UPSTREAM_PLAYING) {
+    DEBUG_LOG(INF, "No more clients for \"%s\"; tearing it down", fURL);
+    stopStreaming();
+  }
+}
+
+RTSPClient* ProxyServerMediaSession::newClient() {
+  RTSPClient* client
+    = RTSPClient::createNew(envir(), fVerbosityLevel, "LiveVideoServer (proxy)");
+  if (client == NULL) {
+    DEBUG_LOG(ERR, "Failed to create a RTSP client for \"%s\": %s",
+	      fURL, envir().getResultMsg());
+  }
+  return client;
+}
+
+void ProxyServerMediaSession::sendDescribe() {
+  fClient = newClient();
+  if (fClient == NULL) return;
+
+  fState = UPSTREAM_DESCRIBING;
+  if (fClient->sendDescribeCommand(fURL, describeResponseHandler, this,
+				   &fAuthenticator) == 0) {
+    failRequest(-1, envir().getResultMsg());
+    return;
+  }
+  scheduleTimeout();
+}
+
+void ProxyServerMediaSession
+::describeResponseHandler(RTSPClient* /*client*/, void* clientData,
+			  int resultCode, char* resultString) {
+  ProxyServerMediaSession* session = (ProxyServerMediaSession*)clientData;
+  session->describeResponseHandler1(resultCode, resultString);
+  delete[] resultString;
+}
+
+void ProxyServerMediaSession::describeResponseHandler1(int resultCode,
+						       char* resultString) {
+  if (resultCode != 0) {
+    failRequest(resultCode, resultString);
+    return;
+  }
+  if (fState == UPSTREAM_SETTING_UP) {
+    // This "DESCRIBE" was only to give the client its base URL.  (We keep
+    // the description that we got first.)
+    sendSetups();
+    return;
+  }
+
+  fSession = MediaSession::createNew(envir(), resultString);
+  if (fSession == NULL) {
+    failRequest(-1, envir().getResultMsg());
+    return;
+  }
+
+  // We're done with the upstream server until our first client arrives:
+  envir().taskScheduler().unscheduleDelayedTask(fTimeoutTask);
+  closeClient();
+  fState = UPSTREAM_IDLE;
+
+  MediaSubsessionIterator iter(*fSession);
+  MediaSubsession* subsession;
+  unsigned numSubsessions = 0;
+  while ((subsession = iter.next()) != NULL) {
+    if (strcmp(subsession->protocolName(), "RTP") != 0) continue;
+
+    if (addSubsession(new ProxyServerMediaSubsession(envir(), *this,
+						     *subsession))) {
+      ++numSubsessions;
+    }
+  }
+  if (numSubsessions == 0) {
+    DEBUG_LOG(ERR, "\"%s\" has no RTP subsessions", fURL);
+  } else {
+    DEBUG_LOG(INF, "Described \"%s\" (%u subsessions)", fURL, numSubsessions);
+  }
+  callReadyHandlers();
+}
+
+void ProxyServerMediaSession::startStreaming() {
+  // This is a new connection (the last was closed after its "DESCRIBE", or
+  // "TEARDOWN"), so it needs a "DESCRIBE" again before the "SETUP"s:
+  fClient = newClient();
+  if (fClient == NULL) return;
+
+  fState = UPSTREAM_SETTING_UP;
+  if (fClient->sendDescribeCommand(fURL, describeResponseHandler, this,
+				   &fAuthenticator) == 0) {
+    failRequest(-1, envir().getResultMsg());
+    return;
+  }
+  scheduleTimeout();
+}
+
+void ProxyServerMediaSession::sendSetups() {
+  // (A server such as ours plays - and tears down - only the whole session,
+  // so all of the subsessions are set up, whichever our clients want:)
+  fNumResponsesAwaited = 0;
+  MediaSubsessionIterator iter(*fSession);
+  MediaSubsession* subsession;
+  while ((subsession = iter.next()) != NULL) {
+    if (strcmp(subsession->protocolName(), "RTP") != 0) continue;
+
+    if (!subsession->initiate()
+	|| fClient->sendSetupCommand(*subsession, setupResponseHandler, this) == 0) {
+      failRequest(-1, envir().getResultMsg());
+      return;
+    }
+    ++fNumResponsesAwaited;
+  }
+  scheduleTimeout();
+}
+
+void ProxyServerMediaSession
+::setupResponseHandler(RTSPClient* /*client*/, void* clientData,
+		       int resultCode, char* resultString) {
+  ProxyServerMediaSession* session = (ProxyServerMediaSession*)clientData;
+  session->setupResponseHandler1(resultCode, resultString);
+  delete[] resultString;
+}
+
+void ProxyServerMediaSession::setupResponseHandler1(int resultCode,
+						    char* resultString) {
+  if (resultCode != 0) {
+    failRequest(resultCode, resultString);
+    return;
+  }
+  if (fNumResponsesAwaited > 0 && --fNumResponsesAwaited > 0) return;
+
+  fState = UPSTREAM_STARTING;
+  if (fClient->sendPlayCommand(*fSession, playResponseHandler, this) == 0) {
+    failRequest(-1, envir().getResultMsg());
+    return;
+  }
+  scheduleTimeout();
+}
+
+void ProxyServerMediaSession
+::playResponseHandler(RTSPClient* /*client*/, void* clientData,
+		      int resultCode, char* resultString) {
+  ProxyServerMediaSession* session = (ProxyServerMediaSession*)clientData;
+  session->playResponseHandler1(resultCode, resultString);
+  delete[] resultString;
+}
+
+void ProxyServerMediaSession::playResponseHandler1(int resultCode,
+						   char* resultString) {
+  if (resultCode != 0) {
+    failRequest(resultCode, resultString);
+    return;
+  }
+
+  envir().taskScheduler().unscheduleDelayedTask(fTimeoutTask);
+  fState = UPSTREAM_PLAYING;
+  DEBUG_LOG(INF, "Started \"%s\"", fURL);
+  callReadyHandlers();
+
+  // If the "SETUP"s that we were waiting for have all since failed (or
+  // their clients have gone), there's no-one to play it to:
+  if (fNumStreamUsers == 0 && fState == UPSTREAM_PLAYING) stopStreaming();
+}
+
+void ProxyServerMediaSession::stopStreaming() {
+  Medium::close(fTearingDownClient); fTearingDownClient = NULL;
+  if (fClient->sendTeardownCommand(*fSession, teardownResponseHandler, this) != 0) {
+    // The client is closed once this has been answered:
+    fTearingDownClient = fClient;
+    fClient = NULL;
+  }
+  closeClient();
+  fState = UPSTREAM_IDLE;
+}
+
+void ProxyServerMediaSession
+::teardownResponseHandler(RTSPClient* client, void* clientData,
+			  int /*resultCode*/, char* resultString) {
+  ProxyServerMediaSession* session = (ProxyServerMediaSession*)clientData;
+  if (session->fTearingDownClient == client) session->fTearingDownClient = NULL;
+  Medium::close(client);
+  delete[] resultString;
+}
+
+void ProxyServerMediaSession::scheduleTimeout() {
+  envir().taskScheduler().rescheduleDelayedTask(fTimeoutTask,
+      (int64_t)PROXY_RTSP_TIMEOUT*1000000, timeoutHandler, this);
+}
+
+void ProxyServerMediaSession::timeoutHandler(void* clientData) {
+  ProxyServerMediaSession* session = (ProxyServerMediaSession*)clientData;
+  session->fTimeoutTask = NULL;
+  session->failRequest(-1, "No response in time");
+}
+
+void ProxyServerMediaSession::failRequest(int resultCode,
+					  char const* resultString) {
+  DEBUG_LOG(ERR, "Failed to %s \"%s\": %d %s",
+	    fState == UPSTREAM_DESCRIBING ? "describe" : "start", fURL,
+	    resultCode, resultString == NULL ? "" : resultString);
+  envir().taskScheduler().unscheduleDelayedTask(fTimeoutTask);
+  closeClient(); // (any requests still outstanding are dropped with it)
+  fState = UPSTREAM_IDLE;
+
+  // The "DESCRIBE"s (or "SETUP"s) that were waiting now fail; any later one
+  // tries again:
+  callReadyHandlers();
+}
+
+void ProxyServerMediaSession::closeClient() {
+  Medium::close(fClient); fClient = NULL;
+  if (fSession == NULL) return;
+
+  MediaSubsessionIterator iter(*fSession);
+  MediaSubsession* subsession;
+  while ((subsession = iter.next()) != NULL) {
+    subsession->deInitiate();
+    delete[] (char*)subsession->sessionId; subsession->sessionId = NULL;
+  }
+}
+
+void ProxyServerMediaSession::addReadyHandler(readyHandler* handler,
+					      void* clientData) {
+  ReadyHandlerRecord* record = new ReadyHandlerRecord;
+  record->handler = handler;
+  record->clientData = clientData;
+  record->next = fReadyHandlers;
+  fReadyHandlers = record;
+}
+
+void ProxyServerMediaSession::callReadyHandlers() {
+  // (A handler may add - or cancel - others, so take the list first:)
+  ReadyHandlerRecord* records = fReadyHandlers;
+  fReadyHandlers = NULL;
+  while (records != NULL) {
+    ReadyHandlerRecord* record = records;
+    records = record->next;
+    (*record->handler)(record->clientData);
+    delete record;
+  }
+}
+
+////////// ProxyServerMediaSubsession //////////
+
+ProxyServerMediaSubsession
+::ProxyServerMediaSubsession(UsageEnvironment& env,
+			     ProxyServerMediaSession& proxySession,
+			     MediaSubsession& upstream)
+  : OnDemandServerMediaSubsession(env, False, 6970, True /*fanOutFirstSource*/),
+    fProxySession(proxySession), fUpstream(upstream), fSource(NULL) {
+}
+
+ProxyServerMediaSubsession::~ProxyServerMediaSubsession() {
+}
+
+Boolean ProxyServerMediaSubsession::isReady(readyHandler* handler,
+					    void* clientData) {
+  return fProxySession.isStreaming(handler, clientData);
+}
+
+void ProxyServerMediaSubsession::cancelReadyHandler(void* clientData) {
+  fProxySession.cancelReadyHandler(clientData);
+}
+
+// Whether "sdpLine" is a "a=rtpmap:", "a=fmtp:" or "a=rtcp-fb:" line for
+// some payload type other than "payloadType":
+static Boolean isForAnotherPayloadType(char const* sdpLine,
+				       unsigned char payloadType) {
+  char const* const prefixes[] = { "a=rtpmap:", "a=fmtp:", "a=rtcp-fb:" };
+  for (unsigned i = 0; i < sizeof prefixes/sizeof prefixes[0]; ++i) {
+    unsigned prefixLen = strlen(prefixes[i]);
+    if (strncmp(sdpLine, prefixes[i], prefixLen) != 0) continue;
+
+    unsigned lineType;
+    return sscanf(&sdpLine[prefixLen], "%u", &lineType) == 1
+      && lineType != payloadType;
+  }
+
+  return False;
+}
+
+char const* ProxyServerMediaSubsession::sdpLines() {
+  if (fSDPLines == NULL) {
+    // The upstream subsession's lines, but with our own "m=", "c=", "b=",
+    // "a=range:" and "a=control:" lines, and none for the payload types
+    // ("rtx", FEC) that we don't relay:
+    char const* upstreamLines = fUpstream.savedSDPLines();
+    unsigned char rtpPayloadType = fUpstream.rtpPayloadFormat();
+    unsigned estBitrate = fUpstream.bandwidth() > 0 ? fUpstream.bandwidth() : 500;
+    struct in_addr serverAddrForSDP; serverAddrForSDP.s_addr = fServerAddressForSDP;
+    char* const ipAddressStr = strDup(our_inet_ntoa(serverAddrForSDP));
+    char const* rangeLine = rangeSDPLine();
+
+    unsigned sdpLinesSize = 2*strlen(upstreamLines) /* allows for "\r\n"s */
+      + 100 + strlen(fUpstream.mediumName()) + strlen(ipAddressStr)
+      + strlen(rangeLine) + strlen(trackId());
+    char* sdpLines = new char[sdpLinesSize];
+    char* ptr = sdpLines;
+    ptr += sprintf(ptr, "m=%s %u %s %d\r\nc=IN IP4 %s\r\nb=AS:%u\r\n",
+		   fUpstream.mediumName(), fPortNumForSDP,
+		   fUpstream.nackIsSupported() ? "RTP/AVPF" : "RTP/AVP",
+		       // its "a=rtcp-fb:" line is kept
+		   rtpPayloadType, ipAddressStr, estBitrate);
+
+    char const* line = upstreamLines;
+    while (*line != '\0') {
+      unsigned lineLen = strcspn(line, "\r\n");
+      if (lineLen > 0
+	  && strncmp(line, "m=", 2) != 0 && strncmp(line, "c=", 2) != 0
+	  && strncmp(line, "b=", 2) != 0
+	  && strncmp(line, "a=range:", 8) != 0
+	  && strncmp(line, "a=control:", 10) != 0
+	  && !isForAnotherPayloadType(line, rtpPayloadType)) {
+	memcpy(ptr, line, lineLen); ptr += lineLen;
+	*ptr++ = '\r'; *ptr++ = '\n';
+      }
+      line += lineLen;
+      line += strspn(line, "\r\n");
+    }
+    sprintf(ptr, "%sa=control:%s\r\n", rangeLine, trackId());
+    delete[] (char*)rangeLine; delete[] ipAddressStr;
+
+    fSDPLines = strDup(sdpLines);
+    DEBUG_LOG(INF, "fSDPLines: %s", fSDPLines);
+    delete[] sdpLines;
+  }
+
+  return fSDPLines;
+}
+
+void ProxyServerMediaSubsession
+::getStreamParameters(unsigned clientSessionId,
+		      netAddressBits clientAddress,
+		      Port const& clientRTPPort,
+		      Port const& clientRTCPPort,
+		      int tcpSocketNum,
+		      unsigned char rtpChannelId,
+		      unsigned char rtcpChannelId,
+		      netAddressBits& destinationAddress,
+		      u_int8_t& destinationTTL,
+		      Boolean& isMulticast,
+		      Port& serverRTPPort,
+		      Port& serverRTCPPort,
+		      void*& streamToken) {
+  OnDemandServerMediaSubsession
+    ::getStreamParameters(clientSessionId, clientAddress,
+			  clientRTPPort, clientRTCPPort,
+			  tcpSocketNum, rtpChannelId, rtcpChannelId,
+			  destinationAddress, destinationTTL, isMulticast,
+			  serverRTPPort, serverRTCPPort, streamToken);
+  // Each of our streams (as well as our source) keeps the upstream session
+  // going, until it's deleted:
+  if (streamToken != NULL) fProxySession.addStreamUser();
+}
+
+void ProxyServerMediaSubsession::deleteStream(unsigned clientSessionId,
+					      void*& streamToken) {
+  Boolean wasStream = streamToken != NULL;
+  OnDemandServerMediaSubsession::deleteStream(clientSessionId, streamToken);
+  if (wasStream) fProxySession.removeStreamUser();
+}
+
+FramedSource* ProxyServerMediaSubsession
+::createNewStreamSource(unsigned /*clientSessionId*/, unsigned& estBitrate) {
+  estBitrate = fUpstream.bandwidth() > 0 ? fUpstream.bandwidth() : 500; // kbps
+  // There's only the one socket to read from, which our fan-out shares
+  // (so a raw-UDP client, which would need a source of its own, gets none):
+  if (fSource != NULL) return NULL;
+
+  // The upstream session was started by our "isReady()" (unless that failed):
+  if (fUpstream.sessionId == NULL || fUpstream.rtpSource() == NULL) return NULL;
+
+  // We read the packets ourself - rather than through the upstream
+  // "RTPSource", which would depacketize them:
+  fSource = BasicUDPSource::createNew(envir(), fUpstream.rtpSource()->RTPgs());
+  if (fSource != NULL) fProxySession.addStreamUser();
+  return fSource;
+}
+
+RTPSink* ProxyServerMediaSubsession
+::createNewRTPSink(Groupsock* rtpGroupsock,
+		   unsigned char /*rtpPayloadTypeIfDynamic*/,
+		   FramedSource* /*inputSource*/) {
+  RelayRTPSink* sink = RelayRTPSink::createNew(envir(), rtpGroupsock, fUpstream);
+  if (sink != NULL) sink->enableRetransmission(PROXY_RTP_HISTORY_SIZE);
+  return sink;
+}
+
+void ProxyServerMediaSubsession::closeStreamSource(FramedSource* inputSource) {
+  Medium::close(inputSource);
+  if (inputSource != NULL && inputSource == fSource) {
+    fSource = NULL;
+    fProxySession.removeStreamUser();
+  }
+}
@@ -380,10 +380,12 @@ void RTCPInstance::incomingReportHandler1() {
     // Check the RTCP packet for validity:
     // It must at least contain a header (4 bytes), and this header
     // must be version=2, with no padding bit, and a payload type of
-    // SR (200) or RR (201):
+    // SR (200) or RR (201), or RTPFB (205) for a 'reduced size' feedback
+    // packet (RFC 5506):
     if (packetSize < 4) break;
     unsigned rtcpHdr = ntohl(*(unsigned*)pkt);
-    if ((rtcpHdr & 0xE0FE0000) != (0x80000000 | (RTCP_PT_SR<<16))) {
+    if ((rtcpHdr & 0xE0FE0000) != (0x80000000 | (RTCP_PT_SR<<16))
+        && (rtcpHdr & 0xE0FF0000) != (0x80000000 | (RTCP_PT_RTPFB<<16))) {
 #ifdef DEBUG
       fprintf(stderr, "rejected bad RTCP packet: header 0x%08x\n", rtcpHdr);
 #endif
@@ -517,6 +519,29 @@ void RTCPInstance::incomingReportHandler1() {
       subPacketOK = True;
       typeOfPacket = PACKET_BYE;
       break;
+    }
+        case RTCP_PT_RTPFB: { // transport layer feedback
+      DEBUG_LOG(INF, "RTCP_PT_RTPFB(%d)", rc);
+      if (length < 4) break;
+      length -= 4;
+      unsigned mediaSSRC = ntohl(*(unsigned*)pkt); ADVANCE(4);
+
+      if (rc == RTCP_FMT_NACK && fSink != NULL && mediaSSRC == fSink->SSRC()) {
+        // Each FCI entry is a lost packet's seq no ("PID"), and a bitmask of
+        // which of the 16 packets after it were lost too ("BLP"):
+        while (length >= 4) {
+          unsigned fci = ntohl(*(unsigned*)pkt); ADVANCE(4); length -= 4;
+          u_int16_t pid = (u_int16_t)(fci>>16);
+          fSink->retransmitPacket(pid);
+          for (unsigned i = 0; i < 16; ++i) {
+            if (fci&(1<<i)) fSink->retransmitPacket((u_int16_t)(pid+i+1));
+          }
+        }
+      }
+      // Other feedback messages are ignored, along with any remaining bytes
+
+      subPacketOK = True;
+      break;
     }
     // Later handle SDES, APP, and compound RTCP packets #####
         default:
@@ -628,6 +653,26 @@ void RTCPInstance::sendBYE() {
   sendBuiltPacket();
 }
 
+// A NACK asks for at most this many packets (16 FCI entries):
+#define MAX_NACK_SEQ_NOS (16*17)
+
+unsigned RTCPInstance::sendNACK(u_int32_t mediaSSRC, u_int16_t firstSeqNo,
+				unsigned numSeqNos) {
+  if (fSource == NULL || numSeqNos == 0) return 0;
+  if (numSeqNos > MAX_NACK_SEQ_NOS) numSeqNos = MAX_NACK_SEQ_NOS;
+
+  // The packet must begin with a RR.  Leave out the report blocks, so that
+  // the next regular report still covers its whole interval:
+  fOutBuf->enqueueWord(0x80000000 | (RTCP_PT_RR<<16) | 1);
+  fOutBuf->enqueueWord(fSource->SSRC());
+
+  addSDES();
+  addNACK(mediaSSRC, firstSeqNo, numSeqNos);
+  sendBuiltPacket();
+
+  return numSeqNos;
+}
+
 void RTCPInstance::sendBuiltPacket() {
 #ifdef DEBUG
   fprintf(stderr, "sending RTCP packet\n");
@@ -849,6 +894,30 @@ void RTCPInstance::addSDES() {
   while (numPaddingBytesNeeded-- > 0) fOutBuf->enqueue(&zero, 1);
 }
 
+void RTCPInstance::addNACK(u_int32_t mediaSSRC, u_int16_t firstSeqNo,
+			   unsigned numSeqNos) {
+  // ASSERT: fSource != NULL
+  unsigned numFCIs = (numSeqNos + 16)/17;
+
+  unsigned rtcpHdr = 0x80000000; // version 2, no padding
+  rtcpHdr |= (RTCP_FMT_NACK<<24);
+  rtcpHdr |= (RTCP_PT_RTPFB<<16);
+  rtcpHdr |= 2 + numFCIs; // the two SSRCs, then the FCI entries
+  fOutBuf->enqueueWord(rtcpHdr);
+
+  fOutBuf->enqueueWord(fSource->SSRC());
+  fOutBuf->enqueueWord(mediaSSRC);
+
+  for (unsigned i = 0; i < numSeqNos; ) {
+    u_int16_t pid = (u_int16_t)(firstSeqNo + i++);
+    unsigned blp = 0;
+    for (unsigned bit = 0; bit < 16 && i < numSeqNos; ++bit, ++i) {
+      blp |= 1<<bit;
+    }
+    fOutBuf->enqueueWord((pid<<16) | blp);
+  }
+}
+
 void RTCPInstance::addBYE() {
   unsigned rtcpHdr = 0x81000000; // version 2, no padding, 1 SSRC
   rtcpHdr |= (RTCP_PT_BYE<<16);
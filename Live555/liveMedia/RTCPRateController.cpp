@@ -0,0 +1,167 @@
+/**********
+This library is free software; you can redistribute it and/or modify it under
+the terms of the GNU Lesser General Public License as published by the
+Free Software Foundation; either version 2.1 of the License, or (at your
+option) any later version. (See <http://www.gnu.org/copyleft/lesser.html>.)
+
+This library is distributed in the hope that it will be useful, but WITHOUT
+ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for
+more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with this library; if not, write to the Free Software Foundation, Inc.,
+51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA
+**********/
+// "liveMedia"
+// Copyright (c) 1996-2009 Live Networks, Inc.  All rights reserved.
+// A congestion controller that picks a stream's encoder bitrate from the
+// RTCP receiver reports of all of its viewers
+// Implementation
+
+#include "RTCPRateController.hh"
+#include "FanOutRTPSink.hh"
+#include "GroupsockHelper.hh" // gettimeofday
+#include "LogMacros.hh"
+
+// How often the sink's reception reports are looked at.  RRs themselves
+// arrive every few seconds, a decision is only made once a new one is in.
+#define CHECK_INTERVAL_US 500000
+
+// Loss-based rule, as in Google Congestion Control: back off in proportion
+// to the loss above 10%, hold between 2% and 10%, probe upwards below 2%
+#define LOSS_HIGH 0.10
+#define LOSS_LOW 0.02
+#define INCREASE_FACTOR 1.08
+
+// Delay-based rule: a round trip this far above the lowest one seen means
+// a queue is building up somewhere, before it overflows into loss
+#define RTT_RISE_MS 150
+#define DELAY_DECREASE_FACTOR 0.85
+
+RTCPRateController*
+RTCPRateController::createNew(UsageEnvironment& env, MultiFramedRTPSink& sink,
+			      unsigned startKbps,
+			      unsigned minKbps, unsigned maxKbps,
+			      RateChangeFunc* rateChangeFunc,
+			      void* clientData) {
+  return new RTCPRateController(env, sink, startKbps, minKbps, maxKbps,
+				rateChangeFunc, clientData);
+}
+
+RTCPRateController
+::RTCPRateController(UsageEnvironment& env, MultiFramedRTPSink& sink,
+		     unsigned startKbps, unsigned minKbps, unsigned maxKbps,
+		     RateChangeFunc* rateChangeFunc, void* clientData)
+  : Medium(env), fSinkName(strDup(sink.name())),
+    fMinKbps(minKbps), fMaxKbps(maxKbps < minKbps ? minKbps : maxKbps),
+    fRateChangeFunc(rateChangeFunc), fClientData(clientData),
+    fTargetKbps(startKbps), fNumReceivers(0), fLossFraction(0.0),
+    fJitterMs(0), fRTTMs(0), fMinRTTMs(0),
+    fNumIncreases(0), fNumDecreases(0), fNumHolds(0) {
+  if (fTargetKbps < fMinKbps) fTargetKbps = fMinKbps;
+  if (fTargetKbps > fMaxKbps) fTargetKbps = fMaxKbps;
+
+  gettimeofday(&fLastDecisionTime, NULL);
+  fCheckTask = envir().taskScheduler().scheduleDelayedTask(CHECK_INTERVAL_US,
+			(TaskFunc*)checkReports, this);
+}
+
+RTCPRateController::~RTCPRateController() {
+  envir().taskScheduler().unscheduleDelayedTask(fCheckTask);
+  delete[] fSinkName;
+}
+
+void RTCPRateController::checkReports(void* clientData) {
+  RTCPRateController* controller = (RTCPRateController*)clientData;
+  controller->checkReports1();
+}
+
+void RTCPRateController::checkReports1() {
+  fCheckTask = NULL;
+
+  RTPSink* sink;
+  if (!RTPSink::lookupByName(envir(), fSinkName, sink)) {
+    // The sink has been closed; there is nothing left to control
+    return;
+  }
+
+  // Combine the reports that came in since the last decision.  The encoder
+  // is shared by every viewer, so it has to fit the worst of them.
+  unsigned numReceivers = 0;
+  unsigned char worstLoss = 0;
+  unsigned worstJitter = 0, worstRTT = 0;
+  // (If the sink fans its packets out, its viewers report to those sinks:)
+  FanOutRTPSink* fanOutSink = ((MultiFramedRTPSink*)sink)->fanOutSinks();
+  for (RTPSink* reportedSink = sink; reportedSink != NULL;
+       reportedSink = fanOutSink,
+	 fanOutSink = fanOutSink == NULL ? NULL : fanOutSink->nextFanOutSink()) {
+    RTPTransmissionStatsDB::Iterator iter(reportedSink->transmissionStatsDB());
+    RTPTransmissionStats* stats;
+    while ((stats = iter.next()) != NULL) {
+      struct timeval timeReceived = stats->lastTimeReceived();
+      if (timeReceived.tv_sec < fLastDecisionTime.tv_sec
+	  || (timeReceived.tv_sec == fLastDecisionTime.tv_sec
+	      && timeReceived.tv_usec <= fLastDecisionTime.tv_usec)) {
+	continue; // nothing new from this viewer
+      }
+
+      ++numReceivers;
+      if (stats->packetLossRatio() > worstLoss) worstLoss = stats->packetLossRatio();
+      if (stats->jitter() > worstJitter) worstJitter = stats->jitter();
+      unsigned rtt = stats->roundTripDelay(); // 1/65536 seconds; 0 if unknown
+      if (rtt > worstRTT) worstRTT = rtt;
+    }
+  }
+
+  if (numReceivers > 0) {
+    fNumReceivers = numReceivers;
+    fLossFraction = worstLoss/256.0;
+    fJitterMs = sink->rtpTimestampFrequency() == 0 ? 0
+      : (unsigned)((worstJitter*1000.0)/sink->rtpTimestampFrequency());
+    fRTTMs = (unsigned)((worstRTT*1000.0)/65536);
+    if (fRTTMs > 0 && (fMinRTTMs == 0 || fRTTMs < fMinRTTMs)) fMinRTTMs = fRTTMs;
+
+    gettimeofday(&fLastDecisionTime, NULL);
+    decide();
+  }
+
+  fCheckTask = envir().taskScheduler().scheduleDelayedTask(CHECK_INTERVAL_US,
+			(TaskFunc*)checkReports, this);
+}
+
+void RTCPRateController::decide() {
+  unsigned oldKbps = fTargetKbps;
+  double newKbps = oldKbps;
+  char const* reason;
+
+  if (fLossFraction > LOSS_HIGH) {
+    newKbps = oldKbps*(1 - 0.5*fLossFraction);
+    reason = "loss";
+  } else if (fMinRTTMs > 0 && fRTTMs > fMinRTTMs + RTT_RISE_MS) {
+    newKbps = oldKbps*DELAY_DECREASE_FACTOR;
+    reason = "delay";
+  } else if (fLossFraction < LOSS_LOW) {
+    newKbps = oldKbps*INCREASE_FACTOR;
+    if (newKbps < oldKbps + 1) newKbps = oldKbps + 1;
+    reason = "probe";
+  } else {
+    reason = "hold";
+  }
+
+  if (newKbps < fMinKbps) newKbps = fMinKbps;
+  if (newKbps > fMaxKbps) newKbps = fMaxKbps;
+  fTargetKbps = (unsigned)newKbps;
+
+  if (fTargetKbps > oldKbps) ++fNumIncreases;
+  else if (fTargetKbps < oldKbps) ++fNumDecreases;
+  else ++fNumHolds;
+
+  DEBUG_LOG(INF, "RTCPRateController(%s): %u receivers, loss %.1f%%, jitter %u ms, rtt %u ms (min %u): %s, %u -> %u kbps",
+	    fSinkName, fNumReceivers, fLossFraction*100, fJitterMs, fRTTMs,
+	    fMinRTTMs, reason, oldKbps, fTargetKbps);
+
+  if (fTargetKbps != oldKbps && fRateChangeFunc != NULL) {
+    (*fRateChangeFunc)(fClientData, fTargetKbps);
+  }
+}
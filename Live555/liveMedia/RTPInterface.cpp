@@ -21,6 +21,7 @@ along with this library; if not, write to the Free Software Foundation, Inc.,
 // Implementation
 
 #include "RTPInterface.hh"
+#include "MetricsRegistry.hh"
 #include <GroupsockHelper.hh>
 #include <stdio.h>
 
@@ -29,7 +30,8 @@ along with this library; if not, write to the Free Software Foundation, Inc.,
 // Helper routines and data structures, used to implement
 // sending/receiving RTP/RTCP over a TCP socket:
 
-static void sendRTPOverTCP(unsigned char* packet, unsigned packetSize,
+static void sendRTPOverTCP(unsigned char* header, unsigned headerSize,
+			   unsigned char* packet, unsigned packetSize,
 			   int socketNum, unsigned char streamChannelId);
 
 // Reading RTP-over-TCP is implemented using two levels of hash tables.
@@ -56,13 +58,20 @@ public:
   RTPInterface* lookupRTPInterface(unsigned char streamChannelId);
   void deregisterRTPInterface(unsigned char streamChannelId);
 
+  void setAlternativeByteHandler(AlternativeByteHandler* handler,
+				 void* clientData);
+
 private:
   static void tcpReadHandler(SocketDescriptor*, int mask);
+  void deleteMyself();
 
 private:
   UsageEnvironment& fEnv;
   int fOurSocketNum;
   HashTable* fSubChannelHashTable;
+  AlternativeByteHandler* fAlternativeByteHandler;
+  void* fAlternativeByteHandlerClientData;
+  Boolean fAreInReadHandlerLoop, fDeleteMyselfNext;
 };
 
 static SocketDescriptor* lookupSocketDescriptor(UsageEnvironment& env,
@@ -158,13 +167,18 @@ void RTPInterface::removeStreamSocket(int sockNum,
 }
 
 void RTPInterface::sendPacket(unsigned char* packet, unsigned packetSize) {
+  sendPacket(NULL, 0, packet, packetSize);
+}
+
+void RTPInterface::sendPacket(unsigned char* header, unsigned headerSize,
+			      unsigned char* payload, unsigned payloadSize) {
   // Normal case: Send as a UDP packet:
-  fGS->output(envir(), fGS->ttl(), packet, packetSize);
+  fGS->output(envir(), fGS->ttl(), header, headerSize, payload, payloadSize);
 
   // Also, send over each of our TCP sockets:
   for (tcpStreamRecord* streams = fTCPStreams; streams != NULL;
        streams = streams->fNext) {
-    sendRTPOverTCP(packet, packetSize,
+    sendRTPOverTCP(header, headerSize, payload, payloadSize,
 		   streams->fStreamSocketNum, streams->fStreamChannelId);
   }
 }
@@ -222,6 +236,14 @@ Boolean RTPInterface::handleRead(unsigned char* buffer,
       RTPOverTCP_OK = False; // HACK #####
     } else {
       readSuccess = True;
+
+      // "recvfrom()" doesn't say who a TCP stream's data is from (but our
+      // caller - e.g. RTCP, for its receiver stats - may want to know):
+      SOCKLEN_T addressSize = sizeof fromAddress;
+      if (getpeername(fNextTCPReadStreamSocketNum,
+		      (struct sockaddr*)&fromAddress, &addressSize) != 0) {
+	fromAddress.sin_addr.s_addr = 0;
+      }
     }
     fNextTCPReadStreamSocketNum = -1; // default, for next time
   }
@@ -233,6 +255,36 @@ Boolean RTPInterface::handleRead(unsigned char* buffer,
   return readSuccess;
 }
 
+unsigned RTPInterface::handleReadBatch(unsigned char** buffers,
+				       unsigned bufferMaxSize,
+				       unsigned* bytesRead,
+				       unsigned maxPackets) {
+  if (maxPackets == 0) return 0;
+
+  struct sockaddr_in fromAddress;
+  if (fNextTCPReadStreamSocketNum >= 0 || maxPackets == 1) {
+    // TCP data comes one framed packet at a time:
+    return handleRead(buffers[0], bufferMaxSize, bytesRead[0], fromAddress)
+      ? 1 : 0;
+  }
+
+  struct sockaddr_in fromAddresses[MAX_PACKETS_PER_READ];
+  if (maxPackets > MAX_PACKETS_PER_READ) maxPackets = MAX_PACKETS_PER_READ;
+  unsigned numPackets;
+  if (!fGS->handleReadBatch(buffers, bufferMaxSize, bytesRead, fromAddresses,
+			    maxPackets, numPackets)) {
+    return 0;
+  }
+
+  if (fAuxReadHandlerFunc != NULL) {
+    // Also pass the newly-read packet data to our auxilliary handler:
+    for (unsigned i = 0; i < numPackets; ++i) {
+      (*fAuxReadHandlerFunc)(fAuxReadHandlerClientData, buffers[i], bytesRead[i]);
+    }
+  }
+  return numPackets;
+}
+
 void RTPInterface::stopNetworkReading() {
   // Normal case
   envir().taskScheduler().turnOffBackgroundReadHandling(fGS->socketNum());
@@ -244,14 +296,37 @@ void RTPInterface::stopNetworkReading() {
   }
 }
 
+void RTPInterface
+::setAlternativeByteHandler(UsageEnvironment& env, int socketNum,
+			    AlternativeByteHandler* handler, void* clientData) {
+  SocketDescriptor* socketDescriptor = lookupSocketDescriptor(env, socketNum);
+  if (socketDescriptor == NULL) {
+    if (handler == NULL) return;
+
+    socketDescriptor = new SocketDescriptor(env, socketNum);
+    socketHashTable(env)->Add((char const*)(long)socketNum, socketDescriptor);
+  }
+
+  socketDescriptor->setAlternativeByteHandler(handler, clientData);
+      // Note: This may delete "socketDescriptor"
+}
+
 
 ////////// Helper Functions - Implementation /////////
 
-void sendRTPOverTCP(unsigned char* packet, unsigned packetSize,
+static MetricsCounter tcpPacketsSent("rtp_tcp_packets_sent_total",
+				     "RTP and RTCP packets sent over TCP");
+static MetricsCounter tcpBytesSent("rtp_tcp_bytes_sent_total",
+				   "RTP and RTCP bytes sent over TCP");
+static MetricsCounter tcpSendFailures("rtp_tcp_send_failures_total",
+				      "RTP-over-TCP packets that couldn't be sent (the client has fallen behind, or gone away)");
+
+void sendRTPOverTCP(unsigned char* header, unsigned headerSize,
+                    unsigned char* packet, unsigned packetSize,
                     int socketNum, unsigned char streamChannelId) {
 #ifdef DEBUG
   fprintf(stderr, "sendRTPOverTCP: %d bytes over channel %d (socket %d)\n",
-	  packetSize, streamChannelId, socketNum); fflush(stderr);
+	  headerSize + packetSize, streamChannelId, socketNum); fflush(stderr);
 #endif
   // Send RTP over TCP, using the encoding defined in
   // RFC 2326, section 10.12:
@@ -260,21 +335,27 @@ void sendRTPOverTCP(unsigned char* packet, unsigned packetSize,
     if (send(socketNum, &dollar, 1, 0) != 1) break;
     if (send(socketNum, (char*)&streamChannelId, 1, 0) != 1) break;
 
+    unsigned totPacketSize = headerSize + packetSize;
     char netPacketSize[2];
-    netPacketSize[0] = (char) ((packetSize&0xFF00)>>8);
-    netPacketSize[1] = (char) (packetSize&0xFF);
+    netPacketSize[0] = (char) ((totPacketSize&0xFF00)>>8);
+    netPacketSize[1] = (char) (totPacketSize&0xFF);
     if (send(socketNum, netPacketSize, 2, 0) != 2) break;
 
+    if (headerSize > 0
+	&& send(socketNum, (char*)header, headerSize, 0) != (int)headerSize) break;
     if (send(socketNum, (char*)packet, packetSize, 0) != (int)packetSize) break;
 
 #ifdef DEBUG
     fprintf(stderr, "sendRTPOverTCP: completed\n"); fflush(stderr);
 #endif
+    tcpPacketsSent.increment();
+    tcpBytesSent.add(4 + totPacketSize);
 
     return;
   } while (0);
 
   RTPOverTCP_OK = False; // HACK #####
+  tcpSendFailures.increment();
 #ifdef DEBUG
   fprintf(stderr, "sendRTPOverTCP: failed!\n"); fflush(stderr);
 #endif
@@ -282,7 +363,9 @@ void sendRTPOverTCP(unsigned char* packet, unsigned packetSize,
 
 SocketDescriptor::SocketDescriptor(UsageEnvironment& env, int socketNum)
   : fEnv(env), fOurSocketNum(socketNum),
-    fSubChannelHashTable(HashTable::create(ONE_WORD_HASH_KEYS)) {
+    fSubChannelHashTable(HashTable::create(ONE_WORD_HASH_KEYS)),
+    fAlternativeByteHandler(NULL), fAlternativeByteHandlerClientData(NULL),
+    fAreInReadHandlerLoop(False), fDeleteMyselfNext(False) {
 }
 
 SocketDescriptor::~SocketDescriptor() {
@@ -315,9 +398,32 @@ void SocketDescriptor
   fSubChannelHashTable->Remove((char const*)(long)streamChannelId);
 
   if (fSubChannelHashTable->IsEmpty()) {
-    // No more interfaces are using us, so it's curtains for us now
     fEnv.taskScheduler().turnOffBackgroundReadHandling(fOurSocketNum);
-    removeSocketDescription(fEnv, fOurSocketNum);
+    if (fAlternativeByteHandler != NULL) {
+      // The socket's other reader takes it back:
+      (*fAlternativeByteHandler)(fAlternativeByteHandlerClientData, 0xFE);
+    } else {
+      // No more interfaces are using us, so it's curtains for us now
+      deleteMyself();
+    }
+  }
+}
+
+void SocketDescriptor
+::setAlternativeByteHandler(AlternativeByteHandler* handler,
+			    void* clientData) {
+  fAlternativeByteHandler = handler;
+  fAlternativeByteHandlerClientData = clientData;
+
+  if (handler == NULL && fSubChannelHashTable->IsEmpty()) deleteMyself();
+}
+
+void SocketDescriptor::deleteMyself() {
+  removeSocketDescription(fEnv, fOurSocketNum);
+  if (fAreInReadHandlerLoop) {
+    // We're being called from "tcpReadHandler()", which deletes us on return:
+    fDeleteMyselfNext = True;
+  } else {
     delete this;
   }
 }
@@ -328,11 +434,10 @@ void SocketDescriptor::tcpReadHandler(SocketDescriptor* socketDescriptor,
     UsageEnvironment& env = socketDescriptor->fEnv; // abbrev
     int socketNum = socketDescriptor->fOurSocketNum;
 
-    // Begin by reading and discarding any characters that aren't '$'.
-    // Any such characters are probably regular RTSP responses or
-    // commands from the server.  At present, we can't do anything with
-    // these, because we have taken complete control of reading this socket.
-    // (Later, fix) #####
+    // Begin by reading any characters that aren't '$'.  Any such
+    // characters are probably regular RTSP responses or commands from the
+    // server.  They're passed to our alternative byte handler (if any) -
+    // e.g., an asynchronous "RTSPClient" - or else discarded.
     unsigned char c;
     struct sockaddr_in fromAddress;
     struct timeval timeout; timeout.tv_sec = 0; timeout.tv_usec = 0;
@@ -341,9 +446,26 @@ void SocketDescriptor::tcpReadHandler(SocketDescriptor* socketDescriptor,
       if (result != 1) { // error reading TCP socket
 	if (result < 0) {
 	  env.taskScheduler().turnOffBackgroundReadHandling(socketNum); // stops further calls to us
+	  if (socketDescriptor->fAlternativeByteHandler != NULL) {
+	    socketDescriptor->fAreInReadHandlerLoop = True;
+	    (*socketDescriptor->fAlternativeByteHandler)
+	      (socketDescriptor->fAlternativeByteHandlerClientData, 0xFF);
+	    socketDescriptor->fAreInReadHandlerLoop = False;
+	    if (socketDescriptor->fDeleteMyselfNext) delete socketDescriptor;
+	  }
 	}
 	return;
       }
+      if (c != '$' && socketDescriptor->fAlternativeByteHandler != NULL) {
+	socketDescriptor->fAreInReadHandlerLoop = True;
+	(*socketDescriptor->fAlternativeByteHandler)
+	  (socketDescriptor->fAlternativeByteHandlerClientData, c);
+	socketDescriptor->fAreInReadHandlerLoop = False;
+	if (socketDescriptor->fDeleteMyselfNext) {
+	  delete socketDescriptor;
+	  return;
+	}
+      }
     } while (c != '$');
 
     // The next byte is the stream channel id:
@@ -152,6 +152,10 @@ char const* RTPSink::auxSDPLine() {
   return NULL; // by default
 }
 
+void RTPSink::retransmitPacket(u_int16_t /*seqNo*/) {
+  // By default, we don't keep sent packets, so there's nothing to resend
+}
+
 
 ////////// RTPTransmissionStatsDB //////////
 
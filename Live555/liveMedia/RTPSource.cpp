@@ -140,6 +140,11 @@ void RTPReceptionStatsDB
   stats->noteIncomingSR(ntpTimestampMSW, ntpTimestampLSW, rtpTimestamp);
 }
 
+void RTPReceptionStatsDB::noteRecoveredPacket(u_int32_t SSRC) {
+  RTPReceptionStats* stats = lookup(SSRC);
+  if (stats != NULL) ++stats->fTotNumPacketsRecovered;
+}
+
 void RTPReceptionStatsDB::removeRecord(u_int32_t SSRC) {
   RTPReceptionStats* stats = lookup(SSRC);
   if (stats != NULL) {
@@ -200,6 +205,7 @@ RTPReceptionStats::~RTPReceptionStats() {
 void RTPReceptionStats::init(u_int32_t SSRC) {
   fSSRC = SSRC;
   fTotNumPacketsReceived = 0;
+  fTotNumPacketsRecovered = 0;
   fTotBytesReceived_hi = fTotBytesReceived_lo = 0;
   fHaveSeenInitialSequenceNumber = False;
   fLastTransit = ~0;
@@ -55,6 +55,46 @@ Boolean RTSPClient::lookupByName(UsageEnvironment& env,
   return True;
 }
 
+// A request made using the asynchronous interface, from when it's queued
+// until its response arrives:
+class RTSPClient::RequestRecord {
+public:
+  RequestRecord(char const* commandName,
+		responseHandler* handler, void* clientData)
+    : fNext(NULL), fCSeq(0), fCommandName(commandName), fURL(NULL),
+      fSession(NULL), fSubsession(NULL),
+      fStreamOutgoing(False), fStreamUsingTCP(False),
+      fForceMulticastOnUnspecified(False),
+      fStart(0.0f), fEnd(-1.0f), fScale(1.0f),
+      fIsAwaitingSessionId(False), fHaveRetriedAuthentication(False),
+      fWillBeAnswered(True),
+      fHandler(handler), fClientData(clientData) {
+  }
+  virtual ~RequestRecord() { delete[] fURL; }
+
+  Boolean needsSessionId() const {
+    // (The first "SETUP" doesn't, but we can't yet tell which that is.)
+    return strcmp(fCommandName, "DESCRIBE") != 0
+      && strcmp(fCommandName, "OPTIONS") != 0;
+  }
+
+public:
+  RequestRecord* fNext;
+  unsigned fCSeq;
+  char const* fCommandName;
+  char* fURL; // for "DESCRIBE" and "OPTIONS"
+  MediaSession* fSession; // for "PLAY", "PAUSE" and "TEARDOWN"
+  MediaSubsession* fSubsession; // for "SETUP"
+  Boolean fStreamOutgoing, fStreamUsingTCP, fForceMulticastOnUnspecified;
+  double fStart, fEnd;
+  float fScale;
+  Boolean fIsAwaitingSessionId; // a "SETUP" sent without a "Session:" header
+  Boolean fHaveRetriedAuthentication;
+  Boolean fWillBeAnswered;
+  responseHandler* fHandler;
+  void* fClientData;
+};
+
 unsigned RTSPClient::fCSeq = 0;
 
 RTSPClient::RTSPClient(UsageEnvironment& env,
@@ -70,7 +110,12 @@ RTSPClient::RTSPClient(UsageEnvironment& env,
     fRealChallengeStr(NULL), fRealETagStr(NULL),
 #endif
     fServerIsKasenna(False), fKasennaContentType(NULL),
-    fServerIsMicrosoft(False)
+    fServerIsMicrosoft(False),
+    fConnectionIsPending(False),
+    fRequestsAwaitingSending(NULL), fRequestsAwaitingResponse(NULL),
+    fNumSetupsAwaitingSessionId(0), fResponseBytesAlreadySeen(0),
+    fInterleavedBytesToSkip(0), fDeletionFlag(NULL),
+    fUnansweredRequestsTask(NULL)
 {
   fResponseBufferSize = 20000;
   fResponseBuffer = new char[fResponseBufferSize+1];
@@ -108,6 +153,25 @@ void RTSPClient::setUserAgentString(char const* userAgentStr) {
 }
 
 RTSPClient::~RTSPClient() {
+  if (fDeletionFlag != NULL) *fDeletionFlag = True; // we were closed by a response handler
+  envir().taskScheduler().unscheduleDelayedTask(fUnansweredRequestsTask);
+
+  // Forget (without calling their handlers) any outstanding asynchronous requests:
+  while (fRequestsAwaitingSending != NULL) {
+    RequestRecord* request = fRequestsAwaitingSending;
+    fRequestsAwaitingSending = request->fNext;
+    delete request;
+  }
+  while (fRequestsAwaitingResponse != NULL) {
+    RequestRecord* request = fRequestsAwaitingResponse;
+    fRequestsAwaitingResponse = request->fNext;
+    delete request;
+  }
+  if (fInputSocketNum >= 0) {
+    RTPInterface::setAlternativeByteHandler(envir(), fInputSocketNum, NULL, NULL);
+  }
+
+  envir().taskScheduler().turnOffBackgroundWriteHandling(fInputSocketNum);
   envir().taskScheduler().turnOffBackgroundReadHandling(fInputSocketNum); // must be called before:
   reset();
 
@@ -839,7 +903,6 @@ Boolean RTSPClient::setupMediaSubsession(MediaSubsession& subsession,
 
     char const *prefix, *separator, *suffix;
     constructSubsessionURL(subsession, prefix, separator, suffix);
-    char const* transportFmt;
 
     if (strcmp(subsession.protocolName(), "UDP") == 0) {
       char const* setupFmt = "SETUP %s%s RTSP/1.0\r\n";
@@ -847,50 +910,22 @@ Boolean RTSPClient::setupMediaSubsession(MediaSubsession& subsession,
         + strlen(prefix) + strlen (separator);
       setupStr = new char[setupSize];
       sprintf(setupStr, setupFmt, prefix, separator);
-
-      transportFmt = "Transport: RAW/RAW/UDP%s%s%s=%d-%d\r\n";
     } else {
       char const* setupFmt = "SETUP %s%s%s RTSP/1.0\r\n";
       unsigned setupSize = strlen(setupFmt)
         + strlen(prefix) + strlen (separator) + strlen(suffix);
       setupStr = new char[setupSize];
       sprintf(setupStr, setupFmt, prefix, separator, suffix);
-
-      transportFmt = "Transport: RTP/AVP%s%s%s=%d-%d\r\n";
     }
 
     if (transportStr == NULL) {
-      // Construct a "Transport:" header.
-      char const* transportTypeStr;
-      char const* modeStr = streamOutgoing ? ";mode=receive" : "";
-          // Note: I think the above is nonstandard, but DSS wants it this way
-      char const* portTypeStr;
-      unsigned short rtpNumber, rtcpNumber;
-      if (streamUsingTCP) { // streaming over the RTSP connection
-	transportTypeStr = "/TCP;unicast";
-	portTypeStr = ";interleaved";
-	rtpNumber = fTCPStreamIdCount++;
-	rtcpNumber = fTCPStreamIdCount++;
-      } else { // normal RTP streaming
-	unsigned connectionAddress = subsession.connectionEndpointAddress();
-	Boolean requestMulticastStreaming = IsMulticastAddress(connectionAddress)
-	  || (connectionAddress == 0 && forceMulticastOnUnspecified);
-	transportTypeStr = requestMulticastStreaming ? ";multicast" : ";unicast";
-	portTypeStr = ";client_port";
-	rtpNumber = subsession.clientPortNum();
-	if (rtpNumber == 0) {
-	  envir().setResultMsg("Client port number unknown\n");
-	  delete[] authenticatorStr; delete[] sessionStr; delete[] setupStr;
-	  break;
-	}
-	rtcpNumber = rtpNumber + 1;
+      transportStr = createTransportString(subsession, streamOutgoing,
+					   streamUsingTCP,
+					   forceMulticastOnUnspecified);
+      if (transportStr == NULL) {
+	delete[] authenticatorStr; delete[] sessionStr; delete[] setupStr;
+	break;
       }
-
-      unsigned transportSize = strlen(transportFmt)
-	+ strlen(transportTypeStr) + strlen(modeStr) + strlen(portTypeStr) + 2*5 /* max port len */;
-      transportStr = new char[transportSize];
-      sprintf(transportStr, transportFmt,
-	      transportTypeStr, modeStr, portTypeStr, rtpNumber, rtcpNumber);
     }
 
     // (Later implement more, as specified in the RTSP spec, sec D.1 #####)
@@ -928,12 +963,76 @@ Boolean RTSPClient::setupMediaSubsession(MediaSubsession& subsession,
     char* firstLine; char* nextLineStart;
     if (!getResponse("SETUP", bytesRead, responseCode, firstLine, nextLineStart)) break;
 
+    unsigned cLength = 0;
+    if (!handleSETUPResponse(subsession, nextLineStart, streamUsingTCP, cLength)) break;
+
+    // If we saw a "Content-Length:" header in the response, then discard whatever
+    // included data it refers to:
+    if (cLength > 0) {
+      char* dummyBuf = new char[cLength];
+      getResponse1(dummyBuf, cLength);
+      delete[] dummyBuf;
+    }
+
+    delete[] cmd;
+    return True;
+  } while (0);
+
+  delete[] cmd;
+  return False;
+}
+
+char* RTSPClient::createTransportString(MediaSubsession& subsession,
+					Boolean streamOutgoing,
+					Boolean streamUsingTCP,
+					Boolean forceMulticastOnUnspecified) {
+  // Construct a "Transport:" header.
+  char const* transportFmt = strcmp(subsession.protocolName(), "UDP") == 0
+    ? "Transport: RAW/RAW/UDP%s%s%s=%d-%d\r\n"
+    : "Transport: RTP/AVP%s%s%s=%d-%d\r\n";
+  char const* transportTypeStr;
+  char const* modeStr = streamOutgoing ? ";mode=receive" : "";
+      // Note: I think the above is nonstandard, but DSS wants it this way
+  char const* portTypeStr;
+  unsigned short rtpNumber, rtcpNumber;
+  if (streamUsingTCP) { // streaming over the RTSP connection
+    transportTypeStr = "/TCP;unicast";
+    portTypeStr = ";interleaved";
+    rtpNumber = fTCPStreamIdCount++;
+    rtcpNumber = fTCPStreamIdCount++;
+  } else { // normal RTP streaming
+    unsigned connectionAddress = subsession.connectionEndpointAddress();
+    Boolean requestMulticastStreaming = IsMulticastAddress(connectionAddress)
+      || (connectionAddress == 0 && forceMulticastOnUnspecified);
+    transportTypeStr = requestMulticastStreaming ? ";multicast" : ";unicast";
+    portTypeStr = ";client_port";
+    rtpNumber = subsession.clientPortNum();
+    if (rtpNumber == 0) {
+      envir().setResultMsg("Client port number unknown\n");
+      return NULL;
+    }
+    rtcpNumber = rtpNumber + 1;
+  }
+
+  unsigned transportSize = strlen(transportFmt)
+    + strlen(transportTypeStr) + strlen(modeStr) + strlen(portTypeStr) + 2*5 /* max port len */;
+  char* transportStr = new char[transportSize];
+  sprintf(transportStr, transportFmt,
+	  transportTypeStr, modeStr, portTypeStr, rtpNumber, rtcpNumber);
+  return transportStr;
+}
+
+Boolean RTSPClient::handleSETUPResponse(MediaSubsession& subsession,
+					char* nextLineStart,
+					Boolean streamUsingTCP,
+					unsigned& cLength) {
+  do {
     // Look for a "Session:" header (to set our session id), and
     // a "Transport: " header (to set the server address/port)
     // For now, ignore other headers.
     char* lineStart;
     char* sessionId = new char[fResponseBufferSize]; // ensures we have enough space
-    unsigned cLength = 0;
+    cLength = 0;
     while (1) {
       lineStart = nextLineStart;
       if (lineStart == NULL) break;
@@ -979,14 +1078,6 @@ Boolean RTSPClient::setupMediaSubsession(MediaSubsession& subsession,
       break;
     }
 
-    // If we saw a "Content-Length:" header in the response, then discard whatever
-    // included data it refers to:
-    if (cLength > 0) {
-      char* dummyBuf = new char[cLength];
-      getResponse1(dummyBuf, cLength);
-      delete[] dummyBuf;
-    }
-
     if (streamUsingTCP) {
       // Tell the subsession to receive RTP (and send/receive RTCP)
       // over the RTSP stream:
@@ -1005,11 +1096,9 @@ Boolean RTSPClient::setupMediaSubsession(MediaSubsession& subsession,
       subsession.setDestinations(destAddress);
     }
 
-    delete[] cmd;
     return True;
   } while (0);
 
-  delete[] cmd;
   return False;
 }
 
@@ -1113,32 +1202,7 @@ Boolean RTSPClient::playMediaSession(MediaSession& session,
     char* firstLine; char* nextLineStart;
     if (!getResponse("PLAY", bytesRead, responseCode, firstLine, nextLineStart)) break;
 
-    // Look for various headers that we understand:
-    char* lineStart;
-    while (1) {
-      lineStart = nextLineStart;
-      if (lineStart == NULL) break;
-
-      nextLineStart = getLine(lineStart);
-
-      if (parseScaleHeader(lineStart, session.scale())) continue;
-      if (parseRangeHeader(lineStart, session.playStartTime(), session.playEndTime())) continue;
-
-      u_int16_t seqNum; u_int32_t timestamp;
-      if (parseRTPInfoHeader(lineStart, seqNum, timestamp)) {
-	// This is data for our first subsession.  Fill it in, and do the same for our other subsessions:
-	MediaSubsessionIterator iter(session);
-	MediaSubsession* subsession;
-	while ((subsession = iter.next()) != NULL) {
-	  subsession->rtpInfo.seqNum = seqNum;
-	  subsession->rtpInfo.timestamp = timestamp;
-	  subsession->rtpInfo.infoIsNew = True;
-
-	  if (!parseRTPInfoHeader(lineStart, seqNum, timestamp)) break;
-	}
-	continue;
-      }
-    }
+    handlePLAYResponse(session, nextLineStart);
 
     if (fTCPStreamIdCount == 0) { // we're not receiving RTP-over-TCP
       // Arrange to handle incoming requests sent by the server
@@ -1154,6 +1218,36 @@ Boolean RTSPClient::playMediaSession(MediaSession& session,
   return False;
 }
 
+void RTSPClient::handlePLAYResponse(MediaSession& session,
+				    char* nextLineStart) {
+  // Look for various headers that we understand:
+  char* lineStart;
+  while (1) {
+    lineStart = nextLineStart;
+    if (lineStart == NULL) break;
+
+    nextLineStart = getLine(lineStart);
+
+    if (parseScaleHeader(lineStart, session.scale())) continue;
+    if (parseRangeHeader(lineStart, session.playStartTime(), session.playEndTime())) continue;
+
+    u_int16_t seqNum; u_int32_t timestamp;
+    if (parseRTPInfoHeader(lineStart, seqNum, timestamp)) {
+      // This is data for our first subsession.  Fill it in, and do the same for our other subsessions:
+      MediaSubsessionIterator iter(session);
+      MediaSubsession* subsession;
+      while ((subsession = iter.next()) != NULL) {
+	subsession->rtpInfo.seqNum = seqNum;
+	subsession->rtpInfo.timestamp = timestamp;
+	subsession->rtpInfo.infoIsNew = True;
+
+	if (!parseRTPInfoHeader(lineStart, seqNum, timestamp)) break;
+      }
+      continue;
+    }
+  }
+}
+
 Boolean RTSPClient::playMediaSubsession(MediaSubsession& subsession,
 					double start, double end, float scale,
 					Boolean hackForDSS) {
@@ -2536,3 +2630,686 @@ void RTSPClient::handleCmd_notSupported(char const* cseq) {
 	   "RTSP/1.0 405 Method Not Allowed\r\nCSeq: %s\r\n\r\n", cseq);
   send(fOutputSocketNum, tmpBuf, strlen(tmpBuf), 0);
 }
+
+
+////////// RTSPClient - asynchronous interface //////////
+
+unsigned RTSPClient::sendDescribeCommand(char const* url,
+					 responseHandler* handler,
+					 void* clientData,
+					 Authenticator* authenticator) {
+  fCurrentAuthenticator.reset();
+  if (authenticator != NULL) {
+    fCurrentAuthenticator = *authenticator;
+  } else {
+    // Use any "<username>:<password>@" in "url":
+    char* username; char* password;
+    if (parseRTSPURLUsernamePassword(url, username, password)) {
+      fCurrentAuthenticator.setUsernameAndPassword(username, password);
+      delete[] username; delete[] password;
+    }
+  }
+
+  RequestRecord* request = new RequestRecord("DESCRIBE", handler, clientData);
+  request->fURL = strDup(url);
+  return queueRequest(request, url);
+}
+
+unsigned RTSPClient::sendOptionsCommand(char const* url,
+					responseHandler* handler,
+					void* clientData,
+					Authenticator* authenticator) {
+  if (authenticator != NULL) fCurrentAuthenticator = *authenticator;
+
+  RequestRecord* request = new RequestRecord("OPTIONS", handler, clientData);
+  request->fURL = strDup(url);
+  return queueRequest(request, url);
+}
+
+unsigned RTSPClient::sendSetupCommand(MediaSubsession& subsession,
+				      responseHandler* handler,
+				      void* clientData,
+				      Boolean streamOutgoing,
+				      Boolean streamUsingTCP,
+				      Boolean forceMulticastOnUnspecified) {
+  RequestRecord* request = new RequestRecord("SETUP", handler, clientData);
+  request->fSubsession = &subsession;
+  request->fStreamOutgoing = streamOutgoing;
+  request->fStreamUsingTCP = streamUsingTCP;
+  request->fForceMulticastOnUnspecified = forceMulticastOnUnspecified;
+  return queueRequest(request, fBaseURL);
+}
+
+unsigned RTSPClient::sendPlayCommand(MediaSession& session,
+				     responseHandler* handler,
+				     void* clientData,
+				     double start, double end, float scale) {
+  RequestRecord* request = new RequestRecord("PLAY", handler, clientData);
+  request->fSession = &session;
+  request->fStart = start; request->fEnd = end; request->fScale = scale;
+  return queueRequest(request, fBaseURL);
+}
+
+unsigned RTSPClient::sendPauseCommand(MediaSession& session,
+				      responseHandler* handler,
+				      void* clientData) {
+  RequestRecord* request = new RequestRecord("PAUSE", handler, clientData);
+  request->fSession = &session;
+  return queueRequest(request, fBaseURL);
+}
+
+unsigned RTSPClient::sendTeardownCommand(MediaSession& session,
+					 responseHandler* handler,
+					 void* clientData) {
+  RequestRecord* request = new RequestRecord("TEARDOWN", handler, clientData);
+  request->fSession = &session;
+  return queueRequest(request, fBaseURL);
+}
+
+unsigned RTSPClient::queueRequest(RequestRecord* request, char const* url) {
+  request->fCSeq = ++fCSeq;
+
+  if (fInputSocketNum < 0) {
+    if (url == NULL) url = "";
+    if (!openConnectionAsync(url)) {
+      delete request;
+      return 0;
+    }
+  }
+
+  if (fConnectionIsPending || fRequestsAwaitingSending != NULL
+      || (request->needsSessionId()
+	  && fLastSessionId == NULL && fNumSetupsAwaitingSessionId > 0)) {
+    // It'll be sent (in order) once the connection's up, or the first
+    // "SETUP"'s response has given us our session id:
+    RequestRecord** last = &fRequestsAwaitingSending;
+    while (*last != NULL) last = &((*last)->fNext);
+    *last = request;
+    return request->fCSeq;
+  }
+
+  unsigned cseq = request->fCSeq;
+  if (!sendRequestNow(request)) {
+    delete request;
+    return 0;
+  }
+  return cseq;
+}
+
+Boolean RTSPClient::openConnectionAsync(char const* url) {
+  do {
+    if (fTunnelOverHTTPPortNum != 0) {
+      envir().setResultMsg("RTSP-over-HTTP isn't supported by the asynchronous interface");
+      break;
+    }
+
+    NetAddress destAddress;
+    portNumBits urlPortNum;
+    if (!parseRTSPURL(envir(), url, destAddress, urlPortNum)) break;
+
+    fInputSocketNum = fOutputSocketNum
+      = setupStreamSocket(envir(), 0, True /* =>non-blocking */);
+    if (fInputSocketNum < 0) break;
+
+    fServerAddress = *(unsigned*)(destAddress.data());
+    MAKE_SOCKADDR_IN(remoteName, fServerAddress, htons(urlPortNum));
+    if (connect(fInputSocketNum, (struct sockaddr*)&remoteName, sizeof remoteName) != 0) {
+      int err = envir().getErrno();
+      if (err != EINPROGRESS && err != EWOULDBLOCK) {
+	envir().setResultErrMsg("connect() failed: ");
+	break;
+      }
+
+      // The connection is pending; we'll be told when it's done:
+      fConnectionIsPending = True;
+      envir().taskScheduler().turnOnBackgroundWriteHandling(fInputSocketNum,
+	   (TaskScheduler::BackgroundHandlerProc*)&connectionHandler, this);
+      return True;
+    }
+
+    connectionEstablished();
+    return True;
+  } while (0);
+
+  resetTCPSockets();
+  return False;
+}
+
+void RTSPClient::connectionEstablished() {
+  // From now on, the socket is read only when it's readable - but in full,
+  // by "RTPInterface" (for RTP-over-TCP) - so make it blocking again:
+  makeSocketBlocking(fInputSocketNum);
+  fResponseBytesAlreadySeen = fInterleavedBytesToSkip = 0;
+  envir().taskScheduler().turnOnBackgroundReadHandling(fInputSocketNum,
+       (TaskScheduler::BackgroundHandlerProc*)&incomingDataHandler, this);
+}
+
+void RTSPClient::connectionHandler(void* instance, int /*mask*/) {
+  RTSPClient* client = (RTSPClient*)instance;
+  client->connectionHandler1();
+}
+
+void RTSPClient::connectionHandler1() {
+  envir().taskScheduler().turnOffBackgroundWriteHandling(fInputSocketNum);
+  fConnectionIsPending = False;
+
+  int err = 0;
+  SOCKLEN_T len = sizeof err;
+  if (getsockopt(fInputSocketNum, SOL_SOCKET, SO_ERROR, (char*)&err, &len) < 0) {
+    err = envir().getErrno();
+  }
+  if (err != 0) {
+    envir().setResultMsg("connect() failed");
+    if (fVerbosityLevel >= 1) {
+      envir() << "Connection to the server failed: " << err << "\n";
+    }
+    closeConnectionAsync(-err);
+    return;
+  }
+
+  connectionEstablished();
+  sendPendingRequests();
+}
+
+char* RTSPClient::createRequestString(RequestRecord* request) {
+  char const* cmdName = request->fCommandName;
+  char* cmdURL = NULL;
+  char* extraHeaders = NULL;
+
+  if (request->fURL != NULL) { // "DESCRIBE" or "OPTIONS"
+    cmdURL = strDup(request->fURL);
+    extraHeaders = strDup(strcmp(cmdName, "DESCRIBE") == 0
+			  ? "Accept: application/sdp\r\n" : "");
+  } else if (request->fSubsession != NULL) { // "SETUP"
+    MediaSubsession& subsession = *request->fSubsession;
+    char const *prefix, *separator, *suffix;
+    constructSubsessionURL(subsession, prefix, separator, suffix);
+    if (strcmp(subsession.protocolName(), "UDP") == 0) suffix = "";
+    cmdURL = new char[strlen(prefix) + strlen(separator) + strlen(suffix) + 1];
+    sprintf(cmdURL, "%s%s%s", prefix, separator, suffix);
+
+    char* transportStr
+      = createTransportString(subsession, request->fStreamOutgoing,
+			      request->fStreamUsingTCP,
+			      request->fForceMulticastOnUnspecified);
+    if (transportStr == NULL) {
+      delete[] cmdURL;
+      return NULL;
+    }
+    // When sending more than one "SETUP" request, include a "Session:"
+    // header in the 2nd and later "SETUP"s.
+    char const* sessionId = fLastSessionId == NULL ? "" : fLastSessionId;
+    extraHeaders = new char[strlen(transportStr) + 20 + strlen(sessionId)];
+    sprintf(extraHeaders, fLastSessionId == NULL ? "%s" : "%sSession: %s\r\n",
+	    transportStr, sessionId);
+    delete[] transportStr;
+  } else { // "PLAY", "PAUSE" or "TEARDOWN", on "request->fSession"
+    if (fLastSessionId == NULL) {
+      envir().setResultMsg(NoSessionErr);
+      return NULL;
+    }
+    char const* sessURL = sessionURL(*request->fSession);
+    cmdURL = strDup(sessURL == NULL ? "" : sessURL);
+
+    char* scaleStr; char* rangeStr;
+    if (strcmp(cmdName, "PLAY") == 0) {
+      scaleStr = createScaleString(request->fScale, request->fSession->scale());
+      rangeStr = createRangeString(request->fStart, request->fEnd);
+    } else {
+      scaleStr = strDup(""); rangeStr = strDup("");
+    }
+    char const* const headersFmt = "Session: %s\r\n%s%s";
+    extraHeaders = new char[strlen(headersFmt) + strlen(fLastSessionId)
+			    + strlen(scaleStr) + strlen(rangeStr)];
+    sprintf(extraHeaders, headersFmt, fLastSessionId, scaleStr, rangeStr);
+    delete[] scaleStr; delete[] rangeStr;
+  }
+
+  char* authenticatorStr
+    = createAuthenticatorString(&fCurrentAuthenticator, cmdName, fBaseURL);
+  char const* const cmdFmt =
+    "%s %s RTSP/1.0\r\n"
+    "CSeq: %u\r\n"
+    "%s"
+    "%s"
+    "%s"
+    "\r\n";
+  unsigned cmdSize = strlen(cmdFmt)
+    + strlen(cmdName) + strlen(cmdURL)
+    + 20 /* max int len */
+    + strlen(extraHeaders)
+    + strlen(authenticatorStr)
+    + fUserAgentHeaderStrSize;
+  char* cmd = new char[cmdSize];
+  sprintf(cmd, cmdFmt,
+	  cmdName, cmdURL,
+	  request->fCSeq,
+	  extraHeaders,
+	  authenticatorStr,
+	  fUserAgentHeaderStr);
+  delete[] authenticatorStr; delete[] extraHeaders; delete[] cmdURL;
+
+  return cmd;
+}
+
+Boolean RTSPClient::sendRequestNow(RequestRecord* request) {
+  char* cmd = createRequestString(request);
+  if (cmd == NULL) return False;
+
+  Boolean result = sendRequest(cmd, request->fCommandName);
+  delete[] cmd;
+  if (!result) return False;
+
+  if (strcmp(request->fCommandName, "SETUP") == 0 && fLastSessionId == NULL) {
+    // Until its response arrives, no other request can be sent with a session id:
+    request->fIsAwaitingSessionId = True;
+    ++fNumSetupsAwaitingSessionId;
+  } else if (strcmp(request->fCommandName, "TEARDOWN") == 0) {
+    if (fTCPStreamIdCount > 0) {
+      // When TCP streaming, don't look for a response (the server's
+      // reading our socket for RTCP-over-TCP), but complete it ourself:
+      request->fWillBeAnswered = False;
+      if (fUnansweredRequestsTask == NULL) {
+	fUnansweredRequestsTask = envir().taskScheduler()
+	  .scheduleDelayedTask(0, completeUnansweredRequests, this);
+      }
+    }
+
+    // From our POV, the session is now over:
+    MediaSubsessionIterator iter(*request->fSession);
+    MediaSubsession* subsession;
+    while ((subsession = iter.next()) != NULL) {
+      delete[] (char*)subsession->sessionId;
+      subsession->sessionId = NULL;
+    }
+    delete[] fLastSessionId; fLastSessionId = NULL;
+  }
+
+  // Await the response:
+  request->fNext = fRequestsAwaitingResponse;
+  fRequestsAwaitingResponse = request;
+  return True;
+}
+
+Boolean RTSPClient::sendPendingRequests() {
+  // Returns False iff a response handler deleted us
+  while (fRequestsAwaitingSending != NULL && !fConnectionIsPending) {
+    RequestRecord* request = fRequestsAwaitingSending;
+    if (request->needsSessionId()
+	&& fLastSessionId == NULL && fNumSetupsAwaitingSessionId > 0) {
+      break; // wait for the outstanding "SETUP"'s response
+    }
+
+    fRequestsAwaitingSending = request->fNext;
+    request->fNext = NULL;
+    if (!sendRequestNow(request)) {
+      int resultCode = -envir().getErrno();
+      if (resultCode == 0) resultCode = -1;
+      if (!callResponseHandler(request, resultCode, strDup(envir().getResultMsg()))) {
+	return False;
+      }
+    }
+  }
+
+  return True;
+}
+
+void RTSPClient::incomingDataHandler(void* instance, int /*mask*/) {
+  RTSPClient* client = (RTSPClient*)instance;
+  client->incomingDataHandler1();
+}
+
+void RTSPClient::incomingDataHandler1() {
+  struct sockaddr_in fromAddress;
+  int bytesRead
+    = readSocket(envir(), fInputSocketNum,
+		 (unsigned char*)&fResponseBuffer[fResponseBytesAlreadySeen],
+		 fResponseBufferSize - fResponseBytesAlreadySeen, fromAddress);
+  handleResponseBytes(bytesRead);
+}
+
+void RTSPClient::handleAlternativeRequestByte(void* instance,
+					      u_int8_t requestByte) {
+  RTSPClient* client = (RTSPClient*)instance;
+  client->handleAlternativeRequestByte1(requestByte);
+}
+
+void RTSPClient::handleAlternativeRequestByte1(u_int8_t requestByte) {
+  if (requestByte == 0xFF) {
+    // The (RTP-over-TCP) read of our socket failed:
+    handleResponseBytes(-1);
+  } else if (requestByte == 0xFE) {
+    // Our socket's no longer being read for RTP-over-TCP, so read it ourself again:
+    envir().taskScheduler().turnOnBackgroundReadHandling(fInputSocketNum,
+	 (TaskScheduler::BackgroundHandlerProc*)&incomingDataHandler, this);
+  } else {
+    // A byte of a RTSP response (or request), read by "RTPInterface":
+    fResponseBuffer[fResponseBytesAlreadySeen] = requestByte;
+    handleResponseBytes(1);
+  }
+}
+
+void RTSPClient::handleResponseBytes(int newBytesRead) {
+  if (newBytesRead <= 0) {
+    if (newBytesRead == 0) {
+      envir().setResultMsg("Failed to read response: Connection was closed by the remote host.");
+    }
+    int resultCode = newBytesRead < 0 ? -envir().getErrno() : 0;
+    closeConnectionAsync(resultCode == 0 ? -1 : resultCode);
+    return;
+  }
+
+  fResponseBytesAlreadySeen += newBytesRead;
+  while (fResponseBytesAlreadySeen > 0) {
+    // Handle each complete response (or request) in turn:
+    if (handleOneResponse() <= 0) break;
+  }
+}
+
+int RTSPClient::handleOneResponse() {
+  // Returns 1 if we handled (or skipped) a response, 0 if we need more
+  // data, or -1 if we were deleted, or our connection closed
+  char* buf = fResponseBuffer;
+
+  // Skip interleaved RTP (or RTCP)-over-TCP packets (which come here only
+  // when nothing's reading them), and any CR or LF before the response:
+  unsigned numSkipped = 0;
+  while (numSkipped < fResponseBytesAlreadySeen) {
+    unsigned numRemaining = fResponseBytesAlreadySeen - numSkipped;
+    if (fInterleavedBytesToSkip > 0) {
+      unsigned n = fInterleavedBytesToSkip < numRemaining
+	? fInterleavedBytesToSkip : numRemaining;
+      numSkipped += n;
+      fInterleavedBytesToSkip -= n;
+    } else if (buf[numSkipped] == '\r' || buf[numSkipped] == '\n') {
+      ++numSkipped;
+    } else if (buf[numSkipped] == '$') {
+      if (numRemaining < 4) break;
+      u_int8_t const* sizePtr = (u_int8_t const*)&buf[numSkipped+2];
+      fInterleavedBytesToSkip = 4 + ((sizePtr[0]<<8)|sizePtr[1]);
+    } else {
+      break;
+    }
+  }
+  consumeResponseBytes(numSkipped);
+  if (fResponseBytesAlreadySeen == 0 || buf[0] == '$') return 0;
+
+  // Look for the end of the header lines:
+  buf[fResponseBytesAlreadySeen] = '\0';
+  char* headersEnd = strstr(buf, "\r\n\r\n");
+  unsigned headerSize;
+  if (headersEnd != NULL) {
+    headerSize = headersEnd + 4 - buf;
+  } else if ((headersEnd = strstr(buf, "\n\n")) != NULL) {
+    headerSize = headersEnd + 2 - buf;
+  } else {
+    if (fResponseBytesAlreadySeen < fResponseBufferSize) return 0;
+
+    envir().setResultMsg("We received a response not ending with <CR><LF><CR><LF>");
+    return closeConnectionAsync(-1) ? 0 : -1;
+  }
+
+  // Check its "CSeq:" and "Content-Length:" (without changing the headers yet):
+  unsigned cseq = 0;
+  int contentLength = 0;
+  for (char const* line = buf; line != NULL && line < headersEnd; ) {
+    if (sscanf(line, "CSeq: %u", &cseq) != 1
+	&& sscanf(line, "Content-Length: %d", &contentLength) != 1) {
+      sscanf(line, "Content-length: %d", &contentLength);
+    }
+    line = strchr(line, '\n');
+    if (line != NULL) ++line;
+  }
+  if (contentLength < 0) contentLength = 0;
+  if (headerSize + contentLength > fResponseBytesAlreadySeen) {
+    if (headerSize + contentLength <= fResponseBufferSize) return 0;
+
+    char tmpBuf[200];
+    sprintf(tmpBuf, "Read buffer size (%d) is too small for \"Content-length:\" %d\n",
+	    fResponseBufferSize, contentLength);
+    envir().setResultMsg(tmpBuf);
+    return closeConnectionAsync(-1) ? 0 : -1;
+  }
+  unsigned messageSize = headerSize + contentLength;
+
+  if (strncmp(buf, "RTSP/", 5) != 0) {
+    // This is a request from the server:
+    char cmdName[RTSP_PARAM_STRING_MAX];
+    char urlPreSuffix[RTSP_PARAM_STRING_MAX];
+    char urlSuffix[RTSP_PARAM_STRING_MAX];
+    char cseqStr[RTSP_PARAM_STRING_MAX];
+    if (parseRTSPRequestString(buf, headerSize,
+			       cmdName, sizeof cmdName,
+			       urlPreSuffix, sizeof urlPreSuffix,
+			       urlSuffix, sizeof urlSuffix,
+			       cseqStr, sizeof cseqStr)) {
+      if (fVerbosityLevel >= 1) {
+	envir() << "Received request: " << buf << "\n";
+      }
+      handleCmd_notSupported(cseqStr);
+    }
+    consumeResponseBytes(messageSize);
+    return 1;
+  }
+
+  // Find (and remove) the request that this responds to:
+  RequestRecord* request = NULL;
+  for (RequestRecord** requestPtr = &fRequestsAwaitingResponse;
+       *requestPtr != NULL; requestPtr = &((*requestPtr)->fNext)) {
+    if ((*requestPtr)->fCSeq == cseq) {
+      request = *requestPtr;
+      *requestPtr = request->fNext;
+      request->fNext = NULL;
+      break;
+    }
+  }
+  if (request == NULL) {
+    if (fVerbosityLevel >= 1) {
+      envir() << "Ignoring a response with unknown \"CSeq:\" " << cseq << "\n";
+    }
+    consumeResponseBytes(messageSize);
+    return 1;
+  }
+  if (fVerbosityLevel >= 1) {
+    envir() << "Received " << request->fCommandName << " response: " << buf << "\n";
+  }
+
+  // Copy the body (if any), then split the header lines:
+  char* body = new char[contentLength+1];
+  memmove(body, &buf[headerSize], contentLength);
+  body[contentLength] = '\0';
+  buf[headerSize] = '\0';
+  char* firstLine = buf;
+  char* nextLineStart = getLine(firstLine);
+  unsigned responseCode;
+  if (!parseResponseCode(firstLine, responseCode)) responseCode = 0;
+
+  return handleResponse(request, responseCode, firstLine, nextLineStart,
+			body, messageSize) ? 1 : -1;
+}
+
+void RTSPClient::consumeResponseBytes(unsigned numBytes) {
+  if (numBytes == 0) return;
+
+  fResponseBytesAlreadySeen -= numBytes;
+  memmove(fResponseBuffer, &fResponseBuffer[numBytes], fResponseBytesAlreadySeen);
+}
+
+Boolean RTSPClient::handleResponse(RequestRecord* request,
+				   unsigned responseCode,
+				   char* firstLine, char* nextLineStart,
+				   char* body, unsigned messageSize) {
+  // Returns False iff a response handler deleted us.  The response (the
+  // first "messageSize" bytes of "fResponseBuffer") is consumed here.
+  char const* cmdName = request->fCommandName;
+  int resultCode = 0;
+  char* resultString = NULL;
+  Boolean unblocksRequests = False;
+
+  if (request->fIsAwaitingSessionId) {
+    request->fIsAwaitingSessionId = False;
+    --fNumSetupsAwaitingSessionId;
+    unblocksRequests = True;
+  }
+
+  if (responseCode == 401 && !request->fHaveRetriedAuthentication
+      && fCurrentAuthenticator.username() != NULL) {
+    // Fill in "fCurrentAuthenticator" from the response, and try again:
+    checkForAuthenticationFailure(responseCode, nextLineStart, &fCurrentAuthenticator);
+    if (fCurrentAuthenticator.realm() != NULL) {
+      consumeResponseBytes(messageSize);
+      delete[] body;
+      request->fHaveRetriedAuthentication = True;
+      request->fCSeq = ++fCSeq;
+      if (!sendRequestNow(request)) {
+	if (!callResponseHandler(request, -1, strDup(envir().getResultMsg()))) {
+	  return False;
+	}
+      }
+      return unblocksRequests ? sendPendingRequests() : True;
+    }
+  }
+
+  if (responseCode != 200) {
+    resultCode = responseCode == 0 ? -1 : (int)responseCode;
+    resultString = strDup(firstLine);
+    envir().setResultMsg(cmdName, ": cannot handle response: ", firstLine);
+  } else if (strcmp(cmdName, "DESCRIBE") == 0) {
+    // Note a "Content-Base:" header (if any); the result is the SDP description:
+    delete[] fBaseURL; fBaseURL = strDup(request->fURL);
+    for (char* lineStart = nextLineStart; lineStart != NULL; ) {
+      char* next = getLine(lineStart);
+      if (strncmp(lineStart, "Content-Base:", 13) == 0) {
+	char const* cb = &lineStart[13];
+	while (*cb == ' ' || *cb == '\t') ++cb;
+	if (*cb != '\0') {
+	  delete[] fBaseURL; fBaseURL = strDup(cb);
+	}
+      }
+      lineStart = next;
+    }
+    resultString = strDup(body);
+  } else if (strcmp(cmdName, "OPTIONS") == 0) {
+    for (char* lineStart = nextLineStart; lineStart != NULL; ) {
+      char* next = getLine(lineStart);
+      if (strncmp(lineStart, "Public:", 7) == 0) {
+	char const* options = &lineStart[7];
+	while (*options == ' ' || *options == '\t') ++options;
+	delete[] resultString; resultString = strDup(options);
+      }
+      lineStart = next;
+    }
+  } else if (strcmp(cmdName, "SETUP") == 0) {
+    unsigned cLength;
+    if (handleSETUPResponse(*request->fSubsession, nextLineStart,
+			    request->fStreamUsingTCP, cLength)) {
+      if (request->fStreamUsingTCP) {
+	// "RTPInterface" will read our socket once the subsession is being
+	// played; have it pass us the bytes of RTSP responses:
+	RTPInterface::setAlternativeByteHandler(envir(), fInputSocketNum,
+						handleAlternativeRequestByte, this);
+      }
+      unblocksRequests = True;
+    } else {
+      resultCode = -1;
+    }
+    resultString = strDup(firstLine);
+  } else if (strcmp(cmdName, "PLAY") == 0) {
+    handlePLAYResponse(*request->fSession, nextLineStart);
+    resultString = strDup(firstLine);
+  } else {
+    resultString = strDup(firstLine);
+  }
+
+  consumeResponseBytes(messageSize);
+  delete[] body;
+
+  if (unblocksRequests && !sendPendingRequests()) {
+    delete request;
+    delete[] resultString;
+    return False;
+  }
+  return callResponseHandler(request, resultCode, resultString);
+}
+
+Boolean RTSPClient::callResponseHandler(RequestRecord* request,
+					int resultCode, char* resultString) {
+  // Returns False iff the handler deleted us
+  responseHandler* handler = request->fHandler;
+  void* clientData = request->fClientData;
+  delete request;
+  if (handler == NULL) {
+    delete[] resultString;
+    return True;
+  }
+
+  Boolean wasDeleted = False;
+  Boolean* prevDeletionFlag = fDeletionFlag;
+  fDeletionFlag = &wasDeleted;
+  (*handler)(this, clientData, resultCode, resultString);
+  if (wasDeleted) {
+    if (prevDeletionFlag != NULL) *prevDeletionFlag = True;
+    return False;
+  }
+  fDeletionFlag = prevDeletionFlag;
+  return True;
+}
+
+Boolean RTSPClient::closeConnectionAsync(int resultCode) {
+  // Returns False iff a response handler deleted us
+  if (fInputSocketNum >= 0) {
+    envir().taskScheduler().turnOffBackgroundReadHandling(fInputSocketNum);
+    envir().taskScheduler().turnOffBackgroundWriteHandling(fInputSocketNum);
+    RTPInterface::setAlternativeByteHandler(envir(), fInputSocketNum, NULL, NULL);
+  }
+  resetTCPSockets();
+  fConnectionIsPending = False;
+  fNumSetupsAwaitingSessionId = 0;
+  fResponseBytesAlreadySeen = fInterleavedBytesToSkip = 0;
+
+  // Fail each outstanding request (those awaiting a response first).  The
+  // handlers may queue new requests (on a new connection), so take ours now:
+  RequestRecord* requests = fRequestsAwaitingResponse;
+  RequestRecord** last = &requests;
+  while (*last != NULL) last = &((*last)->fNext);
+  *last = fRequestsAwaitingSending;
+  fRequestsAwaitingResponse = fRequestsAwaitingSending = NULL;
+
+  while (requests != NULL) {
+    RequestRecord* request = requests;
+    requests = request->fNext;
+    if (!callResponseHandler(request, resultCode, strDup(envir().getResultMsg()))) {
+      while (requests != NULL) {
+	request = requests;
+	requests = request->fNext;
+	delete request;
+      }
+      return False;
+    }
+  }
+
+  return True;
+}
+
+void RTSPClient::completeUnansweredRequests(void* clientData) {
+  RTSPClient* client = (RTSPClient*)clientData;
+  client->completeUnansweredRequests1();
+}
+
+void RTSPClient::completeUnansweredRequests1() {
+  fUnansweredRequestsTask = NULL;
+
+  RequestRecord** requestPtr = &fRequestsAwaitingResponse;
+  while (*requestPtr != NULL) {
+    RequestRecord* request = *requestPtr;
+    if (request->fWillBeAnswered) {
+      requestPtr = &request->fNext;
+      continue;
+    }
+
+    *requestPtr = request->fNext;
+    request->fNext = NULL;
+    if (!callResponseHandler(request, 0, NULL)) return;
+    requestPtr = &fRequestsAwaitingResponse; // start again, in case it changed
+  }
+}
@@ -20,6 +20,8 @@ along with this library; if not, write to the Free Software Foundation, Inc.,
 
 #include "RTSPServer.hh"
 #include "RTSPCommon.hh"
+#include "MetricsRegistry.hh"
+#include "RTCP.hh"
 #include <GroupsockHelper.hh>
 
 #if defined(__WIN32__) || defined(_WIN32) || defined(_QNX4)
@@ -200,7 +202,7 @@ RTSPServer::RTSPServer(UsageEnvironment& env,
     fServerSocket(ourSocket), fServerPort(ourPort),
     fAuthDB(authDatabase), fReclamationTestSeconds(reclamationTestSeconds),
     fServerMediaSessions(HashTable::create(STRING_HASH_KEYS)),
-    fSessionIdCounter(0) {
+    fSessionIdCounter(0), fClientSessions(NULL) {
 #ifdef USE_SIGNALS
   // Ignore the SIGPIPE signal, so that clients on the same host that are killed
   // don't also kill us:
@@ -276,14 +278,18 @@ void RTSPServer::incomingConnectionHandler1() {
 RTSPServer::RTSPClientSession
 ::RTSPClientSession(RTSPServer& ourServer, unsigned sessionId,
 	      int clientSocket, struct sockaddr_in clientAddr)
-  : fOurServer(ourServer), fOurSessionId(sessionId),
+  : fOurServer(ourServer), fNextClientSession(ourServer.fClientSessions),
+    fOurSessionId(sessionId),
     fOurServerMediaSession(NULL),
     fClientSocket(clientSocket), fClientAddr(clientAddr),
     fLivenessCheckTask(NULL),
     fIsMulticast(False), fSessionIsActive(True), fStreamAfterSETUP(False),
+    fSessionBeingWaitedFor(NULL), fSubsessionBeingWaitedFor(NULL),
+    fIsRetryingRequest(False),
     fTCPStreamIdCount(0), fNumStreamStates(0), fStreamStates(NULL) {
     
   DEBUG_LOG(INF, "[sessionId=%d]Construct RTSPClientSession", fOurSessionId);
+  ourServer.fClientSessions = this;
   // RTSPỰArrange to handle incoming requests:
   resetRequestBuffer();
   envir().taskScheduler().turnOnBackgroundReadHandling(fClientSocket,
@@ -293,9 +299,15 @@ RTSPServer::RTSPClientSession
 
 RTSPServer::RTSPClientSession::~RTSPClientSession() {
   DEBUG_LOG(INF, "[%d]Deconstruct RTSPClientSession", fOurSessionId);
+  RTSPClientSession** ptr = &fOurServer.fClientSessions;
+  while (*ptr != this) ptr = &(*ptr)->fNextClientSession;
+  *ptr = fNextClientSession;
+
   // Turn off any liveness checking:
   envir().taskScheduler().unscheduleDelayedTask(fLivenessCheckTask);
 
+  stopWaiting();
+
   // Turn off background read handling:
   envir().taskScheduler().turnOffBackgroundReadHandling(fClientSocket);
 
@@ -383,6 +395,10 @@ void RTSPServer::RTSPClientSession::incomingRequestHandler1() {
 
   if (!endOfMsg) return; // subsequent reads will be needed to complete the request
 
+  handleRequest();
+}
+
+void RTSPServer::RTSPClientSession::handleRequest() {
   // Parse the request string into command name and 'CSeq',
   // then handle the command:
   // е
@@ -425,6 +441,14 @@ void RTSPServer::RTSPClientSession::incomingRequestHandler1() {
       handleCmd_notSupported(cseq);
     }
   }
+  fIsRetryingRequest = False;
+
+  if (fSessionBeingWaitedFor != NULL || fSubsessionBeingWaitedFor != NULL) {
+    // We'll answer once it's ready.  Until then, read no more requests:
+    DEBUG_LOG(INF, "[%d]Wait to answer '%s'", fOurSessionId, cmdName);
+    envir().taskScheduler().turnOffBackgroundReadHandling(fClientSocket);
+    return;
+  }
 
   DEBUG_LOG(INF, "[%d]Send %d bytes: \n%s", 
     fOurSessionId, strlen((char*)fResponseBuffer), fResponseBuffer);
@@ -448,6 +472,37 @@ void RTSPServer::RTSPClientSession::incomingRequestHandler1() {
     delete this;
 }
 
+void RTSPServer::RTSPClientSession::readyHandler(void* clientData) {
+  RTSPClientSession* session = (RTSPClientSession*)clientData;
+  session->readyHandler1();
+}
+
+void RTSPServer::RTSPClientSession::readyHandler1() {
+  stopWaiting();
+  envir().taskScheduler().turnOnBackgroundReadHandling(fClientSocket,
+     (TaskScheduler::BackgroundHandlerProc*)&incomingRequestHandler, this);
+  noteLiveness();
+
+  fIsRetryingRequest = True;
+  handleRequest(); // note: this may delete us
+}
+
+void RTSPServer::RTSPClientSession::stopWaiting() {
+  if (fSubsessionBeingWaitedFor != NULL) {
+    fSubsessionBeingWaitedFor->cancelReadyHandler(this);
+    fSubsessionBeingWaitedFor = NULL;
+  }
+
+  ServerMediaSession* session = fSessionBeingWaitedFor;
+  if (session == NULL) return;
+  fSessionBeingWaitedFor = NULL;
+  session->cancelReadyHandler(this);
+  session->decrementReferenceCount();
+  if (session->referenceCount() == 0 && session->deleteWhenUnreferenced()) {
+    fOurServer.removeServerMediaSession(session);
+  }
+}
+
 // Handler routines for specific RTSP commands:
 
 // Generate a "Date:" header for use in a RTSP response:
@@ -533,6 +588,12 @@ void RTSPServer::RTSPClientSession
       handleCmd_notFound(cseq);
       break;
     }
+    if (!fIsRetryingRequest && !session->isReady(readyHandler, this)) {
+      // Answer once it is:
+      fSessionBeingWaitedFor = session;
+      session->incrementReferenceCount();
+      break;
+    }
 
     // Then, assemble a SDP description for this session:
     sdpDescription = session->generateSDPDescription();
@@ -698,6 +759,7 @@ void RTSPServer::RTSPClientSession
       subsession = iter.next();
       fStreamStates[i].subsession = subsession;
       fStreamStates[i].streamToken = NULL; // for now; reset by SETUP later
+      fStreamStates[i].isOverTCP = False;
     }
   }
 
@@ -735,6 +797,11 @@ void RTSPServer::RTSPClientSession
     subsession = fStreamStates[streamNum].subsession;
   }
   // ASSERT: subsession != NULL
+  if (!fIsRetryingRequest && !subsession->isReady(readyHandler, this)) {
+    // Answer once it is.  (Nothing above needs undoing when we do.)
+    fSubsessionBeingWaitedFor = subsession;
+    return;
+  }
 
   // ѰTransportֶΡLook for a "Transport:" header in the request string,
   // to extract client parameters:
@@ -755,6 +822,7 @@ void RTSPServer::RTSPClientSession
     rtpChannelId = fTCPStreamIdCount; rtcpChannelId = fTCPStreamIdCount+1;
   }
   fTCPStreamIdCount += 2;
+  fStreamStates[streamNum].isOverTCP = streamingMode == RTP_TCP;
 
   Port clientRTPPort(clientRTPPortNum);
   Port clientRTCPPort(clientRTCPPortNum);
@@ -1289,6 +1357,116 @@ RTSPServer::createNewClientSession(unsigned sessionId, int clientSocket, struct
   return new RTSPClientSession(*this, sessionId, clientSocket, clientAddr);
 }
 
+void RTSPServer::collectMetrics(Medium& server, MetricsWriter& writer) {
+  ((RTSPServer&)server).writeMetrics(writer);
+}
+
+void RTSPServer::writeMetrics(MetricsWriter& writer) {
+  unsigned numConnections = 0;
+  RTSPClientSession* clientSession;
+  for (clientSession = fClientSessions; clientSession != NULL;
+       clientSession = clientSession->nextClientSession()) {
+    ++numConnections;
+  }
+  writer.gauge("rtsp_connections", "RTSP connections (client sessions)",
+	       numConnections);
+
+  ServerMediaSessionIterator iter(*this);
+  ServerMediaSession* serverMediaSession;
+  while ((serverMediaSession = iter.next()) != NULL) {
+    unsigned numSessions = 0;
+    for (clientSession = fClientSessions; clientSession != NULL;
+	 clientSession = clientSession->nextClientSession()) {
+      if (clientSession->serverMediaSession() == serverMediaSession) ++numSessions;
+    }
+    MetricsLabels labels;
+    labels.add("stream", serverMediaSession->streamName());
+    writer.gauge("rtsp_sessions", "Client sessions that have set up the stream",
+		 labels, numSessions);
+
+    // Each shared pipeline's state, as one 1-valued sample (and a 0-valued
+    // sample for each other state):
+    ServerMediaSubsessionIterator subsessionIter(*serverMediaSession);
+    ServerMediaSubsession* subsession;
+    while ((subsession = subsessionIter.next()) != NULL) {
+      ServerMediaSubsession::PipelineState state = subsession->pipelineState();
+      if (state == ServerMediaSubsession::PIPELINE_NONE) continue;
+
+      for (int s = ServerMediaSubsession::PIPELINE_IDLE;
+	   s <= ServerMediaSubsession::PIPELINE_DRAINING; ++s) {
+	MetricsLabels stateLabels(labels);
+	stateLabels.add("track", subsession->trackId())
+	  .add("state", ServerMediaSubsession
+	       ::pipelineStateName((ServerMediaSubsession::PipelineState)s));
+	writer.gauge("pipeline_state",
+		     "The state of the stream's shared source and packetizer",
+		     stateLabels, s == state ? 1 : 0);
+      }
+    }
+  }
+
+  for (clientSession = fClientSessions; clientSession != NULL;
+       clientSession = clientSession->nextClientSession()) {
+    clientSession->writeMetrics(writer);
+  }
+}
+
+void RTSPServer::RTSPClientSession::writeMetrics(MetricsWriter& writer) {
+  if (fOurServerMediaSession == NULL) return; // nothing's been set up yet
+
+  char const* clientAddress = our_inet_ntoa(fClientAddr.sin_addr);
+  for (unsigned i = 0; i < fNumStreamStates; ++i) {
+    ServerMediaSubsession* subsession = fStreamStates[i].subsession;
+    if (subsession == NULL || fStreamStates[i].streamToken == NULL) continue;
+
+    RTPSink* rtpSink; RTCPInstance* rtcp;
+    subsession->getRTPSinkandRTCP(fStreamStates[i].streamToken, rtpSink, rtcp);
+    if (rtpSink == NULL) continue;
+
+    MetricsLabels labels;
+    labels.add("stream", fOurServerMediaSession->streamName())
+      .add("track", subsession->trackId())
+      .add("session", fOurSessionId)
+      .add("client", clientAddress)
+      .add("transport", fStreamStates[i].isOverTCP ? "tcp" : "udp");
+    // (A sink that's shared by several sessions is counted under each.)
+    writer.counter("rtp_packets_sent_total", "RTP packets sent",
+		   labels, rtpSink->packetCount());
+    writer.counter("rtp_payload_bytes_sent_total", "RTP payload bytes sent",
+		   labels, rtpSink->octetCount());
+
+    // What this client's receivers (identified by their address, as a sink
+    // may be shared) have said about it, in their latest RTCP reports:
+    RTPTransmissionStatsDB::Iterator statsIter(rtpSink->transmissionStatsDB());
+    RTPTransmissionStats* stats;
+    while ((stats = statsIter.next()) != NULL) {
+      if (stats->lastFromAddress().sin_addr.s_addr
+	  != fClientAddr.sin_addr.s_addr) continue;
+
+      MetricsLabels receiverLabels(labels);
+      receiverLabels.add("ssrc", stats->SSRC());
+      writer.counter("rtp_receiver_packets_lost_total",
+		     "Packets reported lost by the receiver",
+		     receiverLabels, stats->totNumPacketsLost());
+      writer.gauge("rtp_receiver_fraction_lost",
+		   "Fraction of packets lost, since the receiver's previous report",
+		   receiverLabels, stats->packetLossRatio()/256.0);
+      writer.gauge("rtp_receiver_jitter_seconds",
+		   "Interarrival jitter, as reported by the receiver",
+		   receiverLabels,
+		   stats->jitter()/(double)rtpSink->rtpTimestampFrequency());
+      writer.gauge("rtp_receiver_round_trip_seconds",
+		   "Round-trip delay, from the receiver's latest report",
+		   receiverLabels, stats->roundTripDelay()/65536.0);
+      writer.gauge("rtp_receiver_lag_packets",
+		   "Packets sent since the latest that the receiver had reported receiving",
+		   receiverLabels,
+		   (u_int16_t)(rtpSink->currentSeqNo() - 1
+			       - stats->lastPacketNumReceived()));
+    }
+  }
+}
+
 
 ////////// ServerMediaSessionIterator implementation //////////
 
@@ -0,0 +1,97 @@
+/**********
+This library is free software; you can redistribute it and/or modify it under
+the terms of the GNU Lesser General Public License as published by the
+Free Software Foundation; either version 2.1 of the License, or (at your
+option) any later version. (See <http://www.gnu.org/copyleft/lesser.html>.)
+
+This library is distributed in the hope that it will be useful, but WITHOUT
+ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for
+more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with this library; if not, write to the Free Software Foundation, Inc.,
+51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA
+**********/
+// "liveMedia"
+// Copyright (c) 1996-2009 Live Networks, Inc.  All rights reserved.
+// A RTP sink that relays - to its fan-out sinks - the RTP packets of a
+// stream received from elsewhere, without depacketizing or repacketizing them
+// Implementation
+
+#include "RelayRTPSink.hh"
+#include "GroupsockHelper.hh"
+#include "LogMacros.hh"
+
+#define RTP_HEADER_SIZE 12
+#define RELAY_MAX_PACKET_SIZE 1500 // the most that an unfragmented UDP
+                                   // packet can carry, on Ethernet
+
+RelayRTPSink* RelayRTPSink::createNew(UsageEnvironment& env,
+				      Groupsock* RTPgs,
+				      MediaSubsession& upstream) {
+  return new RelayRTPSink(env, RTPgs, upstream);
+}
+
+RelayRTPSink::RelayRTPSink(UsageEnvironment& env, Groupsock* RTPgs,
+			   MediaSubsession& upstream)
+  : MultiFramedRTPSink(env, RTPgs, upstream.rtpPayloadFormat(),
+		       upstream.rtpTimestampFrequency(), upstream.codecName(),
+		       upstream.numChannels()),
+    fUpstream(upstream), fNumDiscardedPackets(0) {
+  // (so that our retransmission history has room for any packet:)
+  setPacketSizes(RELAY_MAX_PACKET_SIZE, RELAY_MAX_PACKET_SIZE);
+  fPacket = new unsigned char[RELAY_MAX_PACKET_SIZE];
+}
+
+RelayRTPSink::~RelayRTPSink() {
+  delete[] fPacket;
+}
+
+char const* RelayRTPSink::sdpMediaType() const {
+  return fUpstream.mediumName();
+}
+
+Boolean RelayRTPSink::continuePlaying() {
+  if (fSource == NULL) return False;
+
+  fSource->getNextFrame(fPacket, RELAY_MAX_PACKET_SIZE,
+			afterGettingPacket, this, onSourceClosure, this);
+  return True;
+}
+
+void RelayRTPSink::afterGettingPacket(void* clientData, unsigned packetSize,
+				      unsigned numTruncatedBytes,
+				      struct timeval /*presentationTime*/,
+				      unsigned /*durationInMicroseconds*/) {
+  ((RelayRTPSink*)clientData)->afterGettingPacket1(packetSize,
+						   numTruncatedBytes);
+}
+
+void RelayRTPSink::afterGettingPacket1(unsigned packetSize,
+				       unsigned numTruncatedBytes) {
+  RTPSource* rtpSource = fUpstream.rtpSource();
+  if (numTruncatedBytes > 0 || packetSize < RTP_HEADER_SIZE
+      || (fPacket[0]&0xC0) != 0x80 // not RTP version 2
+      || (fPacket[1]&0x7F) != rtpPayloadType() || rtpSource == NULL) {
+    ++fNumDiscardedPackets;
+  } else {
+    u_int16_t seqNo = (fPacket[2]<<8)|fPacket[3];
+    u_int32_t rtpTimestamp = ntohl(*(u_int32_t*)&fPacket[4]);
+    u_int32_t SSRC = ntohl(*(u_int32_t*)&fPacket[8]);
+
+    // Note the packet as the upstream "RTPSource" would have, which also
+    // gives us its presentation time (synchronized, once RTCP has been):
+    struct timeval presentationTime;
+    Boolean hasBeenSyncedUsingRTCP;
+    rtpSource->receptionStatsDB()
+      .noteIncomingPacket(SSRC, seqNo, rtpTimestamp,
+			  rtpTimestampFrequency(), True /*useForJitterCalculation*/,
+			  presentationTime, hasBeenSyncedUsingRTCP,
+			  packetSize - RTP_HEADER_SIZE);
+
+    relayPacket(fPacket, packetSize, presentationTime);
+  }
+
+  continuePlaying();
+}
@@ -84,7 +84,7 @@ ServerMediaSession::ServerMediaSession(UsageEnvironment& env,
 
 ServerMediaSession::~ServerMediaSession() {
   DEBUG_LOG(INF, "Deconstruct ServerMediaSession");
-  Medium::close(fSubsessionsHead);
+  deleteAllSubsessions();
   delete[] fStreamName;
   delete[] fInfoSDPString;
   delete[] fDescriptionSDPString;
@@ -189,6 +189,20 @@ float ServerMediaSession::duration() const {
   }
 }
 
+Boolean ServerMediaSession::isReady(readyHandler* /*handler*/,
+				    void* /*clientData*/) {
+  return True; // default implementation
+}
+
+void ServerMediaSession::cancelReadyHandler(void* /*clientData*/) {
+}
+
+void ServerMediaSession::deleteAllSubsessions() {
+  Medium::close(fSubsessionsHead);
+  fSubsessionsHead = fSubsessionsTail = NULL;
+  fSubsessionCounter = 0;
+}
+
 Boolean ServerMediaSession::isServerMediaSession() const {
   return True;
 }
@@ -230,6 +244,7 @@ char* ServerMediaSession::generateSDPDescription() {
       sdpLength += strlen(sdpLines);
     }
     if (subsession != NULL) break; // an error occurred
+    if (fSubsessionsHead == NULL) break; // there's no media (e.g., yet)
 
     // Unless subsessions have differing durations, we also have a "a=range:" line:
     float dur = duration();
@@ -363,6 +378,29 @@ void ServerMediaSubsession::deleteStream(unsigned /*clientSessionId*/,
   // default implementation: do nothing
 }
 
+void ServerMediaSubsession::getRTPSinkandRTCP(void* /*streamToken*/,
+					      RTPSink*& rtpSink,
+					      RTCPInstance*& rtcp) {
+  // default implementation: there are none
+  rtpSink = NULL;
+  rtcp = NULL;
+}
+
+ServerMediaSubsession::PipelineState ServerMediaSubsession::pipelineState() const {
+  // default implementation: there's no shared pipeline
+  return PIPELINE_NONE;
+}
+
+char const* ServerMediaSubsession::pipelineStateName(PipelineState state) {
+  switch (state) {
+  case PIPELINE_IDLE: return "idle";
+  case PIPELINE_READY: return "ready";
+  case PIPELINE_RUNNING: return "running";
+  case PIPELINE_DRAINING: return "draining";
+  default: return "none";
+  }
+}
+
 void ServerMediaSubsession::testScaleFactor(float& scale) {
   // default implementation: Support scale = 1 only
   scale = 1;
@@ -373,6 +411,14 @@ float ServerMediaSubsession::duration() const {
   return 0.0;
 }
 
+Boolean ServerMediaSubsession::isReady(readyHandler* /*handler*/,
+				       void* /*clientData*/) {
+  return True; // default implementation
+}
+
+void ServerMediaSubsession::cancelReadyHandler(void* /*clientData*/) {
+}
+
 void ServerMediaSubsession::setServerAddressAndPortForSDP(netAddressBits addressBits,
 							  portNumBits portBits) {
   fServerAddressForSDP = addressBits;
@@ -0,0 +1,383 @@
+/**********
+This library is free software; you can redistribute it and/or modify it under
+the terms of the GNU Lesser General Public License as published by the
+Free Software Foundation; either version 2.1 of the License, or (at your
+option) any later version. (See <http://www.gnu.org/copyleft/lesser.html>.)
+
+This library is distributed in the hope that it will be useful, but WITHOUT
+ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for
+more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with this library; if not, write to the Free Software Foundation, Inc.,
+51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA
+**********/
+// "liveMedia"
+// Copyright (c) 1996-2009 Live Networks, Inc.  All rights reserved.
+// RFC 5109 "ULPFEC" parity packets: generation (for "MultiFramedRTPSink")
+// and recovery of lost packets (for "MultiFramedRTPSource")
+// Implementation
+
+#include "ULPFEC.hh"
+#include <string.h>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define ULPFEC_USE_SSE2
+#endif
+
+// The layout of the FEC packets that we build (RFC 5109, section 7):
+//   12 bytes: RTP header (filled in by the sink)
+//   10 bytes: FEC header
+//    8 bytes: FEC level 0 header, always with the 48-bit mask ("L" = 1)
+//   the XOR of the protected packets' payloads (everything after their
+//   fixed 12-byte RTP headers)
+#define RTP_HEADER_SIZE 12
+#define FEC_HEADER_SIZE 10
+#define LONG_LEVEL_HEADER_SIZE 8
+#define SHORT_LEVEL_HEADER_SIZE 4
+#define FEC_PAYLOAD_OFFSET (RTP_HEADER_SIZE + FEC_HEADER_SIZE + LONG_LEVEL_HEADER_SIZE)
+
+static void xorBytes(unsigned char* to, unsigned char const* from,
+		     unsigned numBytes) {
+#ifdef ULPFEC_USE_SSE2
+  for (; numBytes >= 16; numBytes -= 16, to += 16, from += 16) {
+    __m128i a = _mm_loadu_si128((__m128i const*)to);
+    __m128i b = _mm_loadu_si128((__m128i const*)from);
+    _mm_storeu_si128((__m128i*)to, _mm_xor_si128(a, b));
+  }
+#else
+  for (; numBytes >= 4; numBytes -= 4, to += 4, from += 4) {
+    *(u_int32_t*)to ^= *(u_int32_t const*)from;
+  }
+#endif
+  while (numBytes-- > 0) *to++ ^= *from++;
+}
+
+
+////////// ParityGroup //////////
+
+// The FEC packet being built for one row or column
+
+class ParityGroup {
+public:
+  ParityGroup();
+  virtual ~ParityGroup();
+
+  void init(unsigned maxPacketSize);
+  void reset(u_int16_t snBase);
+  void add(unsigned char const* packet, unsigned packetSize);
+  unsigned char* finish(unsigned& packetSize);
+
+private:
+  unsigned char* fBuf;
+  unsigned fMaxPayloadSize;
+  u_int16_t fSNBase;
+  unsigned fProtectionLength;
+  unsigned char fMask[6];
+};
+
+ParityGroup::ParityGroup()
+  : fBuf(NULL), fMaxPayloadSize(0), fSNBase(0), fProtectionLength(0) {
+  memset(fMask, 0, sizeof fMask);
+}
+
+ParityGroup::~ParityGroup() {
+  delete[] fBuf;
+}
+
+void ParityGroup::init(unsigned maxPacketSize) {
+  fMaxPayloadSize = maxPacketSize - RTP_HEADER_SIZE;
+  fBuf = new unsigned char[FEC_PAYLOAD_OFFSET + fMaxPayloadSize];
+  memset(fBuf, 0, FEC_PAYLOAD_OFFSET + fMaxPayloadSize);
+}
+
+void ParityGroup::reset(u_int16_t snBase) {
+  // Clear only as much as the previous packets used:
+  memset(&fBuf[RTP_HEADER_SIZE], 0,
+	 FEC_HEADER_SIZE + LONG_LEVEL_HEADER_SIZE + fProtectionLength);
+  fSNBase = snBase;
+  fProtectionLength = 0;
+  memset(fMask, 0, sizeof fMask);
+}
+
+void ParityGroup::add(unsigned char const* packet, unsigned packetSize) {
+  unsigned length = packetSize - RTP_HEADER_SIZE;
+  if (length > fMaxPayloadSize) return;
+  u_int16_t seqNo = (packet[2]<<8)|packet[3];
+  unsigned offset = (u_int16_t)(seqNo - fSNBase);
+  if (offset >= ULPFEC_MAX_GROUP_SPAN) return;
+
+  // The 'recovery' fields: P, X, CC, M, PT, timestamp and length
+  unsigned char* fec = &fBuf[RTP_HEADER_SIZE];
+  fec[0] ^= packet[0];
+  fec[1] ^= packet[1];
+  fec[4] ^= packet[4]; fec[5] ^= packet[5];
+  fec[6] ^= packet[6]; fec[7] ^= packet[7];
+  fec[8] ^= length>>8; fec[9] ^= (unsigned char)length;
+
+  xorBytes(&fBuf[FEC_PAYLOAD_OFFSET], &packet[RTP_HEADER_SIZE], length);
+  if (length > fProtectionLength) fProtectionLength = length;
+  fMask[offset/8] |= 0x80>>(offset%8);
+}
+
+unsigned char* ParityGroup::finish(unsigned& packetSize) {
+  unsigned char* fec = &fBuf[RTP_HEADER_SIZE];
+  fec[0] = 0x40 | (fec[0]&0x3F); // E = 0, L = 1
+  fec[2] = fSNBase>>8; fec[3] = (unsigned char)fSNBase;
+
+  unsigned char* level = &fec[FEC_HEADER_SIZE];
+  level[0] = fProtectionLength>>8; level[1] = (unsigned char)fProtectionLength;
+  memmove(&level[2], fMask, sizeof fMask);
+
+  packetSize = FEC_PAYLOAD_OFFSET + fProtectionLength;
+  return fBuf;
+}
+
+
+////////// ULPFECEncoder //////////
+
+ULPFECEncoder::ULPFECEncoder(unsigned maxPacketSize,
+			     unsigned rowSize, unsigned numRows)
+  : fMaxPacketSize(maxPacketSize), fRowSize(0), fNumRows(0),
+    fPacketNum(0), fRow(NULL), fColumns(NULL), fNumCompleted(0) {
+  setGroupSizes(rowSize, numRows);
+}
+
+ULPFECEncoder::~ULPFECEncoder() {
+  delete[] fRow;
+  delete[] fColumns;
+}
+
+void ULPFECEncoder::setGroupSizes(unsigned rowSize, unsigned numRows) {
+  if (rowSize < 1) rowSize = 1;
+  if (rowSize > ULPFEC_MAX_GROUP_SPAN) rowSize = ULPFEC_MAX_GROUP_SPAN;
+  if (numRows < 2) {
+    numRows = 0; // a single row has no columns
+  } else if ((numRows-1)*rowSize >= ULPFEC_MAX_GROUP_SPAN) {
+    numRows = (ULPFEC_MAX_GROUP_SPAN-1)/rowSize + 1;
+  }
+
+  fNewRowSize = rowSize;
+  fNewNumRows = numRows;
+}
+
+ParityGroup* ULPFECEncoder::newGroups(unsigned numGroups) {
+  ParityGroup* groups = new ParityGroup[numGroups];
+  for (unsigned i = 0; i < numGroups; ++i) groups[i].init(fMaxPacketSize);
+  return groups;
+}
+
+void ULPFECEncoder::applyGroupSizes() {
+  if (fRow != NULL && fNewRowSize == fRowSize && fNewNumRows == fNumRows) return;
+
+  delete[] fRow; delete[] fColumns;
+  fRowSize = fNewRowSize;
+  fNumRows = fNewNumRows;
+  fRow = newGroups(1);
+  fColumns = fNumRows >= 2 ? newGroups(fRowSize) : NULL;
+}
+
+unsigned ULPFECEncoder
+::addMediaPacket(unsigned char const* packet, unsigned packetSize) {
+  fNumCompleted = 0;
+  if (packetSize < RTP_HEADER_SIZE) return 0;
+
+  if (fPacketNum == 0) applyGroupSizes();
+  u_int16_t seqNo = (packet[2]<<8)|packet[3];
+  unsigned column = fPacketNum%fRowSize;
+  unsigned row = fPacketNum/fRowSize;
+
+  if (column == 0) fRow->reset(seqNo);
+  fRow->add(packet, packetSize);
+  if (column == fRowSize-1) fCompleted[fNumCompleted++] = fRow;
+
+  if (fColumns != NULL) {
+    if (row == 0) fColumns[column].reset(seqNo);
+    fColumns[column].add(packet, packetSize);
+  }
+
+  unsigned blockSize = fColumns != NULL ? fRowSize*fNumRows : fRowSize;
+  if (++fPacketNum == blockSize) {
+    if (fColumns != NULL) {
+      for (unsigned i = 0; i < fRowSize; ++i) {
+	fCompleted[fNumCompleted++] = &fColumns[i];
+      }
+    }
+    fPacketNum = 0;
+  }
+
+  return fNumCompleted;
+}
+
+unsigned char* ULPFECEncoder::fecPacket(unsigned i, unsigned& packetSize) {
+  if (i >= fNumCompleted) {
+    packetSize = 0;
+    return NULL;
+  }
+  return fCompleted[i]->finish(packetSize);
+}
+
+
+////////// ULPFECDecoder //////////
+
+// How many media packets are kept.  This must cover the span of a FEC
+// packet's mask, plus however far FEC packets lag behind (a whole block,
+// for columns).
+#define MEDIA_HISTORY_SIZE 128
+#define MAX_FEC_PACKETS 32
+#define MAX_PACKET_SIZE 1500 // bigger packets are neither kept nor rebuilt
+
+struct ReceivedPacket {
+  u_int16_t seqNo;
+  unsigned size; // 0 if the slot is empty
+  unsigned char* data;
+};
+
+static void initPackets(ReceivedPacket* packets, unsigned numPackets) {
+  for (unsigned i = 0; i < numPackets; ++i) {
+    packets[i].seqNo = 0;
+    packets[i].size = 0;
+    packets[i].data = new unsigned char[MAX_PACKET_SIZE];
+  }
+}
+
+static void deletePackets(ReceivedPacket* packets, unsigned numPackets) {
+  for (unsigned i = 0; i < numPackets; ++i) delete[] packets[i].data;
+  delete[] packets;
+}
+
+ULPFECDecoder::ULPFECDecoder()
+  : fMediaPackets(new ReceivedPacket[MEDIA_HISTORY_SIZE]),
+    fFECPackets(new ReceivedPacket[MAX_FEC_PACKETS]), fNumFECPackets(0),
+    fHaveSeenMediaPacket(False), fHighestSeqNo(0),
+    fRecoveredPacket(new unsigned char[MAX_PACKET_SIZE]) {
+  initPackets(fMediaPackets, MEDIA_HISTORY_SIZE);
+  initPackets(fFECPackets, MAX_FEC_PACKETS);
+}
+
+ULPFECDecoder::~ULPFECDecoder() {
+  deletePackets(fMediaPackets, MEDIA_HISTORY_SIZE);
+  deletePackets(fFECPackets, MAX_FEC_PACKETS);
+  delete[] fRecoveredPacket;
+}
+
+void ULPFECDecoder::noteMediaPacket(u_int16_t rtpSeqNo,
+				    unsigned char const* packet,
+				    unsigned packetSize) {
+  if (packetSize < RTP_HEADER_SIZE || packetSize > MAX_PACKET_SIZE) return;
+
+  ReceivedPacket& slot = fMediaPackets[rtpSeqNo%MEDIA_HISTORY_SIZE];
+  slot.seqNo = rtpSeqNo;
+  slot.size = packetSize;
+  memmove(slot.data, packet, packetSize);
+
+  if (!fHaveSeenMediaPacket
+      || (u_int16_t)(rtpSeqNo - fHighestSeqNo) < 0x8000) {
+    fHaveSeenMediaPacket = True;
+    fHighestSeqNo = rtpSeqNo;
+  }
+}
+
+void ULPFECDecoder::noteFECPacket(unsigned char const* fecData,
+				  unsigned fecDataSize) {
+  if (fecDataSize < FEC_HEADER_SIZE + SHORT_LEVEL_HEADER_SIZE
+      || fecDataSize > MAX_PACKET_SIZE) return;
+
+  if (fNumFECPackets == MAX_FEC_PACKETS) {
+    // Make room by dropping the oldest one:
+    unsigned char* data = fFECPackets[0].data;
+    memmove(&fFECPackets[0], &fFECPackets[1],
+	    (MAX_FEC_PACKETS-1)*sizeof (ReceivedPacket));
+    fFECPackets[--fNumFECPackets].data = data;
+  }
+
+  ReceivedPacket& fec = fFECPackets[fNumFECPackets++];
+  fec.seqNo = (fecData[2]<<8)|fecData[3]; // SN base
+  fec.size = fecDataSize;
+  memmove(fec.data, fecData, fecDataSize);
+}
+
+unsigned char* ULPFECDecoder::recoverPacket(u_int32_t mediaSSRC,
+					    unsigned& packetSize) {
+  unsigned i = 0;
+  while (i < fNumFECPackets) {
+    ReceivedPacket& fec = fFECPackets[i];
+    unsigned char const* f = fec.data;
+    Boolean longMask = (f[0]&0x40) != 0;
+    unsigned levelHeaderSize
+      = longMask ? LONG_LEVEL_HEADER_SIZE : SHORT_LEVEL_HEADER_SIZE;
+    unsigned char const* level = &f[FEC_HEADER_SIZE];
+    unsigned protectionLength = (level[0]<<8)|level[1];
+    unsigned char const* mask = &level[2];
+    unsigned char const* payload = &level[levelHeaderSize];
+    unsigned maskBits = longMask ? 48 : 16;
+
+    // Which of the protected packets are missing?
+    unsigned numMissing = 0;
+    u_int16_t missingSeqNo = 0;
+    Boolean usable = fec.size >= FEC_HEADER_SIZE + levelHeaderSize + protectionLength
+      && RTP_HEADER_SIZE + protectionLength <= MAX_PACKET_SIZE
+      && (u_int16_t)(fHighestSeqNo - fec.seqNo) < MEDIA_HISTORY_SIZE;
+        // (otherwise the packets it protects have left our history)
+    for (unsigned k = 0; usable && k < maskBits; ++k) {
+      if ((mask[k/8]&(0x80>>(k%8))) == 0) continue;
+      u_int16_t seqNo = fec.seqNo + k;
+      ReceivedPacket& media = fMediaPackets[seqNo%MEDIA_HISTORY_SIZE];
+      if (media.size == 0 || media.seqNo != seqNo) {
+	++numMissing;
+	missingSeqNo = seqNo;
+      }
+    }
+
+    if (usable && numMissing > 1) {
+      ++i; // keep it, for when more of them arrive (or are recovered)
+      continue;
+    }
+
+    unsigned char* result = NULL;
+    if (usable && numMissing == 1) {
+      // XOR the recovery fields with those of all the other packets:
+      unsigned char hdr0 = f[0], hdr1 = f[1];
+      unsigned char ts[4] = { f[4], f[5], f[6], f[7] };
+      unsigned length = (f[8]<<8)|f[9];
+      unsigned char* rec = fRecoveredPacket;
+      memmove(&rec[RTP_HEADER_SIZE], payload, protectionLength);
+
+      for (unsigned k = 0; k < maskBits; ++k) {
+	if ((mask[k/8]&(0x80>>(k%8))) == 0) continue;
+	u_int16_t seqNo = fec.seqNo + k;
+	if (seqNo == missingSeqNo) continue;
+	ReceivedPacket& media = fMediaPackets[seqNo%MEDIA_HISTORY_SIZE];
+	unsigned char const* p = media.data;
+	unsigned mediaLength = media.size - RTP_HEADER_SIZE;
+	hdr0 ^= p[0]; hdr1 ^= p[1];
+	ts[0] ^= p[4]; ts[1] ^= p[5]; ts[2] ^= p[6]; ts[3] ^= p[7];
+	length ^= mediaLength;
+	xorBytes(&rec[RTP_HEADER_SIZE], &p[RTP_HEADER_SIZE],
+		 mediaLength < protectionLength ? mediaLength : protectionLength);
+      }
+
+      if (length <= protectionLength) {
+	rec[0] = 0x80 | (hdr0&0x3F); // version 2
+	rec[1] = hdr1;
+	rec[2] = missingSeqNo>>8; rec[3] = (unsigned char)missingSeqNo;
+	memmove(&rec[4], ts, 4);
+	rec[8] = (unsigned char)(mediaSSRC>>24); rec[9] = (unsigned char)(mediaSSRC>>16);
+	rec[10] = (unsigned char)(mediaSSRC>>8); rec[11] = (unsigned char)mediaSSRC;
+	packetSize = RTP_HEADER_SIZE + length;
+	result = rec;
+      }
+    }
+
+    // This FEC packet has been used up (or is of no further use):
+    unsigned char* data = fec.data;
+    fec = fFECPackets[--fNumFECPackets];
+    fFECPackets[fNumFECPackets].data = data;
+
+    if (result != NULL) return result;
+  }
+
+  return NULL;
+}
@@ -0,0 +1,112 @@
+/**********
+This library is free software; you can redistribute it and/or modify it under
+the terms of the GNU Lesser General Public License as published by the
+Free Software Foundation; either version 2.1 of the License, or (at your
+option) any later version. (See <http://www.gnu.org/copyleft/lesser.html>.)
+
+This library is distributed in the hope that it will be useful, but WITHOUT
+ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for
+more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with this library; if not, write to the Free Software Foundation, Inc.,
+51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA
+**********/
+// "liveMedia"
+// Copyright (c) 1996-2009 Live Networks, Inc.  All rights reserved.
+// A RTP sink that sends - as its own RTP stream - the packets that another
+// ("packetizer") sink has already built, rewriting only their RTP headers
+// C++ header
+
+#ifndef _FAN_OUT_RTP_SINK_HH
+#define _FAN_OUT_RTP_SINK_HH
+
+#ifndef _MULTI_FRAMED_RTP_SINK_HH
+#include "MultiFramedRTPSink.hh"
+#endif
+
+class CachedRTPPacket; // forward
+
+// Each packet that the packetizer sends is sent again by each of its
+// (started) fan-out sinks, with the sink's own SSRC, sequence numbers and
+// timestamp base, but from the packetizer's buffer: no per-sink source,
+// framing, packetization or copying.  The packetizer's own packets may go
+// nowhere (its groupsock needn't have any destinations).
+
+class FanOutRTPSink: public RTPSink {
+public:
+  static FanOutRTPSink* createNew(UsageEnvironment& env, Groupsock* RTPgs,
+				  MultiFramedRTPSink& packetizer);
+
+  void startFanOut();
+      // Begins sending the packetizer's packets (for video, from the start
+      // of its next frame).  "stopPlaying()" stops again.  If the packetizer
+      // has a GOP cache, its packets - from the last key frame on - are sent
+      // first, at the cache's burst rate, and those that the packetizer sends
+      // meanwhile follow them.  Each of those frames is timestamped with the
+      // time it's sent - so the viewer plays them as fast as they come - and
+      // the live frames after them with the time they were captured, so the
+      // viewer then plays at the live edge, not behind it by the age of that
+      // key frame.
+  Boolean isSendingGOPCache() const { return fNextCachedPacket != NULL; }
+  FanOutRTPSink* nextFanOutSink() const { return fNextFanOutSink; }
+  unsigned numRetransmittedPackets() const { return fNumRetransmittedPackets; }
+
+public: // redefined virtual functions:
+  virtual void stopPlaying();
+  virtual void retransmitPacket(u_int16_t seqNo);
+      // Resends the packetizer's copy (if it keeps a history), as is:
+      // without RFC 4588 "rtx", and without any FEC of our own.
+  virtual char const* sdpMediaType() const;
+
+protected:
+  FanOutRTPSink(UsageEnvironment& env, Groupsock* RTPgs,
+		MultiFramedRTPSink& packetizer);
+      // called only by createNew()
+  virtual ~FanOutRTPSink();
+
+private: // redefined virtual functions:
+  virtual Boolean continuePlaying();
+
+private:
+  friend class MultiFramedRTPSink;
+  void sendFannedOutPacket(unsigned char* packet, unsigned packetSize,
+			   struct timeval presentationTime);
+      // called by the packetizer, for each packet that it sends
+  void sendRewrittenPacket(unsigned char* packet, unsigned packetSize,
+			   struct timeval presentationTime);
+  static void sendNextCachedPackets(void* clientData);
+  void sendNextCachedPackets1();
+  void stopSendingGOPCache();
+  void retimeFrame(u_int32_t timestamp, struct timeval timeNow);
+      // sets our timestamp offset for the frame that starts with (the
+      // packetizer's) "timestamp": "timeNow", unless we've sent a later one
+  u_int32_t timestampOffsetFor(u_int16_t seqNo) const;
+  MultiFramedRTPSink* lookupPacketizer() const;
+
+private:
+  char* fPacketizerName; // looked up by name, in case it's closed first
+  char* fMediaType;
+  FanOutRTPSink* fNextFanOutSink; // in the packetizer's list
+  Boolean fIsFannedOut, fWaitingForFrameStart, fHaveSentPacket;
+  u_int16_t fSeqNoOffset; // ours - the packetizer's
+  u_int32_t fTimestampOffset; // ditto; changed by "retimeFrame()"
+  u_int16_t fFirstSeqNo; // the first that we sent, since starting
+  u_int32_t fLastTimestamp; // the packetizer's, in the last packet we sent
+  Boolean fRetimeNextFrame; // the first live one, after the GOP cache
+  // Each timestamp offset that we've used, from the (our) sequence number
+  // with which it started, for retransmissions:
+  struct TimestampOffset {
+    u_int16_t seqNo;
+    u_int32_t offset;
+  }* fTimestampOffsets;
+  unsigned fNumTimestampOffsets, fMaxNumTimestampOffsets;
+  unsigned char fHeader[12]; // the rewritten RTP header being sent
+  unsigned fNumRetransmittedPackets;
+  CachedRTPPacket* fNextCachedPacket; // while we're sending the GOP cache
+  struct timeval fNextCachedPacketTime;
+  TaskToken fCachedPacketTask;
+};
+
+#endif
@@ -25,6 +25,8 @@ along with this library; if not, write to the Free Software Foundation, Inc.,
 #include "MediaSink.hh"
 #endif
 
+class FrameFragments; // forward
+
 class FileSink: public MediaSink {
 public:
   static FileSink* createNew(UsageEnvironment& env, char const* fileName,
@@ -40,6 +42,11 @@ public:
   void addData(unsigned char* data, unsigned dataSize,
 	       struct timeval presentationTime);
   // (Available in case a client wants to add extra data to the output file)
+  void addFragments(unsigned char* header, unsigned headerSize,
+		    FrameFragments const& fragments,
+		    struct timeval presentationTime);
+  // Like "addData()" for "header" followed by each of "fragments", but
+  // written with a single "writev()" (where available) rather than copied
 
 protected:
   FileSink(UsageEnvironment& env, FILE* fid, unsigned bufferSize,
@@ -54,6 +61,8 @@ protected:
 				unsigned durationInMicroseconds);
   virtual void afterGettingFrame1(unsigned frameSize,
 				  struct timeval presentationTime);
+  void afterWritingFrame();
+      // the rest of "afterGettingFrame1()", once the data has been added
 
   FILE* fOutFid;
   unsigned char* fBuffer;
@@ -61,7 +70,7 @@ protected:
   char* fPerFrameFileNamePrefix; // used if "oneFilePerFrame" is True
   char* fPerFrameFileNameBuffer; // used if "oneFilePerFrame" is True
 
-private: // redefined virtual functions:
+protected: // redefined virtual functions:
   virtual Boolean continuePlaying();
 };
 
@@ -0,0 +1,97 @@
+/**********
+This library is free software; you can redistribute it and/or modify it under
+the terms of the GNU Lesser General Public License as published by the
+Free Software Foundation; either version 2.1 of the License, or (at your
+option) any later version. (See <http://www.gnu.org/copyleft/lesser.html>.)
+
+This library is distributed in the hope that it will be useful, but WITHOUT
+ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for
+more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with this library; if not, write to the Free Software Foundation, Inc.,
+51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA
+**********/
+// "liveMedia"
+// Copyright (c) 1996-2009 Live Networks, Inc.  All rights reserved.
+// Per-frame timestamps at each stage of a live frame's way from the camera
+// to the network, kept in a lock-free ring
+// C++ header
+
+#ifndef _FRAME_TRACE_HH
+#define _FRAME_TRACE_HH
+
+#ifndef _NET_COMMON_H
+#include "NetCommon.h"
+#endif
+#ifndef _BOOLEAN_HH
+#include "Boolean.hh"
+#endif
+
+// A live source calls "beginFrame()" for each frame that it captures, and
+// "mark()"s the frame's id as it passes each stage; the RTP sink that
+// packetizes it marks its first and last packet sent, finding the frame by
+// its presentation time.  The last "RING_SIZE" frames are kept.  Each stage
+// is stamped once (by the first sink, if there are several), with the
+// ticks of a monotonic clock.
+//
+// Stamping and "begin"ning take no lock, and may be done from any thread.
+// The export functions copy each record, skipping any that are being
+// rewritten meanwhile.  Until "enable()"d, all of this does nothing.
+
+class FrameTrace {
+public:
+  enum Stage {
+    CAPTURE_STARTED,	// the camera was asked for the frame
+    GRABBED,		// the camera had it (if the camera says when)
+    CONVERTED,		// ... as YUV
+    ENCODED,		// the encoder has returned its NAL units
+    FIRST_PACKET_SENT,	// its first RTP packet has been sent
+    LAST_PACKET_SENT,	// ... and its last (with the marker bit)
+    NUM_STAGES
+  };
+  enum { RING_SIZE = 2048 }; // frames (over a minute, at 25 fps)
+
+  static void enable(Boolean enabled = True);
+  static Boolean isEnabled() { return fIsEnabled; }
+
+  static unsigned beginFrame();
+      // Stamps "CAPTURE_STARTED" for a new frame, and returns its id (or 0,
+      // if we're not enabled)
+  static void setPresentationTime(unsigned frameId,
+				  struct timeval const& presentationTime);
+  static void mark(unsigned frameId, Stage stage);
+  static void mark(unsigned frameId, Stage stage, u_int64_t ticks);
+      // (for a stage that was passed earlier, e.g. within a capture call)
+  static void markPacketSent(struct timeval const& presentationTime,
+			     Boolean isLastPacketOfFrame);
+      // called by a RTP sink after sending each packet of a frame
+
+  static u_int64_t now(); // ticks of a monotonic clock
+  static u_int64_t ticksPerSecond();
+
+  static Boolean writeChromeTrace(char const* fileName);
+      // Writes the kept frames in the Chrome "Trace Event" JSON format (for
+      // "chrome://tracing", or Perfetto): a row per stage, and each frame,
+      // from capture to its last packet, as an async event.
+  static Boolean writeHistograms(char const* fileNamePrefix);
+      // Writes "<prefix>-<span>.hgrm" for the time that the kept frames took
+      // in each span between stages ("capture", "convert", "encode",
+      // "packetize", "send"), and "<prefix>-total.hgrm" for capture to last
+      // packet: a percentile distribution, in milliseconds, in the format of
+      // HdrHistogram's "outputPercentileDistribution()" (which its plotter
+      // reads).
+
+private:
+  struct Record; // in the ring
+  static Boolean copyRecord(unsigned frameId, Record& result);
+  static unsigned lookupFrame(struct timeval const& presentationTime);
+
+private:
+  static Boolean fIsEnabled;
+  static Record* fRing; // allocated when first enabled
+  static unsigned volatile fLastFrameId;
+};
+
+#endif
@@ -0,0 +1,78 @@
+/**********
+This library is free software; you can redistribute it and/or modify it under
+the terms of the GNU Lesser General Public License as published by the
+Free Software Foundation; either version 2.1 of the License, or (at your
+option) any later version. (See <http://www.gnu.org/copyleft/lesser.html>.)
+
+This library is distributed in the hope that it will be useful, but WITHOUT
+ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for
+more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with this library; if not, write to the Free Software Foundation, Inc.,
+51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA
+**********/
+// "liveMedia"
+// Copyright (c) 1996-2009 Live Networks, Inc.  All rights reserved.
+// A cache of the RTP packets sent since the last key frame, so that a new
+// viewer of a live stream can start decoding at once
+// C++ header
+
+#ifndef _GOP_CACHE_HH
+#define _GOP_CACHE_HH
+
+#ifndef _BOOLEAN_HH
+#include "Boolean.hh"
+#endif
+
+// A copy of a sent RTP packet, shared - through reference counts - by the
+// cache and by anyone still reading from it.  Each packet holds a reference
+// to the one sent after it, so holding one packet keeps the rest of the
+// stream (from there on) in memory, and letting go of it frees whatever
+// no one else holds.
+
+class CachedRTPPacket {
+public:
+  unsigned char* data() const { return fData; }
+  unsigned size() const { return fSize; }
+  CachedRTPPacket* next() const { return fNext; } // NULL if none (yet)
+
+  void addRef() { ++fRefCount; }
+  static void release(CachedRTPPacket*& packet);
+      // drops the reference (and sets "packet" to NULL)
+
+private:
+  friend class GOPCache;
+  CachedRTPPacket(unsigned char const* packet, unsigned packetSize);
+  ~CachedRTPPacket();
+
+private:
+  unsigned fRefCount;
+  CachedRTPPacket* fNext;
+  unsigned char* fData;
+  unsigned fSize;
+};
+
+class GOPCache {
+public:
+  GOPCache(unsigned maxSize);
+      // "maxSize" is in bytes.  A group of pictures that grows beyond it is
+      // dropped, until the next key frame.
+  virtual ~GOPCache();
+
+  void addPacket(unsigned char const* packet, unsigned packetSize,
+		 Boolean startsKeyFrame);
+      // "packet" is a complete RTP packet, as sent
+  CachedRTPPacket* keyFrameStart() const { return fKeyFrameStart; }
+      // the first packet of the most recent key frame, or NULL if none
+      // can be had right now.  The caller adds its own reference.
+  unsigned size() const { return fSize; } // in bytes, from "keyFrameStart()"
+
+private:
+  unsigned fMaxSize, fSize;
+  CachedRTPPacket* fKeyFrameStart;
+  CachedRTPPacket* fLastPacket; // kept even when "fKeyFrameStart" isn't
+};
+
+#endif
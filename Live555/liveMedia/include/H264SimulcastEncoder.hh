@@ -0,0 +1,156 @@
+/**********
+This library is free software; you can redistribute it and/or modify it under
+the terms of the GNU Lesser General Public License as published by the
+Free Software Foundation; either version 2.1 of the License, or (at your
+option) any later version. (See <http://www.gnu.org/copyleft/lesser.html>.)
+
+This library is distributed in the hope that it will be useful, but WITHOUT
+ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for
+more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with this library; if not, write to the Free Software Foundation, Inc.,
+51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA
+**********/
+// "liveMedia"
+// Copyright (c) 1996-2009 Live Networks, Inc.  All rights reserved.
+// A ladder of live H.264 streams - the one camera, encoded at several sizes
+// and bitrates at once - for viewers to choose from
+// C++ header
+
+#ifndef _H264_SIMULCAST_ENCODER_HH
+#define _H264_SIMULCAST_ENCODER_HH
+
+#ifndef _H264_VIDEO_STREAM_FRAMER_HH
+#include "H264VideoStreamFramer.hh"
+#endif
+
+// One rung of the ladder:
+struct H264SimulcastRung {
+  unsigned width, height; // even
+  unsigned bitrate; // kbps
+};
+
+// The camera is read - and its picture scaled to each rung's size - once per
+// frame, whichever rungs are being watched; each rung that is has its own
+// encoder, and the rungs' scaling and encoding is shared out between a
+// worker thread per rung (the event loop's thread being one of them), so
+// that a frame takes about as long as its largest rung does.  A rung's
+// encoder is opened when its first "H264SimulcastSource" is created, and
+// closed with its last; the camera is open while any rung is.
+//
+// (x264's own analysis - its lookahead and motion search - is of each
+// rung's own picture, at that rung's size, so isn't shared.)
+
+class H264SimulcastSource; // forward
+struct H264SimulcastRungState; // forward
+class H264SimulcastWorkers; // forward
+class ICameraCaptuer; // forward
+
+class H264SimulcastEncoder: public Medium {
+public:
+  static H264SimulcastEncoder* createNew(UsageEnvironment& env,
+					 H264SimulcastRung const* rungs,
+					 unsigned numRungs,
+					 unsigned frameRate = 25);
+
+  unsigned numRungs() const { return fNumRungs; }
+  H264SimulcastRung const& rung(unsigned rungIndex) const;
+  unsigned frameRate() const { return fFrameRate; }
+
+  char* spropParameterSets(unsigned rungIndex, unsigned& profileLevelId);
+      // for SDP; NULL if the rung's encoder can't be opened; else to be
+      // delete[]d
+
+protected:
+  H264SimulcastEncoder(UsageEnvironment& env, H264SimulcastRung const* rungs,
+		       unsigned numRungs, unsigned frameRate);
+      // called only by createNew()
+  virtual ~H264SimulcastEncoder();
+
+private:
+  friend class H264SimulcastSource;
+  Boolean addSource(H264SimulcastSource* source);
+      // False if the camera, or the rung's encoder, can't be opened
+  void removeSource(H264SimulcastSource* source);
+
+  Boolean openCamera();
+  void closeCamera();
+  Boolean openRung(H264SimulcastRungState& state);
+  void closeRung(H264SimulcastRungState& state);
+
+  static void tickTask(void* clientData);
+  void tick();
+  static void encodeRung(void* clientData, unsigned jobIndex);
+
+private:
+  unsigned fNumRungs, fFrameRate;
+  H264SimulcastRungState* fRungs;
+  H264SimulcastWorkers* fWorkers;
+  ICameraCaptuer* fCamera; // NULL while no rung is open
+  unsigned fNumOpenRungs;
+  unsigned char* fCameraPicture; // this frame's, while it's being encoded
+  unsigned* fJobs; // the open rungs' indices, while they're being encoded
+  TaskToken fTickTask;
+  struct timeval fNextTickTime;
+};
+
+// Delivers one rung's NAL units, one at a time, as a "H264VideoStreamFramer",
+// starting from a key frame.  Access units wait in a short queue until
+// they're read; a source that falls further behind than that drops what's
+// queued, and waits for (and asks the encoder for) the next key frame.
+
+class H264SimulcastSource: public H264VideoStreamFramer {
+public:
+  static H264SimulcastSource* createNew(UsageEnvironment& env,
+					H264SimulcastEncoder& encoder,
+					unsigned rungIndex);
+      // Returns NULL if the camera, or the rung's encoder, can't be opened
+
+  H264SimulcastEncoder& encoder() const { return fEncoder; }
+  unsigned rungIndex() const { return fRungIndex; }
+
+protected:
+  H264SimulcastSource(UsageEnvironment& env, H264SimulcastEncoder& encoder,
+		      unsigned rungIndex);
+      // called only by createNew()
+  virtual ~H264SimulcastSource();
+
+private: // redefined virtual functions:
+  virtual void doGetNextFrame();
+  virtual void doStopGettingFrames();
+  virtual char const* MIMEtype() const;
+  virtual Boolean currentNALUnitEndsAccessUnit();
+
+private:
+  friend class H264SimulcastEncoder;
+  Boolean enqueueAccessUnit(unsigned char const* accessUnit, unsigned size,
+			    Boolean isKeyFrame,
+			    struct timeval presentationTime);
+      // "accessUnit" is NAL units, each preceded by its 4-byte size; returns
+      // False if the queue has overflowed, and we're waiting for a key frame
+  Boolean dequeueAccessUnit();
+  void deliverNALUnit();
+
+private:
+  H264SimulcastEncoder& fEncoder;
+  unsigned fRungIndex;
+  H264SimulcastSource* fNextSource; // of the same rung
+  Boolean fWaitingForKeyFrame;
+  Boolean fIsWaitingForData; // doGetNextFrame() found the queue empty
+  // The queue: a ring of access units
+  struct AccessUnit {
+    unsigned char* data;
+    unsigned size;
+    struct timeval presentationTime;
+  };
+  AccessUnit* fQueue;
+  unsigned fQueueHead, fQueueLength;
+  // The access unit being delivered (taken from the queue):
+  AccessUnit fCurrent;
+  unsigned fNextNALUnitOffset;
+  Boolean fCurrentNALUnitEndsAccessUnit;
+};
+
+#endif
@@ -0,0 +1,68 @@
+/**********
+This library is free software; you can redistribute it and/or modify it under
+the terms of the GNU Lesser General Public License as published by the
+Free Software Foundation; either version 2.1 of the License, or (at your
+option) any later version. (See <http://www.gnu.org/copyleft/lesser.html>.)
+
+This library is distributed in the hope that it will be useful, but WITHOUT
+ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for
+more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with this library; if not, write to the Free Software Foundation, Inc.,
+51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA
+**********/
+// "liveMedia"
+// Copyright (c) 1996-2009 Live Networks, Inc.  All rights reserved.
+// A 'ServerMediaSubsession' object that creates new, unicast, "RTPSink"s
+// on demand, from one rung of a "H264SimulcastEncoder"'s ladder.
+// C++ header
+
+#ifndef _H264_SIMULCAST_SERVER_MEDIA_SUBSESSION_HH
+#define _H264_SIMULCAST_SERVER_MEDIA_SUBSESSION_HH
+
+#ifndef _ON_DEMAND_SERVER_MEDIA_SUBSESSION_HH
+#include "OnDemandServerMediaSubsession.hh"
+#endif
+
+class H264SimulcastEncoder; // forward
+
+// Each rung is served as a stream of its own, so a viewer picks its rung -
+// by its stream name - when it DESCRIBEs it.  (A rung's bitrate is fixed:
+// it's the ladder, rather than RTCP feedback, that fits viewers' links.)
+
+class H264SimulcastServerMediaSubsession: public OnDemandServerMediaSubsession {
+public:
+  static H264SimulcastServerMediaSubsession*
+  createNew(UsageEnvironment& env, H264SimulcastEncoder& encoder,
+	    unsigned rungIndex, Boolean fanOutFirstSource = False,
+	    unsigned gopCacheSize = 0, unsigned gopBurstRate = 0);
+      // (see "OnDemandServerMediaSubsession" and
+      // "MultiFramedRTPSink::enableGOPCache()"; the GOP cache is used only if
+      // "fanOutFirstSource")
+
+private:
+  H264SimulcastServerMediaSubsession(UsageEnvironment& env,
+				     H264SimulcastEncoder& encoder,
+				     unsigned rungIndex,
+				     Boolean fanOutFirstSource,
+				     unsigned gopCacheSize,
+				     unsigned gopBurstRate);
+      // called only by createNew();
+  virtual ~H264SimulcastServerMediaSubsession();
+
+private: // redefined virtual functions
+  virtual FramedSource* createNewStreamSource(unsigned clientSessionId,
+					      unsigned& estBitrate);
+  virtual RTPSink* createNewRTPSink(Groupsock* rtpGroupsock,
+				    unsigned char rtpPayloadTypeIfDynamic,
+				    FramedSource* inputSource);
+
+private:
+  H264SimulcastEncoder& fEncoder;
+  unsigned fRungIndex;
+  unsigned fGOPCacheSize, fGOPBurstRate;
+};
+
+#endif
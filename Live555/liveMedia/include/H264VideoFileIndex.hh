@@ -0,0 +1,127 @@
+/**********
+This library is free software; you can redistribute it and/or modify it under
+the terms of the GNU Lesser General Public License as published by the
+Free Software Foundation; either version 2.1 of the License, or (at your
+option) any later version. (See <http://www.gnu.org/copyleft/lesser.html>.)
+
+This library is distributed in the hope that it will be useful, but WITHOUT
+ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for
+more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with this library; if not, write to the Free Software Foundation, Inc.,
+51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA
+**********/
+// "liveMedia"
+// Copyright (c) 1996-2009 Live Networks, Inc.  All rights reserved.
+// An index of the NAL units, access units ('frames') and key frames of a
+// (memory-mapped) H.264 Elementary Stream file
+// C++ header
+
+#ifndef _H264_VIDEO_FILE_INDEX_HH
+#define _H264_VIDEO_FILE_INDEX_HH
+
+#ifndef _MEDIA_HH
+#include "Media.hh"
+#endif
+
+#define H264_INDEX_FILE_SUFFIX ".idx"
+
+// The file (an Annex B byte stream) is mapped into memory, rather than read,
+// and scanned - once - for its NAL units' start codes.  The index is then
+// saved alongside it (in "<fileName>.idx"), and reused for as long as the
+// file's size and modification time stay the same.  An elementary stream
+// has no timestamps of its own, so those of its access units come from
+// "frameRate".
+
+class H264VideoFileIndex {
+public:
+  static H264VideoFileIndex* createNew(UsageEnvironment& env,
+				       char const* fileName,
+				       double frameRate = 25.0);
+      // returns NULL (with the result message set) if the file can't be
+      // mapped, or has no NAL units
+  virtual ~H264VideoFileIndex();
+
+  unsigned numNALUnits() const { return fNumNALUnits; }
+  unsigned char const* nalUnit(unsigned i, unsigned& size) const {
+    size = fNALUnits[i].size;
+    return &fData[fNALUnits[i].offset];
+  }
+      // NAL unit "i" (without its start code), where it is in the mapping
+  Boolean nalUnitEndsAccessUnit(unsigned i) const {
+    return (fNALUnits[i].flags&NAL_UNIT_ENDS_ACCESS_UNIT) != 0;
+  }
+  unsigned maxNALUnitSize() const { return fMaxNALUnitSize; }
+
+  unsigned numAccessUnits() const { return fNumAccessUnits; }
+  unsigned firstNALUnit(unsigned accessUnit) const {
+    return fAccessUnits[accessUnit];
+  }
+  double npt(unsigned accessUnit) const { return accessUnit/fFrameRate; }
+  double frameRate() const { return fFrameRate; }
+  double duration() const { return fNumAccessUnits/fFrameRate; } // seconds
+
+  // Key frames are access units with an IDR slice (and any SPS and PPS
+  // that precede it):
+  unsigned numKeyFrames() const { return fNumKeyFrames; }
+  unsigned keyFrame(unsigned k) const { return fKeyFrames[k]; }
+      // the access unit of key frame "k"
+  unsigned keyFrameAtOrBefore(double npt) const;
+      // "k" of the last key frame at or before "npt" (or the first key
+      // frame, if there's none before it); needs "numKeyFrames()" > 0
+
+  u_int64_t fileSize() const { return fFileSize; }
+  unsigned profileLevelId() const { return fProfileLevelId; }
+      // from the first SPS; 0 if there's none
+  char const* spropParameterSets() const { return fSpropParameterSets; }
+      // the first SPS and PPS, for the SDP "a=fmtp:" line
+
+private:
+  H264VideoFileIndex(UsageEnvironment& env, char const* fileName,
+		     double frameRate);
+      // called only by createNew()
+
+  Boolean mapFile();
+  void unmapFile();
+  Boolean readIndexFile();
+  void writeIndexFile();
+  void buildIndex();
+  void addNALUnit(u_int64_t offset, unsigned size);
+  void endAccessUnit();
+  void setParameterSets();
+
+private:
+  enum { NAL_UNIT_ENDS_ACCESS_UNIT = 0x1 };
+  struct NALUnitEntry { // as saved in the index file
+    u_int64_t offset;
+    u_int32_t size;
+    u_int32_t flags;
+  };
+
+  UsageEnvironment& fEnv;
+  char* fFileName;
+  char* fIndexFileName;
+  double fFrameRate;
+  u_int64_t fFileSize;
+  int64_t fModificationTime;
+  unsigned char const* fData; // the mapping
+#if defined(__WIN32__) || defined(_WIN32)
+  void* fFileHandle;
+  void* fMappingHandle;
+#endif
+
+  NALUnitEntry* fNALUnits;
+  unsigned fNumNALUnits, fMaxNumNALUnits, fMaxNALUnitSize;
+  u_int32_t* fAccessUnits; // the first NAL unit of each
+  unsigned fNumAccessUnits, fMaxNumAccessUnits;
+  u_int32_t* fKeyFrames; // the access unit of each
+  unsigned fNumKeyFrames, fMaxNumKeyFrames;
+  Boolean fAccessUnitHasIDR; // while building the index
+
+  unsigned fProfileLevelId;
+  char* fSpropParameterSets;
+};
+
+#endif
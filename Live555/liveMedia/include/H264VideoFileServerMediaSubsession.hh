@@ -0,0 +1,68 @@
+/**********
+This library is free software; you can redistribute it and/or modify it under
+the terms of the GNU Lesser General Public License as published by the
+Free Software Foundation; either version 2.1 of the License, or (at your
+option) any later version. (See <http://www.gnu.org/copyleft/lesser.html>.)
+
+This library is distributed in the hope that it will be useful, but WITHOUT
+ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for
+more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with this library; if not, write to the Free Software Foundation, Inc.,
+51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA
+**********/
+// "liveMedia"
+// Copyright (c) 1996-2009 Live Networks, Inc.  All rights reserved.
+// A 'ServerMediaSubsession' object that creates new, unicast, "RTPSink"s
+// on demand, from an (indexed, memory-mapped) H.264 Elementary Stream file.
+// C++ header
+
+#ifndef _H264_VIDEO_FILE_SERVER_MEDIA_SUBSESSION_HH
+#define _H264_VIDEO_FILE_SERVER_MEDIA_SUBSESSION_HH
+
+#ifndef _FILE_SERVER_MEDIA_SUBSESSION_HH
+#include "FileServerMediaSubsession.hh"
+#endif
+#ifndef _H264_VIDEO_FILE_INDEX_HH
+#include "H264VideoFileIndex.hh"
+#endif
+
+// The file is indexed (see "H264VideoFileIndex") once, when the subsession
+// is created, so that "Range:" seeks (to the preceding key frame) and
+// "Scale:" trick play (key frames only) cost nothing more while streaming.
+
+class H264VideoFileServerMediaSubsession: public FileServerMediaSubsession {
+public:
+  static H264VideoFileServerMediaSubsession*
+  createNew(UsageEnvironment& env, char const* fileName,
+	    Boolean reuseFirstSource, double frameRate = 25.0);
+      // returns NULL (with the result message set) if the file can't be indexed
+
+  H264VideoFileIndex& index() const { return *fIndex; }
+
+private:
+  H264VideoFileServerMediaSubsession(UsageEnvironment& env,
+				     char const* fileName,
+				     Boolean reuseFirstSource,
+				     H264VideoFileIndex* index);
+      // called only by createNew();
+  virtual ~H264VideoFileServerMediaSubsession();
+
+private: // redefined virtual functions
+  virtual void testScaleFactor(float& scale);
+  virtual float duration() const;
+  virtual void seekStreamSource(FramedSource* inputSource, double seekNPT);
+  virtual void setStreamSourceScale(FramedSource* inputSource, float scale);
+  virtual FramedSource* createNewStreamSource(unsigned clientSessionId,
+					      unsigned& estBitrate);
+  virtual RTPSink* createNewRTPSink(Groupsock* rtpGroupsock,
+				    unsigned char rtpPayloadTypeIfDynamic,
+				    FramedSource* inputSource);
+
+private:
+  H264VideoFileIndex* fIndex;
+};
+
+#endif
@@ -24,6 +24,9 @@ along with this library; if not, write to the Free Software Foundation, Inc.,
 #ifndef _FILE_SINK_HH
 #include "FileSink.hh"
 #endif
+#ifndef _MULTI_FRAMED_RTP_SOURCE_HH
+#include "MultiFramedRTPSource.hh"
+#endif
 
 class H264VideoFileSink: public FileSink {
 public:
@@ -42,6 +45,18 @@ protected: // redefined virtual functions:
   virtual Boolean sourceIsCompatibleWithUs(MediaSource& source);
   virtual void afterGettingFrame1(unsigned frameSize,
 				  struct timeval presentationTime);
+  virtual Boolean continuePlaying();
+
+private:
+  // When reading straight from a RTP source, each NAL unit is taken as
+  // "FrameFragments", and written from the packet buffers without copying:
+  static void afterGettingFragments(void* clientData, unsigned frameSize,
+				    unsigned numTruncatedBytes,
+				    struct timeval presentationTime,
+				    unsigned durationInMicroseconds);
+  void afterGettingFragments1(struct timeval presentationTime);
+
+  FrameFragments fFragments;
 };
 
 #endif
@@ -0,0 +1,190 @@
+/**********
+This library is free software; you can redistribute it and/or modify it under
+the terms of the GNU Lesser General Public License as published by the
+Free Software Foundation; either version 2.1 of the License, or (at your
+option) any later version. (See <http://www.gnu.org/copyleft/lesser.html>.)
+
+This library is distributed in the hope that it will be useful, but WITHOUT
+ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for
+more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with this library; if not, write to the Free Software Foundation, Inc.,
+51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA
+**********/
+// "liveMedia"
+// Copyright (c) 1996-2009 Live Networks, Inc.  All rights reserved.
+// A shared-memory ring of H.264 access units, written by one (encoder)
+// process and read - without locks - by any number of (server) processes
+// C++ header
+
+#ifndef _H264_VIDEO_FRAME_BUS_HH
+#define _H264_VIDEO_FRAME_BUS_HH
+
+#ifndef _H264_VIDEO_STREAM_FRAMER_HH
+#include "H264VideoStreamFramer.hh"
+#endif
+#ifndef _MEDIA_SINK_HH
+#include "MediaSink.hh"
+#endif
+
+#define H264_FRAME_BUS_MAX_PARAMETER_SET_SIZE 256
+
+// The bus is a named shared memory region: a header, then "numSlots" slots,
+// each holding one access unit (its NAL units, each preceded by its 4-byte
+// size, and its presentation time, and whether it's a key frame).  The
+// writer numbers the access units 1, 2, ...; slot "n%numSlots" holds access
+// unit "n".  A slot's number is cleared while it's being rewritten, so a
+// reader that copies an access unit out, and then finds its number
+// unchanged, knows that the copy is good; if it's been overwritten (the
+// reader has fallen more than "numSlots" behind), the reader skips ahead,
+// to a key frame.  The latest SPS and PPS are kept in the header, for the
+// SDP descriptions of readers that start after they were sent.
+//
+// If the writer restarts, it carries on the numbering where it left off,
+// so that readers carry on too.  (The region outlives the processes that
+// map it only on POSIX systems, where it's named "/<name>".)
+
+struct H264FrameBusHeader; // forward
+struct H264FrameBusSlot; // forward
+
+class H264VideoFrameBus {
+public:
+  static H264VideoFrameBus* createWriter(UsageEnvironment& env,
+					 char const* name,
+					 unsigned numSlots,
+					 unsigned slotSize);
+      // "slotSize" is the largest access unit (plus 4 bytes per NAL unit)
+      // that can be written.  Returns NULL (with the result message set) if
+      // the region can't be created, or if it exists with another geometry.
+  static H264VideoFrameBus* openReader(UsageEnvironment& env,
+				       char const* name);
+      // Returns NULL (with the result message set) if there's no writer yet.
+  virtual ~H264VideoFrameBus();
+
+  unsigned numSlots() const;
+  unsigned slotSize() const;
+
+  // Used by the writer:
+  void beginAccessUnit();
+  Boolean addNALUnit(unsigned char const* nalUnit, unsigned nalUnitSize);
+      // returns False if the access unit is too big for a slot (it'll be
+      // dropped)
+  void endAccessUnit(struct timeval presentationTime);
+
+  // Used by readers:
+  u_int32_t lastSeqNo() const; // 0 if nothing's been written yet
+  u_int32_t lastKeyFrameSeqNo() const; // 0 if none
+  enum ReadResult { READ_OK, READ_NOT_YET, READ_OVERRUN };
+  ReadResult read(u_int32_t seqNo, unsigned char* to, unsigned& size,
+		  struct timeval& presentationTime, Boolean& isKeyFrame) const;
+      // copies access unit "seqNo" (at most "slotSize()" bytes) to "to"
+  Boolean getParameterSets(unsigned char* sps, unsigned& spsSize,
+			   unsigned char* pps, unsigned& ppsSize) const;
+      // each buffer must hold H264_FRAME_BUS_MAX_PARAMETER_SET_SIZE bytes;
+      // returns False if the writer hasn't sent both yet
+  char* spropParameterSets(unsigned& profileLevelId) const;
+      // for SDP; NULL if there are none yet; else to be delete[]d
+
+private:
+  H264VideoFrameBus(char const* name, Boolean isWriter, void* mapping,
+		    void* region, unsigned regionSize);
+  H264FrameBusSlot* slot(u_int32_t seqNo) const;
+  void noteParameterSet(unsigned char const* nalUnit, unsigned nalUnitSize);
+
+private:
+  char* fName;
+  Boolean fIsWriter;
+  void* fMapping; // Windows: the file mapping's handle
+  void* fRegion;
+  unsigned fRegionSize;
+  H264FrameBusHeader* fHeader;
+  // The access unit being written:
+  u_int32_t fCurrentSeqNo;
+  unsigned fCurrentSize;
+  Boolean fCurrentIsKeyFrame, fCurrentIsTooBig;
+};
+
+// Writes each access unit of a (live) "H264VideoStreamFramer" into a bus:
+
+class H264VideoFrameBusSink: public MediaSink {
+public:
+  static H264VideoFrameBusSink* createNew(UsageEnvironment& env,
+					  char const* busName,
+					  unsigned numSlots,
+					  unsigned slotSize);
+
+protected:
+  H264VideoFrameBusSink(UsageEnvironment& env, H264VideoFrameBus* bus);
+      // called only by createNew()
+  virtual ~H264VideoFrameBusSink();
+
+private: // redefined virtual functions:
+  virtual Boolean sourceIsCompatibleWithUs(MediaSource& source);
+  virtual Boolean continuePlaying();
+
+private:
+  static void afterGettingFrame(void* clientData, unsigned frameSize,
+				unsigned numTruncatedBytes,
+				struct timeval presentationTime,
+				unsigned durationInMicroseconds);
+  void afterGettingFrame1(unsigned frameSize, struct timeval presentationTime,
+			  unsigned durationInMicroseconds);
+  static void getNextFrame(void* clientData);
+
+private:
+  H264VideoFrameBus* fBus;
+  unsigned char* fBuffer;
+  unsigned fBufferSize;
+  Boolean fIsInAccessUnit;
+  struct timeval fNextFrameTime;
+};
+
+// Reads a bus's access units - starting from its latest key frame - and
+// delivers their NAL units, one at a time, as a "H264VideoStreamFramer".
+// (The bus is polled, every "pollInterval" microseconds, for a new access
+// unit.)  A source that falls too far behind skips to the bus's latest key
+// frame (or, if that's gone too, waits for the next).
+
+class H264VideoFrameBusSource: public H264VideoStreamFramer {
+public:
+  static H264VideoFrameBusSource* createNew(UsageEnvironment& env,
+					    char const* busName,
+					    unsigned pollInterval = 5000);
+
+  H264VideoFrameBus& bus() const { return *fBus; }
+  unsigned numOverruns() const { return fNumOverruns; }
+
+protected:
+  H264VideoFrameBusSource(UsageEnvironment& env, H264VideoFrameBus* bus,
+			  unsigned pollInterval);
+      // called only by createNew()
+  virtual ~H264VideoFrameBusSource();
+
+private: // redefined virtual functions:
+  virtual void doGetNextFrame();
+  virtual void doStopGettingFrames();
+  virtual char const* MIMEtype() const;
+  virtual Boolean currentNALUnitEndsAccessUnit();
+
+private:
+  static void pollTask(void* clientData);
+  Boolean readAccessUnit();
+  void deliverNALUnit();
+
+private:
+  H264VideoFrameBus* fBus;
+  unsigned fPollInterval;
+  TaskToken fPollTask;
+  u_int32_t fNextSeqNo; // 0: start from the latest key frame
+  Boolean fWaitingForKeyFrame;
+  unsigned fNumOverruns;
+  // The access unit being delivered, copied out of the bus:
+  unsigned char* fAccessUnit;
+  unsigned fAccessUnitSize, fNextNALUnitOffset;
+  struct timeval fAccessUnitPresentationTime;
+  Boolean fCurrentNALUnitEndsAccessUnit;
+};
+
+#endif
@@ -0,0 +1,64 @@
+/**********
+This library is free software; you can redistribute it and/or modify it under
+the terms of the GNU Lesser General Public License as published by the
+Free Software Foundation; either version 2.1 of the License, or (at your
+option) any later version. (See <http://www.gnu.org/copyleft/lesser.html>.)
+
+This library is distributed in the hope that it will be useful, but WITHOUT
+ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for
+more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with this library; if not, write to the Free Software Foundation, Inc.,
+51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA
+**********/
+// "liveMedia"
+// Copyright (c) 1996-2009 Live Networks, Inc.  All rights reserved.
+// A 'ServerMediaSubsession' object that creates new, unicast, "RTPSink"s
+// on demand, from the live H.264 stream that another process's encoder is
+// writing into a shared-memory "H264VideoFrameBus".
+// C++ header
+
+#ifndef _H264_VIDEO_FRAME_BUS_SERVER_MEDIA_SUBSESSION_HH
+#define _H264_VIDEO_FRAME_BUS_SERVER_MEDIA_SUBSESSION_HH
+
+#ifndef _ON_DEMAND_SERVER_MEDIA_SUBSESSION_HH
+#include "OnDemandServerMediaSubsession.hh"
+#endif
+
+// Any number of server processes - sharing their RTSP port (see
+// "ReusePort" in "GroupsockHelper.hh") - can serve the one encoder this way.
+
+class H264VideoFrameBusServerMediaSubsession: public OnDemandServerMediaSubsession {
+public:
+  static H264VideoFrameBusServerMediaSubsession*
+  createNew(UsageEnvironment& env, char const* busName,
+	    Boolean fanOutFirstSource = False,
+	    unsigned gopCacheSize = 0, unsigned gopBurstRate = 0);
+      // (see "OnDemandServerMediaSubsession" and
+      // "MultiFramedRTPSink::enableGOPCache()"; the GOP cache is used only if
+      // "fanOutFirstSource")
+
+private:
+  H264VideoFrameBusServerMediaSubsession(UsageEnvironment& env,
+					 char const* busName,
+					 Boolean fanOutFirstSource,
+					 unsigned gopCacheSize,
+					 unsigned gopBurstRate);
+      // called only by createNew();
+  virtual ~H264VideoFrameBusServerMediaSubsession();
+
+private: // redefined virtual functions
+  virtual FramedSource* createNewStreamSource(unsigned clientSessionId,
+					      unsigned& estBitrate);
+  virtual RTPSink* createNewRTPSink(Groupsock* rtpGroupsock,
+				    unsigned char rtpPayloadTypeIfDynamic,
+				    FramedSource* inputSource);
+
+private:
+  char* fBusName;
+  unsigned fGOPCacheSize, fGOPBurstRate;
+};
+
+#endif
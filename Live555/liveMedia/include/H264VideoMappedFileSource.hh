@@ -0,0 +1,79 @@
+/**********
+This library is free software; you can redistribute it and/or modify it under
+the terms of the GNU Lesser General Public License as published by the
+Free Software Foundation; either version 2.1 of the License, or (at your
+option) any later version. (See <http://www.gnu.org/copyleft/lesser.html>.)
+
+This library is distributed in the hope that it will be useful, but WITHOUT
+ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for
+more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with this library; if not, write to the Free Software Foundation, Inc.,
+51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA
+**********/
+// "liveMedia"
+// Copyright (c) 1996-2009 Live Networks, Inc.  All rights reserved.
+// A source that delivers - as a "H264VideoStreamFramer" - the NAL units of
+// an indexed, memory-mapped H.264 Elementary Stream file
+// C++ header
+
+#ifndef _H264_VIDEO_MAPPED_FILE_SOURCE_HH
+#define _H264_VIDEO_MAPPED_FILE_SOURCE_HH
+
+#ifndef _H264_VIDEO_STREAM_FRAMER_HH
+#include "H264VideoStreamFramer.hh"
+#endif
+#ifndef _H264_VIDEO_FILE_INDEX_HH
+#include "H264VideoFileIndex.hh"
+#endif
+
+// Each NAL unit is copied straight from the mapping into the reader's
+// buffer: there's no file reading, and no parsing, while streaming.  (The
+// index isn't owned by the source.)
+//
+// At scales other than (0, 1], only key frames are sent: the next one is
+// the first that's at least "scale" frames on (or back, for negative
+// scales), and each lasts for its share of the playing time.
+
+class H264VideoMappedFileSource: public H264VideoStreamFramer {
+public:
+  static H264VideoMappedFileSource* createNew(UsageEnvironment& env,
+					      H264VideoFileIndex& index);
+
+  void seekToNPT(double seekNPT);
+      // continues from the key frame at or before "seekNPT"
+  void setScale(float scale);
+  float scale() const { return fScale; }
+
+protected:
+  H264VideoMappedFileSource(UsageEnvironment& env, H264VideoFileIndex& index);
+      // called only by createNew()
+  virtual ~H264VideoMappedFileSource();
+
+private: // redefined virtual functions:
+  virtual void doGetNextFrame();
+  virtual void doStopGettingFrames();
+  virtual char const* MIMEtype() const;
+  virtual Boolean currentNALUnitEndsAccessUnit();
+
+private:
+  void startAccessUnit(unsigned accessUnit, Boolean fromItsStart = True);
+  Boolean isTrickPlay() const { return fScale > 1.0f || fScale < 0.0f; }
+  Boolean nextKeyFrame(unsigned& accessUnit) const;
+      // in trick play; False if there's none left
+  void deliverNALUnit();
+
+private:
+  H264VideoFileIndex& fIndex;
+  float fScale;
+  unsigned fCurrentAccessUnit;
+  unsigned fNextNALUnit, fEndNALUnit; // of (what remains of) "fCurrentAccessUnit"
+  unsigned fAccessUnitDuration; // in microseconds
+  Boolean fCurrentNALUnitEndsAccessUnit;
+  Boolean fResetPresentationTime;
+  unsigned fLastDuration; // of the previous access unit
+};
+
+#endif
@@ -61,12 +61,16 @@ private: // redefined virtual functions:
                                       unsigned numRemainingBytes);
   virtual Boolean frameCanAppearAfterPacketStart(unsigned char const* frameStart,
 						 unsigned numBytesInFrame) const;
+  virtual Boolean packetStartsKeyFrame(unsigned char const* payload,
+				       unsigned payloadSize);
+      // at its first parameter set (or IDR slice, if it has none)
 
 protected:
   H264FUAFragmenter* fOurFragmenter;
 
 private:
   char* fFmtpSDPLine;
+  unsigned char fLastNALUnitType; // of the last packet to start one
 };
 
 
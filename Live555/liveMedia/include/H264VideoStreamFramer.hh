@@ -47,6 +47,8 @@ private:
 
 class ICameraCaptuer;
 class H264EncWrapper;
+class RTCPRateController;
+class MultiFramedRTPSink;
 class H264DecWrapper;
 struct TNAL;
 
@@ -60,8 +62,21 @@ public:
   static MyH264VideoStreamFramer* createNew(UsageEnvironment& env, FramedSource* inputSource);
   virtual Boolean currentNALUnitEndsAccessUnit();
   virtual void doGetNextFrame();
+  virtual void doStopGettingFrames();
+
+  // Let the RTCP receiver reports of everyone watching "sink" steer the
+  // encoder bitrate.  The controller lives as long as this framer.
+  void startRateControl(MultiFramedRTPSink& sink);
+  RTCPRateController* rateController() const { return m_pRateController; }
+
+  // At most "seconds" from one IDR to the next, e.g. the target duration
+  // of the HTTP Live Stream segments that this source is cut into
+  void setMaxKeyFrameInterval(double seconds);
 
 private:
+  static void onTargetBitrate(void* clientData, unsigned newKbps);
+  static void retryGetNextFrame(void* clientData);
+
   static ICameraCaptuer* m_pCamera;
   
   H264EncWrapper* m_pH264Enc;
@@ -71,21 +86,27 @@ private:
   int m_iCurNalNum; //ǰframeһжٸnal
   int m_iCurNal;//ǰʹõǵڼnal
   unsigned int m_iCurFrame;
+
+  RTCPRateController* m_pRateController;
 };
 
 #include "H264VideoRTPSink.hh"
 #include "ByteStreamFileSource.hh"
 #include "H264VideoStreamFramer.hh"
 #include "FileServerMediaSubsession.hh"
+#include "PassiveServerMediaSubsession.hh"
 
 class H264LiveVideoServerMediaSubsession: public OnDemandServerMediaSubsession{
 public:
   static H264LiveVideoServerMediaSubsession*
-  createNew(UsageEnvironment& env, Boolean reuseFirstSource);
+  createNew(UsageEnvironment& env, Boolean reuseFirstSource,
+	    Boolean fanOutFirstSource = False);
+      // (see "OnDemandServerMediaSubsession")
 
 private:
   H264LiveVideoServerMediaSubsession(UsageEnvironment& env,
-					 Boolean reuseFirstSource);
+					 Boolean reuseFirstSource,
+					 Boolean fanOutFirstSource);
       // called only by createNew();
   virtual ~H264LiveVideoServerMediaSubsession();
 
@@ -95,9 +116,45 @@ private: // redefined virtual functions
   virtual RTPSink* createNewRTPSink(Groupsock* rtpGroupsock,
                                     unsigned char rtpPayloadTypeIfDynamic,
 				                    FramedSource* inputSource);
+      // also starts rate control of "inputSource" from this sink's RTCP RRs
+  virtual void fanOutSourceCreated(FramedSource* inputSource,
+				   MultiFramedRTPSink& packetizer);
+      // ditto, for the fan-out packetizer (created with no "inputSource")
 protected:
   virtual char const* sdpLines();
 };
+
+// The live stream, sent once to a multicast group - any-source, or (if
+// "isSSM") source-specific - however many viewers there are.  RTSP clients
+// are given the group's address.  (Their "ServerMediaSession" must be
+// created with the same "isSSM".)  Streaming starts at once, and stops when
+// the subsession is closed.  With FEC, but no NACKs or RTCP rate control,
+// which would let one viewer steer the stream of all of them.
+class H264LiveVideoMulticastSubsession: public PassiveServerMediaSubsession {
+public:
+  static H264LiveVideoMulticastSubsession*
+  createNew(UsageEnvironment& env, struct in_addr const& groupAddress,
+	    portNumBits rtpPortNum, u_int8_t ttl, Boolean isSSM,
+	    H264VideoStreamFramer* source = NULL);
+      // RTCP uses port "rtpPortNum"+1.  "source" (which is closed with us)
+      // defaults to the camera's.
+
+private:
+  H264LiveVideoMulticastSubsession(RTPSink& rtpSink, RTCPInstance* rtcpInstance,
+				   FramedSource* source, Boolean isSSM);
+      // called only by createNew();
+  virtual ~H264LiveVideoMulticastSubsession();
+
+protected: // redefined virtual functions
+  virtual char const* sdpLines();
+
+private:
+  RTPSink& fOurRTPSink;
+  RTCPInstance* fOurRTCPInstance;
+  FramedSource* fSource;
+  Boolean fIsSSM;
+  char* fOurSDPLines;
+};
 //jiangqi
 
 #endif
@@ -0,0 +1,172 @@
+/**********
+This library is free software; you can redistribute it and/or modify it under
+the terms of the GNU Lesser General Public License as published by the
+Free Software Foundation; either version 2.1 of the License, or (at your
+option) any later version. (See <http://www.gnu.org/copyleft/lesser.html>.)
+
+This library is distributed in the hope that it will be useful, but WITHOUT
+ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for
+more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with this library; if not, write to the Free Software Foundation, Inc.,
+51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA
+**********/
+// "liveMedia"
+// Copyright (c) 1996-2009 Live Networks, Inc.  All rights reserved.
+// A sink that muxes a H.264 video stream into MPEG Transport Stream
+// segments - and (Low-Latency HLS) partial segments - kept in memory, for
+// serving (e.g., by "HLSServer") as a HTTP Live Stream
+// C++ header
+
+#ifndef _HLS_SEGMENTER_HH
+#define _HLS_SEGMENTER_HH
+
+#ifndef _MEDIA_SINK_HH
+#include "MediaSink.hh"
+#endif
+
+// A Transport Stream segment, as it's being (or was) built.  It's shared -
+// through reference counts - by the segmenter and by anyone still sending
+// it, so that it can be sent straight from its buffer even after it's left
+// the segmenter's window.  Its partial segments ("parts") are byte ranges
+// of it.  (A segment that's still being built may grow - and so move - so
+// hold on to the segment, rather than to "data()".)
+
+class HLSSegment {
+public:
+  u_int32_t sequenceNumber() const { return fSequenceNumber; }
+  unsigned char const* data() const { return fData; }
+  unsigned size() const { return fSize; }
+  Boolean isComplete() const { return fIsComplete; }
+  double duration() const { return fDuration; } // seconds, once complete
+
+  unsigned numParts() const { return fNumParts; } // complete parts, so far
+  unsigned partOffset(unsigned i) const { return fParts[i].offset; }
+  unsigned partSize(unsigned i) const { return fParts[i].size; }
+  double partDuration(unsigned i) const { return fParts[i].duration; }
+  Boolean partIsIndependent(unsigned i) const { return fParts[i].isIndependent; }
+      // i.e., it starts with a key frame
+
+  void addRef() { ++fRefCount; }
+  static void release(HLSSegment*& segment);
+      // drops the reference (and sets "segment" to NULL)
+
+private:
+  friend class HLSSegmenter;
+  HLSSegment(u_int32_t sequenceNumber);
+  ~HLSSegment();
+
+  unsigned char* append(unsigned numBytes);
+      // returns space for "numBytes" more bytes at the end
+  void addPart(unsigned offset, double duration, Boolean isIndependent);
+
+private:
+  unsigned fRefCount;
+  u_int32_t fSequenceNumber;
+  unsigned char* fData;
+  unsigned fSize, fMaxSize;
+  Boolean fIsComplete;
+  double fDuration;
+  struct Part {
+    unsigned offset, size;
+    double duration;
+    Boolean isIndependent;
+  }* fParts;
+  unsigned fNumParts, fMaxNumParts;
+};
+
+#define HLS_MAX_NUM_SEGMENTS 16
+
+class HLSSegmenter: public MediaSink {
+public:
+  static HLSSegmenter* createNew(UsageEnvironment& env,
+				 double targetDuration = 4.0,
+				 double partTargetDuration = 0.5,
+				 unsigned numSegments = 6,
+				 double maxKeyFrameInterval = 0.0);
+      // Each segment starts with a key frame (IDR), so it ends at one: the
+      // first that leaves it no more than "targetDuration" (seconds) from
+      // the one after, given that our source's key frames are at most
+      // "maxKeyFrameInterval" apart (e.g. the limit set on its encoder; 0
+      // means "targetDuration").  So no segment runs longer than
+      // "targetDuration" - which is raised, here, to "maxKeyFrameInterval"
+      // if that's longer, and is fixed from then on, as a playlist's
+      // "EXT-X-TARGETDURATION" must be.  Parts end just before they'd run
+      // longer than "partTargetDuration".  The most recent "numSegments"
+      // complete segments (at most HLS_MAX_NUM_SEGMENTS) are kept, and
+      // listed.
+
+  double targetDuration() const { return fTargetDuration; }
+  double partTargetDuration() const { return fPartTargetDuration; }
+
+  unsigned numSegments() const { return fNumSegments; }
+  HLSSegment* segment(unsigned i) const;
+      // the "i"th oldest that we have - complete or not - with the one being
+      // built (if any) last.  The caller adds its own reference.
+  HLSSegment* lookupSegment(u_int32_t sequenceNumber) const;
+      // NULL if it's no longer (or not yet) here
+  u_int32_t nextSequenceNumber() const { return fNextSequenceNumber; }
+      // that of the segment being built, or of the next to be built
+
+  typedef void (newPartHandler)(void* clientData);
+  void setNewPartHandler(newPartHandler* handler, void* clientData);
+      // "handler" is called each time a part (and thus maybe a segment) is
+      // completed.  (Only one handler at a time; NULL for none.)
+
+protected:
+  HLSSegmenter(UsageEnvironment& env, double targetDuration,
+	       double partTargetDuration, unsigned numSegments,
+	       double minSegmentDuration);
+      // called only by createNew()
+  virtual ~HLSSegmenter();
+
+private: // redefined virtual functions:
+  virtual Boolean sourceIsCompatibleWithUs(MediaSource& source);
+  virtual Boolean continuePlaying();
+
+private:
+  static void afterGettingFrame(void* clientData, unsigned frameSize,
+				unsigned numTruncatedBytes,
+				struct timeval presentationTime,
+				unsigned durationInMicroseconds);
+  void afterGettingFrame1(unsigned frameSize, struct timeval presentationTime,
+			  unsigned durationInMicroseconds);
+  static void getNextFrame(void* clientData);
+  void addNALUnit(unsigned char const* nalUnit, unsigned nalUnitSize);
+  void appendNALUnit(unsigned char const* nalUnit, unsigned nalUnitSize);
+  void addAccessUnit(struct timeval presentationTime);
+  void endPart(double endTime);
+  void endSegment(double endTime);
+  void writeTSPackets(u_int16_t pid, unsigned char const* payload,
+		      unsigned payloadSize, Boolean withPCR = False,
+		      u_int64_t pcr = 0, Boolean isRandomAccess = False);
+  void writeProgramTables();
+
+private:
+  double fTargetDuration, fPartTargetDuration;
+  double fMinSegmentDuration; // before we cut at a key frame
+  unsigned fMaxNumSegments, fNumSegments;
+  HLSSegment* fSegments[HLS_MAX_NUM_SEGMENTS + 1]; // oldest first
+  u_int32_t fNextSequenceNumber;
+  HLSSegment* fCurrentSegment; // also the last of "fSegments", if not NULL
+  double fSegmentStartTime, fPartStartTime, fLastFrameTime, fFrameInterval;
+  unsigned fPartOffset; // where the part being built starts
+  Boolean fPartIsIndependent;
+
+  struct timeval fNextFrameTime; // when to ask for the next access unit
+  unsigned char* fBuffer; // for incoming NAL units
+  unsigned fBufferSize;
+  unsigned char* fAccessUnit; // the access unit being gathered, as a PES payload
+  unsigned fAccessUnitSize, fAccessUnitMaxSize;
+  Boolean fAccessUnitIsKeyFrame, fAccessUnitHasSPS, fAccessUnitHasPPS;
+  unsigned char* fSPS; unsigned fSPSSize; // the latest seen, to repeat
+  unsigned char* fPPS; unsigned fPPSSize; // before any key frame without them
+  u_int8_t fContinuityCounter[3]; // PAT, PMT, video
+
+  newPartHandler* fNewPartHandler;
+  void* fNewPartClientData;
+};
+
+#endif
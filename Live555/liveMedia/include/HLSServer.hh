@@ -0,0 +1,119 @@
+/**********
+This library is free software; you can redistribute it and/or modify it under
+the terms of the GNU Lesser General Public License as published by the
+Free Software Foundation; either version 2.1 of the License, or (at your
+option) any later version. (See <http://www.gnu.org/copyleft/lesser.html>.)
+
+This library is distributed in the hope that it will be useful, but WITHOUT
+ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for
+more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with this library; if not, write to the Free Software Foundation, Inc.,
+51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA
+**********/
+// "liveMedia"
+// Copyright (c) 1996-2009 Live Networks, Inc.  All rights reserved.
+// A (non-blocking, keep-alive) HTTP server for the playlist, segments and
+// partial segments of a "HLSSegmenter"'s HTTP Live Stream
+// C++ header
+
+#ifndef _HLS_SERVER_HH
+#define _HLS_SERVER_HH
+
+#include "Media.hh"
+#include "NetInterface.hh"
+
+#define HLS_REQUEST_BUFFER_SIZE 4000
+#define HLS_RESPONSE_HEADER_SIZE 500
+
+class HLSSegmenter;
+class HLSSegment;
+
+// Serves "http://<host>:<port>/<streamName>/index.m3u8", and the
+// "<msn>.ts" segments and "<msn>.<part>.ts" partial segments that it lists.
+// Playlist requests may block (Low-Latency HLS "_HLS_msn" and "_HLS_part"),
+// as may requests for the part that the playlist's preload hint names:
+// they're answered as soon as the segmenter has what they're waiting for.
+// Segments and parts are sent straight from the segmenter's buffers.
+
+class HLSServer: public Medium {
+public:
+  static HLSServer* createNew(UsageEnvironment& env, HLSSegmenter& segmenter,
+			      char const* streamName = "live",
+			      Port ourPort = 8080);
+
+  char* playlistURL() const; // caller must delete[] the result
+
+protected:
+  HLSServer(UsageEnvironment& env, int ourSocket, Port ourPort,
+	    HLSSegmenter& segmenter, char const* streamName);
+      // called only by createNew();
+  virtual ~HLSServer();
+
+  static int setUpOurSocket(UsageEnvironment& env, Port& ourPort);
+
+private:
+  static void incomingConnectionHandler(void*, int /*mask*/);
+  void incomingConnectionHandler1();
+  static void newPartHandler(void* clientData);
+  HLSSegmenter* lookupSegmenter() const;
+
+  // The state of each individual connection handled by a HLS server:
+  class HLSClientConnection {
+  public:
+    HLSClientConnection(HLSServer& ourServer, int clientSocket);
+    virtual ~HLSClientConnection();
+
+    HLSClientConnection* next() const { return fNext; }
+    void retryWaitingRequest();
+        // called whenever the segmenter has something new
+
+  private:
+    static void incomingRequestHandler(void*, int /*mask*/);
+    void incomingRequestHandler1();
+    UsageEnvironment& envir() { return fOurServer.envir(); }
+    void resetRequestBuffer();
+    void handleRequest();
+    Boolean handleCmd_GET(char const* urlSuffix, char const* query);
+        // returns False if the request must wait
+    void handleCmd_bad(unsigned code, char const* reason);
+    Boolean handlePlaylistRequest(HLSSegmenter* segmenter, char const* query);
+    Boolean handleSegmentRequest(HLSSegmenter* segmenter,
+				 u_int32_t sequenceNumber, int partNum);
+    void setResponse(char const* contentType, unsigned contentLength);
+    void sendResponse();
+    static void sendResponseTask(void* clientData);
+    static void waitTimeoutTask(void* clientData);
+    void endRequest();
+
+  private:
+    HLSServer& fOurServer;
+    HLSClientConnection* fNext; // in our server's list
+    int fClientSocket;
+    char fRequestBuffer[HLS_REQUEST_BUFFER_SIZE];
+    unsigned fRequestBytesAlreadySeen, fRequestBufferBytesLeft;
+    char* fLastCRLF;
+    Boolean fKeepAlive, fIsWaiting;
+    TaskToken fWaitTimeoutTask, fSendTask;
+    // The response being sent: a header, then - from "fSegment" or
+    // "fPlaylist" - a body:
+    char fResponseHeader[HLS_RESPONSE_HEADER_SIZE];
+    unsigned fResponseHeaderSize;
+    char* fPlaylist;
+    HLSSegment* fSegment;
+    unsigned fBodyOffset, fBodySize;
+    unsigned fBytesSent; // of header, then body
+  };
+
+private:
+  friend class HLSClientConnection;
+  int fServerSocket;
+  Port fServerPort;
+  char* fSegmenterName; // looked up by name, in case it's closed first
+  char* fStreamName;
+  HLSClientConnection* fConnections;
+};
+
+#endif
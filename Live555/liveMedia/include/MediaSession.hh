@@ -137,6 +137,7 @@ public:
   char const* codecName() const { return fCodecName; }
   char const* protocolName() const { return fProtocolName; }
   char const* controlPath() const { return fControlPath; }
+  unsigned bandwidth() const { return fBandwidth; } // kbps; 0 if unknown
   Boolean isSSM() const { return fSourceFilterAddr.s_addr != 0; }
 
   unsigned short videoWidth() const { return fVideoWidth; }
@@ -144,6 +145,9 @@ public:
   unsigned videoFPS() const { return fVideoFPS; }
   unsigned numChannels() const { return fNumChannels; }
   float& scale() { return fScale; }
+  Boolean nackIsSupported() const { return fNACKIsSupported; }
+  unsigned char rtxPayloadFormat() const { return fRTXPayloadFormat; }
+  unsigned char fecPayloadFormat() const { return fFECPayloadFormat; }
 
   RTPSource* rtpSource() { return fRTPSource; }
   RTCPInstance* rtcpInstance() { return fRTCPInstance; }
@@ -257,6 +261,7 @@ protected:
   Boolean parseSDPAttribute_source_filter(char const* sdpLine);
   Boolean parseSDPAttribute_x_dimensions(char const* sdpLine);
   Boolean parseSDPAttribute_framerate(char const* sdpLine);
+  Boolean parseSDPAttribute_rtcp_fb(char const* sdpLine);
 
 protected:
   // Linkage fields:
@@ -296,6 +301,11 @@ protected:
   unsigned fNumChannels;
      // optionally set by "a=rtpmap:" lines for audio sessions.  Default: 1
   float fScale; // set from a RTSP "Scale:" header
+  Boolean fNACKIsSupported; // set by an "a=rtcp-fb:<fmt> nack" line
+  unsigned char fRTXPayloadFormat;
+     // RFC 4588 retransmissions (set by an "a=fmtp:<rtx fmt> apt=<fmt>" line)
+  unsigned char fFECPayloadFormat;
+     // RFC 5109 parity packets (set by an "a=rtpmap:<fmt> ulpfec/..." line)
   double fNPT_PTS_Offset; // set by "getNormalPlayTime()"; add this to a PTS to get NPT
 
   // Fields set by initiate():
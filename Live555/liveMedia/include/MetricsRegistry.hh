@@ -0,0 +1,169 @@
+/**********
+This library is free software; you can redistribute it and/or modify it under
+the terms of the GNU Lesser General Public License as published by the
+Free Software Foundation; either version 2.1 of the License, or (at your
+option) any later version. (See <http://www.gnu.org/copyleft/lesser.html>.)
+
+This library is distributed in the hope that it will be useful, but WITHOUT
+ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for
+more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with this library; if not, write to the Free Software Foundation, Inc.,
+51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA
+**********/
+// "liveMedia"
+// Copyright (c) 1996-2009 Live Networks, Inc.  All rights reserved.
+// A registry of a server's metrics - counters and gauges, with labels - and
+// their text, in the Prometheus exposition format
+// C++ header
+
+#ifndef _METRICS_REGISTRY_HH
+#define _METRICS_REGISTRY_HH
+
+#include "Media.hh"
+
+#define METRICS_LABELS_SIZE 400
+#define METRICS_COUNTER_NUM_SLOTS 16
+
+class MetricsFamily; // forward
+
+// The labels of one sample, e.g.
+//     MetricsLabels labels;
+//     labels.add("stream", streamName).add("client", clientAddress);
+// (Values are escaped as they're added.)
+
+class MetricsLabels {
+public:
+  MetricsLabels();
+
+  MetricsLabels& add(char const* name, char const* value);
+  MetricsLabels& add(char const* name, unsigned value);
+
+  char const* text() const { return fText; } // "" or "{name="value",...}"
+
+private:
+  char fText[METRICS_LABELS_SIZE];
+  unsigned fSize; // not counting the closing '}'
+};
+
+// Given to each collector, at scrape time, for it to write its samples to.
+// Samples of the same metric may be written in any order (and by different
+// collectors); each metric's "# HELP" and "# TYPE" lines are written once,
+// before all of its samples.  Counters' names should end with "_total".
+
+class MetricsWriter {
+public:
+  void counter(char const* name, char const* help,
+	       MetricsLabels const& labels, double value);
+  void counter(char const* name, char const* help, double value);
+  void gauge(char const* name, char const* help,
+	     MetricsLabels const& labels, double value);
+  void gauge(char const* name, char const* help, double value);
+
+private:
+  friend class MetricsRegistry;
+  MetricsWriter(char const* prefix);
+  virtual ~MetricsWriter();
+
+  void addSample(char const* type, char const* name, char const* help,
+		 char const* labels, double value);
+  char* text(unsigned& size) const;
+      // the exposition, as a string to be delete[]d
+
+private:
+  MetricsFamily* fFamilies; // in the order that they were first written
+  MetricsFamily* fLastFamily;
+  char* fPrefix;
+};
+
+// A counter that any thread may add to, cheaply: each thread adds to its
+// own slot (on its own cache line), and the slots are summed only when
+// the counter is read.  (A thread beyond the first
+// METRICS_COUNTER_NUM_SLOTS shares a slot, and may then - rarely - lose a
+// count.)  Counters are usually static objects; each is written, without
+// labels, by every "MetricsRegistry".
+
+class MetricsCounter {
+public:
+  MetricsCounter(char const* name, char const* help);
+  virtual ~MetricsCounter();
+
+  void add(double amount);
+  void increment() { add(1); }
+  double value() const;
+
+  char const* name() const { return fName; }
+  char const* help() const { return fHelp; }
+
+  static void writeAll(MetricsWriter& writer);
+
+private:
+  struct Slot {
+    double value;
+    char padding[64 - sizeof (double)];
+  };
+  Slot fSlots[METRICS_COUNTER_NUM_SLOTS];
+  char const* fName;
+  char const* fHelp;
+  MetricsCounter* fNext;
+  static MetricsCounter* fFirst; // in a static list, of all counters
+};
+
+// A value that's set by its owner, and read as it is at scrape time.  Like
+// counters, gauges are usually static, and are written by every registry.
+
+class MetricsGauge {
+public:
+  MetricsGauge(char const* name, char const* help);
+  virtual ~MetricsGauge();
+
+  void set(double value) { fValue = value; }
+  void add(double amount) { fValue += amount; } // owner's thread only
+  double value() const { return fValue; }
+
+  static void writeAll(MetricsWriter& writer);
+
+private:
+  volatile double fValue;
+  char const* fName;
+  char const* fHelp;
+  MetricsGauge* fNext;
+  static MetricsGauge* fFirst;
+};
+
+// The registry: all counters and gauges, and the "collectors" that write -
+// at scrape time, from the state of the media that they're given - the
+// metrics that have labels (e.g. per stream, or per client session).
+
+class MetricsRegistry: public Medium {
+public:
+  static MetricsRegistry* createNew(UsageEnvironment& env,
+				    char const* prefix = "live_");
+      // "prefix" is prepended to each metric's name
+
+  typedef void (CollectorFunc)(Medium& medium, MetricsWriter& writer);
+  void addCollector(Medium& medium, CollectorFunc* func);
+      // "medium" is looked up by name at each scrape; once it's been
+      // closed, its collector is forgotten
+
+  char* scrape(unsigned& size);
+      // returns the text of all metrics, as a string to be delete[]d
+
+protected:
+  MetricsRegistry(UsageEnvironment& env, char const* prefix);
+      // called only by createNew()
+  virtual ~MetricsRegistry();
+
+private:
+  struct Collector {
+    char* mediumName;
+    CollectorFunc* func;
+    Collector* next;
+  };
+  Collector* fCollectors;
+  char* fPrefix;
+};
+
+#endif
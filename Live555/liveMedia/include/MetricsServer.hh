@@ -0,0 +1,95 @@
+/**********
+This library is free software; you can redistribute it and/or modify it under
+the terms of the GNU Lesser General Public License as published by the
+Free Software Foundation; either version 2.1 of the License, or (at your
+option) any later version. (See <http://www.gnu.org/copyleft/lesser.html>.)
+
+This library is distributed in the hope that it will be useful, but WITHOUT
+ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for
+more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with this library; if not, write to the Free Software Foundation, Inc.,
+51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA
+**********/
+// "liveMedia"
+// Copyright (c) 1996-2009 Live Networks, Inc.  All rights reserved.
+// A (non-blocking, keep-alive) HTTP server for a "MetricsRegistry"'s
+// metrics, for Prometheus to scrape
+// C++ header
+
+#ifndef _METRICS_SERVER_HH
+#define _METRICS_SERVER_HH
+
+#include "Media.hh"
+#include "NetInterface.hh"
+
+#define METRICS_REQUEST_BUFFER_SIZE 4000
+
+class MetricsRegistry;
+
+// Serves "http://<host>:<port>/metrics".  Each request is answered from the
+// registry's state at the time, on the scheduler's thread, so collectors
+// may read the server's objects without locking.
+
+class MetricsServer: public Medium {
+public:
+  static MetricsServer* createNew(UsageEnvironment& env,
+				  MetricsRegistry& registry,
+				  Port ourPort = 9100);
+
+  char* metricsURL() const; // caller must delete[] the result
+
+protected:
+  MetricsServer(UsageEnvironment& env, int ourSocket, Port ourPort,
+		MetricsRegistry& registry);
+      // called only by createNew();
+  virtual ~MetricsServer();
+
+  static int setUpOurSocket(UsageEnvironment& env, Port& ourPort);
+
+private:
+  static void incomingConnectionHandler(void*, int /*mask*/);
+  void incomingConnectionHandler1();
+  MetricsRegistry* lookupRegistry() const;
+
+  // The state of each individual connection handled by a metrics server:
+  class MetricsClientConnection {
+  public:
+    MetricsClientConnection(MetricsServer& ourServer, int clientSocket);
+    virtual ~MetricsClientConnection();
+
+  private:
+    static void incomingRequestHandler(void*, int /*mask*/);
+    void incomingRequestHandler1();
+    UsageEnvironment& envir() { return fOurServer.envir(); }
+    void resetRequestBuffer();
+    void handleRequest();
+    void setResponse(unsigned code, char const* reason,
+		     char const* body, unsigned bodySize);
+    static void sendResponseHandler(void*, int /*mask*/);
+    void sendResponse();
+    void endRequest();
+
+  private:
+    MetricsServer& fOurServer;
+    MetricsClientConnection* fNext; // in our server's list
+    int fClientSocket;
+    char fRequestBuffer[METRICS_REQUEST_BUFFER_SIZE];
+    unsigned fRequestBytesAlreadySeen, fRequestBufferBytesLeft;
+    char* fLastCRLF;
+    Boolean fKeepAlive, fIsWaitingToSend;
+    char* fResponse; // (header and body) being sent
+    unsigned fResponseSize, fBytesSent;
+  };
+
+private:
+  friend class MetricsClientConnection;
+  int fServerSocket;
+  Port fServerPort;
+  char* fRegistryName; // looked up by name, in case it's closed first
+  MetricsClientConnection* fConnections;
+};
+
+#endif
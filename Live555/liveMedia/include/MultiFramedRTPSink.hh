@@ -26,10 +26,65 @@ along with this library; if not, write to the Free Software Foundation, Inc.,
 #include "RTPSink.hh"
 #endif
 
+class ULPFECEncoder; // forward
+class FanOutRTPSink; // forward
+class GOPCache; // forward
+
 class MultiFramedRTPSink: public RTPSink {
 public:
   void setPacketSizes(unsigned preferredPacketSize, unsigned maxPacketSize);
 
+  void enableRetransmission(unsigned historySize,
+			    unsigned char rtxPayloadType = 0);
+      // Keeps a copy of the last "historySize" packets sent, so that they
+      // can be resent when a receiver NACKs them (RFC 4585).  If
+      // "rtxPayloadType" is non-zero, they are resent in the RFC 4588 "rtx"
+      // format, with that payload type, on a separate SSRC and sequence
+      // number space; otherwise the original packet is sent again as is.
+      // Call this after "setPacketSizes()".  "historySize" 0 turns it off.
+  Boolean retransmissionIsEnabled() const { return fHistory != NULL; }
+  u_int32_t rtxSSRC() const { return fRTXSSRC; }
+  unsigned char rtxPayloadType() const { return fRTXPayloadType; }
+  unsigned numRetransmittedPackets() const { return fNumRetransmittedPackets; }
+  unsigned numUnavailableRetransmissions() const { return fNumUnavailableRetransmissions; }
+      // NACKed packets that had already left the history, or had been
+      // resent too often
+
+  void enableFEC(unsigned char fecPayloadType,
+		 unsigned rowSize, unsigned numRows = 0);
+      // Follows the packets sent with RFC 5109 "ulpfec" parity packets, on
+      // a separate SSRC and sequence number space, so that a receiver can
+      // rebuild lost packets without a round trip.  The packets are taken
+      // in blocks of "numRows" x "rowSize": each row gets a FEC packet, and
+      // so - if "numRows" >= 2 - does each column, once the block is done.
+      // Column FEC recovers bursts (of up to "rowSize" packets), but comes
+      // a whole block later.  "fecPayloadType" 0 turns it off.
+  void setFECGroupSizes(unsigned rowSize, unsigned numRows = 0);
+      // changes the FEC ratio, from the next block on
+  double fecRatio() const;
+      // FEC packets sent per media packet, with the current group sizes
+  unsigned char fecPayloadType() const { return fFECPayloadType; }
+  u_int32_t fecSSRC() const { return fFECSSRC; }
+  unsigned numFECPackets() const { return fNumFECPackets; }
+
+  // Fan-out: each packet that we send is sent again by each of these
+  // sinks, as its own RTP stream (see "FanOutRTPSink"):
+  void addFanOutSink(FanOutRTPSink* sink);
+  void removeFanOutSink(FanOutRTPSink* sink);
+  FanOutRTPSink* fanOutSinks() const { return fFanOutSinks; }
+      // the first; the rest follow through "nextFanOutSink()"
+  unsigned char* sentPacket(u_int16_t seqNo, unsigned& packetSize);
+      // our copy of packet "seqNo", if it's still in the retransmission
+      // history; otherwise NULL
+
+  void enableGOPCache(unsigned maxSize, unsigned burstKbps);
+      // Keeps the packets sent since the last key frame (up to "maxSize"
+      // bytes of them), so that a fan-out sink that starts can first be sent
+      // those - at up to "burstKbps" - rather than wait for the next key
+      // frame.  Needs "packetStartsKeyFrame()".  "maxSize" 0 turns it off.
+  GOPCache* gopCache() const { return fGOPCache; }
+  unsigned gopBurstRate() const { return fGOPBurstRate; } // kbps
+
 protected:
   MultiFramedRTPSink(UsageEnvironment& env,
 		     Groupsock* rtpgs, unsigned char rtpPayloadType,
@@ -65,6 +120,10 @@ protected:
       // frame of size "newFrameSize" to the current RTP packet.
       // (By default, this just calls "numOverflowBytes()", but subclasses can redefine
       // this to (e.g.) impose a granularity upon RTP payload fragments.)
+  virtual Boolean packetStartsKeyFrame(unsigned char const* payload,
+				       unsigned payloadSize);
+      // whether a decoder can start with this packet (default: False).
+      // Called for each packet, in order, if there's a GOP cache.
 
   // Functions that might be called by doSpecialFrameHandling(), or other subclass virtual functions:
   Boolean isFirstPacket() const { return fIsFirstPacket; }
@@ -86,10 +145,19 @@ protected:
 
 public: // redefined virtual functions:
   virtual void stopPlaying();
+  virtual void retransmitPacket(u_int16_t seqNo);
 
 protected: // redefined virtual functions:
   virtual Boolean continuePlaying();
 
+protected:
+  void relayPacket(unsigned char* packet, unsigned packetSize,
+		   struct timeval presentationTime);
+      // For subclasses whose source gives them complete RTP packets, built
+      // elsewhere (in place of "continuePlaying()"'s packetization): the
+      // packet - with its own sequence number - is kept for retransmission,
+      // counted, and handed to our fan-out sinks, but not sent itself.
+
 private:
   void buildAndSendPacket(Boolean isFirstPacket);
   void packFrame();
@@ -108,6 +176,11 @@ private:
 
   static void ourHandleClosure(void* clientData);
 
+  void fanOutPacket(unsigned char* packet, unsigned packetSize);
+  void saveSentPacket(unsigned char const* packet, unsigned packetSize);
+  void deleteHistory();
+  void sendFECPackets();
+
 private:
   OutPacketBuffer* fOutBuf;//͵ݰ
 
@@ -125,6 +198,35 @@ private:
   unsigned fCurFrameSpecificHeaderSize; // size in bytes of cur frame-specific header
   unsigned fTotalFrameSpecificHeaderSizes; // size of all frame-specific hdrs in pkt
   unsigned fOurMaxPacketSize;
+
+  // Recently sent packets, for retransmission; indexed by sequence number:
+  struct SentPacket {
+    u_int16_t seqNo;
+    unsigned size; // 0 if the slot is empty
+    unsigned numRetransmissions;
+    unsigned char* data;
+  };
+  SentPacket* fHistory;
+  unsigned fHistorySize;
+  unsigned fHistoryPacketSize; // size of each slot's "data"
+  unsigned char* fHistoryData;
+  unsigned char fRTXPayloadType; // 0 if RFC 4588 isn't used
+  u_int32_t fRTXSSRC;
+  u_int16_t fRTXSeqNo;
+  unsigned char* fRTXBuf;
+  unsigned fNumRetransmittedPackets, fNumUnavailableRetransmissions;
+
+  ULPFECEncoder* fFECEncoder; // NULL unless FEC is enabled
+  unsigned char fFECPayloadType;
+  u_int32_t fFECSSRC;
+  u_int16_t fFECSeqNo;
+  unsigned fNumFECPackets;
+
+  FanOutRTPSink* fFanOutSinks;
+  struct timeval fCurrentPresentationTime; // of the packet being built
+
+  GOPCache* fGOPCache; // NULL unless enabled
+  unsigned fGOPBurstRate;
 };
 
 #endif
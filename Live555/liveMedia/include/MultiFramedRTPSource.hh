@@ -28,8 +28,48 @@ along with this library; if not, write to the Free Software Foundation, Inc.,
 
 class BufferedPacket; // forward
 class BufferedPacketFactory; // forward
+class FrameFragments; // forward
+class RTCPInstance; // forward
+class ULPFECDecoder; // forward
+class NACKGapList; // forward
 
 class MultiFramedRTPSource: public RTPSource {
+public:
+  void getNextFrameFragments(FrameFragments& fragments, unsigned maxSize,
+			     afterGettingFunc* afterGettingFunc,
+			     void* afterGettingClientData,
+			     onCloseFunc* onCloseFunc,
+			     void* onCloseClientData);
+      // Like "getNextFrame()", except that the frame is not copied anywhere.
+      // Instead, "fragments" (which should be empty) is filled in with where
+      // each piece of it lies in the received packets.  Those packets are
+      // not reused until "fragments.release()" is called, which must be done
+      // before this source is deleted.
+
+  void setNACKSender(RTCPInstance* rtcpInstance,
+		     unsigned char rtxPayloadFormat = 0,
+		     unsigned reorderWindow = 20000);
+      // Has "rtcpInstance" (our RTCP instance) NACK each gap in the incoming
+      // sequence numbers (RFC 4585), so that the sender can resend the
+      // missing packets while they're still awaited.  Packets that are still
+      // missing "reorderWindow" microseconds after the gap was seen are
+      // NACKed; ones that were merely reordered will have arrived by then.
+      // The packet reordering threshold time should be longer than that
+      // plus the round trip time.  If "rtxPayloadFormat" is non-zero,
+      // packets with that payload type are taken to be RFC 4588
+      // retransmissions.  The RTCP instance is looked up by name each time,
+      // so it may be closed first.  NULL turns this off.
+  unsigned numNACKedPackets() const { return fNumNACKedPackets; }
+  unsigned numRTXPacketsReceived() const { return fNumRTXPacketsReceived; }
+
+  void setFECPayloadFormat(unsigned char fecPayloadFormat);
+      // Takes packets with this payload type to be RFC 5109 "ulpfec" parity
+      // packets for our stream, and uses them to rebuild lost packets before
+      // they're depacketized.  Column FEC comes a whole block after the
+      // packets it protects, so the packet reordering threshold time should
+      // cover that.  0 turns this off.
+  unsigned numFECRecoveredPackets() const { return fNumFECRecoveredPackets; }
+
 protected:
   MultiFramedRTPSource(UsageEnvironment& env, Groupsock* RTPgs,
 		       unsigned char rtpPayloadFormat,
@@ -59,6 +99,7 @@ private:
   // redefined virtual functions:
   virtual void doGetNextFrame();
   virtual void setPacketReorderingThresholdTime(unsigned uSeconds);
+  virtual Boolean isMultiFramedRTPSource() const;
 
 private:
   void reset();
@@ -66,15 +107,76 @@ private:
 
   static void networkReadHandler(MultiFramedRTPSource* source, int /*mask*/);
   friend void networkReadHandler(MultiFramedRTPSource*, int);
+  Boolean storeIncomingPacket(BufferedPacket* bPacket,
+			      struct timeval const& timeNow,
+			      Boolean wasRecovered = False);
+      // checks the RTP header of a packet that has just been read, and queues
+      // it for delivery.  Returns False if the packet is not wanted.
+  void recoverLostPackets(struct timeval const& timeNow);
+  void noteSeqNo(unsigned short rtpSeqNo, struct timeval const& timeNow);
+      // notes any packets missing just before "rtpSeqNo", to be NACKed
+  void sendDueNACKs(struct timeval const& timeNow);
+  static void nackTimeoutHandler(MultiFramedRTPSource* source);
 
   Boolean fAreDoingNetworkReads;
   Boolean fNeedDelivery;
   Boolean fPacketLossInFragmentedFrame;
   unsigned char* fSavedTo;
   unsigned fSavedMaxSize;
+  FrameFragments* fFragments; // non-NULL while a "getNextFrameFragments()" is pending
+
+  char* fNACKSenderName; // NULL unless "setNACKSender()" was called
+  unsigned char fRTXPayloadFormat;
+  NACKGapList* fNACKGaps; // the gaps waiting out the reordering window
+  TaskToken fNACKTask;
+  Boolean fHaveSeenSeqNo;
+  unsigned short fHighestSeqNo;
+  unsigned fNumNACKedPackets, fNumRTXPacketsReceived;
+
+  ULPFECDecoder* fFECDecoder; // NULL unless "setFECPayloadFormat()" was called
+  unsigned char fFECPayloadFormat;
+  unsigned fNumFECRecoveredPackets;
 
   // A buffer to (optionally) hold incoming pkts that have been reorderered
   class ReorderingPacketBuffer* fReorderingBuffer;
+  friend class FrameFragments;
+};
+
+
+// The pieces of one frame, as delivered by
+// "MultiFramedRTPSource::getNextFrameFragments()".  Each piece points into
+// a received packet's buffer, and holds a reference to that packet.
+
+class FrameFragments {
+public:
+  FrameFragments();
+  virtual ~FrameFragments(); // also releases
+
+  unsigned numFragments() const { return fNumFragments; }
+  unsigned char* fragmentData(unsigned i) const { return fFragments[i].data; }
+  unsigned fragmentSize(unsigned i) const { return fFragments[i].size; }
+  unsigned totalSize() const { return fTotalSize; }
+
+  unsigned copyTo(unsigned char* to, unsigned toSize) const;
+      // For consumers that need the frame in one piece.  Returns the number
+      // of bytes copied (at most "toSize").
+  void release();
+      // Gives the packets back to the source.  Afterwards, this is empty.
+
+private:
+  friend class MultiFramedRTPSource;
+  void append(MultiFramedRTPSource* source, BufferedPacket* packet,
+	      unsigned char* data, unsigned size);
+
+  struct Fragment {
+    BufferedPacket* packet;
+    unsigned char* data;
+    unsigned size;
+  };
+  MultiFramedRTPSource* fSource;
+  Fragment* fFragments;
+  unsigned fNumFragments, fMaxFragments;
+  unsigned fTotalSize;
 };
 
 
@@ -89,8 +191,18 @@ public:
 
   Boolean hasUsableData() const { return fTail > fHead; }
   unsigned useCount() const { return fUseCount; }
+  unsigned& referenceCount() { return fReferenceCount; }
+      // how many owners (the reordering buffer, and "FrameFragments") the
+      // packet has; it is reused only once this drops to 0
 
   Boolean fillInData(RTPInterface& rtpInterface);
+  void fillInData(unsigned char* data, unsigned dataSize);
+      // for a packet that didn't come from the network (e.g., one rebuilt
+      // from FEC)
+  static unsigned fillInDataBatch(RTPInterface& rtpInterface,
+				  BufferedPacket** packets, unsigned numPackets);
+      // Fills "packets[0..]" with as many waiting network packets as are
+      // available (see "RTPInterface::handleReadBatch()"), returning how many.
   void assignMiscParams(unsigned short rtpSeqNo, unsigned rtpTimestamp,
 			struct timeval presentationTime,
 			Boolean hasBeenSyncedUsingRTCP,
@@ -103,6 +215,12 @@ public:
 	   unsigned short& rtpSeqNo, unsigned& rtpTimestamp,
 	   struct timeval& presentationTime,
 	   Boolean& hasBeenSyncedUsingRTCP, Boolean& rtpMarkerBit);
+  void useInPlace(unsigned char*& framePtr, unsigned toSize,
+		  unsigned& bytesUsed, unsigned& bytesTruncated,
+		  unsigned short& rtpSeqNo, unsigned& rtpTimestamp,
+		  struct timeval& presentationTime,
+		  Boolean& hasBeenSyncedUsingRTCP, Boolean& rtpMarkerBit);
+      // like "use()", but just returns where the frame is, in "framePtr"
 
   BufferedPacket*& nextPacket() { return fNextPacket; }
 
@@ -130,9 +248,10 @@ protected:
   unsigned fTail;
 
 private:
-  BufferedPacket* fNextPacket; // used to link together packets
+  BufferedPacket* fNextPacket; // used to link together free packets
 
   unsigned fUseCount;
+  unsigned fReferenceCount;
   unsigned short fRTPSeqNo;
   unsigned fRTPTimestamp;
   struct timeval fPresentationTime; // corresponding to "fRTPTimestamp"
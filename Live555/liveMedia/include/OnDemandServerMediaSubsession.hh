@@ -25,15 +25,29 @@ along with this library; if not, write to the Free Software Foundation, Inc.,
 #ifndef _SERVER_MEDIA_SESSION_HH
 #include "ServerMediaSession.hh"
 #endif
-#ifndef _RTP_SINK_HH
-#include "RTPSink.hh"
+#ifndef _MULTI_FRAMED_RTP_SINK_HH
+#include "MultiFramedRTPSink.hh"
 #endif
 
 //
 class OnDemandServerMediaSubsession: public ServerMediaSubsession {
+public:
+  void setIdleGracePeriod(unsigned seconds);
+      // For a fan-out subsession: how long its source and packetizer keep
+      // running after its last stream is torn down - so that a viewer who
+      // comes back (or the next one) starts at once, from the GOP cache -
+      // before they're released.  (The default, 0, releases them at once.)
+
 protected: // we're a virtual base class
   OnDemandServerMediaSubsession(UsageEnvironment& env, Boolean reuseFirstSource,
-				portNumBits initialPortNum = 6970);
+				portNumBits initialPortNum = 6970,
+				Boolean fanOutFirstSource = False);
+      // If "fanOutFirstSource" is True, all RTP clients are fed from a single
+      // source and "RTPSink" (which must be a "MultiFramedRTPSink"), packetized
+      // once; each client gets its own copy of each packet - with its own RTP
+      // header - from a "FanOutRTPSink", and can pause independently.  The
+      // "RTPSink" is created (with no "inputSource") at the first "SETUP";
+      // the source - e.g. a camera and encoder - only at the first "PLAY".
   virtual ~OnDemandServerMediaSubsession();
 
 protected: // redefined virtual functions
@@ -60,6 +74,12 @@ protected: // redefined virtual functions
   virtual void seekStream(unsigned clientSessionId, void* streamToken, double seekNPT);
   virtual void setStreamScale(unsigned clientSessionId, void* streamToken, float scale);
   virtual void deleteStream(unsigned clientSessionId, void*& streamToken);
+  virtual void getRTPSinkandRTCP(void* streamToken,
+				 RTPSink*& rtpSink, RTCPInstance*& rtcp);
+  virtual PipelineState pipelineState() const;
+
+protected:
+  Boolean fansOutFirstSource() const { return fFanOutFirstSource; }
 
 protected: // new virtual functions, possibly redefined by subclasses
   virtual char const* getAuxSDPLine(RTPSink* rtpSink,
@@ -67,6 +87,10 @@ protected: // new virtual functions, possibly redefined by subclasses
   virtual void seekStreamSource(FramedSource* inputSource, double seekNPT);
   virtual void setStreamSourceScale(FramedSource* inputSource, float scale);
   virtual void closeStreamSource(FramedSource *inputSource);
+  virtual void fanOutSourceCreated(FramedSource* inputSource,
+				   MultiFramedRTPSink& packetizer);
+      // called - for a fan-out subsession - when "packetizer" (created
+      // earlier) is about to start playing "inputSource"
 
 protected: // new virtual functions, defined by all subclasses
   virtual FramedSource* createNewStreamSource(unsigned clientSessionId,
@@ -80,6 +104,12 @@ private:
   void setSDPLinesFromRTPSink(RTPSink* rtpSink, FramedSource* inputSource,
 			      unsigned estBitrate);
       // used to implement "sdpLines()"
+  MultiFramedRTPSink* getFanOutPacketizer();
+  void startFanOutPacketizer();
+  void releaseFanOutPacketizer();
+      // used by fan-out streams
+  void closeFanOutPacketizer();
+  static void idleTimeout(void* clientData);
 
 //jiangqi : privet -> protected
 protected:
@@ -88,6 +118,14 @@ protected:
 private:
   Boolean fReuseFirstSource;
   portNumBits fInitialPortNum;
+  Boolean fFanOutFirstSource;
+  FramedSource* fFanOutSource;
+  MultiFramedRTPSink* fFanOutPacketizer;
+  Groupsock* fFanOutGroupsock; // has no destinations
+  unsigned fFanOutBitrate; // kbps; an estimate until the source is created
+  unsigned fNumFanOutStreams;
+  unsigned fIdleGracePeriod; // seconds
+  TaskToken fIdleTask;
   HashTable* fDestinationsHashTable; // indexed by client session id
   void* fLastStreamToken;
   char fCNAME[100]; // for RTCP
@@ -63,6 +63,8 @@ protected: // redefined virtual functions
 			   void* rtcpRRHandlerClientData,
                            unsigned short& rtpSeqNum,
                            unsigned& rtpTimestamp);
+  virtual void getRTPSinkandRTCP(void* streamToken,
+				 RTPSink*& rtpSink, RTCPInstance*& rtcp);
 
 private:
   RTPSink& fRTPSink;
@@ -0,0 +1,182 @@
+/**********
+This library is free software; you can redistribute it and/or modify it under
+the terms of the GNU Lesser General Public License as published by the
+Free Software Foundation; either version 2.1 of the License, or (at your
+option) any later version. (See <http://www.gnu.org/copyleft/lesser.html>.)
+
+This library is distributed in the hope that it will be useful, but WITHOUT
+ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for
+more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with this library; if not, write to the Free Software Foundation, Inc.,
+51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA
+**********/
+// "liveMedia"
+// Copyright (c) 1996-2009 Live Networks, Inc.  All rights reserved.
+// 'ServerMediaSession' and 'ServerMediaSubsession' objects that re-serve - to
+// any number of our own clients - a stream pulled (once) from another RTSP server
+// C++ header
+
+#ifndef _PROXY_SERVER_MEDIA_SUBSESSION_HH
+#define _PROXY_SERVER_MEDIA_SUBSESSION_HH
+
+#ifndef _ON_DEMAND_SERVER_MEDIA_SUBSESSION_HH
+#include "OnDemandServerMediaSubsession.hh"
+#endif
+#ifndef _RTSP_CLIENT_HH
+#include "RTSPClient.hh"
+#endif
+#ifndef _MEDIA_SESSION_HH
+#include "MediaSession.hh"
+#endif
+
+#define PROXY_RTSP_TIMEOUT 10 // seconds, for each exchange with the upstream server
+
+// A stream on another ("upstream") RTSP server, re-served as ours.  It's
+// described (with a RTSP "DESCRIBE") when it's created, and gets a
+// "ProxyServerMediaSubsession" for each of the upstream subsessions once the
+// description has come back.  They're all set up, and played, as our first
+// client arrives, and the upstream session is torn down once the last of
+// them has gone.  (It's not kept connected in between, because the server
+// would time us out.)  The "RTSPClient" is driven asynchronously, so a slow
+// or dead upstream server holds up only the "DESCRIBE"s and "SETUP"s of
+// this stream: "RTSPServer" answers them once the upstream server has (or
+// "PROXY_RTSP_TIMEOUT" has passed).
+
+class ProxyServerMediaSession: public ServerMediaSession {
+public:
+  static ProxyServerMediaSession* createNew(UsageEnvironment& env,
+					    char const* streamName,
+					    char const* rtspURL,
+					    char const* username = NULL,
+					    char const* password = NULL,
+					    int verbosityLevel = 0,
+					    char const* description = NULL);
+
+  char const* url() const { return fURL; }
+  MediaSession* upstreamSession() const { return fSession; }
+      // NULL until the stream has been described
+
+protected:
+  ProxyServerMediaSession(UsageEnvironment& env, char const* streamName,
+			  char const* rtspURL,
+			  char const* username, char const* password,
+			  int verbosityLevel, char const* description);
+      // called only by createNew()
+  virtual ~ProxyServerMediaSession();
+
+protected: // redefined virtual functions
+  virtual Boolean isReady(readyHandler* handler, void* clientData);
+      // ready once described (or once that has failed); if it hasn't been,
+      // a new "DESCRIBE" is sent
+  virtual void cancelReadyHandler(void* clientData);
+
+private:
+  friend class ProxyServerMediaSubsession;
+  Boolean isStreaming(readyHandler* handler, void* clientData);
+      // whether the upstream session is playing; if not, it's started
+  void addStreamUser() { ++fNumStreamUsers; }
+  void removeStreamUser();
+      // (nothing is torn down until there are no users left)
+
+  RTSPClient* newClient();
+  void sendDescribe();
+  static void describeResponseHandler(RTSPClient* client, void* clientData,
+				      int resultCode, char* resultString);
+  void describeResponseHandler1(int resultCode, char* resultString);
+  void startStreaming();
+  void sendSetups();
+  static void setupResponseHandler(RTSPClient* client, void* clientData,
+				   int resultCode, char* resultString);
+  void setupResponseHandler1(int resultCode, char* resultString);
+  static void playResponseHandler(RTSPClient* client, void* clientData,
+				  int resultCode, char* resultString);
+  void playResponseHandler1(int resultCode, char* resultString);
+  void stopStreaming();
+  static void teardownResponseHandler(RTSPClient* client, void* clientData,
+				      int resultCode, char* resultString);
+  void scheduleTimeout();
+  static void timeoutHandler(void* clientData);
+  void failRequest(int resultCode, char const* resultString);
+  void closeClient(); // also forgets the upstream subsessions' state
+  void addReadyHandler(readyHandler* handler, void* clientData);
+  void callReadyHandlers();
+
+private:
+  char* fURL;
+  Authenticator fAuthenticator;
+  int fVerbosityLevel;
+  MediaSession* fSession;
+  RTSPClient* fClient; // NULL unless a request is outstanding, or we're playing
+  RTSPClient* fTearingDownClient; // until its "TEARDOWN" has been sent
+  enum {
+    UPSTREAM_IDLE,
+    UPSTREAM_DESCRIBING,
+    UPSTREAM_SETTING_UP, // "DESCRIBE" (for the client's base URL), "SETUP"s
+    UPSTREAM_STARTING, // "PLAY"
+    UPSTREAM_PLAYING
+  } fState;
+  unsigned fNumResponsesAwaited; // to our "SETUP"s
+  TaskToken fTimeoutTask;
+  unsigned fNumStreamUsers;
+  struct ReadyHandlerRecord {
+    readyHandler* handler;
+    void* clientData;
+    ReadyHandlerRecord* next;
+  }* fReadyHandlers;
+};
+
+// The subsession's RTP packets are read straight from the upstream
+// subsession's socket and - with no depacketizing or repacketizing - sent to
+// each of our clients (through the "OnDemandServerMediaSubsession"'s
+// fan-out), with only their SSRC, sequence number and timestamp rewritten.
+// Our SDP is the upstream subsession's, with our own connection and control
+// lines; "rtx" and FEC (if the upstream server sends them) are not relayed.
+
+class ProxyServerMediaSubsession: public OnDemandServerMediaSubsession {
+public:
+  MediaSubsession& upstream() const { return fUpstream; }
+
+protected:
+  ProxyServerMediaSubsession(UsageEnvironment& env,
+			     ProxyServerMediaSession& proxySession,
+			     MediaSubsession& upstream);
+      // called only by "ProxyServerMediaSession"
+  virtual ~ProxyServerMediaSubsession();
+
+protected: // redefined virtual functions
+  virtual Boolean isReady(readyHandler* handler, void* clientData);
+      // ready once the upstream session is playing (or starting it failed)
+  virtual void cancelReadyHandler(void* clientData);
+  virtual char const* sdpLines();
+  virtual void getStreamParameters(unsigned clientSessionId,
+				   netAddressBits clientAddress,
+				   Port const& clientRTPPort,
+				   Port const& clientRTCPPort,
+				   int tcpSocketNum,
+				   unsigned char rtpChannelId,
+				   unsigned char rtcpChannelId,
+				   netAddressBits& destinationAddress,
+				   u_int8_t& destinationTTL,
+				   Boolean& isMulticast,
+				   Port& serverRTPPort,
+				   Port& serverRTCPPort,
+				   void*& streamToken);
+  virtual void deleteStream(unsigned clientSessionId, void*& streamToken);
+  virtual FramedSource* createNewStreamSource(unsigned clientSessionId,
+					      unsigned& estBitrate);
+  virtual RTPSink* createNewRTPSink(Groupsock* rtpGroupsock,
+				    unsigned char rtpPayloadTypeIfDynamic,
+				    FramedSource* inputSource);
+  virtual void closeStreamSource(FramedSource* inputSource);
+
+private:
+  friend class ProxyServerMediaSession;
+  ProxyServerMediaSession& fProxySession;
+  MediaSubsession& fUpstream;
+  FramedSource* fSource; // reading the upstream subsession, if it's active
+};
+
+#endif
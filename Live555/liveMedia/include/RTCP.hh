@@ -80,6 +80,13 @@ public:
       // a specific source address and port.  (Note that if both a specific
       // and a general "RR" handler function is set, then both will be called.)
 
+  unsigned sendNACK(u_int32_t mediaSSRC, u_int16_t firstSeqNo,
+		    unsigned numSeqNos);
+      // Sends, right away, a RTCP generic NACK (RFC 4585) asking the sender
+      // of "mediaSSRC" for packets "firstSeqNo" ... "firstSeqNo"+"numSeqNos"-1
+      // again.  Only for a RTCP instance that has a "RTPSource".  Returns
+      // how many of them were asked for (there's a limit per packet).
+
   Groupsock* RTCPgs() const { return fRTCPInterface.gs(); }
 
   void setStreamSocket(int sockNum, unsigned char streamChannelId);
@@ -117,6 +124,7 @@ private:
         void enqueueReportBlock(RTPReceptionStats* receptionStats);
   void addSDES();
   void addBYE();
+  void addNACK(u_int32_t mediaSSRC, u_int16_t firstSeqNo, unsigned numSeqNos);
 
   void sendBuiltPacket();
 
@@ -185,6 +193,10 @@ const unsigned char RTCP_PT_RR = 201;
 const unsigned char RTCP_PT_SDES = 202;
 const unsigned char RTCP_PT_BYE = 203;
 const unsigned char RTCP_PT_APP = 204;
+const unsigned char RTCP_PT_RTPFB = 205; // transport layer feedback (RFC 4585)
+
+// RTPFB feedback message types (in the 'count' field):
+const unsigned char RTCP_FMT_NACK = 1; // generic NACK
 
 // SDES tags:
 const unsigned char RTCP_SDES_END = 0;
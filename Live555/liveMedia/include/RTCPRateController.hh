@@ -0,0 +1,83 @@
+/**********
+This library is free software; you can redistribute it and/or modify it under
+the terms of the GNU Lesser General Public License as published by the
+Free Software Foundation; either version 2.1 of the License, or (at your
+option) any later version. (See <http://www.gnu.org/copyleft/lesser.html>.)
+
+This library is distributed in the hope that it will be useful, but WITHOUT
+ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for
+more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with this library; if not, write to the Free Software Foundation, Inc.,
+51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA
+**********/
+// "liveMedia"
+// Copyright (c) 1996-2009 Live Networks, Inc.  All rights reserved.
+// A congestion controller that picks a stream's encoder bitrate from the
+// RTCP receiver reports of all of its viewers
+// C++ header
+
+#ifndef _RTCP_RATE_CONTROLLER_HH
+#define _RTCP_RATE_CONTROLLER_HH
+
+#ifndef _MULTI_FRAMED_RTP_SINK_HH
+#include "MultiFramedRTPSink.hh"
+#endif
+
+class RTCPRateController: public Medium {
+public:
+  typedef void (RateChangeFunc)(void* clientData, unsigned newKbps);
+
+  static RTCPRateController* createNew(UsageEnvironment& env,
+				       MultiFramedRTPSink& sink,
+				       unsigned startKbps,
+				       unsigned minKbps, unsigned maxKbps,
+				       RateChangeFunc* rateChangeFunc,
+				       void* clientData);
+      // "rateChangeFunc" is called (from the event loop) each time the
+      // target changes.  "sink" is looked up by name on every check, so it
+      // may be closed first; the controller then goes idle.  The reports of
+      // its fan-out sinks' viewers count too.
+
+  // The control loop's state, for monitoring:
+  unsigned targetKbps() const { return fTargetKbps; }
+  unsigned numReceivers() const { return fNumReceivers; }
+      // viewers that sent a RR since the previous decision
+  double lossFraction() const { return fLossFraction; } // worst viewer, 0..1
+  unsigned jitterMs() const { return fJitterMs; } // worst viewer
+  unsigned rttMs() const { return fRTTMs; } // worst viewer, 0 if unknown
+  unsigned minRTTMs() const { return fMinRTTMs; } // lowest seen, 0 if unknown
+  unsigned numIncreases() const { return fNumIncreases; }
+  unsigned numDecreases() const { return fNumDecreases; }
+  unsigned numHolds() const { return fNumHolds; }
+
+protected:
+  RTCPRateController(UsageEnvironment& env, MultiFramedRTPSink& sink,
+		     unsigned startKbps, unsigned minKbps, unsigned maxKbps,
+		     RateChangeFunc* rateChangeFunc, void* clientData);
+      // called only by createNew()
+  virtual ~RTCPRateController();
+
+private:
+  static void checkReports(void* clientData);
+  void checkReports1();
+  void decide();
+
+private:
+  char* fSinkName;
+  unsigned fMinKbps, fMaxKbps;
+  RateChangeFunc* fRateChangeFunc;
+  void* fClientData;
+  TaskToken fCheckTask;
+  struct timeval fLastDecisionTime;
+
+  unsigned fTargetKbps;
+  unsigned fNumReceivers;
+  double fLossFraction;
+  unsigned fJitterMs, fRTTMs, fMinRTTMs;
+  unsigned fNumIncreases, fNumDecreases, fNumHolds;
+};
+
+#endif
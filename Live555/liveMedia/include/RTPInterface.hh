@@ -35,6 +35,16 @@ along with this library; if not, write to the Free Software Foundation, Inc.,
 typedef void AuxHandlerFunc(void* clientData, unsigned char* packet,
 			    unsigned packetSize);
 
+// Typedef for an optional handler function, to be called with each byte
+// that arrives - on a TCP socket that's being read for RTP-over-TCP - that
+// isn't part of an RTP or RTCP packet (e.g., a RTSP response).  It's also
+// called with 0xFF if the socket fails, and with 0xFE when the socket stops
+// being read for RTP-over-TCP (so the handler's owner must read it again):
+typedef void AlternativeByteHandler(void* clientData, u_int8_t byte);
+
+// The most packets that "RTPInterface::handleReadBatch()" reads at a time:
+#define MAX_PACKETS_PER_READ 32
+
 class tcpStreamRecord {
 public:
   tcpStreamRecord(int streamSocketNum, unsigned char streamChannelId,
@@ -59,13 +69,27 @@ public:
   void removeStreamSocket(int sockNum, unsigned char streamChannelId);
 
   void sendPacket(unsigned char* packet, unsigned packetSize);
+  void sendPacket(unsigned char* header, unsigned headerSize,
+		  unsigned char* payload, unsigned payloadSize);
+      // sends "header" followed by "payload" as one packet, without first
+      // copying them together
   void startNetworkReading(TaskScheduler::BackgroundHandlerProc*
                            handlerProc);
   Boolean handleRead(unsigned char* buffer, unsigned bufferMaxSize,
 		     unsigned& bytesRead,
 		     struct sockaddr_in& fromAddress);
+  unsigned handleReadBatch(unsigned char** buffers, unsigned bufferMaxSize,
+			   unsigned* bytesRead, unsigned maxPackets);
+      // Reads up to "maxPackets" (at most MAX_PACKETS_PER_READ) packets that
+      // are already waiting, returning how many were read; 0 means failure.
+      // Over TCP, this reads just one packet, as "handleRead()" does.
   void stopNetworkReading();
 
+  static void setAlternativeByteHandler(UsageEnvironment& env, int socketNum,
+					AlternativeByteHandler* handler,
+					void* clientData);
+      // A NULL "handler" removes any existing one
+
   UsageEnvironment& envir() const { return fOwner->envir(); }
 
   void setAuxilliaryReadHandler(AuxHandlerFunc* handlerFunc,
@@ -41,6 +41,9 @@ public:
   u_int32_t convertToRTPTimestamp(struct timeval tv);
   unsigned packetCount() const {return fPacketCount;}
   unsigned octetCount() const {return fOctetCount;}
+  virtual void retransmitPacket(u_int16_t seqNo);
+      // called when a receiver asks (with a RTCP NACK) for packet "seqNo"
+      // again.  By default, sent packets are not kept, so this does nothing.
 
   // used by RTSP servers:
   Groupsock const& groupsockBeingUsed() const { return *(fRTPInterface.gs()); }
@@ -146,6 +146,10 @@ public:
   // The following is called when a RTCP BYE packet is received:
   void removeRecord(u_int32_t SSRC);
 
+  // The following is called when a lost packet has been rebuilt (e.g., from
+  // FEC), after "noteIncomingPacket()" has been called for it:
+  void noteRecoveredPacket(u_int32_t SSRC);
+
   RTPReceptionStats* lookup(u_int32_t SSRC) const;
 
 protected: // constructor and destructor, called only by RTPSource:
@@ -172,6 +176,8 @@ public:
     return fNumPacketsReceivedSinceLastReset;
   }
   unsigned totNumPacketsReceived() const { return fTotNumPacketsReceived; }
+      // (including those recovered:)
+  unsigned totNumPacketsRecovered() const { return fTotNumPacketsRecovered; }
   double totNumKBytesReceived() const;
 
   unsigned totNumPacketsExpected() const {
@@ -226,6 +232,7 @@ protected:
   u_int32_t fSSRC;
   unsigned fNumPacketsReceivedSinceLastReset;
   unsigned fTotNumPacketsReceived;
+  unsigned fTotNumPacketsRecovered;
   u_int32_t fTotBytesReceived_hi, fTotBytesReceived_lo;
   Boolean fHaveSeenInitialSequenceNumber;
   unsigned fBaseExtSeqNumReceived;
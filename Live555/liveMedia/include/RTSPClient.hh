@@ -135,6 +135,48 @@ public:
       // Issues a RTSP "TEARDOWN" command on "subsession".
       // Returns True iff this command succeeds
 
+  // An asynchronous (non-blocking) alternative to the above.  Each
+  // "send...Command()" queues its request - to be sent once the connection
+  // (opened, without blocking, by the first such call) is up, and, for
+  // requests that need a session id, once the first "SETUP" has got one -
+  // and returns its "CSeq" at once (or 0 on failure, in which case
+  // "handler" won't be called).  Requests are pipelined on the connection;
+  // "handler" is called, from the event loop, with the response:
+  //   "resultCode": 0 (success), the RTSP response code (if not 200), or
+  //     (for a failed connection) -1 or minus an "errno";
+  //   "resultString": for "DESCRIBE", the SDP description; for "OPTIONS",
+  //     the "Public:" header; otherwise, the response line (if any).  It's
+  //     dynamically allocated (or NULL); the handler must "delete[]" it.
+  // The handler may close the client.  (As with "teardownMediaSession()",
+  // a "TEARDOWN" when streaming over TCP isn't answered; it's completed
+  // once it's been sent.  Don't also use the synchronous
+  // functions on the same client.  The server name is still looked up
+  // synchronously, and RTSP-over-HTTP isn't supported.)
+  typedef void (responseHandler)(RTSPClient* rtspClient, void* clientData,
+				 int resultCode, char* resultString);
+
+  unsigned sendDescribeCommand(char const* url, responseHandler* handler,
+			       void* clientData,
+			       Authenticator* authenticator = NULL);
+  unsigned sendOptionsCommand(char const* url, responseHandler* handler,
+			      void* clientData,
+			      Authenticator* authenticator = NULL);
+  unsigned sendSetupCommand(MediaSubsession& subsession,
+			    responseHandler* handler, void* clientData,
+			    Boolean streamOutgoing = False,
+			    Boolean streamUsingTCP = False,
+			    Boolean forceMulticastOnUnspecified = False);
+      // The "SETUP"s of a session's subsessions may all be sent at once;
+      // all but the first wait for its "Session:" id.
+  unsigned sendPlayCommand(MediaSession& session,
+			   responseHandler* handler, void* clientData,
+			   double start = 0.0f, double end = -1.0f,
+			   float scale = 1.0f);
+  unsigned sendPauseCommand(MediaSession& session,
+			    responseHandler* handler, void* clientData);
+  unsigned sendTeardownCommand(MediaSession& session,
+			       responseHandler* handler, void* clientData);
+
   static Boolean parseRTSPURL(UsageEnvironment& env, char const* url,
 			      NetAddress& address, portNumBits& portNum,
 			      char const** urlSuffix = NULL);
@@ -198,6 +240,38 @@ private:
 			      char const*& separator,
 			      char const*& suffix);
   Boolean setupHTTPTunneling(char const* urlSuffix, Authenticator* authenticator);
+  char* createTransportString(MediaSubsession& subsession,
+			      Boolean streamOutgoing, Boolean streamUsingTCP,
+			      Boolean forceMulticastOnUnspecified);
+  Boolean handleSETUPResponse(MediaSubsession& subsession, char* nextLineStart,
+			      Boolean streamUsingTCP, unsigned& contentLength);
+  void handlePLAYResponse(MediaSession& session, char* nextLineStart);
+
+  // Support for the asynchronous interface:
+  class RequestRecord;
+  unsigned queueRequest(RequestRecord* request, char const* url);
+  Boolean openConnectionAsync(char const* url);
+  void connectionEstablished();
+  static void connectionHandler(void*, int /*mask*/);
+  void connectionHandler1();
+  char* createRequestString(RequestRecord* request);
+  Boolean sendRequestNow(RequestRecord* request);
+  Boolean sendPendingRequests();
+  static void incomingDataHandler(void*, int /*mask*/);
+  void incomingDataHandler1();
+  static void handleAlternativeRequestByte(void*, u_int8_t requestByte);
+  void handleAlternativeRequestByte1(u_int8_t requestByte);
+  void handleResponseBytes(int newBytesRead);
+  int handleOneResponse();
+  void consumeResponseBytes(unsigned numBytes);
+  Boolean handleResponse(RequestRecord* request, unsigned responseCode,
+			 char* firstLine, char* nextLineStart,
+			 char* body, unsigned messageSize);
+  Boolean callResponseHandler(RequestRecord* request,
+			      int resultCode, char* resultString);
+  Boolean closeConnectionAsync(int resultCode);
+  static void completeUnansweredRequests(void* clientData);
+  void completeUnansweredRequests1();
 
   // Support for handling requests sent back by a server:
   static void incomingRequestHandler(void*, int /*mask*/);
@@ -235,6 +309,16 @@ private:
 
   // The following is used to deal with Microsoft servers' non-standard use of RTSP:
   Boolean fServerIsMicrosoft;
+
+  // The following are used to implement the asynchronous interface:
+  Boolean fConnectionIsPending;
+  RequestRecord* fRequestsAwaitingSending; // in order
+  RequestRecord* fRequestsAwaitingResponse;
+  unsigned fNumSetupsAwaitingSessionId;
+  unsigned fResponseBytesAlreadySeen; // in "fResponseBuffer"
+  unsigned fInterleavedBytesToSkip;
+  Boolean* fDeletionFlag; // set by our destructor, if a handler deletes us
+  TaskToken fUnansweredRequestsTask;
 };
 
 #endif
@@ -31,6 +31,8 @@ along with this library; if not, write to the Free Software Foundation, Inc.,
 #include "DigestAuthentication.hh"
 #endif
 
+class MetricsWriter; // forward
+
 // A data structure used for optional user/password authentication:
 // ûȨ
 class UserAuthenticationDatabase {
@@ -91,6 +93,11 @@ public:
       // each session's "rtsp://" URL.
       // This string is dynamically allocated; caller should delete[]
 
+  static void collectMetrics(Medium& server, MetricsWriter& writer);
+      // A "MetricsRegistry::CollectorFunc", for "addCollector()": the number
+      // of client sessions of each stream, and - for each session's tracks -
+      // the packets and bytes sent, and what its receivers' RTCP reports say
+
 protected:
   RTSPServer(UsageEnvironment& env,
 	     int ourSocket, Port ourPort,
@@ -116,6 +123,10 @@ protected:
     RTSPClientSession(RTSPServer& ourServer, unsigned sessionId,
 		      int clientSocket, struct sockaddr_in clientAddr);
     virtual ~RTSPClientSession();
+
+    RTSPClientSession* nextClientSession() const { return fNextClientSession; }
+    ServerMediaSession* serverMediaSession() const { return fOurServerMediaSession; }
+    virtual void writeMetrics(MetricsWriter& writer);
   protected:
     // Make the handler functions for each command virtual, to allow subclasses to redefine them:
     virtual void handleCmd_bad(char const* cseq);
@@ -151,11 +162,16 @@ protected:
     Boolean isMulticast() const { return fIsMulticast; }
     static void incomingRequestHandler(void*, int /*mask*/);
     void incomingRequestHandler1();
+    void handleRequest(); // the one in "fRequestBuffer"
+    static void readyHandler(void* clientData);
+    void readyHandler1();
+    void stopWaiting();
     void noteLiveness();
     static void noteClientLiveness(RTSPClientSession* clientSession);
     static void livenessTimeoutTask(RTSPClientSession* clientSession);
   protected:
     RTSPServer& fOurServer;
+    RTSPClientSession* fNextClientSession; // in our server's list
     unsigned fOurSessionId;
     ServerMediaSession* fOurServerMediaSession;
     int fClientSocket;
@@ -167,11 +183,18 @@ protected:
     unsigned char fResponseBuffer[RTSP_BUFFER_SIZE];
     Boolean fIsMulticast, fSessionIsActive, fStreamAfterSETUP;
     Authenticator fCurrentAuthenticator; // used if access control is needed
+    // A "DESCRIBE" or "SETUP" of a (sub)session that isn't ready is held
+    // back - and no more requests are read - until it is; then it's
+    // handled again (without waiting, this time):
+    ServerMediaSession* fSessionBeingWaitedFor; // referenced while we wait
+    ServerMediaSubsession* fSubsessionBeingWaitedFor;
+    Boolean fIsRetryingRequest;
     unsigned char fTCPStreamIdCount; // used for (optional) RTP/TCP
     unsigned fNumStreamStates;
     struct streamState {
       ServerMediaSubsession* subsession;
       void* streamToken;
+      Boolean isOverTCP;
     } * fStreamStates;
   };
 
@@ -194,6 +217,7 @@ protected:
 private:
   static void incomingConnectionHandler(void*, int /*mask*/);
   void incomingConnectionHandler1();
+  void writeMetrics(MetricsWriter& writer);
 
 private:
   friend class RTSPClientSession;
@@ -204,6 +228,7 @@ private:
   unsigned fReclamationTestSeconds;
   HashTable* fServerMediaSessions;
   unsigned fSessionIdCounter;
+  RTSPClientSession* fClientSessions;
 };
 
 #endif
@@ -0,0 +1,75 @@
+/**********
+This library is free software; you can redistribute it and/or modify it under
+the terms of the GNU Lesser General Public License as published by the
+Free Software Foundation; either version 2.1 of the License, or (at your
+option) any later version. (See <http://www.gnu.org/copyleft/lesser.html>.)
+
+This library is distributed in the hope that it will be useful, but WITHOUT
+ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for
+more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with this library; if not, write to the Free Software Foundation, Inc.,
+51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA
+**********/
+// "liveMedia"
+// Copyright (c) 1996-2009 Live Networks, Inc.  All rights reserved.
+// A RTP sink that relays - to its fan-out sinks - the RTP packets of a
+// stream received from elsewhere, without depacketizing or repacketizing them
+// C++ header
+
+#ifndef _RELAY_RTP_SINK_HH
+#define _RELAY_RTP_SINK_HH
+
+#ifndef _MULTI_FRAMED_RTP_SINK_HH
+#include "MultiFramedRTPSink.hh"
+#endif
+#ifndef _MEDIA_SESSION_HH
+#include "MediaSession.hh"
+#endif
+
+// The sink's source must deliver whole RTP packets, as received from the
+// "upstream" subsession's server: e.g., a "BasicUDPSource" on the
+// subsession's RTP groupsock (in place of its "RTPSource", which is not
+// read).  Each packet of the subsession's payload type is noted in the
+// "RTPSource"'s reception stats (so that its "RTCPInstance" keeps reporting
+// to the server), then handed - as is - to our fan-out sinks, which rewrite
+// only its SSRC, sequence number and timestamp.  Our own groupsock needn't
+// have any destinations.
+
+class RelayRTPSink: public MultiFramedRTPSink {
+public:
+  static RelayRTPSink* createNew(UsageEnvironment& env, Groupsock* RTPgs,
+				 MediaSubsession& upstream);
+      // "upstream" must have been initiated, and must outlive us
+
+  unsigned numDiscardedPackets() const { return fNumDiscardedPackets; }
+      // not RTP, or of another payload type (e.g., "rtx" or FEC)
+
+public: // redefined virtual functions:
+  virtual char const* sdpMediaType() const;
+
+protected:
+  RelayRTPSink(UsageEnvironment& env, Groupsock* RTPgs,
+	       MediaSubsession& upstream);
+      // called only by createNew()
+  virtual ~RelayRTPSink();
+
+protected: // redefined virtual functions:
+  virtual Boolean continuePlaying();
+
+private:
+  static void afterGettingPacket(void* clientData, unsigned packetSize,
+				 unsigned numTruncatedBytes,
+				 struct timeval presentationTime,
+				 unsigned durationInMicroseconds);
+  void afterGettingPacket1(unsigned packetSize, unsigned numTruncatedBytes);
+
+private:
+  MediaSubsession& fUpstream;
+  unsigned char* fPacket; // the packet being received
+  unsigned fNumDiscardedPackets;
+};
+
+#endif
@@ -32,6 +32,8 @@ along with this library; if not, write to the Free Software Foundation, Inc.,
 #endif
 
 class ServerMediaSubsession; // forward
+class RTPSink; // forward
+class RTCPInstance; // forward
 
 class ServerMediaSession: public Medium {
 public:
@@ -66,12 +68,24 @@ public:
   void decrementReferenceCount() { if (fReferenceCount > 0) --fReferenceCount; }
   Boolean& deleteWhenUnreferenced() { return fDeleteWhenUnreferenced; }
 
+  // A session that can't be described yet - e.g. a proxied one whose
+  // upstream server hasn't answered - returns False from "isReady()", and
+  // later calls "handler(clientData)" (once, from the event loop) when it's
+  // worth trying again.  "RTSPServer" holds back its "DESCRIBE" response
+  // until then.  "cancelReadyHandler()" forgets a handler (e.g. of a client
+  // that has gone) before it's called.
+  typedef void (readyHandler)(void* clientData);
+  virtual Boolean isReady(readyHandler* handler, void* clientData);
+  virtual void cancelReadyHandler(void* clientData);
+
 protected:
   ServerMediaSession(UsageEnvironment& env, char const* streamName,
 		     char const* info, char const* description,
 		     Boolean isSSM, char const* miscSDPLines);
   // called only by "createNew()"
 
+  void deleteAllSubsessions();
+
 private: // redefined virtual functions
   virtual Boolean isServerMediaSession() const;
 
@@ -138,12 +152,33 @@ public:
   virtual void seekStream(unsigned clientSessionId, void* streamToken, double seekNPT);
   virtual void setStreamScale(unsigned clientSessionId, void* streamToken, float scale);
   virtual void deleteStream(unsigned clientSessionId, void*& streamToken);
+  virtual void getRTPSinkandRTCP(void* streamToken,
+				 RTPSink*& rtpSink, RTCPInstance*& rtcp);
+      // the objects (if any) that send the stream, and get its receivers'
+      // reports: for metrics only
+
+  // The state of the source (and packetizer) that all of the subsession's
+  // streams share - if they share one (see "OnDemandServerMediaSubsession"):
+  enum PipelineState {
+    PIPELINE_NONE, // they don't
+    PIPELINE_IDLE, // nothing's been created (or it's all been released)
+    PIPELINE_READY, // created, for a SETUP, but not yet started
+    PIPELINE_RUNNING, // started, by a PLAY
+    PIPELINE_DRAINING // no one's left; it's released when it times out
+  };
+  virtual PipelineState pipelineState() const;
+  static char const* pipelineStateName(PipelineState state);
 
   virtual void testScaleFactor(float& scale); // sets "scale" to the actual supported scale
   virtual float duration() const;
     // returns 0 for an unbounded session (the default)
     // returns > 0 for a bounded session
 
+  // As for "ServerMediaSession", but for a "SETUP":
+  typedef ServerMediaSession::readyHandler readyHandler;
+  virtual Boolean isReady(readyHandler* handler, void* clientData);
+  virtual void cancelReadyHandler(void* clientData);
+
   // The following may be called by (e.g.) SIP servers, for which the
   // address and port number fields in SDP descriptions need to be non-zero:
   void setServerAddressAndPortForSDP(netAddressBits addressBits,
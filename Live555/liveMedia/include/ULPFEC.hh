@@ -0,0 +1,102 @@
+/**********
+This library is free software; you can redistribute it and/or modify it under
+the terms of the GNU Lesser General Public License as published by the
+Free Software Foundation; either version 2.1 of the License, or (at your
+option) any later version. (See <http://www.gnu.org/copyleft/lesser.html>.)
+
+This library is distributed in the hope that it will be useful, but WITHOUT
+ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS
+FOR A PARTICULAR PURPOSE.  See the GNU Lesser General Public License for
+more details.
+
+You should have received a copy of the GNU Lesser General Public License
+along with this library; if not, write to the Free Software Foundation, Inc.,
+51 Franklin Street, Fifth Floor, Boston, MA 02110-1301  USA
+**********/
+// "liveMedia"
+// Copyright (c) 1996-2009 Live Networks, Inc.  All rights reserved.
+// RFC 5109 "ULPFEC" parity packets: generation (for "MultiFramedRTPSink")
+// and recovery of lost packets (for "MultiFramedRTPSource")
+// C++ header
+
+#ifndef _ULPFEC_HH
+#define _ULPFEC_HH
+
+#ifndef _NET_COMMON_H
+#include "NetCommon.h"
+#endif
+#ifndef _BOOLEAN_HH
+#include "Boolean.hh"
+#endif
+
+// An FEC packet's mask covers the 48 packets from its "SN base" on, so
+// neither a row, nor the span of a column, may be longer than that.
+#define ULPFEC_MAX_GROUP_SPAN 48
+
+// Protects the packets of a stream in blocks of "numRows" rows by
+// "rowSize" packets (in sending order): one FEC packet per row, and - if
+// "numRows" is at least 2 - one per column, once the block is complete.
+// The overhead is thus 1/"rowSize" + 1/"numRows" of the packets sent.
+
+class ULPFECEncoder {
+public:
+  ULPFECEncoder(unsigned maxPacketSize, unsigned rowSize, unsigned numRows);
+  virtual ~ULPFECEncoder();
+
+  void setGroupSizes(unsigned rowSize, unsigned numRows);
+      // takes effect at the start of the next block
+  unsigned rowSize() const { return fRowSize; }
+  unsigned numRows() const { return fNumRows; }
+
+  unsigned addMediaPacket(unsigned char const* packet, unsigned packetSize);
+      // "packet" is a complete RTP packet, as sent.  Returns the number of
+      // FEC packets that this completed.  They can be got (until the next
+      // call) using:
+  unsigned char* fecPacket(unsigned i, unsigned& packetSize);
+      // The FEC packet begins with 12 bytes for the caller to fill in with
+      // its RTP header; "packetSize" includes them.
+
+private:
+  class ParityGroup* newGroups(unsigned numGroups);
+  void applyGroupSizes();
+
+private:
+  unsigned fMaxPacketSize;
+  unsigned fRowSize, fNumRows; // in use for the current block
+  unsigned fNewRowSize, fNewNumRows;
+  unsigned fPacketNum; // within the current block
+  class ParityGroup* fRow;
+  class ParityGroup* fColumns; // "fRowSize" of them, if "fNumRows" >= 2
+  class ParityGroup* fCompleted[1 + ULPFEC_MAX_GROUP_SPAN];
+  unsigned fNumCompleted;
+};
+
+// Keeps copies of recently received media packets, and of FEC packets that
+// may still be needed, and rebuilds a lost media packet whenever all but one
+// of the packets protected by some FEC packet are in.
+
+class ULPFECDecoder {
+public:
+  ULPFECDecoder();
+  virtual ~ULPFECDecoder();
+
+  void noteMediaPacket(u_int16_t rtpSeqNo,
+		       unsigned char const* packet, unsigned packetSize);
+      // "packet" is a complete RTP packet, as received
+  void noteFECPacket(unsigned char const* fecData, unsigned fecDataSize);
+      // "fecData" is the payload of a FEC packet (after its RTP header)
+
+  unsigned char* recoverPacket(u_int32_t mediaSSRC, unsigned& packetSize);
+      // Returns a rebuilt RTP packet (valid until the next call), or NULL if
+      // no (more) lost packets can be recovered yet.
+
+private:
+  struct ReceivedPacket* fMediaPackets; // indexed by RTP sequence number
+  struct ReceivedPacket* fFECPackets;
+  unsigned fNumFECPackets;
+  Boolean fHaveSeenMediaPacket;
+  u_int16_t fHighestSeqNo;
+  unsigned char* fRecoveredPacket;
+};
+
+#endif
@@ -30,6 +30,7 @@ along with this library; if not, write to the Free Software Foundation, Inc.,
 // #include "MPEG4ESVideoRTPSink.hh"
 // #include "AMRAudioFileSink.hh"
 #include "H264VideoFileSink.hh"
+#include "H264VideoFileIndex.hh"
 #include "BasicUDPSink.hh"
 // #include "MPEG1or2VideoHTTPSink.hh"
 // #include "GSMAudioRTPSink.hh"
@@ -76,17 +77,30 @@ along with this library; if not, write to the Free Software Foundation, Inc.,
 // #include "MPEG1or2VideoStreamDiscreteFramer.hh"
 // #include "MPEG4VideoStreamDiscreteFramer.hh"
 #include "H264VideoStreamFramer.hh"
+#include "H264VideoMappedFileSource.hh"
+#include "H264VideoFileServerMediaSubsession.hh"
+#include "H264VideoFrameBus.hh"
+#include "H264VideoFrameBusServerMediaSubsession.hh"
+#include "H264SimulcastEncoder.hh"
+#include "H264SimulcastServerMediaSubsession.hh"
 #include "DeviceSource.hh"
 #include "AudioInputDevice.hh"
 // #include "WAVAudioFileSource.hh"
 #include "RTSPServer.hh"
 #include "RTSPOverHTTPServer.hh"
+#include "HLSSegmenter.hh"
+#include "HLSServer.hh"
 #include "RTSPClient.hh"
 #include "SIPClient.hh"
 // #include "QuickTimeFileSink.hh"
 // #include "QuickTimeGenericRTPSource.hh"
 #include "AVIFileSink.hh"
 #include "PassiveServerMediaSubsession.hh"
+#include "ProxyServerMediaSubsession.hh"
+#include "RTCPRateController.hh"
+#include "FrameTrace.hh"
+#include "MetricsRegistry.hh"
+#include "MetricsServer.hh"
 // #include "MPEG4VideoFileServerMediaSubsession.hh"
 // #include "WAVAudioFileServerMediaSubsession.hh"
 // #include "AMRAudioFileServerMediaSubsession.hh"
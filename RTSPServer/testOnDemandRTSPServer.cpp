@@ -22,6 +22,7 @@ along with this library; if not, write to the Free Software Foundation, Inc.,
 #include "liveMedia.hh"
 #include "BasicUsageEnvironment.hh"
 #include "LogMacros.hh"
+#include "GroupsockHelper.hh"
 
 #ifdef _DEBUG
     #pragma comment(lib,"cv200d.lib")
@@ -52,8 +53,85 @@ Boolean reuseFirstSource = False;
 // change the following "False" to "True":
 Boolean iFramesOnly = False;
 
+// To send the live "h264" stream to a multicast group instead - one copy of
+// each packet, however many viewers there are on the LAN - change the
+// following "False" to "True".  RTSP clients are given the group's address.
+Boolean liveMulticast = False;
+// ... and, for source-specific multicast (to a random 232.x.x.x group) rather
+// than to "liveMulticastAddress", change this one too:
+Boolean liveMulticastIsSSM = False;
+char const* liveMulticastAddress = "239.255.42.42";
+portNumBits const liveMulticastRTPPortNum = 18888; // RTCP uses the next port
+u_int8_t const liveMulticastTTL = 7; // within the site
+
+// To serve the live stream as a (Low-Latency) HTTP Live Stream instead - to
+// any number of HLS players, from in-memory segments - change the following
+// "False" to "True".  (The camera can feed only one encoder, so the "h264"
+// RTSP stream isn't offered then.)
+Boolean liveHLS = False;
+portNumBits const liveHLSPortNum = 8080;
+double const liveHLSSegmentDuration = 4.0; // seconds
+double const liveHLSPartDuration = 0.5; // seconds
+
+// To also re-serve (as "proxy") a stream from another RTSP server - pulled
+// from it once, and only while someone here is watching - set this to the
+// stream's "rtsp://" URL:
+char const* proxiedStreamURL = NULL;
+
+// A H.264 Elementary Stream file, to be served - seekable, and with fast
+// forward and rewind - as "h264File" (if it's there).  Its index is kept in
+// the same directory, as "<file>.idx":
+char const* h264FileName = "test.264";
+double const h264FileFrameRate = 25.0;
+
+// To trace each live frame's way from the camera to the network - when it
+// was captured, converted to YUV, encoded and sent - set this to a file name
+// prefix.  Every "liveTraceInterval" seconds, the last frames' timestamps are
+// written as "<prefix>.json" (open it in chrome://tracing) and as
+// "<prefix>-<span>.hgrm" (percentile distributions, as HdrHistogram's):
+char const* liveTraceFileName = NULL;
+unsigned const liveTraceInterval = 10; // seconds
+
+// The server's counters and gauges - per stream, per client session, and of
+// the live encoder - are served (for Prometheus to scrape) at
+// "http://<host>:<metricsPortNum>/metrics".  Set this to 0 not to:
+portNumBits const metricsPortNum = 9100;
+
+// To serve the one encoder from several server processes (using more of the
+// machine's cores), set this to a name for the shared-memory "frame bus"
+// between them.  Run one process with "encoder" as an argument: it writes
+// the live stream into the bus, and serves nothing itself.  Run any number
+// of others: they share the RTSP port, and each serves "h264" from the bus.
+char const* liveBusName = NULL;
+unsigned const liveBusNumSlots = 64; // access units; about 2.5s at 25 fps
+unsigned const liveBusSlotSize = 256*1024; // the largest access unit
+unsigned const liveBusGOPCacheSize = 1024*1024;
+unsigned const liveBusGOPBurstRate = 2048; // kbps
+
+// To offer the live stream at several sizes and bitrates at once - each
+// viewer choosing the one that its screen and link suit - change the
+// following "False" to "True".  The camera is read once per frame, and each
+// rung that someone is watching is scaled from it and encoded in parallel.
+// Each rung is a stream of its own, "h264-<height>p" (e.g. "h264-720p"),
+// instead of "h264":
+Boolean liveSimulcast = False;
+H264SimulcastRung const liveSimulcastRungs[] = {
+  { 1920, 1080, 4000 }, // width, height, kbps
+  { 1280, 720, 2000 },
+  { 640, 360, 600 },
+};
+unsigned const liveSimulcastFrameRate = 25;
+unsigned const liveSimulcastGOPCacheSize = 2*1024*1024;
+
+// The live "h264" stream's camera and encoder start with its first PLAY.
+// After its last viewer leaves, they keep running for this long - so that
+// anyone who comes back starts at once, from the last key frame - and are
+// then released, until the next PLAY:
+unsigned const liveIdleGracePeriod = 30; // seconds
+
 static void announceStream(RTSPServer* rtspServer, ServerMediaSession* sms,
 			   char const* streamName, char const* inputFileName = "Live"); // fwd
+static void writeLiveTrace(void* clientData); // fwd
 
 int main(int argc, char** argv) {
 
@@ -61,6 +139,10 @@ int main(int argc, char** argv) {
   {
       initDebugLog("RTSPServer.log");
   }
+  Boolean isBusEncoder = False;
+  for (int i = 1; i < argc; ++i) {
+    if (strcmp(argv[i], "encoder") == 0) isBusEncoder = True;
+  }
   DEBUG_LOG(INF, "*** Begin testOnDemandRTSPServer ***");
   
   // ʹûBegin by setting up our usage environment:
@@ -78,9 +160,31 @@ int main(int argc, char** argv) {
   // access to the server.
 #endif
 
+  if (liveBusName != NULL && isBusEncoder) {
+    DEBUG_LOG(INF, "*** Encode into frame bus \"%s\" ***", liveBusName);
+    FramedSource* source = MyH264VideoStreamFramer::createNew(*env, NULL);
+    H264VideoFrameBusSink* busSink
+      = H264VideoFrameBusSink::createNew(*env, liveBusName,
+					 liveBusNumSlots, liveBusSlotSize);
+    if (source == NULL || busSink == NULL) {
+      *env << "Failed to create frame bus: " << env->getResultMsg() << "\n";
+      exit(1);
+    }
+    busSink->startPlaying(*source, NULL, NULL);
+    *env << "Encoding the live stream into frame bus \"" << liveBusName << "\"\n";
+
+    env->taskScheduler().doEventLoop(); // does not return
+  }
+
   // RTSPʼղݡCreate the RTSP server:
   DEBUG_LOG(INF, "*** Create RTSPServer, port = %d ***", 8554);
-  RTSPServer* rtspServer = RTSPServer::createNew(*env, 8554, authDB);
+  RTSPServer* rtspServer;
+  if (liveBusName != NULL) {
+    ReusePort dummy; // the other servers reading the bus listen here too
+    rtspServer = RTSPServer::createNew(*env, 8554, authDB);
+  } else {
+    rtspServer = RTSPServer::createNew(*env, 8554, authDB);
+  }
   if (rtspServer == NULL) {
     *env << "Failed to create RTSP server: " << env->getResultMsg() << "\n";
     exit(1);
@@ -109,19 +213,152 @@ int main(int argc, char** argv) {
 //   }
 
   //jiangqi
-  {
-    Boolean reuseSource = True;//jiangqi
+  if (liveHLS) {
+    DEBUG_LOG(INF, "*** Create HLSServer, port = %d ***", liveHLSPortNum);
+    MyH264VideoStreamFramer* source = MyH264VideoStreamFramer::createNew(*env, NULL);
+    // Segments start at IDRs, so the encoder has one at least every half
+    // target duration, and the segmenter - whose target duration is fixed
+    // from the start - cuts at the first after that, making segments of
+    // between half and all of it:
+    double const maxKeyFrameInterval = liveHLSSegmentDuration/2;
+    HLSSegmenter* segmenter = HLSSegmenter::createNew(*env, liveHLSSegmentDuration,
+                                                      liveHLSPartDuration, 6,
+                                                      maxKeyFrameInterval);
+    HLSServer* hlsServer = HLSServer::createNew(*env, *segmenter, "h264",
+                                                liveHLSPortNum);
+    if (source == NULL || hlsServer == NULL) {
+      *env << "Failed to create HLS server: " << env->getResultMsg() << "\n";
+      exit(1);
+    }
+    source->setMaxKeyFrameInterval(maxKeyFrameInterval);
+    segmenter->startPlaying(*source, NULL, NULL);
+
+    char* url = hlsServer->playlistURL();
+    *env << "\n\"h264\" live stream\n";
+    *env << "Play this stream using the URL \"" << url << "\"\n";
+    delete[] url;
+  } else if (liveSimulcast) {
+    DEBUG_LOG(INF, "*** Create simulcast ladder ***");
+    unsigned const numRungs = sizeof liveSimulcastRungs/sizeof liveSimulcastRungs[0];
+    H264SimulcastEncoder* encoder
+      = H264SimulcastEncoder::createNew(*env, liveSimulcastRungs, numRungs,
+                                        liveSimulcastFrameRate);
+    if (encoder == NULL) {
+      *env << "Failed to create the simulcast ladder: " << env->getResultMsg() << "\n";
+      exit(1);
+    }
+    for (unsigned i = 0; i < numRungs; ++i) {
+      // As for "h264": one packetizer per rung, fanned out to its viewers,
+      // who start from its GOP cache (sent at twice the rung's bitrate)
+      char streamName[30];
+      sprintf(streamName, "h264-%up", liveSimulcastRungs[i].height);
+      ServerMediaSession* sms
+        = ServerMediaSession::createNew(*env, streamName, streamName,
+                                        descriptionString);
+      H264SimulcastServerMediaSubsession* subsession
+        = H264SimulcastServerMediaSubsession::createNew(*env, *encoder, i, True,
+            liveSimulcastGOPCacheSize, 2*liveSimulcastRungs[i].bitrate);
+      subsession->setIdleGracePeriod(liveIdleGracePeriod);
+      sms->addSubsession(subsession);
+      rtspServer->addServerMediaSession(sms);
+
+      announceStream(rtspServer, sms, streamName);
+    }
+  } else {
+    // One encoder and one packetizer for everyone; each client gets its
+    // own RTP stream (SSRC, sequence numbers, pause) of the same packets:
+    Boolean reuseSource = False;//jiangqi
+    Boolean fanOutSource = True;
     char const* streamName = "h264";
-    ServerMediaSession* sms
-      = ServerMediaSession::createNew(*env, streamName, streamName,
-				      descriptionString);
-    sms->addSubsession(H264LiveVideoServerMediaSubsession::createNew(*env, reuseSource));
+    ServerMediaSession* sms;
+    if (liveMulticast) {
+      struct in_addr groupAddress;
+      groupAddress.s_addr = liveMulticastIsSSM ? chooseRandomIPv4SSMAddress(*env)
+        : our_inet_addr(liveMulticastAddress);
+      sms = ServerMediaSession::createNew(*env, streamName, streamName,
+                                          descriptionString, liveMulticastIsSSM);
+      sms->addSubsession(H264LiveVideoMulticastSubsession::createNew(*env, groupAddress,
+        liveMulticastRTPPortNum, liveMulticastTTL, liveMulticastIsSSM));
+    } else if (liveBusName != NULL) {
+      // The encoder is in another process:
+      sms = ServerMediaSession::createNew(*env, streamName, streamName,
+                                          descriptionString);
+      H264VideoFrameBusServerMediaSubsession* subsession
+        = H264VideoFrameBusServerMediaSubsession::createNew(*env, liveBusName,
+            fanOutSource, liveBusGOPCacheSize, liveBusGOPBurstRate);
+      subsession->setIdleGracePeriod(liveIdleGracePeriod);
+      sms->addSubsession(subsession);
+    } else {
+      sms = ServerMediaSession::createNew(*env, streamName, streamName,
+                                          descriptionString);
+      H264LiveVideoServerMediaSubsession* subsession
+        = H264LiveVideoServerMediaSubsession::createNew(*env, reuseSource,
+                                                        fanOutSource);
+      subsession->setIdleGracePeriod(liveIdleGracePeriod);
+      sms->addSubsession(subsession);
+    }
     rtspServer->addServerMediaSession(sms);
 
     announceStream(rtspServer, sms, streamName);
   }
   //jiangqi
 
+  if (proxiedStreamURL != NULL) {
+    DEBUG_LOG(INF, "*** Proxy %s ***", proxiedStreamURL);
+    char const* streamName = "proxy";
+    // (Its subsessions are added once the upstream server has described
+    // it; until then, our "DESCRIBE"s of it wait:)
+    ProxyServerMediaSession* sms
+      = ProxyServerMediaSession::createNew(*env, streamName, proxiedStreamURL,
+					   NULL, NULL, 0, descriptionString);
+    if (sms == NULL) {
+      *env << "Failed to proxy \"" << proxiedStreamURL << "\": "
+	   << env->getResultMsg() << "\n";
+    } else {
+      rtspServer->addServerMediaSession(sms);
+      announceStream(rtspServer, sms, streamName, proxiedStreamURL);
+    }
+  }
+
+  if (h264FileName != NULL) {
+    char const* streamName = "h264File";
+    H264VideoFileServerMediaSubsession* subsession
+      = H264VideoFileServerMediaSubsession::createNew(*env, h264FileName,
+						      reuseFirstSource,
+						      h264FileFrameRate);
+    if (subsession == NULL) {
+      *env << "Not serving \"" << h264FileName << "\": "
+	   << env->getResultMsg() << "\n";
+    } else {
+      ServerMediaSession* sms
+	= ServerMediaSession::createNew(*env, streamName, streamName,
+					descriptionString);
+      sms->addSubsession(subsession);
+      rtspServer->addServerMediaSession(sms);
+      announceStream(rtspServer, sms, streamName, h264FileName);
+    }
+  }
+
+  if (liveTraceFileName != NULL) {
+    FrameTrace::enable();
+    env->taskScheduler().scheduleDelayedTask(liveTraceInterval*1000000,
+					     writeLiveTrace, NULL);
+  }
+
+  if (metricsPortNum != 0) {
+    MetricsRegistry* metrics = MetricsRegistry::createNew(*env);
+    metrics->addCollector(*rtspServer, RTSPServer::collectMetrics);
+    MetricsServer* metricsServer
+      = MetricsServer::createNew(*env, *metrics, metricsPortNum);
+    if (metricsServer == NULL) {
+      *env << "Failed to create metrics server: " << env->getResultMsg() << "\n";
+    } else {
+      char* url = metricsServer->metricsURL();
+      *env << "\nMetrics are at \"" << url << "\"\n";
+      delete[] url;
+    }
+  }
+
   DEBUG_LOG(INF, "*** Begin doEventLoop ***");
   env->taskScheduler().doEventLoop(); // does not return
 
@@ -138,3 +375,16 @@ static void announceStream(RTSPServer* rtspServer, ServerMediaSession* sms,
   env << "Play this stream using the URL \"" << url << "\"\n";
   delete[] url;
 }
+
+static void writeLiveTrace(void* /*clientData*/) {
+  char* jsonFileName = new char[strlen(liveTraceFileName) + 6];
+  sprintf(jsonFileName, "%s.json", liveTraceFileName);
+  if (!FrameTrace::writeChromeTrace(jsonFileName)
+      || !FrameTrace::writeHistograms(liveTraceFileName)) {
+    *env << "Failed to write the frame trace \"" << liveTraceFileName << "\"\n";
+  }
+  delete[] jsonFileName;
+
+  env->taskScheduler().scheduleDelayedTask(liveTraceInterval*1000000,
+					   writeLiveTrace, NULL);
+}
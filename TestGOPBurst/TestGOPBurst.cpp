@@ -0,0 +1,384 @@
+// TestGOPBurst: how far behind the live stream a late joiner plays
+//
+// Serves numbered H.264 frames - one every FRAME_DURATION, a key frame every
+// GOP_LENGTH of them - from a fan-out "OnDemandServerMediaSubsession" with a
+// GOP cache, through our RTSPServer, to two viewers (asynchronous
+// "RTSPClient"s, in this process).  The first starts the stream; the second
+// joins JOIN_TIME later, most of a GOP after the last key frame, so it's sent
+// the GOP cache first.  Each frame carries the time that it was captured.
+//
+// A viewer plays each frame at the time that its RTP timestamp says, counted
+// from when the first frame arrived.  Its lag, for a frame, is how long
+// after the frame's capture that is.  Checks, for each viewer:
+//   - that its first frame is a key frame, and that its timestamps increase;
+//   - that, once the GOP cache has been sent, its lag is under MAX_LAG -
+//     rather than the age of the cached key frame, which the joiner would
+//     otherwise stay behind by.
+//
+// usage: TestGOPBurst
+//
+// Prints what it checks, then PASS or FAIL; the program exits with 1 if any
+// check failed.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "liveMedia.hh"
+#include "BasicUsageEnvironment.hh"
+#include "GroupsockHelper.hh"
+#include "LogMacros.hh"
+
+static const unsigned FRAME_DURATION = 40000; // us (25 fps)
+static const unsigned GOP_LENGTH = 50; // frames: a key frame every 2 s
+static const unsigned FRAME_SIZE = 3000; // bytes: a few RTP packets each
+static const unsigned GOP_CACHE_SIZE = 1024*1024; // bytes
+static const unsigned GOP_BURST_RATE = 20000; // kbps
+static const portNumBits RTSP_PORT = 18554;
+static const unsigned JOIN_TIME = 1600000; // us, after the first viewer
+static const unsigned SETTLE_TIME = 1000000; // us, after joining: the lag
+    // is measured from then on, once the GOP cache has long been sent
+static const unsigned RUN_TIME = JOIN_TIME + 3000000; // us
+static const int MAX_LAG = 200000; // us
+
+static const unsigned char KEY_FRAME_HEADER = 0x65; // an IDR slice
+static const unsigned char FRAME_HEADER = 0x41; // a non-IDR slice
+
+static UsageEnvironment* env;
+static char runDone;
+static Boolean allPassed = True;
+
+static void check(Boolean ok, char const* what)
+{
+    printf("  %s: %s\n", ok ? "ok" : "FAILED", what);
+    if (!ok) allPassed = False;
+}
+
+static int microsecondsBetween(struct timeval const& from, struct timeval const& to)
+{
+    return (to.tv_sec - from.tv_sec)*1000000 + (to.tv_usec - from.tv_usec);
+}
+
+// Delivers frames 0, 1, 2, ... - each of them one NAL unit, and an access
+// unit - in real time, each holding its number and the time it was captured
+class NumberedFrameSource: public H264VideoStreamFramer
+{
+public:
+    NumberedFrameSource(UsageEnvironment& env)
+        : H264VideoStreamFramer(env, NULL), fNextFrameNum(0)
+    {
+        gettimeofday(&fNextFrameTime, NULL);
+    }
+
+    virtual Boolean currentNALUnitEndsAccessUnit()
+    {
+        return True;
+    }
+
+private:
+    virtual void doGetNextFrame()
+    {
+        struct timeval timeNow;
+        gettimeofday(&timeNow, NULL);
+        int uSecondsToGo = microsecondsBetween(timeNow, fNextFrameTime);
+        nextTask() = envir().taskScheduler().scheduleDelayedTask(
+            uSecondsToGo < 0 ? 0 : uSecondsToGo, (TaskFunc*)deliverFrame, this);
+    }
+
+    static void deliverFrame(NumberedFrameSource* source)
+    {
+        source->deliverFrame1();
+    }
+
+    void deliverFrame1()
+    {
+        if (fMaxSize < FRAME_SIZE)
+        {
+            handleClosure(this);
+            return;
+        }
+        unsigned frameNum = fNextFrameNum++;
+        gettimeofday(&fPresentationTime, NULL);
+        memset(fTo, frameNum & 0xFF, FRAME_SIZE);
+        fTo[0] = frameNum % GOP_LENGTH == 0 ? KEY_FRAME_HEADER : FRAME_HEADER;
+        memcpy(&fTo[1], &frameNum, sizeof frameNum);
+        memcpy(&fTo[1 + sizeof frameNum], &fPresentationTime, sizeof fPresentationTime);
+        fFrameSize = FRAME_SIZE;
+        fDurationInMicroseconds = FRAME_DURATION;
+
+        fNextFrameTime.tv_usec += FRAME_DURATION;
+        fNextFrameTime.tv_sec += fNextFrameTime.tv_usec/1000000;
+        fNextFrameTime.tv_usec %= 1000000;
+        FramedSource::afterGetting(this);
+    }
+
+    unsigned fNextFrameNum;
+    struct timeval fNextFrameTime;
+};
+
+// One source, packetized once, fanned out to every viewer
+class NumberedFrameSubsession: public OnDemandServerMediaSubsession
+{
+public:
+    NumberedFrameSubsession(UsageEnvironment& env)
+        : OnDemandServerMediaSubsession(env, False, 6970, True /*fanOutFirstSource*/)
+    {
+    }
+
+private:
+    virtual FramedSource* createNewStreamSource(unsigned /*clientSessionId*/,
+                                                unsigned& estBitrate)
+    {
+        estBitrate = FRAME_SIZE*8/1000 * 1000000/FRAME_DURATION; // kbps
+        return new NumberedFrameSource(envir());
+    }
+
+    virtual RTPSink* createNewRTPSink(Groupsock* rtpGroupsock,
+                                      unsigned char rtpPayloadTypeIfDynamic,
+                                      FramedSource* /*inputSource*/)
+    {
+        H264VideoRTPSink* sink = H264VideoRTPSink::createNew(envir(), rtpGroupsock,
+            rtpPayloadTypeIfDynamic, 0, "");
+        if (sink != NULL && fansOutFirstSource())
+        {
+            sink->enableGOPCache(GOP_CACHE_SIZE, GOP_BURST_RATE);
+        }
+        return sink;
+    }
+};
+
+// Measures how far behind each frame's capture a player would play it
+class LagMeasuringSink: public MediaSink
+{
+public:
+    LagMeasuringSink(UsageEnvironment& env, RTPSource& rtpSource)
+        : MediaSink(env), fRTPSource(rtpSource), fNumFrames(0),
+          fFirstFrameIsKeyFrame(False), fTimestampsIncrease(True),
+          fNumMeasured(0), fTotalLag(0), fMaxLag(0)
+    {
+    }
+
+    struct timeval fMeasureFrom; // (set by our owner)
+    unsigned fNumFrames;
+    Boolean fFirstFrameIsKeyFrame, fTimestampsIncrease;
+    unsigned fNumMeasured;
+    double fTotalLag; // us
+    int fMaxLag; // us
+
+private:
+    virtual Boolean continuePlaying()
+    {
+        if (fSource == NULL) return False;
+        fSource->getNextFrame(fBuffer, sizeof fBuffer, afterGettingFrame, this,
+                              onSourceClosure, this);
+        return True;
+    }
+
+    static void afterGettingFrame(void* clientData, unsigned frameSize,
+                                  unsigned /*numTruncatedBytes*/,
+                                  struct timeval /*presentationTime*/,
+                                  unsigned /*durationInMicroseconds*/)
+    {
+        ((LagMeasuringSink*)clientData)->afterGettingFrame1(frameSize);
+    }
+
+    void afterGettingFrame1(unsigned frameSize)
+    {
+        struct timeval timeNow;
+        gettimeofday(&timeNow, NULL);
+        u_int32_t timestamp = fRTPSource.curPacketRTPTimestamp();
+
+        if (frameSize == FRAME_SIZE)
+        {
+            struct timeval captureTime;
+            memcpy(&captureTime, &fBuffer[1 + sizeof (unsigned)], sizeof captureTime);
+            if (fNumFrames++ == 0)
+            {
+                fFirstFrameIsKeyFrame = fBuffer[0] == KEY_FRAME_HEADER;
+                fFirstArrival = timeNow;
+                fFirstTimestamp = timestamp;
+            }
+            else if ((int32_t)(timestamp - fLastTimestamp) <= 0)
+            {
+                fTimestampsIncrease = False;
+            }
+            fLastTimestamp = timestamp;
+
+            // When it's played, counting from the first frame:
+            int playOffset = (int)((int32_t)(timestamp - fFirstTimestamp)
+                                   / 90.0 * 1000); // us, at 90 kHz
+            struct timeval playTime = fFirstArrival;
+            playTime.tv_sec += playOffset/1000000;
+            playTime.tv_usec += playOffset%1000000;
+            int lag = microsecondsBetween(captureTime, playTime);
+            if (microsecondsBetween(fMeasureFrom, timeNow) >= 0)
+            {
+                ++fNumMeasured;
+                fTotalLag += lag;
+                if (lag > fMaxLag) fMaxLag = lag;
+            }
+        }
+        continuePlaying();
+    }
+
+    RTPSource& fRTPSource;
+    struct timeval fFirstArrival;
+    u_int32_t fFirstTimestamp, fLastTimestamp;
+    unsigned char fBuffer[2*FRAME_SIZE];
+};
+
+// A viewer: DESCRIBE, SETUP and PLAY, each once the last is answered
+struct Viewer
+{
+    Viewer()
+        : client(NULL), session(NULL), subsession(NULL), sink(NULL), failed(False)
+    {
+    }
+
+    void start()
+    {
+        client = RTSPClient::createNew(*env, 0, "TestGOPBurst");
+        char url[100];
+        sprintf(url, "rtsp://127.0.0.1:%u/live", RTSP_PORT);
+        if (client == NULL
+            || client->sendDescribeCommand(url, afterDESCRIBE, this) == 0)
+        {
+            failed = True;
+        }
+    }
+
+    static void afterDESCRIBE(RTSPClient* /*client*/, void* clientData,
+                              int resultCode, char* resultString)
+    {
+        Viewer* viewer = (Viewer*)clientData;
+        if (resultCode == 0)
+        {
+            viewer->session = MediaSession::createNew(*env, resultString);
+        }
+        delete[] resultString;
+        if (viewer->session == NULL)
+        {
+            viewer->failed = True;
+            return;
+        }
+
+        MediaSubsessionIterator iter(*viewer->session);
+        viewer->subsession = iter.next();
+        if (viewer->subsession == NULL || !viewer->subsession->initiate()
+            || viewer->client->sendSetupCommand(*viewer->subsession,
+                                                afterSETUP, viewer) == 0)
+        {
+            viewer->failed = True;
+        }
+    }
+
+    static void afterSETUP(RTSPClient* /*client*/, void* clientData,
+                           int resultCode, char* resultString)
+    {
+        Viewer* viewer = (Viewer*)clientData;
+        delete[] resultString;
+        if (resultCode != 0)
+        {
+            viewer->failed = True;
+            return;
+        }
+
+        viewer->sink = new LagMeasuringSink(*env, *viewer->subsession->rtpSource());
+        gettimeofday(&viewer->sink->fMeasureFrom, NULL);
+        viewer->sink->fMeasureFrom.tv_sec += SETTLE_TIME/1000000;
+        viewer->sink->fMeasureFrom.tv_usec += SETTLE_TIME%1000000;
+        viewer->sink->startPlaying(*viewer->subsession->readSource(), NULL, NULL);
+        if (viewer->client->sendPlayCommand(*viewer->session, afterPLAY, viewer) == 0)
+        {
+            viewer->failed = True;
+        }
+    }
+
+    static void afterPLAY(RTSPClient* /*client*/, void* clientData,
+                          int resultCode, char* resultString)
+    {
+        Viewer* viewer = (Viewer*)clientData;
+        delete[] resultString;
+        if (resultCode != 0) viewer->failed = True;
+    }
+
+    void report(char const* name)
+    {
+        printf("%s:\n", name);
+        check(!failed && sink != NULL && sink->fNumFrames > 0, "set up, and played");
+        if (sink == NULL || sink->fNumFrames == 0) return;
+
+        printf("  %u frames; lag, once settled: %.0f ms on average, %.0f ms at most\n",
+               sink->fNumFrames,
+               sink->fNumMeasured == 0 ? 0.0 : sink->fTotalLag/sink->fNumMeasured/1000,
+               sink->fMaxLag/1000.0);
+        check(sink->fFirstFrameIsKeyFrame, "the first frame is a key frame");
+        check(sink->fTimestampsIncrease, "the timestamps increase");
+        check(sink->fNumMeasured > 0 && sink->fMaxLag < MAX_LAG,
+              "plays at the live edge (lag under 200 ms)");
+    }
+
+    void stop()
+    {
+        Medium::close(sink);
+        if (session != NULL && client != NULL)
+        {
+            client->sendTeardownCommand(*session, NULL, NULL);
+        }
+        Medium::close(client);
+        if (subsession != NULL) subsession->deInitiate();
+        Medium::close(session);
+    }
+
+    RTSPClient* client;
+    MediaSession* session;
+    MediaSubsession* subsession;
+    LagMeasuringSink* sink;
+    Boolean failed;
+};
+
+static Viewer firstViewer, lateJoiner;
+
+static void startLateJoiner(void* /*clientData*/)
+{
+    lateJoiner.start();
+}
+
+static void endRun(void* /*clientData*/)
+{
+    runDone = ~0;
+}
+
+int main()
+{
+    initDebugLog("TestGOPBurst.log");
+    TaskScheduler* scheduler = BasicTaskScheduler::createNew();
+    env = BasicUsageEnvironment::createNew(*scheduler);
+
+    RTSPServer* rtspServer = RTSPServer::createNew(*env, RTSP_PORT);
+    if (rtspServer == NULL)
+    {
+        printf("Failed to create the RTSP server: %s\nFAIL\n", env->getResultMsg());
+        return 1;
+    }
+    ServerMediaSession* sms = ServerMediaSession::createNew(*env, "live", "live",
+        "TestGOPBurst");
+    sms->addSubsession(new NumberedFrameSubsession(*env));
+    rtspServer->addServerMediaSession(sms);
+
+    firstViewer.start();
+    env->taskScheduler().scheduleDelayedTask(JOIN_TIME, startLateJoiner, NULL);
+    env->taskScheduler().scheduleDelayedTask(RUN_TIME, endRun, NULL);
+    env->taskScheduler().doEventLoop(&runDone);
+
+    firstViewer.report("first viewer");
+    lateJoiner.report("late joiner (sent the GOP cache first)");
+    printf("%s\n", allPassed ? "PASS" : "FAIL");
+
+    firstViewer.stop();
+    lateJoiner.stop();
+    Medium::close(rtspServer);
+    env->reclaim();
+    delete scheduler;
+    return allPassed ? 0 : 1;
+}
@@ -0,0 +1,272 @@
+// TestMulticast: live multicast loopback test
+//
+// Publishes numbered H.264 NAL units through "H264LiveVideoMulticastSubsession"
+// (in place of the camera's), to a group on this host, and receives them -
+// as RTSP clients would - with two "MediaSession"s made from the SDP
+// description that DESCRIBE would return.  Once for an any-source group, and
+// once for a source-specific one.  Checks:
+//   - the SDP: the group's address and port, FEC but no NACK or "rtx"
+//     (multicast has no per-viewer feedback), and for SSM the source filter
+//     and "a=rtcp-unicast:reflection";
+//   - that each receiver gets every NAL unit, once and intact;
+//   - that each receiver hears of the other one through RTCP.  For SSM,
+//     receivers send their RTCP to the source, by unicast, and it's only
+//     through the source's reflecting it to the group that they hear of each
+//     other.
+//
+// usage: TestMulticast
+//
+// The host must route multicast (to itself: the groups' TTL is 0).  Prints
+// what it checks, then PASS or FAIL; the program exits with 1 if any check
+// failed.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "liveMedia.hh"
+#include "BasicUsageEnvironment.hh"
+#include "GroupsockHelper.hh"
+#include "H264VideoStreamFramer.hh"
+
+static const unsigned NUM_NAL_UNITS = 4000;
+static const unsigned NAL_UNIT_SIZE = 1000; // one RTP packet each
+static const unsigned NAL_UNIT_DURATION = 2000; // us
+static const unsigned DRAIN_TIME = 2000000; // us, after the last NAL unit,
+    // so that everyone has sent a RTCP report (about every 5 s) by then
+static const unsigned char NAL_UNIT_HEADER = 0x41; // a non-IDR slice
+static const unsigned NUM_RECEIVERS = 2;
+
+static char const* const ASM_GROUP_ADDRESS = "239.255.42.43";
+static const portNumBits ASM_RTP_PORT = 18890;
+static const portNumBits SSM_RTP_PORT = 18892; // (with a random 232.x.x.x group)
+static const u_int8_t TTL = 0; // this host only
+
+static UsageEnvironment* env;
+static char phaseDone;
+static Boolean allPassed = True;
+
+static void check(Boolean ok, char const* what)
+{
+    printf("  %s: %s\n", ok ? "ok" : "FAILED", what);
+    if (!ok) allPassed = False;
+}
+
+// Delivers the NAL units 0 .. NUM_NAL_UNITS-1, one every NAL_UNIT_DURATION,
+// each of them an access unit
+class NumberedNALUnitSource: public H264VideoStreamFramer
+{
+public:
+    NumberedNALUnitSource(UsageEnvironment& env)
+        : H264VideoStreamFramer(env, NULL), fNextNALUnitNum(0)
+    {
+    }
+
+    virtual Boolean currentNALUnitEndsAccessUnit()
+    {
+        return True;
+    }
+
+private:
+    virtual void doGetNextFrame()
+    {
+        if (fNextNALUnitNum >= NUM_NAL_UNITS || fMaxSize < NAL_UNIT_SIZE)
+        {
+            handleClosure(this);
+            return;
+        }
+        unsigned nalUnitNum = fNextNALUnitNum++;
+        memset(fTo, nalUnitNum & 0xFF, NAL_UNIT_SIZE);
+        fTo[0] = NAL_UNIT_HEADER;
+        memcpy(&fTo[1], &nalUnitNum, sizeof nalUnitNum);
+        fFrameSize = NAL_UNIT_SIZE;
+        gettimeofday(&fPresentationTime, NULL);
+        fDurationInMicroseconds = NAL_UNIT_DURATION;
+        nextTask() = envir().taskScheduler().scheduleDelayedTask(0,
+            (TaskFunc*)FramedSource::afterGetting, this);
+    }
+
+    unsigned fNextNALUnitNum;
+};
+
+// Counts the distinct intact NAL units that it receives
+class NALUnitCountingSink: public MediaSink
+{
+public:
+    NALUnitCountingSink(UsageEnvironment& env)
+        : MediaSink(env), fNumGood(0), fNumDuplicate(0), fNumBad(0)
+    {
+        memset(fSeen, 0, sizeof fSeen);
+    }
+
+    unsigned fNumGood, fNumDuplicate, fNumBad;
+
+private:
+    virtual Boolean continuePlaying()
+    {
+        if (fSource == NULL) return False;
+        fSource->getNextFrame(fBuffer, sizeof fBuffer, afterGettingFrame, this,
+                              onSourceClosure, this);
+        return True;
+    }
+
+    static void afterGettingFrame(void* clientData, unsigned frameSize,
+                                  unsigned /*numTruncatedBytes*/,
+                                  struct timeval /*presentationTime*/,
+                                  unsigned /*durationInMicroseconds*/)
+    {
+        NALUnitCountingSink* sink = (NALUnitCountingSink*)clientData;
+        unsigned nalUnitNum;
+        memcpy(&nalUnitNum, &sink->fBuffer[1], sizeof nalUnitNum);
+        if (frameSize != NAL_UNIT_SIZE || sink->fBuffer[0] != NAL_UNIT_HEADER
+            || nalUnitNum >= NUM_NAL_UNITS
+            || sink->fBuffer[NAL_UNIT_SIZE-1] != (nalUnitNum & 0xFF))
+        {
+            ++sink->fNumBad;
+        }
+        else if (sink->fSeen[nalUnitNum])
+        {
+            ++sink->fNumDuplicate;
+        }
+        else
+        {
+            sink->fSeen[nalUnitNum] = True;
+            ++sink->fNumGood;
+        }
+        sink->continuePlaying();
+    }
+
+    unsigned char fBuffer[2*NAL_UNIT_SIZE];
+    Boolean fSeen[NUM_NAL_UNITS];
+};
+
+// A viewer, set up from the SDP description as an RTSP client would be
+struct Receiver
+{
+    Receiver()
+        : session(NULL), subsession(NULL), sink(NULL)
+    {
+    }
+
+    Boolean start(char const* sdpDescription)
+    {
+        session = MediaSession::createNew(*env, sdpDescription);
+        if (session == NULL) return False;
+        MediaSubsessionIterator iter(*session);
+        subsession = iter.next();
+        if (subsession == NULL || !subsession->initiate()) return False;
+
+        sink = new NALUnitCountingSink(*env);
+        sink->startPlaying(*subsession->readSource(), NULL, NULL);
+        return True;
+    }
+
+    ~Receiver()
+    {
+        Medium::close(sink);
+        if (subsession != NULL) subsession->deInitiate();
+        Medium::close(session);
+    }
+
+    MediaSession* session;
+    MediaSubsession* subsession;
+    NALUnitCountingSink* sink;
+};
+
+static void endPhase(void* /*clientData*/)
+{
+    phaseDone = ~0;
+}
+
+static void runPhase(Boolean isSSM)
+{
+    printf("%s:\n", isSSM ? "source-specific multicast" : "any-source multicast");
+
+    struct in_addr groupAddress;
+    groupAddress.s_addr = isSSM ? chooseRandomIPv4SSMAddress(*env)
+        : our_inet_addr(ASM_GROUP_ADDRESS);
+    portNumBits rtpPortNum = isSSM ? SSM_RTP_PORT : ASM_RTP_PORT;
+
+    ServerMediaSession* sms = ServerMediaSession::createNew(*env, "h264",
+        "h264", "TestMulticast", isSSM);
+    sms->addSubsession(H264LiveVideoMulticastSubsession::createNew(*env,
+        groupAddress, rtpPortNum, TTL, isSSM, new NumberedNALUnitSource(*env)));
+    char* sdpDescription = sms->generateSDPDescription();
+
+    // The SDP description:
+    char mLine[100];
+    sprintf(mLine, "m=video %u RTP/AVP 96 98\r\n", rtpPortNum);
+    char cLine[100];
+    sprintf(cLine, "c=IN IP4 %s/%u\r\n", our_inet_ntoa(groupAddress), TTL);
+    check(sdpDescription != NULL && strstr(sdpDescription, mLine) != NULL
+          && strstr(sdpDescription, cLine) != NULL,
+          "SDP has the group's address and port");
+    check(sdpDescription != NULL
+          && strstr(sdpDescription, "a=rtpmap:98 ulpfec/90000\r\n") != NULL
+          && strstr(sdpDescription, "a=rtcp-fb:") == NULL
+          && strstr(sdpDescription, " rtx/") == NULL,
+          "SDP has FEC, but no NACKs or rtx");
+    if (isSSM)
+    {
+        check(sdpDescription != NULL
+              && strstr(sdpDescription, "a=source-filter: incl IN IP4 ") != NULL
+              && strstr(sdpDescription, "a=rtcp-unicast:reflection\r\n") != NULL,
+              "SDP has the source filter and a=rtcp-unicast:reflection");
+    }
+    else
+    {
+        check(sdpDescription != NULL
+              && strstr(sdpDescription, "a=source-filter:") == NULL
+              && strstr(sdpDescription, "a=rtcp-unicast:") == NULL,
+              "SDP has no source filter or a=rtcp-unicast");
+    }
+
+    Receiver receivers[NUM_RECEIVERS];
+    Boolean receiversStarted = sdpDescription != NULL;
+    for (unsigned i = 0; i < NUM_RECEIVERS && receiversStarted; ++i)
+    {
+        receiversStarted = receivers[i].start(sdpDescription);
+    }
+    check(receiversStarted, "receivers set up from the SDP description");
+    delete[] sdpDescription;
+
+    if (receiversStarted)
+    {
+        phaseDone = 0;
+        env->taskScheduler().scheduleDelayedTask(
+            NUM_NAL_UNITS*NAL_UNIT_DURATION + DRAIN_TIME, endPhase, NULL);
+        env->taskScheduler().doEventLoop(&phaseDone);
+
+        for (unsigned i = 0; i < NUM_RECEIVERS; ++i)
+        {
+            NALUnitCountingSink* sink = receivers[i].sink;
+            RTCPInstance* rtcp = receivers[i].subsession->rtcpInstance();
+            printf("  receiver %u: received %u/%u NAL units (%u duplicate, "
+                   "%u bad); knows of %u RTCP members\n",
+                   i, sink->fNumGood, NUM_NAL_UNITS, sink->fNumDuplicate,
+                   sink->fNumBad, rtcp == NULL ? 0 : rtcp->numMembers());
+
+            check(sink->fNumGood == NUM_NAL_UNITS && sink->fNumDuplicate == 0
+                  && sink->fNumBad == 0, "every NAL unit received intact, once");
+            check(rtcp != NULL && rtcp->numMembers() == NUM_RECEIVERS + 1,
+                  "heard of the source and the other receiver through RTCP");
+        }
+    }
+
+    Medium::close(sms); // closes the subsession, and its source
+}
+
+int main()
+{
+    TaskScheduler* scheduler = BasicTaskScheduler::createNew();
+    env = BasicUsageEnvironment::createNew(*scheduler);
+
+    runPhase(False);
+    runPhase(True);
+
+    printf("%s\n", allPassed ? "PASS" : "FAIL");
+
+    env->reclaim();
+    delete scheduler;
+    return allPassed ? 0 : 1;
+}
@@ -0,0 +1,352 @@
+// TestRTPLoss: RTP loss recovery test
+//
+// Streams numbered frames from a SimpleRTPSink into a SimpleRTPSource over
+// the loopback interface, in this one process, and checks what the receiver
+// recovers:
+//   1. with no feedback, as a baseline;
+//   2. with RTCP NACKs (RFC 4585) answered by RTX retransmissions (RFC 4588);
+//   3. with hand-made RTP packets, some of them swapped with their neighbour
+//      and some left out, to check that only the ones left out are NACKed,
+//      and not the ones that merely arrive out of order.
+//
+// The project compiles its own copy of "MultiFramedRTPSink.cpp" with
+// TEST_LOSS defined, so that the sink drops ~10% of the media packets and of
+// the retransmissions (overriding the object in libLive555, which is built
+// without it); the receiver itself loses nothing.  Phase 3 bypasses the sink,
+// so it's deterministic.
+//
+// usage: TestRTPLoss
+//
+// Prints the counts of each phase, then PASS or FAIL; the program exits with
+// 1 if any check failed.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "liveMedia.hh"
+#include "BasicUsageEnvironment.hh"
+#include "GroupsockHelper.hh"
+
+static const unsigned NUM_FRAMES = 2000;
+static const unsigned FRAME_SIZE = 1000; // one RTP packet each
+static const unsigned FRAME_DURATION = 1000; // us
+static const unsigned DRAIN_TIME = 1000000; // us, after the last frame
+static const unsigned char MEDIA_PAYLOAD_FORMAT = 96;
+static const unsigned char RTX_PAYLOAD_FORMAT = 97;
+static const unsigned REORDER_WINDOW = 20000; // us, as "setNACKSender()"'s default
+
+// Phase 3 leaves out every SKIP_INTERVAL'th packet, and swaps every
+// SWAP_INTERVAL'th one with the next.  It leaves none out of the last
+// INTACT_TAIL, because the receiver gives up on a missing packet only when a
+// later one arrives after its reordering threshold time (100 ms):
+static const unsigned SKIP_INTERVAL = 50;
+static const unsigned SWAP_INTERVAL = 7;
+static const unsigned INTACT_TAIL = 200;
+
+static const portNumBits SINK_RTP_PORT = 50010, SOURCE_RTP_PORT = 50000;
+
+static UsageEnvironment* env;
+static char phaseDone;
+static Boolean allPassed = True;
+
+static void fillFrame(unsigned char* to, unsigned frameNum)
+{
+    memset(to, frameNum & 0xFF, FRAME_SIZE);
+    memcpy(to, &frameNum, sizeof frameNum);
+}
+
+static void check(Boolean ok, char const* what)
+{
+    printf("  %s: %s\n", ok ? "ok" : "FAILED", what);
+    if (!ok) allPassed = False;
+}
+
+// Delivers the frames 0 .. NUM_FRAMES-1, one every FRAME_DURATION
+class NumberedFrameSource: public FramedSource
+{
+public:
+    NumberedFrameSource(UsageEnvironment& env)
+        : FramedSource(env), fNextFrameNum(0)
+    {
+    }
+
+private:
+    virtual void doGetNextFrame()
+    {
+        if (fNextFrameNum >= NUM_FRAMES || fMaxSize < FRAME_SIZE)
+        {
+            handleClosure(this);
+            return;
+        }
+        fillFrame(fTo, fNextFrameNum++);
+        fFrameSize = FRAME_SIZE;
+        gettimeofday(&fPresentationTime, NULL);
+        fDurationInMicroseconds = FRAME_DURATION;
+        nextTask() = envir().taskScheduler().scheduleDelayedTask(0,
+            (TaskFunc*)FramedSource::afterGetting, this);
+    }
+
+    unsigned fNextFrameNum;
+};
+
+// Counts the distinct intact frames that it receives
+class FrameCountingSink: public MediaSink
+{
+public:
+    FrameCountingSink(UsageEnvironment& env)
+        : MediaSink(env), fNumGood(0), fNumDuplicate(0), fNumBad(0)
+    {
+        memset(fSeen, 0, sizeof fSeen);
+    }
+
+    unsigned fNumGood, fNumDuplicate, fNumBad;
+
+private:
+    virtual Boolean continuePlaying()
+    {
+        if (fSource == NULL) return False;
+        fSource->getNextFrame(fBuffer, sizeof fBuffer, afterGettingFrame, this,
+                              onSourceClosure, this);
+        return True;
+    }
+
+    static void afterGettingFrame(void* clientData, unsigned frameSize,
+                                  unsigned /*numTruncatedBytes*/,
+                                  struct timeval /*presentationTime*/,
+                                  unsigned /*durationInMicroseconds*/)
+    {
+        FrameCountingSink* sink = (FrameCountingSink*)clientData;
+        unsigned frameNum;
+        memcpy(&frameNum, sink->fBuffer, sizeof frameNum);
+        if (frameSize != FRAME_SIZE || frameNum >= NUM_FRAMES
+            || sink->fBuffer[FRAME_SIZE-1] != (frameNum & 0xFF))
+        {
+            ++sink->fNumBad;
+        }
+        else if (sink->fSeen[frameNum])
+        {
+            ++sink->fNumDuplicate;
+        }
+        else
+        {
+            sink->fSeen[frameNum] = True;
+            ++sink->fNumGood;
+        }
+        sink->continuePlaying();
+    }
+
+    unsigned char fBuffer[2*FRAME_SIZE];
+    Boolean fSeen[NUM_FRAMES];
+};
+
+// The receiving end, shared by all of the phases
+struct Receiver
+{
+    Receiver(Boolean withNACKs)
+    {
+        struct in_addr loopback;
+        loopback.s_addr = our_inet_addr("127.0.0.1");
+        rtpGroupsock = new Groupsock(*env, loopback, Port(SOURCE_RTP_PORT), 1);
+        rtpGroupsock->changeDestinationParameters(loopback, Port(SINK_RTP_PORT), 1);
+        rtcpGroupsock = new Groupsock(*env, loopback, Port(SOURCE_RTP_PORT+1), 1);
+        rtcpGroupsock->changeDestinationParameters(loopback, Port(SINK_RTP_PORT+1), 1);
+
+        source = SimpleRTPSource::createNew(*env, rtpGroupsock,
+            MEDIA_PAYLOAD_FORMAT, 90000, "video/X", 0, False);
+        rtcp = RTCPInstance::createNew(*env, rtcpGroupsock, 500,
+            (unsigned char const*)"TestRTPLoss receiver", NULL, source);
+        if (withNACKs) source->setNACKSender(rtcp, RTX_PAYLOAD_FORMAT, REORDER_WINDOW);
+
+        sink = new FrameCountingSink(*env);
+        sink->startPlaying(*source, NULL, NULL);
+    }
+
+    ~Receiver()
+    {
+        Medium::close(rtcp);
+        Medium::close(sink);
+        Medium::close(source);
+        delete rtcpGroupsock;
+        delete rtpGroupsock;
+    }
+
+    Groupsock* rtpGroupsock;
+    Groupsock* rtcpGroupsock;
+    MultiFramedRTPSource* source;
+    RTCPInstance* rtcp;
+    FrameCountingSink* sink;
+};
+
+static void endPhase(void* /*clientData*/)
+{
+    phaseDone = ~0;
+}
+
+static void runFor(unsigned uSeconds)
+{
+    phaseDone = 0;
+    env->taskScheduler().scheduleDelayedTask(uSeconds, endPhase, NULL);
+    env->taskScheduler().doEventLoop(&phaseDone);
+}
+
+// Phases 1 and 2: returns the number of distinct frames received
+static unsigned runSinkPhase(Boolean withNACKs)
+{
+    printf("%s:\n", withNACKs ? "NACK + RTX" : "no feedback");
+
+    struct in_addr loopback;
+    loopback.s_addr = our_inet_addr("127.0.0.1");
+    Groupsock rtpGroupsock(*env, loopback, Port(SINK_RTP_PORT), 1);
+    rtpGroupsock.changeDestinationParameters(loopback, Port(SOURCE_RTP_PORT), 1);
+    Groupsock rtcpGroupsock(*env, loopback, Port(SINK_RTP_PORT+1), 1);
+    rtcpGroupsock.changeDestinationParameters(loopback, Port(SOURCE_RTP_PORT+1), 1);
+
+    MultiFramedRTPSink* rtpSink = SimpleRTPSink::createNew(*env, &rtpGroupsock,
+        MEDIA_PAYLOAD_FORMAT, 90000, "video", "X", 1, False);
+    if (withNACKs) rtpSink->enableRetransmission(256, RTX_PAYLOAD_FORMAT);
+    RTCPInstance* rtcp = RTCPInstance::createNew(*env, &rtcpGroupsock, 500,
+        (unsigned char const*)"TestRTPLoss sender", rtpSink, NULL);
+    Receiver receiver(withNACKs);
+
+    NumberedFrameSource* frameSource = new NumberedFrameSource(*env);
+    rtpSink->startPlaying(*frameSource, NULL, NULL);
+    runFor(NUM_FRAMES*FRAME_DURATION + DRAIN_TIME);
+
+    FrameCountingSink* sink = receiver.sink;
+    printf("  received %u/%u frames (%u duplicate, %u bad); NACKed %u, "
+           "received %u retransmissions; the sink resent %u, %u unavailable\n",
+           sink->fNumGood, NUM_FRAMES, sink->fNumDuplicate, sink->fNumBad,
+           receiver.source->numNACKedPackets(),
+           receiver.source->numRTXPacketsReceived(),
+           rtpSink->numRetransmittedPackets(),
+           rtpSink->numUnavailableRetransmissions());
+
+    check(sink->fNumBad == 0 && sink->fNumDuplicate == 0,
+          "no corrupt or duplicate frames");
+    if (withNACKs)
+    {
+        check(receiver.source->numNACKedPackets() > 0, "gaps were NACKed");
+        check(rtpSink->numRetransmittedPackets() > 0, "the sink retransmitted");
+        check(receiver.source->numRTXPacketsReceived() > 0,
+              "retransmissions were received");
+    }
+    else
+    {
+        check(receiver.source->numNACKedPackets() == 0, "nothing was NACKed");
+        check(sink->fNumGood < NUM_FRAMES, "the sink lost packets (TEST_LOSS)");
+    }
+    unsigned numGood = sink->fNumGood;
+
+    rtpSink->stopPlaying();
+    Medium::close(rtcp);
+    Medium::close(rtpSink);
+    Medium::close(frameSource);
+    return numGood;
+}
+
+// Phase 3: sends "NUM_FRAMES" packets by hand, one every "FRAME_DURATION"
+class ReorderingSender
+{
+public:
+    ReorderingSender(Groupsock& groupsock)
+        : fGroupsock(groupsock), fNextIndex(0), fNumSkipped(0), fNumSwapped(0)
+    {
+        sendNext(this);
+    }
+
+    unsigned numSkipped() const { return fNumSkipped; }
+    unsigned numSwapped() const { return fNumSwapped; }
+
+private:
+    static void sendNext(void* clientData)
+    {
+        ReorderingSender* sender = (ReorderingSender*)clientData;
+        if (sender->fNextIndex >= NUM_FRAMES) return;
+
+        unsigned index = sender->fNextIndex++;
+        unsigned seqNo = index;
+        if (index%SWAP_INTERVAL == 1 && index+1 < NUM_FRAMES)
+        {
+            seqNo = index+1; // and its predecessor comes next
+            ++sender->fNumSwapped;
+        }
+        else if (index%SWAP_INTERVAL == 2)
+        {
+            seqNo = index-1;
+        }
+
+        if (seqNo%SKIP_INTERVAL == SKIP_INTERVAL/2 && seqNo+INTACT_TAIL < NUM_FRAMES)
+        {
+            ++sender->fNumSkipped;
+        }
+        else
+        {
+            sender->sendPacket(seqNo);
+        }
+        env->taskScheduler().scheduleDelayedTask(FRAME_DURATION, sendNext, sender);
+    }
+
+    void sendPacket(unsigned seqNo)
+    {
+        unsigned char packet[12 + FRAME_SIZE];
+        unsigned rtpHdr = 0x80000000 | (MEDIA_PAYLOAD_FORMAT<<16) | (seqNo&0xFFFF);
+        unsigned word = htonl(rtpHdr);
+        memcpy(&packet[0], &word, 4);
+        word = htonl(seqNo*(90000/1000)); // timestamp
+        memcpy(&packet[4], &word, 4);
+        word = htonl(0x12345678); // SSRC
+        memcpy(&packet[8], &word, 4);
+        fillFrame(&packet[12], seqNo);
+        fGroupsock.output(*env, 255, packet, sizeof packet);
+    }
+
+    Groupsock& fGroupsock;
+    unsigned fNextIndex, fNumSkipped, fNumSwapped;
+};
+
+static void runReorderingPhase()
+{
+    printf("reordering:\n");
+
+    struct in_addr loopback;
+    loopback.s_addr = our_inet_addr("127.0.0.1");
+    Groupsock rtpGroupsock(*env, loopback, Port(SINK_RTP_PORT), 1);
+    rtpGroupsock.changeDestinationParameters(loopback, Port(SOURCE_RTP_PORT), 1);
+    Receiver receiver(True);
+
+    ReorderingSender sender(rtpGroupsock);
+    runFor(NUM_FRAMES*FRAME_DURATION + DRAIN_TIME);
+
+    FrameCountingSink* sink = receiver.sink;
+    printf("  received %u/%u frames (%u duplicate, %u bad); %u left out, "
+           "%u swapped; NACKed %u\n",
+           sink->fNumGood, NUM_FRAMES, sink->fNumDuplicate, sink->fNumBad,
+           sender.numSkipped(), sender.numSwapped(),
+           receiver.source->numNACKedPackets());
+
+    check(sink->fNumBad == 0 && sink->fNumDuplicate == 0,
+          "no corrupt or duplicate frames");
+    check(sink->fNumGood == NUM_FRAMES - sender.numSkipped(),
+          "every packet that was sent was delivered");
+    check(receiver.source->numNACKedPackets() == sender.numSkipped(),
+          "only the packets left out were NACKed");
+}
+
+int main()
+{
+    TaskScheduler* scheduler = BasicTaskScheduler::createNew();
+    env = BasicUsageEnvironment::createNew(*scheduler);
+
+    unsigned numWithout = runSinkPhase(False);
+    unsigned numWith = runSinkPhase(True);
+    printf("recovery:\n");
+    check(numWith > numWithout, "NACK + RTX delivered more frames");
+    runReorderingPhase();
+
+    printf("%s\n", allPassed ? "PASS" : "FAIL");
+
+    env->reclaim();
+    delete scheduler;
+    return allPassed ? 0 : 1;
+}
@@ -0,0 +1,513 @@
+// bench_h264dec: decoder throughput benchmark
+//
+// Decodes a corpus of Annex-B .264 files with H264DecWrapper and reports
+// fps, ns per macroblock and a per-stage breakdown taken from the decoder's
+// cycle counters (see H264Decoder/bench.h).  Without file arguments the
+// corpus is generated first with H264EncWrapper at several resolutions and
+// settings, so the numbers are comparable between builds on any machine.
+//
+// usage: bench_h264dec [-loops n] [-frames n] [-csv file] [-baseline file]
+//                      [-tolerance pct] [-gen] [file.264 ...]
+//
+// The "#summary" block at the end is CSV (ns per macroblock per stage).
+// Save it with -csv and pass it back with -baseline on the next build; the
+// program exits with 1 if any stream got slower than the tolerance.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "H264DecWrapper.h"
+#include "H264EndWrapper.h"
+
+#if defined(_WIN32)
+#include <windows.h>
+#include <intrin.h>
+#pragma intrinsic(__rdtsc)
+#else
+#include <sys/time.h>
+#include <unistd.h>
+#include <x86intrin.h>
+#endif
+
+// Output buffer size; larger input streams are not supported
+static const int MAX_WIDTH = 1920;
+static const int MAX_HEIGHT = 1088;
+static const int MAX_STREAMS = 64;
+static const int INBUF_SIZE = 4096;
+
+struct TGenSetting
+{
+    const char* name;
+    int width;
+    int height;
+    int bitrate;    // kbps
+    int cabac;
+    int deblock;
+};
+
+// Generated corpus: covers CAVLC and CABAC and the loop filter on and off.
+// No B-frames, the live encoder never emits them.
+static const TGenSetting g_GenSettings[] =
+{
+    { "qcif_cavlc",     176,  144,   64, 0, 1 },
+    { "cif_cavlc",      352,  288,  256, 0, 1 },
+    { "cif_cabac",      352,  288,  256, 1, 1 },
+    { "cif_nodeblock",  352,  288,  256, 1, 0 },
+    { "vga_cabac",      640,  480,  768, 1, 1 },
+    { "720p_cabac",    1280,  720, 2000, 1, 1 },
+};
+
+struct TResult
+{
+    char name[256];
+    int width, height;
+    int frames;
+    double fps;
+    double nsPerMB;
+    double stageNs[6];   // cavlc, cabac, mc, idct, deblock, er
+};
+
+static const char* g_StageNames[6] = { "cavlc", "cabac", "mc", "idct", "deblock", "er" };
+
+static double NowSeconds()
+{
+#if defined(_WIN32)
+    LARGE_INTEGER freq, now;
+    QueryPerformanceFrequency(&freq);
+    QueryPerformanceCounter(&now);
+    return (double)now.QuadPart / (double)freq.QuadPart;
+#else
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return tv.tv_sec + tv.tv_usec / 1000000.0;
+#endif
+}
+
+static void SleepMs(int ms)
+{
+#if defined(_WIN32)
+    Sleep(ms);
+#else
+    usleep(ms * 1000);
+#endif
+}
+
+// TSC ticks per nanosecond, used to turn the decoder's cycle counts into time
+static double CalibrateTsc()
+{
+    double t0 = NowSeconds();
+    unsigned long long c0 = __rdtsc();
+    SleepMs(200);
+    double t1 = NowSeconds();
+    unsigned long long c1 = __rdtsc();
+    return (double)(c1 - c0) / ((t1 - t0) * 1e9);
+}
+
+// Synthetic I420 frame: panning texture plus a moving block, so that both
+// intra and inter paths of the decoder get exercised
+static void MakeFrame(unsigned char* yuv, int w, int h, int t)
+{
+    unsigned char* py = yuv;
+    unsigned char* pu = yuv + w * h;
+    unsigned char* pv = pu + w * h / 4;
+    int x, y;
+
+    for(y = 0; y < h; y++)
+    {
+        for(x = 0; x < w; x++)
+        {
+            int sx = x + t * 2, sy = y + t;
+            int v = (sx * 3 + sy * 2) & 0xff;
+            if(((sx >> 4) ^ (sy >> 4)) & 1)
+                v = 255 - v;
+            py[y * w + x] = (unsigned char)v;
+        }
+    }
+
+    int bx = (t * 5) % (w > 64 ? w - 64 : 1), by = (t * 3) % (h > 64 ? h - 64 : 1);
+    unsigned int seed = 12345;
+    for(y = 0; y < 64 && by + y < h; y++)
+    {
+        for(x = 0; x < 64 && bx + x < w; x++)
+        {
+            seed = seed * 1103515245 + 12345;
+            py[(by + y) * w + bx + x] = (unsigned char)(seed >> 24);
+        }
+    }
+
+    for(y = 0; y < h / 2; y++)
+    {
+        for(x = 0; x < w / 2; x++)
+        {
+            pu[y * (w / 2) + x] = (unsigned char)(128 + ((x + t) & 63) - 32);
+            pv[y * (w / 2) + x] = (unsigned char)(128 + ((y - t) & 63) - 32);
+        }
+    }
+}
+
+static int GenerateStream(const TGenSetting& set, int iFrames, const char* szFile)
+{
+    H264EncWrapper enc;
+    x264_param_t& param = enc.GetParam();
+    param.b_cabac = set.cabac;
+    param.b_deblocking_filter = set.deblock;
+    param.i_keyint_max = 50;
+
+    if(enc.Initialize(set.width, set.height, set.bitrate, 25) < 0)
+    {
+        fprintf(stderr, "Initialize x264 encoder error (%s).\n", set.name);
+        return -1;
+    }
+
+    FILE* fout = fopen(szFile, "wb");
+    if(NULL == fout)
+    {
+        fprintf(stderr, "open %s error\n", szFile);
+        enc.Destroy();
+        return -1;
+    }
+
+    unsigned char* yuv = new unsigned char[set.width * set.height * 3 / 2];
+    for(int t = 0; t < iFrames; t++)
+    {
+        TNAL* pNal = NULL;
+        int iNalNum = 0;
+        MakeFrame(yuv, set.width, set.height, t);
+        if(enc.Encode(yuv, pNal, iNalNum) < 0)
+        {
+            break;
+        }
+        for(int i = 0; i < iNalNum; i++)
+        {
+            fwrite(pNal[i].data, 1, pNal[i].size, fout);
+        }
+        enc.CleanNAL(pNal, iNalNum);
+    }
+
+    delete []yuv;
+    fclose(fout);
+    enc.Destroy();
+    return 0;
+}
+
+static unsigned char* LoadFile(const char* szFile, int& iSize)
+{
+    FILE* fin = fopen(szFile, "rb");
+    if(NULL == fin)
+    {
+        return NULL;
+    }
+    fseek(fin, 0, SEEK_END);
+    iSize = (int)ftell(fin);
+    fseek(fin, 0, SEEK_SET);
+
+    unsigned char* buf = new unsigned char[iSize > 0 ? iSize : 1];
+    if((int)fread(buf, 1, iSize, fin) != iSize)
+    {
+        delete []buf;
+        buf = NULL;
+    }
+    fclose(fin);
+    return buf;
+}
+
+// One full pass over the stream.  The input is already in memory, so the
+// measured time is decode + the wrapper's output copy only.
+static double DecodeOnce(H264DecWrapper* pDec, const unsigned char* stream, int iStreamSize,
+                         unsigned char* outbuf, int& iFrames)
+{
+    unsigned char inbuf[INBUF_SIZE + 8];
+    int pos = 0, iOutSize = 0, len, size, flush;
+    bool bGetFrame = false;
+
+    iFrames = 0;
+    double t0 = NowSeconds();
+
+    while(pos < iStreamSize)
+    {
+        size = iStreamSize - pos < INBUF_SIZE ? iStreamSize - pos : INBUF_SIZE;
+        memcpy(inbuf, stream + pos, size);
+        pos += size;
+
+        unsigned char* inbuf_ptr = inbuf;
+        while(size > 0)
+        {
+            len = pDec->Decode(inbuf_ptr, size, outbuf, iOutSize, bGetFrame);
+            if(len < 0)
+            {
+                break;
+            }
+            if(bGetFrame)
+            {
+                iFrames++;
+            }
+            size -= len;
+            inbuf_ptr += len;
+        }
+    }
+
+    // empty input flushes the parser and then the delayed pictures
+    for(flush = 0; flush < 16; flush++)
+    {
+        bGetFrame = false;
+        if(pDec->Decode(inbuf, 0, outbuf, iOutSize, bGetFrame) < 0 || !bGetFrame)
+        {
+            if(flush > 0)
+                break;
+        }
+        else
+        {
+            iFrames++;
+        }
+    }
+
+    return NowSeconds() - t0;
+}
+
+static int BenchStream(const char* szFile, int iLoops, double dTicksPerNs,
+                       unsigned char* outbuf, TResult& res)
+{
+    int iStreamSize = 0;
+    unsigned char* stream = LoadFile(szFile, iStreamSize);
+    if(NULL == stream)
+    {
+        fprintf(stderr, "open file error: %s\n", szFile);
+        return -1;
+    }
+
+    TDecBenchStats total;
+    double dBest = 0;
+    int iFrames = 0, iWidth = 0, iHeight = 0;
+
+    for(int loop = 0; loop < iLoops; loop++)
+    {
+        H264DecWrapper* pDec = new H264DecWrapper;
+        if(pDec->Initialize() < 0)
+        {
+            fprintf(stderr, "Initialize H.264 decoder error.\n");
+            delete pDec;
+            delete []stream;
+            return -1;
+        }
+        pDec->EnableBench(true);
+
+        double dTime = DecodeOnce(pDec, stream, iStreamSize, outbuf, iFrames);
+        if(loop == 0 || dTime < dBest)
+        {
+            dBest = dTime;
+        }
+
+        TDecBenchStats stats;
+        pDec->GetBenchStats(stats);
+        total.macroblocks += stats.macroblocks;
+        total.cavlc += stats.cavlc;
+        total.cabac += stats.cabac;
+        total.mc += stats.mc;
+        total.idct += stats.idct;
+        total.deblock += stats.deblock;
+        total.er += stats.er;
+        iWidth = pDec->GetWidth();
+        iHeight = pDec->GetHeight();
+
+        pDec->Destroy();
+        delete pDec;
+    }
+    delete []stream;
+
+    const char* base = strrchr(szFile, '/');
+    const char* base2 = strrchr(szFile, '\\');
+    if(base2 > base) base = base2;
+    base = base ? base + 1 : szFile;
+
+    memset(&res, 0, sizeof(res));
+    strncpy(res.name, base, sizeof(res.name) - 1);
+    res.width = iWidth;
+    res.height = iHeight;
+    res.frames = iFrames;
+
+    double mbPerPass = (double)total.macroblocks / iLoops;
+    if(iFrames == 0 || mbPerPass == 0 || dBest <= 0)
+    {
+        fprintf(stderr, "%s: nothing decoded\n", szFile);
+        return -1;
+    }
+    res.fps = iFrames / dBest;
+    res.nsPerMB = dBest * 1e9 / mbPerPass;
+
+    double mbs = (double)total.macroblocks;
+    unsigned long long cycles[6] = { total.cavlc, total.cabac, total.mc, total.idct, total.deblock, total.er };
+    for(int i = 0; i < 6; i++)
+    {
+        res.stageNs[i] = cycles[i] / dTicksPerNs / mbs;
+    }
+    return 0;
+}
+
+static void PrintResult(const TResult& r)
+{
+    double staged = 0;
+    int i;
+    for(i = 0; i < 6; i++)
+        staged += r.stageNs[i];
+
+    printf("%-24s %4dx%-4d %5d frames %9.1f fps %8.1f ns/MB\n",
+        r.name, r.width, r.height, r.frames, r.fps, r.nsPerMB);
+    for(i = 0; i < 6; i++)
+    {
+        printf("    %-8s %8.1f ns/MB %5.1f%%\n", g_StageNames[i], r.stageNs[i],
+            r.nsPerMB > 0 ? 100.0 * r.stageNs[i] / r.nsPerMB : 0.0);
+    }
+    printf("    %-8s %8.1f ns/MB %5.1f%%\n", "other", r.nsPerMB - staged,
+        r.nsPerMB > 0 ? 100.0 * (r.nsPerMB - staged) / r.nsPerMB : 0.0);
+}
+
+static void WriteSummary(FILE* f, const TResult* res, int n)
+{
+    fprintf(f, "name,width,height,frames,fps,ns_per_mb");
+    for(int i = 0; i < 6; i++)
+        fprintf(f, ",%s", g_StageNames[i]);
+    fprintf(f, "\n");
+
+    for(int j = 0; j < n; j++)
+    {
+        const TResult& r = res[j];
+        fprintf(f, "%s,%d,%d,%d,%.2f,%.2f", r.name, r.width, r.height, r.frames, r.fps, r.nsPerMB);
+        for(int i = 0; i < 6; i++)
+            fprintf(f, ",%.2f", r.stageNs[i]);
+        fprintf(f, "\n");
+    }
+}
+
+// Returns the number of streams that are slower than the baseline by more
+// than dTolerance percent
+static int CompareBaseline(const char* szFile, const TResult* res, int n, double dTolerance)
+{
+    FILE* f = fopen(szFile, "r");
+    if(NULL == f)
+    {
+        fprintf(stderr, "open baseline error: %s\n", szFile);
+        return 0;
+    }
+
+    char line[1024];
+    int iRegressions = 0;
+    printf("\n#baseline %s (tolerance %.1f%%)\n", szFile, dTolerance);
+    while(fgets(line, sizeof(line), f))
+    {
+        char name[256];
+        int w, h, frames;
+        double fps, nsPerMB;
+        if(sscanf(line, "%255[^,],%d,%d,%d,%lf,%lf", name, &w, &h, &frames, &fps, &nsPerMB) != 6)
+        {
+            continue;
+        }
+        for(int j = 0; j < n; j++)
+        {
+            if(strcmp(res[j].name, name) != 0)
+                continue;
+            double delta = 100.0 * (res[j].nsPerMB - nsPerMB) / nsPerMB;
+            bool bSlow = delta > dTolerance;
+            printf("%-24s %8.1f -> %8.1f ns/MB %+6.1f%%%s\n", name, nsPerMB, res[j].nsPerMB,
+                delta, bSlow ? "  REGRESSION" : "");
+            if(bSlow)
+                iRegressions++;
+        }
+    }
+    fclose(f);
+    return iRegressions;
+}
+
+int main(int argc, char** argv)
+{
+    int iLoops = 3, iGenFrames = 100;
+    const char* szCsv = NULL;
+    const char* szBaseline = NULL;
+    double dTolerance = 5.0;
+    bool bGen = false;
+    const char* files[MAX_STREAMS];
+    char genNames[MAX_STREAMS][64];
+    int iFiles = 0, i;
+
+    for(i = 1; i < argc; i++)
+    {
+        if(0 == strcmp(argv[i], "-loops") && i + 1 < argc)
+            iLoops = atoi(argv[++i]);
+        else if(0 == strcmp(argv[i], "-frames") && i + 1 < argc)
+            iGenFrames = atoi(argv[++i]);
+        else if(0 == strcmp(argv[i], "-csv") && i + 1 < argc)
+            szCsv = argv[++i];
+        else if(0 == strcmp(argv[i], "-baseline") && i + 1 < argc)
+            szBaseline = argv[++i];
+        else if(0 == strcmp(argv[i], "-tolerance") && i + 1 < argc)
+            dTolerance = atof(argv[++i]);
+        else if(0 == strcmp(argv[i], "-gen"))
+            bGen = true;
+        else if(argv[i][0] == '-')
+        {
+            fprintf(stderr, "usage: %s [-loops n] [-frames n] [-csv file] [-baseline file] "
+                "[-tolerance pct] [-gen] [file.264 ...]\n", argv[0]);
+            return 2;
+        }
+        else if(iFiles < MAX_STREAMS)
+            files[iFiles++] = argv[i];
+    }
+    if(iLoops < 1)
+        iLoops = 1;
+    if(0 == iFiles)
+        bGen = true;
+
+    if(bGen)
+    {
+        int iGen = sizeof(g_GenSettings) / sizeof(g_GenSettings[0]);
+        for(i = 0; i < iGen && iFiles < MAX_STREAMS; i++)
+        {
+            sprintf(genNames[i], "bench_%s.264", g_GenSettings[i].name);
+            printf("Encoding %s (%d frames)\n", genNames[i], iGenFrames);
+            if(GenerateStream(g_GenSettings[i], iGenFrames, genNames[i]) == 0)
+                files[iFiles++] = genNames[i];
+        }
+    }
+
+    double dTicksPerNs = CalibrateTsc();
+    printf("TSC %.3f GHz, %d loops per stream (best pass reported)\n\n", dTicksPerNs, iLoops);
+
+    unsigned char* outbuf = new unsigned char[MAX_WIDTH * MAX_HEIGHT * 3 / 2];
+    TResult* res = new TResult[iFiles];
+    int n = 0;
+    for(i = 0; i < iFiles; i++)
+    {
+        if(BenchStream(files[i], iLoops, dTicksPerNs, outbuf, res[n]) == 0)
+        {
+            PrintResult(res[n]);
+            n++;
+        }
+    }
+
+    printf("\n#summary\n");
+    WriteSummary(stdout, res, n);
+
+    if(szCsv)
+    {
+        FILE* f = fopen(szCsv, "w");
+        if(f)
+        {
+            WriteSummary(f, res, n);
+            fclose(f);
+        }
+        else
+        {
+            fprintf(stderr, "open %s error\n", szCsv);
+        }
+    }
+
+    int iRegressions = 0;
+    if(szBaseline)
+    {
+        iRegressions = CompareBaseline(szBaseline, res, n, dTolerance);
+    }
+
+    delete []res;
+    delete []outbuf;
+    return iRegressions > 0 ? 1 : 0;
+}
@@ -0,0 +1,783 @@
+// rtspload: RTSP server load generator
+//
+// Simulates N viewers of one stream from a single process: each is an
+// RTSPClient (using its asynchronous interface, so that all of the sessions
+// share one event loop) that sets the stream up over UDP or TCP-interleaved
+// RTP, plays it and discards what it receives.  Reports, as percentile
+// histograms, each session's setup latency (DESCRIBE sent to PLAY answered),
+// its time to the first frame, the inter-frame arrival jitter and each
+// session's throughput, plus the RTP packets lost and the failures by stage
+// and result code.
+//
+// usage: rtspload [-n sessions] [-t tcp-percent] [-d seconds]
+//                 [-r sessions-per-second] [-i report-seconds] [-v]
+//                 (rtsp://url | -s file.264 [-p port])
+//
+// With -s, the file is served from an RTSPServer on the loopback interface
+// in this process (and event loop), and that is what is loaded; otherwise,
+// run the server to be measured (e.g. "RTSPServer" on 127.0.0.1) separately.
+// The sessions are started -r per second (default: all at once), and each
+// plays for -d seconds after the last one has been started.  The program
+// exits with 1 if any session failed.
+//
+// Each session uses 2 sockets per subsession (even over TCP, which leaves
+// them idle) and 1 more for RTSP; with -s, the server uses 1 more for each.
+// One select() can watch only FD_SETSIZE sockets.  On Windows that's how
+// many, and the project settings (here and in libLive555) raise it to 1024;
+// elsewhere it's the limit on their numbers (usually 1024, and fixed), which
+// the program's other files count against, too.  The program refuses to
+// start more sessions than that allows.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "liveMedia.hh"
+#include "BasicUsageEnvironment.hh"
+#include "GroupsockHelper.hh"
+#include "LogMacros.hh"
+
+// Settings
+static unsigned numSessions = 10;
+static unsigned tcpPercent = 0;
+static double durationSecs = 30.0;
+static double sessionsPerSecond = 0.0; // 0: start them all at once
+static double reportSecs = 5.0;
+static int verbosityLevel = 0;
+static char const* url = NULL;
+static char const* serveFileName = NULL;
+static portNumBits serverPortNum = 8554;
+
+static const unsigned SINK_BUFFER_SIZE = 512*1024; // shared by all sinks
+static const double GRACE_SECS = 3.0; // for the TEARDOWNs to be answered
+static const unsigned MAX_SUBSESSIONS = 8;
+static const unsigned SOCKETS_PER_SESSION = 3; // RTSP, RTP and RTCP (video only)
+static const unsigned OTHER_SOCKETS = 16; // stdio, the log, listening sockets...
+
+static UsageEnvironment* env;
+static struct timeval startTime, endTime; // of the test (not the TEARDOWNs)
+static Boolean haveEndTime = False;
+
+static double secondsSince(struct timeval const& t, struct timeval const* now = NULL)
+{
+    struct timeval timeNow;
+    if (now == NULL)
+    {
+        gettimeofday(&timeNow, NULL);
+        now = &timeNow;
+    }
+    return (now->tv_sec - t.tv_sec) + (now->tv_usec - t.tv_usec)/1000000.0;
+}
+
+// A log-linear histogram: 16 buckets per power of 2 (so a value's bucket is
+// within 1/16th of it), over unsigned integer values.  Values are printed
+// divided by "scale", in "unit".
+class Histogram
+{
+public:
+    Histogram(char const* name, char const* unit, double scale)
+        : fName(name), fUnit(unit), fScale(scale), fNumValues(0), fSum(0.0),
+          fMax(0)
+    {
+        memset(fCounts, 0, sizeof fCounts);
+    }
+
+    void add(double value)
+    {
+        unsigned v = value <= 0.0 ? 0
+            : value >= 4294967295.0 ? 4294967295U : (unsigned)(value + 0.5);
+        ++fCounts[bucketOf(v)];
+        ++fNumValues;
+        fSum += v;
+        if (v > fMax) fMax = v;
+    }
+
+    void print() const
+    {
+        printf("%s (%s): n %u", fName, fUnit, fNumValues);
+        if (fNumValues == 0)
+        {
+            printf("\n");
+            return;
+        }
+        printf(", p50 %.4g, p90 %.4g, p99 %.4g, p99.9 %.4g, max %.4g, mean %.4g\n",
+               percentile(50.0)/fScale, percentile(90.0)/fScale,
+               percentile(99.0)/fScale, percentile(99.9)/fScale,
+               fMax/fScale, fSum/fNumValues/fScale);
+
+        // One bar per power of 2:
+        unsigned octaveCounts[33];
+        memset(octaveCounts, 0, sizeof octaveCounts);
+        int lo = 33, hi = -1;
+        for (unsigned i = 0; i < NUM_BUCKETS; ++i)
+        {
+            if (fCounts[i] == 0) continue;
+            int octave = octaveOf(bucketLow(i));
+            octaveCounts[octave] += fCounts[i];
+            if (octave < lo) lo = octave;
+            if (octave > hi) hi = octave;
+        }
+        unsigned maxCount = 0;
+        for (int o = lo; o <= hi; ++o)
+        {
+            if (octaveCounts[o] > maxCount) maxCount = octaveCounts[o];
+        }
+        for (int o = lo; o <= hi; ++o)
+        {
+            double low = o == 0 ? 0.0 : ldexp(1.0, o - 1);
+            double high = ldexp(1.0, o);
+            int barLength = (int)((50.0*octaveCounts[o] + maxCount - 1)/maxCount);
+            printf("  [%9.4g, %9.4g) %8u ", low/fScale, high/fScale, octaveCounts[o]);
+            for (int j = 0; j < barLength; ++j) putchar('#');
+            putchar('\n');
+        }
+    }
+
+private:
+    enum { SUB_BUCKETS = 16, NUM_BUCKETS = 29*SUB_BUCKETS };
+
+    // Values below 16 have a bucket each; above, a value with its most
+    // significant bit at bit "msb" is in octave "msb - 3", sub-bucket given
+    // by its next 4 bits:
+    static unsigned bucketOf(unsigned v)
+    {
+        if (v < SUB_BUCKETS) return v;
+        int msb = octaveOf(v) - 1;
+        return (msb - 3)*SUB_BUCKETS + ((v >> (msb - 4)) & (SUB_BUCKETS - 1));
+    }
+
+    static double bucketLow(unsigned i)
+    {
+        if (i < SUB_BUCKETS) return i;
+        int msb = i/SUB_BUCKETS + 3;
+        return ldexp((double)(SUB_BUCKETS + i%SUB_BUCKETS), msb - 4);
+    }
+
+    // 0 for 0; otherwise 1 + the index of the most significant bit:
+    static int octaveOf(double v)
+    {
+        int octave = 0;
+        while (v >= 1.0)
+        {
+            v /= 2;
+            ++octave;
+        }
+        return octave;
+    }
+
+    double percentile(double p) const
+    {
+        double rank = p/100.0*fNumValues;
+        unsigned seen = 0;
+        for (unsigned i = 0; i < NUM_BUCKETS; ++i)
+        {
+            seen += fCounts[i];
+            if (seen >= rank && fCounts[i] > 0)
+            {
+                // The middle of the bucket (but no more than the maximum):
+                double mid = (bucketLow(i) + bucketLow(i + 1))/2;
+                if (i < SUB_BUCKETS) mid = i;
+                return mid > fMax ? fMax : mid;
+            }
+        }
+        return fMax;
+    }
+
+private:
+    char const* fName;
+    char const* fUnit;
+    double fScale;
+    unsigned fCounts[NUM_BUCKETS];
+    unsigned fNumValues;
+    double fSum;
+    unsigned fMax;
+};
+
+static Histogram setupLatency("setup latency, DESCRIBE to PLAY response", "ms", 1000.0);
+static Histogram firstFrameLatency("first frame, after DESCRIBE", "ms", 1000.0);
+static Histogram frameJitter("inter-frame arrival jitter", "ms", 1000.0);
+static Histogram sessionThroughput("per-session throughput", "kbit/s", 1.0);
+
+// Failures, by stage and result code:
+struct TFailure
+{
+    char const* stage;
+    int resultCode;
+    unsigned count;
+    char* firstResultString;
+};
+static const unsigned MAX_FAILURE_KINDS = 32;
+static TFailure failures[MAX_FAILURE_KINDS];
+static unsigned numFailureKinds = 0;
+
+// Totals, over all sessions:
+static unsigned numStarted = 0, numPlaying = 0, numFailed = 0, numClosed = 0;
+static double totalBytes = 0.0, totalFrames = 0.0;
+static double bytesAtLastReport = 0.0;
+static double totalPacketsExpected = 0.0, totalPacketsLost = 0.0;
+static char stopEventLoop = 0;
+
+enum TViewerState { VIEWER_IDLE, VIEWER_DESCRIBING, VIEWER_SETTING_UP,
+                    VIEWER_PLAYING, VIEWER_TEARING_DOWN, VIEWER_CLOSED };
+
+class DiscardSink;
+
+struct TViewer
+{
+    unsigned index;
+    Boolean useTCP;
+    TViewerState state;
+    RTSPClient* client;
+    MediaSession* session;
+    DiscardSink* sinks[MAX_SUBSESSIONS];
+    unsigned numSubsessions, numSetUp;
+    struct timeval describeTime; // when the DESCRIBE was sent
+    Boolean haveFirstFrame;
+    struct timeval firstFrameTime, lastFrameTime;
+    double bytes;
+};
+static TViewer* viewers;
+
+static void noteFailure(TViewer& viewer, char const* stage, int resultCode,
+                        char const* resultString);
+static void closeViewer(TViewer& viewer);
+
+// A sink that discards what it receives - into one buffer, shared by all of
+// them - noting only its size, and when.  The first NAL unit with a new
+// presentation time starts a new frame.
+class DiscardSink: public MediaSink
+{
+public:
+    static DiscardSink* createNew(UsageEnvironment& env, TViewer& viewer)
+    {
+        return new DiscardSink(env, viewer);
+    }
+
+    Boolean hasEnded() const { return fHasEnded; }
+
+protected:
+    DiscardSink(UsageEnvironment& env, TViewer& viewer)
+        : MediaSink(env), fViewer(viewer), fHasEnded(False), fNumFrames(0)
+    {
+        if (fBuffer == NULL) fBuffer = new unsigned char[SINK_BUFFER_SIZE];
+    }
+
+private: // redefined virtual functions:
+    virtual Boolean continuePlaying()
+    {
+        if (fSource == NULL) return False;
+
+        fSource->getNextFrame(fBuffer, SINK_BUFFER_SIZE,
+                              afterGettingFrame, this, onEnded, this);
+        return True;
+    }
+
+private:
+    static void afterGettingFrame(void* clientData, unsigned frameSize,
+                                  unsigned /*numTruncatedBytes*/,
+                                  struct timeval presentationTime,
+                                  unsigned /*durationInMicroseconds*/)
+    {
+        DiscardSink* sink = (DiscardSink*)clientData;
+        sink->afterGettingFrame1(frameSize, presentationTime);
+    }
+
+    void afterGettingFrame1(unsigned frameSize, struct timeval presentationTime)
+    {
+        struct timeval timeNow;
+        gettimeofday(&timeNow, NULL);
+        fViewer.bytes += frameSize;
+        totalBytes += frameSize;
+
+        if (fNumFrames == 0
+            || presentationTime.tv_sec != fLastPresentationTime.tv_sec
+            || presentationTime.tv_usec != fLastPresentationTime.tv_usec)
+        {
+            if (fNumFrames > 0)
+            {
+                // How much later (or sooner) than its presentation time says
+                // this frame arrived, relative to the previous one:
+                double arrivalDelta = secondsSince(fLastArrivalTime, &timeNow);
+                double presentationDelta
+                    = secondsSince(fLastPresentationTime, &presentationTime);
+                frameJitter.add(fabs(arrivalDelta - presentationDelta)*1000000.0);
+            }
+            ++fNumFrames;
+            ++totalFrames;
+            fLastPresentationTime = presentationTime;
+            fLastArrivalTime = timeNow;
+        }
+
+        if (!fViewer.haveFirstFrame)
+        {
+            fViewer.haveFirstFrame = True;
+            fViewer.firstFrameTime = timeNow;
+            firstFrameLatency.add(secondsSince(fViewer.describeTime, &timeNow)*1000000.0);
+        }
+        fViewer.lastFrameTime = timeNow;
+
+        continuePlaying();
+    }
+
+    // The stream has ended (or the server has closed it); that's not a
+    // failure, unless the TEARDOWN then fails:
+    static void onEnded(void* clientData)
+    {
+        DiscardSink* sink = (DiscardSink*)clientData;
+        sink->fHasEnded = True;
+        if (verbosityLevel > 0)
+        {
+            printf("session %u: a stream ended\n", sink->fViewer.index);
+        }
+        sink->stopPlaying();
+    }
+
+private:
+    static unsigned char* fBuffer;
+    TViewer& fViewer;
+    Boolean fHasEnded;
+    unsigned fNumFrames;
+    struct timeval fLastPresentationTime, fLastArrivalTime;
+};
+
+unsigned char* DiscardSink::fBuffer = NULL;
+
+static void afterTEARDOWN(RTSPClient* /*client*/, void* clientData,
+                          int resultCode, char* resultString)
+{
+    TViewer& viewer = *(TViewer*)clientData;
+    if (resultCode != 0) noteFailure(viewer, "TEARDOWN", resultCode, resultString);
+    delete[] resultString;
+    closeViewer(viewer); // closes "client", too
+}
+
+static void afterPLAY(RTSPClient* /*client*/, void* clientData,
+                      int resultCode, char* resultString)
+{
+    TViewer& viewer = *(TViewer*)clientData;
+    if (resultCode != 0)
+    {
+        noteFailure(viewer, "PLAY", resultCode, resultString);
+        delete[] resultString;
+        closeViewer(viewer);
+        return;
+    }
+    delete[] resultString;
+
+    setupLatency.add(secondsSince(viewer.describeTime)*1000000.0);
+    viewer.state = VIEWER_PLAYING;
+    ++numPlaying;
+}
+
+static void afterSETUP(RTSPClient* client, void* clientData,
+                       int resultCode, char* resultString)
+{
+    TViewer& viewer = *(TViewer*)clientData;
+    if (viewer.state != VIEWER_SETTING_UP)
+    {
+        // An earlier SETUP failed:
+        delete[] resultString;
+        return;
+    }
+    if (resultCode != 0)
+    {
+        noteFailure(viewer, "SETUP", resultCode, resultString);
+        delete[] resultString;
+        closeViewer(viewer);
+        return;
+    }
+    delete[] resultString;
+    if (++viewer.numSetUp < viewer.numSubsessions) return;
+
+    // Start discarding each subsession's data, then PLAY:
+    MediaSubsessionIterator iter(*viewer.session);
+    MediaSubsession* subsession;
+    unsigned i = 0;
+    while ((subsession = iter.next()) != NULL && i < viewer.numSubsessions)
+    {
+        if (subsession->readSource() == NULL) continue;
+
+        viewer.sinks[i] = DiscardSink::createNew(*env, viewer);
+        subsession->sink = viewer.sinks[i];
+        viewer.sinks[i]->startPlaying(*subsession->readSource(), NULL, NULL);
+        ++i;
+    }
+    if (client->sendPlayCommand(*viewer.session, afterPLAY, &viewer) == 0)
+    {
+        noteFailure(viewer, "PLAY", -1, env->getResultMsg());
+        closeViewer(viewer);
+    }
+}
+
+static void afterDESCRIBE(RTSPClient* client, void* clientData,
+                          int resultCode, char* resultString)
+{
+    TViewer& viewer = *(TViewer*)clientData;
+    if (resultCode != 0)
+    {
+        noteFailure(viewer, "DESCRIBE", resultCode, resultString);
+        delete[] resultString;
+        closeViewer(viewer);
+        return;
+    }
+
+    viewer.session = MediaSession::createNew(*env, resultString);
+    delete[] resultString;
+    if (viewer.session == NULL)
+    {
+        noteFailure(viewer, "SDP", -1, env->getResultMsg());
+        closeViewer(viewer);
+        return;
+    }
+
+    // Send all of the SETUPs at once; the client holds back all but the
+    // first until it has the session id:
+    viewer.state = VIEWER_SETTING_UP;
+    MediaSubsessionIterator iter(*viewer.session);
+    MediaSubsession* subsession;
+    while ((subsession = iter.next()) != NULL)
+    {
+        if (viewer.numSubsessions == MAX_SUBSESSIONS) break;
+        if (!subsession->initiate())
+        {
+            noteFailure(viewer, "initiate", -1, env->getResultMsg());
+            closeViewer(viewer);
+            return;
+        }
+        if (subsession->rtpSource() != NULL)
+        {
+            // Large enough for a burst of key-frame packets, at this rate:
+            int rtpSocketNum = subsession->rtpSource()->RTPgs()->socketNum();
+            increaseReceiveBufferTo(*env, rtpSocketNum, 256*1024);
+        }
+        ++viewer.numSubsessions;
+        if (client->sendSetupCommand(*subsession, afterSETUP, &viewer,
+                                     False, viewer.useTCP) == 0)
+        {
+            noteFailure(viewer, "SETUP", -1, env->getResultMsg());
+            closeViewer(viewer);
+            return;
+        }
+    }
+    if (viewer.numSubsessions == 0)
+    {
+        noteFailure(viewer, "SDP", -1, "no subsessions");
+        closeViewer(viewer);
+    }
+}
+
+static void startViewer(TViewer& viewer)
+{
+    ++numStarted;
+    viewer.client = RTSPClient::createNew(*env, verbosityLevel > 1 ? 1 : 0,
+                                          "rtspload");
+    if (viewer.client == NULL)
+    {
+        noteFailure(viewer, "connect", -1, env->getResultMsg());
+        closeViewer(viewer);
+        return;
+    }
+    viewer.state = VIEWER_DESCRIBING;
+    gettimeofday(&viewer.describeTime, NULL);
+    if (viewer.client->sendDescribeCommand(url, afterDESCRIBE, &viewer) == 0)
+    {
+        noteFailure(viewer, "DESCRIBE", -1, env->getResultMsg());
+        closeViewer(viewer);
+    }
+}
+
+// Adds the viewer's RTP loss and throughput to the totals, then closes it
+static void closeViewer(TViewer& viewer)
+{
+    if (viewer.state == VIEWER_CLOSED) return;
+    if (viewer.state == VIEWER_PLAYING || viewer.state == VIEWER_TEARING_DOWN)
+    {
+        --numPlaying;
+    }
+
+    if (viewer.haveFirstFrame)
+    {
+        double secs = secondsSince(viewer.firstFrameTime, &viewer.lastFrameTime);
+        if (secs > 0.0) sessionThroughput.add(viewer.bytes*8/1000/secs);
+    }
+
+    if (viewer.session != NULL)
+    {
+        MediaSubsessionIterator iter(*viewer.session);
+        MediaSubsession* subsession;
+        while ((subsession = iter.next()) != NULL)
+        {
+            RTPSource* rtpSource = subsession->rtpSource();
+            if (rtpSource == NULL) continue;
+
+            RTPReceptionStatsDB::Iterator statsIter(rtpSource->receptionStatsDB());
+            RTPReceptionStats* stats;
+            while ((stats = statsIter.next(True)) != NULL)
+            {
+                unsigned expected = stats->totNumPacketsExpected();
+                unsigned received = stats->totNumPacketsReceived();
+                totalPacketsExpected += expected;
+                if (expected > received) totalPacketsLost += expected - received;
+            }
+        }
+    }
+    for (unsigned i = 0; i < MAX_SUBSESSIONS; ++i)
+    {
+        Medium::close(viewer.sinks[i]);
+        viewer.sinks[i] = NULL;
+    }
+    Medium::close(viewer.session);
+    viewer.session = NULL;
+    Medium::close(viewer.client); // (may be from within one of its handlers)
+    viewer.client = NULL;
+
+    viewer.state = VIEWER_CLOSED;
+    if (++numClosed == numSessions) stopEventLoop = 1;
+}
+
+static void noteFailure(TViewer& viewer, char const* stage, int resultCode,
+                        char const* resultString)
+{
+    ++numFailed;
+    if (verbosityLevel > 0)
+    {
+        printf("session %u: %s failed (%d): %s\n", viewer.index, stage,
+               resultCode, resultString == NULL ? "" : resultString);
+    }
+
+    unsigned i;
+    for (i = 0; i < numFailureKinds; ++i)
+    {
+        if (strcmp(failures[i].stage, stage) == 0
+            && failures[i].resultCode == resultCode) break;
+    }
+    if (i == numFailureKinds)
+    {
+        if (numFailureKinds == MAX_FAILURE_KINDS) i = MAX_FAILURE_KINDS - 1;
+        else
+        {
+            ++numFailureKinds;
+            failures[i].stage = stage;
+            failures[i].resultCode = resultCode;
+            failures[i].count = 0;
+            failures[i].firstResultString = strDup(resultString);
+        }
+    }
+    ++failures[i].count;
+}
+
+static void startNextViewer(void*)
+{
+    if (numStarted == numSessions) return;
+
+    startViewer(viewers[numStarted]);
+
+    // Keep to the rate from the start, not from the last session started:
+    double due = numStarted/sessionsPerSecond;
+    double waitSecs = due - secondsSince(startTime);
+    env->taskScheduler().scheduleDelayedTask(
+        waitSecs > 0.0 ? (int64_t)(waitSecs*1000000) : 0, startNextViewer, NULL);
+}
+
+static void reportProgress(void*)
+{
+    double bytes = totalBytes - bytesAtLastReport;
+    bytesAtLastReport = totalBytes;
+    printf("%7.1fs: started %u, playing %u, failed %u; %.2f Mbit/s\n",
+           secondsSince(startTime), numStarted, numPlaying, numFailed,
+           bytes*8/1000000/reportSecs);
+    fflush(stdout);
+    env->taskScheduler().scheduleDelayedTask((int64_t)(reportSecs*1000000),
+                                             reportProgress, NULL);
+}
+
+static void giveUp(void*)
+{
+    // Any TEARDOWN that's still unanswered:
+    for (unsigned i = 0; i < numSessions; ++i)
+    {
+        if (viewers[i].state == VIEWER_TEARING_DOWN)
+        {
+            noteFailure(viewers[i], "TEARDOWN", -1, "no response");
+        }
+        closeViewer(viewers[i]);
+    }
+    stopEventLoop = 1;
+}
+
+static void endTest(void*)
+{
+    gettimeofday(&endTime, NULL);
+    haveEndTime = True;
+    for (unsigned i = 0; i < numSessions; ++i)
+    {
+        TViewer& viewer = viewers[i];
+        switch (viewer.state)
+        {
+        case VIEWER_PLAYING:
+            viewer.state = VIEWER_TEARING_DOWN;
+            if (viewer.client->sendTeardownCommand(*viewer.session,
+                                                   afterTEARDOWN, &viewer) == 0)
+            {
+                noteFailure(viewer, "TEARDOWN", -1, env->getResultMsg());
+                closeViewer(viewer);
+            }
+            break;
+        case VIEWER_DESCRIBING:
+        case VIEWER_SETTING_UP:
+            noteFailure(viewer, viewer.state == VIEWER_DESCRIBING ? "DESCRIBE" : "SETUP",
+                        -1, "not answered before the end of the test");
+            closeViewer(viewer);
+            break;
+        default:
+            break;
+        }
+    }
+    env->taskScheduler().scheduleDelayedTask((int64_t)(GRACE_SECS*1000000),
+                                             giveUp, NULL);
+}
+
+static void printReport(double testSecs)
+{
+    unsigned numTCP = 0;
+    for (unsigned i = 0; i < numSessions; ++i)
+    {
+        if (viewers[i].useTCP) ++numTCP;
+    }
+
+    printf("\n#report\n");
+    printf("url: %s\n", url);
+    printf("sessions: %u (%u over UDP, %u over TCP), failed %u\n",
+           numSessions, numSessions - numTCP, numTCP, numFailed);
+    for (unsigned i = 0; i < numFailureKinds; ++i)
+    {
+        printf("  %-10s %5d  x%-6u %s\n", failures[i].stage, failures[i].resultCode,
+               failures[i].count,
+               failures[i].firstResultString == NULL ? "" : failures[i].firstResultString);
+    }
+    printf("received: %.2f MB, %.0f frames in %.1fs: %.2f Mbit/s aggregate\n",
+           totalBytes/1000000, totalFrames, testSecs,
+           testSecs > 0.0 ? totalBytes*8/1000000/testSecs : 0.0);
+    printf("RTP packets lost: %.0f of %.0f (%.3f%%)\n",
+           totalPacketsLost, totalPacketsExpected,
+           totalPacketsExpected > 0.0 ? 100.0*totalPacketsLost/totalPacketsExpected : 0.0);
+    printf("\n");
+    setupLatency.print();
+    firstFrameLatency.print();
+    frameJitter.print();
+    sessionThroughput.print();
+}
+
+static void usage(char const* progName)
+{
+    fprintf(stderr, "usage: %s [-n sessions] [-t tcp-percent] [-d seconds]\n"
+            "\t[-r sessions-per-second] [-i report-seconds] [-v]\n"
+            "\t(rtsp://url | -s file.264 [-p port])\n", progName);
+    exit(2);
+}
+
+int main(int argc, char** argv)
+{
+    for (int i = 1; i < argc; ++i)
+    {
+        char const* arg = argv[i];
+        if (strcmp(arg, "-v") == 0) ++verbosityLevel;
+        else if (arg[0] == '-' && i + 1 < argc)
+        {
+            char const* value = argv[++i];
+            if (strcmp(arg, "-n") == 0) numSessions = atoi(value);
+            else if (strcmp(arg, "-t") == 0) tcpPercent = atoi(value);
+            else if (strcmp(arg, "-d") == 0) durationSecs = atof(value);
+            else if (strcmp(arg, "-r") == 0) sessionsPerSecond = atof(value);
+            else if (strcmp(arg, "-i") == 0) reportSecs = atof(value);
+            else if (strcmp(arg, "-s") == 0) serveFileName = value;
+            else if (strcmp(arg, "-p") == 0) serverPortNum = (portNumBits)atoi(value);
+            else usage(argv[0]);
+        }
+        else if (arg[0] != '-' && url == NULL) url = arg;
+        else usage(argv[0]);
+    }
+    if (numSessions == 0 || tcpPercent > 100 || reportSecs <= 0.0
+        || (url == NULL) == (serveFileName == NULL))
+    {
+        usage(argv[0]);
+    }
+
+    // Every socket must be one that select() can watch:
+    unsigned socketsPerSession = SOCKETS_PER_SESSION + (serveFileName != NULL ? 1 : 0);
+    if (numSessions > (FD_SETSIZE - OTHER_SOCKETS)/socketsPerSession)
+    {
+        fprintf(stderr, "%u sessions need about %u sockets, but select() can watch "
+                "only %u (FD_SETSIZE); use at most -n %u\n",
+                numSessions, numSessions*socketsPerSession + OTHER_SOCKETS,
+                (unsigned)FD_SETSIZE, (FD_SETSIZE - OTHER_SOCKETS)/socketsPerSession);
+        return 2;
+    }
+
+    initDebugLog("rtspload.log");
+    TaskScheduler* scheduler = BasicTaskScheduler::createNew();
+    env = BasicUsageEnvironment::createNew(*scheduler);
+
+    RTSPServer* rtspServer = NULL;
+    char localURL[100];
+    if (serveFileName != NULL)
+    {
+        rtspServer = RTSPServer::createNew(*env, serverPortNum);
+        if (rtspServer == NULL)
+        {
+            fprintf(stderr, "Failed to create RTSP server: %s\n", env->getResultMsg());
+            return 2;
+        }
+        H264VideoFileServerMediaSubsession* subsession
+            = H264VideoFileServerMediaSubsession::createNew(*env, serveFileName, True);
+        if (subsession == NULL)
+        {
+            fprintf(stderr, "Can't serve \"%s\": %s\n", serveFileName, env->getResultMsg());
+            return 2;
+        }
+        ServerMediaSession* sms
+            = ServerMediaSession::createNew(*env, "load", serveFileName,
+                                            "Session streamed by \"rtspload\"");
+        sms->addSubsession(subsession);
+        rtspServer->addServerMediaSession(sms);
+        sprintf(localURL, "rtsp://127.0.0.1:%u/load", (unsigned)serverPortNum);
+        url = localURL;
+    }
+
+    // Spread the TCP sessions evenly among the UDP ones:
+    viewers = new TViewer[numSessions];
+    memset(viewers, 0, numSessions*sizeof viewers[0]);
+    for (unsigned i = 0; i < numSessions; ++i)
+    {
+        viewers[i].index = i;
+        viewers[i].useTCP = (i + 1)*tcpPercent/100 != i*tcpPercent/100;
+        viewers[i].state = VIEWER_IDLE;
+    }
+
+    printf("rtspload: %u sessions to %s\n", numSessions, url);
+    fflush(stdout);
+    gettimeofday(&startTime, NULL);
+    double rampSecs = 0.0;
+    if (sessionsPerSecond > 0.0)
+    {
+        rampSecs = numSessions/sessionsPerSecond;
+        startNextViewer(NULL);
+    }
+    else
+    {
+        for (unsigned i = 0; i < numSessions; ++i) startViewer(viewers[i]);
+    }
+    scheduler->scheduleDelayedTask((int64_t)(reportSecs*1000000), reportProgress, NULL);
+    scheduler->scheduleDelayedTask((int64_t)((rampSecs + durationSecs)*1000000),
+                                   endTest, NULL);
+
+    if (numClosed < numSessions) scheduler->doEventLoop(&stopEventLoop);
+    double testSecs = haveEndTime ? secondsSince(startTime, &endTime)
+                                  : secondsSince(startTime);
+
+    printReport(testSecs);
+
+    Medium::close(rtspServer);
+    return numFailed > 0 ? 1 : 0;
+}
@@ -8,6 +8,65 @@ extern "C"
 #include <stdio.h>
 #include <string.h> // strerror() 
 #include <stdlib.h>
+#if defined(_WIN32)
+#include <windows.h>
+#else
+#include <sys/time.h>
+#endif
+
+// The speed control ladder, fastest first. Every step keeps to what
+// x264_encoder_reconfig() can change: no more references than Initialize()
+// opened the encoder with, no exhaustive ME, and subme never 0.
+struct TPreset
+{
+    const char* szName;
+    int iMeMethod;
+    int iSubpelRefine;
+    int iFrameReference;
+    unsigned int uPartitions;
+    int iTrellis;
+    int bFastPSkip;
+};
+
+#define PARTITIONS_INTRA (X264_ANALYSE_I4x4 | X264_ANALYSE_I8x8)
+#define PARTITIONS_DEFAULT (PARTITIONS_INTRA | X264_ANALYSE_PSUB16x16 | X264_ANALYSE_BSUB16x16)
+
+static const TPreset s_presets[] =
+{
+    { "ultrafast", X264_ME_DIA, 1, 1, 0,                  0, 1 },
+    { "superfast", X264_ME_DIA, 1, 1, PARTITIONS_INTRA,   0, 1 },
+    { "veryfast",  X264_ME_HEX, 2, 1, PARTITIONS_INTRA,   0, 1 },
+    { "faster",    X264_ME_HEX, 4, 2, PARTITIONS_DEFAULT, 0, 1 },
+    { "fast",      X264_ME_HEX, 6, 2, PARTITIONS_DEFAULT, 1, 1 },
+    { "medium",    X264_ME_HEX, 7, 3, PARTITIONS_DEFAULT, 1, 1 },
+    { "slow",      X264_ME_UMH, 8, 4, PARTITIONS_DEFAULT, 2, 0 },
+};
+static const int NUM_PRESETS = sizeof(s_presets) / sizeof(s_presets[0]);
+static const int SPEED_START_PRESET = 4; // "fast"
+
+// A step to a faster preset waits this many frames after the last step (to
+// see its effect); a step to a slower one waits longer - twice as long after
+// each step down, up to SPEED_MAX_UP_HOLD - and needs room for it: the next
+// preset is taken to cost up to SPEED_STEP_COST times as much
+static const int SPEED_DOWN_HOLD = 4;
+static const int SPEED_UP_HOLD = 50;
+static const int SPEED_MAX_UP_HOLD = 800;
+static const double SPEED_STEP_COST = 1.6;
+
+static double NowMs()
+{
+#if defined(_WIN32)
+    static LARGE_INTEGER freq;
+    LARGE_INTEGER now;
+    if (freq.QuadPart == 0) QueryPerformanceFrequency(&freq);
+    QueryPerformanceCounter(&now);
+    return now.QuadPart * 1000.0 / freq.QuadPart;
+#else
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return tv.tv_sec * 1000.0 + tv.tv_usec / 1000.0;
+#endif
+}
 
 
 
@@ -51,6 +110,15 @@ H264EncWrapper::H264EncWrapper()
     m_pBuffer = NULL;
     m_iBufferSize = 0;
     m_iFrameNum = 0;
+    m_bSpeedControl = false;
+    m_iTargetPercent = 70;
+    m_iPreset = -1;
+    m_dEncodeMs = 0;
+    m_iFramesSinceStep = 0;
+    m_iUpHold = SPEED_UP_HOLD;
+    m_iStepsDown = m_iStepsUp = 0;
+    m_bLastFrameStatic = false;
+    m_bForceKeyFrame = false;
     x264_param_default(&m_param);
 }
 
@@ -79,8 +147,10 @@ int H264EncWrapper::Initialize(int iWidth, int iHeight, int iRateBit, int iFps)
         fprintf( stderr, "x264 [error]: x264_encoder_open failed\n" );
         return -1;
     }
+    m_paramApplied = m_param;
 
-    x264_picture_alloc( &m_pic, X264_CSP_I420, m_param.i_width, m_param.i_height );
+    // No buffer of its own: Encode() points m_pic at the caller's planes
+    memset( &m_pic, 0, sizeof(m_pic) );
     m_pic.i_type = X264_TYPE_AUTO;
     m_pic.i_qpplus1 = 0;
     
@@ -89,10 +159,17 @@ int H264EncWrapper::Initialize(int iWidth, int iHeight, int iRateBit, int iFps)
 
 int H264EncWrapper::Destroy()
 {
-    x264_picture_clean( &m_pic );
+    if (m_h == NULL)
+    {
+        return 0;
+    }
 
-    // TODO: clean m_h
-    //x264_encoder_close  (m_h); //?????
+    x264_encoder_close( m_h );
+    m_h = NULL;
+
+    my_free( m_pBuffer );
+    m_pBuffer = NULL;
+    m_iBufferSize = 0;
     
    return 0;
 }
@@ -100,10 +177,35 @@ int H264EncWrapper::Destroy()
 //FILE* ff1 ;
 int H264EncWrapper::Encode(unsigned char* szYUVFrame, TNAL*& pNALArray, int& iNalNum)
 {
-    // ŻΪm_picбһָ,ֱִszYUVFrame
-    memcpy(m_pic.img.plane[0], szYUVFrame, m_param.i_width * m_param.i_height*3 / 2);
+    unsigned char* pPlane[3];
+    int iStride[3];
+    pPlane[0] = szYUVFrame;
+    pPlane[1] = pPlane[0] + m_param.i_width * m_param.i_height;
+    pPlane[2] = pPlane[1] + m_param.i_width * m_param.i_height / 4;
+    iStride[0] = m_param.i_width;
+    iStride[1] = iStride[2] = m_param.i_width / 2;
+    return Encode(X264_CSP_I420, pPlane, iStride, pNALArray, iNalNum);
+}
+
+int H264EncWrapper::Encode(int iCsp, unsigned char* const pPlane[3], const int iStride[3],
+                           TNAL*& pNALArray, int& iNalNum)
+{
+    double dStartMs = NowMs();
+
+    // x264 copies the picture into a frame of its own (with the borders that
+    // motion search needs) inside x264_encoder_encode(), so the caller's planes
+    // can be used in place
+    m_pic.img.i_csp = iCsp;
+    m_pic.img.i_plane = iCsp == X264_CSP_YUYV ? 1 : iCsp == X264_CSP_NV12 ? 2 : 3;
+    for (int i = 0; i < 3; i++)
+    {
+        m_pic.img.plane[i] = i < m_pic.img.i_plane ? pPlane[i] : NULL;
+        m_pic.img.i_stride[i] = i < m_pic.img.i_plane ? iStride[i] : 0;
+    }
     
     m_pic.i_pts = (int64_t)m_iFrameNum * m_param.i_fps_den;
+    m_pic.i_type = m_bForceKeyFrame ? X264_TYPE_IDR : X264_TYPE_AUTO;
+    m_bForceKeyFrame = false;
 
     x264_picture_t pic_out;
     x264_nal_t *nal;
@@ -146,6 +248,42 @@ int H264EncWrapper::Encode(unsigned char* szYUVFrame, TNAL*& pNALArray, int& iNa
 
     iNalNum = i_nal;    
     m_iFrameNum++;
+    m_bLastFrameStatic = pic_out.b_static != 0;
+
+    // A static frame costs next to nothing, whatever the preset
+    if (m_bSpeedControl && !m_bLastFrameStatic)
+    {
+        UpdateSpeed(NowMs() - dStartMs);
+    }
+    return 0;
+}
+
+int H264EncWrapper::GetHeaders(TNAL*& pNALArray, int& iNalNum)
+{
+    if (m_h == NULL || m_iFrameNum > 0)
+    {
+        return -1;
+    }
+
+    x264_nal_t *nal;
+    int i_nal, i;
+    if (x264_encoder_headers(m_h, &nal, &i_nal) < 0)
+    {
+        fprintf( stderr, "x264 [error]: x264_encoder_headers failed\n" );
+        return -1;
+    }
+
+    pNALArray = new TNAL[i_nal];
+    for (i = 0; i < i_nal; i++)
+    {
+        // (headers are small: the payload, a start code and a little escaping)
+        int i_size = nal[i].i_payload * 2 + 4;
+        unsigned char* pData = new unsigned char[i_size];
+        x264_nal_encode(pData, &i_size, 1, &nal[i]);
+        pNALArray[i].size = i_size;
+        pNALArray[i].data = pData;
+    }
+    iNalNum = i_nal;
     return 0;
 }
 
@@ -160,3 +298,153 @@ void H264EncWrapper::CleanNAL(TNAL* pNALArray, int iNalNum)
     pNALArray = NULL;
 }
 
+int H264EncWrapper::SetBitrate(int iRateBit)
+{
+    if (m_h == NULL || iRateBit <= 0)
+    {
+        return -1;
+    }
+
+    if (m_param.rc.i_vbv_buffer_size > 0)
+    {
+        // keep the buffer the same number of seconds and the peak/average ratio
+        int iMaxRate = m_param.rc.i_vbv_max_bitrate > 0 ? m_param.rc.i_vbv_max_bitrate : m_param.rc.i_bitrate;
+        m_param.rc.i_vbv_max_bitrate = (int)((long long)iMaxRate * iRateBit / m_param.rc.i_bitrate);
+        m_param.rc.i_vbv_buffer_size = (int)((long long)m_param.rc.i_vbv_buffer_size * iRateBit / m_param.rc.i_bitrate);
+    }
+    m_param.rc.i_bitrate = iRateBit;
+
+    return Reconfig();
+}
+
+int H264EncWrapper::Reconfig()
+{
+    if (m_h == NULL)
+    {
+        return -1;
+    }
+
+    if (x264_encoder_reconfig(m_h, &m_param) < 0)
+    {
+        fprintf( stderr, "x264 [error]: x264_encoder_reconfig failed\n" );
+        m_param = m_paramApplied;
+        return -1;
+    }
+    m_paramApplied = m_param;
+    return 0;
+}
+
+int H264EncWrapper::SetStaticThreshold(float fThreshold)
+{
+    if (fThreshold < 0)
+    {
+        return -1;
+    }
+
+    m_param.analyse.f_static_thresh = fThreshold;
+    return m_h != NULL ? Reconfig() : 0;
+}
+
+int H264EncWrapper::SetMaxKeyFrameInterval(int iFrames)
+{
+    if (iFrames <= 0)
+    {
+        return -1;
+    }
+
+    m_param.i_keyint_max = iFrames;
+    return m_h != NULL ? Reconfig() : 0;
+}
+
+int H264EncWrapper::EnableSpeedControl(int iTargetPercent)
+{
+    if (iTargetPercent <= 0 || iTargetPercent > 100)
+    {
+        return -1;
+    }
+
+    m_iTargetPercent = iTargetPercent;
+    m_iUpHold = SPEED_UP_HOLD;
+    m_iStepsDown = m_iStepsUp = 0;
+    if (m_iPreset < 0 && SetPreset(SPEED_START_PRESET) < 0)
+    {
+        return -1;
+    }
+    m_bSpeedControl = true;
+    return 0;
+}
+
+int H264EncWrapper::GetNumPresets()
+{
+    return NUM_PRESETS;
+}
+
+const char* H264EncWrapper::GetPresetName(int iPreset)
+{
+    return iPreset < 0 || iPreset >= NUM_PRESETS ? "none" : s_presets[iPreset].szName;
+}
+
+int H264EncWrapper::SetPreset(int iPreset)
+{
+    if (iPreset < 0 || iPreset >= NUM_PRESETS)
+    {
+        return -1;
+    }
+
+    const TPreset& preset = s_presets[iPreset];
+    m_param.analyse.i_me_method = preset.iMeMethod;
+    m_param.analyse.i_subpel_refine = preset.iSubpelRefine;
+    m_param.i_frame_reference = preset.iFrameReference;
+    m_param.analyse.inter = preset.uPartitions;
+    m_param.analyse.intra = preset.uPartitions & PARTITIONS_INTRA;
+    m_param.analyse.i_trellis = preset.iTrellis;
+    m_param.analyse.b_fast_pskip = preset.bFastPSkip;
+    if (m_h != NULL && Reconfig() < 0)
+    {
+        return -1;
+    }
+
+    // Frames encoded with the previous preset say nothing about this one
+    m_iPreset = iPreset;
+    m_dEncodeMs = 0;
+    m_iFramesSinceStep = 0;
+    return 0;
+}
+
+void H264EncWrapper::GetSpeedState(TSpeedState& state) const
+{
+    state.bEnabled = m_bSpeedControl;
+    state.iPreset = m_iPreset;
+    state.dEncodeMs = m_dEncodeMs;
+    state.dBudgetMs = 1000.0 * m_param.i_fps_den / m_param.i_fps_num;
+    state.iStepsDown = m_iStepsDown;
+    state.iStepsUp = m_iStepsUp;
+}
+
+void H264EncWrapper::UpdateSpeed(double dEncodeMs)
+{
+    // Smoothed over about 8 frames, so that one slow frame (e.g. an IDR)
+    // doesn't cost a step
+    m_dEncodeMs = m_dEncodeMs == 0 ? dEncodeMs : m_dEncodeMs + (dEncodeMs - m_dEncodeMs) / 8;
+    m_iFramesSinceStep++;
+
+    double dTargetMs = 1000.0 * m_param.i_fps_den / m_param.i_fps_num * m_iTargetPercent / 100;
+    if (m_dEncodeMs > dTargetMs && m_iPreset > 0 && m_iFramesSinceStep >= SPEED_DOWN_HOLD)
+    {
+        // A live encoder that misses its deadlines falls behind for good: go faster at once
+        if (SetPreset(m_iPreset - 1) == 0)
+        {
+            m_iStepsDown++;
+            m_iUpHold = m_iUpHold * 2 > SPEED_MAX_UP_HOLD ? SPEED_MAX_UP_HOLD : m_iUpHold * 2;
+        }
+    }
+    else if (m_dEncodeMs * SPEED_STEP_COST < dTargetMs && m_iPreset < NUM_PRESETS - 1
+             && m_iFramesSinceStep >= m_iUpHold)
+    {
+        // There's been room for the next preset for a while: spend it on quality
+        if (SetPreset(m_iPreset + 1) == 0)
+        {
+            m_iStepsUp++;
+        }
+    }
+}
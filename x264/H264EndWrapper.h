@@ -27,19 +27,103 @@ public:
     int Initialize(int iWidth, int iHeight, int iRateBit = 96, int iFps = 25);
     // һ֡б룬NAL
     int Encode(unsigned char* szYUVFrame, TNAL*& pNALArray, int& iNalNum);
+    // ... or a frame given as planes that the caller owns, in iCsp: X264_CSP_I420
+    // (Y, U, V), X264_CSP_NV12 (Y, then U and V packed together) or X264_CSP_YUYV
+    // (one packed plane), with each plane's stride in bytes. They're handed to
+    // x264 as they are, and read (NV12 and YUYV converted to I420 on the way)
+    // before Encode() returns.
+    int Encode(int iCsp, unsigned char* const pPlane[3], const int iStride[3],
+               TNAL*& pNALArray, int& iNalNum);
     // NAL
     void H264EncWrapper::CleanNAL(TNAL* pNALArray, int iNalNum);
     // ٱ
     int Destroy();
 
+    // x264 parameters; changes made after Initialize() need a Reconfig()
+    x264_param_t& GetParam() { return m_param; }
+    // Apply the changes made to GetParam() to the running encoder from the next
+    // frame on, without reopening it: ratecontrol within the method it was opened
+    // with, VBV size, fps, keyint, B-frame decision, ME and the other analysis
+    // options (see x264_encoder_reconfig()). Call from the thread that calls Encode().
+    // Changes the encoder rejects are undone in GetParam() too, and -1 returned.
+    int Reconfig();
+
+    // Retarget the ABR bitrate (kbit/s) of the running encoder, through Reconfig().
+    // A VBV set up through GetParam() is scaled along with it.
+    int SetBitrate(int iRateBit);
+    int GetBitrate() const { return m_param.rc.i_bitrate; }
+
+    // Deadline-aware speed control: hold the (smoothed) time that Encode() takes
+    // at iTargetPercent of the frame interval (1/fps), by stepping the analysis
+    // options - ME method, subpel refinement, references, partitions, trellis and
+    // fast P-skip - up or down a ladder of presets, from "ultrafast" to "slow".
+    // Each step goes through Reconfig(), so it takes effect between frames.
+    // Starts from "fast", which is nearest to what Initialize() sets up.
+    int EnableSpeedControl(int iTargetPercent = 70);
+    void DisableSpeedControl() { m_bSpeedControl = false; }
+
+    // The ladder; 0 is the fastest preset. SetPreset() applies one directly.
+    static int GetNumPresets();
+    static const char* GetPresetName(int iPreset);
+    int SetPreset(int iPreset);
+    int GetPreset() const { return m_iPreset; } // -1 if none has been applied
+
+    struct TSpeedState
+    {
+        bool bEnabled;
+        int iPreset;
+        double dEncodeMs; // smoothed encode time per frame
+        double dBudgetMs; // the frame interval
+        int iStepsDown, iStepsUp; // to faster and to slower presets, so far
+    };
+    void GetSpeedState(TSpeedState& state) const;
+
+    // Static-scene skip, for cameras that watch a scene where nothing happens:
+    // a frame that hasn't changed since the last one coded in full - in no
+    // macroblock by more than fThreshold, the mean absolute difference per pixel
+    // of the half-resolution luma - is coded as all P_SKIP, without motion search
+    // or mode decision (analyse.f_static_thresh). It repeats the last picture in
+    // a few bytes, and keeps the frame rate and the reference frames as they are.
+    // 0 turns it off. Through Reconfig().
+    int SetStaticThreshold(float fThreshold = 3.0f);
+    bool IsLastFrameStatic() const { return m_bLastFrameStatic; }
+
+    // Code the next frame as an IDR, for a viewer that joins an encoder that's
+    // already running (x264 keeps its own GOP otherwise)
+    void ForceKeyFrame() { m_bForceKeyFrame = true; }
+    // At most iFrames frames from one IDR to the next (i_keyint_max; 250 by
+    // default), e.g. so that the segments of a HTTP Live Stream, which start at
+    // IDRs, stay within their target duration. Through Reconfig(), which rejects
+    // an interval too long for the SPS that the encoder was opened with.
+    int SetMaxKeyFrameInterval(int iFrames);
+
+    // The SEI, SPS and PPS that the stream starts with, as Encode() returns NAL
+    // units (to be freed with CleanNAL()), e.g. for an SDP description. Only
+    // before the first Encode(); after that they're repeated before each IDR.
+    int GetHeaders(TNAL*& pNALArray, int& iNalNum);
+
 private:
+    void UpdateSpeed(double dEncodeMs);
+
     x264_param_t m_param;
+    x264_param_t m_paramApplied; // what the running encoder has taken
     x264_picture_t m_pic;
     x264_t* m_h;
     
     unsigned char *m_pBuffer; //ŵNAL
     int m_iBufferSize;//NALĴС
     int m_iFrameNum;//֡
+
+    bool m_bSpeedControl;
+    int m_iTargetPercent;
+    int m_iPreset;
+    double m_dEncodeMs; // smoothed; 0 until the first frame after a step
+    int m_iFramesSinceStep;
+    int m_iUpHold; // frames; doubled by each step down, against see-sawing
+    int m_iStepsDown, m_iStepsUp;
+
+    bool m_bLastFrameStatic;
+    bool m_bForceKeyFrame;
 };
 
 #endif
@@ -128,6 +128,7 @@ void    x264_param_default( x264_param_t *param )
     param->analyse.i_chroma_qp_offset = 0;
     param->analyse.b_fast_pskip = 1;
     param->analyse.b_dct_decimate = 1;
+    param->analyse.f_static_thresh = 0;
     param->analyse.i_luma_deadzone[0] = 21;
     param->analyse.i_luma_deadzone[1] = 11;
     param->analyse.b_psnr = 1;
@@ -496,6 +497,8 @@ int x264_param_parse( x264_param_t *p, const char *name, const char *value )
         p->analyse.b_fast_pskip = atobool(value);
     OPT("dct-decimate")
         p->analyse.b_dct_decimate = atobool(value);
+    OPT("static-thresh")
+        p->analyse.f_static_thresh = atof(value);
     OPT("deadzone-inter")
         p->analyse.i_luma_deadzone[0] = atoi(value);
     OPT("deadzone-intra")
@@ -631,14 +634,36 @@ void x264_picture_alloc( x264_picture_t *pic, int i_csp, int i_width, int i_heig
 {
     pic->i_type = X264_TYPE_AUTO;
     pic->i_qpplus1 = 0;
+    pic->b_static = 0;
     pic->img.i_csp = i_csp;
-    pic->img.i_plane = 3;
-    pic->img.plane[0] = x264_malloc( 3 * i_width * i_height / 2 );
-    pic->img.plane[1] = pic->img.plane[0] + i_width * i_height;
-    pic->img.plane[2] = pic->img.plane[1] + i_width * i_height / 4;
-    pic->img.i_stride[0] = i_width;
-    pic->img.i_stride[1] = i_width / 2;
-    pic->img.i_stride[2] = i_width / 2;
+    switch( i_csp & X264_CSP_MASK )
+    {
+    case X264_CSP_NV12:
+        pic->img.i_plane = 2;
+        pic->img.plane[0] = x264_malloc( 3 * i_width * i_height / 2 );
+        pic->img.plane[1] = pic->img.plane[0] + i_width * i_height;
+        pic->img.plane[2] = NULL;
+        pic->img.i_stride[0] = i_width;
+        pic->img.i_stride[1] = i_width;
+        pic->img.i_stride[2] = 0;
+        break;
+    case X264_CSP_YUYV:
+        pic->img.i_plane = 1;
+        pic->img.plane[0] = x264_malloc( 2 * i_width * i_height );
+        pic->img.plane[1] = pic->img.plane[2] = NULL;
+        pic->img.i_stride[0] = 2 * i_width;
+        pic->img.i_stride[1] = pic->img.i_stride[2] = 0;
+        break;
+    default:
+        pic->img.i_plane = 3;
+        pic->img.plane[0] = x264_malloc( 3 * i_width * i_height / 2 );
+        pic->img.plane[1] = pic->img.plane[0] + i_width * i_height;
+        pic->img.plane[2] = pic->img.plane[1] + i_width * i_height / 4;
+        pic->img.i_stride[0] = i_width;
+        pic->img.i_stride[1] = i_width / 2;
+        pic->img.i_stride[2] = i_width / 2;
+        break;
+    }
 }
 
 /****************************************************************************
@@ -849,6 +874,8 @@ char *x264_param2string( x264_param_t *p, int b_res )
     s += sprintf( s, " threads=%d", p->i_threads );
     s += sprintf( s, " nr=%d", p->analyse.i_noise_reduction );
     s += sprintf( s, " decimate=%d", p->analyse.b_dct_decimate );
+    if( p->analyse.f_static_thresh > 0 )
+        s += sprintf( s, " static_thresh=%.1f", p->analyse.f_static_thresh );
     s += sprintf( s, " mbaff=%d", p->b_interlaced );
 
     s += sprintf( s, " bframes=%d", p->i_bframe );
@@ -261,6 +261,11 @@ struct x264_t
     int             b_thread_active;
     int             i_thread_phase; /* which thread to use for the next frame */
 
+    /* x264_encoder_reconfig() validates the new parameters on a scratch
+     * context, and leaves them there for the next frame; in thread[0] */
+    x264_t          *reconfig_h;
+    int             b_reconfig;         /* reconfig_h has parameters not applied yet */
+
     /* bitstream output */
     struct
     {
@@ -342,6 +347,9 @@ struct x264_t
         int i_delay;    /* Number of frames buffered for B reordering */
         int b_have_lowres;  /* Whether 1/2 resolution luma planes are being used */
         int b_have_sub8x8_esa;
+        /* Half-res luma of the last I/P-frame coded in full, for static-scene skip */
+        uint8_t *lowres_coded;
+        int b_lowres_coded; /* whether lowres_coded holds one */
     } frames;
 
     /* current frame being encoded */
@@ -598,6 +606,7 @@ struct x264_t
         int64_t i_slice_size[5];
         double  f_slice_qp[5];
         int     i_consecutive_bframes[X264_BFRAME_MAX+1];
+        int     i_static_frames;
         /* */
         int64_t i_ssd_global[5];
         double  f_psnr_average[5];
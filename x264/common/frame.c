@@ -186,7 +186,8 @@ int x264_frame_copy_picture( x264_t *h, x264_frame_t *dst, x264_picture_t *src )
 {
     int i_csp = src->img.i_csp & X264_CSP_MASK;
     int i;
-    if( i_csp != X264_CSP_I420 && i_csp != X264_CSP_YV12 )
+    if( i_csp != X264_CSP_I420 && i_csp != X264_CSP_YV12
+        && i_csp != X264_CSP_NV12 && i_csp != X264_CSP_YUYV )
     {
         x264_log( h, X264_LOG_ERROR, "Arg invalid CSP\n" );
         return -1;
@@ -196,7 +197,38 @@ int x264_frame_copy_picture( x264_t *h, x264_frame_t *dst, x264_picture_t *src )
     dst->i_qpplus1  = src->i_qpplus1;
     dst->i_pts      = src->i_pts;
 
-    for( i=0; i<3; i++ )
+    if( i_csp == X264_CSP_YUYV )
+    {
+        uint8_t *plane = src->img.plane[0];
+        int stride = src->img.i_stride[0];
+        if( src->img.i_csp & X264_CSP_VFLIP )
+        {
+            plane += (h->param.i_height-1)*stride;
+            stride = -stride;
+        }
+        h->mc.plane_copy_deinterleave_yuyv( dst->plane[0], dst->i_stride[0],
+                                            dst->plane[1], dst->i_stride[1],
+                                            dst->plane[2], dst->i_stride[2],
+                                            plane, stride, h->param.i_width, h->param.i_height );
+        return 0;
+    }
+
+    if( i_csp == X264_CSP_NV12 )
+    {
+        int height = h->param.i_height >> 1;
+        uint8_t *plane = src->img.plane[1];
+        int stride = src->img.i_stride[1];
+        if( src->img.i_csp & X264_CSP_VFLIP )
+        {
+            plane += (height-1)*stride;
+            stride = -stride;
+        }
+        h->mc.plane_copy_deinterleave( dst->plane[1], dst->i_stride[1],
+                                       dst->plane[2], dst->i_stride[2],
+                                       plane, stride, h->param.i_width >> 1, height );
+    }
+
+    for( i=0; i < (i_csp == X264_CSP_NV12 ? 1 : 3); i++ )
     {
         int s = (i_csp == X264_CSP_YV12 && i) ? i^3 : i;
         uint8_t *plane = src->img.plane[s];
@@ -255,6 +255,45 @@ static void plane_copy( uint8_t *dst, int i_dst,
     }
 }
 
+static void plane_copy_deinterleave( uint8_t *dstu, int i_dstu,
+                                     uint8_t *dstv, int i_dstv,
+                                     uint8_t *src, int i_src, int w, int h )
+{
+    int x, y;
+    for( y = 0; y < h; y++, dstu += i_dstu, dstv += i_dstv, src += i_src )
+        for( x = 0; x < w; x++ )
+        {
+            dstu[x] = src[2*x];
+            dstv[x] = src[2*x+1];
+        }
+}
+
+static void plane_copy_deinterleave_yuyv( uint8_t *dsty, int i_dsty,
+                                          uint8_t *dstu, int i_dstu,
+                                          uint8_t *dstv, int i_dstv,
+                                          uint8_t *src, int i_src, int w, int h )
+{
+    int x, y;
+    for( y = 0; y < h; y += 2 )
+    {
+        uint8_t *src1 = src + i_src;
+        for( x = 0; x < w; x++ )
+        {
+            dsty[x]        = src[2*x];
+            dsty[x+i_dsty] = src1[2*x];
+        }
+        for( x = 0; x < w/2; x++ )
+        {
+            dstu[x] = ( src[4*x+1] + src1[4*x+1] + 1 ) >> 1;
+            dstv[x] = ( src[4*x+3] + src1[4*x+3] + 1 ) >> 1;
+        }
+        dsty += 2*i_dsty;
+        dstu += i_dstu;
+        dstv += i_dstv;
+        src  += 2*i_src;
+    }
+}
+
 static void prefetch_fenc_null( uint8_t *pix_y, int stride_y,
                                 uint8_t *pix_uv, int stride_uv, int mb_x )
 {}
@@ -379,6 +418,8 @@ void x264_mc_init( int cpu, x264_mc_functions_t *pf )
     pf->copy[PIXEL_4x4]   = mc_copy_w4;
 
     pf->plane_copy = plane_copy;
+    pf->plane_copy_deinterleave = plane_copy_deinterleave;
+    pf->plane_copy_deinterleave_yuyv = plane_copy_deinterleave_yuyv;
     pf->hpel_filter = hpel_filter;
 
     pf->prefetch_fenc = prefetch_fenc_null;
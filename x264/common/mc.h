@@ -53,6 +53,16 @@ typedef struct
 
     void (*plane_copy)( uint8_t *dst, int i_dst,
                         uint8_t *src, int i_src, int w, int h);
+    /* split the packed u+v plane of NV12 input; w is the width of u and v */
+    void (*plane_copy_deinterleave)( uint8_t *dstu, int i_dstu,
+                                     uint8_t *dstv, int i_dstv,
+                                     uint8_t *src, int i_src, int w, int h );
+    /* split YUYV (4:2:2) input into y, u and v planes of 4:2:0, each pair of
+     * rows of u and v averaged; w and h are those of the luma */
+    void (*plane_copy_deinterleave_yuyv)( uint8_t *dsty, int i_dsty,
+                                          uint8_t *dstu, int i_dstu,
+                                          uint8_t *dstv, int i_dstv,
+                                          uint8_t *src, int i_src, int w, int h );
 
     void (*hpel_filter)( uint8_t *dsth, uint8_t *dstv, uint8_t *dstc, uint8_t *src,
                          int i_stride, int i_width, int i_height, int16_t *buf );
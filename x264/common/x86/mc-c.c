@@ -26,6 +26,8 @@
 #include <stdio.h>
 #include <string.h>
 
+#include <emmintrin.h>
+
 #include "common/common.h"
 #include "mc.h"
 
@@ -234,6 +236,77 @@ HPEL(16, ssse3, sse2, ssse3, ssse3)
 #endif
 HPEL(16, sse2_misalign, sse2, sse2_misalign, sse2)
 
+/* Deinterleaving of NV12 and YUYV input, 16 pixels of each output plane at a
+ * time; the rest of each row as in mc.c */
+static void x264_plane_copy_deinterleave_sse2( uint8_t *dstu, int i_dstu,
+                                               uint8_t *dstv, int i_dstv,
+                                               uint8_t *src, int i_src, int w, int h )
+{
+    const __m128i mask = _mm_set1_epi16( 0x00ff );
+    int x, y;
+    for( y = 0; y < h; y++, dstu += i_dstu, dstv += i_dstv, src += i_src )
+    {
+        for( x = 0; x + 16 <= w; x += 16 )
+        {
+            __m128i a = _mm_loadu_si128( (__m128i*)(src + 2*x) );
+            __m128i b = _mm_loadu_si128( (__m128i*)(src + 2*x + 16) );
+            _mm_storeu_si128( (__m128i*)(dstu + x),
+                              _mm_packus_epi16( _mm_and_si128( a, mask ), _mm_and_si128( b, mask ) ) );
+            _mm_storeu_si128( (__m128i*)(dstv + x),
+                              _mm_packus_epi16( _mm_srli_epi16( a, 8 ), _mm_srli_epi16( b, 8 ) ) );
+        }
+        for( ; x < w; x++ )
+        {
+            dstu[x] = src[2*x];
+            dstv[x] = src[2*x+1];
+        }
+    }
+}
+
+static void x264_plane_copy_deinterleave_yuyv_sse2( uint8_t *dsty, int i_dsty,
+                                                    uint8_t *dstu, int i_dstu,
+                                                    uint8_t *dstv, int i_dstv,
+                                                    uint8_t *src, int i_src, int w, int h )
+{
+    const __m128i mask = _mm_set1_epi16( 0x00ff );
+    int x, y;
+    for( y = 0; y < h; y += 2 )
+    {
+        uint8_t *src1 = src + i_src;
+        for( x = 0; x + 16 <= w; x += 16 )
+        {
+            __m128i a0 = _mm_loadu_si128( (__m128i*)(src + 2*x) );
+            __m128i b0 = _mm_loadu_si128( (__m128i*)(src + 2*x + 16) );
+            __m128i a1 = _mm_loadu_si128( (__m128i*)(src1 + 2*x) );
+            __m128i b1 = _mm_loadu_si128( (__m128i*)(src1 + 2*x + 16) );
+            __m128i uv;
+            _mm_storeu_si128( (__m128i*)(dsty + x),
+                              _mm_packus_epi16( _mm_and_si128( a0, mask ), _mm_and_si128( b0, mask ) ) );
+            _mm_storeu_si128( (__m128i*)(dsty + x + i_dsty),
+                              _mm_packus_epi16( _mm_and_si128( a1, mask ), _mm_and_si128( b1, mask ) ) );
+            /* u and v of both rows, averaged: u0 v0 u1 v1 ... */
+            uv = _mm_avg_epu8( _mm_packus_epi16( _mm_srli_epi16( a0, 8 ), _mm_srli_epi16( b0, 8 ) ),
+                               _mm_packus_epi16( _mm_srli_epi16( a1, 8 ), _mm_srli_epi16( b1, 8 ) ) );
+            uv = _mm_packus_epi16( _mm_and_si128( uv, mask ), _mm_srli_epi16( uv, 8 ) );
+            _mm_storel_epi64( (__m128i*)(dstu + x/2), uv );
+            _mm_storel_epi64( (__m128i*)(dstv + x/2), _mm_srli_si128( uv, 8 ) );
+        }
+        for( ; x < w; x += 2 )
+        {
+            dsty[x]          = src[2*x];
+            dsty[x+1]        = src[2*x+2];
+            dsty[x+i_dsty]   = src1[2*x];
+            dsty[x+1+i_dsty] = src1[2*x+2];
+            dstu[x/2] = ( src[2*x+1] + src1[2*x+1] + 1 ) >> 1;
+            dstv[x/2] = ( src[2*x+3] + src1[2*x+3] + 1 ) >> 1;
+        }
+        dsty += 2*i_dsty;
+        dstu += i_dstu;
+        dstv += i_dstv;
+        src  += 2*i_src;
+    }
+}
+
 void x264_mc_init_mmx( int cpu, x264_mc_functions_t *pf )
 {
     if( !(cpu&X264_CPU_MMX) )
@@ -294,6 +367,8 @@ void x264_mc_init_mmx( int cpu, x264_mc_functions_t *pf )
     pf->integral_init4v = x264_integral_init4v_sse2;
     pf->integral_init8v = x264_integral_init8v_sse2;
     pf->hpel_filter = x264_hpel_filter_sse2_amd;
+    pf->plane_copy_deinterleave = x264_plane_copy_deinterleave_sse2;
+    pf->plane_copy_deinterleave_yuyv = x264_plane_copy_deinterleave_yuyv_sse2;
 
     if( cpu&X264_CPU_SSE2_IS_SLOW )
         return;
@@ -176,47 +176,66 @@ static void x264_analyse_update_cache( x264_t *h, x264_mb_analysis_t *a );
 
 uint16_t *x264_cost_mv_fpel[52][4];
 uint16_t x264_cost_ref[52][3][33];
-int16_t *g_cost_mv[52] = { 0 };
-uint16_t *g_x264_cost_mv_fpel[52][4] = { 0 };
-/* initialize an array of lambda*nbits for all possible mvs */
-static void x264_mb_analyse_load_costs( x264_t *h, x264_mb_analysis_t *a )
+static int16_t *p_cost_mv[52];
+
+/* The mv cost tables depend on nothing but the qp, so they're shared by all
+ * the encoders in the process, and kept for its lifetime. */
+static void x264_mb_analyse_build_costs( int i_qp, int b_fpel )
 {
-	static int16_t *p_cost_mv[52] = { 0 };
-	int i, j;
+    int i_lambda = x264_lambda_tab[i_qp];
+    int i, j;
 
-    if( !p_cost_mv[a->i_qp] )
+    if( !p_cost_mv[i_qp] )
     {
         x264_emms();
         /* could be faster, but isn't called many times */
         /* factor of 4 from qpel, 2 from sign, and 2 because mv can be opposite from mvp */
-        g_cost_mv[a->i_qp] = p_cost_mv[a->i_qp] = x264_malloc( (4*4*2048 + 1) * sizeof(int16_t) );
-        p_cost_mv[a->i_qp] += 2*4*2048;
+        p_cost_mv[i_qp] = x264_malloc( (4*4*2048 + 1) * sizeof(int16_t) );
+        p_cost_mv[i_qp] += 2*4*2048;
         for( i = 0; i <= 2*4*2048; i++ )
         {
-            p_cost_mv[a->i_qp][-i] =
-            p_cost_mv[a->i_qp][i]  = a->i_lambda * (log2f(i+1)*2 + 0.718f + !!i) + .5f;
+            p_cost_mv[i_qp][-i] =
+            p_cost_mv[i_qp][i]  = i_lambda * (log2f(i+1)*2 + 0.718f + !!i) + .5f;
         }
         for( i = 0; i < 3; i++ )
             for( j = 0; j < 33; j++ )
-                x264_cost_ref[a->i_qp][i][j] = a->i_lambda * bs_size_te( i, j );
+                x264_cost_ref[i_qp][i][j] = i_lambda * bs_size_te( i, j );
     }
-    a->p_cost_mv = p_cost_mv[a->i_qp];
-    a->p_cost_ref0 = x264_cost_ref[a->i_qp][x264_clip3(h->sh.i_num_ref_idx_l0_active-1,0,2)];
-    a->p_cost_ref1 = x264_cost_ref[a->i_qp][x264_clip3(h->sh.i_num_ref_idx_l1_active-1,0,2)];
 
     /* FIXME is this useful for all me methods? */
-    if( h->param.analyse.i_me_method >= X264_ME_ESA && !x264_cost_mv_fpel[a->i_qp][0] )
+    if( b_fpel && !x264_cost_mv_fpel[i_qp][0] )
     {
         for( j=0; j<4; j++ )
         {
-            g_x264_cost_mv_fpel[a->i_qp][j] = x264_cost_mv_fpel[a->i_qp][j] = x264_malloc( (4*2048 + 1) * sizeof(int16_t) );
-            x264_cost_mv_fpel[a->i_qp][j] += 2*2048;
+            x264_cost_mv_fpel[i_qp][j] = x264_malloc( (4*2048 + 1) * sizeof(int16_t) );
+            x264_cost_mv_fpel[i_qp][j] += 2*2048;
             for( i = -2*2048; i < 2*2048; i++ )
-                x264_cost_mv_fpel[a->i_qp][j][i] = p_cost_mv[a->i_qp][i*4+j];
+                x264_cost_mv_fpel[i_qp][j][i] = p_cost_mv[i_qp][i*4+j];
         }
     }
 }
 
+/* Build the tables for every qp when an encoder is opened, rather than each
+ * as it's first needed, so that encoders running on other threads only ever
+ * read them. */
+void x264_analyse_init_costs( x264_t *h )
+{
+    int i_qp;
+    for( i_qp = 0; i_qp < 52; i_qp++ )
+        x264_mb_analyse_build_costs( i_qp, h->param.analyse.i_me_method >= X264_ME_ESA );
+}
+
+/* initialize an array of lambda*nbits for all possible mvs */
+static void x264_mb_analyse_load_costs( x264_t *h, x264_mb_analysis_t *a )
+{
+    /* (a reconfig may have switched to an exhaustive search since the open) */
+    x264_mb_analyse_build_costs( a->i_qp, h->param.analyse.i_me_method >= X264_ME_ESA );
+
+    a->p_cost_mv = p_cost_mv[a->i_qp];
+    a->p_cost_ref0 = x264_cost_ref[a->i_qp][x264_clip3(h->sh.i_num_ref_idx_l0_active-1,0,2)];
+    a->p_cost_ref1 = x264_cost_ref[a->i_qp][x264_clip3(h->sh.i_num_ref_idx_l1_active-1,0,2)];
+}
+
 static void x264_mb_analyse_init( x264_t *h, x264_mb_analysis_t *a, int i_qp )
 {
     int i = h->param.analyse.i_subpel_refine - (h->sh.i_type == SLICE_TYPE_B);
@@ -2191,9 +2210,12 @@ void x264_macroblock_analyse( x264_t *h )
 
         h->mc.prefetch_ref( h->mb.pic.p_fref[0][0][h->mb.i_mb_x&3], h->mb.pic.i_stride[0], 0 );
 
-        /* Fast P_SKIP detection */
+        /* Fast P_SKIP detection; all of an unchanged picture is P_SKIP
+         * (see x264_slicetype_static()) */
         analysis.b_try_pskip = 0;
-        if( h->param.analyse.b_fast_pskip )
+        if( h->fenc->b_static )
+            b_skip = 1;
+        else if( h->param.analyse.b_fast_pskip )
         {
             if( h->param.i_threads > 1 && h->mb.cache.pskip_mv[1] > h->mb.mv_max_spel[1] )
                 // FIXME don't need to check this if the reference frame is done
@@ -24,7 +24,10 @@
 #ifndef X264_ANALYSE_H
 #define X264_ANALYSE_H
 
+void x264_analyse_init_costs( x264_t *h );
 void x264_macroblock_analyse( x264_t *h );
 void x264_slicetype_decide( x264_t *h );
+int  x264_slicetype_static( x264_t *h );
+void x264_slicetype_static_update( x264_t *h );
 
 #endif
@@ -36,9 +36,6 @@
 #include "common/visualize.h"
 #endif
 
-extern uint16_t *g_x264_cost_mv_fpel[52][4];
-extern int16_t *g_cost_mv[52];
-
 //#define DEBUG_MB_TYPE
 
 #define NALU_OVERHEAD 5 // startcode + NAL type costs 5 bytes per frame
@@ -524,6 +521,7 @@ static int x264_validate_parameters( x264_t *h )
     if( h->param.rc.f_aq_strength == 0 )
         h->param.rc.i_aq_mode = 0;
     h->param.analyse.i_noise_reduction = x264_clip3( h->param.analyse.i_noise_reduction, 0, 1<<16 );
+    h->param.analyse.f_static_thresh = x264_clip3f( h->param.analyse.f_static_thresh, 0, 255 );
 
     {
         const x264_level_t *l = x264_levels;
@@ -714,6 +712,10 @@ x264_t *x264_encoder_open   ( x264_param_t *param )
           || h->param.i_bframe_adaptive
           || h->param.b_pre_scenecut );
     h->frames.b_have_lowres |= (h->param.rc.b_stat_read && h->param.rc.i_vbv_buffer_size > 0);
+    h->frames.b_have_lowres |= h->param.analyse.f_static_thresh > 0;
+    if( h->frames.b_have_lowres )
+        h->frames.lowres_coded = x264_malloc( h->mb.i_mb_count * 8*8 );
+    h->frames.b_lowres_coded = 0;
     h->frames.b_have_sub8x8_esa = !!(h->param.analyse.inter & X264_ANALYSE_PSUB8x8);
 
     h->frames.i_last_idr = - h->param.i_keyint_max;
@@ -726,6 +728,7 @@ x264_t *x264_encoder_open   ( x264_param_t *param )
     h->chroma_qp_table = i_chroma_qp_table + 12 + h->pps->i_chroma_qp_index_offset;
 
     x264_rdo_init( );
+    x264_analyse_init_costs( h );
 
     /* init CPU functions */
     x264_predict_16x16_init( h->param.cpu, h->predict_16x16 );
@@ -787,6 +790,12 @@ x264_t *x264_encoder_open   ( x264_param_t *param )
     if( x264_ratecontrol_new( h ) < 0 )
         return NULL;
 
+    /* x264_encoder_reconfig() validates on a copy, which shares the SPS,
+     * PPS and frame setup with the encoding contexts */
+    h->reconfig_h = x264_malloc( sizeof(x264_t) );
+    *h->reconfig_h = *h;
+    h->b_reconfig = 0;
+
     if( h->param.psz_dump_yuv )
     {
         /* create or truncate the reconstructed video file */
@@ -811,9 +820,10 @@ x264_t *x264_encoder_open   ( x264_param_t *param )
 }
 
 /****************************************************************************
- * x264_encoder_reconfig:
+ * x264_encoder_copy_zone: merge into h->param the options that can change
+ * between any two frames
  ****************************************************************************/
-int x264_encoder_reconfig( x264_t *h, x264_param_t *param )
+static void x264_encoder_copy_zone( x264_t *h, x264_param_t *param )
 {
 #define COPY(var) h->param.var = param->var
     COPY( i_frame_reference ); // but never uses more refs than initially specified
@@ -838,6 +848,9 @@ int x264_encoder_reconfig( x264_t *h, x264_param_t *param )
     COPY( analyse.b_dct_decimate );
     COPY( analyse.b_fast_pskip );
     COPY( analyse.b_mixed_references );
+    /* static-scene skip compares half-res planes */
+    if( h->frames.b_have_lowres )
+        COPY( analyse.f_static_thresh );
     COPY( analyse.f_psy_rd );
     COPY( analyse.f_psy_trellis );
     // can only twiddle these if they were enabled to begin with:
@@ -850,12 +863,184 @@ int x264_encoder_reconfig( x264_t *h, x264_param_t *param )
     if( h->frames.i_max_ref1 > 1 )
         COPY( b_bframe_pyramid );
 #undef COPY
+}
+
+/****************************************************************************
+ * x264_encoder_reconfig_zone: options that can change between any two frames,
+ * applied to h at once. Zones switch with this.
+ ****************************************************************************/
+int x264_encoder_reconfig_zone( x264_t *h, x264_param_t *param )
+{
+    x264_encoder_copy_zone( h, param );
 
     mbcmp_init( h );
 
     return x264_validate_parameters( h );
 }
 
+/****************************************************************************
+ * x264_encoder_copy_reconfig: merge into h->param what x264_encoder_reconfig()
+ * takes from param. Returns -1 if param asks for a change that the stream
+ * can't make, else whether the ratecontrol has to be retargeted.
+ ****************************************************************************/
+static int x264_encoder_copy_reconfig( x264_t *h, x264_param_t *param )
+{
+    int b_rc = 0;
+#define COPY(var) h->param.var = param->var
+#define COPY_RC(var) if( h->param.var != param->var ) { COPY( var ); b_rc = 1; }
+    /* frame type decisions. frame_num and poc_lsb in the SPS are sized for
+     * the initial keyint, and an intra-only stream keeps no references */
+    if( param->i_keyint_max != h->param.i_keyint_max
+        && ( param->i_keyint_max >= 1 << (h->sps->i_log2_max_frame_num - 1)
+             || (param->i_keyint_max > 1) != (h->param.i_keyint_max > 1) ) )
+    {
+        x264_log( h, X264_LOG_ERROR, "keyint can't change from %d to %d while encoding\n",
+                  h->param.i_keyint_max, param->i_keyint_max );
+        return -1;
+    }
+    COPY( i_keyint_max );
+    COPY( i_keyint_min );
+    /* trellis needs a longer delay, and adaptive B-frames the lowres planes */
+    if( h->param.i_bframe && param->i_bframe_adaptive != h->param.i_bframe_adaptive
+        && ( !h->frames.b_have_lowres
+             || param->i_bframe_adaptive == X264_B_ADAPT_TRELLIS
+             || h->param.i_bframe_adaptive == X264_B_ADAPT_TRELLIS ) )
+    {
+        x264_log( h, X264_LOG_ERROR, "b-adapt can't change from %d to %d while encoding\n",
+                  h->param.i_bframe_adaptive, param->i_bframe_adaptive );
+        return -1;
+    }
+    COPY( i_bframe_adaptive );
+
+    /* ratecontrol, within the mode the encoder was opened with */
+    if( h->param.rc.i_rc_method == X264_RC_ABR && !h->param.rc.b_stat_read )
+    {
+        if( param->rc.i_bitrate <= 0 )
+        {
+            x264_log( h, X264_LOG_ERROR, "invalid bitrate: %d\n", param->rc.i_bitrate );
+            return -1;
+        }
+        COPY_RC( rc.i_bitrate );
+    }
+    if( h->param.rc.i_vbv_buffer_size )
+    {
+        if( param->rc.i_vbv_buffer_size <= 0 )
+        {
+            x264_log( h, X264_LOG_ERROR, "VBV can't be turned off while encoding\n" );
+            return -1;
+        }
+        COPY_RC( rc.i_vbv_max_bitrate );
+        COPY_RC( rc.i_vbv_buffer_size );
+    }
+    if( h->param.rc.i_rc_method == X264_RC_CRF )
+        COPY_RC( rc.f_rf_constant );
+    if( h->param.rc.i_rc_method == X264_RC_CQP )
+        COPY_RC( rc.i_qp_constant );
+    if( param->i_fps_num <= 0 || param->i_fps_den <= 0 )
+    {
+        x264_log( h, X264_LOG_ERROR, "invalid fps: %d/%d\n", param->i_fps_num, param->i_fps_den );
+        return -1;
+    }
+    if( !h->param.rc.b_stat_read
+        && (int64_t)param->i_fps_num * h->param.i_fps_den != (int64_t)h->param.i_fps_num * param->i_fps_den )
+    {
+        COPY( i_fps_num );
+        COPY( i_fps_den );
+        x264_reduce_fraction( &h->param.i_fps_num, &h->param.i_fps_den );
+        b_rc = 1;
+    }
+#undef COPY_RC
+#undef COPY
+
+    x264_encoder_copy_zone( h, param );
+
+    return b_rc;
+}
+
+/****************************************************************************
+ * x264_encoder_reconfig_apply: bring h, the context about to start a frame,
+ * in line with the parameters x264_encoder_reconfig() has accepted. The
+ * contexts that start the frames after it take them from it.
+ ****************************************************************************/
+static int x264_encoder_reconfig_apply( x264_t *h )
+{
+    x264_t *r = h->thread[0]->reconfig_h;
+    x264_param_t param = r->param;
+    int b_rc;
+
+    /* They're merged into h's own parameters, and validated, on the scratch
+     * context once more: h takes the result only if it's all valid, so a
+     * rejected change leaves it encoding as before */
+    r->param = h->param;
+    r->mb.b_lossless = 0;
+    b_rc = x264_encoder_copy_reconfig( r, &param );
+    if( b_rc >= 0 && x264_validate_parameters( r ) < 0 )
+        b_rc = -1;
+    if( b_rc >= 0 && r->mb.b_lossless != h->mb.b_lossless )
+    {
+        x264_log( h, X264_LOG_ERROR, "lossless can't be turned on or off while encoding\n" );
+        b_rc = -1;
+    }
+    if( b_rc < 0 )
+    {
+        r->param = h->param;
+        return -1;
+    }
+
+    h->param = r->param;
+    h->mb.b_direct_auto_write = r->mb.b_direct_auto_write;
+    h->mb.i_psy_rd = r->mb.i_psy_rd;
+    h->mb.i_psy_trellis = r->mb.i_psy_trellis;
+    if( b_rc > 0 )
+        x264_ratecontrol_reconfig( h );
+
+    /* goes out with the next IDR */
+    if( h->sps->vui.b_timing_info_present )
+    {
+        h->sps->vui.i_num_units_in_tick = h->param.i_fps_den;
+        h->sps->vui.i_time_scale = h->param.i_fps_num * 2;
+    }
+
+    mbcmp_init( h );
+
+    return 0;
+}
+
+/****************************************************************************
+ * x264_encoder_reconfig:
+ ****************************************************************************/
+int x264_encoder_reconfig( x264_t *h, x264_param_t *param )
+{
+    /* the context that started the last frame has the parameters in use */
+    x264_t *last = h->thread[ h->i_thread_phase % h->param.i_threads ];
+    x264_t *r = h->reconfig_h;
+    x264_param_t param_save = r->param;
+    int ret;
+
+    /* The encoding contexts may be busy with earlier frames: the change is
+     * tried out on a scratch context, on top of one that hasn't been applied
+     * yet, and the next frame to start takes it from there */
+    if( !h->b_reconfig )
+        r->param = last->param;
+    r->mb.b_lossless = 0;
+    ret = x264_encoder_copy_reconfig( r, param );
+    if( ret >= 0 )
+        ret = x264_validate_parameters( r );
+    if( ret >= 0 && r->mb.b_lossless != h->mb.b_lossless )
+    {
+        x264_log( h, X264_LOG_ERROR, "lossless can't be turned on or off while encoding\n" );
+        ret = -1;
+    }
+    if( ret < 0 )
+    {
+        r->param = param_save;
+        return -1;
+    }
+
+    h->b_reconfig = 1;
+    return 0;
+}
+
 /* internal usage */
 static void x264_nal_start( x264_t *h, int i_type, int i_ref_idc )
 {
@@ -1307,6 +1492,11 @@ static void x264_thread_sync_context( x264_t *dst, x264_t *src )
     // copy everything except the per-thread pointers and the constants.
     memcpy( &dst->i_frame, &src->i_frame, offsetof(x264_t, mb.type) - offsetof(x264_t, i_frame) );
     dst->stat = src->stat;
+
+    // x264_encoder_reconfig() and zones change the parameters as the source starts a frame
+    dst->param = src->param;
+    dst->mb.b_direct_auto_write = src->mb.b_direct_auto_write;
+    mbcmp_init( dst );
 }
 
 static void x264_thread_sync_stat( x264_t *dst, x264_t *src )
@@ -1391,6 +1581,13 @@ int     x264_encoder_encode( x264_t *h,
         thread_oldest  = h;
     }
 
+    if( h->thread[0]->b_reconfig )
+    {
+        h->thread[0]->b_reconfig = 0;
+        if( x264_encoder_reconfig_apply( h ) < 0 )
+            return -1;
+    }
+
     // ok to call this before encoding any frames, since the initial values of fdec have b_kept_as_ref=0
     x264_reference_update( h );
     h->fdec->i_lines_completed = -1;
@@ -1524,6 +1721,12 @@ do_encode:
     h->fenc->b_kept_as_ref =
     h->fdec->b_kept_as_ref = i_nal_ref_idc != NAL_PRIORITY_DISPOSABLE && h->param.i_keyint_max > 1;
 
+    /* static-scene skip: a P-frame that shows the same picture as its
+     * reference is coded as all P_SKIP, with no ME or mode decision */
+    h->fenc->b_static = h->sh.i_type == SLICE_TYPE_P && x264_slicetype_static( h );
+    if( !h->fenc->b_static && h->sh.i_type != SLICE_TYPE_B && h->frames.b_have_lowres )
+        x264_slicetype_static_update( h );
+
 
 
     /* ------------------- Init                ----------------------------- */
@@ -1750,6 +1953,7 @@ static void x264_encoder_frame_end( x264_t *h, x264_t *thread_current,
     else
         pic_out->i_type = X264_TYPE_B;
     pic_out->i_pts = h->fenc->i_pts;
+    pic_out->b_static = h->fenc->b_static;
 
     pic_out->img.i_plane = h->fdec->i_plane;
     for(i = 0; i < 3; i++)
@@ -1789,6 +1993,8 @@ static void x264_encoder_frame_end( x264_t *h, x264_t *thread_current,
                 h->stat.i_mb_count_ref[h->sh.i_type][i_list][i] += h->stat.frame.i_mb_count_ref[i_list][i];
     if( h->sh.i_type == SLICE_TYPE_P )
         h->stat.i_consecutive_bframes[h->fdec->i_frame - h->fref0[0]->i_frame - 1]++;
+    if( h->fenc->b_static )
+        h->stat.i_static_frames++;
     if( h->sh.i_type == SLICE_TYPE_B )
     {
         h->stat.i_direct_frames[ h->sh.b_direct_spatial_mv_pred ] ++;
@@ -1955,6 +2161,9 @@ void    x264_encoder_close  ( x264_t *h )
             p += sprintf( p, " %4.1f%%", 100. * (i+1) * h->stat.i_consecutive_bframes[i] / den );
         x264_log( h, X264_LOG_INFO, "consecutive B-frames:%s\n", buf );
     }
+    if( h->stat.i_static_frames > 0 )
+        x264_log( h, X264_LOG_INFO, "static P-frames: %d (%.1f%%)\n", h->stat.i_static_frames,
+                  100. * h->stat.i_static_frames / h->stat.i_slice_count[SLICE_TYPE_P] );
 
     for( i_type = 0; i_type < 2; i_type++ )
         for( i = 0; i < X264_PARTTYPE_MAX; i++ )
@@ -2127,6 +2336,9 @@ void    x264_encoder_close  ( x264_t *h )
 
     h = h->thread[0];
 
+    x264_free( h->frames.lowres_coded );
+    x264_free( h->reconfig_h );
+
     for( i = h->param.i_threads - 1; i >= 0; i-- )
     {
         x264_frame_t **frame;
@@ -2148,14 +2360,4 @@ void    x264_encoder_close  ( x264_t *h )
         x264_free( h->thread[i]->out.p_bitstream );
         x264_free( h->thread[i] );
     }
-	//////////////////////////////////////////////////////////////////////////
-	for( i=0; i<52; i++ ) {
-		if (g_cost_mv[i]) {
-			for ( j=0; j<4; j++) {
-				if (g_x264_cost_mv_fpel[i][j])
-					x264_free(g_x264_cost_mv_fpel[i][j]);
-			}
-			x264_free(g_cost_mv[i]);
-		}		
-	}
 }
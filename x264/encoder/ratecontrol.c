@@ -95,6 +95,8 @@ struct x264_ratecontrol_t
     double cplxr_sum;           /* sum of bits*qscale/rceq */
     double expected_bits_sum;   /* sum of qscale2bits after rceq, ratefactor, and overflow, only includes finished frames */
     double wanted_bits_window;  /* target bitrate * window */
+    double window_rate;         /* bits per frame wanted_bits_window is counted in */
+    double wanted_bits_offset;  /* target bits of the frames done before the last bitrate change, minus what the current bitrate would give them */
     double cbr_decay;
     double short_term_cplxsum;
     double short_term_cplxcount;
@@ -354,6 +356,7 @@ int x264_ratecontrol_new( x264_t *h )
         /* estimated ratio that produces a reasonable QP for the first I-frame */
         rc->cplxr_sum = .01 * pow( 7.0e5, h->param.rc.f_qcompress ) * pow( h->mb.i_mb_count, 0.5 );
         rc->wanted_bits_window = 1.0 * rc->bitrate / rc->fps;
+        rc->window_rate = rc->bitrate / rc->fps;
         rc->last_non_b_pict_type = SLICE_TYPE_I;
     }
 
@@ -598,6 +601,85 @@ int x264_ratecontrol_new( x264_t *h )
     return 0;
 }
 
+/* Bring the ratecontrol of h, the context about to start a frame, in line
+ * with h->param: the bitrate and VBV size, the rate factor or QP, and the
+ * frame rate.  The contexts that start the following frames take the new
+ * values from it in x264_thread_sync_ratecontrol().  VBV can only be
+ * resized, not switched on or off.  Frames already done stay accounted at
+ * the old rate, so the overflow compensation doesn't try to pay the
+ * difference back over the rest of the stream. */
+void x264_ratecontrol_reconfig( x264_t *h )
+{
+    x264_ratecontrol_t *rc = h->rc;
+    double fps, bitrate;
+    int i_frame_done = X264_MAX( 0, h->frames.i_input - h->frames.i_delay );
+
+    x264_emms();
+
+    if(h->param.i_fps_num > 0 && h->param.i_fps_den > 0)
+        fps = (float) h->param.i_fps_num / h->param.i_fps_den;
+    else
+        fps = 25.0;
+
+    if( rc->b_vbv )
+    {
+        if( h->param.rc.i_vbv_max_bitrate < h->param.rc.i_bitrate )
+            h->param.rc.i_vbv_max_bitrate = h->param.rc.i_bitrate;
+        if( h->param.rc.i_vbv_buffer_size < 3 * h->param.rc.i_vbv_max_bitrate / fps )
+            h->param.rc.i_vbv_buffer_size = 3 * h->param.rc.i_vbv_max_bitrate / fps;
+    }
+    else
+    {
+        h->param.rc.i_vbv_max_bitrate = 0;
+        h->param.rc.i_vbv_buffer_size = 0;
+    }
+    bitrate = h->param.rc.i_bitrate * 1000.;
+
+    /* wanted_bits_window moves on with the frames as they end, it is
+     * rescaled to the new rate in rebase_window() */
+    if( rc->b_abr && h->param.rc.i_rc_method == X264_RC_ABR )
+        rc->wanted_bits_offset += i_frame_done * (rc->bitrate / rc->fps - bitrate / fps);
+    rc->bitrate = bitrate;
+    rc->fps = fps;
+
+    if( h->param.rc.i_rc_method == X264_RC_CRF )
+    {
+        double base_cplx = h->mb.i_mb_count * (h->param.i_bframe ? 120 : 80);
+        rc->rate_factor_constant = pow( base_cplx, 1 - h->param.rc.f_qcompress )
+                                 / qp2qscale( h->param.rc.f_rf_constant );
+    }
+    rc->qp_constant[SLICE_TYPE_P] = h->param.rc.i_qp_constant;
+    rc->qp_constant[SLICE_TYPE_I] = x264_clip3( h->param.rc.i_qp_constant - rc->ip_offset + 0.5, 0, 51 );
+    rc->qp_constant[SLICE_TYPE_B] = x264_clip3( h->param.rc.i_qp_constant + rc->pb_offset + 0.5, 0, 51 );
+
+    if( rc->b_vbv )
+    {
+        /* the buffer as of the last finished frame is kept in thread[0] for
+         * all of them, and only touched between frames */
+        x264_ratecontrol_t *rct = h->thread[0]->rc;
+        rct->buffer_fill_final *= h->param.rc.i_vbv_buffer_size * 1000. / rc->buffer_size;
+        rc->buffer_rate = h->param.rc.i_vbv_max_bitrate * 1000. / rc->fps;
+        rc->buffer_size = h->param.rc.i_vbv_buffer_size * 1000.;
+        rc->cbr_decay = 1.0 - rc->buffer_rate / rc->buffer_size
+                      * 0.5 * X264_MAX(0, 1.5 - rc->buffer_rate * rc->fps / rc->bitrate);
+        rc->b_vbv_min_rate = !rc->b_2pass
+                          && h->param.rc.i_rc_method == X264_RC_ABR
+                          && h->param.rc.i_vbv_max_bitrate <= h->param.rc.i_bitrate;
+    }
+}
+
+/* wanted_bits_window comes from the frames that ended last, which may have
+ * started before a x264_ratecontrol_reconfig(): count it at this frame's rate */
+static void rebase_window( x264_ratecontrol_t *rc )
+{
+    double rate = rc->bitrate / rc->fps;
+    if( rc->window_rate != rate )
+    {
+        rc->wanted_bits_window *= rate / rc->window_rate;
+        rc->window_rate = rate;
+    }
+}
+
 static int parse_zone( x264_t *h, x264_zone_t *z, char *p )
 {
     int len = 0;
@@ -796,7 +878,7 @@ void x264_ratecontrol_start( x264_t *h, int i_force_qp )
     x264_emms();
 
     if( zone && (!rc->prev_zone || zone->param != rc->prev_zone->param) )
-        x264_encoder_reconfig( h, zone->param );
+        x264_encoder_reconfig_zone( h, zone->param );
     rc->prev_zone = zone;
 
     rc->qp_force = i_force_qp;
@@ -1126,6 +1208,7 @@ void x264_ratecontrol_end( x264_t *h, int bits )
             rc->cplxr_sum += bits * qp2qscale(rc->qpa_rc) / (rc->last_rceq * fabs(h->param.rc.f_pb_factor));
         }
         rc->cplxr_sum *= rc->cbr_decay;
+        rebase_window( rc );
         rc->wanted_bits_window += rc->bitrate / rc->fps;
         rc->wanted_bits_window *= rc->cbr_decay;
 
@@ -1289,10 +1372,11 @@ static void update_vbv( x264_t *h, int bits )
     if( !rcc->b_vbv )
         return;
 
-    rct->buffer_fill_final += rct->buffer_rate - bits;
+    /* at the rate the frame was started with */
+    rct->buffer_fill_final += rcc->buffer_rate - bits;
     if( rct->buffer_fill_final < 0 )
         x264_log( h, X264_LOG_WARNING, "VBV underflow (%.0f bits)\n", rct->buffer_fill_final );
-    rct->buffer_fill_final = x264_clip3f( rct->buffer_fill_final, 0, rct->buffer_size );
+    rct->buffer_fill_final = x264_clip3f( rct->buffer_fill_final, 0, rcc->buffer_size );
 }
 
 // provisionally update VBV according to the planned size of all frames currently in progress
@@ -1558,10 +1642,11 @@ static float rate_estimate_qscale( x264_t *h )
             {
                 int i_frame_done = h->fenc->i_frame + 1 - h->param.i_threads;
 
+                rebase_window( rcc );
                 q = get_qscale( h, &rce, rcc->wanted_bits_window / rcc->cplxr_sum, h->fenc->i_frame );
 
                 // FIXME is it simpler to keep track of wanted_bits in ratecontrol_end?
-                wanted_bits = i_frame_done * rcc->bitrate / rcc->fps;
+                wanted_bits = i_frame_done * rcc->bitrate / rcc->fps + rcc->wanted_bits_offset;
                 if( wanted_bits > 0 )
                 {
                     abr_buffer *= X264_MAX( 1, sqrt(i_frame_done/25) );
@@ -1633,6 +1718,16 @@ void x264_thread_sync_ratecontrol( x264_t *cur, x264_t *prev, x264_t *next )
         COPY(short_term_cplxcount);
         COPY(bframes);
         COPY(prev_zone);
+        /* and these by x264_ratecontrol_reconfig() */
+        COPY(bitrate);
+        COPY(fps);
+        COPY(qp_constant);
+        COPY(rate_factor_constant);
+        COPY(wanted_bits_offset);
+        COPY(buffer_rate);
+        COPY(buffer_size);
+        COPY(cbr_decay);
+        COPY(b_vbv_min_rate);
 #undef COPY
     }
     if( cur != next )
@@ -1645,6 +1740,7 @@ void x264_thread_sync_ratecontrol( x264_t *cur, x264_t *prev, x264_t *next )
         COPY(cplxr_sum);
         COPY(expected_bits_sum);
         COPY(wanted_bits_window);
+        COPY(window_rate);
         COPY(bframe_bits);
 #undef COPY
     }
@@ -26,6 +26,8 @@
 
 int  x264_ratecontrol_new   ( x264_t * );
 void x264_ratecontrol_delete( x264_t * );
+void x264_ratecontrol_reconfig( x264_t * );
+int  x264_encoder_reconfig_zone( x264_t *, x264_param_t * ); /* in encoder.c */
 
 void x264_adaptive_quant_frame( x264_t *h, x264_frame_t *frame );
 void x264_adaptive_quant( x264_t * );
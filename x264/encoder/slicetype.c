@@ -574,6 +574,46 @@ no_b_frames:
     }
 }
 
+/* Whether h->fenc, a P-frame, shows the same picture as the last frame coded
+ * in full: if so it can be coded as all P_SKIP, which copies its reference.
+ * Compared against that frame rather than the reference, so that a slow
+ * change can't creep in a little at a time. */
+int x264_slicetype_static( x264_t *h )
+{
+    const int i_stride = h->fenc->i_stride_lowres;
+    const int i_thresh = h->param.analyse.f_static_thresh * 64;
+    uint8_t *coded = h->frames.lowres_coded;
+    int x, y;
+
+    if( i_thresh <= 0 || !h->frames.b_lowres_coded )
+        return 0;
+
+    /* each MB is an 8x8 block at half resolution */
+    for( y = 0; y < h->sps->i_mb_height; y++ )
+        for( x = 0; x < h->sps->i_mb_width; x++ )
+        {
+            int i_sad = h->pixf.sad[PIXEL_8x8]( &h->fenc->lowres[0][8*(x + y*i_stride)], i_stride,
+                                                &coded[8*(x + y*h->fenc->i_width_lowres)], h->fenc->i_width_lowres );
+            if( i_sad > i_thresh )
+                return 0;
+        }
+    return 1;
+}
+
+/* After h->fenc, an I/P-frame, has been found not static: keep its half-res
+ * luma to compare those that follow with */
+void x264_slicetype_static_update( x264_t *h )
+{
+    int y;
+
+    h->frames.b_lowres_coded = h->param.analyse.f_static_thresh > 0;
+    if( !h->frames.b_lowres_coded )
+        return;
+    for( y = 0; y < h->fenc->i_lines_lowres; y++ )
+        memcpy( &h->frames.lowres_coded[y*h->fenc->i_width_lowres],
+                &h->fenc->lowres[0][y*h->fenc->i_stride_lowres], h->fenc->i_width_lowres );
+}
+
 void x264_slicetype_decide( x264_t *h )
 {
     x264_frame_t *frm;
@@ -115,7 +115,8 @@ static const char * const x264_colmatrix_names[] = { "GBR", "bt709", "undef", ""
 #define X264_CSP_RGB            0x0006  /* rgb 24bits       */
 #define X264_CSP_BGR            0x0007  /* bgr 24bits       */
 #define X264_CSP_BGRA           0x0008  /* bgr 32bits       */
-#define X264_CSP_MAX            0x0009  /* end of list */
+#define X264_CSP_NV12           0x0009  /* yuv 4:2:0, with one y plane and one packed u+v */
+#define X264_CSP_MAX            0x000a  /* end of list */
 #define X264_CSP_VFLIP          0x1000  /* */
 
 /* Slice type
@@ -241,6 +242,9 @@ typedef struct x264_param_t
         int          i_trellis;  /* trellis RD quantization */
         int          b_fast_pskip; /* early SKIP detection on P-frames */
         int          b_dct_decimate; /* transform coefficient thresholding on P-frames */
+        float        f_static_thresh; /* code a P-frame as all P_SKIP, with no ME, if no MB's half-res luma
+                                       * differs from the last frame coded in full by more than this (mean
+                                       * absolute difference per pixel). 0 = off */
         int          i_noise_reduction; /* adaptive pseudo-deadzone */
         float        f_psy_rd; /* Psy RD strength */
         float        f_psy_trellis; /* Psy trellis strength */
@@ -353,13 +357,17 @@ typedef struct
     int     i_qpplus1;
     /* In: user pts, Out: pts of encoded picture (user)*/
     int64_t i_pts; /* ʾʱ */
+    /* Out: coded as an unchanged picture (all P_SKIP), see analyse.f_static_thresh */
+    int     b_static;
 
     /* In: raw data */
     x264_image_t img;
 } x264_picture_t;
 
 /* x264_picture_alloc:
- *  alloc data for a picture. You must call x264_picture_clean on it. */
+ *  alloc data for a picture. You must call x264_picture_clean on it.
+ *  i_csp may be I420/YV12, NV12 or YUYV; the encoder takes all of them as
+ *  input, NV12 and YUYV converted to i420 as it copies them in. */
 void x264_picture_alloc( x264_picture_t *pic, int i_csp, int i_width, int i_height );
 
 /* x264_picture_clean:
@@ -417,8 +425,13 @@ int x264_nal_encode( void *, int *, int b_annexeb, x264_nal_t *nal );
  *      create a new encoder handler, all parameters from x264_param_t are copied */
 x264_t *x264_encoder_open   ( x264_param_t * );
 /* x264_encoder_reconfig:
- *      change encoder options while encoding,
- *      analysis-related parameters from x264_param_t are copied */
+ *      change encoder options while encoding, from the next frame on.
+ *      analysis-related parameters from x264_param_t are copied, and so are
+ *      keyint and adaptive B-frame decisions, the frame rate, and the
+ *      bitrate, VBV size, rate factor or QP of the ratecontrol method in use
+ *      (VBV can't be turned on or off, nor 2-pass settings changed).
+ *      The parameters are validated at once: returns < 0, and leaves the
+ *      encoder as it was, if they are rejected */
 int     x264_encoder_reconfig( x264_t *, x264_param_t * );
 /* x264_encoder_headers:
  *      return the SPS and PPS that will be used for the whole stream */